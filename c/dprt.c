@@ -11,10 +11,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "fitsio.h"
 #include "dprt_jni_general.h"
 #include "ccd_dprt.h"
 #include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_config.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_buffer_pool.h"
+#include "dprt_fits.h"
+#include "dprt_job.h"
+#include "dprt_batch.h"
+#include "dprt_master.h"
+#include "dprt_accumulate.h"
+#include "dprt_calibration.h"
+#include "dprt_overscan.h"
+#include "dprt_histogram.h"
+#include "dprt_source.h"
+#include "dprt_focus.h"
+#include "dprt_spectrum.h"
+#include "dprt_trace.h"
+#include "dprt_arc.h"
+#include "dprt_mask.h"
 
 /* ------------------------------------------------------- */
 /* hash definitions */
@@ -28,6 +49,31 @@
  */
 #define FITS_GET_DATA_NAXIS		(2)
 
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure passed as the user data of a batch of fake reductions (DpRt_Batch_Run).
+ * <dl>
+ * <dt>Context</dt> <dd>The context the batch is running in.</dd>
+ * <dt>Input_Filename_List</dt> <dd>The list of FITS filenames in the batch.</dd>
+ * <dt>Calibrate_Result_List</dt> <dd>The list of results, for calibration batches.</dd>
+ * <dt>Expose_Result_List</dt> <dd>The list of results, for exposure batches.</dd>
+ * <dt>Image_List</dt> <dd>The image data read into each batch slot.</dd>
+ * <dt>Telfocus_List</dt> <dd>The TELFOCUS value read into each batch slot (exposure batches).</dd>
+ * </dl>
+ * @see dprt_batch.html#DPRT_BATCH_MAX_DEPTH
+ */
+struct Batch_Reduce_Struct
+{
+	DpRt_Context *Context;
+	char **Input_Filename_List;
+	struct DpRt_Calibrate_Reduce_Result_Struct *Calibrate_Result_List;
+	struct DpRt_Expose_Reduce_Result_Struct *Expose_Result_List;
+	struct DpRt_Fits_Image_Struct Image_List[DPRT_BATCH_MAX_DEPTH];
+	double Telfocus_List[DPRT_BATCH_MAX_DEPTH];
+};
+
 /* ------------------------------------------------------- */
 /* internal variables */
 /* ------------------------------------------------------- */
@@ -35,13 +81,77 @@
  * Revision Control System identifier.
  */
 static char rcsid[] = "$Id: dprt.c,v 1.1 2014-09-03 14:07:35 cjm Exp $";
+/**
+ * Mutex serialising calls into the real reduction pipeline (dprt_process etc.), which keeps it's state
+ * (including dprt_err_int/dprt_err_str) in globals, so reductions in different contexts don't interleave in it.
+ */
+static pthread_mutex_t Real_Pipeline_Mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* ------------------------------------------------------- */
 /* internal function declarations */
 /* ------------------------------------------------------- */
-static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts);
-static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double *seeing,double *counts,
-	double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+static int Initialise(void);
+static int Initialise_Start(void);
+static void Initialise_Tear_Down(void);
+static int Shutdown(void);
+static void Reduce_Clear_Default_Abort(DpRt_Context *context);
+static int Calibrate_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,double *mean_counts,
+			    double *peak_counts);
+static int Expose_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,double *seeing,
+			 double *counts,double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,
+			 int *saturated);
+static int Calibrate_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+				   int naxis_one,int naxis_two,double bzero,char **output_filename,
+				   double *mean_counts,double *peak_counts);
+static int Expose_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+				int naxis_one,int naxis_two,double bzero,double telfocus,char **output_filename,
+				double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+				double *sky_brightness,int *saturated);
+static int Make_Master_Bias(char *directory_name);
+static int Make_Master_Flat(char *directory_name);
+static int Calibrate_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+				  struct DpRt_Calibrate_Reduce_Result_Struct *result_list);
+static int Expose_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+			       struct DpRt_Expose_Reduce_Result_Struct *result_list);
+static int Calibrate_Reduce_Batch_Read(int index,int slot,void *user_data);
+static void Calibrate_Reduce_Batch_Process(int index,int slot,int read_retval,void *user_data);
+static int Expose_Reduce_Batch_Read(int index,int slot,void *user_data);
+static void Expose_Reduce_Batch_Process(int index,int slot,int read_retval,void *user_data);
+static int Batch_Reduce_Result(int successful,int error_number,char *error_string);
+static int Calibrate_Reduce_Fake(DpRt_Context *context,char *input_filename,char **output_filename,
+				 double *mean_counts,double *peak_counts);
+static int Calibrate_Reduce_Fake_Read(char *input_filename,struct DpRt_Fits_Image_Struct *image);
+static int Calibrate_Reduce_Fake_Accumulate(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					    struct DpRt_Stats_Struct *stats);
+static int Calibrate_Reduce_Fake_Arc(DpRt_Context *context,char *input_filename,struct DpRt_Fits_Image_Struct *image);
+static int Calibrate_Reduce_Fake_Process(DpRt_Context *context,char *input_filename,
+					 struct DpRt_Fits_Image_Struct *image,char **output_filename,
+					 double *mean_counts,double *peak_counts);
+static int Expose_Reduce_Is_Native(int *native);
+static int Expose_Reduce_Fake(DpRt_Context *context,char *input_filename,char **output_filename,double *seeing,
+	double *counts,double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+static int Expose_Reduce_Fake_Read(char *input_filename,struct DpRt_Fits_Image_Struct *image,double *telfocus);
+static int Reduce_Fake_Get_Mask(struct DpRt_Fits_Image_Struct *image,unsigned long long **mask);
+static int Expose_Reduce_Fake_Get_Calibration(struct DpRt_Fits_Image_Struct *image,float **bias,float **flat,
+					      unsigned long long **mask);
+static int Expose_Reduce_Fake_Sky_Brightness(char *input_filename,struct DpRt_Histogram_Struct *histogram,
+					     double exposure_length,int saturation_level,double *sky,double *sky_sigma,
+					     double *sky_brightness);
+static int Expose_Reduce_Fake_Find_Sources(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					   struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,
+					   unsigned long long *mask,double sky,double sky_sigma,int saturation_level,
+					   struct DpRt_Source_Struct *source_list,int *source_count,
+					   struct DpRt_Source_Peak_Struct *peak,double *seeing);
+static int Expose_Reduce_Fake_Extract_Spectrum(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					       struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,
+					       unsigned long long *mask,
+					       struct DpRt_Spectrum_Parameter_Struct *parameters,
+					       unsigned long long *row_sum_list,double *profile_list,double *flux_list,
+					       double *sky_list,struct DpRt_Spectrum_Struct *spectrum);
+static int Expose_Reduce_Fake_Process(DpRt_Context *context,char *input_filename,
+				      struct DpRt_Fits_Image_Struct *image,double telfocus,char **output_filename,
+				      double *seeing,double *counts,double *x_pix,double *y_pix,
+				      double *photometricity,double *sky_brightness,int *saturated);
 
 /* ------------------------------------------------------- */
 /* external functions */
@@ -52,30 +162,684 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
  * The function pointers to use a C routine to load the property from the config file are initialised.
  * Note these function pointers will be over-written by the functions in DpRtLibrary.c if this
  * initialise routine was called from the Java (JNI) layer.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_General_Initialise
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ * The configuration snapshot is then loaded, so the reduction routines do not have to retrieve properties
+ * (via the Java layer) on every call, the statistics kernel is selected, the reduction worker threads
+ * are started, the frame buffer pool is created and the asynchronous job threads are started.
+ * The initialisation is done in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see #Initialise
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ * @see dprt_config.html#DpRt_Config_Load
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_stats.html#DpRt_Stats_Initialise
+ * @see dprt_reduce.html#DpRt_Reduce_Initialise
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Initialise
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Initialise
+ * @see dprt_job.html#DpRt_Job_Initialise
  * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_set_path
  * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_init
  */
 int DpRt_Initialise(void)
 {
-	char *pathname = NULL;
-	int retval,fake;
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	previous_context = DpRt_Context_Enter(NULL);
+	retval = Initialise();
+	DpRt_Context_Leave(NULL,previous_context);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * This finction should be called when the library/DpRt is about to be shutdown.
+ * Any asynchronous jobs are finished or cancelled, the reduction worker threads are stopped, the frame buffer pool
+ * is freed, and the configuration snapshot is freed.
+ * The shutdown is done in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @see #Shutdown
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ * @see dprt_config.html#DpRt_Config_Free
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Shutdown
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Shutdown
+ * @see dprt_job.html#DpRt_Job_Shutdown
+ * @see ../../ccd_imager/cdocs/.html#dprt_close_down
+ */
+int DpRt_Shutdown(void)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	previous_context = DpRt_Context_Enter(NULL);
+	retval = Shutdown();
+	DpRt_Context_Leave(NULL,previous_context);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * This routine re-loads the configuration snapshot used by the reduction routines. It should be called
+ * when the dprt.* configuration properties have been changed, as the reduction routines do not otherwise
+ * re-read them after DpRt_Initialise.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed. On failure the previous
+ *       snapshot is retained.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_config.html#DpRt_Config_Load
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Reload_Config(void)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	previous_context = DpRt_Context_Enter(NULL);
+	fprintf(stdout,"DpRt_Reload_Config:Re-loading configuration snapshot.\n");
+	retval = DpRt_Config_Load();
+	DpRt_Context_Leave(NULL,previous_context);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * This routine does the real time data reduction pipeline on a calibration file. It is usually invoked from the
+ * Java DpRtCalibrateReduce call in DpRtLibrary.java. If the DpRt_JNI_Get_Abort
+ * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
+ * current operation and return FALSE.
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param meanCounts The address of a double to store the mean counts calculated by this routine.
+ * @param peakCounts The address of a double to store the peak counts calculated by this routine.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see ngat_dprt_ccs_DpRtLibrary.html
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see #Calibrate_Reduce_Fake
+ * @see ../../ccd_imager/cdocs/.html#dprt_process
+ * @see #DpRt_Context_Calibrate_Reduce
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts)
+{
+	int retval;
+
+	retval = DpRt_Context_Calibrate_Reduce(NULL,input_filename,output_filename,mean_counts,peak_counts);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Calibrate_Reduce, but running in the specified context rather than the default one.
+ * Reductions in different contexts can run at the same time, from different threads. If the routine fails,
+ * the error can be retrieved with DpRt_Context_Get_Error_Number and DpRt_Context_Get_Error_String.
+ * Only the default context's abort flag is cleared when the reduction starts (see Reduce_Clear_Default_Abort),
+ * the abort flag of any other context must be cleared by the caller with DpRt_Context_Set_Abort beforehand.
+ * @param context The context to run in, or NULL for the default context.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param meanCounts The address of a double to store the mean counts calculated by this routine.
+ * @param peakCounts The address of a double to store the peak counts calculated by this routine.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Calibrate_Reduce
+ * @see #Calibrate_Reduce
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Calibrate_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,
+				  double *mean_counts,double *peak_counts)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Calibrate_Reduce(context,input_filename,output_filename,mean_counts,peak_counts);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * This routine does the real time data reduction pipeline on an expose file. It is usually invoked from the
+ * Java DpRtExposeReduce call in DpRtLibrary.java. If the <a href="#DpRt_Get_Abort">DpRt_Get_Abort</a>
+ * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
+ * current operation and return FALSE.
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param seeing The address of a double to store the seeing calculated by this routine.
+ * @param counts The address of a double to store the counts of th brightest pixel calculated by this
+ *       routine.
+ * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
+ * 	reductions.
+ * @param sky_brightness In units of magnitudes per arcsec&#178;. This is an estimate of sky brightness.
+ * @param saturated This is a boolean, returning TRUE if the object is saturated.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see ngat_dprt_ccs_DpRtLibrary.html
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see #Expose_Reduce_Fake
+ * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
+ * @see #DpRt_Context_Expose_Reduce
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
+		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+{
+	int retval;
+
+	retval = DpRt_Context_Expose_Reduce(NULL,input_filename,output_filename,seeing,counts,x_pix,y_pix,
+					    photometricity,sky_brightness,saturated);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Expose_Reduce, but running in the specified context rather than the default one.
+ * Reductions in different contexts can run at the same time, from different threads. If the routine fails,
+ * the error can be retrieved with DpRt_Context_Get_Error_Number and DpRt_Context_Get_Error_String.
+ * Only the default context's abort flag is cleared when the reduction starts (see Reduce_Clear_Default_Abort),
+ * the abort flag of any other context must be cleared by the caller with DpRt_Context_Set_Abort beforehand.
+ * @param context The context to run in, or NULL for the default context.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param seeing The address of a double to store the seeing calculated by this routine.
+ * @param counts The address of a double to store the counts of th brightest pixel calculated by this
+ *       routine.
+ * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
+ * 	reductions.
+ * @param sky_brightness In units of magnitudes per arcsec&#178;. This is an estimate of sky brightness.
+ * @param saturated This is a boolean, returning TRUE if the object is saturated.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Expose_Reduce
+ * @see #Expose_Reduce
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Expose_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,double *seeing,
+			       double *counts,double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,
+			       int *saturated)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Expose_Reduce(context,input_filename,output_filename,seeing,counts,x_pix,y_pix,photometricity,
+			       sky_brightness,saturated);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * Reduce a batch of calibration frames. The FITS file open/read of each frame is overlapped with the
+ * statistics of the previous one, using a small ring of frame buffers (dprt.batch.depth, two by default).
+ * Each frame's result (including it's own error number and string) is put in the corresponding
+ * element of result_list. The routine runs in the default context, and any error is copied to
+ * DpRt_JNI_Error_Number/String.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ *        The caller should free each non-NULL Output_Filename.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed,
+ *         in which case the error number/string are those of the first failure.
+ * @see #DpRt_Context_Calibrate_Reduce_Batch
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Calibrate_Reduce_Batch(char **input_filename_list,int input_filename_count,
+				struct DpRt_Calibrate_Reduce_Result_Struct *result_list)
+{
+	int retval;
+
+	retval = DpRt_Context_Calibrate_Reduce_Batch(NULL,input_filename_list,input_filename_count,result_list);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Calibrate_Reduce_Batch, but running in the specified context rather than the default one.
+ * @param context The context to run in, or NULL for the default context.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed.
+ * @see #DpRt_Calibrate_Reduce_Batch
+ * @see #Calibrate_Reduce_Batch
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Calibrate_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+					struct DpRt_Calibrate_Reduce_Result_Struct *result_list)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Calibrate_Reduce_Batch(context,input_filename_list,input_filename_count,result_list);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * Reduce a batch of exposure frames. The FITS file open/read of each frame is overlapped with the
+ * statistics of the previous one, using a small ring of frame buffers (dprt.batch.depth, two by default).
+ * Each frame's result (including it's own error number and string) is put in the corresponding
+ * element of result_list. The routine runs in the default context, and any error is copied to
+ * DpRt_JNI_Error_Number/String.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ *        The caller should free each non-NULL Output_Filename.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed,
+ *         in which case the error number/string are those of the first failure.
+ * @see #DpRt_Context_Expose_Reduce_Batch
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Expose_Reduce_Batch(char **input_filename_list,int input_filename_count,
+			     struct DpRt_Expose_Reduce_Result_Struct *result_list)
+{
+	int retval;
+
+	retval = DpRt_Context_Expose_Reduce_Batch(NULL,input_filename_list,input_filename_count,result_list);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Expose_Reduce_Batch, but running in the specified context rather than the default one.
+ * @param context The context to run in, or NULL for the default context.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed.
+ * @see #DpRt_Expose_Reduce_Batch
+ * @see #Expose_Reduce_Batch
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Expose_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+				     struct DpRt_Expose_Reduce_Result_Struct *result_list)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Expose_Reduce_Batch(context,input_filename_list,input_filename_count,result_list);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * Reduce a calibration frame held in memory, rather than in a FITS file, for instance the pixels of a frame
+ * the camera has just read out but not yet saved. The same statistics as DpRt_Calibrate_Reduce are computed,
+ * directly on the caller's data (it is not copied). Only the fake pipeline supports in-memory reductions.
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param frame_name The name of the frame, usually the FITS filename it will be saved as. This is used
+ *        in messages, and returned as the output filename.
+ * @param data The pixel data, of naxis_one*naxis_two 16-bit pixels in row-major order.
+ * @param data_length The length of data in bytes.
+ * @param naxis_one The number of columns in the frame (NAXIS1).
+ * @param naxis_two The number of rows in the frame (NAXIS2).
+ * @param bzero The BZERO of the data: 32768 for big-endian FITS encoded pixels, or 0 for unsigned pixels in host
+ *        byte order.
+ * @param output_filename The address of a pointer to store the (allocated) output filename.
+ * @param mean_counts The address of a double to store the mean counts calculated by this routine.
+ * @param peak_counts The address of a double to store the peak counts calculated by this routine.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Calibrate_Reduce_Buffer
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Calibrate_Reduce_Buffer(char *frame_name,void *data,size_t data_length,int naxis_one,int naxis_two,
+				 double bzero,char **output_filename,double *mean_counts,double *peak_counts)
+{
+	int retval;
+
+	retval = DpRt_Context_Calibrate_Reduce_Buffer(NULL,frame_name,data,data_length,naxis_one,naxis_two,bzero,
+						      output_filename,mean_counts,peak_counts);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Calibrate_Reduce_Buffer, but running in the specified context rather than the default one.
+ * @param context The context to run in, or NULL for the default context.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Calibrate_Reduce_Buffer
+ * @see #Calibrate_Reduce_Buffer
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Calibrate_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+					 int naxis_one,int naxis_two,double bzero,char **output_filename,
+					 double *mean_counts,double *peak_counts)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Calibrate_Reduce_Buffer(context,frame_name,data,data_length,naxis_one,naxis_two,bzero,
+					 output_filename,mean_counts,peak_counts);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * Reduce an exposure frame held in memory, rather than in a FITS file. The same statistics as DpRt_Expose_Reduce
+ * are computed, directly on the caller's data (it is not copied). The header values the reduction needs
+ * are passed in. Only the fake pipeline supports in-memory reductions.
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param frame_name The name of the frame, usually the FITS filename it will be saved as. This is used
+ *        in messages, and returned as the output filename.
+ * @param data The pixel data, of naxis_one*naxis_two 16-bit pixels in row-major order.
+ * @param data_length The length of data in bytes.
+ * @param naxis_one The number of columns in the frame (NAXIS1).
+ * @param naxis_two The number of rows in the frame (NAXIS2).
+ * @param bzero The BZERO of the data: 32768 for big-endian FITS encoded pixels, or 0 for unsigned pixels in host
+ *        byte order.
+ * @param telfocus The telescope focus the frame was taken at (the TELFOCUS keyword value).
+ * @param output_filename The address of a pointer to store the (allocated) output filename.
+ * @param seeing The address of a double to store the seeing calculated by this routine.
+ * @param counts The address of a double to store the counts of the brightest pixel.
+ * @param x_pix The address of a double to store the x pixel position of the brightest object.
+ * @param y_pix The address of a double to store the y pixel position of the brightest object.
+ * @param photometricity The address of a double to store the photometricity.
+ * @param sky_brightness The address of a double to store the sky brightness.
+ * @param saturated The address of an integer to store whether the brightest object is saturated.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Expose_Reduce_Buffer
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Expose_Reduce_Buffer(char *frame_name,void *data,size_t data_length,int naxis_one,int naxis_two,
+			      double bzero,double telfocus,char **output_filename,double *seeing,double *counts,
+			      double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+{
+	int retval;
+
+	retval = DpRt_Context_Expose_Reduce_Buffer(NULL,frame_name,data,data_length,naxis_one,naxis_two,bzero,telfocus,
+						   output_filename,seeing,counts,x_pix,y_pix,photometricity,
+						   sky_brightness,saturated);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Expose_Reduce_Buffer, but running in the specified context rather than the default one.
+ * @param context The context to run in, or NULL for the default context.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Expose_Reduce_Buffer
+ * @see #Expose_Reduce_Buffer
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Expose_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+				      int naxis_one,int naxis_two,double bzero,double telfocus,char **output_filename,
+				      double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+				      double *sky_brightness,int *saturated)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Expose_Reduce_Buffer(context,frame_name,data,data_length,naxis_one,naxis_two,bzero,telfocus,
+				      output_filename,seeing,counts,x_pix,y_pix,photometricity,sky_brightness,saturated);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * This routine creates a master bias frame for each binning factor, created from biases in the specified
+ * directory
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
+ * @see ../../ccd_imager/cdocs/ccd_dprt.html#MAKE_BIAS
+ * @see #DpRt_Context_Make_Master_Bias
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Make_Master_Bias(char *directory_name)
+{
+	int retval;
+
+	retval = DpRt_Context_Make_Master_Bias(NULL,directory_name);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
+
+/**
+ * As DpRt_Make_Master_Bias, but running in the specified context rather than the default one.
+ * Reductions in different contexts can run at the same time, from different threads. If the routine fails,
+ * the error can be retrieved with DpRt_Context_Get_Error_Number and DpRt_Context_Get_Error_String.
+ * Only the default context's abort flag is cleared when the master starts (see Reduce_Clear_Default_Abort),
+ * the abort flag of any other context must be cleared by the caller with DpRt_Context_Set_Abort beforehand.
+ * @param context The context to run in, or NULL for the default context.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Make_Master_Bias
+ * @see #Make_Master_Bias
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Make_Master_Bias(DpRt_Context *context,char *directory_name)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Make_Master_Bias(directory_name);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+/**
+ * This routine creates a master flat frame for each binning factor, created from flats in the specified
+ * directory.
+ * The routine runs in the default context, and any error is copied to DpRt_JNI_Error_Number/String.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
+ * @see ../../ccd_imager/cdocs/ccd_dprt.html#MAKE_FLAT
+ * @see #DpRt_Context_Make_Master_Flat
+ * @see dprt_context.html#DpRt_Context_Error_To_JNI
+ */
+int DpRt_Make_Master_Flat(char *directory_name)
+{
+	int retval;
 
+	retval = DpRt_Context_Make_Master_Flat(NULL,directory_name);
+	DpRt_Context_Error_To_JNI(NULL);
+	return retval;
+}
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
+/**
+ * As DpRt_Make_Master_Flat, but running in the specified context rather than the default one.
+ * Reductions in different contexts can run at the same time, from different threads. If the routine fails,
+ * the error can be retrieved with DpRt_Context_Get_Error_Number and DpRt_Context_Get_Error_String.
+ * Only the default context's abort flag is cleared when the master starts (see Reduce_Clear_Default_Abort),
+ * the abort flag of any other context must be cleared by the caller with DpRt_Context_Set_Abort beforehand.
+ * @param context The context to run in, or NULL for the default context.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Make_Master_Flat
+ * @see #Make_Master_Flat
+ * @see #Reduce_Clear_Default_Abort
+ * @see dprt_context.html#DpRt_Context_Enter
+ * @see dprt_context.html#DpRt_Context_Leave
+ */
+int DpRt_Context_Make_Master_Flat(DpRt_Context *context,char *directory_name)
+{
+	DpRt_Context *previous_context = NULL;
+	int retval;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	previous_context = DpRt_Context_Enter(context);
+	Reduce_Clear_Default_Abort(context);
+	retval = Make_Master_Flat(directory_name);
+	DpRt_Context_Leave(context,previous_context);
+	return retval;
+}
+
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Clear the default context's abort flag (the JNI abort flag), ready to start a reduction, once the context has
+ * been entered. Only the default context is cleared here: the abort flag of any other context is cleared by it's
+ * owner before it starts the reduction (the job threads clear it whilst claiming a job, under the job mutex), so an
+ * abort (or job cancel) made after the reduction has been started is never lost.
+ * @param context The context that has been entered.
+ * @see dprt_context.html#DpRt_Context_Get_Default
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ */
+static void Reduce_Clear_Default_Abort(DpRt_Context *context)
+{
+	if(context == DpRt_Context_Get_Default())
+		DpRt_Context_Set_Abort(context,FALSE);
+}
+
+/**
+ * Initialise the library, called from DpRt_Initialise in the default context.
+ * If any start-up step fails, the parts of the library already started are torn down again.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Initialise
+ * @see #Initialise_Start
+ * @see #Initialise_Tear_Down
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Initialise
+ * @see dprt_context.html#DpRt_Context_Error_From_JNI
+ */
+static int Initialise(void)
+{
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
 	if(!DpRt_JNI_Initialise())
+	{
+		DpRt_Context_Error_From_JNI();
+		return FALSE;
+	}
+	if(!Initialise_Start())
+	{
+		Initialise_Tear_Down();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Start the library, once the JNI layer is initialised: load the configuration snapshot, select the statistics
+ * kernel, start the reduction worker threads, create the frame buffer pool, start the asynchronous job threads
+ * and initialise the real pipeline (if it is in use).
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Initialise
+ */
+static int Initialise_Start(void)
+{
+	char *pathname = NULL;
+	char *kernel_name = NULL;
+	int retval,fake,thread_count,band_rows,buffer_pool_max_mbytes,buffer_pool_huge_pages,job_thread_count;
+
+/* load the configuration snapshot used by the reduction routines */
+	if(!DpRt_Config_Load())
+		return FALSE;
+/* select the statistics kernel */
+	if(!DpRt_Config_Get_String("dprt.stats.kernel",&kernel_name))
+		return FALSE;
+	retval = DpRt_Stats_Initialise(kernel_name);
+	if(kernel_name != NULL)
+		free(kernel_name);
+	if(retval == FALSE)
+		return FALSE;
+/* start the reduction worker threads */
+	if(!DpRt_Config_Get_Integer("dprt.threads",&thread_count))
+		return FALSE;
+	if(!DpRt_Config_Get_Integer("dprt.reduce.band_rows",&band_rows))
+		return FALSE;
+	if(!DpRt_Reduce_Initialise(band_rows))
+		return FALSE;
+	if(!DpRt_Thread_Pool_Initialise(thread_count))
+		return FALSE;
+/* create the frame buffer pool */
+	if(!DpRt_Config_Get_Integer("dprt.buffer_pool.max_mbytes",&buffer_pool_max_mbytes))
+		return FALSE;
+	if(!DpRt_Config_Get_Boolean("dprt.buffer_pool.huge_pages",&buffer_pool_huge_pages))
+		return FALSE;
+	if(!DpRt_Buffer_Pool_Initialise(((size_t)buffer_pool_max_mbytes)*1024*1024,buffer_pool_huge_pages))
+		return FALSE;
+/* start the asynchronous job threads */
+	if(!DpRt_Config_Get_Integer("dprt.job.threads",&job_thread_count))
+		return FALSE;
+	if(!DpRt_Job_Initialise(job_thread_count))
 		return FALSE;
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Initialise:Fake:%d\n",fake);
 	if(fake == FALSE)
 	{
 		/* sort out libdprt pathname */
-		if(!DpRt_JNI_Get_Property("dprt.path",&pathname))
+		if(!DpRt_Config_Get_String("dprt.path",&pathname))
 			return FALSE;
 		fprintf(stdout,"Calling DpRt set path routine (dprt_set_path(%s)).\n",pathname);
 		retval = dprt_set_path(pathname);
@@ -83,8 +847,8 @@ int DpRt_Initialise(void)
 		{
 			if(pathname != NULL)
 				free(pathname);
-			DpRt_JNI_Error_Number = dprt_err_int;
-			strcpy(DpRt_JNI_Error_String,dprt_err_str);
+			DpRt_Error_Number = dprt_err_int;
+			strcpy(DpRt_Error_String,dprt_err_str);
 			return FALSE;
 		}
 		if(pathname != NULL)
@@ -95,8 +859,8 @@ int DpRt_Initialise(void)
 		fprintf(stdout,"DpRt initialisation routine (dprt_init) returned %d.\n",retval);
 		if(retval == TRUE)
 		{
-			DpRt_JNI_Error_Number = dprt_err_int;
-			strcpy(DpRt_JNI_Error_String,dprt_err_str);
+			DpRt_Error_Number = dprt_err_int;
+			strcpy(DpRt_Error_String,dprt_err_str);
 			return FALSE;
 		}
 	}
@@ -104,73 +868,99 @@ int DpRt_Initialise(void)
 }
 
 /**
- * This finction should be called when the library/DpRt is about to be shutdown.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../ccd_imager/cdocs/.html#dprt_close_down
+ * Tear down the parts of the library started by Initialise_Start, after a later start-up step failed, as
+ * Shutdown does: the job threads and reduction worker threads are stopped, and the frame buffer pool and
+ * configuration snapshot are freed. Each part is left alone if it was never started, and the start-up error is kept.
+ * @see #Initialise
+ * @see #Shutdown
+ * @see dprt_job.html#DpRt_Job_Shutdown
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Shutdown
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Shutdown
+ * @see dprt_config.html#DpRt_Config_Free
  */
-int DpRt_Shutdown(void)
+static void Initialise_Tear_Down(void)
+{
+	char error_string[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	int error_number;
+
+	error_number = DpRt_Error_Number;
+	strcpy(error_string,DpRt_Error_String);
+	DpRt_Job_Shutdown();
+	DpRt_Thread_Pool_Shutdown();
+	DpRt_Buffer_Pool_Shutdown();
+	DpRt_Config_Free();
+	DpRt_Error_Number = error_number;
+	strcpy(DpRt_Error_String,error_string);
+}
+
+/**
+ * Shutdown the library, called from DpRt_Shutdown in the default context.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Shutdown
+ */
+static int Shutdown(void)
 {
 	int retval,fake;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+/* finish or cancel any asynchronous jobs, before the pipeline is closed down */
+	DpRt_Job_Shutdown();
+	DpRt_Accumulate_Shutdown();
+	DpRt_Calibration_Cache_Shutdown();
+	DpRt_Focus_Shutdown();
+	DpRt_Trace_Shutdown();
+	DpRt_Arc_Shutdown();
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Shutdown:Fake:%d\n",fake);
 	if(fake == FALSE)
 	{
 		fprintf(stdout,"Calling DpRt shutdown routine (dprt_close_down).\n");
+		pthread_mutex_lock(&Real_Pipeline_Mutex);
 		retval = dprt_close_down();
 		fprintf(stdout,"DpRt shutdown routine (dprt_lose_down) returned %d.\n",retval);
 		if(retval != TRUE)
 		{
-			DpRt_JNI_Error_Number = dprt_err_int;
-			strcpy(DpRt_JNI_Error_String,dprt_err_str);
+			DpRt_Error_Number = dprt_err_int;
+			strcpy(DpRt_Error_String,dprt_err_str);
+			pthread_mutex_unlock(&Real_Pipeline_Mutex);
 			return FALSE;
 		}
+		pthread_mutex_unlock(&Real_Pipeline_Mutex);
 	}
+	DpRt_Thread_Pool_Shutdown();
+	DpRt_Buffer_Pool_Shutdown();
+	DpRt_Config_Free();
 	return TRUE;
 }
 
 /**
- * This routine does the real time data reduction pipeline on a calibration file. It is usually invoked from the
- * Java DpRtCalibrateReduce call in DpRtLibrary.java. If the DpRt_JNI_Get_Abort
- * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
- * current operation and return FALSE.
- * @param input_filename The FITS filename to be processed.
- * @param output_filename The resultant filename should be put in this variable. This variable is the
- *       address of a pointer to a sequence of characters, hence it should be referenced using
- *       <code>(*output_filename)</code> in this routine.
- * @param meanCounts The address of a double to store the mean counts calculated by this routine.
- * @param peakCounts The address of a double to store the peak counts calculated by this routine.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ngat_dprt_ccs_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ * Internal routine for DpRt_Context_Calibrate_Reduce, called once the context has been entered.
+ * @param context The context the routine is running in.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Calibrate_Reduce
  * @see #Calibrate_Reduce_Fake
- * @see ../../ccd_imager/cdocs/.html#dprt_process
+ * @see #Real_Pipeline_Mutex
  */
-int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts)
+static int Calibrate_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,double *mean_counts,
+			    double *peak_counts)
 {
 	int fake,retval;
 	float l1mean,l1seeing,l1xpix,l1ypix,l1counts,l1photom,l1skybright;
 	int l1sat,run_mode,full_reduction;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Calibrate_Reduce:Fake:%d\n",fake);
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.full_reduction",&full_reduction))
+	if(!DpRt_Config_Get_Boolean("dprt.full_reduction",&full_reduction))
 		return FALSE;
 	fprintf(stdout,"DpRt_Calibrate_Reduce:Full Reduction Flag:%d\n",full_reduction);
 	if(fake)
 	{
-		return Calibrate_Reduce_Fake(input_filename,output_filename,mean_counts,peak_counts);
+		return Calibrate_Reduce_Fake(context,input_filename,output_filename,mean_counts,peak_counts);
 	}
 	else
 	{
@@ -182,6 +972,7 @@ int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *me
 			run_mode = QUICK_REDUCTION;
 		fprintf(stdout,"DpRt_Calibrate_Reduce:Calling Calibration reduction routine (dprt_process(%d)).\n",
 			run_mode);
+		pthread_mutex_lock(&Real_Pipeline_Mutex);
 		retval = dprt_process(input_filename,run_mode,output_filename,&l1mean,&l1seeing, 
 			&l1xpix,&l1ypix,&l1counts,&l1sat,&l1photom,&l1skybright);
 		fprintf(stdout,"DpRt_Calibrate_Reduce:Calibration reduction routine (dprt_process) returned %d.\n",
@@ -189,13 +980,15 @@ int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *me
 		if(retval == TRUE)
 		/* an error has occured */
 		{
-			DpRt_JNI_Error_Number = dprt_err_int;
-			strcpy(DpRt_JNI_Error_String,dprt_err_str);
+			DpRt_Error_Number = dprt_err_int;
+			strcpy(DpRt_Error_String,dprt_err_str);
+			pthread_mutex_unlock(&Real_Pipeline_Mutex);
 			(*output_filename) = NULL;
 			(*mean_counts) = 0;
 			(*peak_counts) = 0;
 			return FALSE;
 		}
+		pthread_mutex_unlock(&Real_Pipeline_Mutex);
 		(*mean_counts) = (double)l1mean;
 		(*peak_counts) = (double)l1counts;
 	}
@@ -203,53 +996,37 @@ int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *me
 }
 
 /**
- * This routine does the real time data reduction pipeline on an expose file. It is usually invoked from the
- * Java DpRtExposeReduce call in DpRtLibrary.java. If the <a href="#DpRt_Get_Abort">DpRt_Get_Abort</a>
- * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
- * current operation and return FALSE.
- * @param input_filename The FITS filename to be processed.
- * @param output_filename The resultant filename should be put in this variable. This variable is the
- *       address of a pointer to a sequence of characters, hence it should be referenced using
- *       <code>(*output_filename)</code> in this routine.
- * @param seeing The address of a double to store the seeing calculated by this routine.
- * @param counts The address of a double to store the counts of th brightest pixel calculated by this
- *       routine.
- * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
- *       number that may not be a whole number of pixels.
- * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
- *       number that may not be a whole number of pixels.
- * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
- * 	reductions.
- * @param sky_brightness In units of magnitudes per arcsec&#178;. This is an estimate of sky brightness.
- * @param saturated This is a boolean, returning TRUE if the object is saturated.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ngat_dprt_ccs_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ * Internal routine for DpRt_Context_Expose_Reduce, called once the context has been entered.
+ * Fake and native quick-look reductions (see Expose_Reduce_Is_Native) are done by Expose_Reduce_Fake,
+ * other reductions by the real pipeline (dprt_process).
+ * @param context The context the routine is running in.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Expose_Reduce
+ * @see #Expose_Reduce_Is_Native
  * @see #Expose_Reduce_Fake
- * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
+ * @see #Real_Pipeline_Mutex
  */
-int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
-		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+static int Expose_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,double *seeing,
+			 double *counts,double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,
+			 int *saturated)
 {
-	int fake,retval;
+	int fake,native,retval;
 	float l1mean,l1seeing,l1xpix,l1ypix,l1counts,l1photom,l1skybright;
 	int l1sat,run_mode,full_reduction;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Expose_Reduce:Fake:%d\n",fake);
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.full_reduction",&full_reduction))
+	if(!DpRt_Config_Get_Boolean("dprt.full_reduction",&full_reduction))
 		return FALSE;
 	fprintf(stdout,"DpRt_Expose_Reduce:Full Reduction Flag:%d\n",full_reduction);
-	if(fake)
+	if(!Expose_Reduce_Is_Native(&native))
+		return FALSE;
+	fprintf(stdout,"DpRt_Expose_Reduce:Native:%d\n",native);
+	if(native)
 	{
-		return Expose_Reduce_Fake(input_filename,output_filename,seeing,counts,x_pix,y_pix,
+		return Expose_Reduce_Fake(context,input_filename,output_filename,seeing,counts,x_pix,y_pix,
 			photometricity,sky_brightness,saturated);
 	}
 	else
@@ -259,13 +1036,15 @@ int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seein
 		else
 			run_mode = QUICK_REDUCTION;
 		fprintf(stdout,"DpRt_Expose_Reduce:Calling Exposure reduction routine (dprt_process(%d)).\n",run_mode);
+		pthread_mutex_lock(&Real_Pipeline_Mutex);
 		retval = dprt_process(input_filename,run_mode,output_filename,&l1mean,&l1seeing, 
 			&l1xpix,&l1ypix,&l1counts,&l1sat,&l1photom,&l1skybright);
 		fprintf(stdout,"DpRt_Expose_Reduce:Exposure reduction routine (dprt_process) returned %d.\n",retval);
 		if(retval == TRUE)
 		{
-			DpRt_JNI_Error_Number = dprt_err_int;
-			strcpy(DpRt_JNI_Error_String,dprt_err_str);
+			DpRt_Error_Number = dprt_err_int;
+			strcpy(DpRt_Error_String,dprt_err_str);
+			pthread_mutex_unlock(&Real_Pipeline_Mutex);
 			(*output_filename) = NULL;
 			(*seeing) = 0.0;
 			(*counts) = 0.0;
@@ -276,6 +1055,7 @@ int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seein
 			(*saturated) = FALSE;
 			return FALSE;
 		}
+		pthread_mutex_unlock(&Real_Pipeline_Mutex);
 		(*seeing) = (double)l1seeing;
 		(*counts) = (double)l1counts;
 		(*x_pix) = (double)l1xpix;
@@ -288,52 +1068,176 @@ int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seein
 }
 
 /**
- * This routine creates a master bias frame for each binning factor, created from biases in the specified
- * directory
- * @param directory_name A directory containing the  FITS filenames to be processed.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
- * @see ../../ccd_imager/cdocs/ccd_dprt.html#MAKE_BIAS
+ * Internal routine for DpRt_Context_Calibrate_Reduce_Buffer, called once the context has been entered.
+ * The data is described with DpRt_Fits_Image_From_Buffer (without copying it), and reduced with
+ * Calibrate_Reduce_Fake_Process.
+ * @param context The context the routine is running in.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Calibrate_Reduce_Buffer
+ * @see #Calibrate_Reduce_Fake_Process
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see dprt_fits.html#DpRt_Fits_Image_From_Buffer
  */
-int DpRt_Make_Master_Bias(char *directory_name)
+static int Calibrate_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+				   int naxis_one,int naxis_two,double bzero,char **output_filename,
+				   double *mean_counts,double *peak_counts)
+{
+	struct DpRt_Fits_Image_Struct image;
+	int fake;
+
+/* set the error stuff to no error*/
+	DpRt_Error_Number = 0;
+	strcpy(DpRt_Error_String,"");
+/* setup return values */
+	(*output_filename) = NULL;
+	(*mean_counts) = 0.0;
+	(*peak_counts) = 0.0;
+	if(frame_name == NULL)
+	{
+		DpRt_Error_Number = 48;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Buffer:frame_name was NULL.\n");
+		return FALSE;
+	}
+/* the real pipeline only reduces files */
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
+		return FALSE;
+	if(!fake)
+	{
+		DpRt_Error_Number = 49;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Buffer(%.150s):In-memory reductions are only supported "
+			"by the fake pipeline.\n",frame_name);
+		return FALSE;
+	}
+	fprintf(stderr,"Calibrate_Reduce_Buffer(%s).\n",frame_name);
+	if(!DpRt_Fits_Image_From_Buffer(data,data_length,naxis_one,naxis_two,bzero,&image))
+		return FALSE;
+	return Calibrate_Reduce_Fake_Process(context,frame_name,&image,output_filename,mean_counts,peak_counts);
+}
+
+/**
+ * Internal routine for DpRt_Context_Expose_Reduce_Buffer, called once the context has been entered.
+ * The data is described with DpRt_Fits_Image_From_Buffer (without copying it), and reduced with
+ * Expose_Reduce_Fake_Process.
+ * @param context The context the routine is running in.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Expose_Reduce_Buffer
+ * @see #Expose_Reduce_Fake_Process
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see dprt_fits.html#DpRt_Fits_Image_From_Buffer
+ */
+static int Expose_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+				int naxis_one,int naxis_two,double bzero,double telfocus,char **output_filename,
+				double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+				double *sky_brightness,int *saturated)
 {
-	int fake,retval,make_master_bias;
+	struct DpRt_Fits_Image_Struct image;
+	int native;
+
+/* set the error stuff to no error*/
+	DpRt_Error_Number = 0;
+	strcpy(DpRt_Error_String,"");
+/* setup return values */
+	(*output_filename) = NULL;
+	(*seeing) = 0.0;
+	(*counts) = 0.0;
+	(*x_pix) = 0.0;
+	(*y_pix) = 0.0;
+	(*photometricity) = 0.0;
+	(*sky_brightness) = 0.0;
+	(*saturated) = FALSE;
+	if(frame_name == NULL)
+	{
+		DpRt_Error_Number = 50;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Buffer:frame_name was NULL.\n");
+		return FALSE;
+	}
+/* the real pipeline only reduces files */
+	if(!Expose_Reduce_Is_Native(&native))
+		return FALSE;
+	if(!native)
+	{
+		DpRt_Error_Number = 51;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Buffer(%.150s):In-memory reductions are only supported "
+			"by the fake and quick-look pipelines.\n",frame_name);
+		return FALSE;
+	}
+	fprintf(stderr,"Expose_Reduce_Buffer(%s).\n",frame_name);
+	if(!DpRt_Fits_Image_From_Buffer(data,data_length,naxis_one,naxis_two,bzero,&image))
+		return FALSE;
+	return Expose_Reduce_Fake_Process(context,frame_name,&image,telfocus,output_filename,seeing,counts,x_pix,
+					  y_pix,photometricity,sky_brightness,saturated);
+}
+
+/**
+ * Internal routine for DpRt_Context_Make_Master_Bias, called once the context has been entered.
+ * For fake reductions, or if dprt.master.native is TRUE, the master bias is made by the native stacking engine
+ * (DpRt_Master_Make), otherwise by the real pipeline (dprt_process). Either way, any cached master bias is
+ * invalidated, so the next exposure reduction uses the new master. A new master may also change the bad pixel
+ * mask (a native master can derive one, see DpRt_Mask_Make), so any cached mask is invalidated too.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Make_Master_Bias
+ * @see #Real_Pipeline_Mutex
+ * @see dprt_master.html#DpRt_Master_Make
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Invalidate
+ */
+static int Make_Master_Bias(char *directory_name)
+{
+	int fake,native,retval,make_master_bias;
 	float l1mean,l1seeing,l1xpix,l1ypix,l1counts,l1photom,l1skybright;
 	int l1sat;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Make_Master_Bias:Fake:%d\n",fake);
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.make_master_bias",&make_master_bias))
+	if(!DpRt_Config_Get_Boolean("dprt.make_master_bias",&make_master_bias))
 		return FALSE;
 	fprintf(stdout,"DpRt_Make_Master_Bias:Make Master Bias Flag:%d\n",make_master_bias);
-	if(fake)
+	if(!DpRt_Config_Get_Boolean("dprt.master.native",&native))
+		return FALSE;
+	if(fake || native)
 	{
-		/* do nothing to fake this */
-		return TRUE;
+		if(make_master_bias)
+		{
+			fprintf(stdout,"DpRt_Make_Master_Bias:Calling native Make Master Bias routine.\n");
+			retval = DpRt_Master_Make(directory_name,DPRT_MASTER_TYPE_BIAS);
+			/* any cached master bias, and bad pixel mask derived from it, is now out of date */
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BIAS);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BPM);
+			return retval;
+		}
+		else
+		{
+			fprintf(stdout,"DpRt_Make_Master_Bias:Make Master Bias Flag was FALSE:"
+				"Not making master bias.\n");
+		}
 	}
 	else
 	{
 		if(make_master_bias)
 		{
 			fprintf(stdout,"DpRt_Make_Master_Bias:Calling Make Master Bias routine (dprt_process).\n");
+			pthread_mutex_lock(&Real_Pipeline_Mutex);
 			retval = dprt_process(directory_name,MAKE_BIAS,NULL,&l1mean,&l1seeing, 
 					      &l1xpix,&l1ypix,&l1counts,&l1sat,&l1photom,&l1skybright);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BIAS);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BPM);
 			fprintf(stdout,"DpRt_Make_Master_Bias:Make Master Bias routine (dprt_process) returned %d.\n",
 				retval);
 			if(retval == TRUE)
 			{
-				DpRt_JNI_Error_Number = dprt_err_int;
-				strcpy(DpRt_JNI_Error_String,dprt_err_str);
+				DpRt_Error_Number = dprt_err_int;
+				strcpy(DpRt_Error_String,dprt_err_str);
+				pthread_mutex_unlock(&Real_Pipeline_Mutex);
 				return FALSE;
 			}
+			pthread_mutex_unlock(&Real_Pipeline_Mutex);
 		}
 		else
 		{
@@ -345,52 +1249,69 @@ int DpRt_Make_Master_Bias(char *directory_name)
 }
 
 /**
- * This routine creates a master flat frame for each binning factor, created from flats in the specified
- * directory.
- * @param directory_name A directory containing the  FITS filenames to be processed.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see ../../ccd_imager/cdocs/ccd_dprt.html#dprt_process
- * @see ../../ccd_imager/cdocs/ccd_dprt.html#MAKE_FLAT
+ * Internal routine for DpRt_Context_Make_Master_Flat, called once the context has been entered.
+ * For fake reductions, or if dprt.master.native is TRUE, the master flat is made by the native stacking engine
+ * (DpRt_Master_Make), otherwise by the real pipeline (dprt_process). Either way, any cached master flat is
+ * invalidated, so the next exposure reduction uses the new master. A new master may also change the bad pixel
+ * mask (a native master can derive one, see DpRt_Mask_Make), so any cached mask is invalidated too.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #DpRt_Context_Make_Master_Flat
+ * @see #Real_Pipeline_Mutex
+ * @see dprt_master.html#DpRt_Master_Make
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Invalidate
  */
-int DpRt_Make_Master_Flat(char *directory_name)
+static int Make_Master_Flat(char *directory_name)
 {
-	int fake,retval,make_master_flat;
+	int fake,native,retval,make_master_flat;
 	float l1mean,l1seeing,l1xpix,l1ypix,l1counts,l1photom,l1skybright;
 	int l1sat;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 /* are we doing a fake reduction or a real one. */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.fake",&fake))
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
 	fprintf(stdout,"DpRt_Make_Master_Flat:Fake:%d\n",fake);
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.make_master_flat",&make_master_flat))
+	if(!DpRt_Config_Get_Boolean("dprt.make_master_flat",&make_master_flat))
 		return FALSE;
 	fprintf(stdout,"DpRt_Make_Master_Flat:Make Master Flat Flag:%d\n",make_master_flat);
-	if(fake)
+	if(!DpRt_Config_Get_Boolean("dprt.master.native",&native))
+		return FALSE;
+	if(fake || native)
 	{
-		/* do nothing to fake this */
-		return TRUE;
+		if(make_master_flat)
+		{
+			fprintf(stdout,"DpRt_Make_Master_Flat:Calling native Make Master Flat routine.\n");
+			retval = DpRt_Master_Make(directory_name,DPRT_MASTER_TYPE_FLAT);
+			/* any cached master flat, and bad pixel mask derived from it, is now out of date */
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_FLAT);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BPM);
+			return retval;
+		}
+		else
+		{
+			fprintf(stdout,"DpRt_Make_Master_Flat:Make Master Flat Flag was FALSE:"
+				"Not making master flat.\n");
+		}
 	}
 	else
 	{
 		if(make_master_flat)
 		{
 			fprintf(stdout,"DpRt_Make_Master_Flat:Calling Make Master Flat routine (dprt_process).\n");
+			pthread_mutex_lock(&Real_Pipeline_Mutex);
 			retval = dprt_process(directory_name,MAKE_FLAT,NULL,&l1mean,&l1seeing, 
 					      &l1xpix,&l1ypix,&l1counts,&l1sat,&l1photom,&l1skybright);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_FLAT);
+			DpRt_Calibration_Cache_Invalidate(DPRT_CALIBRATION_TYPE_BPM);
 			fprintf(stdout,"DpRt_Make_Master_Flat:Make Master Flat routine (dprt_process) returned %d.\n",
 				retval);
 			if(retval == TRUE)
 			{
-				DpRt_JNI_Error_Number = dprt_err_int;
-				strcpy(DpRt_JNI_Error_String,dprt_err_str);
+				DpRt_Error_Number = dprt_err_int;
+				strcpy(DpRt_Error_String,dprt_err_str);
+				pthread_mutex_unlock(&Real_Pipeline_Mutex);
 				return FALSE;
 			}
+			pthread_mutex_unlock(&Real_Pipeline_Mutex);
 		}
 		else
 		{
@@ -401,14 +1322,295 @@ int DpRt_Make_Master_Flat(char *directory_name)
 	return TRUE;
 }
 
-/* ------------------------------------------------------- */
-/* internal functions */
-/* ------------------------------------------------------- */
+/**
+ * Internal routine for DpRt_Context_Calibrate_Reduce_Batch, called once the context has been entered.
+ * For fake reductions, the frames are run through a batch pipeline (DpRt_Batch_Run), so the FITS read of
+ * one frame overlaps the statistics of the previous one. The real pipeline (dprt_process) does it's own I/O,
+ * and is serialised, so for real reductions the frames are reduced in turn.
+ * @param context The context the routine is running in.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed,
+ *         in which case the error number/string are those of the first failure.
+ * @see #DpRt_Context_Calibrate_Reduce_Batch
+ * @see #Batch_Reduce_Struct
+ * @see #Calibrate_Reduce
+ * @see #Calibrate_Reduce_Batch_Read
+ * @see #Calibrate_Reduce_Batch_Process
+ * @see #Batch_Reduce_Result
+ * @see dprt_batch.html#DpRt_Batch_Run
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ */
+static int Calibrate_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+				  struct DpRt_Calibrate_Reduce_Result_Struct *result_list)
+{
+	struct Batch_Reduce_Struct batch_data;
+	struct DpRt_Calibrate_Reduce_Result_Struct *result = NULL;
+	int i,fake,depth;
+
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+	if((input_filename_list == NULL)||(input_filename_count < 0)||(result_list == NULL))
+	{
+		DpRt_Error_Number = 46;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Batch:Illegal arguments(%d).\n",input_filename_count);
+		return FALSE;
+	}
+	for(i=0;i<input_filename_count;i++)
+	{
+		result_list[i].Successful = FALSE;
+		result_list[i].Error_Number = 0;
+		result_list[i].Error_String[0] = '\0';
+		result_list[i].Output_Filename = NULL;
+		result_list[i].Mean_Counts = 0.0;
+		result_list[i].Peak_Counts = 0.0;
+	}
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
+		return FALSE;
+	fprintf(stdout,"DpRt_Calibrate_Reduce_Batch:Fake:%d:%d frames.\n",fake,input_filename_count);
+	if(fake)
+	{
+		if(!DpRt_Config_Get_Integer("dprt.batch.depth",&depth))
+			return FALSE;
+		batch_data.Context = context;
+		batch_data.Input_Filename_List = input_filename_list;
+		batch_data.Calibrate_Result_List = result_list;
+		batch_data.Expose_Result_List = NULL;
+		if(!DpRt_Batch_Run(context,input_filename_count,depth,Calibrate_Reduce_Batch_Read,
+				   Calibrate_Reduce_Batch_Process,&batch_data))
+			return FALSE;
+	}
+	else
+	{
+		for(i=0;i<input_filename_count;i++)
+		{
+			result = &(result_list[i]);
+			DpRt_Error_Number = 0;
+			DpRt_Error_String[0] = '\0';
+			result->Successful = Calibrate_Reduce(context,input_filename_list[i],&(result->Output_Filename),
+							      &(result->Mean_Counts),&(result->Peak_Counts));
+			result->Error_Number = DpRt_Error_Number;
+			strcpy(result->Error_String,DpRt_Error_String);
+		}
+	}
+	for(i=0;i<input_filename_count;i++)
+	{
+		if(!Batch_Reduce_Result(result_list[i].Successful,result_list[i].Error_Number,
+					result_list[i].Error_String))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Internal routine for DpRt_Context_Expose_Reduce_Batch, called once the context has been entered.
+ * For fake and native quick-look reductions (see Expose_Reduce_Is_Native), the frames are run through a batch pipeline (DpRt_Batch_Run), so the FITS read of
+ * one frame overlaps the statistics of the previous one. For real reductions the frames are reduced in turn.
+ * @param context The context the routine is running in.
+ * @param input_filename_list The list of FITS filenames to be processed.
+ * @param input_filename_count The number of filenames in the list.
+ * @param result_list A list of input_filename_count result structures, filled in by this routine.
+ * @return The routine returns TRUE if all the frames were reduced successfully, and FALSE if any failed,
+ *         in which case the error number/string are those of the first failure.
+ * @see #DpRt_Context_Expose_Reduce_Batch
+ * @see #Batch_Reduce_Struct
+ * @see #Expose_Reduce
+ * @see #Expose_Reduce_Batch_Read
+ * @see #Expose_Reduce_Batch_Process
+ * @see #Batch_Reduce_Result
+ * @see dprt_batch.html#DpRt_Batch_Run
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ */
+static int Expose_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+			       struct DpRt_Expose_Reduce_Result_Struct *result_list)
+{
+	struct Batch_Reduce_Struct batch_data;
+	struct DpRt_Expose_Reduce_Result_Struct *result = NULL;
+	int i,native,depth;
+
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+	if((input_filename_list == NULL)||(input_filename_count < 0)||(result_list == NULL))
+	{
+		DpRt_Error_Number = 47;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Batch:Illegal arguments(%d).\n",input_filename_count);
+		return FALSE;
+	}
+	for(i=0;i<input_filename_count;i++)
+	{
+		result_list[i].Successful = FALSE;
+		result_list[i].Error_Number = 0;
+		result_list[i].Error_String[0] = '\0';
+		result_list[i].Output_Filename = NULL;
+		result_list[i].Seeing = 0.0;
+		result_list[i].Counts = 0.0;
+		result_list[i].X_Pix = 0.0;
+		result_list[i].Y_Pix = 0.0;
+		result_list[i].Photometricity = 0.0;
+		result_list[i].Sky_Brightness = 0.0;
+		result_list[i].Saturated = FALSE;
+	}
+	if(!Expose_Reduce_Is_Native(&native))
+		return FALSE;
+	fprintf(stdout,"DpRt_Expose_Reduce_Batch:Native:%d:%d frames.\n",native,input_filename_count);
+	if(native)
+	{
+		if(!DpRt_Config_Get_Integer("dprt.batch.depth",&depth))
+			return FALSE;
+		batch_data.Context = context;
+		batch_data.Input_Filename_List = input_filename_list;
+		batch_data.Calibrate_Result_List = NULL;
+		batch_data.Expose_Result_List = result_list;
+		if(!DpRt_Batch_Run(context,input_filename_count,depth,Expose_Reduce_Batch_Read,
+				   Expose_Reduce_Batch_Process,&batch_data))
+			return FALSE;
+	}
+	else
+	{
+		for(i=0;i<input_filename_count;i++)
+		{
+			result = &(result_list[i]);
+			DpRt_Error_Number = 0;
+			DpRt_Error_String[0] = '\0';
+			result->Successful = Expose_Reduce(context,input_filename_list[i],&(result->Output_Filename),
+							   &(result->Seeing),&(result->Counts),&(result->X_Pix),
+							   &(result->Y_Pix),&(result->Photometricity),
+							   &(result->Sky_Brightness),&(result->Saturated));
+			result->Error_Number = DpRt_Error_Number;
+			strcpy(result->Error_String,DpRt_Error_String);
+		}
+	}
+	for(i=0;i<input_filename_count;i++)
+	{
+		if(!Batch_Reduce_Result(result_list[i].Successful,result_list[i].Error_Number,
+					result_list[i].Error_String))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Batch read function for fake calibration batches, called on the batch's read thread.
+ * @param index The index of the frame in the batch.
+ * @param slot The slot to read the frame into.
+ * @param user_data The batch's Batch_Reduce_Struct.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #Batch_Reduce_Struct
+ * @see #Calibrate_Reduce_Fake_Read
+ */
+static int Calibrate_Reduce_Batch_Read(int index,int slot,void *user_data)
+{
+	struct Batch_Reduce_Struct *batch_data = (struct Batch_Reduce_Struct *)user_data;
+
+	fprintf(stderr,"Calibrate_Reduce_Batch_Read(%s).\n",batch_data->Input_Filename_List[index]);
+	return Calibrate_Reduce_Fake_Read(batch_data->Input_Filename_List[index],&(batch_data->Image_List[slot]));
+}
+
+/**
+ * Batch process function for fake calibration batches, called on the calling thread. The frame's result
+ * structure is filled in.
+ * @param index The index of the frame in the batch.
+ * @param slot The slot the frame was read into.
+ * @param read_retval Whether the frame was read successfully.
+ * @param user_data The batch's Batch_Reduce_Struct.
+ * @see #Batch_Reduce_Struct
+ * @see #Calibrate_Reduce_Fake_Process
+ */
+static void Calibrate_Reduce_Batch_Process(int index,int slot,int read_retval,void *user_data)
+{
+	struct Batch_Reduce_Struct *batch_data = (struct Batch_Reduce_Struct *)user_data;
+	struct DpRt_Calibrate_Reduce_Result_Struct *result = &(batch_data->Calibrate_Result_List[index]);
+
+	if(read_retval)
+	{
+		result->Successful = Calibrate_Reduce_Fake_Process(batch_data->Context,
+					batch_data->Input_Filename_List[index],&(batch_data->Image_List[slot]),
+					&(result->Output_Filename),&(result->Mean_Counts),&(result->Peak_Counts));
+	}
+	else
+		result->Successful = FALSE;
+	result->Error_Number = DpRt_Error_Number;
+	strcpy(result->Error_String,DpRt_Error_String);
+}
+
+/**
+ * Batch read function for fake exposure batches, called on the batch's read thread.
+ * @param index The index of the frame in the batch.
+ * @param slot The slot to read the frame into.
+ * @param user_data The batch's Batch_Reduce_Struct.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #Batch_Reduce_Struct
+ * @see #Expose_Reduce_Fake_Read
+ */
+static int Expose_Reduce_Batch_Read(int index,int slot,void *user_data)
+{
+	struct Batch_Reduce_Struct *batch_data = (struct Batch_Reduce_Struct *)user_data;
+
+	fprintf(stderr,"Expose_Reduce_Batch_Read(%s).\n",batch_data->Input_Filename_List[index]);
+	return Expose_Reduce_Fake_Read(batch_data->Input_Filename_List[index],&(batch_data->Image_List[slot]),
+				       &(batch_data->Telfocus_List[slot]));
+}
+
+/**
+ * Batch process function for fake exposure batches, called on the calling thread. The frame's result
+ * structure is filled in.
+ * @param index The index of the frame in the batch.
+ * @param slot The slot the frame was read into.
+ * @param read_retval Whether the frame was read successfully.
+ * @param user_data The batch's Batch_Reduce_Struct.
+ * @see #Batch_Reduce_Struct
+ * @see #Expose_Reduce_Fake_Process
+ */
+static void Expose_Reduce_Batch_Process(int index,int slot,int read_retval,void *user_data)
+{
+	struct Batch_Reduce_Struct *batch_data = (struct Batch_Reduce_Struct *)user_data;
+	struct DpRt_Expose_Reduce_Result_Struct *result = &(batch_data->Expose_Result_List[index]);
+
+	if(read_retval)
+	{
+		result->Successful = Expose_Reduce_Fake_Process(batch_data->Context,
+					batch_data->Input_Filename_List[index],&(batch_data->Image_List[slot]),
+					batch_data->Telfocus_List[slot],&(result->Output_Filename),&(result->Seeing),
+					&(result->Counts),&(result->X_Pix),&(result->Y_Pix),&(result->Photometricity),
+					&(result->Sky_Brightness),&(result->Saturated));
+	}
+	else
+		result->Successful = FALSE;
+	result->Error_Number = DpRt_Error_Number;
+	strcpy(result->Error_String,DpRt_Error_String);
+}
+
+/**
+ * Check the result of one frame of a batch. If the frame failed, it's error is copied into the calling thread's
+ * error number/string.
+ * @param successful Whether the frame was reduced successfully.
+ * @param error_number The frame's error number.
+ * @param error_string The frame's error string.
+ * @return The routine returns successful.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Batch_Reduce_Result(int successful,int error_number,char *error_string)
+{
+	if(successful)
+		return TRUE;
+	DpRt_Error_Number = error_number;
+	strcpy(DpRt_Error_String,error_string);
+	return FALSE;
+}
+
 /**
  * This routine does a fake real time data reduction pipeline on a calibration file. It is invoked from the
  * DpRt_Calibrate_Reduce routine.If the <a href="#DpRt_Get_Abort">DpRt_Get_Abort</a>
  * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
  * current operation and return FALSE.
+ * The frame is read with Calibrate_Reduce_Fake_Read, and reduced with Calibrate_Reduce_Fake_Process.
+ * @param context The context the reduction is running in, whose abort flag is checked.
  * @param input_filename The FITS filename to be processed.
  * @param output_filename The resultant filename should be put in this variable. This variable is the
  *       address of a pointer to a sequence of characters, hence it should be referenced using
@@ -418,38 +1620,60 @@ int DpRt_Make_Master_Flat(char *directory_name)
  * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
  *       succeeded and FALSE if they fail.
  * @see ngat_dprt_sprat_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Abort
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Abort
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see #Calibrate_Reduce_Fake_Read
+ * @see #Calibrate_Reduce_Fake_Process
  * @see #DpRt_Calibrate_Reduce
  */
-static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts)
+static int Calibrate_Reduce_Fake(DpRt_Context *context,char *input_filename,char **output_filename,
+				 double *mean_counts,double *peak_counts)
 {
-	fitsfile *fp = NULL;
-	int retval=0,status=0,integer_value,naxis_one,naxis_two,i,j,value;
-	unsigned short *data = NULL;
-	double counts_count = 0.0;
-	int max_count = 0;
+	struct DpRt_Fits_Image_Struct image;
 
 /* set the error stuff to no error*/
-	DpRt_JNI_Error_Number = 0;
-	strcpy(DpRt_JNI_Error_String,"");
+	DpRt_Error_Number = 0;
+	strcpy(DpRt_Error_String,"");
 /* setup return values */
 	(*mean_counts) = 0.0;
 	(*peak_counts) = 0.0;
-/* unset any previous aborts - ready to start processing */
-	DpRt_JNI_Set_Abort(FALSE);
 /* do processing  here */
 	fprintf(stderr,"Calibrate_Reduce_Fake(%s).\n",input_filename);
+	if(!Calibrate_Reduce_Fake_Read(input_filename,&image))
+		return FALSE;
+	return Calibrate_Reduce_Fake_Process(context,input_filename,&image,output_filename,mean_counts,peak_counts);
+}
+
+/**
+ * Open a calibration FITS file, check it's a 16-bit 2 axis image, and get hold of it's data.
+ * This routine does not use a context, so it can be called from a batch's read thread.
+ * @param input_filename The FITS filename to be processed.
+ * @param image The address of an image structure to fill in. On success, the image data must be freed with
+ *        DpRt_Fits_Image_Free (Calibrate_Reduce_Fake_Process does this).
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #FITS_GET_DATA_BITPIX
+ * @see #FITS_GET_DATA_NAXIS
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_fits.html#DpRt_Fits_Image_Read
+ * @see dprt_fits.html#DpRt_Fits_Image_Free
+ */
+static int Calibrate_Reduce_Fake_Read(char *input_filename,struct DpRt_Fits_Image_Struct *image)
+{
+	fitsfile *fp = NULL;
+	int retval=0,status=0,integer_value,naxis_one,naxis_two,use_mmap;
+
+	if(!DpRt_Config_Get_Boolean("dprt.fits.mmap",&use_mmap))
+		return FALSE;
 /* open file */
 	retval = fits_open_file(&fp,input_filename,READONLY,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 23;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Open failed.\n",input_filename);
+		DpRt_Error_Number = 23;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Open failed.\n",input_filename);
 		return FALSE;
 	}
 /* check bitpix */
@@ -457,14 +1681,16 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 24;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to get BITPIX.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 24;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Failed to get BITPIX.\n",input_filename);
 		return FALSE;
 	}
 	if(integer_value != FITS_GET_DATA_BITPIX)
 	{
-		DpRt_JNI_Error_Number = 25;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Wrong BITPIX value(%d).\n",
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 25;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Wrong BITPIX value(%d).\n",
 			input_filename,integer_value);
 		return FALSE;
 	}
@@ -473,14 +1699,16 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 26;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to get NAXIS.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 26;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Failed to get NAXIS.\n",input_filename);
 		return FALSE;
 	}
 	if(integer_value != FITS_GET_DATA_NAXIS)
 	{
-		DpRt_JNI_Error_Number = 27;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Wrong NAXIS value(%d).\n",
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 27;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Wrong NAXIS value(%d).\n",
 			input_filename,integer_value);
 		return FALSE;
 	}
@@ -489,95 +1717,314 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 28;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to get NAXIS1.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 28;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Failed to get NAXIS1.\n",input_filename);
 		return FALSE;
 	}
 	retval = fits_read_key(fp,TINT,"NAXIS2",&naxis_two,NULL,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 29;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to get NAXIS2.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 29;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Failed to get NAXIS2.\n",input_filename);
 		return FALSE;
 	}
-/* allocate data */
-	data = (unsigned short *)malloc(naxis_one*naxis_two*sizeof(unsigned short));
-	if(data == NULL)
+/* map the data, or read it into a frame buffer leased from the pool */
+	if(!DpRt_Fits_Image_Read(fp,input_filename,naxis_one,naxis_two,use_mmap,image))
 	{
-		DpRt_JNI_Error_Number = 30;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to allocate memory (%d,%d,%d).\n",
-			input_filename,naxis_one,naxis_two,naxis_one*naxis_two*sizeof(short));
+		fits_close_file(fp,&status);
 		return FALSE;
 	}
-/* read the data */
-	retval = fits_read_img(fp,TUSHORT,1,naxis_one*naxis_two,NULL,data,NULL,&status);
+/* close file */
+	retval = fits_close_file(fp,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 31;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to read image(%d,%d).\n",
-			input_filename,naxis_one,naxis_two);
-		if(data != NULL)
-			free(data);
+		DpRt_Error_Number = 32;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Failed to close file.\n",input_filename);
+		DpRt_Fits_Image_Free(image);
 		return FALSE;
 	}
-/* close file */
-	retval = fits_close_file(fp,&status);
-	if(retval)
+	return TRUE;
+}
+
+/**
+ * If dprt.master.accumulate is TRUE, fold a calibration frame into the master accumulators, so
+ * DpRt_Make_Master_Bias/DpRt_Make_Master_Flat can make masters without re-reading the frames. Frames whose
+ * OBSTYPE contains dprt.master.bias.obstype are accumulated as biases, and those whose OBSTYPE contains
+ * dprt.master.flat.obstype are accumulated as flats, normalised by their mean. Other frames (including those
+ * reduced from buffers, which have no OBSTYPE) are not accumulated. A failure to accumulate the frame is logged,
+ * but does not fail the reduction.
+ * @param input_filename The FITS filename being processed.
+ * @param image The frame's image data.
+ * @param stats The frame's statistics, used to normalise flats.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed to read the configuration.
+ * @see dprt_accumulate.html#DpRt_Accumulate_Add
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_String
+ */
+static int Calibrate_Reduce_Fake_Accumulate(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					    struct DpRt_Stats_Struct *stats)
+{
+	char *bias_obstype = NULL;
+	char *flat_obstype = NULL;
+	double scale;
+	int accumulate,type;
+
+	if(!DpRt_Config_Get_Boolean("dprt.master.accumulate",&accumulate))
+		return FALSE;
+	if((accumulate == FALSE)||(strlen(image->Obstype) == 0))
+		return TRUE;
+	if(!DpRt_Config_Get_String("dprt.master.bias.obstype",&bias_obstype))
+		return FALSE;
+	if(!DpRt_Config_Get_String("dprt.master.flat.obstype",&flat_obstype))
 	{
-		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 32;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Failed to close file.\n",input_filename);
-		if(data != NULL)
-			free(data);
+		free(bias_obstype);
 		return FALSE;
 	}
-/* during processing regularily check the abort flag as below */
-	if(DpRt_JNI_Get_Abort())
+	if(strstr(image->Obstype,bias_obstype) != NULL)
+		type = DPRT_MASTER_TYPE_BIAS;
+	else if(strstr(image->Obstype,flat_obstype) != NULL)
+		type = DPRT_MASTER_TYPE_FLAT;
+	else
+		type = -1;
+	free(bias_obstype);
+	free(flat_obstype);
+	if(type == -1)
+		return TRUE;
+	scale = 1.0;
+	if(type == DPRT_MASTER_TYPE_FLAT)
 	{
-		/* tidy up anything that needs tidying as a result of this routine here */
-		(*mean_counts) = 0.0;
-		(*peak_counts) = 0.0;
-		(*output_filename) = NULL;
-		DpRt_JNI_Error_Number = 1;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Operation Aborted.\n",input_filename);
-		if(data != NULL)
-			free(data);
+		if(stats->Sum == 0)
+		{
+			fprintf(stderr,"Calibrate_Reduce_Fake_Accumulate(%s):Flat has a mean of zero:"
+				"Not accumulated.\n",input_filename);
+			return TRUE;
+		}
+		scale = ((double)stats->Pixel_Count)/((double)stats->Sum);
+	}
+	if(!DpRt_Accumulate_Add(type,image->Data,image->Encoding,image->Naxis_One,image->Naxis_Two,scale))
+	{
+		fprintf(stderr,"Calibrate_Reduce_Fake_Accumulate(%s):Failed to accumulate frame:%s",input_filename,
+			DpRt_Error_String);
+		DpRt_Error_Number = 0;
+		DpRt_Error_String[0] = '\0';
+	}
+	return TRUE;
+}
+
+/**
+ * Fit a dispersion solution to an arc frame, if the frame's OBSTYPE contains "dprt.arc.obstype" and a line list
+ * is configured ("dprt.arc.line_list"). The arc is calibrated with the frame's overscan and the cached master
+ * bias, master flat and bad pixel mask (if there are any) as it is collapsed along the spatial axis, and the
+ * emission lines found in the collapsed arc are matched to the line list. The cached dispersion solution for
+ * frames of this size is refined with the new lines, or if there is none (or refining it fails), a solution is
+ * searched for from scratch. A good solution replaces the cached one, in memory and in the calibration directory,
+ * so the quick-look spectra of later exposures are wavelength calibrated with it. Failing to fit a solution is
+ * logged, but does not fail the reduction.
+ * @param context The context the reduction is running in, whose arc scratch buffer is used.
+ * @param input_filename The FITS filename being processed.
+ * @param image The frame's image data.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed to read the configuration or allocate
+ *         it's buffer.
+ * @see #Expose_Reduce_Fake_Get_Calibration
+ * @see dprt_arc.html#DpRt_Arc_Get_Parameters
+ * @see dprt_arc.html#DpRt_Arc_Read_Line_List
+ * @see dprt_arc.html#DpRt_Arc_Collapse
+ * @see dprt_arc.html#DpRt_Arc_Find_Lines
+ * @see dprt_arc.html#DpRt_Arc_Solve
+ * @see dprt_arc.html#DpRt_Arc_Solution_Get
+ * @see dprt_arc.html#DpRt_Arc_Solution_Put
+ * @see dprt_context.html#DpRt_Context_Get_Scratch
+ * @see dprt_overscan.html#DpRt_Overscan_Get
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Release
+ */
+static int Calibrate_Reduce_Fake_Arc(DpRt_Context *context,char *input_filename,struct DpRt_Fits_Image_Struct *image)
+{
+	struct DpRt_Arc_Parameter_Struct parameters;
+	struct DpRt_Arc_Line_Struct line_list[DPRT_ARC_MAX_LINE_COUNT];
+	struct DpRt_Arc_Solution_Struct solution;
+	struct DpRt_Overscan_Struct overscan;
+	struct DpRt_Source_Frame_Struct frame;
+	double wavelength_list[DPRT_ARC_MAX_LINE_COUNT];
+	double *column_sum_list = NULL;
+	double *work_list = NULL;
+	char *arc_obstype = NULL;
+	float *bias = NULL;
+	float *flat = NULL;
+	unsigned long long *mask = NULL;
+	int start_x,length,line_count,wavelength_count,is_arc,retval;
+
+	if(strlen(image->Obstype) == 0)
+		return TRUE;
+	if(!DpRt_Config_Get_String("dprt.arc.obstype",&arc_obstype))
 		return FALSE;
+	is_arc = (strlen(arc_obstype) > 0)&&(strstr(image->Obstype,arc_obstype) != NULL);
+	free(arc_obstype);
+	if(is_arc == FALSE)
+		return TRUE;
+	if(!DpRt_Arc_Get_Parameters(&parameters))
+		return FALSE;
+	if(strlen(parameters.Line_List_Filename) == 0)
+	{
+		fprintf(stderr,"Calibrate_Reduce_Fake_Arc(%s):No line list (dprt.arc.line_list):"
+			"Dispersion solution not fitted.\n",input_filename);
+		return TRUE;
+	}
+/* get the context's arc buffer: the collapsed arc, and the line finding work list */
+	if(!DpRt_Context_Get_Scratch(context,DPRT_CONTEXT_SCRATCH_ARC,((size_t)image->Naxis_One)*2*sizeof(double),
+				     (void **)&column_sum_list))
+	{
+		DpRt_Error_Number = 54;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.150s): Failed to allocate arc buffer.\n",
+			input_filename);
+		return FALSE;
+	}
+	work_list = column_sum_list+image->Naxis_One;
+/* collapse the calibrated arc, find it's lines, and fit the dispersion solution */
+	retval = DpRt_Overscan_Get(image->Biassec,image->Trimsec,image->Naxis_One,image->Naxis_Two,&overscan);
+	if(retval)
+		retval = Expose_Reduce_Fake_Get_Calibration(image,&bias,&flat,&mask);
+	if(retval)
+	{
+		frame.Data = image->Data;
+		frame.Encoding = image->Encoding;
+		frame.Naxis_One = image->Naxis_One;
+		frame.Naxis_Two = image->Naxis_Two;
+		frame.Overscan = &overscan;
+		frame.Bias = bias;
+		frame.Flat = flat;
+		frame.Mask = mask;
+		retval = DpRt_Arc_Collapse(&frame,column_sum_list,&start_x,&length);
+		DpRt_Calibration_Cache_Release(bias);
+		DpRt_Calibration_Cache_Release(flat);
+		DpRt_Calibration_Cache_Release(mask);
+	}
+	if(retval)
+	{
+		retval = DpRt_Arc_Find_Lines(column_sum_list,start_x,length,&parameters,work_list,line_list,
+					     &line_count);
+	}
+	if(retval)
+		retval = DpRt_Arc_Read_Line_List(parameters.Line_List_Filename,wavelength_list,&wavelength_count);
+	if(retval)
+		retval = DpRt_Arc_Solution_Get(image->Naxis_One,image->Naxis_Two,&solution);
+	if(retval)
+	{
+		retval = DpRt_Arc_Solve(line_list,line_count,wavelength_list,wavelength_count,image->Naxis_One,
+					image->Naxis_Two,&parameters,&solution,&solution);
+	}
+	if(retval && solution.Valid)
+	{
+		fprintf(stderr,"Calibrate_Reduce_Fake_Arc(%s):%d lines:Dispersion solution %s:Order %d fitted to %d "
+			"lines:RMS %.3f:Central wavelength %.2f:Dispersion %.4f per pixel.\n",input_filename,line_count,
+			(solution.Arc_Count > 1) ? "refined" : "searched for",solution.Order,solution.Line_Count,
+			solution.RMS,solution.Coefficient_List[0],solution.Coefficient_List[1]/solution.Scale_X);
+		retval = DpRt_Arc_Solution_Put(&solution);
+	}
+	else if(retval)
+	{
+		fprintf(stderr,"Calibrate_Reduce_Fake_Arc(%s):%d lines:No dispersion solution fitted.\n",input_filename,
+			line_count);
+	}
+	if(retval == FALSE)
+	{
+		fprintf(stderr,"Calibrate_Reduce_Fake_Arc(%s):Failed to fit dispersion solution:%s",input_filename,
+			DpRt_Error_String);
+		DpRt_Error_Number = 0;
+		DpRt_Error_String[0] = '\0';
 	}
+	return TRUE;
+}
+
+/**
+ * Reduce the data of a calibration frame read by Calibrate_Reduce_Fake_Read. The image data is freed
+ * whether or not the routine succeeds.
+ * @param context The context the reduction is running in, whose abort flag is checked.
+ * @param input_filename The FITS filename being processed.
+ * @param image The frame's image data.
+ * @param output_filename The address of a pointer to store the (allocated) output filename.
+ * @param meanCounts The address of a double to store the mean counts calculated by this routine.
+ * @param peakCounts The address of a double to store the peak counts calculated by this routine.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ * @see #Calibrate_Reduce_Fake_Accumulate
+ * @see #Calibrate_Reduce_Fake_Arc
+ * @see #Reduce_Fake_Get_Mask
+ * @see dprt_reduce.html#DpRt_Reduce_Calibrated_Stats
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Release
+ * @see dprt_fits.html#DpRt_Fits_Image_Free
+ */
+static int Calibrate_Reduce_Fake_Process(DpRt_Context *context,char *input_filename,
+					 struct DpRt_Fits_Image_Struct *image,char **output_filename,
+					 double *mean_counts,double *peak_counts)
+{
+	struct DpRt_Stats_Struct stats;
+	unsigned long long *mask = NULL;
+	int saturation_level,retval;
+
 /* setup return values */
+	(*output_filename) = NULL;
 	(*mean_counts) = 0.0;
 	(*peak_counts) = 0.0;
-	counts_count = 0.0;
-	max_count = 0;
-	for(j=0;j<naxis_two;j++)
+/* get parameters from the config snapshot */
+	if(!DpRt_Config_Get_Integer("dprt.saturation_level",&saturation_level))
 	{
-		for(i=0;i<naxis_one;i++)
-		{
-			value = (int)(data[(naxis_one*j)+i]);
-			counts_count += (double)value;
-			if(value>max_count)
-				max_count = value;
-		}
-		/* during processing regularily check the abort flag as below */
-		if(DpRt_JNI_Get_Abort())
-		{
-			/* tidy up anything that needs tidying as a result of this routine here */
-			(*mean_counts) = 0.0;
-			(*peak_counts) = 0.0;
-			(*output_filename) = NULL;
-			DpRt_JNI_Error_Number = 45;
-			sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Operation Aborted.\n",input_filename);
-			if(data != NULL)
-				free(data);
-			return FALSE;
-		}
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* during processing regularily check the abort flag as below */
+	if(DpRt_Context_Get_Abort(context))
+	{
+		/* tidy up anything that needs tidying as a result of this routine here */
+		DpRt_Error_Number = 1;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Operation Aborted.\n",input_filename);
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* compute statistics in parallel bands of rows, each band checks the abort flag, leaving out bad pixels */
+	if(!Reduce_Fake_Get_Mask(image,&mask))
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+	retval = DpRt_Reduce_Calibrated_Stats(image->Data,image->Encoding,image->Naxis_One,image->Naxis_Two,NULL,NULL,
+					      NULL,mask,saturation_level,&stats,NULL,NULL);
+	DpRt_Calibration_Cache_Release(mask);
+	if(retval == FALSE)
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* fold bias and flat frames into the master accumulators */
+	if(!Calibrate_Reduce_Fake_Accumulate(input_filename,image,&stats))
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
 	}
-	if(data != NULL)
-		free(data);
-	(*mean_counts) = (float)(((double)counts_count)/((double)(naxis_one*naxis_two)));
-	(*peak_counts) = (float)max_count;
+/* fit the dispersion solution of arc frames */
+	if(!Calibrate_Reduce_Fake_Arc(context,input_filename,image))
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+	DpRt_Fits_Image_Free(image);
+/* during processing regularily check the abort flag as below */
+	if(DpRt_Context_Get_Abort(context))
+	{
+		/* tidy up anything that needs tidying as a result of this routine here */
+		DpRt_Error_Number = 45;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Operation Aborted.\n",input_filename);
+		return FALSE;
+	}
+	if(stats.Pixel_Count > 0)
+		(*mean_counts) = (float)(((double)stats.Sum)/((double)stats.Pixel_Count));
+	(*peak_counts) = (float)stats.Max;
 /* setup filename - allocate space for string */
 	(*output_filename) = (char*)malloc((strlen(input_filename)+1)*sizeof(char));
 	/* if malloc fails it returns NULL - this is an error */
@@ -587,8 +2034,8 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
 		(*mean_counts) = 0.0;
 		(*peak_counts) = 0.0;
 		(*output_filename) = NULL;
-		DpRt_JNI_Error_Number = 2;
-		sprintf(DpRt_JNI_Error_String,"Calibrate_Reduce_Fake(%s): Memory Allocation Error.\n",input_filename);
+		DpRt_Error_Number = 2;
+		sprintf(DpRt_Error_String,"Calibrate_Reduce_Fake(%.200s): Memory Allocation Error.\n",input_filename);
 		return FALSE;
 	}
 /* set the filename to something more sensible here */
@@ -600,6 +2047,8 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
  * This routine does the fake data reduction pipeline on an expose file. It is usually invoked from the
  * DpRt_Expose_Reduce routine. If the DpRt_Get_Abort routine returns TRUE during the execution of the pipeline 
  * the pipeline should abort it's current operation and return FALSE.
+ * The frame is read with Expose_Reduce_Fake_Read, and reduced with Expose_Reduce_Fake_Process.
+ * @param context The context the reduction is running in, whose abort flag and random number generator are used.
  * @param input_filename The FITS filename to be processed.
  * @param output_filename The resultant filename should be put in this variable. This variable is the
  *       address of a pointer to a sequence of characters, hence it should be referenced using
@@ -618,28 +2067,22 @@ static int Calibrate_Reduce_Fake(char *input_filename,char **output_filename,dou
  * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
  *       succeeded and FALSE if they fail.
  * @see ngat_dprt_ccs_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Double
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Abort
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Abort
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see #Expose_Reduce_Fake_Read
+ * @see #Expose_Reduce_Fake_Process
  */
-static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double *seeing,double *counts,
-	double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+static int Expose_Reduce_Fake(DpRt_Context *context,char *input_filename,char **output_filename,double *seeing,
+	double *counts,double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
 {
-	fitsfile *fp = NULL;
-	int retval=0,status=0,integer_value,naxis_one,naxis_two,i,j,value;
-	unsigned short *data = NULL;
-	double telfocus,best_focus,fwhm_per_mm,atmospheric_seeing,atmospheric_variation,error;
-	char *ch = NULL;
+	struct DpRt_Fits_Image_Struct image;
+	double telfocus;
 
 	/* set the error stuff to no error*/
-	DpRt_JNI_Error_Number = 0;
-	strcpy(DpRt_JNI_Error_String,"");
+	DpRt_Error_Number = 0;
+	strcpy(DpRt_Error_String,"");
 
-/* unset any previous aborts - ready to start processing */
-	DpRt_JNI_Set_Abort(FALSE);
 /* do processing  here */
 	fprintf(stderr,"Expose_Reduce_Fake(%s).\n",input_filename);
 /* setup return values */
@@ -651,22 +2094,64 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
 	(*photometricity) = 0.0;
 	(*sky_brightness) = 0.0;
 	(*saturated) = FALSE;
-/* get parameters from config */
-	if(!DpRt_JNI_Get_Property_Double("dprt.telfocus.best_focus",&best_focus))
+	if(!Expose_Reduce_Fake_Read(input_filename,&image,&telfocus))
+		return FALSE;
+	return Expose_Reduce_Fake_Process(context,input_filename,&image,telfocus,output_filename,seeing,counts,
+					  x_pix,y_pix,photometricity,sky_brightness,saturated);
+}
+
+/**
+ * Determine whether exposure frames are reduced natively (by Expose_Reduce_Fake_Process) rather than by the real
+ * pipeline (dprt_process). They are for fake reductions (dprt.fake), and for quick-look reductions when
+ * dprt.quick_look is TRUE and dprt.full_reduction is FALSE.
+ * @param native The address of an integer, set to TRUE if frames are reduced natively, and FALSE if not.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed to read the configuration.
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ */
+static int Expose_Reduce_Is_Native(int *native)
+{
+	int fake,quick_look,full_reduction;
+
+	if(!DpRt_Config_Get_Boolean("dprt.fake",&fake))
 		return FALSE;
-	if(!DpRt_JNI_Get_Property_Double("dprt.telfocus.fwhm_per_mm",&fwhm_per_mm))
+	if(!DpRt_Config_Get_Boolean("dprt.quick_look",&quick_look))
 		return FALSE;
-	if(!DpRt_JNI_Get_Property_Double("dprt.telfocus.atmospheric_seeing",&atmospheric_seeing))
+	if(!DpRt_Config_Get_Boolean("dprt.full_reduction",&full_reduction))
 		return FALSE;
-	if(!DpRt_JNI_Get_Property_Double("dprt.telfocus.atmospheric_variation",&atmospheric_variation))
+	(*native) = fake || (quick_look && (full_reduction == FALSE));
+	return TRUE;
+}
+
+/**
+ * Open an exposure FITS file, check it's a 16-bit 2 axis image, get the telescope focus,
+ * and get hold of it's data. This routine does not use a context, so it can be called from a batch's read thread.
+ * @param input_filename The FITS filename to be processed.
+ * @param image The address of an image structure to fill in. On success, the image data must be freed with
+ *        DpRt_Fits_Image_Free (Expose_Reduce_Fake_Process does this).
+ * @param telfocus The address of a double to store the TELFOCUS keyword value.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #FITS_GET_DATA_BITPIX
+ * @see #FITS_GET_DATA_NAXIS
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_fits.html#DpRt_Fits_Image_Read
+ * @see dprt_fits.html#DpRt_Fits_Image_Free
+ */
+static int Expose_Reduce_Fake_Read(char *input_filename,struct DpRt_Fits_Image_Struct *image,double *telfocus)
+{
+	fitsfile *fp = NULL;
+	int retval=0,status=0,integer_value,naxis_one,naxis_two,use_mmap;
+
+	if(!DpRt_Config_Get_Boolean("dprt.fits.mmap",&use_mmap))
 		return FALSE;
 /* open file */
 	retval = fits_open_file(&fp,input_filename,READONLY,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 33;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Open failed.\n",input_filename);
+		DpRt_Error_Number = 33;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Open failed.\n",input_filename);
 		return FALSE;
 	}
 /* check bitpix */
@@ -674,14 +2159,16 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 34;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to get BITPIX.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 34;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to get BITPIX.\n",input_filename);
 		return FALSE;
 	}
 	if(integer_value != FITS_GET_DATA_BITPIX)
 	{
-		DpRt_JNI_Error_Number = 35;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Wrong BITPIX value(%d).\n",
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 35;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Wrong BITPIX value(%d).\n",
 			input_filename,integer_value);
 		return FALSE;
 	}
@@ -690,14 +2177,16 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 36;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to get NAXIS.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 36;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to get NAXIS.\n",input_filename);
 		return FALSE;
 	}
 	if(integer_value != FITS_GET_DATA_NAXIS)
 	{
-		DpRt_JNI_Error_Number = 37;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Wrong NAXIS value(%d).\n",
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 37;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Wrong NAXIS value(%d).\n",
 			input_filename,integer_value);
 		return FALSE;
 	}
@@ -706,108 +2195,581 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 38;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to get NAXIS1.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 38;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to get NAXIS1.\n",input_filename);
 		return FALSE;
 	}
 	retval = fits_read_key(fp,TINT,"NAXIS2",&naxis_two,NULL,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 39;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to get NAXIS2.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 39;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to get NAXIS2.\n",input_filename);
 		return FALSE;
 	}
 /* get telescope focus */
-	retval = fits_read_key(fp,TDOUBLE,"TELFOCUS",&telfocus,NULL,&status);
+	retval = fits_read_key(fp,TDOUBLE,"TELFOCUS",telfocus,NULL,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 40;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to get TELFOCUS.\n",input_filename);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 40;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to get TELFOCUS.\n",input_filename);
 		return FALSE;
 	}
-/* allocate data */
-	data = (unsigned short *)malloc(naxis_one*naxis_two*sizeof(unsigned short));
-	if(data == NULL)
+/* map the data, or read it into a frame buffer leased from the pool */
+	if(!DpRt_Fits_Image_Read(fp,input_filename,naxis_one,naxis_two,use_mmap,image))
 	{
-		DpRt_JNI_Error_Number = 41;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to allocate memory (%d,%d,%d).\n",
-			input_filename,naxis_one,naxis_two,naxis_one*naxis_two*sizeof(short));
+		fits_close_file(fp,&status);
 		return FALSE;
 	}
-/* read the data */
-	retval = fits_read_img(fp,TUSHORT,1,naxis_one*naxis_two,NULL,data,NULL,&status);
+/* close file */
+	retval = fits_close_file(fp,&status);
 	if(retval)
 	{
 		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 42;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to read image(%d,%d).\n",
-			input_filename,naxis_one,naxis_two);
-		if(data != NULL)
-			free(data);
+		DpRt_Error_Number = 43;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to close file.\n",input_filename);
+		DpRt_Fits_Image_Free(image);
 		return FALSE;
 	}
-/* close file */
-	retval = fits_close_file(fp,&status);
+	return TRUE;
+}
+
+/**
+ * Get the bad pixel mask for a frame from the calibration cache, as a packed bitset: the
+ * dprt.calibration.bpm_filename mask if one is configured, otherwise the mask of the frame's size derived from the
+ * masters in the dprt.calibration.directory directory (see DpRt_Mask_Make), if there is one. It is only read from
+ * disk when it changes. The mask got must be released with DpRt_Calibration_Cache_Release.
+ * @param image The frame's image data.
+ * @param mask The address of a pointer to store the cached bad pixel mask bitset, or NULL if there is no mask.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Get_Mask
+ * @see dprt_mask.html#DpRt_Mask_Get_Filename
+ * @see dprt_config.html#DpRt_Config_Get_String
+ */
+static int Reduce_Fake_Get_Mask(struct DpRt_Fits_Image_Struct *image,unsigned long long **mask)
+{
+	char mask_filename[DPRT_MASK_FILENAME_LENGTH];
+	char *directory_name = NULL;
+	char *bpm_filename = NULL;
+	int retval;
+
+	(*mask) = NULL;
+	if(!DpRt_Config_Get_String("dprt.calibration.bpm_filename",&bpm_filename))
+		return FALSE;
+	if(strlen(bpm_filename) > 0)
+	{
+		retval = DpRt_Calibration_Cache_Get_Mask(bpm_filename,image->Naxis_One,image->Naxis_Two,mask);
+		free(bpm_filename);
+		return retval;
+	}
+	free(bpm_filename);
+	if(!DpRt_Config_Get_String("dprt.calibration.directory",&directory_name))
+		return FALSE;
+	retval = TRUE;
+	if(strlen(directory_name) > 0)
+	{
+		retval = DpRt_Mask_Get_Filename(directory_name,image->Naxis_One,image->Naxis_Two,mask_filename,
+						DPRT_MASK_FILENAME_LENGTH);
+		if(retval)
+		{
+			retval = DpRt_Calibration_Cache_Get_Mask(mask_filename,image->Naxis_One,image->Naxis_Two,
+								 mask);
+		}
+	}
+	free(directory_name);
+	return retval;
+}
+
+/**
+ * Get the calibration frames for an exposure frame from the calibration cache: the master bias and flat of it's
+ * size in the dprt.calibration.directory directory (as made by DpRt_Make_Master_Bias/DpRt_Make_Master_Flat), and
+ * the bad pixel mask (see Reduce_Fake_Get_Mask). They are only read from disk when they change. Missing
+ * calibration frames are returned as NULL. The frames got must be released with DpRt_Calibration_Cache_Release.
+ * @param image The frame's image data.
+ * @param bias The address of a float pointer to store the cached master bias, or NULL.
+ * @param flat The address of a float pointer to store the cached master flat, or NULL.
+ * @param mask The address of a pointer to store the cached bad pixel mask bitset, or NULL.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed. On failure no frames are held.
+ * @see #Reduce_Fake_Get_Mask
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Get
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Release
+ * @see dprt_master.html#DpRt_Master_Get_Filename
+ * @see dprt_config.html#DpRt_Config_Get_String
+ */
+static int Expose_Reduce_Fake_Get_Calibration(struct DpRt_Fits_Image_Struct *image,float **bias,float **flat,
+					      unsigned long long **mask)
+{
+	char master_filename[DPRT_CALIBRATION_FILENAME_LENGTH];
+	char *directory_name = NULL;
+	int retval;
+
+	(*bias) = NULL;
+	(*flat) = NULL;
+	(*mask) = NULL;
+	if(!DpRt_Config_Get_String("dprt.calibration.directory",&directory_name))
+		return FALSE;
+	retval = TRUE;
+	if(strlen(directory_name) > 0)
+	{
+		retval = DpRt_Master_Get_Filename(directory_name,DPRT_MASTER_TYPE_BIAS,image->Naxis_One,
+						  image->Naxis_Two,master_filename,DPRT_CALIBRATION_FILENAME_LENGTH);
+		if(retval)
+			retval = DpRt_Calibration_Cache_Get(DPRT_CALIBRATION_TYPE_BIAS,master_filename,image->Naxis_One,
+							    image->Naxis_Two,bias);
+		if(retval)
+			retval = DpRt_Master_Get_Filename(directory_name,DPRT_MASTER_TYPE_FLAT,image->Naxis_One,
+							  image->Naxis_Two,master_filename,
+							  DPRT_CALIBRATION_FILENAME_LENGTH);
+		if(retval)
+			retval = DpRt_Calibration_Cache_Get(DPRT_CALIBRATION_TYPE_FLAT,master_filename,image->Naxis_One,
+							    image->Naxis_Two,flat);
+	}
 	if(retval)
+		retval = Reduce_Fake_Get_Mask(image,mask);
+	free(directory_name);
+	if(retval == FALSE)
 	{
-		fits_report_error(stderr,status);
-		DpRt_JNI_Error_Number = 43;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Failed to close file.\n",input_filename);
-		if(data != NULL)
-			free(data);
+		DpRt_Calibration_Cache_Release((*bias));
+		DpRt_Calibration_Cache_Release((*flat));
+		(*bias) = NULL;
+		(*flat) = NULL;
+		(*mask) = NULL;
+	}
+	return retval;
+}
+
+/**
+ * Work out the sky brightness of an exposure frame from the histogram of it's (calibrated) pixels. The sky level
+ * per pixel is the clipped sky estimate of the histogram (DpRt_Histogram_Get_Sky), which is converted to
+ * magnitudes per square arcsecond using the "dprt.sky.zero_point" (the magnitude giving one count per second)
+ * and "dprt.sky.pixel_scale" (arcseconds per pixel) properties, and the exposure length. If the exposure length
+ * is not known, the sky is per frame rather than per second. The number of saturated pixels is logged.
+ * @param input_filename The FITS filename being processed.
+ * @param histogram The histogram of the frame.
+ * @param exposure_length The exposure length in seconds, or zero if it is not known.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param sky The address of a double to store the sky level per pixel, in counts.
+ * @param sky_sigma The address of a double to store the standard deviation of the sky, in counts.
+ * @param sky_brightness The address of a double to store the sky brightness, in magnitudes per arcsec&#178;.
+ *        It is zero if the sky level is not positive.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_histogram.html#DpRt_Histogram_Get_Sky
+ * @see dprt_histogram.html#DpRt_Histogram_Get_Count
+ */
+static int Expose_Reduce_Fake_Sky_Brightness(char *input_filename,struct DpRt_Histogram_Struct *histogram,
+					     double exposure_length,int saturation_level,double *sky,double *sky_sigma,
+					     double *sky_brightness)
+{
+	unsigned long long saturated_count;
+	double zero_point,pixel_scale,kappa,sky_rate;
+	int iterations;
+
+	(*sky) = 0.0;
+	(*sky_sigma) = 0.0;
+	(*sky_brightness) = 0.0;
+	if(histogram->Pixel_Count == 0)
+		return TRUE;
+	if((!DpRt_Config_Get_Double("dprt.sky.zero_point",&zero_point))||
+	   (!DpRt_Config_Get_Double("dprt.sky.pixel_scale",&pixel_scale))||
+	   (!DpRt_Config_Get_Double("dprt.sky.sigma_clip.kappa",&kappa))||
+	   (!DpRt_Config_Get_Integer("dprt.sky.sigma_clip.iterations",&iterations)))
+		return FALSE;
+	if(!DpRt_Histogram_Get_Sky(histogram,kappa,iterations,sky,sky_sigma))
+		return FALSE;
+	if(!DpRt_Histogram_Get_Count(histogram,saturation_level,DPRT_HISTOGRAM_BIN_COUNT-1,&saturated_count))
+		return FALSE;
+	sky_rate = (*sky);
+	if(exposure_length > 0.0)
+		sky_rate /= exposure_length;
+	if((sky_rate > 0.0)&&(pixel_scale > 0.0))
+		(*sky_brightness) = zero_point-(2.5*log10(sky_rate/(pixel_scale*pixel_scale)));
+	fprintf(stderr,"Expose_Reduce_Fake(%s):Sky %.2f +/- %.2f counts%s:Sky brightness %.2f:%llu saturated.\n",
+		input_filename,(*sky),(*sky_sigma),(exposure_length > 0.0) ? "" : " (no EXPTIME)",(*sky_brightness),
+		saturated_count);
+	return TRUE;
+}
+
+/**
+ * Find and measure the brightest sources in an exposure frame (see DpRt_Source_Find), calibrating the pixels
+ * looked at on the fly in the same way as the fused statistics pass. The seeing is the median FWHM of the
+ * unsaturated sources, converted to arcseconds using the "dprt.sky.pixel_scale" property (arcseconds per pixel).
+ * The brightest peak, robust against cosmic rays and hot pixels, is found in the same pass.
+ * @param input_filename The FITS filename being processed.
+ * @param image The frame's image data.
+ * @param overscan The overscan and data sections of the frame.
+ * @param bias The cached master bias, or NULL.
+ * @param flat The cached master flat, or NULL.
+ * @param mask The cached bad pixel mask bitset, or NULL.
+ * @param sky The sky level per pixel, in counts.
+ * @param sky_sigma The standard deviation of the sky, in counts.
+ * @param saturation_level Sources with a peak greater than or equal to this are saturated.
+ * @param source_list A list of DPRT_SOURCE_MAX_COUNT sources, filled in brightest first.
+ * @param source_count The address of an integer to store the number of sources found.
+ * @param peak The address of a structure to store the brightest peak in.
+ * @param seeing The address of a double to store the seeing in arcseconds, or zero if no unsaturated
+ *        sources were found.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_source.html#DpRt_Source_Get_Parameters
+ * @see dprt_source.html#DpRt_Source_Find
+ * @see dprt_source.html#DpRt_Source_Get_FWHM
+ */
+static int Expose_Reduce_Fake_Find_Sources(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					   struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,
+					   unsigned long long *mask,double sky,double sky_sigma,int saturation_level,
+					   struct DpRt_Source_Struct *source_list,int *source_count,
+					   struct DpRt_Source_Peak_Struct *peak,double *seeing)
+{
+	struct DpRt_Source_Frame_Struct frame;
+	struct DpRt_Source_Parameter_Struct parameters;
+	double pixel_scale,fwhm;
+
+	(*source_count) = 0;
+	(*seeing) = 0.0;
+	peak->Found = FALSE;
+	if(!DpRt_Config_Get_Double("dprt.sky.pixel_scale",&pixel_scale))
+		return FALSE;
+	if(!DpRt_Source_Get_Parameters(saturation_level,&parameters))
+		return FALSE;
+	frame.Data = image->Data;
+	frame.Encoding = image->Encoding;
+	frame.Naxis_One = image->Naxis_One;
+	frame.Naxis_Two = image->Naxis_Two;
+	frame.Overscan = overscan;
+	frame.Bias = bias;
+	frame.Flat = flat;
+	frame.Mask = mask;
+	if(!DpRt_Source_Find(&frame,sky,sky_sigma,&parameters,source_list,source_count,peak))
+		return FALSE;
+	if(!DpRt_Source_Get_FWHM(source_list,(*source_count),&fwhm))
+		return FALSE;
+	(*seeing) = fwhm*pixel_scale;
+	if((*source_count) > 0)
+	{
+		fprintf(stderr,"Expose_Reduce_Fake(%s):%d sources:Brightest at %.2f,%.2f (peak %.0f):"
+			"FWHM %.2f pixels:Seeing %.2f arcsec.\n",input_filename,(*source_count),source_list[0].X,
+			source_list[0].Y,source_list[0].Peak,fwhm,(*seeing));
+	}
+	else
+		fprintf(stderr,"Expose_Reduce_Fake(%s):No sources found.\n",input_filename);
+	if(peak->Found)
+	{
+		fprintf(stderr,"Expose_Reduce_Fake(%s):Brightest peak at %.2f,%.2f (peak %.0f,flux %.0f):"
+			"Confidence %.1f.\n",input_filename,peak->X,peak->Y,peak->Peak,peak->Flux,peak->Confidence);
+	}
+	return TRUE;
+}
+
+/**
+ * Extract a quick-look spectrum from an exposure frame. The trace is measured around the cached trace of the
+ * previous frame of the same target, or failing that around the trace found in the frame's spatial profile, the row
+ * sums kept by the fused statistics pass, and the aperture and sky band rows following it summed (see
+ * dprt_spectrum.c). Frames are of the same target if they have the same OBJECT and dimensions, frames with no
+ * OBJECT do not use the trace cache. The dispersion solution of the latest arc of the frame's size is attached to
+ * the spectrum, if there is one (see Calibrate_Reduce_Fake_Arc).
+ * @param input_filename The FITS filename being processed, for logging.
+ * @param image The frame's image data.
+ * @param overscan The overscan and data sections of the frame.
+ * @param bias The cached master bias, or NULL.
+ * @param flat The cached master flat, or NULL.
+ * @param mask The cached bad pixel mask bitset, or NULL.
+ * @param parameters The extraction parameters.
+ * @param row_sum_list The sum of each calibrated row of the frame, from DpRt_Reduce_Calibrated_Stats.
+ * @param profile_list A list of image->Naxis_Two doubles, used to find the trace.
+ * @param flux_list A list of image->Naxis_One doubles, filled in with the spectrum.
+ * @param sky_list A list of image->Naxis_One doubles, filled in with the sky.
+ * @param spectrum The address of a structure to fill in with the spectrum's trace and aperture. If no trace was
+ *        found, Found is set to FALSE.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_spectrum.html#DpRt_Spectrum_Find_Trace
+ * @see dprt_spectrum.html#DpRt_Spectrum_Extract
+ * @see dprt_trace.html#DPRT_TRACE_KEY_LENGTH
+ * @see dprt_arc.html#DpRt_Arc_Solution_Get
+ */
+static int Expose_Reduce_Fake_Extract_Spectrum(char *input_filename,struct DpRt_Fits_Image_Struct *image,
+					       struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,
+					       unsigned long long *mask,
+					       struct DpRt_Spectrum_Parameter_Struct *parameters,
+					       unsigned long long *row_sum_list,double *profile_list,double *flux_list,
+					       double *sky_list,struct DpRt_Spectrum_Struct *spectrum)
+{
+	struct DpRt_Source_Frame_Struct frame;
+	char trace_key[DPRT_TRACE_KEY_LENGTH];
+
+	frame.Data = image->Data;
+	frame.Encoding = image->Encoding;
+	frame.Naxis_One = image->Naxis_One;
+	frame.Naxis_Two = image->Naxis_Two;
+	frame.Overscan = overscan;
+	frame.Bias = bias;
+	frame.Flat = flat;
+	frame.Mask = mask;
+/* the trace cache key, the target and the frame's dimensions */
+	trace_key[0] = '\0';
+	if(strlen(image->Object) > 0)
+	{
+		snprintf(trace_key,DPRT_TRACE_KEY_LENGTH,"%s:%dx%d",image->Object,image->Naxis_One,
+			 image->Naxis_Two);
+	}
+	if(!DpRt_Spectrum_Find_Trace(&frame,row_sum_list,trace_key,parameters,profile_list,spectrum))
+		return FALSE;
+	if(!DpRt_Spectrum_Extract(&frame,parameters,spectrum,flux_list,sky_list))
+		return FALSE;
+/* the dispersion solution of the latest arc of this frame size, if there is one */
+	if(!DpRt_Arc_Solution_Get(image->Naxis_One,image->Naxis_Two,&(spectrum->Solution)))
+		return FALSE;
+	if(spectrum->Found)
+	{
+		fprintf(stderr,"Expose_Reduce_Fake(%s):Spectrum trace at row %.2f (source %d, order %d, "
+			"%d blocks, residual %.3f):Aperture rows %d to %d:%d sky rows:Flux %.0f.\n",input_filename,
+			spectrum->Trace_Y,spectrum->Trace_Source,spectrum->Trace.Order,spectrum->Trace.Used_Block_Count,
+			spectrum->Trace.Residual,spectrum->Aperture_Start_Y,spectrum->Aperture_End_Y-1,
+			spectrum->Sky_Row_Count,spectrum->Flux);
+	}
+	else
+		fprintf(stderr,"Expose_Reduce_Fake(%s):No spectrum trace found.\n",input_filename);
+	return TRUE;
+}
+
+/**
+ * Reduce the data of an exposure frame read by Expose_Reduce_Fake_Read. The image data is freed
+ * whether or not the routine succeeds. This is also the native quick-look reduction (see Expose_Reduce_Is_Native):
+ * the frame is calibrated with the cached master bias, master flat and bad pixel mask (if there are any), and the
+ * counts, peak position and mean counts are computed in the same fused pass over the frame. If "dprt.overscan" is
+ * set, each row's overscan level is subtracted in the same pass, and only the data section (TRIMSEC) is used for
+ * the statistics. The exact histogram of the calibrated pixels is built in the same pass, and gives the sky
+ * brightness (see Expose_Reduce_Fake_Sky_Brightness). The brightest sources are then found and measured
+ * (see Expose_Reduce_Fake_Find_Sources): the seeing is their median FWHM. The counts, x_pix, y_pix and saturated
+ * describe the brightest peak that is not a cosmic ray or hot pixel, found in the same pass (or the brightest pixel,
+ * if no peak was found). For fake reductions of
+ * "telFocus" frames the seeing is instead faked from the TELFOCUS keyword, so focus runs can be simulated.
+ * If a focus run is current (see DpRt_Focus_Run_Start), the frame's seeing and TELFOCUS are added to it and the
+ * best focus refitted.
+ * If "dprt.spectrum.enable" is set, the fused pass also keeps the sum of each row, the spatial profile the trace of
+ * the spectrum is found in, and a quick-look spectrum is extracted (see Expose_Reduce_Fake_Extract_Spectrum) and
+ * written next to the output file.
+ * @param context The context the reduction is running in, whose abort flag and random number generator are used.
+ * @param input_filename The FITS filename being processed.
+ * @param image The frame's image data.
+ * @param telfocus The frame's TELFOCUS keyword value.
+ * @param output_filename The address of a pointer to store the (allocated) output filename.
+ * @param seeing The address of a double to store the seeing calculated by this routine.
+ * @param counts The address of a double to store the counts of th brightest pixel calculated by this
+ *       routine.
+ * @param x_pix The x pixel position of the brightest object in the field.
+ * @param y_pix The y pixel position of the brightest object in the field.
+ * @param photometricity In units of magnitudes of extinction.
+ * @param sky_brightness In units of magnitudes per arcsec&#178;.
+ * @param saturated This is a boolean, returning TRUE if the object is saturated.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ * @see dprt_context.html#DpRt_Context_Random
+ * @see #Expose_Reduce_Is_Native
+ * @see #Expose_Reduce_Fake_Get_Calibration
+ * @see #Expose_Reduce_Fake_Sky_Brightness
+ * @see #Expose_Reduce_Fake_Find_Sources
+ * @see #Expose_Reduce_Fake_Extract_Spectrum
+ * @see dprt_spectrum.html#DpRt_Spectrum_Get_Parameters
+ * @see dprt_spectrum.html#DpRt_Spectrum_Get_Filename
+ * @see dprt_spectrum.html#DpRt_Spectrum_Write
+ * @see dprt_focus.html#DpRt_Focus_Run_Add_Current
+ * @see dprt_overscan.html#DpRt_Overscan_Get
+ * @see dprt_reduce.html#DpRt_Reduce_Calibrated_Stats
+ * @see dprt_context.html#DpRt_Context_Get_Scratch
+ * @see dprt_calibration.html#DpRt_Calibration_Cache_Release
+ * @see dprt_fits.html#DpRt_Fits_Image_Free
+ */
+static int Expose_Reduce_Fake_Process(DpRt_Context *context,char *input_filename,
+				      struct DpRt_Fits_Image_Struct *image,double telfocus,char **output_filename,
+				      double *seeing,double *counts,double *x_pix,double *y_pix,
+				      double *photometricity,double *sky_brightness,int *saturated)
+{
+	struct DpRt_Stats_Struct stats;
+	struct DpRt_Overscan_Struct overscan;
+	struct DpRt_Histogram_Struct *histogram = NULL;
+	struct DpRt_Source_Struct source_list[DPRT_SOURCE_MAX_COUNT];
+	struct DpRt_Source_Peak_Struct peak;
+	double best_focus,fwhm_per_mm,atmospheric_seeing,atmospheric_variation,error,exposure_length;
+	double sky,sky_sigma,measured_seeing;
+	struct DpRt_Focus_Fit_Struct focus_fit;
+	char focus_run_id[DPRT_FOCUS_RUN_ID_LENGTH];
+	struct DpRt_Spectrum_Parameter_Struct spectrum_parameters;
+	struct DpRt_Spectrum_Struct spectrum;
+	char spectrum_filename[DPRT_SPECTRUM_FILENAME_LENGTH];
+	unsigned long long *row_sum_list = NULL;
+	double *profile_list = NULL;
+	double *flux_list = NULL;
+	double *sky_list = NULL;
+	float *bias = NULL;
+	float *flat = NULL;
+	unsigned long long *mask = NULL;
+	int saturation_level,fake,source_count,spectrum_enable,retval;
+	char *ch = NULL;
+
+/* setup return values */
+	(*output_filename) = NULL;
+	(*seeing) = 0.0;
+	(*counts) = 0.0;
+	(*x_pix) = 0.0;
+	(*y_pix) = 0.0;
+	(*photometricity) = 0.0;
+	(*sky_brightness) = 0.0;
+	(*saturated) = FALSE;
+/* get parameters from the config snapshot */
+	if((!DpRt_Config_Get_Double("dprt.telfocus.best_focus",&best_focus))||
+	   (!DpRt_Config_Get_Double("dprt.telfocus.fwhm_per_mm",&fwhm_per_mm))||
+	   (!DpRt_Config_Get_Double("dprt.telfocus.atmospheric_seeing",&atmospheric_seeing))||
+	   (!DpRt_Config_Get_Double("dprt.telfocus.atmospheric_variation",&atmospheric_variation))||
+	   (!DpRt_Config_Get_Integer("dprt.saturation_level",&saturation_level))||
+	   (!DpRt_Config_Get_Boolean("dprt.fake",&fake))||
+	   (!DpRt_Config_Get_Boolean("dprt.spectrum.enable",&spectrum_enable)))
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+	spectrum.Found = FALSE;
+	if(spectrum_enable && (!DpRt_Spectrum_Get_Parameters(&spectrum_parameters)))
+	{
+		DpRt_Fits_Image_Free(image);
 		return FALSE;
 	}
 /* during processing regularily check the abort flag as below */
-	if(DpRt_JNI_Get_Abort())
+	if(DpRt_Context_Get_Abort(context))
 	{
 		/* tidy up anything that needs tidying as a result of this routine here */
-		(*output_filename) = NULL;
-		DpRt_JNI_Error_Number = 44;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Operation Aborted.\n",input_filename);
-		if(data != NULL)
-			free(data);
+		DpRt_Error_Number = 44;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Operation Aborted.\n",input_filename);
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* get the overscan and data sections, from the frame's BIASSEC/TRIMSEC or the config */
+	if(!DpRt_Overscan_Get(image->Biassec,image->Trimsec,image->Naxis_One,image->Naxis_Two,&overscan))
+	{
+		DpRt_Fits_Image_Free(image);
 		return FALSE;
 	}
-/* get counts,x_pix,y_pix */
-	for(j=0;j<naxis_two;j++)
+/* get the context's histogram buffer */
+	if(!DpRt_Context_Get_Scratch(context,DPRT_CONTEXT_SCRATCH_EXPOSE_HISTOGRAM,sizeof(struct DpRt_Histogram_Struct),
+				     (void **)&histogram))
 	{
-		for(i=0;i<naxis_one;i++)
+		DpRt_Error_Number = 52;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Failed to allocate histogram.\n",input_filename);
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* get the context's spectrum buffer: the row sums, the profile work list, and the spectrum and sky */
+	if(spectrum_enable)
+	{
+		if(!DpRt_Context_Get_Scratch(context,DPRT_CONTEXT_SCRATCH_SPECTRUM,
+					     (((size_t)image->Naxis_Two)*(sizeof(unsigned long long)+sizeof(double)))+
+					     (((size_t)image->Naxis_One)*2*sizeof(double)),(void **)&row_sum_list))
 		{
-			value = (int)(data[(naxis_one*j)+i]);
-			if(value> (*counts))
-			{
-				(*counts) = value;
-				(*x_pix) = i;
-				(*y_pix) = j;
-			}
+			DpRt_Error_Number = 53;
+			sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.150s): Failed to allocate spectrum buffer.\n",
+				input_filename);
+			DpRt_Fits_Image_Free(image);
+			return FALSE;
 		}
+		profile_list = (double *)(row_sum_list+image->Naxis_Two);
+		flux_list = profile_list+image->Naxis_Two;
+		sky_list = flux_list+image->Naxis_One;
+	}
+	exposure_length = image->Exposure_Length;
+/* get the cached master bias, master flat and bad pixel mask, if there are any */
+	if(!Expose_Reduce_Fake_Get_Calibration(image,&bias,&flat,&mask))
+	{
+		DpRt_Fits_Image_Free(image);
+		return FALSE;
+	}
+/* overscan correct and calibrate the frame and get counts,x_pix,y_pix,saturated, the histogram and the row sums
+** in one fused pass, in parallel bands of rows, each band checks the abort flag */
+	retval = DpRt_Reduce_Calibrated_Stats(image->Data,image->Encoding,image->Naxis_One,image->Naxis_Two,
+					      &overscan,bias,flat,mask,saturation_level,&stats,histogram,row_sum_list);
+/* the sky level and brightness, from the histogram */
+	if(retval)
+	{
+		retval = Expose_Reduce_Fake_Sky_Brightness(input_filename,histogram,exposure_length,saturation_level,
+							   &sky,&sky_sigma,sky_brightness);
+	}
+/* find and measure the brightest sources above the sky */
+	if(retval)
+	{
+		retval = Expose_Reduce_Fake_Find_Sources(input_filename,image,&overscan,bias,flat,mask,sky,sky_sigma,
+							 saturation_level,source_list,&source_count,&peak,&measured_seeing);
+	}
+/* extract the quick-look spectrum along the trace in the row sums */
+	if(retval && spectrum_enable)
+	{
+		retval = Expose_Reduce_Fake_Extract_Spectrum(input_filename,image,&overscan,bias,flat,mask,
+							     &spectrum_parameters,row_sum_list,profile_list,flux_list,
+							     sky_list,&spectrum);
+	}
+	DpRt_Calibration_Cache_Release(bias);
+	DpRt_Calibration_Cache_Release(flat);
+	DpRt_Calibration_Cache_Release(mask);
+	DpRt_Fits_Image_Free(image);
+	if(retval == FALSE)
+		return FALSE;
+	if(stats.Pixel_Count > 0)
+	{
+		fprintf(stderr,"Expose_Reduce_Fake(%s):%scalibrated:Mean counts %.2f:Peak %d at %d,%d.\n",
+			input_filename,((bias != NULL)||(flat != NULL)||(mask != NULL)||overscan.Enabled) ? "" : "Not ",
+			((double)stats.Sum)/((double)stats.Pixel_Count),stats.Max,stats.Max_X,stats.Max_Y);
+	}
+	if(peak.Found)
+	{
+		(*counts) = peak.Peak;
+		(*x_pix) = peak.X;
+		(*y_pix) = peak.Y;
+		(*saturated) = (peak.Peak >= saturation_level);
+	}
+	else
+	{
+		(*counts) = (double)stats.Max;
+		(*x_pix) = (double)stats.Max_X;
+		(*y_pix) = (double)stats.Max_Y;
+		(*saturated) = (stats.Max >= saturation_level);
 	}
-	if(data != NULL)
-		free(data);
 /* during processing regularily check the abort flag as below */
-	if(DpRt_JNI_Get_Abort())
+	if(DpRt_Context_Get_Abort(context))
 	{
 		/* tidy up anything that needs tidying as a result of this routine here */
 		(*output_filename) = NULL;
-		DpRt_JNI_Error_Number = 3;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Operation Aborted.\n",input_filename);
+		DpRt_Error_Number = 3;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Operation Aborted.\n",input_filename);
 		return FALSE;
 	}
 
-	/* setup return values */
+	/* setup return values, the seeing is only faked for fake reductions of focus run frames */
 	ch = strstr(input_filename,"telFocus");
-	if(ch != NULL)
+	if((fake == TRUE)&&(ch != NULL))
 	{
-		error = (atmospheric_variation*((double)rand()))/((double)RAND_MAX);
+		error = (atmospheric_variation*((double)DpRt_Context_Random(context)))/((double)RAND_MAX);
 		(*seeing) = (pow((telfocus-best_focus),2.0)*(fwhm_per_mm-atmospheric_seeing))+
 				atmospheric_seeing+error;
 		fprintf(stderr,"Expose_Reduce_Fake:telfocus %.2f:seeing set to %.2f.\n",telfocus,(*seeing));
 	}
 	else
+		(*seeing) = measured_seeing;
+/* add the frame to the current focus run, if there is one */
+	if(!DpRt_Focus_Run_Add_Current(telfocus,(*seeing),focus_run_id,&focus_fit))
+		return FALSE;
+	if(strlen(focus_run_id) > 0)
 	{
-		(*seeing) = ((float)(rand()%50))/10.0;
+		fprintf(stderr,"Expose_Reduce_Fake:Focus run %s:%d frames (%d used):Best focus %.3f +/- %.3f "
+			"(FWHM %.2f):%s.\n",focus_run_id,focus_fit.Point_Count,focus_fit.Used_Count,
+			focus_fit.Best_Focus,focus_fit.Best_Focus_Error,focus_fit.Best_FWHM,
+			focus_fit.Converged ? "Converged" : (focus_fit.Valid ? "Not converged" : "No fit"));
 	}
 /* setup filename - allocate space for string */
 	(*output_filename) = (char*)malloc((strlen(input_filename)+1)*sizeof(char));
@@ -816,12 +2778,25 @@ static int Expose_Reduce_Fake(char *input_filename,char **output_filename,double
 	{
 		/* tidy up anything that needs tidying as a result of this routine here */
 		(*output_filename) = NULL;
-		DpRt_JNI_Error_Number = 4;
-		sprintf(DpRt_JNI_Error_String,"Expose_Reduce_Fake(%s): Memory Allocation Error.\n",input_filename);
+		DpRt_Error_Number = 4;
+		sprintf(DpRt_Error_String,"Expose_Reduce_Fake(%.200s): Memory Allocation Error.\n",input_filename);
 		return FALSE;
 	}
 /* set the filename to something more sensible here */
 	strcpy((*output_filename),input_filename);
+/* write the quick-look spectrum next to the output file */
+	if(spectrum.Found)
+	{
+		if((!DpRt_Spectrum_Get_Filename((*output_filename),&spectrum_parameters,spectrum_filename,
+						DPRT_SPECTRUM_FILENAME_LENGTH))||
+		   (!DpRt_Spectrum_Write(spectrum_filename,input_filename,&spectrum,flux_list)))
+		{
+			free((*output_filename));
+			(*output_filename) = NULL;
+			return FALSE;
+		}
+		fprintf(stderr,"Expose_Reduce_Fake(%s):Spectrum written to %s.\n",input_filename,spectrum_filename);
+	}
 	return TRUE;
 }
 
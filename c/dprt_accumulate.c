@@ -0,0 +1,746 @@
+/* dprt_accumulate.c
+** Incremental accumulation of calibration frames into master frames.
+** $Header$
+*/
+/**
+ * dprt_accumulate.c folds bias and flat frames into running per-pixel accumulators as they are reduced, so a
+ * master frame can be made from them without re-reading the frames. There is one accumulator for each master
+ * type and frame size. Each holds the sum and sum of squares of every pixel over all the frames added, and a
+ * bounded reservoir of up to dprt.master.accumulate.reservoir whole frames, chosen by reservoir sampling so
+ * they are a uniform sample of all the frames added. Finalising an accumulator is O(pixels): the mean comes
+ * from the sums, and the median, min/max rejected and sigma clipped means are combined from the reservoir
+ * (which holds every frame, giving the same result as DpRt_Master_Combine, if no more frames than it's size
+ * were added). The accumulators are held in memory, or in a memory mapped scratch file in the
+ * dprt.master.accumulate.scratch_directory directory, if one is configured. Folding and finalising are spread
+ * across the thread pool in bands of rows.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_config.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_master.h"
+#include "dprt_accumulate.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * Macro to convert a 16-bit value read from a FITS data unit (big-endian, signed, with a BZERO of 32768)
+ * into the unsigned pixel value. On a big-endian host only the BZERO offset (flipping the top bit) is needed.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define ACCUMULATE_FITS_DECODE(v)	((unsigned short)((v)^0x8000))
+#else
+#define ACCUMULATE_FITS_DECODE(v)	((unsigned short)((((v)>>8)|((v)<<8))^0x8000))
+#endif
+/**
+ * The template of the scratch file name, created in dprt.master.accumulate.scratch_directory.
+ */
+#define ACCUMULATE_SCRATCH_TEMPLATE	("dprt_accumulate_XXXXXX")
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding an accumulator, for one master type and frame size.
+ * <dl>
+ * <dt>Type</dt> <dd>The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frames.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frames.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of frames added.</dd>
+ * <dt>Reservoir_Size</dt> <dd>The number of frames the reservoir can hold.</dd>
+ * <dt>Reservoir_Count</dt> <dd>The number of frames in the reservoir.</dd>
+ * <dt>Sum</dt> <dd>The sum of each (scaled) pixel over all the frames.</dd>
+ * <dt>Sum_Squares</dt> <dd>The sum of the square of each (scaled) pixel over all the frames.</dd>
+ * <dt>Reservoir</dt> <dd>The (unscaled) frames in the reservoir, one after another.</dd>
+ * <dt>Scale_List</dt> <dd>The scale of each frame in the reservoir.</dd>
+ * <dt>Random_Seed</dt> <dd>The seed used to choose which reservoir frame a new frame replaces.</dd>
+ * <dt>Map_Address</dt> <dd>The memory mapped scratch file holding the sums and reservoir, or NULL if they are
+ *     in Memory.</dd>
+ * <dt>Map_Length</dt> <dd>The length of the memory mapping in bytes.</dd>
+ * <dt>Memory</dt> <dd>The allocated memory holding the sums and reservoir, or NULL if they are in a
+ *     scratch file.</dd>
+ * <dt>Next</dt> <dd>The next accumulator in the list.</dd>
+ * </dl>
+ */
+struct Accumulate_Struct
+{
+	int Type;
+	int Naxis_One;
+	int Naxis_Two;
+	int Frame_Count;
+	int Reservoir_Size;
+	int Reservoir_Count;
+	double *Sum;
+	double *Sum_Squares;
+	unsigned short *Reservoir;
+	double Scale_List[DPRT_ACCUMULATE_MAX_RESERVOIR_SIZE];
+	unsigned int Random_Seed;
+	void *Map_Address;
+	size_t Map_Length;
+	void *Memory;
+	struct Accumulate_Struct *Next;
+};
+
+/**
+ * Structure holding the state of a fold or finalise, shared by it's band tasks.
+ * <dl>
+ * <dt>Accumulator</dt> <dd>The accumulator.</dd>
+ * <dt>Data</dt> <dd>Fold: the frame being added.</dd>
+ * <dt>Encoding</dt> <dd>Fold: how the pixel values are stored in Data.</dd>
+ * <dt>Scale</dt> <dd>Fold: the value the frame's pixels are multiplied by before being summed.</dd>
+ * <dt>Slot</dt> <dd>Fold: the reservoir slot the frame is copied into, or -1 if it is not kept.</dd>
+ * <dt>Parameters</dt> <dd>Finalise: the combine method and it's parameters.</dd>
+ * <dt>Output</dt> <dd>Finalise: the master frame.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in a band.</dd>
+ * <dt>Error_Mutex</dt> <dd>Finalise: mutex protecting Failed and the error, so only the first band to fail records
+ *     it's error.</dd>
+ * <dt>Failed</dt> <dd>A boolean, set when a band fails.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the first band to fail.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the first band to fail.</dd>
+ * </dl>
+ */
+struct Accumulate_Band_Struct
+{
+	struct Accumulate_Struct *Accumulator;
+	void *Data;
+	int Encoding;
+	double Scale;
+	int Slot;
+	struct DpRt_Combine_Parameter_Struct *Parameters;
+	float *Output;
+	int Band_Rows;
+	pthread_mutex_t Error_Mutex;
+	volatile int Failed;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of accumulators, in the order they were created.
+ * @see #Accumulate_Struct
+ */
+static struct Accumulate_Struct *Accumulate_List = NULL;
+/**
+ * Mutex protecting the accumulator list, and the accumulators in it. It is held whilst a frame is folded into
+ * an accumulator or an accumulator is finalised.
+ */
+static pthread_mutex_t Accumulate_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static struct Accumulate_Struct *Accumulate_Find(int type,int index);
+static int Accumulate_Create(int type,int naxis_one,int naxis_two,struct Accumulate_Struct **accumulator);
+static void Accumulate_Free(struct Accumulate_Struct *accumulator);
+static int Accumulate_Fold_Band(void *user_data,int band_index,int thread_index);
+static int Accumulate_Finalise_Band(void *user_data,int band_index,int thread_index);
+static void Accumulate_Sigma_Clip_Estimate(struct Accumulate_Struct *accumulator,double kappa,size_t start,
+					   size_t pixel_count,float *output);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Fold a frame into the accumulator for it's type and size, creating the accumulator if needed.
+ * The frame's (scaled) pixels are added to the accumulator's sums. While the reservoir is not full, the frame is
+ * copied into it; after that, the Nth frame replaces a random reservoir frame with probability
+ * reservoir size/N.
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param data The frame's pixel data.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param scale The value the frame's pixels are multiplied by when combined: 1 for biases, one over the frame's
+ *        mean for flats.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Accumulate_Mutex
+ * @see #Accumulate_Create
+ * @see #Accumulate_Fold_Band
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Accumulate_Add(int type,void *data,int encoding,int naxis_one,int naxis_two,double scale)
+{
+	struct Accumulate_Band_Struct band;
+	struct Accumulate_Struct *accumulator = NULL;
+	struct Accumulate_Struct **previous = NULL;
+	int index,retval;
+
+	if(((type != DPRT_MASTER_TYPE_BIAS)&&(type != DPRT_MASTER_TYPE_FLAT))||(data == NULL)||
+	   ((encoding != DPRT_STATS_ENCODING_NATIVE)&&(encoding != DPRT_STATS_ENCODING_FITS))||
+	   (naxis_one < 1)||(naxis_two < 1))
+	{
+		DpRt_Error_Number = 1200;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Add:Illegal arguments (type %d,encoding %d,%dx%d).\n",
+			type,encoding,naxis_one,naxis_two);
+		return FALSE;
+	}
+	pthread_mutex_lock(&Accumulate_Mutex);
+	for(accumulator=Accumulate_List;accumulator != NULL;accumulator=accumulator->Next)
+	{
+		if((accumulator->Type == type)&&(accumulator->Naxis_One == naxis_one)&&
+		   (accumulator->Naxis_Two == naxis_two))
+			break;
+	}
+	if(accumulator == NULL)
+	{
+		if(!Accumulate_Create(type,naxis_one,naxis_two,&accumulator))
+		{
+			pthread_mutex_unlock(&Accumulate_Mutex);
+			return FALSE;
+		}
+	}
+	/* choose the reservoir slot */
+	if(accumulator->Reservoir_Count < accumulator->Reservoir_Size)
+		band.Slot = accumulator->Reservoir_Count;
+	else
+	{
+		index = rand_r(&(accumulator->Random_Seed))%(accumulator->Frame_Count+1);
+		if(index < accumulator->Reservoir_Size)
+			band.Slot = index;
+		else
+			band.Slot = -1;
+	}
+	band.Accumulator = accumulator;
+	band.Data = data;
+	band.Encoding = encoding;
+	band.Scale = scale;
+	band.Parameters = NULL;
+	band.Output = NULL;
+	band.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	band.Failed = FALSE;
+	band.Error_Number = 0;
+	band.Error_String[0] = '\0';
+	retval = DpRt_Thread_Pool_Run((naxis_two+band.Band_Rows-1)/band.Band_Rows,Accumulate_Fold_Band,&band);
+	if(retval == FALSE)
+	{
+		/* the sums are now inconsistent, so the accumulator is thrown away */
+		fprintf(stderr,"%s",DpRt_Error_String);
+		previous = &Accumulate_List;
+		while((*previous) != accumulator)
+			previous = &((*previous)->Next);
+		(*previous) = accumulator->Next;
+		Accumulate_Free(accumulator);
+		DpRt_Error_Number = 1201;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Add:Failed to fold frame into %dx%d accumulator.\n",
+			naxis_one,naxis_two);
+		pthread_mutex_unlock(&Accumulate_Mutex);
+		return FALSE;
+	}
+	if(band.Slot >= 0)
+	{
+		accumulator->Scale_List[band.Slot] = scale;
+		if(band.Slot == accumulator->Reservoir_Count)
+			accumulator->Reservoir_Count++;
+	}
+	accumulator->Frame_Count++;
+	fprintf(stdout,"DpRt_Accumulate_Add:%dx%d accumulator of type %d now has %d frames (%d in reservoir).\n",
+		naxis_one,naxis_two,type,accumulator->Frame_Count,accumulator->Reservoir_Count);
+	pthread_mutex_unlock(&Accumulate_Mutex);
+	return TRUE;
+}
+
+/**
+ * Get the number of accumulators (frame sizes) of a master type.
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param count The address of an integer to store the number of accumulators.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Accumulate_List
+ */
+int DpRt_Accumulate_Get_Count(int type,int *count)
+{
+	struct Accumulate_Struct *accumulator = NULL;
+
+	if(count == NULL)
+	{
+		DpRt_Error_Number = 1202;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Get_Count:count was NULL.\n");
+		return FALSE;
+	}
+	(*count) = 0;
+	pthread_mutex_lock(&Accumulate_Mutex);
+	for(accumulator=Accumulate_List;accumulator != NULL;accumulator=accumulator->Next)
+	{
+		if(accumulator->Type == type)
+			(*count)++;
+	}
+	pthread_mutex_unlock(&Accumulate_Mutex);
+	return TRUE;
+}
+
+/**
+ * Get the frame size and number of frames of an accumulator.
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param index The index of the accumulator amongst those of the type, from 0 to DpRt_Accumulate_Get_Count-1.
+ * @param naxis_one The address of an integer to store the number of columns in the frames.
+ * @param naxis_two The address of an integer to store the number of rows in the frames.
+ * @param frame_count The address of an integer to store the number of frames added.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Accumulate_Find
+ */
+int DpRt_Accumulate_Get(int type,int index,int *naxis_one,int *naxis_two,int *frame_count)
+{
+	struct Accumulate_Struct *accumulator = NULL;
+
+	if((naxis_one == NULL)||(naxis_two == NULL)||(frame_count == NULL))
+	{
+		DpRt_Error_Number = 1203;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Get:naxis_one, naxis_two or frame_count was NULL.\n");
+		return FALSE;
+	}
+	pthread_mutex_lock(&Accumulate_Mutex);
+	accumulator = Accumulate_Find(type,index);
+	if(accumulator == NULL)
+	{
+		pthread_mutex_unlock(&Accumulate_Mutex);
+		DpRt_Error_Number = 1204;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Get:No accumulator %d of type %d.\n",index,type);
+		return FALSE;
+	}
+	(*naxis_one) = accumulator->Naxis_One;
+	(*naxis_two) = accumulator->Naxis_Two;
+	(*frame_count) = accumulator->Frame_Count;
+	pthread_mutex_unlock(&Accumulate_Mutex);
+	return TRUE;
+}
+
+/**
+ * Make a master frame from an accumulator. The mean is the accumulated sum over the number of frames.
+ * If every frame added is in the reservoir, the other methods combine the reservoir with DpRt_Combine_Pixels,
+ * giving the same result as combining the frames themselves. Otherwise, the median and min/max rejected mean are
+ * taken from the reservoir sample, and the sigma clipped mean is estimated in one pass, clipping the reservoir
+ * values around the mean and standard deviation of all the frames (see Accumulate_Sigma_Clip_Estimate).
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param index The index of the accumulator amongst those of the type, from 0 to DpRt_Accumulate_Get_Count-1.
+ * @param parameters The combine method and it's parameters.
+ * @param output The address of a buffer of naxis_one*naxis_two floats to store the master frame.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Accumulate_Find
+ * @see #Accumulate_Finalise_Band
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ */
+int DpRt_Accumulate_Finalise(int type,int index,struct DpRt_Combine_Parameter_Struct *parameters,float *output)
+{
+	struct Accumulate_Band_Struct band;
+	struct Accumulate_Struct *accumulator = NULL;
+	int retval;
+
+	if((parameters == NULL)||(output == NULL))
+	{
+		DpRt_Error_Number = 1205;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Finalise:parameters or output was NULL.\n");
+		return FALSE;
+	}
+	pthread_mutex_lock(&Accumulate_Mutex);
+	accumulator = Accumulate_Find(type,index);
+	if((accumulator == NULL)||(accumulator->Frame_Count < 1))
+	{
+		pthread_mutex_unlock(&Accumulate_Mutex);
+		DpRt_Error_Number = 1206;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Finalise:No frames in accumulator %d of type %d.\n",
+			index,type);
+		return FALSE;
+	}
+	band.Accumulator = accumulator;
+	band.Data = NULL;
+	band.Slot = -1;
+	band.Parameters = parameters;
+	band.Output = output;
+	band.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	band.Failed = FALSE;
+	band.Error_Number = 0;
+	band.Error_String[0] = '\0';
+	pthread_mutex_init(&(band.Error_Mutex),NULL);
+	retval = DpRt_Thread_Pool_Run((accumulator->Naxis_Two+band.Band_Rows-1)/band.Band_Rows,
+				      Accumulate_Finalise_Band,&band);
+	pthread_mutex_destroy(&(band.Error_Mutex));
+	pthread_mutex_unlock(&Accumulate_Mutex);
+	if(band.Failed)
+	{
+		DpRt_Error_Number = band.Error_Number;
+		strcpy(DpRt_Error_String,band.Error_String);
+		return FALSE;
+	}
+	if(retval == FALSE)
+	{
+		DpRt_Error_Number = 1207;
+		sprintf(DpRt_Error_String,"DpRt_Accumulate_Finalise:Failed to finalise accumulator %d of type %d.\n",
+			index,type);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Throw away the accumulators of a master type, usually once the master frames have been made from them.
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @return The routine returns TRUE.
+ * @see #Accumulate_Free
+ */
+int DpRt_Accumulate_Reset(int type)
+{
+	struct Accumulate_Struct *accumulator = NULL;
+	struct Accumulate_Struct **previous = NULL;
+
+	pthread_mutex_lock(&Accumulate_Mutex);
+	previous = &Accumulate_List;
+	while((*previous) != NULL)
+	{
+		accumulator = (*previous);
+		if(accumulator->Type == type)
+		{
+			(*previous) = accumulator->Next;
+			Accumulate_Free(accumulator);
+		}
+		else
+			previous = &(accumulator->Next);
+	}
+	pthread_mutex_unlock(&Accumulate_Mutex);
+	return TRUE;
+}
+
+/**
+ * Throw away all the accumulators, called when the library is shut down.
+ * @return The routine returns TRUE.
+ * @see #DpRt_Accumulate_Reset
+ */
+int DpRt_Accumulate_Shutdown(void)
+{
+	DpRt_Accumulate_Reset(DPRT_MASTER_TYPE_BIAS);
+	DpRt_Accumulate_Reset(DPRT_MASTER_TYPE_FLAT);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Find an accumulator. Accumulate_Mutex must be held.
+ * @param type The master type.
+ * @param index The index of the accumulator amongst those of the type.
+ * @return The accumulator, or NULL if there is no such accumulator.
+ * @see #Accumulate_List
+ */
+static struct Accumulate_Struct *Accumulate_Find(int type,int index)
+{
+	struct Accumulate_Struct *accumulator = NULL;
+
+	for(accumulator=Accumulate_List;accumulator != NULL;accumulator=accumulator->Next)
+	{
+		if(accumulator->Type == type)
+		{
+			if(index == 0)
+				return accumulator;
+			index--;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Create an empty accumulator, and add it to the end of the list. Accumulate_Mutex must be held.
+ * The sums and reservoir are allocated in memory, or in a scratch file in dprt.master.accumulate.scratch_directory
+ * (which is unlinked as soon as it is mapped), if that is not blank.
+ * @param type The master type.
+ * @param naxis_one The number of columns in the frames.
+ * @param naxis_two The number of rows in the frames.
+ * @param accumulator The address of a pointer to store the new accumulator.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #ACCUMULATE_SCRATCH_TEMPLATE
+ * @see #DPRT_ACCUMULATE_MAX_RESERVOIR_SIZE
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_String
+ */
+static int Accumulate_Create(int type,int naxis_one,int naxis_two,struct Accumulate_Struct **accumulator)
+{
+	struct Accumulate_Struct *new_accumulator = NULL;
+	struct Accumulate_Struct **last = NULL;
+	char *scratch_directory = NULL;
+	char *scratch_filename = NULL;
+	size_t pixel_count,length;
+	void *memory = NULL;
+	int reservoir_size,fd;
+
+	if(!DpRt_Config_Get_Integer("dprt.master.accumulate.reservoir",&reservoir_size))
+		return FALSE;
+	if(!DpRt_Config_Get_String("dprt.master.accumulate.scratch_directory",&scratch_directory))
+		return FALSE;
+	if(reservoir_size < 1)
+		reservoir_size = 1;
+	if(reservoir_size > DPRT_ACCUMULATE_MAX_RESERVOIR_SIZE)
+		reservoir_size = DPRT_ACCUMULATE_MAX_RESERVOIR_SIZE;
+	new_accumulator = (struct Accumulate_Struct *)malloc(sizeof(struct Accumulate_Struct));
+	if(new_accumulator == NULL)
+	{
+		free(scratch_directory);
+		DpRt_Error_Number = 1208;
+		sprintf(DpRt_Error_String,"Accumulate_Create:Failed to allocate accumulator.\n");
+		return FALSE;
+	}
+	pixel_count = ((size_t)naxis_one)*((size_t)naxis_two);
+	length = (pixel_count*2*sizeof(double))+(((size_t)reservoir_size)*pixel_count*sizeof(unsigned short));
+	new_accumulator->Map_Address = NULL;
+	new_accumulator->Map_Length = 0;
+	new_accumulator->Memory = NULL;
+	if(strlen(scratch_directory) > 0)
+	{
+		scratch_filename = (char *)malloc(strlen(scratch_directory)+strlen(ACCUMULATE_SCRATCH_TEMPLATE)+2);
+		if(scratch_filename == NULL)
+		{
+			free(scratch_directory);
+			free(new_accumulator);
+			DpRt_Error_Number = 1208;
+			sprintf(DpRt_Error_String,"Accumulate_Create:Failed to allocate scratch filename.\n");
+			return FALSE;
+		}
+		sprintf(scratch_filename,"%s/%s",scratch_directory,ACCUMULATE_SCRATCH_TEMPLATE);
+		fd = mkstemp(scratch_filename);
+		if(fd < 0)
+		{
+			DpRt_Error_Number = 1209;
+			sprintf(DpRt_Error_String,"Accumulate_Create:Failed to create scratch file in %.200s.\n",
+				scratch_directory);
+			free(scratch_filename);
+			free(scratch_directory);
+			free(new_accumulator);
+			return FALSE;
+		}
+		/* the scratch file is removed when it is unmapped */
+		unlink(scratch_filename);
+		free(scratch_filename);
+		if(ftruncate(fd,(off_t)length) == 0)
+			memory = mmap(NULL,length,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+		else
+			memory = MAP_FAILED;
+		close(fd);
+		if(memory == MAP_FAILED)
+		{
+			DpRt_Error_Number = 1210;
+			sprintf(DpRt_Error_String,"Accumulate_Create:Failed to map %lu byte scratch file in %.150s.\n",
+				(unsigned long)length,scratch_directory);
+			free(scratch_directory);
+			free(new_accumulator);
+			return FALSE;
+		}
+		/* a new scratch file reads as zeros */
+		new_accumulator->Map_Address = memory;
+		new_accumulator->Map_Length = length;
+	}
+	else
+	{
+		memory = calloc(1,length);
+		if(memory == NULL)
+		{
+			DpRt_Error_Number = 1208;
+			sprintf(DpRt_Error_String,"Accumulate_Create:Failed to allocate %lu bytes for %dx%d accumulator.\n",
+				(unsigned long)length,naxis_one,naxis_two);
+			free(scratch_directory);
+			free(new_accumulator);
+			return FALSE;
+		}
+		new_accumulator->Memory = memory;
+	}
+	free(scratch_directory);
+	new_accumulator->Type = type;
+	new_accumulator->Naxis_One = naxis_one;
+	new_accumulator->Naxis_Two = naxis_two;
+	new_accumulator->Frame_Count = 0;
+	new_accumulator->Reservoir_Size = reservoir_size;
+	new_accumulator->Reservoir_Count = 0;
+	new_accumulator->Sum = (double *)memory;
+	new_accumulator->Sum_Squares = new_accumulator->Sum+pixel_count;
+	new_accumulator->Reservoir = (unsigned short *)(new_accumulator->Sum_Squares+pixel_count);
+	new_accumulator->Random_Seed = (unsigned int)((naxis_one*31)+naxis_two+type);
+	new_accumulator->Next = NULL;
+	last = &Accumulate_List;
+	while((*last) != NULL)
+		last = &((*last)->Next);
+	(*last) = new_accumulator;
+	(*accumulator) = new_accumulator;
+	fprintf(stdout,"Accumulate_Create:Created %dx%d accumulator of type %d (%d frame reservoir,%lu bytes,%s).\n",
+		naxis_one,naxis_two,type,reservoir_size,(unsigned long)length,
+		(new_accumulator->Map_Address != NULL) ? "scratch file" : "memory");
+	return TRUE;
+}
+
+/**
+ * Free an accumulator, which must have been removed from the list.
+ * @param accumulator The accumulator.
+ */
+static void Accumulate_Free(struct Accumulate_Struct *accumulator)
+{
+	if(accumulator->Map_Address != NULL)
+		munmap(accumulator->Map_Address,accumulator->Map_Length);
+	if(accumulator->Memory != NULL)
+		free(accumulator->Memory);
+	free(accumulator);
+}
+
+/**
+ * Thread pool task folding a band of a frame into an accumulator's sums, and copying it into the reservoir slot
+ * (if any).
+ * @param user_data The band structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread (unused).
+ * @return The routine returns TRUE.
+ * @see #ACCUMULATE_FITS_DECODE
+ */
+static int Accumulate_Fold_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Accumulate_Band_Struct *band = (struct Accumulate_Band_Struct *)user_data;
+	struct Accumulate_Struct *accumulator = band->Accumulator;
+	unsigned short *data = NULL;
+	unsigned short *slot = NULL;
+	size_t start,end,pixel_count,i;
+	double value;
+	unsigned short pixel;
+
+	(void)thread_index;
+	pixel_count = ((size_t)accumulator->Naxis_One)*((size_t)accumulator->Naxis_Two);
+	start = ((size_t)band_index)*((size_t)band->Band_Rows)*((size_t)accumulator->Naxis_One);
+	end = start+(((size_t)band->Band_Rows)*((size_t)accumulator->Naxis_One));
+	if(end > pixel_count)
+		end = pixel_count;
+	data = (unsigned short *)band->Data;
+	if(band->Slot >= 0)
+		slot = accumulator->Reservoir+(((size_t)band->Slot)*pixel_count);
+	for(i=start;i<end;i++)
+	{
+		pixel = data[i];
+		if(band->Encoding == DPRT_STATS_ENCODING_FITS)
+			pixel = ACCUMULATE_FITS_DECODE(pixel);
+		value = ((double)pixel)*band->Scale;
+		accumulator->Sum[i] += value;
+		accumulator->Sum_Squares[i] += value*value;
+		if(slot != NULL)
+			slot[i] = pixel;
+	}
+	return TRUE;
+}
+
+/**
+ * Thread pool task finalising a band of an accumulator into the master frame.
+ * @param user_data The band structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread (unused).
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed. Only the first band to fail records
+ *         it's error in the band structure.
+ * @see #Accumulate_Sigma_Clip_Estimate
+ * @see dprt_combine.html#DpRt_Combine_Pixels
+ */
+static int Accumulate_Finalise_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Accumulate_Band_Struct *band = (struct Accumulate_Band_Struct *)user_data;
+	struct Accumulate_Struct *accumulator = band->Accumulator;
+	size_t start,end,pixel_count,i;
+
+	(void)thread_index;
+	pixel_count = ((size_t)accumulator->Naxis_One)*((size_t)accumulator->Naxis_Two);
+	start = ((size_t)band_index)*((size_t)band->Band_Rows)*((size_t)accumulator->Naxis_One);
+	end = start+(((size_t)band->Band_Rows)*((size_t)accumulator->Naxis_One));
+	if(end > pixel_count)
+		end = pixel_count;
+	if(band->Parameters->Method == DPRT_COMBINE_METHOD_MEAN)
+	{
+		for(i=start;i<end;i++)
+			band->Output[i] = (float)(accumulator->Sum[i]/((double)accumulator->Frame_Count));
+		return TRUE;
+	}
+	if((band->Parameters->Method == DPRT_COMBINE_METHOD_SIGMA_CLIP)&&
+	   (accumulator->Frame_Count > accumulator->Reservoir_Count))
+	{
+		Accumulate_Sigma_Clip_Estimate(accumulator,band->Parameters->Kappa,start,end-start,
+					       band->Output+start);
+		return TRUE;
+	}
+	if(!DpRt_Combine_Pixels(band->Parameters,accumulator->Reservoir+start,pixel_count,
+				accumulator->Reservoir_Count,accumulator->Scale_List,end-start,band->Output+start))
+	{
+		pthread_mutex_lock(&(band->Error_Mutex));
+		if(band->Failed == FALSE)
+		{
+			band->Error_Number = DpRt_Error_Number;
+			strcpy(band->Error_String,DpRt_Error_String);
+			band->Failed = TRUE;
+		}
+		pthread_mutex_unlock(&(band->Error_Mutex));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Estimate the sigma clipped mean of pixels of an accumulator with more frames than it's reservoir holds.
+ * Each pixel's values are clipped once, at kappa standard deviations from the mean of all the frames (from the
+ * sums). The reservoir values that are clipped are removed from the sum of all the frames. Values in frames
+ * that are not in the reservoir cannot be clipped, and stay in the mean (scaling the reservoir's clipped values
+ * up to all the frames instead would turn a single outlier into several).
+ * @param accumulator The accumulator.
+ * @param kappa The number of standard deviations from the mean beyond which values are rejected.
+ * @param start The index of the first pixel.
+ * @param pixel_count The number of pixels.
+ * @param output The address of a buffer of pixel_count floats to store the clipped means.
+ */
+static void Accumulate_Sigma_Clip_Estimate(struct Accumulate_Struct *accumulator,double kappa,size_t start,
+					   size_t pixel_count,float *output)
+{
+	size_t frame_stride,i;
+	double frame_count,mean,variance,limit,value,clipped_sum,clipped_count;
+	int slot;
+
+	frame_stride = ((size_t)accumulator->Naxis_One)*((size_t)accumulator->Naxis_Two);
+	frame_count = (double)accumulator->Frame_Count;
+	for(i=0;i<pixel_count;i++)
+	{
+		mean = accumulator->Sum[start+i]/frame_count;
+		variance = (accumulator->Sum_Squares[start+i]/frame_count)-(mean*mean);
+		output[i] = (float)mean;
+		if(variance <= 0.0)
+			continue;
+		limit = kappa*sqrt(variance);
+		clipped_sum = 0.0;
+		clipped_count = 0.0;
+		for(slot=0;slot<accumulator->Reservoir_Count;slot++)
+		{
+			value = ((double)accumulator->Reservoir[(slot*frame_stride)+start+i])*
+				accumulator->Scale_List[slot];
+			if(fabs(value-mean) > limit)
+			{
+				clipped_sum += value;
+				clipped_count += 1.0;
+			}
+		}
+		if(clipped_count < frame_count)
+		{
+			output[i] = (float)((accumulator->Sum[start+i]-clipped_sum)/
+					    (frame_count-clipped_count));
+		}
+	}
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,1100 @@
+/* dprt_arc.c
+** Arc line finding and dispersion solution fitting.
+** $Header$
+*/
+/**
+ * dprt_arc.c finds the emission lines in a Sprat arc frame and fits a dispersion solution to them, so quick-look
+ * spectra can be wavelength calibrated as they are extracted. The arc is collapsed along the spatial axis into a
+ * 1D spectrum, a chunk of calibrated pixels at a time, and the lines are found with a branch free local maximum
+ * test over the whole spectrum, followed by a parabolic fit to each peak. The lines are matched against a line
+ * list, and a polynomial of the column fitted to their wavelengths. The solution is cached in memory for each frame
+ * size, and persisted in the calibration directory, so it survives a restart. A new arc refines the cached solution,
+ * matching it's lines to the line list around the cached solution's wavelengths, and only searches for the solution
+ * from scratch, around an initial guess, if there is no cached solution or refining it fails.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_calibration.h"
+#include "dprt_combine.h"
+#include "dprt_overscan.h"
+#include "dprt_source.h"
+#include "dprt_arc.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The ratio of the standard deviation of a normal distribution to it's median absolute deviation.
+ */
+#define ARC_SIGMA_PER_MAD		(1.4826)
+/**
+ * The maximum number of times the lines are re-matched and the solution refitted.
+ */
+#define ARC_ITERATIONS			(4)
+/**
+ * The maximum number of initial guesses tried when searching for a solution from scratch.
+ */
+#define ARC_MAX_SEARCH_STEPS		(10000)
+/**
+ * The prefix of a dispersion solution's filename, in the calibration directory.
+ */
+#define ARC_FILENAME_PREFIX		("dispersion_")
+/**
+ * The suffix of a dispersion solution's filename.
+ */
+#define ARC_FILENAME_SUFFIX		(".fits")
+/**
+ * The length of a line in a line list file.
+ */
+#define ARC_LINE_LENGTH			(256)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a cached dispersion solution.
+ * <dl>
+ * <dt>Naxis_One</dt> <dd>The number of columns of the frames the entry is for, zero if the entry is unused.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows of the frames the entry is for.</dd>
+ * <dt>Solution</dt> <dd>The solution. If it is not valid, there was no solution on disk for this frame size.</dd>
+ * <dt>Last_Used</dt> <dd>The value of Arc_Use_Count when the entry was last used.</dd>
+ * </dl>
+ */
+struct Arc_Cache_Struct
+{
+	int Naxis_One;
+	int Naxis_Two;
+	struct DpRt_Arc_Solution_Struct Solution;
+	unsigned long Last_Used;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The cached dispersion solutions.
+ * @see #Arc_Cache_Struct
+ */
+static struct Arc_Cache_Struct Arc_Cache_List[DPRT_ARC_SOLUTION_COUNT];
+/**
+ * A counter incremented every time a cached solution is used, used to find the least recently used solution.
+ */
+static unsigned long Arc_Use_Count = 0;
+/**
+ * Mutex protecting the cached dispersion solutions, and their files.
+ */
+static pthread_mutex_t Arc_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Arc_Match(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		     int wavelength_count,struct DpRt_Arc_Solution_Struct *solution,double tolerance,
+		     double *residual_sum);
+static int Arc_Fit(struct DpRt_Arc_Line_Struct *line_list,int line_count,int order,
+		   struct DpRt_Arc_Solution_Struct *solution);
+static int Arc_Refine(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		      int wavelength_count,struct DpRt_Arc_Parameter_Struct *parameters,double tolerance,
+		      int first_order,struct DpRt_Arc_Solution_Struct *solution);
+static int Arc_Search(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		      int wavelength_count,struct DpRt_Arc_Parameter_Struct *parameters,
+		      struct DpRt_Arc_Solution_Struct *solution);
+static struct Arc_Cache_Struct *Arc_Cache_Find(int naxis_one,int naxis_two);
+static int Arc_Get_Filename(int naxis_one,int naxis_two,char *filename,size_t filename_length);
+static int Arc_Load(char *filename,int naxis_one,int naxis_two,struct DpRt_Arc_Solution_Struct *solution);
+static int Arc_Save(char *filename,struct DpRt_Arc_Solution_Struct *solution);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the arc line finding and dispersion solution parameters from the configuration ("dprt.arc.line_list",
+ * "dprt.arc.detect_sigma", "dprt.arc.order", "dprt.arc.initial.central_wavelength", "dprt.arc.initial.dispersion",
+ * "dprt.arc.initial.search_range", "dprt.arc.match_tolerance", "dprt.arc.refine_tolerance", "dprt.arc.min_lines"
+ * and "dprt.arc.max_rms").
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_ARC_MAX_ORDER
+ * @see #DPRT_ARC_FILENAME_LENGTH
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Get_Parameters(struct DpRt_Arc_Parameter_Struct *parameters)
+{
+	char *line_list_filename = NULL;
+
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 2000;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Double("dprt.arc.detect_sigma",&(parameters->Detect_Sigma)))||
+	   (!DpRt_Config_Get_Integer("dprt.arc.order",&(parameters->Order)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.initial.central_wavelength",&(parameters->Central_Wavelength)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.initial.dispersion",&(parameters->Dispersion)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.initial.search_range",&(parameters->Search_Range)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.match_tolerance",&(parameters->Match_Tolerance)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.refine_tolerance",&(parameters->Refine_Tolerance)))||
+	   (!DpRt_Config_Get_Integer("dprt.arc.min_lines",&(parameters->Min_Lines)))||
+	   (!DpRt_Config_Get_Double("dprt.arc.max_rms",&(parameters->Max_RMS)))||
+	   (!DpRt_Config_Get_String("dprt.arc.line_list",&line_list_filename)))
+		return FALSE;
+	if((parameters->Order < 1)||(parameters->Order > DPRT_ARC_MAX_ORDER)||(parameters->Dispersion == 0.0)||
+	   (parameters->Search_Range < 0.0)||(parameters->Match_Tolerance <= 0.0)||
+	   (parameters->Refine_Tolerance <= 0.0)||(parameters->Min_Lines < parameters->Order+2)||
+	   (parameters->Max_RMS <= 0.0)||(strlen(line_list_filename) >= DPRT_ARC_FILENAME_LENGTH))
+	{
+		DpRt_Error_Number = 2001;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Get_Parameters:Illegal order %d (1..%d), dispersion %.3g, "
+			"search range %.3g, tolerances %.3g/%.3g, min lines %d (at least order+2), max rms %.3g "
+			"or line list filename.\n",parameters->Order,DPRT_ARC_MAX_ORDER,parameters->Dispersion,
+			parameters->Search_Range,parameters->Match_Tolerance,parameters->Refine_Tolerance,
+			parameters->Min_Lines,parameters->Max_RMS);
+		free(line_list_filename);
+		return FALSE;
+	}
+	strcpy(parameters->Line_List_Filename,line_list_filename);
+	free(line_list_filename);
+	return TRUE;
+}
+
+/**
+ * Read a line list: a text file with the wavelength of a line at the start of each line. Blank lines and lines
+ * starting with '#' are ignored, as is anything after the wavelength. The wavelengths are sorted into ascending
+ * order.
+ * @param filename The line list's filename.
+ * @param wavelength_list A list of DPRT_ARC_MAX_LINE_COUNT doubles to store the wavelengths in.
+ * @param wavelength_count The address of an integer to store the number of wavelengths in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #ARC_LINE_LENGTH
+ * @see #DPRT_ARC_MAX_LINE_COUNT
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Read_Line_List(char *filename,double *wavelength_list,int *wavelength_count)
+{
+	FILE *fp = NULL;
+	char line[ARC_LINE_LENGTH];
+	char *ch = NULL;
+	double wavelength;
+	int i;
+
+	if((filename == NULL)||(wavelength_list == NULL)||(wavelength_count == NULL))
+	{
+		DpRt_Error_Number = 2002;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Read_Line_List:Illegal arguments.\n");
+		return FALSE;
+	}
+	(*wavelength_count) = 0;
+	fp = fopen(filename,"r");
+	if(fp == NULL)
+	{
+		DpRt_Error_Number = 2003;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Read_Line_List:Failed to open %.200s.\n",filename);
+		return FALSE;
+	}
+	while(fgets(line,ARC_LINE_LENGTH,fp) != NULL)
+	{
+		ch = line;
+		while((*ch == ' ')||(*ch == '\t'))
+			ch++;
+		if((*ch == '#')||(*ch == '\n')||(*ch == '\r')||(*ch == '\0'))
+			continue;
+		if((sscanf(ch,"%lf",&wavelength) != 1)||((*wavelength_count) >= DPRT_ARC_MAX_LINE_COUNT))
+		{
+			fclose(fp);
+			(*wavelength_count) = 0;
+			DpRt_Error_Number = 2004;
+			sprintf(DpRt_Error_String,"DpRt_Arc_Read_Line_List:%.150s has an illegal line, or more than %d "
+				"lines.\n",filename,DPRT_ARC_MAX_LINE_COUNT);
+			return FALSE;
+		}
+		/* insertion sort, line lists are short */
+		for(i=(*wavelength_count);(i > 0)&&(wavelength_list[i-1] > wavelength);i--)
+			wavelength_list[i] = wavelength_list[i-1];
+		wavelength_list[i] = wavelength;
+		(*wavelength_count)++;
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+/**
+ * Collapse a frame along the spatial axis: sum each column of the data section, calibrating each row a chunk at
+ * a time into a buffer on the stack, which is added to the column sums whilst it is still in cache.
+ * @param frame The frame, and it's calibration.
+ * @param column_sum_list A list of at least frame->Naxis_One doubles, filled in with the column sums.
+ * @param start_x The address of an integer to store the first column of the data section in.
+ * @param length The address of an integer to store the number of columns of the data section in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_overscan.html#DpRt_Overscan_Get_Levels
+ * @see dprt_calibration.html#DpRt_Calibration_Apply_Pixels
+ * @see dprt_calibration.html#DPRT_CALIBRATION_CHUNK_PIXELS
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Collapse(struct DpRt_Source_Frame_Struct *frame,double *column_sum_list,int *start_x,int *length)
+{
+	unsigned short chunk[DPRT_CALIBRATION_CHUNK_PIXELS];
+	double *chunk_sum_list = NULL;
+	size_t row_start;
+	float level;
+	int end_x,start_y,end_y,chunk_count,x,y,i;
+
+	if((frame == NULL)||(column_sum_list == NULL)||(start_x == NULL)||(length == NULL))
+	{
+		DpRt_Error_Number = 2005;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Collapse:Illegal arguments.\n");
+		return FALSE;
+	}
+	if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+	{
+		(*start_x) = frame->Overscan->Trim_Start_X;
+		end_x = frame->Overscan->Trim_End_X;
+		start_y = frame->Overscan->Trim_Start_Y;
+		end_y = frame->Overscan->Trim_End_Y;
+	}
+	else
+	{
+		(*start_x) = 0;
+		end_x = frame->Naxis_One;
+		start_y = 0;
+		end_y = frame->Naxis_Two;
+	}
+	(*length) = end_x-(*start_x);
+	for(x=0;x<(*length);x++)
+		column_sum_list[x] = 0.0;
+	for(y=start_y;y<end_y;y++)
+	{
+		level = 0.0f;
+		if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+		{
+			if(!DpRt_Overscan_Get_Levels(frame->Overscan,frame->Data,frame->Encoding,frame->Naxis_One,y,1,
+						     frame->Bias,&level))
+				return FALSE;
+		}
+		row_start = (((size_t)y)*((size_t)frame->Naxis_One))+(*start_x);
+		for(x=0;x<(*length);x+=chunk_count)
+		{
+			chunk_count = (*length)-x;
+			if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+				chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+			DpRt_Calibration_Apply_Pixels(frame->Data,frame->Encoding,row_start+x,(size_t)chunk_count,level,
+						      frame->Bias,frame->Flat,frame->Mask,chunk);
+			chunk_sum_list = column_sum_list+x;
+			for(i=0;i<chunk_count;i++)
+				chunk_sum_list[i] += (double)chunk[i];
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Find the emission lines in a collapsed arc. A column is a line's peak if it is greater than the column before
+ * it, no less than the column after it, and more than Detect_Sigma standard deviations (estimated from the median
+ * absolute deviation) above the median of the collapsed arc. The test is made for every column in one branch free
+ * loop the compiler can vectorise, the flags being stored in work_list, and the (few) flagged columns are then
+ * collected, the centre of each line being the vertex of the parabola through it's peak and the columns either side.
+ * If there are more than DPRT_ARC_MAX_LINE_COUNT lines, the brightest are kept. The lines are returned in column
+ * order.
+ * @param column_sum_list The collapsed arc.
+ * @param start_x The column of the first element of the collapsed arc.
+ * @param length The number of elements in the collapsed arc.
+ * @param parameters The arc parameters.
+ * @param work_list A list of at least length doubles, used to find the medians and flag the peaks.
+ * @param line_list A list of DPRT_ARC_MAX_LINE_COUNT lines to fill in.
+ * @param line_count The address of an integer to store the number of lines found in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #ARC_SIGMA_PER_MAD
+ * @see dprt_combine.html#DpRt_Combine_Median_Double
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Find_Lines(double *column_sum_list,int start_x,int length,struct DpRt_Arc_Parameter_Struct *parameters,
+			double *work_list,struct DpRt_Arc_Line_Struct *line_list,int *line_count)
+{
+	struct DpRt_Arc_Line_Struct line;
+	double median,threshold,denominator,offset;
+	int faintest,x,i;
+
+	if((column_sum_list == NULL)||(parameters == NULL)||(work_list == NULL)||(line_list == NULL)||
+	   (line_count == NULL))
+	{
+		DpRt_Error_Number = 2006;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Find_Lines:Illegal arguments.\n");
+		return FALSE;
+	}
+	(*line_count) = 0;
+	if(length < 3)
+		return TRUE;
+	/* the median and median absolute deviation of the collapsed arc */
+	for(x=0;x<length;x++)
+		work_list[x] = column_sum_list[x];
+	median = DpRt_Combine_Median_Double(work_list,length);
+	for(x=0;x<length;x++)
+		work_list[x] = fabs(column_sum_list[x]-median);
+	threshold = median+(parameters->Detect_Sigma*ARC_SIGMA_PER_MAD*DpRt_Combine_Median_Double(work_list,length));
+	/* flag the peaks, without branches */
+	work_list[0] = 0.0;
+	work_list[length-1] = 0.0;
+	for(x=1;x<length-1;x++)
+	{
+		work_list[x] = (double)((column_sum_list[x] > column_sum_list[x-1])&
+					(column_sum_list[x] >= column_sum_list[x+1])&(column_sum_list[x] > threshold));
+	}
+	/* collect the flagged peaks, keeping the brightest */
+	for(x=1;x<length-1;x++)
+	{
+		if(work_list[x] == 0.0)
+			continue;
+		offset = 0.0;
+		denominator = column_sum_list[x-1]-(2.0*column_sum_list[x])+column_sum_list[x+1];
+		if(denominator < 0.0)
+			offset = 0.5*(column_sum_list[x-1]-column_sum_list[x+1])/denominator;
+		line.X = ((double)(start_x+x))+offset;
+		line.Peak = column_sum_list[x]-median;
+		line.Wavelength = 0.0;
+		line.Matched = FALSE;
+		if((*line_count) < DPRT_ARC_MAX_LINE_COUNT)
+		{
+			line_list[(*line_count)] = line;
+			(*line_count)++;
+			continue;
+		}
+		faintest = 0;
+		for(i=1;i<(*line_count);i++)
+		{
+			if(line_list[i].Peak < line_list[faintest].Peak)
+				faintest = i;
+		}
+		if(line.Peak > line_list[faintest].Peak)
+		{
+			/* keep the list in column order */
+			for(i=faintest;i<(*line_count)-1;i++)
+				line_list[i] = line_list[i+1];
+			line_list[(*line_count)-1] = line;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Fit a dispersion solution to the lines found in an arc. If there is a valid seed solution for frames of this
+ * size (the cached solution), the lines are matched to the line list within Match_Tolerance of the seed's
+ * wavelengths, which allows for the arc shifting by a pixel or two, and the solution refitted (see Arc_Refine).
+ * If that fails, or there is no seed, the solution is searched for from scratch around the initial guess (see
+ * Arc_Search). A solution is only returned as valid if it was fitted to at least Min_Lines lines with an rms
+ * residual of no more than Max_RMS.
+ * @param line_list The lines found in the arc (see DpRt_Arc_Find_Lines). Their Wavelength and Matched fields
+ *        are filled in.
+ * @param line_count The number of lines.
+ * @param wavelength_list The line list wavelengths, in ascending order (see DpRt_Arc_Read_Line_List).
+ * @param wavelength_count The number of line list wavelengths.
+ * @param naxis_one The number of columns in the arc frame.
+ * @param naxis_two The number of rows in the arc frame.
+ * @param parameters The arc parameters.
+ * @param seed_solution The cached solution to refine, or NULL.
+ * @param solution The address of a structure to fill in with the solution. It can be seed_solution.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Arc_Refine
+ * @see #Arc_Search
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Solve(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		   int wavelength_count,int naxis_one,int naxis_two,struct DpRt_Arc_Parameter_Struct *parameters,
+		   struct DpRt_Arc_Solution_Struct *seed_solution,struct DpRt_Arc_Solution_Struct *solution)
+{
+	struct DpRt_Arc_Solution_Struct seed;
+	int arc_count;
+
+	if((line_list == NULL)||(wavelength_list == NULL)||(parameters == NULL)||(solution == NULL)||
+	   (naxis_one < 1)||(naxis_two < 1))
+	{
+		DpRt_Error_Number = 2007;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Solve:Illegal arguments.\n");
+		return FALSE;
+	}
+	/* take a copy of the seed, so it can be the solution being filled in */
+	if(seed_solution != NULL)
+		seed = (*seed_solution);
+	else
+		seed.Valid = FALSE;
+	memset(solution,0,sizeof(struct DpRt_Arc_Solution_Struct));
+	solution->Valid = FALSE;
+	solution->Naxis_One = naxis_one;
+	solution->Naxis_Two = naxis_two;
+	solution->Centre_X = ((double)(naxis_one-1))/2.0;
+	solution->Scale_X = ((double)naxis_one)/2.0;
+	if(wavelength_count < 1)
+		return TRUE;
+	/* refine the cached solution */
+	if(seed.Valid && (seed.Naxis_One == naxis_one)&&(seed.Naxis_Two == naxis_two))
+	{
+		arc_count = seed.Arc_Count;
+		(*solution) = seed;
+		solution->Valid = Arc_Refine(line_list,line_count,wavelength_list,wavelength_count,parameters,
+					     parameters->Match_Tolerance,parameters->Order,solution);
+		if(solution->Valid && (solution->Line_Count >= parameters->Min_Lines)&&
+		   (solution->RMS <= parameters->Max_RMS))
+		{
+			solution->Arc_Count = arc_count+1;
+			return TRUE;
+		}
+		solution->Centre_X = ((double)(naxis_one-1))/2.0;
+		solution->Scale_X = ((double)naxis_one)/2.0;
+	}
+	/* otherwise search for a solution from scratch */
+	solution->Valid = Arc_Search(line_list,line_count,wavelength_list,wavelength_count,parameters,solution);
+	if(solution->Valid)
+		solution->Valid = Arc_Refine(line_list,line_count,wavelength_list,wavelength_count,parameters,
+					     parameters->Match_Tolerance,1,solution);
+	if(solution->Valid && ((solution->Line_Count < parameters->Min_Lines)||
+			       (solution->RMS > parameters->Max_RMS)))
+		solution->Valid = FALSE;
+	solution->Arc_Count = 1;
+	return TRUE;
+}
+
+/**
+ * Get the wavelength of a dispersion solution at a column.
+ * @param solution The dispersion solution.
+ * @param x The column.
+ * @return The wavelength.
+ * @see #DpRt_Arc_Solution_Struct
+ */
+double DpRt_Arc_Evaluate(struct DpRt_Arc_Solution_Struct *solution,double x)
+{
+	double u,wavelength;
+	int i;
+
+	u = (x-solution->Centre_X)/solution->Scale_X;
+	wavelength = 0.0;
+	for(i=solution->Order;i>=0;i--)
+		wavelength = (wavelength*u)+solution->Coefficient_List[i];
+	return wavelength;
+}
+
+/**
+ * Get the dispersion solution for frames of a size. If it is not cached in memory, it is loaded from the
+ * calibration directory (if "dprt.calibration.directory" is set), and cached. If there is no solution on disk
+ * either, that is cached too, so the disk is only looked at once for each frame size.
+ * @param naxis_one The number of columns in the frames.
+ * @param naxis_two The number of rows in the frames.
+ * @param solution The address of a structure to copy the solution into. If there is no solution, Valid is set
+ *        to FALSE.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Arc_Mutex
+ * @see #Arc_Cache_Find
+ * @see #Arc_Get_Filename
+ * @see #Arc_Load
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Solution_Get(int naxis_one,int naxis_two,struct DpRt_Arc_Solution_Struct *solution)
+{
+	struct Arc_Cache_Struct *entry = NULL;
+	char filename[DPRT_ARC_FILENAME_LENGTH];
+	struct stat file_stat;
+	int retval;
+
+	if(solution == NULL)
+	{
+		DpRt_Error_Number = 2008;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Solution_Get:solution was NULL.\n");
+		return FALSE;
+	}
+	solution->Valid = FALSE;
+	retval = TRUE;
+	pthread_mutex_lock(&Arc_Mutex);
+	entry = Arc_Cache_Find(naxis_one,naxis_two);
+	if((entry->Naxis_One != naxis_one)||(entry->Naxis_Two != naxis_two))
+	{
+		/* not cached, look on disk */
+		memset(entry,0,sizeof(struct Arc_Cache_Struct));
+		entry->Solution.Valid = FALSE;
+		filename[0] = '\0';
+		retval = Arc_Get_Filename(naxis_one,naxis_two,filename,DPRT_ARC_FILENAME_LENGTH);
+		if(retval && (strlen(filename) > 0)&&(stat(filename,&file_stat) == 0))
+		{
+			retval = Arc_Load(filename,naxis_one,naxis_two,&(entry->Solution));
+			if(retval)
+			{
+				fprintf(stdout,"DpRt_Arc_Solution_Get:Loaded %s:%d lines:RMS %.3f.\n",filename,
+					entry->Solution.Line_Count,entry->Solution.RMS);
+			}
+		}
+		if(retval)
+		{
+			entry->Naxis_One = naxis_one;
+			entry->Naxis_Two = naxis_two;
+		}
+	}
+	if(retval)
+	{
+		(*solution) = entry->Solution;
+		entry->Last_Used = ++Arc_Use_Count;
+	}
+	pthread_mutex_unlock(&Arc_Mutex);
+	return retval;
+}
+
+/**
+ * Cache a valid dispersion solution, for frames of it's size, replacing any cached solution for that size, and
+ * persist it in the calibration directory (if "dprt.calibration.directory" is set). Solutions that are not valid
+ * are not cached.
+ * @param solution The dispersion solution.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the solution is still cached in
+ *         memory if it failed to be written to disk).
+ * @see #Arc_Mutex
+ * @see #Arc_Cache_Find
+ * @see #Arc_Get_Filename
+ * @see #Arc_Save
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Arc_Solution_Put(struct DpRt_Arc_Solution_Struct *solution)
+{
+	struct Arc_Cache_Struct *entry = NULL;
+	char filename[DPRT_ARC_FILENAME_LENGTH];
+	int retval;
+
+	if(solution == NULL)
+	{
+		DpRt_Error_Number = 2009;
+		sprintf(DpRt_Error_String,"DpRt_Arc_Solution_Put:solution was NULL.\n");
+		return FALSE;
+	}
+	if(solution->Valid == FALSE)
+		return TRUE;
+	pthread_mutex_lock(&Arc_Mutex);
+	entry = Arc_Cache_Find(solution->Naxis_One,solution->Naxis_Two);
+	entry->Naxis_One = solution->Naxis_One;
+	entry->Naxis_Two = solution->Naxis_Two;
+	entry->Solution = (*solution);
+	entry->Last_Used = ++Arc_Use_Count;
+	filename[0] = '\0';
+	retval = Arc_Get_Filename(solution->Naxis_One,solution->Naxis_Two,filename,DPRT_ARC_FILENAME_LENGTH);
+	if(retval && (strlen(filename) > 0))
+		retval = Arc_Save(filename,solution);
+	pthread_mutex_unlock(&Arc_Mutex);
+	return retval;
+}
+
+/**
+ * Throw away all the cached dispersion solutions (they are still on disk).
+ * @return The routine returns TRUE.
+ * @see #Arc_Mutex
+ * @see #Arc_Cache_List
+ */
+int DpRt_Arc_Shutdown(void)
+{
+	int i;
+
+	pthread_mutex_lock(&Arc_Mutex);
+	for(i=0;i<DPRT_ARC_SOLUTION_COUNT;i++)
+	{
+		Arc_Cache_List[i].Naxis_One = 0;
+		Arc_Cache_List[i].Naxis_Two = 0;
+		Arc_Cache_List[i].Solution.Valid = FALSE;
+	}
+	Arc_Use_Count = 0;
+	pthread_mutex_unlock(&Arc_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Match the lines found in an arc to the line list, using a dispersion solution. Each line is matched to the
+ * nearest line list wavelength to the solution's wavelength at it's column, if they are within the tolerance. If
+ * more than one line matches the same line list wavelength, only the nearest is kept.
+ * @param line_list The lines. Their Wavelength and Matched fields are filled in.
+ * @param line_count The number of lines.
+ * @param wavelength_list The line list wavelengths, in ascending order.
+ * @param wavelength_count The number of line list wavelengths, at least one.
+ * @param solution The dispersion solution.
+ * @param tolerance The largest difference between a line's wavelength and the line list wavelength it matches.
+ * @param residual_sum The address of a double to store the sum of the absolute differences of the matched lines
+ *        in, or NULL.
+ * @return The number of lines matched.
+ * @see #DpRt_Arc_Evaluate
+ */
+static int Arc_Match(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		     int wavelength_count,struct DpRt_Arc_Solution_Struct *solution,double tolerance,
+		     double *residual_sum)
+{
+	double wavelength,difference;
+	int match_count,low,high,middle,nearest,i;
+
+	for(i=0;i<line_count;i++)
+	{
+		line_list[i].Matched = FALSE;
+		wavelength = DpRt_Arc_Evaluate(solution,line_list[i].X);
+		/* binary search for the first line list wavelength no less than the line's */
+		low = 0;
+		high = wavelength_count;
+		while(low < high)
+		{
+			middle = (low+high)/2;
+			if(wavelength_list[middle] < wavelength)
+				low = middle+1;
+			else
+				high = middle;
+		}
+		nearest = low;
+		if((nearest == wavelength_count)||((nearest > 0)&&((wavelength-wavelength_list[nearest-1]) <
+								   (wavelength_list[nearest]-wavelength))))
+			nearest--;
+		if(fabs(wavelength_list[nearest]-wavelength) <= tolerance)
+		{
+			line_list[i].Wavelength = wavelength_list[nearest];
+			line_list[i].Matched = TRUE;
+		}
+	}
+	/* the lines are in column order, so lines matching the same wavelength are next to each other (for a
+	** monotonic solution) */
+	for(i=1;i<line_count;i++)
+	{
+		if(line_list[i].Matched && line_list[i-1].Matched &&
+		   (line_list[i].Wavelength == line_list[i-1].Wavelength))
+		{
+			if(fabs(DpRt_Arc_Evaluate(solution,line_list[i].X)-line_list[i].Wavelength) <
+			   fabs(DpRt_Arc_Evaluate(solution,line_list[i-1].X)-line_list[i-1].Wavelength))
+				line_list[i-1].Matched = FALSE;
+			else
+				line_list[i].Matched = FALSE;
+		}
+	}
+	match_count = 0;
+	if(residual_sum != NULL)
+		(*residual_sum) = 0.0;
+	for(i=0;i<line_count;i++)
+	{
+		if(line_list[i].Matched)
+		{
+			match_count++;
+			if(residual_sum != NULL)
+			{
+				difference = DpRt_Arc_Evaluate(solution,line_list[i].X)-line_list[i].Wavelength;
+				(*residual_sum) += fabs(difference);
+			}
+		}
+	}
+	return match_count;
+}
+
+/**
+ * Fit a polynomial to the wavelengths of the matched lines by least squares. The order is reduced if there are too
+ * few matched lines to leave a residual.
+ * @param line_list The lines, the matched lines are fitted.
+ * @param line_count The number of lines.
+ * @param order The order of the polynomial.
+ * @param solution The solution, with Centre_X and Scale_X set. The fitted Order, Coefficient_List, RMS and
+ *        Line_Count are filled in.
+ * @return The routine returns TRUE if the fit succeeded, and FALSE if there were too few matched lines.
+ * @see #DpRt_Arc_Evaluate
+ */
+static int Arc_Fit(struct DpRt_Arc_Line_Struct *line_list,int line_count,int order,
+		   struct DpRt_Arc_Solution_Struct *solution)
+{
+	double matrix[DPRT_ARC_MAX_ORDER+1][DPRT_ARC_MAX_ORDER+2];
+	double power_list[(2*DPRT_ARC_MAX_ORDER)+1];
+	double u,power,swap,factor,residual,residual_sum,value;
+	int used_count,i,j,k,pivot;
+
+	used_count = 0;
+	for(i=0;i<line_count;i++)
+	{
+		if(line_list[i].Matched)
+			used_count++;
+	}
+	if(order > used_count-2)
+		order = used_count-2;
+	if(order < 1)
+		return FALSE;
+	/* the normal equations, solved by gaussian elimination with partial pivoting */
+	memset(matrix,0,sizeof(matrix));
+	for(i=0;i<line_count;i++)
+	{
+		if(line_list[i].Matched == FALSE)
+			continue;
+		u = (line_list[i].X-solution->Centre_X)/solution->Scale_X;
+		power = 1.0;
+		for(j=0;j<=2*order;j++)
+		{
+			power_list[j] = power;
+			power *= u;
+		}
+		for(j=0;j<=order;j++)
+		{
+			for(k=0;k<=order;k++)
+				matrix[j][k] += power_list[j+k];
+			matrix[j][order+1] += power_list[j]*line_list[i].Wavelength;
+		}
+	}
+	for(j=0;j<=order;j++)
+	{
+		pivot = j;
+		for(k=j+1;k<=order;k++)
+		{
+			if(fabs(matrix[k][j]) > fabs(matrix[pivot][j]))
+				pivot = k;
+		}
+		if(fabs(matrix[pivot][j]) < 1.0e-12)
+			return FALSE;
+		for(k=0;k<=order+1;k++)
+		{
+			swap = matrix[j][k];
+			matrix[j][k] = matrix[pivot][k];
+			matrix[pivot][k] = swap;
+		}
+		for(i=j+1;i<=order;i++)
+		{
+			factor = matrix[i][j]/matrix[j][j];
+			for(k=j;k<=order+1;k++)
+				matrix[i][k] -= factor*matrix[j][k];
+		}
+	}
+	for(j=order;j>=0;j--)
+	{
+		value = matrix[j][order+1];
+		for(k=j+1;k<=order;k++)
+			value -= matrix[j][k]*solution->Coefficient_List[k];
+		solution->Coefficient_List[j] = value/matrix[j][j];
+	}
+	for(j=order+1;j<=DPRT_ARC_MAX_ORDER;j++)
+		solution->Coefficient_List[j] = 0.0;
+	solution->Order = order;
+	solution->Line_Count = used_count;
+	residual_sum = 0.0;
+	for(i=0;i<line_count;i++)
+	{
+		if(line_list[i].Matched)
+		{
+			residual = line_list[i].Wavelength-DpRt_Arc_Evaluate(solution,line_list[i].X);
+			residual_sum += residual*residual;
+		}
+	}
+	solution->RMS = sqrt(residual_sum/((double)(used_count-order-1)));
+	return TRUE;
+}
+
+/**
+ * Refine a dispersion solution: match the lines to the line list using the solution, refit it, and repeat
+ * (matching within Refine_Tolerance of the refitted solution) until the matched lines do not change, at most
+ * ARC_ITERATIONS times. The first fit is of first_order, later fits of parameters->Order, so a linear initial guess
+ * can be refined to a higher order solution.
+ * @param line_list The lines.
+ * @param line_count The number of lines.
+ * @param wavelength_list The line list wavelengths, in ascending order.
+ * @param wavelength_count The number of line list wavelengths.
+ * @param parameters The arc parameters.
+ * @param tolerance The tolerance of the first match.
+ * @param first_order The order of the first fit.
+ * @param solution The solution to refine, refined in place.
+ * @return The routine returns TRUE if the solution was refitted, and FALSE if too few lines matched.
+ * @see #ARC_ITERATIONS
+ * @see #Arc_Match
+ * @see #Arc_Fit
+ */
+static int Arc_Refine(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		      int wavelength_count,struct DpRt_Arc_Parameter_Struct *parameters,double tolerance,
+		      int first_order,struct DpRt_Arc_Solution_Struct *solution)
+{
+	double last_wavelength_sum,wavelength_sum;
+	int match_count,last_match_count,iteration,i;
+
+	last_match_count = -1;
+	last_wavelength_sum = 0.0;
+	for(iteration=0;iteration<ARC_ITERATIONS;iteration++)
+	{
+		match_count = Arc_Match(line_list,line_count,wavelength_list,wavelength_count,solution,tolerance,NULL);
+		wavelength_sum = 0.0;
+		for(i=0;i<line_count;i++)
+		{
+			if(line_list[i].Matched)
+				wavelength_sum += line_list[i].Wavelength*((double)(i+1));
+		}
+		/* stop when the fit of the full order has the same lines as the last one */
+		if((iteration > 1)&&(match_count == last_match_count)&&(wavelength_sum == last_wavelength_sum))
+			break;
+		if(!Arc_Fit(line_list,line_count,(iteration == 0) ? first_order : parameters->Order,solution))
+			return FALSE;
+		last_match_count = match_count;
+		last_wavelength_sum = wavelength_sum;
+		tolerance = parameters->Refine_Tolerance;
+	}
+	/* leave the lines matched to the final solution */
+	Arc_Match(line_list,line_count,wavelength_list,wavelength_count,solution,tolerance,NULL);
+	return TRUE;
+}
+
+/**
+ * Search for a linear dispersion solution from scratch. Linear solutions with the initial dispersion, and a
+ * central wavelength stepped across Search_Range either side of the initial central wavelength, in steps of half
+ * the Match_Tolerance, are tried, and the one matching the most lines (within Match_Tolerance) to the line list
+ * kept, ties going to the one with the smallest total difference.
+ * @param line_list The lines.
+ * @param line_count The number of lines.
+ * @param wavelength_list The line list wavelengths, in ascending order.
+ * @param wavelength_count The number of line list wavelengths.
+ * @param parameters The arc parameters.
+ * @param solution The solution, with Centre_X and Scale_X set. Order and Coefficient_List are filled in with the
+ *        best linear solution.
+ * @return The routine returns TRUE if a solution matching at least two lines was found, and FALSE otherwise.
+ * @see #ARC_MAX_SEARCH_STEPS
+ * @see #Arc_Match
+ */
+static int Arc_Search(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+		      int wavelength_count,struct DpRt_Arc_Parameter_Struct *parameters,
+		      struct DpRt_Arc_Solution_Struct *solution)
+{
+	double step,residual_sum,best_residual_sum,best_offset;
+	int step_count,match_count,best_match_count,i;
+
+	step = parameters->Match_Tolerance/2.0;
+	step_count = (int)floor(parameters->Search_Range/step);
+	if(step_count > ARC_MAX_SEARCH_STEPS)
+	{
+		step_count = ARC_MAX_SEARCH_STEPS;
+		step = parameters->Search_Range/((double)step_count);
+	}
+	memset(solution->Coefficient_List,0,sizeof(solution->Coefficient_List));
+	solution->Order = 1;
+	solution->Coefficient_List[1] = parameters->Dispersion*solution->Scale_X;
+	best_match_count = 0;
+	best_residual_sum = 0.0;
+	best_offset = 0.0;
+	for(i=-step_count;i<=step_count;i++)
+	{
+		solution->Coefficient_List[0] = parameters->Central_Wavelength+(((double)i)*step);
+		match_count = Arc_Match(line_list,line_count,wavelength_list,wavelength_count,solution,
+					parameters->Match_Tolerance,&residual_sum);
+		if((match_count > best_match_count)||
+		   ((match_count == best_match_count)&&(residual_sum < best_residual_sum)))
+		{
+			best_match_count = match_count;
+			best_residual_sum = residual_sum;
+			best_offset = ((double)i)*step;
+		}
+	}
+	solution->Coefficient_List[0] = parameters->Central_Wavelength+best_offset;
+	return (best_match_count >= 2);
+}
+
+/**
+ * Find the cache entry for frames of a size. Arc_Mutex must be held.
+ * @param naxis_one The number of columns in the frames.
+ * @param naxis_two The number of rows in the frames.
+ * @return The entry for the frame size if there is one, otherwise an unused entry or the least recently used one,
+ *         which the caller must check the size of, and fill in.
+ * @see #Arc_Cache_List
+ */
+static struct Arc_Cache_Struct *Arc_Cache_Find(int naxis_one,int naxis_two)
+{
+	int index,i;
+
+	index = -1;
+	for(i=0;i<DPRT_ARC_SOLUTION_COUNT;i++)
+	{
+		if((Arc_Cache_List[i].Naxis_One == naxis_one)&&(Arc_Cache_List[i].Naxis_Two == naxis_two))
+			return &(Arc_Cache_List[i]);
+	}
+	for(i=0;i<DPRT_ARC_SOLUTION_COUNT;i++)
+	{
+		if(Arc_Cache_List[i].Naxis_One == 0)
+			return &(Arc_Cache_List[i]);
+		if((index < 0)||(Arc_Cache_List[i].Last_Used < Arc_Cache_List[index].Last_Used))
+			index = i;
+	}
+	return &(Arc_Cache_List[index]);
+}
+
+/**
+ * Get the filename the dispersion solution for frames of a size is persisted in:
+ * &lt;dprt.calibration.directory&gt;/dispersion_&lt;naxis_one&gt;x&lt;naxis_two&gt;.fits, or an empty string if
+ * "dprt.calibration.directory" is not set.
+ * @param naxis_one The number of columns in the frames.
+ * @param naxis_two The number of rows in the frames.
+ * @param filename A string to store the filename in.
+ * @param filename_length The length of the filename string, including the terminator.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (or the filename was too long).
+ * @see #ARC_FILENAME_PREFIX
+ * @see #ARC_FILENAME_SUFFIX
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Arc_Get_Filename(int naxis_one,int naxis_two,char *filename,size_t filename_length)
+{
+	char *directory_name = NULL;
+	int length;
+
+	filename[0] = '\0';
+	if(!DpRt_Config_Get_String("dprt.calibration.directory",&directory_name))
+		return FALSE;
+	if(strlen(directory_name) == 0)
+	{
+		free(directory_name);
+		return TRUE;
+	}
+	length = snprintf(filename,filename_length,"%s/%s%dx%d%s",directory_name,ARC_FILENAME_PREFIX,naxis_one,
+			  naxis_two,ARC_FILENAME_SUFFIX);
+	if((length < 0)||(((size_t)length) >= filename_length))
+	{
+		DpRt_Error_Number = 2010;
+		sprintf(DpRt_Error_String,"Arc_Get_Filename:Dispersion solution filename in %.128s too long.\n",
+			directory_name);
+		free(directory_name);
+		return FALSE;
+	}
+	free(directory_name);
+	return TRUE;
+}
+
+/**
+ * Load a dispersion solution persisted by Arc_Save.
+ * @param filename The filename of the solution.
+ * @param naxis_one The number of columns in the frames the solution is for.
+ * @param naxis_two The number of rows in the frames the solution is for.
+ * @param solution The address of a structure to fill in with the solution.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Arc_Save
+ * @see #DPRT_ARC_MAX_ORDER
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Arc_Load(char *filename,int naxis_one,int naxis_two,struct DpRt_Arc_Solution_Struct *solution)
+{
+	fitsfile *fp = NULL;
+	char keyword[FLEN_KEYWORD];
+	int i,status = 0;
+
+	memset(solution,0,sizeof(struct DpRt_Arc_Solution_Struct));
+	solution->Valid = FALSE;
+	if(fits_open_file(&fp,filename,READONLY,&status)||
+	   fits_read_key(fp,TINT,"DISPORD",&(solution->Order),NULL,&status)||
+	   fits_read_key(fp,TDOUBLE,"DISPXCEN",&(solution->Centre_X),NULL,&status)||
+	   fits_read_key(fp,TDOUBLE,"DISPXSCL",&(solution->Scale_X),NULL,&status)||
+	   fits_read_key(fp,TDOUBLE,"DISPRMS",&(solution->RMS),NULL,&status)||
+	   fits_read_key(fp,TINT,"DISPNLIN",&(solution->Line_Count),NULL,&status)||
+	   fits_read_key(fp,TINT,"DISPNARC",&(solution->Arc_Count),NULL,&status)||
+	   (solution->Order < 1)||(solution->Order > DPRT_ARC_MAX_ORDER)||(solution->Scale_X == 0.0))
+	{
+		fits_report_error(stderr,status);
+		if(fp != NULL)
+		{
+			status = 0;
+			fits_close_file(fp,&status);
+		}
+		DpRt_Error_Number = 2011;
+		sprintf(DpRt_Error_String,"Arc_Load:Failed to read dispersion solution %.200s.\n",filename);
+		return FALSE;
+	}
+	for(i=0;i<=solution->Order;i++)
+	{
+		sprintf(keyword,"DISPC%d",i);
+		if(fits_read_key(fp,TDOUBLE,keyword,&(solution->Coefficient_List[i]),NULL,&status))
+		{
+			fits_report_error(stderr,status);
+			status = 0;
+			fits_close_file(fp,&status);
+			DpRt_Error_Number = 2011;
+			sprintf(DpRt_Error_String,"Arc_Load:Failed to read dispersion solution %.200s.\n",filename);
+			return FALSE;
+		}
+	}
+	fits_close_file(fp,&status);
+	/* the centre column is 1 based in FITS */
+	solution->Centre_X -= 1.0;
+	solution->Naxis_One = naxis_one;
+	solution->Naxis_Two = naxis_two;
+	solution->Valid = TRUE;
+	return TRUE;
+}
+
+/**
+ * Persist a dispersion solution as a FITS file with no data, overwriting any existing file. The header holds the
+ * order (DISPORD) and coefficients (DISPC0...) of the polynomial giving the wavelength at each column, of the
+ * variable (column-DISPXCEN)/DISPXSCL, with the columns 1 based, the rms residual (DISPRMS), the number of lines
+ * fitted (DISPNLIN) and the number of arcs the solution was refined with (DISPNARC).
+ * @param filename The filename to write the solution to.
+ * @param solution The solution.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Arc_Load
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Arc_Save(char *filename,struct DpRt_Arc_Solution_Struct *solution)
+{
+	fitsfile *fp = NULL;
+	char fits_filename[DPRT_ARC_FILENAME_LENGTH+1];
+	char keyword[FLEN_KEYWORD];
+	double centre_x;
+	int i,status = 0;
+
+	snprintf(fits_filename,DPRT_ARC_FILENAME_LENGTH+1,"!%s",filename);
+	centre_x = solution->Centre_X+1.0;
+	fits_create_file(&fp,fits_filename,&status);
+	fits_create_img(fp,SHORT_IMG,0,NULL,&status);
+	fits_update_key(fp,TINT,"DISPORD",&(solution->Order),"Order of the dispersion polynomial",&status);
+	for(i=0;i<=solution->Order;i++)
+	{
+		sprintf(keyword,"DISPC%d",i);
+		fits_update_key(fp,TDOUBLE,keyword,&(solution->Coefficient_List[i]),"Dispersion polynomial coefficient",
+				&status);
+	}
+	fits_update_key(fp,TDOUBLE,"DISPXCEN",&centre_x,"Dispersion polynomial centre column",&status);
+	fits_update_key(fp,TDOUBLE,"DISPXSCL",&(solution->Scale_X),"Dispersion polynomial column scale",&status);
+	fits_update_key(fp,TDOUBLE,"DISPRMS",&(solution->RMS),"Dispersion fit rms residual",&status);
+	fits_update_key(fp,TINT,"DISPNLIN",&(solution->Line_Count),"Number of arc lines fitted",&status);
+	fits_update_key(fp,TINT,"DISPNARC",&(solution->Arc_Count),"Number of arcs the solution was refined with",
+			&status);
+	if(status)
+	{
+		fits_report_error(stderr,status);
+		if(fp != NULL)
+		{
+			status = 0;
+			fits_close_file(fp,&status);
+			remove(filename);
+		}
+		DpRt_Error_Number = 2012;
+		sprintf(DpRt_Error_String,"Arc_Save:Failed to write dispersion solution %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_close_file(fp,&status))
+	{
+		fits_report_error(stderr,status);
+		remove(filename);
+		DpRt_Error_Number = 2013;
+		sprintf(DpRt_Error_String,"Arc_Save:Failed to close dispersion solution %.200s.\n",filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
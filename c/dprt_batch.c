@@ -0,0 +1,240 @@
+/* dprt_batch.c
+** Pipelined processing of batches of frames, overlapping reading with processing.
+** $Header$
+*/
+/**
+ * dprt_batch.c runs a batch of items (usually frames) through a two stage pipeline. A read thread, created for the
+ * batch, calls a read function for each item in turn, putting the result into one of a small ring of slots.
+ * The calling thread calls a process function for each item, in order, as soon as it has been read. The read of
+ * item N+1 (opening the FITS file and getting it's data into memory) therefore overlaps the processing of item N.
+ * The number of slots (the depth) bounds the number of items in memory at once; a depth of two gives double
+ * buffering.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_batch.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the state of one slot of a batch.
+ * <dl>
+ * <dt>Is_Full</dt> <dd>A boolean, TRUE when an item has been read into the slot and not yet processed.</dd>
+ * <dt>Read_Retval</dt> <dd>The value returned by the read function for the item in the slot.</dd>
+ * <dt>Error_Number</dt> <dd>The read thread's error number, if the read failed.</dd>
+ * <dt>Error_String</dt> <dd>The read thread's error string, if the read failed.</dd>
+ * </dl>
+ */
+struct Batch_Slot_Struct
+{
+	int Is_Full;
+	int Read_Retval;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+};
+
+/**
+ * Structure holding the state of a batch. The structure lives on the stack of the DpRt_Batch_Run call.
+ * <dl>
+ * <dt>Context</dt> <dd>The context the batch is running in, whose abort flag stops further reads.</dd>
+ * <dt>Count</dt> <dd>The number of items in the batch.</dd>
+ * <dt>Depth</dt> <dd>The number of slots in use.</dd>
+ * <dt>Read_Function</dt> <dd>The function to read an item.</dd>
+ * <dt>User_Data</dt> <dd>The user data passed to the read and process functions.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting the slots.</dd>
+ * <dt>Condition</dt> <dd>Condition signalled when a slot is filled or emptied.</dd>
+ * <dt>Slot_List</dt> <dd>The slots.</dd>
+ * </dl>
+ * @see #Batch_Slot_Struct
+ */
+struct Batch_Struct
+{
+	DpRt_Context *Context;
+	int Count;
+	int Depth;
+	DpRt_Batch_Read_Function Read_Function;
+	void *User_Data;
+	pthread_mutex_t Mutex;
+	pthread_cond_t Condition;
+	struct Batch_Slot_Struct Slot_List[DPRT_BATCH_MAX_DEPTH];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void *Batch_Read_Thread(void *arg);
+static void Batch_Read_Item(struct Batch_Struct *batch,int index,struct Batch_Slot_Struct *slot);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Run a batch of count items through the read and process functions. Items are read on a read thread created
+ * for the batch, up to depth-1 items ahead of the item being processed on the calling thread. Items are
+ * processed in order. If the context's abort flag is set, the remaining items are not read, and are passed to
+ * the process function as failed reads. If the read thread cannot be created, the items are read and processed
+ * in turn on the calling thread.
+ * @param context The context the batch is running in, or NULL for the default context.
+ * @param count The number of items.
+ * @param depth The number of slots to use, between 1 and DPRT_BATCH_MAX_DEPTH. Values outside this range
+ *        are clamped.
+ * @param read_function The function called to read an item.
+ * @param process_function The function called to process an item.
+ * @param user_data A pointer passed to each call of read_function and process_function.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed. Individual item failures are
+ *         passed to the process function, and do not make this routine fail.
+ * @see #Batch_Read_Thread
+ * @see #Batch_Read_Item
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Batch_Run(DpRt_Context *context,int count,int depth,DpRt_Batch_Read_Function read_function,
+		   DpRt_Batch_Process_Function process_function,void *user_data)
+{
+	struct Batch_Struct batch;
+	struct Batch_Slot_Struct *slot = NULL;
+	pthread_t read_thread;
+	int i,retval;
+
+	if((count < 0)||(read_function == NULL)||(process_function == NULL))
+	{
+		DpRt_Error_Number = 900;
+		sprintf(DpRt_Error_String,"DpRt_Batch_Run:Illegal count (%d) or NULL function.\n",count);
+		return FALSE;
+	}
+	if(depth < 1)
+		depth = 1;
+	if(depth > DPRT_BATCH_MAX_DEPTH)
+		depth = DPRT_BATCH_MAX_DEPTH;
+	batch.Context = context;
+	batch.Count = count;
+	batch.Depth = depth;
+	batch.Read_Function = read_function;
+	batch.User_Data = user_data;
+	for(i=0;i<depth;i++)
+		batch.Slot_List[i].Is_Full = FALSE;
+	if(count == 0)
+		return TRUE;
+	pthread_mutex_init(&(batch.Mutex),NULL);
+	pthread_cond_init(&(batch.Condition),NULL);
+	retval = pthread_create(&read_thread,NULL,Batch_Read_Thread,&batch);
+	if(retval != 0)
+	{
+		fprintf(stderr,"DpRt_Batch_Run:Failed to create read thread (%d):Reading serially.\n",retval);
+		for(i=0;i<count;i++)
+		{
+			slot = &(batch.Slot_List[0]);
+			Batch_Read_Item(&batch,i,slot);
+			if(slot->Read_Retval == FALSE)
+			{
+				DpRt_Error_Number = slot->Error_Number;
+				strcpy(DpRt_Error_String,slot->Error_String);
+			}
+			process_function(i,0,slot->Read_Retval,user_data);
+		}
+	}
+	else
+	{
+		for(i=0;i<count;i++)
+		{
+			slot = &(batch.Slot_List[i%depth]);
+			pthread_mutex_lock(&(batch.Mutex));
+			while(slot->Is_Full == FALSE)
+				pthread_cond_wait(&(batch.Condition),&(batch.Mutex));
+			pthread_mutex_unlock(&(batch.Mutex));
+			/* pass any read error to the process function in this thread's error number/string */
+			if(slot->Read_Retval == FALSE)
+			{
+				DpRt_Error_Number = slot->Error_Number;
+				strcpy(DpRt_Error_String,slot->Error_String);
+			}
+			process_function(i,i%depth,slot->Read_Retval,user_data);
+			pthread_mutex_lock(&(batch.Mutex));
+			slot->Is_Full = FALSE;
+			pthread_cond_broadcast(&(batch.Condition));
+			pthread_mutex_unlock(&(batch.Mutex));
+		}
+		pthread_join(read_thread,NULL);
+	}
+	pthread_cond_destroy(&(batch.Condition));
+	pthread_mutex_destroy(&(batch.Mutex));
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * The batch's read thread. Reads each item in turn into the next slot, waiting for the slot to be emptied by
+ * the calling thread first.
+ * @param arg The batch structure.
+ * @return The routine returns NULL.
+ * @see #Batch_Read_Item
+ */
+static void *Batch_Read_Thread(void *arg)
+{
+	struct Batch_Struct *batch = (struct Batch_Struct *)arg;
+	struct Batch_Slot_Struct *slot = NULL;
+	int i;
+
+	for(i=0;i<batch->Count;i++)
+	{
+		slot = &(batch->Slot_List[i%batch->Depth]);
+		pthread_mutex_lock(&(batch->Mutex));
+		while(slot->Is_Full)
+			pthread_cond_wait(&(batch->Condition),&(batch->Mutex));
+		pthread_mutex_unlock(&(batch->Mutex));
+		Batch_Read_Item(batch,i,slot);
+		pthread_mutex_lock(&(batch->Mutex));
+		slot->Is_Full = TRUE;
+		pthread_cond_broadcast(&(batch->Condition));
+		pthread_mutex_unlock(&(batch->Mutex));
+	}
+	return NULL;
+}
+
+/**
+ * Read an item into a slot, unless the batch's context has been aborted. Any failure is recorded in the slot.
+ * @param batch The batch structure.
+ * @param index The index of the item to read.
+ * @param slot The slot to read the item into.
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ */
+static void Batch_Read_Item(struct Batch_Struct *batch,int index,struct Batch_Slot_Struct *slot)
+{
+	if(DpRt_Context_Get_Abort(batch->Context))
+	{
+		slot->Read_Retval = FALSE;
+		slot->Error_Number = 901;
+		sprintf(slot->Error_String,"Batch_Read_Item:Batch aborted before item %d was read.\n",index);
+		return;
+	}
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+	slot->Read_Retval = batch->Read_Function(index,(int)(slot-batch->Slot_List),batch->User_Data);
+	if(slot->Read_Retval == FALSE)
+	{
+		slot->Error_Number = DpRt_Error_Number;
+		strcpy(slot->Error_String,DpRt_Error_String);
+	}
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,444 @@
+/* dprt_buffer_pool.c
+** Pool of reusable, aligned frame buffers.
+** $Header$
+*/
+/**
+ * dprt_buffer_pool.c provides a pool of reusable frame buffers owned by the library. It is created in
+ * DpRt_Initialise and destroyed in DpRt_Shutdown. Reductions lease a buffer big enough for a frame with
+ * DpRt_Buffer_Pool_Lease, and give it back with DpRt_Buffer_Pool_Return, rather than using malloc/free per frame.
+ * Buffers are rounded up to a size class (four classes per power of two), so frames of similar size share buffers,
+ * and are aligned to DPRT_BUFFER_POOL_ALIGNMENT bytes. Large buffers can optionally be backed by huge pages.
+ * The total memory allocated by the pool is limited to a configurable ceiling; idle buffers of other size classes
+ * are released to make room for a new one before a lease fails.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_buffer_pool.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The smallest buffer size class, in bytes.
+ */
+#define BUFFER_POOL_MIN_SIZE_CLASS	(4096)
+/**
+ * The size of a huge page, in bytes. Buffers of at least this size are eligible for huge page backing.
+ */
+#define BUFFER_POOL_HUGE_PAGE_SIZE	(2*1024*1024)
+/**
+ * The maximum number of buffers (leased or idle) the pool can hold.
+ */
+#define BUFFER_POOL_MAX_BUFFER_COUNT	(64)
+
+/* ------------------------------------------------------- */
+/* enums */
+/* ------------------------------------------------------- */
+/**
+ * How a buffer's memory was allocated, and therefore how it must be freed.
+ * <dl>
+ * <dt>BUFFER_ALLOCATION_NONE</dt> <dd>The buffer slot is empty.</dd>
+ * <dt>BUFFER_ALLOCATION_ALIGNED</dt> <dd>Allocated with posix_memalign, free with free.</dd>
+ * <dt>BUFFER_ALLOCATION_HUGE_PAGE</dt> <dd>Allocated with mmap (MAP_HUGETLB), free with munmap.</dd>
+ * </dl>
+ */
+enum BUFFER_ALLOCATION
+{
+	BUFFER_ALLOCATION_NONE=0,BUFFER_ALLOCATION_ALIGNED=1,BUFFER_ALLOCATION_HUGE_PAGE=2
+};
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure describing one buffer in the pool.
+ * <dl>
+ * <dt>Data</dt> <dd>The buffer memory.</dd>
+ * <dt>Size</dt> <dd>The size of the buffer in bytes (it's size class).</dd>
+ * <dt>Allocation</dt> <dd>How the buffer was allocated, of type BUFFER_ALLOCATION.</dd>
+ * <dt>Is_Leased</dt> <dd>A boolean, TRUE if the buffer is currently leased.</dd>
+ * </dl>
+ * @see #BUFFER_ALLOCATION
+ */
+struct Buffer_Struct
+{
+	void *Data;
+	size_t Size;
+	enum BUFFER_ALLOCATION Allocation;
+	int Is_Leased;
+};
+
+/**
+ * Structure holding the buffer pool's data.
+ * <dl>
+ * <dt>Buffer_List</dt> <dd>The list of buffers.</dd>
+ * <dt>Allocated_Bytes</dt> <dd>The total size of all buffers in the pool.</dd>
+ * <dt>Leased_Bytes</dt> <dd>The total size of all leased buffers.</dd>
+ * <dt>Max_Bytes</dt> <dd>The ceiling on Allocated_Bytes, or zero for no ceiling.</dd>
+ * <dt>Use_Huge_Pages</dt> <dd>A boolean, whether to try to back large buffers with huge pages.</dd>
+ * </dl>
+ * @see #Buffer_Struct
+ * @see #BUFFER_POOL_MAX_BUFFER_COUNT
+ */
+struct Buffer_Pool_Struct
+{
+	struct Buffer_Struct Buffer_List[BUFFER_POOL_MAX_BUFFER_COUNT];
+	size_t Allocated_Bytes;
+	size_t Leased_Bytes;
+	size_t Max_Bytes;
+	int Use_Huge_Pages;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The buffer pool data.
+ * @see #Buffer_Pool_Struct
+ */
+static struct Buffer_Pool_Struct Buffer_Pool_Data;
+/**
+ * Mutex protecting Buffer_Pool_Data.
+ * @see #Buffer_Pool_Data
+ */
+static pthread_mutex_t Buffer_Pool_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static size_t Buffer_Pool_Size_Class(size_t size);
+static int Buffer_Pool_Allocate(struct Buffer_Struct *buffer,size_t size);
+static void Buffer_Pool_Free(struct Buffer_Struct *buffer);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Initialise the buffer pool. If the pool already holds idle buffers they are released; leased buffers remain
+ * valid and are freed when returned if they no longer fit under the ceiling.
+ * @param max_bytes The maximum number of bytes the pool may allocate in total, or zero for no limit.
+ * @param use_huge_pages A boolean, if TRUE buffers of BUFFER_POOL_HUGE_PAGE_SIZE or more are allocated from
+ *        huge pages where the system allows it (falling back to normal pages, with a transparent huge page hint).
+ * @return The routine returns TRUE.
+ * @see #Buffer_Pool_Data
+ * @see #Buffer_Pool_Mutex
+ * @see #Buffer_Pool_Free
+ */
+int DpRt_Buffer_Pool_Initialise(size_t max_bytes,int use_huge_pages)
+{
+	int i;
+
+	pthread_mutex_lock(&Buffer_Pool_Mutex);
+	for(i=0;i<BUFFER_POOL_MAX_BUFFER_COUNT;i++)
+	{
+		if((Buffer_Pool_Data.Buffer_List[i].Allocation != BUFFER_ALLOCATION_NONE)&&
+		   (Buffer_Pool_Data.Buffer_List[i].Is_Leased == FALSE))
+		{
+			Buffer_Pool_Data.Allocated_Bytes -= Buffer_Pool_Data.Buffer_List[i].Size;
+			Buffer_Pool_Free(&(Buffer_Pool_Data.Buffer_List[i]));
+		}
+	}
+	Buffer_Pool_Data.Max_Bytes = max_bytes;
+	Buffer_Pool_Data.Use_Huge_Pages = use_huge_pages;
+	pthread_mutex_unlock(&Buffer_Pool_Mutex);
+	fprintf(stdout,"DpRt_Buffer_Pool_Initialise:Maximum bytes %lu:Huge pages %d.\n",(unsigned long)max_bytes,
+		use_huge_pages);
+	return TRUE;
+}
+
+/**
+ * Free all the buffers in the pool. Any buffers still leased are freed as well, and should not be used or
+ * returned afterwards.
+ * @return The routine returns TRUE if it succeeded, and FALSE if buffers were still leased.
+ * @see #Buffer_Pool_Data
+ * @see #Buffer_Pool_Mutex
+ * @see #Buffer_Pool_Free
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Buffer_Pool_Shutdown(void)
+{
+	int i,leased_count = 0;
+
+	pthread_mutex_lock(&Buffer_Pool_Mutex);
+	for(i=0;i<BUFFER_POOL_MAX_BUFFER_COUNT;i++)
+	{
+		if(Buffer_Pool_Data.Buffer_List[i].Allocation != BUFFER_ALLOCATION_NONE)
+		{
+			if(Buffer_Pool_Data.Buffer_List[i].Is_Leased)
+				leased_count++;
+			Buffer_Pool_Free(&(Buffer_Pool_Data.Buffer_List[i]));
+		}
+	}
+	Buffer_Pool_Data.Allocated_Bytes = 0;
+	Buffer_Pool_Data.Leased_Bytes = 0;
+	pthread_mutex_unlock(&Buffer_Pool_Mutex);
+	if(leased_count > 0)
+	{
+		DpRt_Error_Number = 500;
+		sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Shutdown:%d buffers were still leased.\n",leased_count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Lease a buffer of at least size bytes from the pool. An idle buffer of the same size class is re-used if
+ * available. Otherwise a new buffer is allocated, first releasing idle buffers of other size classes
+ * if this is needed to keep the pool under it's ceiling.
+ * @param size The number of bytes required.
+ * @param buffer The address of a pointer, set to the leased buffer on success. The buffer contents are undefined.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (including if the ceiling would be
+ *         exceeded).
+ * @see #Buffer_Pool_Data
+ * @see #Buffer_Pool_Mutex
+ * @see #Buffer_Pool_Size_Class
+ * @see #Buffer_Pool_Allocate
+ * @see #Buffer_Pool_Free
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Buffer_Pool_Lease(size_t size,void **buffer)
+{
+	size_t size_class;
+	int i,empty_index;
+
+	if(buffer == NULL)
+	{
+		DpRt_Error_Number = 501;
+		sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Lease:buffer was NULL.\n");
+		return FALSE;
+	}
+	(*buffer) = NULL;
+	size_class = Buffer_Pool_Size_Class(size);
+	pthread_mutex_lock(&Buffer_Pool_Mutex);
+	/* re-use an idle buffer of the right size class */
+	empty_index = -1;
+	for(i=0;i<BUFFER_POOL_MAX_BUFFER_COUNT;i++)
+	{
+		if(Buffer_Pool_Data.Buffer_List[i].Allocation == BUFFER_ALLOCATION_NONE)
+		{
+			if(empty_index == -1)
+				empty_index = i;
+		}
+		else if((Buffer_Pool_Data.Buffer_List[i].Is_Leased == FALSE)&&
+			(Buffer_Pool_Data.Buffer_List[i].Size == size_class))
+		{
+			Buffer_Pool_Data.Buffer_List[i].Is_Leased = TRUE;
+			Buffer_Pool_Data.Leased_Bytes += size_class;
+			(*buffer) = Buffer_Pool_Data.Buffer_List[i].Data;
+			pthread_mutex_unlock(&Buffer_Pool_Mutex);
+			return TRUE;
+		}
+	}
+	/* release idle buffers of other size classes until the new buffer fits (and a slot is free) */
+	for(i=0;i<BUFFER_POOL_MAX_BUFFER_COUNT;i++)
+	{
+		if((empty_index != -1)&&((Buffer_Pool_Data.Max_Bytes == 0)||
+			   (Buffer_Pool_Data.Allocated_Bytes+size_class <= Buffer_Pool_Data.Max_Bytes)))
+			break;
+		if((Buffer_Pool_Data.Buffer_List[i].Allocation != BUFFER_ALLOCATION_NONE)&&
+		   (Buffer_Pool_Data.Buffer_List[i].Is_Leased == FALSE))
+		{
+			Buffer_Pool_Data.Allocated_Bytes -= Buffer_Pool_Data.Buffer_List[i].Size;
+			Buffer_Pool_Free(&(Buffer_Pool_Data.Buffer_List[i]));
+			if(empty_index == -1)
+				empty_index = i;
+		}
+	}
+	if(empty_index == -1)
+	{
+		pthread_mutex_unlock(&Buffer_Pool_Mutex);
+		DpRt_Error_Number = 502;
+		sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Lease:All %d buffers are leased.\n",
+			BUFFER_POOL_MAX_BUFFER_COUNT);
+		return FALSE;
+	}
+	if((Buffer_Pool_Data.Max_Bytes != 0)&&
+	   (Buffer_Pool_Data.Allocated_Bytes+size_class > Buffer_Pool_Data.Max_Bytes))
+	{
+		pthread_mutex_unlock(&Buffer_Pool_Mutex);
+		DpRt_Error_Number = 503;
+		sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Lease:Leasing %lu bytes would exceed the pool ceiling "
+			"(%lu of %lu bytes allocated).\n",(unsigned long)size_class,
+			(unsigned long)Buffer_Pool_Data.Allocated_Bytes,(unsigned long)Buffer_Pool_Data.Max_Bytes);
+		return FALSE;
+	}
+	if(!Buffer_Pool_Allocate(&(Buffer_Pool_Data.Buffer_List[empty_index]),size_class))
+	{
+		pthread_mutex_unlock(&Buffer_Pool_Mutex);
+		DpRt_Error_Number = 504;
+		sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Lease:Failed to allocate %lu bytes.\n",
+			(unsigned long)size_class);
+		return FALSE;
+	}
+	Buffer_Pool_Data.Buffer_List[empty_index].Is_Leased = TRUE;
+	Buffer_Pool_Data.Allocated_Bytes += size_class;
+	Buffer_Pool_Data.Leased_Bytes += size_class;
+	(*buffer) = Buffer_Pool_Data.Buffer_List[empty_index].Data;
+	pthread_mutex_unlock(&Buffer_Pool_Mutex);
+	return TRUE;
+}
+
+/**
+ * Return a leased buffer to the pool, so it can be re-used. If the pool is over it's ceiling (because the
+ * ceiling was lowered whilst the buffer was leased) the buffer is freed instead.
+ * @param buffer The buffer to return. NULL is allowed, and ignored.
+ * @return The routine returns TRUE if it succeeded, and FALSE if the buffer was not leased from the pool.
+ * @see #Buffer_Pool_Data
+ * @see #Buffer_Pool_Mutex
+ * @see #Buffer_Pool_Free
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Buffer_Pool_Return(void *buffer)
+{
+	int i;
+
+	if(buffer == NULL)
+		return TRUE;
+	pthread_mutex_lock(&Buffer_Pool_Mutex);
+	for(i=0;i<BUFFER_POOL_MAX_BUFFER_COUNT;i++)
+	{
+		if((Buffer_Pool_Data.Buffer_List[i].Data == buffer)&&(Buffer_Pool_Data.Buffer_List[i].Is_Leased))
+		{
+			Buffer_Pool_Data.Buffer_List[i].Is_Leased = FALSE;
+			Buffer_Pool_Data.Leased_Bytes -= Buffer_Pool_Data.Buffer_List[i].Size;
+			if((Buffer_Pool_Data.Max_Bytes != 0)&&(Buffer_Pool_Data.Allocated_Bytes > Buffer_Pool_Data.Max_Bytes))
+			{
+				Buffer_Pool_Data.Allocated_Bytes -= Buffer_Pool_Data.Buffer_List[i].Size;
+				Buffer_Pool_Free(&(Buffer_Pool_Data.Buffer_List[i]));
+			}
+			pthread_mutex_unlock(&Buffer_Pool_Mutex);
+			return TRUE;
+		}
+	}
+	pthread_mutex_unlock(&Buffer_Pool_Mutex);
+	DpRt_Error_Number = 505;
+	sprintf(DpRt_Error_String,"DpRt_Buffer_Pool_Return:Buffer %p was not leased from the pool.\n",buffer);
+	return FALSE;
+}
+
+/**
+ * Get the current memory usage of the pool.
+ * @param allocated_bytes The address of a size_t to store the total bytes allocated by the pool, or NULL.
+ * @param leased_bytes The address of a size_t to store the total bytes currently leased, or NULL.
+ * @param max_bytes The address of a size_t to store the pool ceiling (zero for no ceiling), or NULL.
+ * @return The routine returns TRUE.
+ * @see #Buffer_Pool_Data
+ * @see #Buffer_Pool_Mutex
+ */
+int DpRt_Buffer_Pool_Get_Usage(size_t *allocated_bytes,size_t *leased_bytes,size_t *max_bytes)
+{
+	pthread_mutex_lock(&Buffer_Pool_Mutex);
+	if(allocated_bytes != NULL)
+		(*allocated_bytes) = Buffer_Pool_Data.Allocated_Bytes;
+	if(leased_bytes != NULL)
+		(*leased_bytes) = Buffer_Pool_Data.Leased_Bytes;
+	if(max_bytes != NULL)
+		(*max_bytes) = Buffer_Pool_Data.Max_Bytes;
+	pthread_mutex_unlock(&Buffer_Pool_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Work out the size class for a buffer of the given size. There are four size classes per power of two,
+ * so at most 25% of a buffer is wasted. Size classes are multiples of DPRT_BUFFER_POOL_ALIGNMENT.
+ * @param size The number of bytes required.
+ * @return The size class, in bytes.
+ * @see #BUFFER_POOL_MIN_SIZE_CLASS
+ */
+static size_t Buffer_Pool_Size_Class(size_t size)
+{
+	size_t power,step;
+
+	if(size <= BUFFER_POOL_MIN_SIZE_CLASS)
+		return BUFFER_POOL_MIN_SIZE_CLASS;
+	/* find the largest power of two less than size */
+	power = BUFFER_POOL_MIN_SIZE_CLASS;
+	while((power*2) < size)
+		power *= 2;
+	step = power/4;
+	return ((size+step-1)/step)*step;
+}
+
+/**
+ * Allocate the memory for a buffer. Huge page backed memory is tried first if enabled and the buffer is large
+ * enough, otherwise aligned memory is allocated (with a transparent huge page hint if huge pages are enabled).
+ * @param buffer The buffer slot to fill in.
+ * @param size The size class to allocate.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Buffer_Pool_Data
+ * @see #BUFFER_POOL_HUGE_PAGE_SIZE
+ */
+static int Buffer_Pool_Allocate(struct Buffer_Struct *buffer,size_t size)
+{
+	void *data = NULL;
+	size_t alignment;
+
+#ifdef MAP_HUGETLB
+	if(Buffer_Pool_Data.Use_Huge_Pages && (size >= BUFFER_POOL_HUGE_PAGE_SIZE) &&
+	   ((size % BUFFER_POOL_HUGE_PAGE_SIZE) == 0))
+	{
+		data = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		if(data != MAP_FAILED)
+		{
+			buffer->Data = data;
+			buffer->Size = size;
+			buffer->Allocation = BUFFER_ALLOCATION_HUGE_PAGE;
+			buffer->Is_Leased = FALSE;
+			return TRUE;
+		}
+		/* no huge pages reserved, fall back to normal allocation */
+	}
+#endif
+	alignment = DPRT_BUFFER_POOL_ALIGNMENT;
+	if(Buffer_Pool_Data.Use_Huge_Pages && (size >= BUFFER_POOL_HUGE_PAGE_SIZE))
+		alignment = BUFFER_POOL_HUGE_PAGE_SIZE;
+	if(posix_memalign(&data,alignment,size) != 0)
+		return FALSE;
+#ifdef MADV_HUGEPAGE
+	if(Buffer_Pool_Data.Use_Huge_Pages && (size >= BUFFER_POOL_HUGE_PAGE_SIZE))
+		madvise(data,size,MADV_HUGEPAGE);
+#endif
+	buffer->Data = data;
+	buffer->Size = size;
+	buffer->Allocation = BUFFER_ALLOCATION_ALIGNED;
+	buffer->Is_Leased = FALSE;
+	return TRUE;
+}
+
+/**
+ * Free the memory for a buffer, and mark the slot empty. The caller is responsible for updating
+ * the pool's byte counts.
+ * @param buffer The buffer slot to free.
+ */
+static void Buffer_Pool_Free(struct Buffer_Struct *buffer)
+{
+	if(buffer->Allocation == BUFFER_ALLOCATION_HUGE_PAGE)
+		munmap(buffer->Data,buffer->Size);
+	else if(buffer->Allocation == BUFFER_ALLOCATION_ALIGNED)
+		free(buffer->Data);
+	buffer->Data = NULL;
+	buffer->Size = 0;
+	buffer->Allocation = BUFFER_ALLOCATION_NONE;
+	buffer->Is_Leased = FALSE;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,799 @@
+/* dprt_calibration.c
+** Resident cache of master calibration frames, and the calibration of frames with them.
+** $Header$
+*/
+/**
+ * dprt_calibration.c keeps master bias, master flat and bad pixel mask frames resident between reductions, so
+ * calibrating a frame does not re-read them from disk. Each cached frame is keyed by it's type, filename,
+ * modification time and size, and is held in memory aligned to DPRT_BUFFER_POOL_ALIGNMENT bytes, pre-converted so
+ * calibration is a single multiply-add pass: biases as 32-bit floats, flats as the reciprocal of their value, and
+ * bad pixel masks as a packed bitset, one bit per pixel set for bad pixels (see DPRT_STATS_MASK_WORD_COUNT), so a
+ * mask adds 1/16th to the memory read by a reduction, and a band's worth of it stays in cache whilst the band's
+ * statistics are taken. A cached frame whose file has been modified since
+ * it was loaded is re-read. DpRt_Calibration_Cache_Invalidate throws away all the cached frames of a type, and
+ * is called when new masters are made. Frames in use by a reduction are reference counted, and are only freed
+ * once they are released. The number of cache hits and misses is counted.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_buffer_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_calibration.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The maximum number of frames held in the cache. When a new frame takes the cache over this number, the least
+ * recently used frame that is not in use is thrown away.
+ */
+#define CALIBRATION_CACHE_MAX_ENTRY_COUNT	(16)
+/**
+ * Macro to convert a 16-bit value read from a FITS data unit (big-endian, signed, with a BZERO of 32768)
+ * into the unsigned pixel value. On a big-endian host only the BZERO offset (flipping the top bit) is needed.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define CALIBRATION_FITS_DECODE(v)	((unsigned short)((v)^0x8000))
+#else
+#define CALIBRATION_FITS_DECODE(v)	((unsigned short)((((v)>>8)|((v)<<8))^0x8000))
+#endif
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a cached calibration frame.
+ * <dl>
+ * <dt>Type</dt> <dd>The frame type, DPRT_CALIBRATION_TYPE_BIAS, DPRT_CALIBRATION_TYPE_FLAT or
+ *     DPRT_CALIBRATION_TYPE_BPM.</dd>
+ * <dt>Filename</dt> <dd>The filename the frame was loaded from.</dd>
+ * <dt>Modification_Time</dt> <dd>The modification time of the file when it was loaded.</dd>
+ * <dt>File_Size</dt> <dd>The size of the file in bytes when it was loaded.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Data</dt> <dd>The aligned, pre-converted frame data: floats for biases and flats, a bitset of unsigned long
+ *     longs for bad pixel masks.</dd>
+ * <dt>Reference_Count</dt> <dd>The number of reductions using the frame.</dd>
+ * <dt>Is_Stale</dt> <dd>A boolean, TRUE if the frame has been invalidated whilst in use. It is freed when it is
+ *     last released, and is never returned by DpRt_Calibration_Cache_Get.</dd>
+ * <dt>Last_Used</dt> <dd>The value of Calibration_Use_Count when the frame was last got.</dd>
+ * <dt>Next</dt> <dd>The next frame in the list.</dd>
+ * </dl>
+ */
+struct Calibration_Entry_Struct
+{
+	int Type;
+	char Filename[DPRT_CALIBRATION_FILENAME_LENGTH];
+	struct timespec Modification_Time;
+	off_t File_Size;
+	int Naxis_One;
+	int Naxis_Two;
+	void *Data;
+	int Reference_Count;
+	int Is_Stale;
+	unsigned long Last_Used;
+	struct Calibration_Entry_Struct *Next;
+};
+
+/**
+ * Structure holding the state of a calibration, shared by it's band tasks.
+ * <dl>
+ * <dt>Data</dt> <dd>The frame being calibrated.</dd>
+ * <dt>Encoding</dt> <dd>How the pixel values are stored in Data.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Bias</dt> <dd>The cached master bias, or NULL.</dd>
+ * <dt>Flat</dt> <dd>The cached master flat (reciprocals), or NULL.</dd>
+ * <dt>Mask</dt> <dd>The cached bad pixel mask bitset, or NULL.</dd>
+ * <dt>Output</dt> <dd>The calibrated frame.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in a band.</dd>
+ * </dl>
+ */
+struct Calibration_Apply_Struct
+{
+	void *Data;
+	int Encoding;
+	int Naxis_One;
+	int Naxis_Two;
+	float *Bias;
+	float *Flat;
+	unsigned long long *Mask;
+	unsigned short *Output;
+	int Band_Rows;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of cached frames.
+ * @see #Calibration_Entry_Struct
+ */
+static struct Calibration_Entry_Struct *Calibration_Entry_List = NULL;
+/**
+ * Mutex protecting the cache list and counters. It is held whilst a frame is loaded into the cache.
+ */
+static pthread_mutex_t Calibration_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The number of times a frame was found in the cache.
+ */
+static int Calibration_Hit_Count = 0;
+/**
+ * The number of times a frame had to be loaded into the cache.
+ */
+static int Calibration_Miss_Count = 0;
+/**
+ * A counter incremented every time a frame is got, used to find the least recently used frame.
+ */
+static unsigned long Calibration_Use_Count = 0;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Calibration_Get(int type,char *filename,int naxis_one,int naxis_two,void **data);
+static int Calibration_Load(int type,char *filename,int naxis_one,int naxis_two,
+			    struct Calibration_Entry_Struct **entry);
+static int Calibration_Pack_Mask(float *data,size_t pixel_count,unsigned long long **mask);
+static void Calibration_Remove(struct Calibration_Entry_Struct *entry);
+static void Calibration_Evict(void);
+static void Calibration_Free(struct Calibration_Entry_Struct *entry);
+static int Calibration_Apply_Band(void *user_data,int band_index,int thread_index);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get a master bias or flat from the cache, loading it if it is not cached or it's file has been modified since
+ * it was cached. The frame is held until it is released with DpRt_Calibration_Cache_Release. Bad pixel masks are
+ * got with DpRt_Calibration_Cache_Get_Mask.
+ * @param type The frame type, DPRT_CALIBRATION_TYPE_BIAS or DPRT_CALIBRATION_TYPE_FLAT.
+ * @param filename The filename of the frame, a 2 axis FITS image.
+ * @param naxis_one The number of columns the frame must have.
+ * @param naxis_two The number of rows the frame must have.
+ * @param data The address of a float pointer to store the frame's data: the bias value, or the reciprocal of the
+ *        flat value (0 where the flat is not positive), of naxis_one*naxis_two pixels in row-major order. It is
+ *        set to NULL if the file does not exist.
+ * @return The routine returns TRUE if it succeeded (or the file does not exist), and FALSE if it failed.
+ * @see #Calibration_Get
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Calibration_Cache_Get(int type,char *filename,int naxis_one,int naxis_two,float **data)
+{
+	void *cached_data = NULL;
+
+	if((type != DPRT_CALIBRATION_TYPE_BIAS)&&(type != DPRT_CALIBRATION_TYPE_FLAT))
+	{
+		DpRt_Error_Number = 1300;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Cache_Get:Illegal type %d.\n",type);
+		return FALSE;
+	}
+	if(data == NULL)
+	{
+		DpRt_Error_Number = 1300;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Cache_Get:data was NULL.\n");
+		return FALSE;
+	}
+	if(!Calibration_Get(type,filename,naxis_one,naxis_two,&cached_data))
+		return FALSE;
+	(*data) = (float *)cached_data;
+	return TRUE;
+}
+
+/**
+ * Get a bad pixel mask from the cache, loading it if it is not cached or it's file has been modified since
+ * it was cached. The mask file is a 2 axis FITS image, non-zero for bad pixels, which is held as a packed bitset.
+ * The mask is held until it is released with DpRt_Calibration_Cache_Release.
+ * @param filename The filename of the mask.
+ * @param naxis_one The number of columns the mask must have.
+ * @param naxis_two The number of rows the mask must have.
+ * @param mask The address of a pointer to store the mask bitset, of DPRT_STATS_MASK_WORD_COUNT(naxis_one*naxis_two)
+ *        words, the bit of each pixel (in row-major order) set if it is bad. It is set to NULL if the file does not
+ *        exist.
+ * @return The routine returns TRUE if it succeeded (or the file does not exist), and FALSE if it failed.
+ * @see #Calibration_Get
+ * @see dprt_stats.html#DPRT_STATS_MASK_WORD_COUNT
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Calibration_Cache_Get_Mask(char *filename,int naxis_one,int naxis_two,unsigned long long **mask)
+{
+	void *cached_data = NULL;
+
+	if(mask == NULL)
+	{
+		DpRt_Error_Number = 1300;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Cache_Get_Mask:mask was NULL.\n");
+		return FALSE;
+	}
+	if(!Calibration_Get(DPRT_CALIBRATION_TYPE_BPM,filename,naxis_one,naxis_two,&cached_data))
+		return FALSE;
+	(*mask) = (unsigned long long *)cached_data;
+	return TRUE;
+}
+
+/**
+ * Release a calibration frame got with DpRt_Calibration_Cache_Get. A frame invalidated whilst it was in use
+ * is freed when it is last released.
+ * @param data The frame's data, as returned by DpRt_Calibration_Cache_Get or DpRt_Calibration_Cache_Get_Mask.
+ *        NULL is ignored.
+ * @return The routine returns TRUE if it succeeded, and FALSE if the data was not a cached frame.
+ * @see #Calibration_Mutex
+ * @see #Calibration_Remove
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Calibration_Cache_Release(void *data)
+{
+	struct Calibration_Entry_Struct *entry = NULL;
+
+	if(data == NULL)
+		return TRUE;
+	pthread_mutex_lock(&Calibration_Mutex);
+	for(entry=Calibration_Entry_List;entry != NULL;entry=entry->Next)
+	{
+		if((entry->Data == data)&&(entry->Reference_Count > 0))
+			break;
+	}
+	if(entry == NULL)
+	{
+		pthread_mutex_unlock(&Calibration_Mutex);
+		DpRt_Error_Number = 1302;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Cache_Release:%p is not a cached frame in use.\n",
+			data);
+		return FALSE;
+	}
+	entry->Reference_Count--;
+	if(entry->Is_Stale)
+		Calibration_Remove(entry);
+	pthread_mutex_unlock(&Calibration_Mutex);
+	return TRUE;
+}
+
+/**
+ * Throw away all the cached frames of a type, so they are re-read the next time they are used. Frames in use
+ * are freed when they are released.
+ * @param type The frame type, DPRT_CALIBRATION_TYPE_BIAS, DPRT_CALIBRATION_TYPE_FLAT or DPRT_CALIBRATION_TYPE_BPM.
+ * @return The routine returns TRUE.
+ * @see #Calibration_Mutex
+ * @see #Calibration_Remove
+ */
+int DpRt_Calibration_Cache_Invalidate(int type)
+{
+	struct Calibration_Entry_Struct *entry = NULL;
+	struct Calibration_Entry_Struct *next_entry = NULL;
+	int count = 0;
+
+	pthread_mutex_lock(&Calibration_Mutex);
+	for(entry=Calibration_Entry_List;entry != NULL;entry=next_entry)
+	{
+		next_entry = entry->Next;
+		if((entry->Type == type)&&(entry->Is_Stale == FALSE))
+		{
+			Calibration_Remove(entry);
+			count++;
+		}
+	}
+	pthread_mutex_unlock(&Calibration_Mutex);
+	if(count > 0)
+		fprintf(stdout,"DpRt_Calibration_Cache_Invalidate:Invalidated %d frames of type %d.\n",count,type);
+	return TRUE;
+}
+
+/**
+ * Get the number of cache hits and misses since the library was initialised.
+ * @param hit_count The address of an integer to store the number of times a frame was found in the cache.
+ * @param miss_count The address of an integer to store the number of times a frame was loaded into the cache.
+ * @return The routine returns TRUE.
+ * @see #Calibration_Hit_Count
+ * @see #Calibration_Miss_Count
+ */
+int DpRt_Calibration_Cache_Get_Counts(int *hit_count,int *miss_count)
+{
+	pthread_mutex_lock(&Calibration_Mutex);
+	if(hit_count != NULL)
+		(*hit_count) = Calibration_Hit_Count;
+	if(miss_count != NULL)
+		(*miss_count) = Calibration_Miss_Count;
+	pthread_mutex_unlock(&Calibration_Mutex);
+	return TRUE;
+}
+
+/**
+ * Free all the cached frames, and reset the counters. No frames may be in use.
+ * @return The routine returns TRUE.
+ * @see #Calibration_Entry_List
+ * @see #Calibration_Free
+ */
+int DpRt_Calibration_Cache_Shutdown(void)
+{
+	struct Calibration_Entry_Struct *entry = NULL;
+
+	pthread_mutex_lock(&Calibration_Mutex);
+	while(Calibration_Entry_List != NULL)
+	{
+		entry = Calibration_Entry_List;
+		Calibration_Entry_List = entry->Next;
+		Calibration_Free(entry);
+	}
+	Calibration_Hit_Count = 0;
+	Calibration_Miss_Count = 0;
+	Calibration_Use_Count = 0;
+	pthread_mutex_unlock(&Calibration_Mutex);
+	return TRUE;
+}
+
+/**
+ * Calibrate a 16-bit frame: subtract the bias, multiply by the flat reciprocal, set bad pixels to zero,
+ * and round and clamp the result to 0..65535. Any of the calibration frames can be NULL, in which case that
+ * step is skipped. Bands of rows are calibrated in parallel on the thread pool. Reductions that only need the
+ * statistics of the calibrated frame should use DpRt_Reduce_Calibrated_Stats, which does not write it out.
+ * @param data The frame data, of naxis_one*naxis_two pixels, in row-major order.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param bias The cached master bias of the same size, or NULL.
+ * @param flat The cached master flat of the same size, or NULL.
+ * @param mask The cached bad pixel mask bitset of the same size, or NULL.
+ * @param output Where to put the calibrated frame, as host order unsigned shorts (DPRT_STATS_ENCODING_NATIVE).
+ *        It can be the same as data, if data is natively encoded.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Calibration_Apply_Struct
+ * @see #Calibration_Apply_Band
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Calibration_Apply(void *data,int encoding,int naxis_one,int naxis_two,float *bias,float *flat,
+			   unsigned long long *mask,unsigned short *output)
+{
+	struct Calibration_Apply_Struct apply;
+
+	if((data == NULL)||(output == NULL)||(naxis_one < 1)||(naxis_two < 1)||
+	   ((encoding != DPRT_STATS_ENCODING_NATIVE)&&(encoding != DPRT_STATS_ENCODING_FITS)))
+	{
+		DpRt_Error_Number = 1303;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Apply:Illegal arguments (encoding %d,%dx%d).\n",
+			encoding,naxis_one,naxis_two);
+		return FALSE;
+	}
+	apply.Data = data;
+	apply.Encoding = encoding;
+	apply.Naxis_One = naxis_one;
+	apply.Naxis_Two = naxis_two;
+	apply.Bias = bias;
+	apply.Flat = flat;
+	apply.Mask = mask;
+	apply.Output = output;
+	apply.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	if(!DpRt_Thread_Pool_Run((naxis_two+apply.Band_Rows-1)/apply.Band_Rows,Calibration_Apply_Band,&apply))
+	{
+		DpRt_Error_Number = 1304;
+		sprintf(DpRt_Error_String,"DpRt_Calibration_Apply:Failed to calibrate %dx%d frame.\n",
+			naxis_one,naxis_two);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Calibrate a run of up to DPRT_CALIBRATION_CHUNK_PIXELS pixels of a 16-bit frame: subtract an offset (the row's
+ * overscan level) and the bias, multiply
+ * by the flat reciprocal, set bad pixels to zero, and round and clamp the result to 0..65535. Any of the
+ * calibration frames can be NULL, in which case that step is skipped. The pixels are decoded into a float buffer
+ * on the stack, and each step is a separate loop over it, so each can be vectorised by the compiler. Bad pixels are
+ * zeroed a mask word at a time, so words with no bad pixels cost one test. This is the
+ * kernel used by DpRt_Calibration_Apply, and by the fused calibration and statistics pass of
+ * DpRt_Reduce_Calibrated_Stats.
+ * @param data The frame data, in row-major order.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param start The index of the first pixel to calibrate, in data and the calibration frames.
+ * @param pixel_count The number of pixels to calibrate, at most DPRT_CALIBRATION_CHUNK_PIXELS.
+ * @param offset A constant subtracted from every pixel as it is decoded, normally zero or an overscan level.
+ * @param bias The cached master bias of the frame's size, or NULL.
+ * @param flat The cached master flat of the frame's size, or NULL.
+ * @param mask The cached bad pixel mask bitset of the frame's size, or NULL.
+ * @param output Where to put the pixel_count calibrated pixels (host order unsigned shorts).
+ * @see #DPRT_CALIBRATION_CHUNK_PIXELS
+ * @see #CALIBRATION_FITS_DECODE
+ * @see dprt_stats.html#DpRt_Stats_Mask_Get_Bits
+ */
+void DpRt_Calibration_Apply_Pixels(void *data,int encoding,size_t start,size_t pixel_count,float offset,
+				   float *bias,float *flat,unsigned long long *mask,unsigned short *output)
+{
+	float value_list[DPRT_CALIBRATION_CHUNK_PIXELS];
+	unsigned short *pixel_list = ((unsigned short *)data)+start;
+	unsigned long long bits;
+	float value;
+	size_t i;
+
+	if(pixel_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+		pixel_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+	if(encoding == DPRT_STATS_ENCODING_FITS)
+	{
+		for(i=0;i<pixel_count;i++)
+			value_list[i] = ((float)CALIBRATION_FITS_DECODE(pixel_list[i]))-offset;
+	}
+	else
+	{
+		for(i=0;i<pixel_count;i++)
+			value_list[i] = ((float)pixel_list[i])-offset;
+	}
+	if(bias != NULL)
+	{
+		bias += start;
+		for(i=0;i<pixel_count;i++)
+			value_list[i] -= bias[i];
+	}
+	if(flat != NULL)
+	{
+		flat += start;
+		for(i=0;i<pixel_count;i++)
+			value_list[i] *= flat[i];
+	}
+	if(mask != NULL)
+	{
+		for(i=0;i<pixel_count;i+=DPRT_STATS_MASK_WORD_BITS)
+		{
+			bits = DpRt_Stats_Mask_Get_Bits(mask,start+i);
+			if(pixel_count-i < DPRT_STATS_MASK_WORD_BITS)
+				bits &= (1ULL<<(pixel_count-i))-1ULL;
+			while(bits != 0)
+			{
+				value_list[i+__builtin_ctzll(bits)] = 0.0f;
+				bits &= bits-1ULL;
+			}
+		}
+	}
+	for(i=0;i<pixel_count;i++)
+	{
+		value = value_list[i]+0.5f;
+		value = (value < 0.0f) ? 0.0f : value;
+		value = (value > 65535.0f) ? 65535.0f : value;
+		output[i] = (unsigned short)value;
+	}
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Get a calibration frame from the cache, loading it if it is not cached or it's file has been modified since
+ * it was cached. The frame is held until it is released with DpRt_Calibration_Cache_Release.
+ * @param type The frame type, DPRT_CALIBRATION_TYPE_BIAS, DPRT_CALIBRATION_TYPE_FLAT or DPRT_CALIBRATION_TYPE_BPM.
+ * @param filename The filename of the frame, a 2 axis FITS image.
+ * @param naxis_one The number of columns the frame must have.
+ * @param naxis_two The number of rows the frame must have.
+ * @param data The address of a pointer to store the frame's pre-converted data (see Calibration_Load). It is set
+ *        to NULL if the file does not exist.
+ * @return The routine returns TRUE if it succeeded (or the file does not exist), and FALSE if it failed.
+ * @see #Calibration_Mutex
+ * @see #Calibration_Entry_List
+ * @see #Calibration_Load
+ * @see #Calibration_Remove
+ * @see #Calibration_Evict
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Calibration_Get(int type,char *filename,int naxis_one,int naxis_two,void **data)
+{
+	struct Calibration_Entry_Struct *entry = NULL;
+	struct stat file_stat;
+
+	if((type < DPRT_CALIBRATION_TYPE_BIAS)||(type > DPRT_CALIBRATION_TYPE_BPM)||(filename == NULL)||
+	   (data == NULL)||(naxis_one < 1)||(naxis_two < 1)||
+	   (strlen(filename) >= DPRT_CALIBRATION_FILENAME_LENGTH))
+	{
+		DpRt_Error_Number = 1300;
+		sprintf(DpRt_Error_String,"Calibration_Get:Illegal arguments (type %d,%dx%d).\n",
+			type,naxis_one,naxis_two);
+		return FALSE;
+	}
+	(*data) = NULL;
+	if(stat(filename,&file_stat) != 0)
+	{
+		if(errno == ENOENT)
+			return TRUE;
+		DpRt_Error_Number = 1301;
+		sprintf(DpRt_Error_String,"Calibration_Get:Failed to stat %.200s.\n",filename);
+		return FALSE;
+	}
+	pthread_mutex_lock(&Calibration_Mutex);
+	for(entry=Calibration_Entry_List;entry != NULL;entry=entry->Next)
+	{
+		if((entry->Is_Stale == FALSE)&&(entry->Type == type)&&(entry->Naxis_One == naxis_one)&&
+		   (entry->Naxis_Two == naxis_two)&&(strcmp(entry->Filename,filename) == 0))
+			break;
+	}
+	if(entry != NULL)
+	{
+		if((entry->Modification_Time.tv_sec == file_stat.st_mtim.tv_sec)&&
+		   (entry->Modification_Time.tv_nsec == file_stat.st_mtim.tv_nsec)&&
+		   (entry->File_Size == file_stat.st_size))
+		{
+			entry->Reference_Count++;
+			entry->Last_Used = ++Calibration_Use_Count;
+			Calibration_Hit_Count++;
+			(*data) = entry->Data;
+			pthread_mutex_unlock(&Calibration_Mutex);
+			return TRUE;
+		}
+		fprintf(stdout,"Calibration_Get:%s has been modified:Reloading.\n",filename);
+		Calibration_Remove(entry);
+	}
+	Calibration_Miss_Count++;
+	if(!Calibration_Load(type,filename,naxis_one,naxis_two,&entry))
+	{
+		pthread_mutex_unlock(&Calibration_Mutex);
+		return FALSE;
+	}
+	entry->Modification_Time = file_stat.st_mtim;
+	entry->File_Size = file_stat.st_size;
+	entry->Reference_Count = 1;
+	entry->Last_Used = ++Calibration_Use_Count;
+	entry->Next = Calibration_Entry_List;
+	Calibration_Entry_List = entry;
+	Calibration_Evict();
+	(*data) = entry->Data;
+	fprintf(stdout,"Calibration_Get:Loaded %s (type %d,%dx%d):%d hits,%d misses.\n",filename,type,
+		naxis_one,naxis_two,Calibration_Hit_Count,Calibration_Miss_Count);
+	pthread_mutex_unlock(&Calibration_Mutex);
+	return TRUE;
+}
+
+/**
+ * Load a calibration frame from a FITS file, and convert it for it's type: flats to their reciprocal, and bad pixel
+ * masks to a packed bitset (the floats read are then freed). Calibration_Mutex must be held.
+ * @param type The frame type.
+ * @param filename The filename of the frame.
+ * @param naxis_one The number of columns the frame must have.
+ * @param naxis_two The number of rows the frame must have.
+ * @param entry The address of a pointer to store the new (allocated) cache entry. It is not in the list.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Calibration_Entry_Struct
+ * @see #Calibration_Pack_Mask
+ * @see dprt_buffer_pool.html#DPRT_BUFFER_POOL_ALIGNMENT
+ */
+static int Calibration_Load(int type,char *filename,int naxis_one,int naxis_two,
+			    struct Calibration_Entry_Struct **entry)
+{
+	struct Calibration_Entry_Struct *new_entry = NULL;
+	fitsfile *fp = NULL;
+	void *memory = NULL;
+	float *data = NULL;
+	unsigned long long *mask = NULL;
+	size_t pixel_count,i;
+	int naxis,file_naxis_one,file_naxis_two,status = 0;
+
+	if(fits_open_file(&fp,filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 1305;
+		sprintf(DpRt_Error_String,"Calibration_Load:Failed to open %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_read_key(fp,TINT,"NAXIS",&naxis,NULL,&status)||
+	   fits_read_key(fp,TINT,"NAXIS1",&file_naxis_one,NULL,&status)||
+	   fits_read_key(fp,TINT,"NAXIS2",&file_naxis_two,NULL,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 1306;
+		sprintf(DpRt_Error_String,"Calibration_Load:Failed to read the size of %.200s.\n",filename);
+		return FALSE;
+	}
+	if((naxis != 2)||(file_naxis_one != naxis_one)||(file_naxis_two != naxis_two))
+	{
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 1307;
+		sprintf(DpRt_Error_String,"Calibration_Load:%.150s is %dx%d (%d axes), not %dx%d.\n",filename,
+			file_naxis_one,file_naxis_two,naxis,naxis_one,naxis_two);
+		return FALSE;
+	}
+	pixel_count = ((size_t)naxis_one)*((size_t)naxis_two);
+	new_entry = (struct Calibration_Entry_Struct *)malloc(sizeof(struct Calibration_Entry_Struct));
+	if((new_entry == NULL)||
+	   (posix_memalign(&memory,DPRT_BUFFER_POOL_ALIGNMENT,pixel_count*sizeof(float)) != 0))
+	{
+		if(new_entry != NULL)
+			free(new_entry);
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 1308;
+		sprintf(DpRt_Error_String,"Calibration_Load:Failed to allocate %dx%d frame for %.150s.\n",
+			naxis_one,naxis_two,filename);
+		return FALSE;
+	}
+	data = (float *)memory;
+	if(fits_read_img(fp,TFLOAT,1,(LONGLONG)pixel_count,NULL,data,NULL,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		free(memory);
+		free(new_entry);
+		DpRt_Error_Number = 1309;
+		sprintf(DpRt_Error_String,"Calibration_Load:Failed to read %.200s.\n",filename);
+		return FALSE;
+	}
+	fits_close_file(fp,&status);
+	/* pre-convert the frame, so calibration is a subtract and a multiply per pixel */
+	if(type == DPRT_CALIBRATION_TYPE_FLAT)
+	{
+		for(i=0;i<pixel_count;i++)
+			data[i] = (data[i] > 0.0f) ? (1.0f/data[i]) : 0.0f;
+	}
+	else if(type == DPRT_CALIBRATION_TYPE_BPM)
+	{
+		if(!Calibration_Pack_Mask(data,pixel_count,&mask))
+		{
+			free(memory);
+			free(new_entry);
+			DpRt_Error_Number = 1308;
+			sprintf(DpRt_Error_String,"Calibration_Load:Failed to allocate %dx%d mask for %.150s.\n",
+				naxis_one,naxis_two,filename);
+			return FALSE;
+		}
+		free(memory);
+		memory = mask;
+	}
+	new_entry->Type = type;
+	strcpy(new_entry->Filename,filename);
+	new_entry->Naxis_One = naxis_one;
+	new_entry->Naxis_Two = naxis_two;
+	new_entry->Data = memory;
+	new_entry->Reference_Count = 0;
+	new_entry->Is_Stale = FALSE;
+	new_entry->Last_Used = 0;
+	new_entry->Next = NULL;
+	(*entry) = new_entry;
+	return TRUE;
+}
+
+/**
+ * Pack a bad pixel mask read from a FITS file, non-zero for bad pixels, into a bitset.
+ * @param data The mask read from the file, of pixel_count pixels.
+ * @param pixel_count The number of pixels in the mask.
+ * @param mask The address of a pointer to store the (allocated, aligned) bitset of
+ *        DPRT_STATS_MASK_WORD_COUNT(pixel_count) words, including the spare zero word.
+ * @return The routine returns TRUE if it succeeded, and FALSE if the bitset could not be allocated.
+ * @see dprt_stats.html#DPRT_STATS_MASK_WORD_COUNT
+ * @see dprt_buffer_pool.html#DPRT_BUFFER_POOL_ALIGNMENT
+ */
+static int Calibration_Pack_Mask(float *data,size_t pixel_count,unsigned long long **mask)
+{
+	void *memory = NULL;
+	size_t word_count,i;
+
+	word_count = DPRT_STATS_MASK_WORD_COUNT(pixel_count);
+	if(posix_memalign(&memory,DPRT_BUFFER_POOL_ALIGNMENT,word_count*sizeof(unsigned long long)) != 0)
+		return FALSE;
+	(*mask) = (unsigned long long *)memory;
+	memset((*mask),0,word_count*sizeof(unsigned long long));
+	for(i=0;i<pixel_count;i++)
+	{
+		if(data[i] != 0.0f)
+			(*mask)[i/DPRT_STATS_MASK_WORD_BITS] |= 1ULL<<(i%DPRT_STATS_MASK_WORD_BITS);
+	}
+	return TRUE;
+}
+
+/**
+ * Remove a frame from the cache. If it is not in use it is freed, otherwise it is marked stale, and freed when it
+ * is last released. Calibration_Mutex must be held.
+ * @param entry The cached frame.
+ * @see #Calibration_Entry_List
+ * @see #Calibration_Free
+ */
+static void Calibration_Remove(struct Calibration_Entry_Struct *entry)
+{
+	struct Calibration_Entry_Struct **previous = NULL;
+
+	if(entry->Reference_Count > 0)
+	{
+		entry->Is_Stale = TRUE;
+		return;
+	}
+	previous = &Calibration_Entry_List;
+	while((*previous) != entry)
+		previous = &((*previous)->Next);
+	(*previous) = entry->Next;
+	Calibration_Free(entry);
+}
+
+/**
+ * Throw away the least recently used frames not in use, until the cache holds no more than
+ * CALIBRATION_CACHE_MAX_ENTRY_COUNT frames (or every frame left is in use). Calibration_Mutex must be held.
+ * @see #CALIBRATION_CACHE_MAX_ENTRY_COUNT
+ * @see #Calibration_Remove
+ */
+static void Calibration_Evict(void)
+{
+	struct Calibration_Entry_Struct *entry = NULL;
+	struct Calibration_Entry_Struct *oldest_entry = NULL;
+	int count;
+
+	while(TRUE)
+	{
+		count = 0;
+		oldest_entry = NULL;
+		for(entry=Calibration_Entry_List;entry != NULL;entry=entry->Next)
+		{
+			if(entry->Is_Stale)
+				continue;
+			count++;
+			if((entry->Reference_Count == 0)&&
+			   ((oldest_entry == NULL)||(entry->Last_Used < oldest_entry->Last_Used)))
+				oldest_entry = entry;
+		}
+		if((count <= CALIBRATION_CACHE_MAX_ENTRY_COUNT)||(oldest_entry == NULL))
+			return;
+		Calibration_Remove(oldest_entry);
+	}
+}
+
+/**
+ * Free a cached frame, which must have been removed from the list.
+ * @param entry The cached frame.
+ */
+static void Calibration_Free(struct Calibration_Entry_Struct *entry)
+{
+	if(entry->Data != NULL)
+		free(entry->Data);
+	free(entry);
+}
+
+/**
+ * Thread pool task calibrating a band of rows of a frame, a chunk of pixels at a time.
+ * @param user_data The calibration structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread running the task (not used).
+ * @return The routine returns TRUE.
+ * @see #Calibration_Apply_Struct
+ * @see #DPRT_CALIBRATION_CHUNK_PIXELS
+ * @see #DpRt_Calibration_Apply_Pixels
+ */
+static int Calibration_Apply_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Calibration_Apply_Struct *apply = (struct Calibration_Apply_Struct *)user_data;
+	size_t start,end,chunk_count,i;
+	int end_y;
+
+	(void)thread_index;
+	start = ((size_t)band_index)*((size_t)apply->Band_Rows);
+	end_y = (band_index+1)*apply->Band_Rows;
+	if(end_y > apply->Naxis_Two)
+		end_y = apply->Naxis_Two;
+	end = ((size_t)end_y)*((size_t)apply->Naxis_One);
+	start *= (size_t)apply->Naxis_One;
+	for(i=start;i<end;i+=chunk_count)
+	{
+		chunk_count = end-i;
+		if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+			chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+		DpRt_Calibration_Apply_Pixels(apply->Data,apply->Encoding,i,chunk_count,0.0f,apply->Bias,
+					      apply->Flat,apply->Mask,apply->Output+i);
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
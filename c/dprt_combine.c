@@ -0,0 +1,744 @@
+/* dprt_combine.c
+** Per-pixel combination of stacks of frames.
+** $Header$
+*/
+/**
+ * dprt_combine.c combines the pixels of a stack of 16-bit frames into a floating point result, using the mean,
+ * median, kappa-sigma clipped mean or min/max rejected mean of each pixel's values. It is the inner loop of
+ * making master frames.
+ * <p>
+ * Stacks of up to DPRT_COMBINE_MAX_NETWORK_COUNT frames are combined DPRT_COMBINE_LANE_COUNT pixels at a time.
+ * The values of a block of pixels are put into a frame by lane array, and sorted with a sorting network
+ * (Batcher's odd-even merge sort, built once for each stack depth). Every compare-exchange of the network is a
+ * fixed length loop of min/max operations across the lanes with no branches, which the compiler turns into
+ * vector instructions. Unscaled stacks (biases) are sorted as unsigned shorts, which packs twice as many lanes
+ * into a vector; scaled stacks (flats) are sorted as floats. The median, min/max rejected mean and sigma clipped
+ * mean are then taken from the sorted values. Deeper stacks are combined a pixel at a time using quickselect.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_combine.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The maximum number of compare-exchanges in a sorting network. Batcher's odd-even merge sort of 32 values
+ * uses 191.
+ */
+#define COMBINE_NETWORK_MAX_PAIR_COUNT	(256)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a sorting network for one stack depth.
+ * <dl>
+ * <dt>Pair_Count</dt> <dd>The number of compare-exchanges in the network.</dd>
+ * <dt>Pair_List</dt> <dd>The compare-exchanges, in order. After each, the value in the first index is not
+ *     greater than the value in the second.</dd>
+ * </dl>
+ */
+struct Combine_Network_Struct
+{
+	int Pair_Count;
+	unsigned char Pair_List[COMBINE_NETWORK_MAX_PAIR_COUNT][2];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The sorting networks, indexed by stack depth.
+ * @see #Combine_Network_Struct
+ */
+static struct Combine_Network_Struct Combine_Network_List[DPRT_COMBINE_MAX_NETWORK_COUNT+1];
+/**
+ * Used to build the sorting networks once, on first use.
+ * @see #Combine_Network_Initialise
+ */
+static pthread_once_t Combine_Network_Once = PTHREAD_ONCE_INIT;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Combine_Network_Initialise(void);
+static void Combine_Network_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+				   size_t frame_stride,int frame_count,double *scale_list,int unscaled,
+				   size_t pixel_count,float *output);
+static void Combine_Sort_UShort(unsigned short block[][DPRT_COMBINE_LANE_COUNT],int frame_count);
+static void Combine_Sort_Float(float block[][DPRT_COMBINE_LANE_COUNT],int frame_count);
+static void Combine_Sorted_Block(struct DpRt_Combine_Parameter_Struct *parameters,
+				 float block[][DPRT_COMBINE_LANE_COUNT],int frame_count,float *result);
+static void Combine_Sigma_Clip_Block(float block[][DPRT_COMBINE_LANE_COUNT],int frame_count,double kappa,
+				     int iterations,float *result);
+static int Combine_Column_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+				 size_t frame_stride,int frame_count,double *scale_list,size_t pixel_count,
+				 float *output);
+static float Combine_Sigma_Clip(float *value_list,int count,double kappa,int iterations);
+static int Combine_Float_Compare(const void *a,const void *b);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Combine the pixels of a stack of frames. Pixel i of frame f is data[(f*frame_stride)+i], and is multiplied by
+ * scale_list[f] before being combined. The mean is accumulated frame by frame. The other methods use the
+ * sorting network kernels for stacks of up to DPRT_COMBINE_MAX_NETWORK_COUNT frames, and quickselect
+ * for deeper stacks. For min/max rejection, if Reject_Low plus Reject_High leaves no values, the median is used.
+ * @param parameters The combine method and it's parameters.
+ * @param data The stack of frames.
+ * @param frame_stride The number of pixels between the start of one frame and the next in data.
+ * @param frame_count The number of frames in the stack, at least one.
+ * @param scale_list The value each frame is multiplied by, frame_count long.
+ * @param pixel_count The number of pixels to combine, no more than frame_stride.
+ * @param output The address of a buffer of pixel_count floats to store the combined pixels.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Combine_Network_Pixels
+ * @see #Combine_Column_Pixels
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Combine_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+			size_t frame_stride,int frame_count,double *scale_list,size_t pixel_count,float *output)
+{
+	size_t i;
+	float scale;
+	int frame_index,unscaled;
+
+	if((parameters == NULL)||(data == NULL)||(scale_list == NULL)||(output == NULL)||(frame_count < 1))
+	{
+		DpRt_Error_Number = 1100;
+		sprintf(DpRt_Error_String,"DpRt_Combine_Pixels:Illegal arguments (%d frames).\n",frame_count);
+		return FALSE;
+	}
+	if((parameters->Method < DPRT_COMBINE_METHOD_MEAN)||(parameters->Method > DPRT_COMBINE_METHOD_MINMAX))
+	{
+		DpRt_Error_Number = 1100;
+		sprintf(DpRt_Error_String,"DpRt_Combine_Pixels:Illegal method %d.\n",parameters->Method);
+		return FALSE;
+	}
+	if(parameters->Method == DPRT_COMBINE_METHOD_MEAN)
+	{
+		for(i=0;i<pixel_count;i++)
+			output[i] = 0.0f;
+		for(frame_index=0;frame_index<frame_count;frame_index++)
+		{
+			scale = (float)(scale_list[frame_index]/((double)frame_count));
+			for(i=0;i<pixel_count;i++)
+				output[i] += ((float)data[(frame_index*frame_stride)+i])*scale;
+		}
+		return TRUE;
+	}
+	if(frame_count > DPRT_COMBINE_MAX_NETWORK_COUNT)
+	{
+		return Combine_Column_Pixels(parameters,data,frame_stride,frame_count,scale_list,pixel_count,
+					     output);
+	}
+	unscaled = TRUE;
+	for(frame_index=0;frame_index<frame_count;frame_index++)
+	{
+		if(scale_list[frame_index] != 1.0)
+			unscaled = FALSE;
+	}
+	pthread_once(&Combine_Network_Once,Combine_Network_Initialise);
+	Combine_Network_Pixels(parameters,data,frame_stride,frame_count,scale_list,unscaled,pixel_count,output);
+	return TRUE;
+}
+
+/**
+ * Find the median of a list of values, using quickselect. The list is re-ordered. For an even number of values,
+ * the mean of the middle two is returned.
+ * @param value_list The list of values.
+ * @param count The number of values, at least one.
+ * @return The median.
+ */
+float DpRt_Combine_Median(float *value_list,int count)
+{
+	float pivot,swap,upper,lower;
+	int left,right,i,j,k;
+
+	k = count/2;
+	left = 0;
+	right = count-1;
+	while(left < right)
+	{
+		pivot = value_list[(left+right)/2];
+		i = left;
+		j = right;
+		while(i <= j)
+		{
+			while(value_list[i] < pivot)
+				i++;
+			while(value_list[j] > pivot)
+				j--;
+			if(i <= j)
+			{
+				swap = value_list[i];
+				value_list[i] = value_list[j];
+				value_list[j] = swap;
+				i++;
+				j--;
+			}
+		}
+		if(k <= j)
+			right = j;
+		else if(k >= i)
+			left = i;
+		else
+			break;
+	}
+	upper = value_list[k];
+	if((count%2) == 1)
+		return upper;
+	/* the lower middle value is the largest value below k */
+	lower = value_list[0];
+	for(i=1;i<k;i++)
+	{
+		if(value_list[i] > lower)
+			lower = value_list[i];
+	}
+	return (lower+upper)/2.0f;
+}
+
+/**
+ * As DpRt_Combine_Median, for a list of doubles. The list is re-ordered.
+ * @param value_list The list of values.
+ * @param count The number of values, at least one.
+ * @return The median.
+ * @see #DpRt_Combine_Median
+ */
+double DpRt_Combine_Median_Double(double *value_list,int count)
+{
+	double pivot,swap,upper,lower;
+	int left,right,i,j,k;
+
+	k = count/2;
+	left = 0;
+	right = count-1;
+	while(left < right)
+	{
+		pivot = value_list[(left+right)/2];
+		i = left;
+		j = right;
+		while(i <= j)
+		{
+			while(value_list[i] < pivot)
+				i++;
+			while(value_list[j] > pivot)
+				j--;
+			if(i <= j)
+			{
+				swap = value_list[i];
+				value_list[i] = value_list[j];
+				value_list[j] = swap;
+				i++;
+				j--;
+			}
+		}
+		if(k <= j)
+			right = j;
+		else if(k >= i)
+			left = i;
+		else
+			break;
+	}
+	upper = value_list[k];
+	if((count%2) == 1)
+		return upper;
+	/* the lower middle value is the largest value below k */
+	lower = value_list[0];
+	for(i=1;i<k;i++)
+	{
+		if(value_list[i] > lower)
+			lower = value_list[i];
+	}
+	return (lower+upper)/2.0;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Build the sorting networks, called once via pthread_once. Batcher's odd-even merge sort network for
+ * DPRT_COMBINE_MAX_NETWORK_COUNT values is generated, and the network for each smaller depth n is the same network
+ * with the compare-exchanges involving values n and above removed (as if they were padded with infinities,
+ * which those compare-exchanges would never move).
+ * @see #Combine_Network_List
+ * @see #COMBINE_NETWORK_MAX_PAIR_COUNT
+ */
+static void Combine_Network_Initialise(void)
+{
+	struct Combine_Network_Struct *network = NULL;
+	int count,p,k,j,i,low,high;
+
+	for(count=0;count<=DPRT_COMBINE_MAX_NETWORK_COUNT;count++)
+		Combine_Network_List[count].Pair_Count = 0;
+	for(p=1;p<DPRT_COMBINE_MAX_NETWORK_COUNT;p+=p)
+	{
+		for(k=p;k>=1;k/=2)
+		{
+			for(j=k%p;j+k<DPRT_COMBINE_MAX_NETWORK_COUNT;j+=2*k)
+			{
+				for(i=0;(i<k)&&(i+j+k<DPRT_COMBINE_MAX_NETWORK_COUNT);i++)
+				{
+					if(((i+j)/(p*2)) != ((i+j+k)/(p*2)))
+						continue;
+					low = i+j;
+					high = i+j+k;
+					for(count=high+1;count<=DPRT_COMBINE_MAX_NETWORK_COUNT;count++)
+					{
+						network = &(Combine_Network_List[count]);
+						if(network->Pair_Count < COMBINE_NETWORK_MAX_PAIR_COUNT)
+						{
+							network->Pair_List[network->Pair_Count][0] = (unsigned char)low;
+							network->Pair_List[network->Pair_Count][1] = (unsigned char)high;
+							network->Pair_Count++;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Combine the pixels of a stack of at most DPRT_COMBINE_MAX_NETWORK_COUNT frames, DPRT_COMBINE_LANE_COUNT pixels
+ * at a time, using the sorting networks. The last block of pixels is padded with copies of it's first pixel.
+ * @param parameters The combine method and it's parameters.
+ * @param data The stack of frames.
+ * @param frame_stride The number of pixels between the start of one frame and the next in data.
+ * @param frame_count The number of frames in the stack.
+ * @param scale_list The value each frame is multiplied by.
+ * @param unscaled A boolean, TRUE if every value in scale_list is one, so the values can be sorted as
+ *        unsigned shorts.
+ * @param pixel_count The number of pixels to combine.
+ * @param output The address of a buffer of pixel_count floats to store the combined pixels.
+ * @see #Combine_Sort_UShort
+ * @see #Combine_Sort_Float
+ * @see #Combine_Sorted_Block
+ */
+static void Combine_Network_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+				   size_t frame_stride,int frame_count,double *scale_list,int unscaled,
+				   size_t pixel_count,float *output)
+{
+	unsigned short ushort_block[DPRT_COMBINE_MAX_NETWORK_COUNT][DPRT_COMBINE_LANE_COUNT];
+	float block[DPRT_COMBINE_MAX_NETWORK_COUNT][DPRT_COMBINE_LANE_COUNT];
+	float result[DPRT_COMBINE_LANE_COUNT];
+	unsigned short *source = NULL;
+	size_t i;
+	float scale;
+	int frame_index,lane,lane_count;
+
+	for(i=0;i<pixel_count;i+=DPRT_COMBINE_LANE_COUNT)
+	{
+		lane_count = DPRT_COMBINE_LANE_COUNT;
+		if(i+lane_count > pixel_count)
+			lane_count = (int)(pixel_count-i);
+		if(unscaled)
+		{
+			for(frame_index=0;frame_index<frame_count;frame_index++)
+			{
+				source = data+(frame_index*frame_stride)+i;
+				for(lane=0;lane<lane_count;lane++)
+					ushort_block[frame_index][lane] = source[lane];
+				for(;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+					ushort_block[frame_index][lane] = source[0];
+			}
+			Combine_Sort_UShort(ushort_block,frame_count);
+			for(frame_index=0;frame_index<frame_count;frame_index++)
+			{
+				for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+					block[frame_index][lane] = (float)ushort_block[frame_index][lane];
+			}
+		}
+		else
+		{
+			for(frame_index=0;frame_index<frame_count;frame_index++)
+			{
+				source = data+(frame_index*frame_stride)+i;
+				scale = (float)scale_list[frame_index];
+				for(lane=0;lane<lane_count;lane++)
+					block[frame_index][lane] = ((float)source[lane])*scale;
+				for(;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+					block[frame_index][lane] = ((float)source[0])*scale;
+			}
+			Combine_Sort_Float(block,frame_count);
+		}
+		Combine_Sorted_Block(parameters,block,frame_count,result);
+		for(lane=0;lane<lane_count;lane++)
+			output[i+lane] = result[lane];
+	}
+}
+
+/**
+ * Sort each lane of a block of unsigned short values, using the sorting network for frame_count values.
+ * @param block The block, frame_count rows of DPRT_COMBINE_LANE_COUNT lanes.
+ * @param frame_count The number of values in each lane.
+ * @see #Combine_Network_List
+ */
+static void Combine_Sort_UShort(unsigned short block[][DPRT_COMBINE_LANE_COUNT],int frame_count)
+{
+	struct Combine_Network_Struct *network = &(Combine_Network_List[frame_count]);
+	unsigned short minimum[DPRT_COMBINE_LANE_COUNT],maximum[DPRT_COMBINE_LANE_COUNT];
+	unsigned short *low = NULL;
+	unsigned short *high = NULL;
+	int pair,lane;
+
+	for(pair=0;pair<network->Pair_Count;pair++)
+	{
+		low = block[network->Pair_List[pair][0]];
+		high = block[network->Pair_List[pair][1]];
+		/* compute into temporaries, so the lane loops have no branches or aliasing to stop vectorisation */
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		{
+			minimum[lane] = (low[lane] < high[lane]) ? low[lane] : high[lane];
+			maximum[lane] = (low[lane] < high[lane]) ? high[lane] : low[lane];
+		}
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			low[lane] = minimum[lane];
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			high[lane] = maximum[lane];
+	}
+}
+
+/**
+ * Sort each lane of a block of float values, using the sorting network for frame_count values.
+ * @param block The block, frame_count rows of DPRT_COMBINE_LANE_COUNT lanes.
+ * @param frame_count The number of values in each lane.
+ * @see #Combine_Network_List
+ */
+static void Combine_Sort_Float(float block[][DPRT_COMBINE_LANE_COUNT],int frame_count)
+{
+	struct Combine_Network_Struct *network = &(Combine_Network_List[frame_count]);
+	float minimum[DPRT_COMBINE_LANE_COUNT],maximum[DPRT_COMBINE_LANE_COUNT];
+	float *low = NULL;
+	float *high = NULL;
+	int pair,lane;
+
+	for(pair=0;pair<network->Pair_Count;pair++)
+	{
+		low = block[network->Pair_List[pair][0]];
+		high = block[network->Pair_List[pair][1]];
+		/* compute into temporaries, so the lane loops have no branches or aliasing to stop vectorisation */
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		{
+			minimum[lane] = (low[lane] < high[lane]) ? low[lane] : high[lane];
+			maximum[lane] = (low[lane] < high[lane]) ? high[lane] : low[lane];
+		}
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			low[lane] = minimum[lane];
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			high[lane] = maximum[lane];
+	}
+}
+
+/**
+ * Combine each lane of a block of sorted values, using the median, min/max rejected mean or sigma clipped mean.
+ * @param parameters The combine method and it's parameters.
+ * @param block The sorted block, frame_count rows of DPRT_COMBINE_LANE_COUNT lanes.
+ * @param frame_count The number of values in each lane.
+ * @param result An array of DPRT_COMBINE_LANE_COUNT floats to store the combined value of each lane.
+ * @see #Combine_Sigma_Clip_Block
+ */
+static void Combine_Sorted_Block(struct DpRt_Combine_Parameter_Struct *parameters,
+				 float block[][DPRT_COMBINE_LANE_COUNT],int frame_count,float *result)
+{
+	double sum[DPRT_COMBINE_LANE_COUNT];
+	int reject_low,reject_high,frame_index,lane,k;
+
+	if(parameters->Method == DPRT_COMBINE_METHOD_SIGMA_CLIP)
+	{
+		Combine_Sigma_Clip_Block(block,frame_count,parameters->Kappa,parameters->Iterations,result);
+		return;
+	}
+	if(parameters->Method == DPRT_COMBINE_METHOD_MINMAX)
+	{
+		reject_low = parameters->Reject_Low;
+		reject_high = parameters->Reject_High;
+		if(reject_low < 0)
+			reject_low = 0;
+		if(reject_high < 0)
+			reject_high = 0;
+		if(reject_low+reject_high < frame_count)
+		{
+			for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+				sum[lane] = 0.0;
+			for(frame_index=reject_low;frame_index<frame_count-reject_high;frame_index++)
+			{
+				for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+					sum[lane] += block[frame_index][lane];
+			}
+			for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+				result[lane] = (float)(sum[lane]/((double)(frame_count-reject_low-reject_high)));
+			return;
+		}
+	}
+	/* median */
+	k = frame_count/2;
+	if((frame_count%2) == 1)
+	{
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			result[lane] = block[k][lane];
+	}
+	else
+	{
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			result[lane] = (block[k-1][lane]+block[k][lane])/2.0f;
+	}
+}
+
+/**
+ * Find the kappa-sigma clipped mean of each lane of a block of values. Each lane is clipped as
+ * Combine_Sigma_Clip does, but the values kept are held as a mask of weights, so the sums over the
+ * lanes have no branches.
+ * @param block The block, frame_count rows of DPRT_COMBINE_LANE_COUNT lanes.
+ * @param frame_count The number of values in each lane.
+ * @param kappa The number of standard deviations from the mean beyond which values are rejected.
+ * @param iterations The maximum number of clipping iterations.
+ * @param result An array of DPRT_COMBINE_LANE_COUNT floats to store the clipped mean of each lane.
+ * @see #Combine_Sigma_Clip
+ */
+static void Combine_Sigma_Clip_Block(float block[][DPRT_COMBINE_LANE_COUNT],int frame_count,double kappa,
+				     int iterations,float *result)
+{
+	float weight[DPRT_COMBINE_MAX_NETWORK_COUNT][DPRT_COMBINE_LANE_COUNT];
+	double sum[DPRT_COMBINE_LANE_COUNT],sum_squares[DPRT_COMBINE_LANE_COUNT];
+	double count[DPRT_COMBINE_LANE_COUNT],mean[DPRT_COMBINE_LANE_COUNT],limit[DPRT_COMBINE_LANE_COUNT];
+	double kept_count[DPRT_COMBINE_LANE_COUNT];
+	float active[DPRT_COMBINE_LANE_COUNT];
+	double variance,value;
+	int done[DPRT_COMBINE_LANE_COUNT];
+	int iteration,frame_index,lane,all_done;
+
+	for(frame_index=0;frame_index<frame_count;frame_index++)
+	{
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			weight[frame_index][lane] = 1.0f;
+	}
+	for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+	{
+		done[lane] = FALSE;
+		mean[lane] = 0.0;
+		limit[lane] = 0.0;
+	}
+	for(iteration=0;iteration<=iterations;iteration++)
+	{
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		{
+			sum[lane] = 0.0;
+			sum_squares[lane] = 0.0;
+			count[lane] = 0.0;
+		}
+		for(frame_index=0;frame_index<frame_count;frame_index++)
+		{
+			for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			{
+				value = weight[frame_index][lane]*block[frame_index][lane];
+				sum[lane] += value;
+				sum_squares[lane] += value*block[frame_index][lane];
+				count[lane] += weight[frame_index][lane];
+			}
+		}
+		all_done = TRUE;
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		{
+			if(done[lane])
+				continue;
+			mean[lane] = sum[lane]/count[lane];
+			if((iteration == iterations)||(count[lane] < 3.0))
+			{
+				done[lane] = TRUE;
+				continue;
+			}
+			variance = (sum_squares[lane]/count[lane])-(mean[lane]*mean[lane]);
+			if(variance <= 0.0)
+			{
+				done[lane] = TRUE;
+				continue;
+			}
+			limit[lane] = kappa*sqrt(variance);
+			all_done = FALSE;
+		}
+		if(all_done)
+			break;
+		/* count the values each lane would keep */
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			kept_count[lane] = 0.0;
+		for(frame_index=0;frame_index<frame_count;frame_index++)
+		{
+			for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			{
+				kept_count[lane] += weight[frame_index][lane]*
+					((fabs(((double)block[frame_index][lane])-mean[lane]) <= limit[lane]) ? 1.0 : 0.0);
+			}
+		}
+		/* lanes that would keep all or none of their values are finished */
+		for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		{
+			if((!done[lane])&&((kept_count[lane] == count[lane])||(kept_count[lane] == 0.0)))
+				done[lane] = TRUE;
+			active[lane] = done[lane] ? 0.0f : 1.0f;
+		}
+		/* reject values from the lanes still clipping */
+		for(frame_index=0;frame_index<frame_count;frame_index++)
+		{
+			for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+			{
+				weight[frame_index][lane] *= 1.0f-
+					((fabs(((double)block[frame_index][lane])-mean[lane]) > limit[lane]) ? active[lane] : 0.0f);
+			}
+		}
+	}
+	for(lane=0;lane<DPRT_COMBINE_LANE_COUNT;lane++)
+		result[lane] = (float)mean[lane];
+}
+
+/**
+ * Combine the pixels of a stack of more than DPRT_COMBINE_MAX_NETWORK_COUNT frames, a pixel at a time.
+ * @param parameters The combine method and it's parameters.
+ * @param data The stack of frames.
+ * @param frame_stride The number of pixels between the start of one frame and the next in data.
+ * @param frame_count The number of frames in the stack.
+ * @param scale_list The value each frame is multiplied by.
+ * @param pixel_count The number of pixels to combine.
+ * @param output The address of a buffer of pixel_count floats to store the combined pixels.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Combine_Median
+ * @see #Combine_Sigma_Clip
+ * @see #Combine_Float_Compare
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Combine_Column_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+				 size_t frame_stride,int frame_count,double *scale_list,size_t pixel_count,
+				 float *output)
+{
+	float *column = NULL;
+	double sum;
+	size_t i;
+	int reject_low,reject_high,frame_index;
+
+	column = (float *)malloc(frame_count*sizeof(float));
+	if(column == NULL)
+	{
+		DpRt_Error_Number = 1101;
+		sprintf(DpRt_Error_String,"Combine_Column_Pixels:Failed to allocate column (%d frames).\n",
+			frame_count);
+		return FALSE;
+	}
+	reject_low = parameters->Reject_Low;
+	reject_high = parameters->Reject_High;
+	if(reject_low < 0)
+		reject_low = 0;
+	if(reject_high < 0)
+		reject_high = 0;
+	for(i=0;i<pixel_count;i++)
+	{
+		for(frame_index=0;frame_index<frame_count;frame_index++)
+		{
+			column[frame_index] = ((float)data[(frame_index*frame_stride)+i])*
+				((float)scale_list[frame_index]);
+		}
+		if(parameters->Method == DPRT_COMBINE_METHOD_SIGMA_CLIP)
+			output[i] = Combine_Sigma_Clip(column,frame_count,parameters->Kappa,parameters->Iterations);
+		else if((parameters->Method == DPRT_COMBINE_METHOD_MINMAX)&&(reject_low+reject_high < frame_count))
+		{
+			qsort(column,frame_count,sizeof(float),Combine_Float_Compare);
+			sum = 0.0;
+			for(frame_index=reject_low;frame_index<frame_count-reject_high;frame_index++)
+				sum += column[frame_index];
+			output[i] = (float)(sum/((double)(frame_count-reject_low-reject_high)));
+		}
+		else
+			output[i] = DpRt_Combine_Median(column,frame_count);
+	}
+	free(column);
+	return TRUE;
+}
+
+/**
+ * Find the kappa-sigma clipped mean of a list of values. Values more than kappa standard deviations from the
+ * mean of the remaining values are rejected, until none are rejected or iterations have been done.
+ * The list is re-ordered.
+ * @param value_list The list of values.
+ * @param count The number of values, at least one.
+ * @param kappa The number of standard deviations from the mean beyond which values are rejected.
+ * @param iterations The maximum number of clipping iterations.
+ * @return The clipped mean.
+ */
+static float Combine_Sigma_Clip(float *value_list,int count,double kappa,int iterations)
+{
+	double sum,sum_squares,mean,sigma,limit;
+	float swap;
+	int iteration,i,kept_count;
+
+	mean = 0.0;
+	for(iteration=0;iteration<=iterations;iteration++)
+	{
+		sum = 0.0;
+		sum_squares = 0.0;
+		for(i=0;i<count;i++)
+		{
+			sum += value_list[i];
+			sum_squares += ((double)value_list[i])*((double)value_list[i]);
+		}
+		mean = sum/((double)count);
+		if((iteration == iterations)||(count < 3))
+			break;
+		sigma = (sum_squares/((double)count))-(mean*mean);
+		if(sigma <= 0.0)
+			break;
+		limit = kappa*sqrt(sigma);
+		/* move the kept values to the start of the list */
+		kept_count = 0;
+		for(i=0;i<count;i++)
+		{
+			if(fabs(((double)value_list[i])-mean) <= limit)
+			{
+				swap = value_list[kept_count];
+				value_list[kept_count] = value_list[i];
+				value_list[i] = swap;
+				kept_count++;
+			}
+		}
+		if((kept_count == count)||(kept_count == 0))
+			break;
+		count = kept_count;
+	}
+	return (float)mean;
+}
+
+/**
+ * qsort comparison function for floats, sorting into ascending order.
+ * @param a The address of the first float.
+ * @param b The address of the second float.
+ * @return The routine returns -1, 0 or 1 if a is less than, equal to or greater than b.
+ */
+static int Combine_Float_Compare(const void *a,const void *b)
+{
+	float fa = *((const float *)a);
+	float fb = *((const float *)b);
+
+	if(fa < fb)
+		return -1;
+	if(fa > fb)
+		return 1;
+	return 0;
+}
+
+/*
+** $Log$
+*/
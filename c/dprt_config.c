@@ -0,0 +1,640 @@
+/* dprt_config.c
+** Cached snapshot of the dprt.* configuration properties.
+** $Header$
+*/
+/**
+ * dprt_config.c holds a typed, read-only snapshot of the dprt.* configuration properties used by the
+ * reduction routines. The snapshot is loaded once (in DpRt_Initialise) using the DpRt_JNI_Get_Property* routines,
+ * which when running under JNI are upcalls into the Java DpRtStatus object. The per-frame reduction routines then
+ * retrieve their configuration from a native hash table, rather than calling back into Java each time.
+ * The snapshot can be re-loaded using DpRt_Config_Load, which builds a new snapshot and swaps it in.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of slots in the snapshot hash table. Must be a power of two, and larger than the number of
+ * entries in Config_Keyword_List.
+ * @see #Config_Keyword_List
+ */
+#define CONFIG_HASH_TABLE_SIZE		(128)
+
+/* ------------------------------------------------------- */
+/* enums */
+/* ------------------------------------------------------- */
+/**
+ * The type of a configuration property value.
+ * <dl>
+ * <dt>CONFIG_TYPE_STRING</dt> <dd>The value is a string.</dd>
+ * <dt>CONFIG_TYPE_INTEGER</dt> <dd>The value is an integer.</dd>
+ * <dt>CONFIG_TYPE_DOUBLE</dt> <dd>The value is a double.</dd>
+ * <dt>CONFIG_TYPE_BOOLEAN</dt> <dd>The value is a boolean (TRUE/FALSE).</dd>
+ * </dl>
+ */
+enum CONFIG_TYPE
+{
+	CONFIG_TYPE_STRING=0,CONFIG_TYPE_INTEGER=1,CONFIG_TYPE_DOUBLE=2,CONFIG_TYPE_BOOLEAN=3
+};
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure describing a configuration property to be loaded into the snapshot.
+ * <dl>
+ * <dt>Keyword</dt> <dd>The property keyword.</dd>
+ * <dt>Type</dt> <dd>The type of the property value, of type CONFIG_TYPE.</dd>
+ * <dt>Mandatory</dt> <dd>A boolean, if TRUE loading the snapshot fails if this property cannot be retrieved.
+ *     Otherwise the property is marked as not present, and an error only occurs when an attempt
+ *     is made to retrieve it.</dd>
+ * <dt>Default_Value</dt> <dd>For optional properties, a string representation of the value to use if the
+ *     property cannot be retrieved, or NULL if the property has no default value.</dd>
+ * </dl>
+ * @see #CONFIG_TYPE
+ */
+struct Config_Keyword_Struct
+{
+	char *Keyword;
+	enum CONFIG_TYPE Type;
+	int Mandatory;
+	char *Default_Value;
+};
+
+/**
+ * Structure holding a loaded configuration property value (a hash table slot).
+ * <dl>
+ * <dt>Keyword</dt> <dd>The property keyword, or NULL if this hash table slot is empty.</dd>
+ * <dt>Type</dt> <dd>The type of the property value, of type CONFIG_TYPE.</dd>
+ * <dt>Is_Present</dt> <dd>A boolean, TRUE if the property was successfully retrieved when the snapshot was
+ *     loaded.</dd>
+ * <dt>String_Value</dt> <dd>The value, if the property is of type CONFIG_TYPE_STRING.</dd>
+ * <dt>Integer_Value</dt> <dd>The value, if the property is of type CONFIG_TYPE_INTEGER or CONFIG_TYPE_BOOLEAN.</dd>
+ * <dt>Double_Value</dt> <dd>The value, if the property is of type CONFIG_TYPE_DOUBLE.</dd>
+ * </dl>
+ * @see #CONFIG_TYPE
+ */
+struct Config_Entry_Struct
+{
+	char *Keyword;
+	enum CONFIG_TYPE Type;
+	int Is_Present;
+	char *String_Value;
+	int Integer_Value;
+	double Double_Value;
+};
+
+/**
+ * Structure holding a complete configuration snapshot.
+ * <dl>
+ * <dt>Entry_List</dt> <dd>An open addressing hash table of CONFIG_HASH_TABLE_SIZE entries.</dd>
+ * </dl>
+ * @see #CONFIG_HASH_TABLE_SIZE
+ * @see #Config_Entry_Struct
+ */
+struct Config_Snapshot_Struct
+{
+	struct Config_Entry_Struct Entry_List[CONFIG_HASH_TABLE_SIZE];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of configuration properties loaded into the snapshot. The list is terminated by an entry with
+ * a NULL keyword.
+ * @see #Config_Keyword_Struct
+ */
+static struct Config_Keyword_Struct Config_Keyword_List[] =
+{
+	{"dprt.fake",CONFIG_TYPE_BOOLEAN,TRUE,NULL},
+	{"dprt.path",CONFIG_TYPE_STRING,FALSE,NULL},
+	{"dprt.full_reduction",CONFIG_TYPE_BOOLEAN,FALSE,NULL},
+	{"dprt.quick_look",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.make_master_bias",CONFIG_TYPE_BOOLEAN,FALSE,NULL},
+	{"dprt.make_master_flat",CONFIG_TYPE_BOOLEAN,FALSE,NULL},
+	{"dprt.telfocus.best_focus",CONFIG_TYPE_DOUBLE,FALSE,NULL},
+	{"dprt.telfocus.fwhm_per_mm",CONFIG_TYPE_DOUBLE,FALSE,NULL},
+	{"dprt.telfocus.atmospheric_seeing",CONFIG_TYPE_DOUBLE,FALSE,NULL},
+	{"dprt.telfocus.atmospheric_variation",CONFIG_TYPE_DOUBLE,FALSE,NULL},
+	{"dprt.saturation_level",CONFIG_TYPE_INTEGER,FALSE,"65535"},
+	{"dprt.stats.kernel",CONFIG_TYPE_STRING,FALSE,"auto"},
+	{"dprt.threads",CONFIG_TYPE_INTEGER,FALSE,"0"},
+	{"dprt.reduce.band_rows",CONFIG_TYPE_INTEGER,FALSE,"64"},
+	{"dprt.buffer_pool.max_mbytes",CONFIG_TYPE_INTEGER,FALSE,"1024"},
+	{"dprt.buffer_pool.huge_pages",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.fits.mmap",CONFIG_TYPE_BOOLEAN,FALSE,"true"},
+	{"dprt.job.threads",CONFIG_TYPE_INTEGER,FALSE,"1"},
+	{"dprt.batch.depth",CONFIG_TYPE_INTEGER,FALSE,"2"},
+	{"dprt.master.native",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.master.bias.obstype",CONFIG_TYPE_STRING,FALSE,"BIAS"},
+	{"dprt.master.flat.obstype",CONFIG_TYPE_STRING,FALSE,"FLAT"},
+	{"dprt.master.bias.method",CONFIG_TYPE_STRING,FALSE,"median"},
+	{"dprt.master.flat.method",CONFIG_TYPE_STRING,FALSE,"median"},
+	{"dprt.master.flat.normalise",CONFIG_TYPE_BOOLEAN,FALSE,"true"},
+	{"dprt.master.flat.normalise.window",CONFIG_TYPE_INTEGER,FALSE,"51"},
+	{"dprt.master.flat.normalise.min_level",CONFIG_TYPE_DOUBLE,FALSE,"0.1"},
+	{"dprt.master.min_frames",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.master.max_mbytes",CONFIG_TYPE_INTEGER,FALSE,"256"},
+	{"dprt.master.sigma_clip.kappa",CONFIG_TYPE_DOUBLE,FALSE,"3.0"},
+	{"dprt.master.sigma_clip.iterations",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.master.minmax.reject_low",CONFIG_TYPE_INTEGER,FALSE,"1"},
+	{"dprt.master.minmax.reject_high",CONFIG_TYPE_INTEGER,FALSE,"1"},
+	{"dprt.master.accumulate",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.master.accumulate.reservoir",CONFIG_TYPE_INTEGER,FALSE,"16"},
+	{"dprt.master.accumulate.scratch_directory",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.calibration.directory",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.calibration.bpm_filename",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.mask.auto",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.mask.bias_sigma",CONFIG_TYPE_DOUBLE,FALSE,"6.0"},
+	{"dprt.mask.column_sigma",CONFIG_TYPE_DOUBLE,FALSE,"5.0"},
+	{"dprt.mask.flat_low",CONFIG_TYPE_DOUBLE,FALSE,"0.5"},
+	{"dprt.mask.flat_high",CONFIG_TYPE_DOUBLE,FALSE,"1.5"},
+	{"dprt.overscan",CONFIG_TYPE_BOOLEAN,FALSE,"false"},
+	{"dprt.overscan.biassec",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.overscan.trimsec",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.overscan.method",CONFIG_TYPE_STRING,FALSE,"median"},
+	{"dprt.overscan.sigma_clip.kappa",CONFIG_TYPE_DOUBLE,FALSE,"3.0"},
+	{"dprt.overscan.sigma_clip.iterations",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.sky.zero_point",CONFIG_TYPE_DOUBLE,FALSE,"25.0"},
+	{"dprt.sky.pixel_scale",CONFIG_TYPE_DOUBLE,FALSE,"0.44"},
+	{"dprt.sky.sigma_clip.kappa",CONFIG_TYPE_DOUBLE,FALSE,"3.0"},
+	{"dprt.sky.sigma_clip.iterations",CONFIG_TYPE_INTEGER,FALSE,"5"},
+	{"dprt.source.max_count",CONFIG_TYPE_INTEGER,FALSE,"16"},
+	{"dprt.source.detect_sigma",CONFIG_TYPE_DOUBLE,FALSE,"5.0"},
+	{"dprt.source.min_pixels",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.source.stamp_radius",CONFIG_TYPE_INTEGER,FALSE,"8"},
+	{"dprt.source.min_fwhm",CONFIG_TYPE_DOUBLE,FALSE,"1.0"},
+	{"dprt.source.peak.psf_fwhm",CONFIG_TYPE_DOUBLE,FALSE,"1.5"},
+	{"dprt.focus.min_frames",CONFIG_TYPE_INTEGER,FALSE,"5"},
+	{"dprt.focus.tolerance",CONFIG_TYPE_DOUBLE,FALSE,"0.02"},
+	{"dprt.focus.sigma_clip.kappa",CONFIG_TYPE_DOUBLE,FALSE,"3.0"},
+	{"dprt.focus.sigma_clip.iterations",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.spectrum.enable",CONFIG_TYPE_BOOLEAN,FALSE,"true"},
+	{"dprt.spectrum.aperture",CONFIG_TYPE_INTEGER,FALSE,"5"},
+	{"dprt.spectrum.sky.gap",CONFIG_TYPE_INTEGER,FALSE,"5"},
+	{"dprt.spectrum.sky.width",CONFIG_TYPE_INTEGER,FALSE,"10"},
+	{"dprt.spectrum.detect_sigma",CONFIG_TYPE_DOUBLE,FALSE,"5.0"},
+	{"dprt.spectrum.suffix",CONFIG_TYPE_STRING,FALSE,"_1d"},
+	{"dprt.trace.block_count",CONFIG_TYPE_INTEGER,FALSE,"16"},
+	{"dprt.trace.order",CONFIG_TYPE_INTEGER,FALSE,"1"},
+	{"dprt.trace.window",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.trace.search_window",CONFIG_TYPE_INTEGER,FALSE,"10"},
+	{"dprt.trace.max_residual",CONFIG_TYPE_DOUBLE,FALSE,"0.5"},
+	{"dprt.arc.obstype",CONFIG_TYPE_STRING,FALSE,"ARC"},
+	{"dprt.arc.line_list",CONFIG_TYPE_STRING,FALSE,""},
+	{"dprt.arc.detect_sigma",CONFIG_TYPE_DOUBLE,FALSE,"10.0"},
+	{"dprt.arc.order",CONFIG_TYPE_INTEGER,FALSE,"3"},
+	{"dprt.arc.initial.central_wavelength",CONFIG_TYPE_DOUBLE,FALSE,"6000.0"},
+	{"dprt.arc.initial.dispersion",CONFIG_TYPE_DOUBLE,FALSE,"4.6"},
+	{"dprt.arc.initial.search_range",CONFIG_TYPE_DOUBLE,FALSE,"200.0"},
+	{"dprt.arc.match_tolerance",CONFIG_TYPE_DOUBLE,FALSE,"10.0"},
+	{"dprt.arc.refine_tolerance",CONFIG_TYPE_DOUBLE,FALSE,"3.0"},
+	{"dprt.arc.min_lines",CONFIG_TYPE_INTEGER,FALSE,"6"},
+	{"dprt.arc.max_rms",CONFIG_TYPE_DOUBLE,FALSE,"1.0"},
+	{NULL,CONFIG_TYPE_STRING,FALSE,NULL}
+};
+/**
+ * The currently loaded configuration snapshot, or NULL if no snapshot has been loaded.
+ * @see #Config_Snapshot_Struct
+ */
+static struct Config_Snapshot_Struct *Config_Snapshot = NULL;
+/**
+ * Mutex protecting Config_Snapshot, so a snapshot can be re-loaded whilst a reduction is retrieving values.
+ * @see #Config_Snapshot
+ */
+static pthread_mutex_t Config_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static unsigned int Config_Hash(char *keyword);
+static struct Config_Entry_Struct *Config_Find(struct Config_Snapshot_Struct *snapshot,char *keyword,int insert);
+static int Config_Get_Entry(char *function_name,char *keyword,enum CONFIG_TYPE type,
+			    struct Config_Entry_Struct *entry);
+static int Config_Set_Default(struct Config_Entry_Struct *entry,char *default_value);
+static void Config_Snapshot_Free(struct Config_Snapshot_Struct *snapshot);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Load (or re-load) the configuration snapshot. Each property in Config_Keyword_List is retrieved using the
+ * relevant DpRt_JNI_Get_Property* routine, and stored in a new snapshot hash table. If a mandatory property
+ * cannot be retrieved the routine fails, and the previous snapshot (if any) is retained. If an optional property
+ * with a default value cannot be retrieved, the default value is used instead.
+ * Otherwise the new snapshot replaces the current one, which is freed.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Keyword_List
+ * @see #Config_Snapshot
+ * @see #Config_Mutex
+ * @see #Config_Find
+ * @see #Config_Set_Default
+ * @see #Config_Snapshot_Free
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Integer
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Double
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_context.html#DpRt_Context_Error_From_JNI
+ */
+int DpRt_Config_Load(void)
+{
+	struct Config_Snapshot_Struct *snapshot = NULL;
+	struct Config_Snapshot_Struct *old_snapshot = NULL;
+	struct Config_Entry_Struct *entry = NULL;
+	int i,retval;
+
+	snapshot = (struct Config_Snapshot_Struct *)malloc(sizeof(struct Config_Snapshot_Struct));
+	if(snapshot == NULL)
+	{
+		DpRt_Error_Number = 100;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load: Failed to allocate snapshot.\n");
+		return FALSE;
+	}
+	memset(snapshot,0,sizeof(struct Config_Snapshot_Struct));
+	for(i=0;Config_Keyword_List[i].Keyword != NULL;i++)
+	{
+		entry = Config_Find(snapshot,Config_Keyword_List[i].Keyword,TRUE);
+		if(entry == NULL)
+		{
+			Config_Snapshot_Free(snapshot);
+			DpRt_Error_Number = 101;
+			sprintf(DpRt_Error_String,"DpRt_Config_Load: Hash table full when adding %s.\n",
+				Config_Keyword_List[i].Keyword);
+			return FALSE;
+		}
+		entry->Type = Config_Keyword_List[i].Type;
+		switch(entry->Type)
+		{
+			case CONFIG_TYPE_STRING:
+				retval = DpRt_JNI_Get_Property(entry->Keyword,&(entry->String_Value));
+				break;
+			case CONFIG_TYPE_INTEGER:
+				retval = DpRt_JNI_Get_Property_Integer(entry->Keyword,&(entry->Integer_Value));
+				break;
+			case CONFIG_TYPE_DOUBLE:
+				retval = DpRt_JNI_Get_Property_Double(entry->Keyword,&(entry->Double_Value));
+				break;
+			case CONFIG_TYPE_BOOLEAN:
+				retval = DpRt_JNI_Get_Property_Boolean(entry->Keyword,&(entry->Integer_Value));
+				break;
+			default:
+				retval = FALSE;
+				break;
+		}
+		entry->Is_Present = retval;
+		if(retval == FALSE)
+		{
+			if(Config_Keyword_List[i].Mandatory)
+			{
+				Config_Snapshot_Free(snapshot);
+				DpRt_Context_Error_From_JNI();
+				return FALSE;
+			}
+			/* an optional property is allowed to be missing */
+			DpRt_JNI_Error_Number = 0;
+			DpRt_JNI_Error_String[0] = '\0';
+			if(Config_Keyword_List[i].Default_Value != NULL)
+			{
+				if(!Config_Set_Default(entry,Config_Keyword_List[i].Default_Value))
+				{
+					Config_Snapshot_Free(snapshot);
+					return FALSE;
+				}
+				fprintf(stdout,"DpRt_Config_Load:%s:Not present:Using default %s.\n",entry->Keyword,
+					Config_Keyword_List[i].Default_Value);
+			}
+			else
+				fprintf(stdout,"DpRt_Config_Load:%s:Not present.\n",entry->Keyword);
+		}
+	}
+	pthread_mutex_lock(&Config_Mutex);
+	old_snapshot = Config_Snapshot;
+	Config_Snapshot = snapshot;
+	pthread_mutex_unlock(&Config_Mutex);
+	if(old_snapshot != NULL)
+		Config_Snapshot_Free(old_snapshot);
+	fprintf(stdout,"DpRt_Config_Load:Configuration snapshot loaded.\n");
+	return TRUE;
+}
+
+/**
+ * Free the currently loaded configuration snapshot.
+ * @return The routine returns TRUE.
+ * @see #Config_Snapshot
+ * @see #Config_Mutex
+ * @see #Config_Snapshot_Free
+ */
+int DpRt_Config_Free(void)
+{
+	struct Config_Snapshot_Struct *old_snapshot = NULL;
+
+	pthread_mutex_lock(&Config_Mutex);
+	old_snapshot = Config_Snapshot;
+	Config_Snapshot = NULL;
+	pthread_mutex_unlock(&Config_Mutex);
+	if(old_snapshot != NULL)
+		Config_Snapshot_Free(old_snapshot);
+	return TRUE;
+}
+
+/**
+ * Return whether a configuration snapshot is currently loaded.
+ * @return TRUE if a snapshot is loaded, FALSE otherwise.
+ * @see #Config_Snapshot
+ */
+int DpRt_Config_Is_Loaded(void)
+{
+	int retval;
+
+	pthread_mutex_lock(&Config_Mutex);
+	retval = (Config_Snapshot != NULL);
+	pthread_mutex_unlock(&Config_Mutex);
+	return retval;
+}
+
+/**
+ * Retrieve a string property from the configuration snapshot.
+ * @param keyword The property keyword.
+ * @param value The address of a string pointer. On success, this is set to a copy of the property value,
+ *        allocated with malloc, which the caller must free.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Get_Entry
+ */
+int DpRt_Config_Get_String(char *keyword,char **value)
+{
+	struct Config_Entry_Struct entry;
+
+	if(value == NULL)
+	{
+		DpRt_Error_Number = 102;
+		sprintf(DpRt_Error_String,"DpRt_Config_Get_String:%s:value was NULL.\n",keyword);
+		return FALSE;
+	}
+	if(!Config_Get_Entry("DpRt_Config_Get_String",keyword,CONFIG_TYPE_STRING,&entry))
+		return FALSE;
+	(*value) = entry.String_Value;
+	return TRUE;
+}
+
+/**
+ * Retrieve an integer property from the configuration snapshot.
+ * @param keyword The property keyword.
+ * @param value The address of an integer to store the value.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Get_Entry
+ */
+int DpRt_Config_Get_Integer(char *keyword,int *value)
+{
+	struct Config_Entry_Struct entry;
+
+	if(value == NULL)
+	{
+		DpRt_Error_Number = 103;
+		sprintf(DpRt_Error_String,"DpRt_Config_Get_Integer:%s:value was NULL.\n",keyword);
+		return FALSE;
+	}
+	if(!Config_Get_Entry("DpRt_Config_Get_Integer",keyword,CONFIG_TYPE_INTEGER,&entry))
+		return FALSE;
+	(*value) = entry.Integer_Value;
+	return TRUE;
+}
+
+/**
+ * Retrieve a double property from the configuration snapshot.
+ * @param keyword The property keyword.
+ * @param value The address of a double to store the value.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Get_Entry
+ */
+int DpRt_Config_Get_Double(char *keyword,double *value)
+{
+	struct Config_Entry_Struct entry;
+
+	if(value == NULL)
+	{
+		DpRt_Error_Number = 104;
+		sprintf(DpRt_Error_String,"DpRt_Config_Get_Double:%s:value was NULL.\n",keyword);
+		return FALSE;
+	}
+	if(!Config_Get_Entry("DpRt_Config_Get_Double",keyword,CONFIG_TYPE_DOUBLE,&entry))
+		return FALSE;
+	(*value) = entry.Double_Value;
+	return TRUE;
+}
+
+/**
+ * Retrieve a boolean property from the configuration snapshot.
+ * @param keyword The property keyword.
+ * @param value The address of an integer to store the value (TRUE or FALSE).
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Get_Entry
+ */
+int DpRt_Config_Get_Boolean(char *keyword,int *value)
+{
+	struct Config_Entry_Struct entry;
+
+	if(value == NULL)
+	{
+		DpRt_Error_Number = 105;
+		sprintf(DpRt_Error_String,"DpRt_Config_Get_Boolean:%s:value was NULL.\n",keyword);
+		return FALSE;
+	}
+	if(!Config_Get_Entry("DpRt_Config_Get_Boolean",keyword,CONFIG_TYPE_BOOLEAN,&entry))
+		return FALSE;
+	(*value) = entry.Integer_Value;
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Compute a hash of the specified keyword (djb2).
+ * @param keyword The keyword to hash.
+ * @return The hash value.
+ */
+static unsigned int Config_Hash(char *keyword)
+{
+	unsigned int hash = 5381;
+	unsigned char *ch = NULL;
+
+	for(ch = (unsigned char *)keyword;(*ch) != '\0';ch++)
+		hash = ((hash << 5) + hash) + (*ch);
+	return hash;
+}
+
+/**
+ * Find the hash table slot for a keyword, using linear probing.
+ * @param snapshot The snapshot to search.
+ * @param keyword The keyword to find.
+ * @param insert A boolean, if TRUE and the keyword is not in the table, an empty slot is claimed for it.
+ * @return A pointer to the slot, or NULL if the keyword was not found (or the table is full when inserting).
+ * @see #CONFIG_HASH_TABLE_SIZE
+ * @see #Config_Hash
+ */
+static struct Config_Entry_Struct *Config_Find(struct Config_Snapshot_Struct *snapshot,char *keyword,int insert)
+{
+	unsigned int index;
+	int i;
+
+	index = Config_Hash(keyword) & (CONFIG_HASH_TABLE_SIZE-1);
+	for(i=0;i<CONFIG_HASH_TABLE_SIZE;i++)
+	{
+		if(snapshot->Entry_List[index].Keyword == NULL)
+		{
+			if(insert == FALSE)
+				return NULL;
+			snapshot->Entry_List[index].Keyword = keyword;
+			return &(snapshot->Entry_List[index]);
+		}
+		if(strcmp(snapshot->Entry_List[index].Keyword,keyword) == 0)
+			return &(snapshot->Entry_List[index]);
+		index = (index+1) & (CONFIG_HASH_TABLE_SIZE-1);
+	}
+	return NULL;
+}
+
+/**
+ * Copy a property entry out of the current snapshot, whilst holding Config_Mutex.
+ * String values are duplicated, so the copy remains valid if the snapshot is re-loaded.
+ * @param function_name The name of the calling function, used in error messages.
+ * @param keyword The property keyword.
+ * @param type The type of value the caller expects.
+ * @param entry The address of a structure to copy the entry into.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Config_Snapshot
+ * @see #Config_Mutex
+ * @see #Config_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Config_Get_Entry(char *function_name,char *keyword,enum CONFIG_TYPE type,
+			    struct Config_Entry_Struct *entry)
+{
+	struct Config_Entry_Struct *snapshot_entry = NULL;
+
+	if(keyword == NULL)
+	{
+		DpRt_Error_Number = 106;
+		sprintf(DpRt_Error_String,"%s:keyword was NULL.\n",function_name);
+		return FALSE;
+	}
+	pthread_mutex_lock(&Config_Mutex);
+	if(Config_Snapshot == NULL)
+	{
+		pthread_mutex_unlock(&Config_Mutex);
+		DpRt_Error_Number = 107;
+		sprintf(DpRt_Error_String,"%s:%s:Configuration snapshot not loaded.\n",function_name,keyword);
+		return FALSE;
+	}
+	snapshot_entry = Config_Find(Config_Snapshot,keyword,FALSE);
+	if((snapshot_entry == NULL)||(snapshot_entry->Is_Present == FALSE))
+	{
+		pthread_mutex_unlock(&Config_Mutex);
+		DpRt_Error_Number = 108;
+		sprintf(DpRt_Error_String,"%s:%s:Not present in configuration snapshot.\n",function_name,keyword);
+		return FALSE;
+	}
+	if(snapshot_entry->Type != type)
+	{
+		pthread_mutex_unlock(&Config_Mutex);
+		DpRt_Error_Number = 109;
+		sprintf(DpRt_Error_String,"%s:%s:Wrong type %d (%d).\n",function_name,keyword,
+			snapshot_entry->Type,type);
+		return FALSE;
+	}
+	(*entry) = (*snapshot_entry);
+	if((type == CONFIG_TYPE_STRING)&&(snapshot_entry->String_Value != NULL))
+	{
+		entry->String_Value = strdup(snapshot_entry->String_Value);
+		if(entry->String_Value == NULL)
+		{
+			pthread_mutex_unlock(&Config_Mutex);
+			DpRt_Error_Number = 110;
+			sprintf(DpRt_Error_String,"%s:%s:Failed to copy string value.\n",function_name,keyword);
+			return FALSE;
+		}
+	}
+	pthread_mutex_unlock(&Config_Mutex);
+	return TRUE;
+}
+
+/**
+ * Set a snapshot entry's value from a default value string, and mark it as present.
+ * @param entry The snapshot entry to set. The entry's Type should already be set.
+ * @param default_value The string representation of the default value. Booleans are "true" or "false".
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Config_Set_Default(struct Config_Entry_Struct *entry,char *default_value)
+{
+	switch(entry->Type)
+	{
+		case CONFIG_TYPE_STRING:
+			entry->String_Value = strdup(default_value);
+			if(entry->String_Value == NULL)
+			{
+				DpRt_Error_Number = 111;
+				sprintf(DpRt_Error_String,"Config_Set_Default:%s:Failed to copy default value %s.\n",
+					entry->Keyword,default_value);
+				return FALSE;
+			}
+			break;
+		case CONFIG_TYPE_INTEGER:
+			entry->Integer_Value = (int)strtol(default_value,NULL,0);
+			break;
+		case CONFIG_TYPE_DOUBLE:
+			entry->Double_Value = strtod(default_value,NULL);
+			break;
+		case CONFIG_TYPE_BOOLEAN:
+			entry->Integer_Value = (strcasecmp(default_value,"true") == 0);
+			break;
+		default:
+			DpRt_Error_Number = 112;
+			sprintf(DpRt_Error_String,"Config_Set_Default:%s:Illegal type %d.\n",entry->Keyword,
+				entry->Type);
+			return FALSE;
+	}
+	entry->Is_Present = TRUE;
+	return TRUE;
+}
+
+/**
+ * Free a configuration snapshot, including any allocated string values.
+ * @param snapshot The snapshot to free.
+ */
+static void Config_Snapshot_Free(struct Config_Snapshot_Struct *snapshot)
+{
+	int i;
+
+	if(snapshot == NULL)
+		return;
+	for(i=0;i<CONFIG_HASH_TABLE_SIZE;i++)
+	{
+		if(snapshot->Entry_List[i].String_Value != NULL)
+			free(snapshot->Entry_List[i].String_Value);
+	}
+	free(snapshot);
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,469 @@
+/* dprt_context.c
+** Reentrant reduction contexts.
+** $Header$
+*/
+/**
+ * dprt_context.c provides reduction contexts, so several reductions can run at the same time from different
+ * threads without clobbering each other's state. Each context has it's own error number and string, abort flag,
+ * random number generator state and scratch buffers.
+ * The library routines report errors in the per-thread DpRt_Error_Number and DpRt_Error_String variables.
+ * A reduction routine called with a context enters the context with DpRt_Context_Enter, which makes it the calling
+ * thread's current context and clears the thread's error state, and leaves it with DpRt_Context_Leave, which copies
+ * the thread's error state into the context.
+ * The original (context-less) routines in dprt.h use a default context, whose abort flag is the JNI layer's abort
+ * flag, and copy the default context's error into DpRt_JNI_Error_Number/DpRt_JNI_Error_String, where the JNI layer
+ * expects to find it.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The alignment, in bytes, of scratch buffers.
+ */
+#define CONTEXT_SCRATCH_ALIGNMENT	(64)
+/**
+ * The initial random number generator seed of a new context. This is the seed rand() uses if srand is
+ * not called.
+ */
+#define CONTEXT_DEFAULT_RANDOM_SEED	(1)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the state of a reduction context.
+ * <dl>
+ * <dt>Mutex</dt> <dd>A recursive mutex, held whilst a thread has entered the context.</dd>
+ * <dt>Is_Default</dt> <dd>A boolean, TRUE for the default context used by the original API.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the last reduction in this context.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the last reduction in this context.</dd>
+ * <dt>Abort</dt> <dd>A boolean, set to TRUE to abort the reduction currently running in this context.
+ *     Not used for the default context, which uses the JNI abort flag.</dd>
+ * <dt>Random_Seed</dt> <dd>The random number generator state, used with rand_r.</dd>
+ * <dt>Scratch_List</dt> <dd>A list of scratch buffers, reused between reductions.</dd>
+ * <dt>Scratch_Size_List</dt> <dd>The size of each scratch buffer, in bytes.</dd>
+ * </dl>
+ * @see #DPRT_CONTEXT_ERROR_STRING_LENGTH
+ * @see #DPRT_CONTEXT_SCRATCH_COUNT
+ */
+struct DpRt_Context_Struct
+{
+	pthread_mutex_t Mutex;
+	int Is_Default;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	volatile int Abort;
+	unsigned int Random_Seed;
+	void *Scratch_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	size_t Scratch_Size_List[DPRT_CONTEXT_SCRATCH_COUNT];
+};
+
+/* ------------------------------------------------------- */
+/* external variables */
+/* ------------------------------------------------------- */
+/**
+ * The error number of the last error reported by a library routine in this thread.
+ */
+__thread int DpRt_Error_Number = 0;
+/**
+ * The error string of the last error reported by a library routine in this thread.
+ * @see #DPRT_CONTEXT_ERROR_STRING_LENGTH
+ */
+__thread char DpRt_Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH] = "";
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The default context, used by the original (context-less) API.
+ * @see #Context_Default_Once
+ */
+static struct DpRt_Context_Struct Context_Default;
+/**
+ * Used to initialise the default context once.
+ * @see #Context_Default_Initialise
+ */
+static pthread_once_t Context_Default_Once = PTHREAD_ONCE_INIT;
+/**
+ * The context the calling thread has entered, or NULL if it has not entered a context.
+ */
+static __thread struct DpRt_Context_Struct *Context_Current = NULL;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Context_Initialise(struct DpRt_Context_Struct *context,int is_default);
+static void Context_Default_Initialise(void);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Create a new reduction context.
+ * @param context The address of a context handle, set to the new context.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Context_Initialise
+ * @see #DpRt_Error_Number
+ * @see #DpRt_Error_String
+ */
+int DpRt_Context_Create(DpRt_Context **context)
+{
+	if(context == NULL)
+	{
+		DpRt_Error_Number = 700;
+		sprintf(DpRt_Error_String,"DpRt_Context_Create:context was NULL.\n");
+		return FALSE;
+	}
+	(*context) = (struct DpRt_Context_Struct *)malloc(sizeof(struct DpRt_Context_Struct));
+	if((*context) == NULL)
+	{
+		DpRt_Error_Number = 701;
+		sprintf(DpRt_Error_String,"DpRt_Context_Create:Failed to allocate context.\n");
+		return FALSE;
+	}
+	if(!Context_Initialise((*context),FALSE))
+	{
+		free((*context));
+		(*context) = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Destroy a reduction context created with DpRt_Context_Create, freeing it's scratch buffers.
+ * No thread must be using the context.
+ * @param context The context to destroy. The default context cannot be destroyed.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Error_Number
+ * @see #DpRt_Error_String
+ */
+int DpRt_Context_Destroy(DpRt_Context *context)
+{
+	int i;
+
+	if(context == NULL)
+		return TRUE;
+	if(context->Is_Default)
+	{
+		DpRt_Error_Number = 702;
+		sprintf(DpRt_Error_String,"DpRt_Context_Destroy:Cannot destroy the default context.\n");
+		return FALSE;
+	}
+	for(i=0;i<DPRT_CONTEXT_SCRATCH_COUNT;i++)
+	{
+		if(context->Scratch_List[i] != NULL)
+			free(context->Scratch_List[i]);
+	}
+	pthread_mutex_destroy(&(context->Mutex));
+	free(context);
+	return TRUE;
+}
+
+/**
+ * Return the default context, used by the original (context-less) API.
+ * @return The default context.
+ * @see #Context_Default
+ * @see #Context_Default_Initialise
+ */
+DpRt_Context *DpRt_Context_Get_Default(void)
+{
+	pthread_once(&Context_Default_Once,Context_Default_Initialise);
+	return &Context_Default;
+}
+
+/**
+ * Return the context the calling thread has entered, or the default context if it has not entered one.
+ * @return The current context.
+ * @see #Context_Current
+ */
+DpRt_Context *DpRt_Context_Get_Current(void)
+{
+	if(Context_Current == NULL)
+		return DpRt_Context_Get_Default();
+	return Context_Current;
+}
+
+/**
+ * Enter a context: lock it, make it the calling thread's current context and clear the thread's error state.
+ * Each call must be matched by a call to DpRt_Context_Leave in the same thread.
+ * @param context The context to enter, or NULL to enter the default context.
+ * @return The thread's previous current context (which may be NULL), to pass to DpRt_Context_Leave.
+ * @see #Context_Current
+ * @see #DpRt_Context_Leave
+ */
+DpRt_Context *DpRt_Context_Enter(DpRt_Context *context)
+{
+	struct DpRt_Context_Struct *previous_context = NULL;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	pthread_mutex_lock(&(context->Mutex));
+	previous_context = Context_Current;
+	Context_Current = context;
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+	return previous_context;
+}
+
+/**
+ * Leave a context entered with DpRt_Context_Enter: copy the thread's error state into the context,
+ * restore the thread's previous current context, and unlock the context.
+ * @param context The context to leave, or NULL to leave the default context.
+ * @param previous_context The value returned from the matching DpRt_Context_Enter.
+ * @see #Context_Current
+ * @see #DpRt_Context_Enter
+ */
+void DpRt_Context_Leave(DpRt_Context *context,DpRt_Context *previous_context)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	context->Error_Number = DpRt_Error_Number;
+	strcpy(context->Error_String,DpRt_Error_String);
+	Context_Current = previous_context;
+	pthread_mutex_unlock(&(context->Mutex));
+}
+
+/**
+ * Set (or clear) a context's abort flag. This can be called from any thread, whilst another thread is running
+ * a reduction in the context. The default context's abort flag is the JNI layer's abort flag.
+ * @param context The context, or NULL for the default context.
+ * @param value A boolean, TRUE to abort the current reduction.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Abort
+ */
+void DpRt_Context_Set_Abort(DpRt_Context *context,int value)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	if(context->Is_Default)
+		DpRt_JNI_Set_Abort(value);
+	else
+		context->Abort = value;
+}
+
+/**
+ * Get a context's abort flag.
+ * @param context The context, or NULL for the default context.
+ * @return A boolean, TRUE if the reduction running in the context should abort.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Abort
+ */
+int DpRt_Context_Get_Abort(DpRt_Context *context)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	if(context->Is_Default)
+		return DpRt_JNI_Get_Abort();
+	return context->Abort;
+}
+
+/**
+ * Get the error number of the last reduction run in a context.
+ * @param context The context, or NULL for the default context.
+ * @return The error number, 0 if the last reduction succeeded.
+ */
+int DpRt_Context_Get_Error_Number(DpRt_Context *context)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	return context->Error_Number;
+}
+
+/**
+ * Get the error string of the last reduction run in a context.
+ * @param context The context, or NULL for the default context.
+ * @param error_string A string of at least DPRT_CONTEXT_ERROR_STRING_LENGTH characters to copy the
+ *        error string into.
+ */
+void DpRt_Context_Get_Error_String(DpRt_Context *context,char *error_string)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	strcpy(error_string,context->Error_String);
+}
+
+/**
+ * Seed a context's random number generator.
+ * @param context The context, or NULL for the default context.
+ * @param seed The seed.
+ */
+void DpRt_Context_Set_Random_Seed(DpRt_Context *context,unsigned int seed)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	context->Random_Seed = seed;
+}
+
+/**
+ * Return the next random number from a context's random number generator. This should only be called from the
+ * thread that has entered the context.
+ * @param context The context, or NULL for the default context.
+ * @return A random number between 0 and RAND_MAX.
+ */
+int DpRt_Context_Random(DpRt_Context *context)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	return rand_r(&(context->Random_Seed));
+}
+
+/**
+ * Get one of a context's scratch buffers, of at least the specified size. The buffer is kept between reductions,
+ * and only re-allocated if a bigger one is needed, in which case it's previous contents are lost.
+ * This should only be called from the thread that has entered the context.
+ * @param context The context, or NULL for the default context.
+ * @param index Which scratch buffer to get, from 0 to DPRT_CONTEXT_SCRATCH_COUNT-1.
+ * @param size The minimum size of the buffer, in bytes.
+ * @param buffer The address of a pointer, set to the buffer.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_CONTEXT_SCRATCH_COUNT
+ * @see #CONTEXT_SCRATCH_ALIGNMENT
+ * @see #DpRt_Error_Number
+ * @see #DpRt_Error_String
+ */
+int DpRt_Context_Get_Scratch(DpRt_Context *context,int index,size_t size,void **buffer)
+{
+	void *new_buffer = NULL;
+
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	if(buffer == NULL)
+	{
+		DpRt_Error_Number = 703;
+		sprintf(DpRt_Error_String,"DpRt_Context_Get_Scratch:buffer was NULL.\n");
+		return FALSE;
+	}
+	if((index < 0)||(index >= DPRT_CONTEXT_SCRATCH_COUNT))
+	{
+		DpRt_Error_Number = 704;
+		sprintf(DpRt_Error_String,"DpRt_Context_Get_Scratch:Illegal index %d.\n",index);
+		return FALSE;
+	}
+	if(size > context->Scratch_Size_List[index])
+	{
+		if(posix_memalign(&new_buffer,CONTEXT_SCRATCH_ALIGNMENT,size) != 0)
+		{
+			DpRt_Error_Number = 705;
+			sprintf(DpRt_Error_String,"DpRt_Context_Get_Scratch:Failed to allocate %lu bytes.\n",
+				(unsigned long)size);
+			return FALSE;
+		}
+		if(context->Scratch_List[index] != NULL)
+			free(context->Scratch_List[index]);
+		context->Scratch_List[index] = new_buffer;
+		context->Scratch_Size_List[index] = size;
+	}
+	(*buffer) = context->Scratch_List[index];
+	return TRUE;
+}
+
+/**
+ * Copy the JNI layer's error number and string into the calling thread's error state. This should be called
+ * when a DpRt_JNI_* routine (which reports errors in DpRt_JNI_Error_Number/DpRt_JNI_Error_String) fails.
+ * @see #DpRt_Error_Number
+ * @see #DpRt_Error_String
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ */
+void DpRt_Context_Error_From_JNI(void)
+{
+	DpRt_Error_Number = DpRt_JNI_Error_Number;
+	strncpy(DpRt_Error_String,DpRt_JNI_Error_String,DPRT_CONTEXT_ERROR_STRING_LENGTH-1);
+	DpRt_Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH-1] = '\0';
+}
+
+/**
+ * Copy a context's error number and string into the JNI layer's error number and string, so they are reported
+ * by DpRt_JNI_Get_Error_Number/DpRt_JNI_Get_Error_String.
+ * @param context The context, or NULL for the default context.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ */
+void DpRt_Context_Error_To_JNI(DpRt_Context *context)
+{
+	if(context == NULL)
+		context = DpRt_Context_Get_Default();
+	DpRt_JNI_Error_Number = context->Error_Number;
+	strcpy(DpRt_JNI_Error_String,context->Error_String);
+}
+
+/**
+ * Copy the calling thread's error number and string into the JNI layer's error number and string, so they are
+ * reported by DpRt_JNI_Get_Error_Number/DpRt_JNI_Get_Error_String. This should be used, rather than
+ * DpRt_Context_Error_To_JNI, after a routine that reports errors without entering a context (the job and focus run
+ * routines), as no context's error will have been updated.
+ * @see #DpRt_Error_Number
+ * @see #DpRt_Error_String
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ */
+void DpRt_Context_Thread_Error_To_JNI(void)
+{
+	DpRt_JNI_Error_Number = DpRt_Error_Number;
+	strcpy(DpRt_JNI_Error_String,DpRt_Error_String);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Initialise a context structure.
+ * @param context The context to initialise.
+ * @param is_default A boolean, TRUE if this is the default context.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #CONTEXT_DEFAULT_RANDOM_SEED
+ */
+static int Context_Initialise(struct DpRt_Context_Struct *context,int is_default)
+{
+	pthread_mutexattr_t mutex_attr;
+	int i;
+
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_settype(&mutex_attr,PTHREAD_MUTEX_RECURSIVE);
+	if(pthread_mutex_init(&(context->Mutex),&mutex_attr) != 0)
+	{
+		pthread_mutexattr_destroy(&mutex_attr);
+		DpRt_Error_Number = 706;
+		sprintf(DpRt_Error_String,"Context_Initialise:Failed to initialise mutex.\n");
+		return FALSE;
+	}
+	pthread_mutexattr_destroy(&mutex_attr);
+	context->Is_Default = is_default;
+	context->Error_Number = 0;
+	context->Error_String[0] = '\0';
+	context->Abort = FALSE;
+	context->Random_Seed = CONTEXT_DEFAULT_RANDOM_SEED;
+	for(i=0;i<DPRT_CONTEXT_SCRATCH_COUNT;i++)
+	{
+		context->Scratch_List[i] = NULL;
+		context->Scratch_Size_List[i] = 0;
+	}
+	return TRUE;
+}
+
+/**
+ * Initialise the default context, called once via pthread_once.
+ * @see #Context_Default
+ * @see #Context_Initialise
+ */
+static void Context_Default_Initialise(void)
+{
+	Context_Initialise(&Context_Default,TRUE);
+}
+
+/*
+** $Log$
+*/
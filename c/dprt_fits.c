@@ -0,0 +1,349 @@
+/* dprt_fits.c
+** Read the data of 16-bit FITS images, memory mapping the file where possible.
+** $Header$
+*/
+/**
+ * dprt_fits.c gets hold of the pixel data of a 16-bit FITS image for the reduction routines.
+ * For a plain uncompressed primary HDU on disk, with BZERO 32768 and BSCALE 1, the file is memory mapped and the data
+ * unit is handed to the statistics kernels as it is stored on disk (DPRT_STATS_ENCODING_FITS); the kernels
+ * byte-swap and apply BZERO as the data is loaded. This avoids copying the frame out of the CFITSIO buffers.
+ * Anything else (extensions, compressed or filtered files, other scalings) is read with fits_read_img into a
+ * frame buffer leased from the buffer pool, as before.
+ * DpRt_Fits_Image_From_Buffer describes pixel data already in memory (for instance a Java direct ByteBuffer)
+ * in the same way, so it can be reduced without a FITS file.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_stats.h"
+#include "dprt_buffer_pool.h"
+#include "dprt_fits.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The BZERO value the FITS encoded statistics kernels apply.
+ */
+#define FITS_MAP_BZERO			(32768.0)
+/**
+ * The CFITSIO URL type of a plain disk file.
+ */
+#define FITS_MAP_URL_TYPE		("file://")
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Fits_Image_Map(fitsfile *fp,char *filename,int naxis_one,int naxis_two,
+			  struct DpRt_Fits_Image_Struct *image);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get hold of the pixel data of an open 16-bit, 2 axis FITS image. If use_mmap is TRUE, and the image is a plain
+ * uncompressed primary HDU, the file is memory mapped. Otherwise the data is read via CFITSIO into a frame buffer
+ * leased from the buffer pool. The caller should check image->Encoding to see how the data is stored, and must
+ * call DpRt_Fits_Image_Free when it has finished with the data. The FITS file can be closed before the data is used.
+ * The OBSTYPE, OBJECT, BIASSEC, TRIMSEC and EXPTIME keywords, if present, are copied into image->Obstype,
+ * image->Object, image->Biassec, image->Trimsec and image->Exposure_Length.
+ * @param fp The open FITS file, positioned at the HDU to read.
+ * @param filename The name the FITS file was opened with.
+ * @param naxis_one The number of columns in the image (NAXIS1).
+ * @param naxis_two The number of rows in the image (NAXIS2).
+ * @param use_mmap A boolean, if TRUE try to memory map the image data.
+ * @param image The address of a structure to fill in with the image data.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Fits_Image_Map
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Lease
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_Read(fitsfile *fp,char *filename,int naxis_one,int naxis_two,int use_mmap,
+			 struct DpRt_Fits_Image_Struct *image)
+{
+	int retval,status = 0;
+
+	if((fp == NULL)||(filename == NULL)||(image == NULL))
+	{
+		DpRt_Error_Number = 600;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Read:fp, filename or image was NULL.\n");
+		return FALSE;
+	}
+	if((naxis_one < 0)||(naxis_two < 0))
+	{
+		DpRt_Error_Number = 601;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Read(%.150s):Illegal dimensions (%d,%d).\n",filename,
+			naxis_one,naxis_two);
+		return FALSE;
+	}
+	image->Data = NULL;
+	image->Encoding = DPRT_STATS_ENCODING_NATIVE;
+	image->Naxis_One = naxis_one;
+	image->Naxis_Two = naxis_two;
+	image->Buffer = NULL;
+	image->Map_Address = NULL;
+	image->Map_Length = 0;
+/* the OBSTYPE is optional, it is used to recognise calibration frames */
+	image->Obstype[0] = '\0';
+	if(fits_read_key(fp,TSTRING,"OBSTYPE",image->Obstype,NULL,&status))
+	{
+		image->Obstype[0] = '\0';
+		fits_clear_errmsg();
+		status = 0;
+	}
+/* the OBJECT is optional, it is used to recognise frames of the same target */
+	if(fits_read_key(fp,TSTRING,"OBJECT",image->Object,NULL,&status))
+	{
+		image->Object[0] = '\0';
+		fits_clear_errmsg();
+		status = 0;
+	}
+/* the BIASSEC and TRIMSEC are optional, they describe the overscan and data regions */
+	if(fits_read_key(fp,TSTRING,"BIASSEC",image->Biassec,NULL,&status))
+	{
+		image->Biassec[0] = '\0';
+		fits_clear_errmsg();
+		status = 0;
+	}
+	if(fits_read_key(fp,TSTRING,"TRIMSEC",image->Trimsec,NULL,&status))
+	{
+		image->Trimsec[0] = '\0';
+		fits_clear_errmsg();
+		status = 0;
+	}
+/* the EXPTIME is optional, it is used to normalise the sky brightness */
+	if(fits_read_key(fp,TDOUBLE,"EXPTIME",&(image->Exposure_Length),NULL,&status))
+	{
+		image->Exposure_Length = 0.0;
+		fits_clear_errmsg();
+		status = 0;
+	}
+	if(use_mmap && Fits_Image_Map(fp,filename,naxis_one,naxis_two,image))
+		return TRUE;
+/* lease a frame buffer from the pool */
+	if(!DpRt_Buffer_Pool_Lease(((size_t)naxis_one)*((size_t)naxis_two)*sizeof(unsigned short),&(image->Buffer)))
+	{
+		fprintf(stderr,"%s",DpRt_Error_String);
+		DpRt_Error_Number = 602;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Read(%.150s):Failed to lease frame buffer (%d,%d).\n",
+			filename,naxis_one,naxis_two);
+		return FALSE;
+	}
+/* read the data */
+	retval = fits_read_img(fp,TUSHORT,1,((LONGLONG)naxis_one)*((LONGLONG)naxis_two),NULL,image->Buffer,NULL,
+			       &status);
+	if(retval)
+	{
+		fits_report_error(stderr,status);
+		DpRt_Buffer_Pool_Return(image->Buffer);
+		image->Buffer = NULL;
+		DpRt_Error_Number = 603;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Read(%.150s):Failed to read image(%d,%d).\n",
+			filename,naxis_one,naxis_two);
+		return FALSE;
+	}
+	image->Data = image->Buffer;
+	return TRUE;
+}
+
+/**
+ * Release the data of an image got with DpRt_Fits_Image_Read, by unmapping the file or returning the frame buffer
+ * to the pool.
+ * @param image The address of the image structure.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Return
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_Free(struct DpRt_Fits_Image_Struct *image)
+{
+	int retval = TRUE;
+
+	if(image == NULL)
+		return TRUE;
+	if(image->Map_Address != NULL)
+	{
+		if(munmap(image->Map_Address,image->Map_Length) != 0)
+		{
+			DpRt_Error_Number = 604;
+			sprintf(DpRt_Error_String,"DpRt_Fits_Image_Free:munmap failed.\n");
+			retval = FALSE;
+		}
+		image->Map_Address = NULL;
+		image->Map_Length = 0;
+	}
+	if(image->Buffer != NULL)
+	{
+		if(!DpRt_Buffer_Pool_Return(image->Buffer))
+			retval = FALSE;
+		image->Buffer = NULL;
+	}
+	image->Data = NULL;
+	return retval;
+}
+
+/**
+ * Describe 16-bit pixel data already in memory (owned by the caller) as an image, so it can be reduced without
+ * writing and re-reading a FITS file. The data is not copied. A BZERO of 32768 means the data is a FITS data unit
+ * (big-endian signed 16-bit integers, DPRT_STATS_ENCODING_FITS), as the camera would write it to disk. A BZERO of 0
+ * means the data is unsigned 16-bit integers in host byte order (DPRT_STATS_ENCODING_NATIVE). Other BZERO values are
+ * not supported. DpRt_Fits_Image_Free can be called on the image, but does not free the caller's data.
+ * @param data The pixel data, of naxis_one*naxis_two pixels in row-major order.
+ * @param data_length The length of data in bytes.
+ * @param naxis_one The number of columns in the image (NAXIS1).
+ * @param naxis_two The number of rows in the image (NAXIS2).
+ * @param bzero The BZERO of the data, either 32768 or 0.
+ * @param image The address of a structure to fill in with the image data.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #FITS_MAP_BZERO
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_From_Buffer(void *data,size_t data_length,int naxis_one,int naxis_two,double bzero,
+				struct DpRt_Fits_Image_Struct *image)
+{
+	if((data == NULL)||(image == NULL))
+	{
+		DpRt_Error_Number = 605;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_From_Buffer:data or image was NULL.\n");
+		return FALSE;
+	}
+	if((naxis_one < 0)||(naxis_two < 0)||
+	   ((((size_t)naxis_one)*((size_t)naxis_two)*sizeof(unsigned short)) > data_length))
+	{
+		DpRt_Error_Number = 606;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_From_Buffer:Illegal dimensions (%d,%d) for %lu bytes.\n",
+			naxis_one,naxis_two,(unsigned long)data_length);
+		return FALSE;
+	}
+	if(bzero == FITS_MAP_BZERO)
+		image->Encoding = DPRT_STATS_ENCODING_FITS;
+	else if(bzero == 0.0)
+		image->Encoding = DPRT_STATS_ENCODING_NATIVE;
+	else
+	{
+		DpRt_Error_Number = 607;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_From_Buffer:Unsupported BZERO %.2f.\n",bzero);
+		return FALSE;
+	}
+	image->Data = data;
+	image->Naxis_One = naxis_one;
+	image->Naxis_Two = naxis_two;
+	image->Obstype[0] = '\0';
+	image->Object[0] = '\0';
+	image->Biassec[0] = '\0';
+	image->Trimsec[0] = '\0';
+	image->Exposure_Length = 0.0;
+	image->Buffer = NULL;
+	image->Map_Address = NULL;
+	image->Map_Length = 0;
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Try to memory map the data unit of an open FITS image. The image must be the primary HDU of a plain (not compressed,
+ * not filtered) disk file, with BZERO 32768 and BSCALE 1, so it can be decoded by the FITS encoded statistics kernels.
+ * The data unit offset is taken from the header CFITSIO has already parsed. The mapping is advised for sequential
+ * access, and read ahead is started. If the image cannot be mapped, FALSE is returned without setting an error, and
+ * the caller should read it via CFITSIO instead.
+ * @param fp The open FITS file.
+ * @param filename The name the FITS file was opened with.
+ * @param naxis_one The number of columns in the image (NAXIS1).
+ * @param naxis_two The number of rows in the image (NAXIS2).
+ * @param image The address of a structure to fill in with the mapping.
+ * @return The routine returns TRUE if the image was mapped, and FALSE if it was not.
+ * @see #FITS_MAP_BZERO
+ * @see #FITS_MAP_URL_TYPE
+ */
+static int Fits_Image_Map(fitsfile *fp,char *filename,int naxis_one,int naxis_two,
+			  struct DpRt_Fits_Image_Struct *image)
+{
+	struct stat file_stat;
+	char url_type[FLEN_FILENAME];
+	char *pathname = NULL;
+	LONGLONG header_start,data_start,data_end,data_length;
+	double bzero,bscale;
+	void *address = NULL;
+	size_t map_length;
+	int status = 0,hdu_number,fd;
+
+/* only the primary HDU of a plain disk file is mapped */
+	if(strchr(filename,'[') != NULL)
+		return FALSE;
+	fits_get_hdu_num(fp,&hdu_number);
+	if(hdu_number != 1)
+		return FALSE;
+	if(fits_url_type(fp,url_type,&status))
+		return FALSE;
+	if(strcmp(url_type,FITS_MAP_URL_TYPE) != 0)
+		return FALSE;
+	if(fits_is_compressed_image(fp,&status)||status)
+		return FALSE;
+/* check scaling */
+	if(fits_read_key(fp,TDOUBLE,"BZERO",&bzero,NULL,&status))
+		return FALSE;
+	if(fits_read_key(fp,TDOUBLE,"BSCALE",&bscale,NULL,&status))
+	{
+		if(status != KEY_NO_EXIST)
+			return FALSE;
+		status = 0;
+		bscale = 1.0;
+	}
+	if((bzero != FITS_MAP_BZERO)||(bscale != 1.0))
+		return FALSE;
+/* find the data unit */
+	if(fits_get_hduaddrll(fp,&header_start,&data_start,&data_end,&status))
+		return FALSE;
+	data_length = ((LONGLONG)naxis_one)*((LONGLONG)naxis_two)*((LONGLONG)sizeof(unsigned short));
+	if((data_length == 0)||((data_end-data_start) < data_length))
+		return FALSE;
+/* map the file */
+	pathname = filename;
+	if(strncmp(pathname,FITS_MAP_URL_TYPE,strlen(FITS_MAP_URL_TYPE)) == 0)
+		pathname += strlen(FITS_MAP_URL_TYPE);
+	fd = open(pathname,O_RDONLY);
+	if(fd < 0)
+		return FALSE;
+	if((fstat(fd,&file_stat) != 0)||(((LONGLONG)file_stat.st_size) < (data_start+data_length)))
+	{
+		close(fd);
+		return FALSE;
+	}
+	map_length = (size_t)(data_start+data_length);
+	address = mmap(NULL,map_length,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(address == MAP_FAILED)
+		return FALSE;
+	madvise(address,map_length,MADV_SEQUENTIAL);
+	madvise(address,map_length,MADV_WILLNEED);
+	image->Map_Address = address;
+	image->Map_Length = map_length;
+	image->Data = ((char *)address)+data_start;
+	image->Encoding = DPRT_STATS_ENCODING_FITS;
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
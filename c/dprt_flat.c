@@ -0,0 +1,288 @@
+/* dprt_flat.c
+** Spectral normalisation of master flat frames.
+** $Header$
+*/
+/**
+ * dprt_flat.c removes the lamp spectrum from a Sprat master flat, leaving the pixel to pixel response. The smooth
+ * level of each row along the dispersion axis is measured, and the row divided by it. The level is the median of
+ * each block of Window columns of the row, joined by straight lines between the block centres: each pixel is
+ * copied into one block and each block median found by quickselect, so a row costs O(n) whatever the window, and
+ * the medians ignore arc-like features, hot pixels and cosmic rays. Rows are independent, so the master flat is
+ * normalised a band of rows at a time across the thread pool, or inside the master combine's own band tasks as each
+ * band of the master is made (see dprt_master.c). The normalised master is written to disk as usual, and held in
+ * memory by the calibration cache.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_thread_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_combine.h"
+#include "dprt_overscan.h"
+#include "dprt_flat.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the state of one DpRt_Flat_Normalise call, shared by it's band tasks.
+ * <dl>
+ * <dt>Parameters</dt> <dd>The normalisation parameters.</dd>
+ * <dt>Flat</dt> <dd>The master flat being normalised.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the master flat.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the master flat.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in a band.</dd>
+ * </dl>
+ */
+struct Flat_Normalise_Struct
+{
+	struct DpRt_Flat_Parameter_Struct *Parameters;
+	float *Flat;
+	int Naxis_One;
+	int Naxis_Two;
+	int Band_Rows;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Flat_Normalise_Band(void *user_data,int band_index,int thread_index);
+static void Flat_Normalise_Row(struct DpRt_Flat_Parameter_Struct *parameters,float *row);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the spectral flat normalisation parameters from the configuration ("dprt.master.flat.normalise",
+ * "dprt.master.flat.normalise.window" and "dprt.master.flat.normalise.min_level"), and the data section of master
+ * flats of a size (the "dprt.overscan.trimsec" section if "dprt.overscan" is set, otherwise the whole frame).
+ * @param naxis_one The number of columns in the master flat.
+ * @param naxis_two The number of rows in the master flat.
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_FLAT_MAX_WINDOW
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_overscan.html#DpRt_Overscan_Get
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Flat_Get_Parameters(int naxis_one,int naxis_two,struct DpRt_Flat_Parameter_Struct *parameters)
+{
+	struct DpRt_Overscan_Struct overscan;
+
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 2100;
+		sprintf(DpRt_Error_String,"DpRt_Flat_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Boolean("dprt.master.flat.normalise",&(parameters->Enabled)))||
+	   (!DpRt_Config_Get_Integer("dprt.master.flat.normalise.window",&(parameters->Window)))||
+	   (!DpRt_Config_Get_Double("dprt.master.flat.normalise.min_level",&(parameters->Min_Level))))
+		return FALSE;
+	if((parameters->Window < 1)||(parameters->Window > DPRT_FLAT_MAX_WINDOW))
+	{
+		DpRt_Error_Number = 2101;
+		sprintf(DpRt_Error_String,"DpRt_Flat_Get_Parameters:Illegal window %d (1..%d).\n",parameters->Window,
+			DPRT_FLAT_MAX_WINDOW);
+		return FALSE;
+	}
+	if(!DpRt_Overscan_Get("","",naxis_one,naxis_two,&overscan))
+		return FALSE;
+	parameters->Start_X = overscan.Trim_Start_X;
+	parameters->End_X = overscan.Trim_End_X;
+	parameters->Start_Y = overscan.Trim_Start_Y;
+	parameters->End_Y = overscan.Trim_End_Y;
+	return TRUE;
+}
+
+/**
+ * Normalise some rows of a master flat, in place. Each row of the data section is divided by it's smooth level
+ * (see Flat_Normalise_Row). Pixels outside the data section are set to one. This routine is thread safe, so
+ * bands of rows can be normalised in parallel.
+ * @param parameters The normalisation parameters (see DpRt_Flat_Get_Parameters).
+ * @param flat The first pixel of the first row to normalise.
+ * @param naxis_one The number of columns in the master flat.
+ * @param start_y The row of the master flat the first row is.
+ * @param row_count The number of rows to normalise.
+ * @see #Flat_Normalise_Row
+ */
+void DpRt_Flat_Normalise_Rows(struct DpRt_Flat_Parameter_Struct *parameters,float *flat,int naxis_one,
+			      int start_y,int row_count)
+{
+	float *row = NULL;
+	int x,y;
+
+	for(y=start_y;y<start_y+row_count;y++)
+	{
+		row = flat+(((size_t)(y-start_y))*((size_t)naxis_one));
+		if((y < parameters->Start_Y)||(y >= parameters->End_Y))
+		{
+			for(x=0;x<naxis_one;x++)
+				row[x] = 1.0f;
+			continue;
+		}
+		for(x=0;x<parameters->Start_X;x++)
+			row[x] = 1.0f;
+		for(x=parameters->End_X;x<naxis_one;x++)
+			row[x] = 1.0f;
+		Flat_Normalise_Row(parameters,row);
+	}
+}
+
+/**
+ * Normalise a whole master flat, in place, a band of rows at a time across the thread pool.
+ * @param parameters The normalisation parameters (see DpRt_Flat_Get_Parameters).
+ * @param flat The master flat.
+ * @param naxis_one The number of columns in the master flat.
+ * @param naxis_two The number of rows in the master flat.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Flat_Normalise_Struct
+ * @see #Flat_Normalise_Band
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Flat_Normalise(struct DpRt_Flat_Parameter_Struct *parameters,float *flat,int naxis_one,int naxis_two)
+{
+	struct Flat_Normalise_Struct normalise;
+	int band_count;
+
+	if((parameters == NULL)||(flat == NULL)||(naxis_one < 1)||(naxis_two < 1))
+	{
+		DpRt_Error_Number = 2102;
+		sprintf(DpRt_Error_String,"DpRt_Flat_Normalise:Illegal arguments (%d,%d).\n",naxis_one,naxis_two);
+		return FALSE;
+	}
+	normalise.Parameters = parameters;
+	normalise.Flat = flat;
+	normalise.Naxis_One = naxis_one;
+	normalise.Naxis_Two = naxis_two;
+	normalise.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	if(normalise.Band_Rows < 1)
+		normalise.Band_Rows = 1;
+	band_count = (naxis_two+normalise.Band_Rows-1)/normalise.Band_Rows;
+	if(!DpRt_Thread_Pool_Run(band_count,Flat_Normalise_Band,&normalise))
+	{
+		DpRt_Error_Number = 2103;
+		sprintf(DpRt_Error_String,"DpRt_Flat_Normalise:Failed to normalise bands.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Thread pool task normalising a band of rows of a master flat.
+ * @param user_data The normalise structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread (unused).
+ * @return The routine returns TRUE.
+ * @see #DpRt_Flat_Normalise_Rows
+ */
+static int Flat_Normalise_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Flat_Normalise_Struct *normalise = (struct Flat_Normalise_Struct *)user_data;
+	int start_y,rows;
+
+	(void)thread_index;
+	start_y = band_index*normalise->Band_Rows;
+	rows = normalise->Band_Rows;
+	if(start_y+rows > normalise->Naxis_Two)
+		rows = normalise->Naxis_Two-start_y;
+	DpRt_Flat_Normalise_Rows(normalise->Parameters,
+				 normalise->Flat+(((size_t)start_y)*((size_t)normalise->Naxis_One)),
+				 normalise->Naxis_One,start_y,rows);
+	return TRUE;
+}
+
+/**
+ * Normalise the data section of a row of a master flat by it's smooth level. The data section is divided into
+ * blocks of Window columns (wider, if that would make more than DPRT_FLAT_MAX_BLOCK_COUNT blocks), and the median
+ * of each block found. The smooth level is the straight line between the medians at the centres of neighbouring
+ * blocks, the first and last lines being extended to the ends of the row. Each pixel is divided by it's smooth
+ * level, or set to one if the level is below Min_Level.
+ * @param parameters The normalisation parameters.
+ * @param row The row.
+ * @see #DPRT_FLAT_MAX_WINDOW
+ * @see #DPRT_FLAT_MAX_BLOCK_COUNT
+ * @see dprt_combine.html#DpRt_Combine_Median
+ */
+static void Flat_Normalise_Row(struct DpRt_Flat_Parameter_Struct *parameters,float *row)
+{
+	float window_list[DPRT_FLAT_MAX_WINDOW];
+	float median_list[DPRT_FLAT_MAX_BLOCK_COUNT];
+	double centre_list[DPRT_FLAT_MAX_BLOCK_COUNT];
+	double level,slope,min_level;
+	int width,window,block_count,block,block_start_x,block_end_x,count,x;
+
+	width = parameters->End_X-parameters->Start_X;
+	if(width < 1)
+		return;
+	window = parameters->Window;
+	if(window > width)
+		window = width;
+	if((width+window-1)/window > DPRT_FLAT_MAX_BLOCK_COUNT)
+		window = (width+DPRT_FLAT_MAX_BLOCK_COUNT-1)/DPRT_FLAT_MAX_BLOCK_COUNT;
+	if(window > DPRT_FLAT_MAX_WINDOW)
+		window = DPRT_FLAT_MAX_WINDOW;
+	block_count = (width+window-1)/window;
+	if(block_count > DPRT_FLAT_MAX_BLOCK_COUNT)
+		block_count = DPRT_FLAT_MAX_BLOCK_COUNT;
+	/* the median of each block */
+	for(block=0;block<block_count;block++)
+	{
+		block_start_x = parameters->Start_X+(block*window);
+		block_end_x = block_start_x+window;
+		if((block_end_x > parameters->End_X)||(block == block_count-1))
+			block_end_x = parameters->End_X;
+		count = block_end_x-block_start_x;
+		if(count > DPRT_FLAT_MAX_WINDOW)
+			count = DPRT_FLAT_MAX_WINDOW;
+		memcpy(window_list,row+block_start_x,count*sizeof(float));
+		median_list[block] = DpRt_Combine_Median(window_list,count);
+		centre_list[block] = ((double)(block_start_x+block_end_x-1))/2.0;
+	}
+	/* divide by the straight lines between the block medians, extended to the ends of the row */
+	min_level = parameters->Min_Level;
+	block = 0;
+	for(x=parameters->Start_X;x<parameters->End_X;x++)
+	{
+		while((block < block_count-2)&&(((double)x) >= centre_list[block+1]))
+			block++;
+		if(block_count == 1)
+			level = median_list[0];
+		else
+		{
+			slope = (median_list[block+1]-median_list[block])/(centre_list[block+1]-centre_list[block]);
+			level = median_list[block]+((((double)x)-centre_list[block])*slope);
+		}
+		if(level >= min_level)
+			row[x] = (float)(row[x]/level);
+		else
+			row[x] = 1.0f;
+	}
+}
+
+/*
+** $Log$
+*/
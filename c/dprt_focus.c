@@ -0,0 +1,745 @@
+/* dprt_focus.c
+** Accumulation and fitting of focus runs.
+** $Header$
+*/
+/**
+ * dprt_focus.c collects the FWHM and TELFOCUS of each frame of a focus run as it is reduced, and fits the best
+ * focus parabola to them after every frame, so a focus run can be stopped as soon as the best focus is known well
+ * enough. Runs are keyed by a run id chosen by the caller. Frames are added explicitly with DpRt_Focus_Run_Add, or
+ * by the expose reductions whilst a run is current (between DpRt_Focus_Run_Start and DpRt_Focus_Run_End).
+ * The parabola FWHM = c0 + c1 x + c2 x&#178; (x being the focus about the mean focus of the frames used) is a linear
+ * least squares fit, which is cheap enough to redo from the (few) frames every time one is added. Outliers are
+ * rejected by iterated clipping on the residuals, the residual sigma estimated from their median absolute
+ * deviation. The best focus is at -c1/2c2, and it's uncertainty is propagated from the covariance of the fit,
+ * scaled by the residual variance.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_focus.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The fewest frames left in a fit after outliers are rejected. A parabola needs three, and with one more there is
+ * a residual left to estimate the scatter from.
+ */
+#define FOCUS_MIN_USED_COUNT		(4)
+/**
+ * The ratio of the standard deviation of a normal distribution to it's median absolute deviation.
+ */
+#define FOCUS_SIGMA_PER_MAD		(1.4826)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a frame of a focus run.
+ * <dl>
+ * <dt>Focus</dt> <dd>The telescope focus (TELFOCUS) the frame was taken at.</dd>
+ * <dt>FWHM</dt> <dd>The FWHM (seeing) measured in the frame.</dd>
+ * <dt>Rejected</dt> <dd>A boolean, TRUE if the frame was rejected as an outlier by the last fit.</dd>
+ * </dl>
+ */
+struct Focus_Point_Struct
+{
+	double Focus;
+	double FWHM;
+	int Rejected;
+};
+
+/**
+ * Structure holding a focus run.
+ * <dl>
+ * <dt>Run_Id</dt> <dd>The run id, or an empty string if the slot is not in use.</dd>
+ * <dt>Point_Count</dt> <dd>The number of frames in Point_List.</dd>
+ * <dt>Point_List</dt> <dd>The frames of the run, in the order they were added.</dd>
+ * <dt>Fit</dt> <dd>The fit after the last frame was added.</dd>
+ * <dt>Last_Used</dt> <dd>The value of Focus_Use_Count when the run was last used.</dd>
+ * </dl>
+ */
+struct Focus_Run_Struct
+{
+	char Run_Id[DPRT_FOCUS_RUN_ID_LENGTH];
+	int Point_Count;
+	struct Focus_Point_Struct Point_List[DPRT_FOCUS_MAX_POINT_COUNT];
+	struct DpRt_Focus_Fit_Struct Fit;
+	unsigned long Last_Used;
+};
+
+/**
+ * Structure holding the fitting parameters, from the configuration.
+ * <dl>
+ * <dt>Min_Frames</dt> <dd>The number of frames a fit must use before it can converge.</dd>
+ * <dt>Tolerance</dt> <dd>The largest best focus uncertainty of a converged fit.</dd>
+ * <dt>Kappa</dt> <dd>Frames more than this many residual sigmas from the fit are rejected.</dd>
+ * <dt>Iterations</dt> <dd>The maximum number of rejection iterations.</dd>
+ * </dl>
+ */
+struct Focus_Parameter_Struct
+{
+	int Min_Frames;
+	double Tolerance;
+	double Kappa;
+	int Iterations;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The focus runs.
+ * @see #Focus_Run_Struct
+ */
+static struct Focus_Run_Struct Focus_Run_List[DPRT_FOCUS_MAX_RUN_COUNT];
+/**
+ * The index in Focus_Run_List of the current run, the one the expose reductions add frames to, or -1 if there
+ * is no current run.
+ */
+static int Focus_Current_Run = -1;
+/**
+ * A counter incremented every time a run is used, used to find the least recently used run.
+ */
+static unsigned long Focus_Use_Count = 0;
+/**
+ * Mutex protecting the focus runs.
+ */
+static pthread_mutex_t Focus_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Focus_Get_Parameters(struct Focus_Parameter_Struct *parameters);
+static int Focus_Find(char *run_id);
+static int Focus_Add(struct Focus_Run_Struct *run,double telfocus,double fwhm,
+		     struct Focus_Parameter_Struct *parameters);
+static void Focus_Fit(struct Focus_Run_Struct *run,struct Focus_Parameter_Struct *parameters);
+static double Focus_Median_Residual(struct Focus_Run_Struct *run,double mean_focus,double *coefficient_list,
+				    double *residual_list);
+static int Focus_Fit_Parabola(struct Focus_Run_Struct *run,double *mean_focus,double *coefficient_list,
+			      double *covariance_list,double *residual_variance,double *min_focus,double *max_focus);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Start a focus run, and make it the current run, that frames reduced by the expose reductions are added to.
+ * If a run with this id already exists, it's frames are thrown away. If the list of runs is full, the least
+ * recently used run is thrown away.
+ * @param run_id The run id, a non-empty string shorter than DPRT_FOCUS_RUN_ID_LENGTH.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Focus_Mutex
+ * @see #Focus_Run_List
+ * @see #Focus_Current_Run
+ * @see #Focus_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Focus_Run_Start(char *run_id)
+{
+	struct Focus_Run_Struct *run = NULL;
+	int index,i;
+
+	if((run_id == NULL)||(strlen(run_id) == 0)||(strlen(run_id) >= DPRT_FOCUS_RUN_ID_LENGTH))
+	{
+		DpRt_Error_Number = 1700;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Start:Illegal run id.\n");
+		return FALSE;
+	}
+	pthread_mutex_lock(&Focus_Mutex);
+	index = Focus_Find(run_id);
+	if(index < 0)
+	{
+		/* an unused slot, or the least recently used run that is not current */
+		for(i=0;i<DPRT_FOCUS_MAX_RUN_COUNT;i++)
+		{
+			if(i == Focus_Current_Run)
+				continue;
+			if(strlen(Focus_Run_List[i].Run_Id) == 0)
+			{
+				index = i;
+				break;
+			}
+			if((index < 0)||(Focus_Run_List[i].Last_Used < Focus_Run_List[index].Last_Used))
+				index = i;
+		}
+		if(strlen(Focus_Run_List[index].Run_Id) > 0)
+		{
+			fprintf(stderr,"DpRt_Focus_Run_Start:Throwing away focus run %s.\n",
+				Focus_Run_List[index].Run_Id);
+		}
+	}
+	run = &(Focus_Run_List[index]);
+	strcpy(run->Run_Id,run_id);
+	run->Point_Count = 0;
+	memset(&(run->Fit),0,sizeof(struct DpRt_Focus_Fit_Struct));
+	run->Last_Used = ++Focus_Use_Count;
+	Focus_Current_Run = index;
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/**
+ * Add a frame to a focus run, and fit the best focus parabola to the run's frames.
+ * @param run_id The run id, of a run started with DpRt_Focus_Run_Start.
+ * @param telfocus The telescope focus the frame was taken at.
+ * @param fwhm The FWHM measured in the frame. Frames with no FWHM (zero or less) are not added.
+ * @param fit The address of a structure to store the fit in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Focus_Mutex
+ * @see #Focus_Get_Parameters
+ * @see #Focus_Find
+ * @see #Focus_Add
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Focus_Run_Add(char *run_id,double telfocus,double fwhm,struct DpRt_Focus_Fit_Struct *fit)
+{
+	struct Focus_Parameter_Struct parameters;
+	int index;
+
+	if((run_id == NULL)||(fit == NULL))
+	{
+		DpRt_Error_Number = 1701;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Add:Illegal arguments.\n");
+		return FALSE;
+	}
+	if(!Focus_Get_Parameters(&parameters))
+		return FALSE;
+	pthread_mutex_lock(&Focus_Mutex);
+	index = Focus_Find(run_id);
+	if(index < 0)
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		DpRt_Error_Number = 1702;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Add:Focus run %s not found.\n",run_id);
+		return FALSE;
+	}
+	if(!Focus_Add(&(Focus_Run_List[index]),telfocus,fwhm,&parameters))
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		return FALSE;
+	}
+	(*fit) = Focus_Run_List[index].Fit;
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/**
+ * Add a frame to the current focus run (if there is one), and fit the best focus parabola to the run's frames.
+ * This is called by the expose reductions.
+ * @param telfocus The telescope focus the frame was taken at.
+ * @param fwhm The FWHM measured in the frame. Frames with no FWHM (zero or less) are not added.
+ * @param run_id A string of at least DPRT_FOCUS_RUN_ID_LENGTH characters, to store the current run's id in. It is
+ *        set to an empty string if there is no current run (the frame is then not added, and fit is not set).
+ * @param fit The address of a structure to store the fit in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Focus_Mutex
+ * @see #Focus_Current_Run
+ * @see #Focus_Get_Parameters
+ * @see #Focus_Add
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Focus_Run_Add_Current(double telfocus,double fwhm,char *run_id,struct DpRt_Focus_Fit_Struct *fit)
+{
+	struct Focus_Parameter_Struct parameters;
+
+	if((run_id == NULL)||(fit == NULL))
+	{
+		DpRt_Error_Number = 1703;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Add_Current:Illegal arguments.\n");
+		return FALSE;
+	}
+	run_id[0] = '\0';
+	/* don't read the configuration unless there is a run to add to */
+	pthread_mutex_lock(&Focus_Mutex);
+	if(Focus_Current_Run < 0)
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		return TRUE;
+	}
+	pthread_mutex_unlock(&Focus_Mutex);
+	if(!Focus_Get_Parameters(&parameters))
+		return FALSE;
+	pthread_mutex_lock(&Focus_Mutex);
+	/* the run may have been ended whilst the parameters were read */
+	if(Focus_Current_Run < 0)
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		return TRUE;
+	}
+	if(!Focus_Add(&(Focus_Run_List[Focus_Current_Run]),telfocus,fwhm,&parameters))
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		return FALSE;
+	}
+	strcpy(run_id,Focus_Run_List[Focus_Current_Run].Run_Id);
+	(*fit) = Focus_Run_List[Focus_Current_Run].Fit;
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/**
+ * Get the fit of a focus run, as it was after the last frame was added.
+ * @param run_id The run id.
+ * @param fit The address of a structure to store the fit in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the run was not found).
+ * @see #Focus_Mutex
+ * @see #Focus_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Focus_Run_Get(char *run_id,struct DpRt_Focus_Fit_Struct *fit)
+{
+	int index;
+
+	if((run_id == NULL)||(fit == NULL))
+	{
+		DpRt_Error_Number = 1704;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Get:Illegal arguments.\n");
+		return FALSE;
+	}
+	pthread_mutex_lock(&Focus_Mutex);
+	index = Focus_Find(run_id);
+	if(index < 0)
+	{
+		pthread_mutex_unlock(&Focus_Mutex);
+		DpRt_Error_Number = 1705;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_Get:Focus run %s not found.\n",run_id);
+		return FALSE;
+	}
+	Focus_Run_List[index].Last_Used = ++Focus_Use_Count;
+	(*fit) = Focus_Run_List[index].Fit;
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/**
+ * End a focus run, throwing away it's frames. If it is the current run, there is no longer a current run.
+ * Ending a run that does not exist (or has already been thrown away) is not an error.
+ * @param run_id The run id.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Focus_Mutex
+ * @see #Focus_Find
+ * @see #Focus_Current_Run
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Focus_Run_End(char *run_id)
+{
+	int index;
+
+	if(run_id == NULL)
+	{
+		DpRt_Error_Number = 1706;
+		sprintf(DpRt_Error_String,"DpRt_Focus_Run_End:Illegal run id.\n");
+		return FALSE;
+	}
+	pthread_mutex_lock(&Focus_Mutex);
+	index = Focus_Find(run_id);
+	if(index >= 0)
+	{
+		Focus_Run_List[index].Run_Id[0] = '\0';
+		Focus_Run_List[index].Point_Count = 0;
+		if(index == Focus_Current_Run)
+			Focus_Current_Run = -1;
+	}
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/**
+ * Copy a fit into a list of DPRT_FOCUS_RESULT_COUNT doubles, indexed by the DPRT_FOCUS_RESULT_ hash definitions,
+ * to return it to Java. The best focus values are zero if the fit is not valid.
+ * @param fit The fit.
+ * @param result_list The list to fill in.
+ * @see #DPRT_FOCUS_RESULT_BEST_FOCUS
+ * @see #DPRT_FOCUS_RESULT_BEST_FOCUS_ERROR
+ * @see #DPRT_FOCUS_RESULT_BEST_FWHM
+ * @see #DPRT_FOCUS_RESULT_POINT_COUNT
+ * @see #DPRT_FOCUS_RESULT_USED_COUNT
+ */
+void DpRt_Focus_Fit_To_List(struct DpRt_Focus_Fit_Struct *fit,double *result_list)
+{
+	result_list[DPRT_FOCUS_RESULT_BEST_FOCUS] = fit->Valid ? fit->Best_Focus : 0.0;
+	result_list[DPRT_FOCUS_RESULT_BEST_FOCUS_ERROR] = fit->Valid ? fit->Best_Focus_Error : 0.0;
+	result_list[DPRT_FOCUS_RESULT_BEST_FWHM] = fit->Valid ? fit->Best_FWHM : 0.0;
+	result_list[DPRT_FOCUS_RESULT_POINT_COUNT] = (double)fit->Point_Count;
+	result_list[DPRT_FOCUS_RESULT_USED_COUNT] = (double)fit->Used_Count;
+}
+
+/**
+ * Throw away all the focus runs.
+ * @return The routine returns TRUE.
+ * @see #Focus_Mutex
+ * @see #Focus_Run_List
+ * @see #Focus_Current_Run
+ */
+int DpRt_Focus_Shutdown(void)
+{
+	int i;
+
+	pthread_mutex_lock(&Focus_Mutex);
+	for(i=0;i<DPRT_FOCUS_MAX_RUN_COUNT;i++)
+	{
+		Focus_Run_List[i].Run_Id[0] = '\0';
+		Focus_Run_List[i].Point_Count = 0;
+	}
+	Focus_Current_Run = -1;
+	Focus_Use_Count = 0;
+	pthread_mutex_unlock(&Focus_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the fitting parameters from the configuration ("dprt.focus.min_frames", "dprt.focus.tolerance",
+ * "dprt.focus.sigma_clip.kappa" and "dprt.focus.sigma_clip.iterations").
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Focus_Parameter_Struct
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ */
+static int Focus_Get_Parameters(struct Focus_Parameter_Struct *parameters)
+{
+	if((!DpRt_Config_Get_Integer("dprt.focus.min_frames",&(parameters->Min_Frames)))||
+	   (!DpRt_Config_Get_Double("dprt.focus.tolerance",&(parameters->Tolerance)))||
+	   (!DpRt_Config_Get_Double("dprt.focus.sigma_clip.kappa",&(parameters->Kappa)))||
+	   (!DpRt_Config_Get_Integer("dprt.focus.sigma_clip.iterations",&(parameters->Iterations))))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Find a focus run by it's id. Focus_Mutex must be held.
+ * @param run_id The run id.
+ * @return The index of the run in Focus_Run_List, or -1 if it was not found.
+ * @see #Focus_Run_List
+ */
+static int Focus_Find(char *run_id)
+{
+	int i;
+
+	if(strlen(run_id) == 0)
+		return -1;
+	for(i=0;i<DPRT_FOCUS_MAX_RUN_COUNT;i++)
+	{
+		if(strcmp(Focus_Run_List[i].Run_Id,run_id) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * Add a frame to a focus run, and refit it. Focus_Mutex must be held.
+ * @param run The run.
+ * @param telfocus The telescope focus the frame was taken at.
+ * @param fwhm The FWHM measured in the frame. Frames with no FWHM (zero or less) are not added, but the run
+ *        is still refitted.
+ * @param parameters The fitting parameters.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the run is full).
+ * @see #Focus_Fit
+ * @see #Focus_Use_Count
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Focus_Add(struct Focus_Run_Struct *run,double telfocus,double fwhm,
+		     struct Focus_Parameter_Struct *parameters)
+{
+	run->Last_Used = ++Focus_Use_Count;
+	if(fwhm > 0.0)
+	{
+		if(run->Point_Count >= DPRT_FOCUS_MAX_POINT_COUNT)
+		{
+			DpRt_Error_Number = 1707;
+			sprintf(DpRt_Error_String,"Focus_Add:Focus run %s already has %d frames.\n",run->Run_Id,
+				run->Point_Count);
+			return FALSE;
+		}
+		run->Point_List[run->Point_Count].Focus = telfocus;
+		run->Point_List[run->Point_Count].FWHM = fwhm;
+		run->Point_List[run->Point_Count].Rejected = FALSE;
+		run->Point_Count++;
+	}
+	Focus_Fit(run,parameters);
+	return TRUE;
+}
+
+/**
+ * Fit the best focus parabola to a focus run's frames, rejecting outliers, and fill in the run's Fit.
+ * A least squares fit is pulled well away from the other frames by one bad frame when there are only a few, so the
+ * rejection starts from the most robust fit: of the fit to all the frames and the fits leaving each frame out in turn,
+ * the one with the smallest median absolute residual. Each iteration then estimates the residual sigma from the
+ * median absolute residual of the frames used, rejects every frame (including ones rejected before) more than
+ * Kappa sigma from the fit, and refits. Iteration stops when the rejected frames do not change, when rejecting them
+ * would leave fewer than FOCUS_MIN_USED_COUNT frames (or too few focus values to fit), or after Iterations
+ * iterations. Focus_Mutex must be held.
+ * @param run The run.
+ * @param parameters The fitting parameters.
+ * @see #FOCUS_MIN_USED_COUNT
+ * @see #Focus_Fit_Parabola
+ * @see #Focus_Median_Residual
+ */
+static void Focus_Fit(struct Focus_Run_Struct *run,struct Focus_Parameter_Struct *parameters)
+{
+	struct DpRt_Focus_Fit_Struct *fit = &(run->Fit);
+	double coefficient_list[3],covariance_list[9];
+	double residual_list[DPRT_FOCUS_MAX_POINT_COUNT];
+	double mean_focus,residual_variance,min_focus,max_focus,sigma,best_sigma,best_x;
+	double derivative_one,derivative_two,variance;
+	int previous_rejected_list[DPRT_FOCUS_MAX_POINT_COUNT];
+	int fitted,used_count,new_used_count,changed,iteration,best_left_out,i;
+
+	memset(fit,0,sizeof(struct DpRt_Focus_Fit_Struct));
+	fit->Point_Count = run->Point_Count;
+	for(i=0;i<run->Point_Count;i++)
+		run->Point_List[i].Rejected = FALSE;
+	/* pick the most robust starting fit, -1 being the fit to all the frames */
+	best_left_out = -1;
+	if(run->Point_Count > FOCUS_MIN_USED_COUNT)
+	{
+		best_sigma = -1.0;
+		for(i=-1;i<run->Point_Count;i++)
+		{
+			if(i >= 0)
+				run->Point_List[i].Rejected = TRUE;
+			if(Focus_Fit_Parabola(run,&mean_focus,coefficient_list,covariance_list,&residual_variance,
+					      &min_focus,&max_focus))
+			{
+				sigma = Focus_Median_Residual(run,mean_focus,coefficient_list,residual_list);
+				if((best_sigma < 0.0)||(sigma < best_sigma))
+				{
+					best_sigma = sigma;
+					best_left_out = i;
+				}
+			}
+			if(i >= 0)
+				run->Point_List[i].Rejected = FALSE;
+		}
+		if(best_left_out >= 0)
+			run->Point_List[best_left_out].Rejected = TRUE;
+	}
+	fitted = Focus_Fit_Parabola(run,&mean_focus,coefficient_list,covariance_list,&residual_variance,
+				    &min_focus,&max_focus);
+	for(iteration=0;fitted && (iteration<parameters->Iterations);iteration++)
+	{
+		sigma = FOCUS_SIGMA_PER_MAD*Focus_Median_Residual(run,mean_focus,coefficient_list,residual_list);
+		if(sigma <= 0.0)
+			break;
+		new_used_count = 0;
+		changed = FALSE;
+		for(i=0;i<run->Point_Count;i++)
+		{
+			if(residual_list[i] <= (parameters->Kappa*sigma))
+				new_used_count++;
+			if((residual_list[i] > (parameters->Kappa*sigma)) != run->Point_List[i].Rejected)
+				changed = TRUE;
+		}
+		if((changed == FALSE)||(new_used_count < FOCUS_MIN_USED_COUNT))
+			break;
+		for(i=0;i<run->Point_Count;i++)
+		{
+			previous_rejected_list[i] = run->Point_List[i].Rejected;
+			run->Point_List[i].Rejected = (residual_list[i] > (parameters->Kappa*sigma));
+		}
+		if(!Focus_Fit_Parabola(run,&mean_focus,coefficient_list,covariance_list,&residual_variance,
+				       &min_focus,&max_focus))
+		{
+			/* too few focus values left, go back to the last fit */
+			for(i=0;i<run->Point_Count;i++)
+				run->Point_List[i].Rejected = previous_rejected_list[i];
+			fitted = Focus_Fit_Parabola(run,&mean_focus,coefficient_list,covariance_list,&residual_variance,
+						    &min_focus,&max_focus);
+			break;
+		}
+	}
+	used_count = 0;
+	for(i=0;i<run->Point_Count;i++)
+	{
+		if(run->Point_List[i].Rejected == FALSE)
+			used_count++;
+	}
+	fit->Used_Count = used_count;
+	/* the parabola must have a minimum */
+	if((fitted == FALSE)||(coefficient_list[2] <= 0.0))
+		return;
+	best_x = -coefficient_list[1]/(2.0*coefficient_list[2]);
+	fit->Valid = TRUE;
+	fit->Best_Focus = mean_focus+best_x;
+	fit->Best_FWHM = coefficient_list[0]+(coefficient_list[1]*best_x)+(coefficient_list[2]*best_x*best_x);
+	/* propagate the covariance of c1 and c2 to -c1/2c2 */
+	derivative_one = -1.0/(2.0*coefficient_list[2]);
+	derivative_two = coefficient_list[1]/(2.0*coefficient_list[2]*coefficient_list[2]);
+	variance = (derivative_one*derivative_one*covariance_list[4])+
+		(derivative_two*derivative_two*covariance_list[8])+
+		(2.0*derivative_one*derivative_two*covariance_list[5]);
+	if(variance > 0.0)
+		fit->Best_Focus_Error = sqrt(variance);
+	fit->Converged = (used_count >= parameters->Min_Frames)&&(used_count > 3)&&
+		(fit->Best_Focus_Error <= parameters->Tolerance)&&
+		(fit->Best_Focus >= min_focus)&&(fit->Best_Focus <= max_focus);
+}
+
+/**
+ * Work out the absolute residual of every frame of a focus run from a fitted parabola, and the median absolute
+ * residual of the frames that are not rejected. Focus_Mutex must be held.
+ * @param run The run.
+ * @param mean_focus The mean focus the parabola was fitted about.
+ * @param coefficient_list The 3 coefficients of the parabola.
+ * @param residual_list A list of at least Point_Count doubles to store the absolute residuals in.
+ * @return The median absolute residual of the frames that are not rejected.
+ * @see #Focus_Fit_Parabola
+ */
+static double Focus_Median_Residual(struct Focus_Run_Struct *run,double mean_focus,double *coefficient_list,
+				    double *residual_list)
+{
+	double sorted_list[DPRT_FOCUS_MAX_POINT_COUNT];
+	double x;
+	int used_count,i,j;
+
+	used_count = 0;
+	for(i=0;i<run->Point_Count;i++)
+	{
+		x = run->Point_List[i].Focus-mean_focus;
+		residual_list[i] = fabs(run->Point_List[i].FWHM-(coefficient_list[0]+(coefficient_list[1]*x)+
+								  (coefficient_list[2]*x*x)));
+		if(run->Point_List[i].Rejected)
+			continue;
+		for(j=used_count-1;(j >= 0)&&(sorted_list[j] > residual_list[i]);j--)
+			sorted_list[j+1] = sorted_list[j];
+		sorted_list[j+1] = residual_list[i];
+		used_count++;
+	}
+	if(used_count == 0)
+		return 0.0;
+	if((used_count%2) == 1)
+		return sorted_list[used_count/2];
+	return (sorted_list[(used_count/2)-1]+sorted_list[used_count/2])/2.0;
+}
+
+/**
+ * Least squares fit of a parabola, FWHM = c0 + c1 x + c2 x&#178;, to the frames of a focus run that are not
+ * rejected, where x is the focus less the mean focus of those frames (which keeps the normal equations well
+ * conditioned). The covariance of the coefficients is the inverse of the normal matrix scaled by the residual
+ * variance (zero if there are only three frames). Focus_Mutex must be held.
+ * @param run The run.
+ * @param mean_focus The address of a double to store the mean focus of the frames in.
+ * @param coefficient_list A list of 3 doubles to store c0, c1 and c2 in.
+ * @param covariance_list A list of 9 doubles to store the covariance matrix of the coefficients in, in row-major
+ *        order.
+ * @param residual_variance The address of a double to store the residual variance in.
+ * @param min_focus The address of a double to store the smallest focus of the frames in.
+ * @param max_focus The address of a double to store the largest focus of the frames in.
+ * @return The routine returns TRUE if the parabola was fitted, and FALSE if there were fewer than three different
+ *         focus values.
+ */
+static int Focus_Fit_Parabola(struct Focus_Run_Struct *run,double *mean_focus,double *coefficient_list,
+			      double *covariance_list,double *residual_variance,double *min_focus,double *max_focus)
+{
+	double sum_list[5],product_list[3],inverse_list[9],distinct_list[3];
+	double x,x_power,determinant,residual,residual_sum;
+	int count,distinct_count,i,j;
+
+	count = 0;
+	distinct_count = 0;
+	(*mean_focus) = 0.0;
+	for(i=0;i<run->Point_Count;i++)
+	{
+		if(run->Point_List[i].Rejected)
+			continue;
+		x = run->Point_List[i].Focus;
+		if(count == 0)
+		{
+			(*min_focus) = x;
+			(*max_focus) = x;
+		}
+		if(x < (*min_focus))
+			(*min_focus) = x;
+		if(x > (*max_focus))
+			(*max_focus) = x;
+		for(j=0;(j < distinct_count)&&(distinct_list[j] != x);j++)
+			;
+		if((j == distinct_count)&&(distinct_count < 3))
+			distinct_list[distinct_count++] = x;
+		(*mean_focus) += x;
+		count++;
+	}
+	if(distinct_count < 3)
+		return FALSE;
+	(*mean_focus) /= (double)count;
+	for(j=0;j<5;j++)
+		sum_list[j] = 0.0;
+	for(j=0;j<3;j++)
+		product_list[j] = 0.0;
+	for(i=0;i<run->Point_Count;i++)
+	{
+		if(run->Point_List[i].Rejected)
+			continue;
+		x = run->Point_List[i].Focus-(*mean_focus);
+		x_power = 1.0;
+		for(j=0;j<5;j++)
+		{
+			sum_list[j] += x_power;
+			if(j < 3)
+				product_list[j] += x_power*run->Point_List[i].FWHM;
+			x_power *= x;
+		}
+	}
+	/* invert the (symmetric) normal matrix [S0 S1 S2;S1 S2 S3;S2 S3 S4] by cofactors */
+	inverse_list[0] = (sum_list[2]*sum_list[4])-(sum_list[3]*sum_list[3]);
+	inverse_list[1] = (sum_list[2]*sum_list[3])-(sum_list[1]*sum_list[4]);
+	inverse_list[2] = (sum_list[1]*sum_list[3])-(sum_list[2]*sum_list[2]);
+	inverse_list[4] = (sum_list[0]*sum_list[4])-(sum_list[2]*sum_list[2]);
+	inverse_list[5] = (sum_list[1]*sum_list[2])-(sum_list[0]*sum_list[3]);
+	inverse_list[8] = (sum_list[0]*sum_list[2])-(sum_list[1]*sum_list[1]);
+	determinant = (sum_list[0]*inverse_list[0])+(sum_list[1]*inverse_list[1])+(sum_list[2]*inverse_list[2]);
+	if(determinant <= 0.0)
+		return FALSE;
+	inverse_list[3] = inverse_list[1];
+	inverse_list[6] = inverse_list[2];
+	inverse_list[7] = inverse_list[5];
+	for(j=0;j<9;j++)
+		inverse_list[j] /= determinant;
+	for(j=0;j<3;j++)
+	{
+		coefficient_list[j] = (inverse_list[(j*3)]*product_list[0])+(inverse_list[(j*3)+1]*product_list[1])+
+			(inverse_list[(j*3)+2]*product_list[2]);
+	}
+	residual_sum = 0.0;
+	for(i=0;i<run->Point_Count;i++)
+	{
+		if(run->Point_List[i].Rejected)
+			continue;
+		x = run->Point_List[i].Focus-(*mean_focus);
+		residual = run->Point_List[i].FWHM-(coefficient_list[0]+(coefficient_list[1]*x)+
+						    (coefficient_list[2]*x*x));
+		residual_sum += residual*residual;
+	}
+	(*residual_variance) = 0.0;
+	if(count > 3)
+		(*residual_variance) = residual_sum/((double)(count-3));
+	for(j=0;j<9;j++)
+		covariance_list[j] = inverse_list[j]*(*residual_variance);
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,547 @@
+/* dprt_histogram.c
+** Exact histograms of 16-bit frames, and robust statistics taken from them.
+** $Header$
+*/
+/**
+ * dprt_histogram.c builds exact histograms of 16-bit frames, with one bin for each of the 65536 possible pixel
+ * values, in a single pass over the frame. The frame is split into bands of rows reduced on the thread pool, each
+ * thread adding it's bands into it's own histogram (held in a scratch buffer of the calling thread's context),
+ * and the per-thread histograms are merged at the end, so no locking is needed. The median, mode, percentiles,
+ * counts above a level (e.g. saturated pixels) and a clipped sky level are then found by scanning the bins,
+ * in linear time without sorting the pixels.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_histogram.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * Macro to convert a 16-bit value read from a FITS data unit (big-endian, signed, with a BZERO of 32768)
+ * into the unsigned pixel value. On a big-endian host only the BZERO offset (flipping the top bit) is needed.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HISTOGRAM_FITS_DECODE(v)	((unsigned short)((v)^0x8000))
+#else
+#define HISTOGRAM_FITS_DECODE(v)	((unsigned short)((((v)>>8)|((v)<<8))^0x8000))
+#endif
+/**
+ * The largest difference between the clipped mean and median, in clipped standard deviations, for which the
+ * sky is estimated as the mode (2.5 median - 1.5 mean). In more crowded fields the median is used.
+ */
+#define HISTOGRAM_SKY_MODE_LIMIT	(0.3)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the data needed to build the histogram of each band of a frame.
+ * <dl>
+ * <dt>Data</dt> <dd>The frame data.</dd>
+ * <dt>Encoding</dt> <dd>How the pixel values are stored in Data (DPRT_STATS_ENCODING_NATIVE/DPRT_STATS_ENCODING_FITS).</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in each band (the last band may be smaller).</dd>
+ * <dt>Thread_Histogram_List</dt> <dd>A list of histograms, one per thread, held in the context's scratch buffer.</dd>
+ * <dt>Context</dt> <dd>The context of the thread that started the histogram, whose abort flag the bands check.</dd>
+ * <dt>Aborted</dt> <dd>A boolean, set to TRUE by any band that saw the abort flag set.</dd>
+ * </dl>
+ */
+struct Histogram_Calculate_Struct
+{
+	void *Data;
+	int Encoding;
+	int Naxis_One;
+	int Naxis_Two;
+	int Band_Rows;
+	struct DpRt_Histogram_Struct *Thread_Histogram_List;
+	DpRt_Context *Context;
+	volatile int Aborted;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Histogram_Calculate_Band(void *user_data,int band_index,int thread_index);
+static unsigned long long Histogram_Window_Count(struct DpRt_Histogram_Struct *histogram,int low,int high);
+static int Histogram_Window_Percentile(struct DpRt_Histogram_Struct *histogram,int low,int high,
+				       unsigned long long window_count,double fraction);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Empty a histogram, with no pedestal.
+ * @param histogram The histogram.
+ */
+void DpRt_Histogram_Clear(struct DpRt_Histogram_Struct *histogram)
+{
+	memset(histogram,0,sizeof(struct DpRt_Histogram_Struct));
+}
+
+/**
+ * Add a run of pixels of a 16-bit frame to a histogram.
+ * @param histogram The histogram.
+ * @param data The frame data.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param start The index in data of the first pixel to add.
+ * @param pixel_count The number of pixels to add.
+ * @see #HISTOGRAM_FITS_DECODE
+ */
+void DpRt_Histogram_Add(struct DpRt_Histogram_Struct *histogram,void *data,int encoding,size_t start,
+			size_t pixel_count)
+{
+	unsigned short *pixel_list = ((unsigned short *)data)+start;
+	unsigned int *bin_list = histogram->Bin_List;
+	size_t i;
+
+	if(encoding == DPRT_STATS_ENCODING_FITS)
+	{
+		for(i=0;i<pixel_count;i++)
+			bin_list[HISTOGRAM_FITS_DECODE(pixel_list[i])]++;
+	}
+	else
+	{
+		for(i=0;i<pixel_count;i++)
+			bin_list[pixel_list[i]]++;
+	}
+	histogram->Pixel_Count += pixel_count;
+}
+
+/**
+ * Add a run of pixels of a 16-bit frame to a histogram, leaving out the pixels set in a bad pixel mask. The run is
+ * added as it would be without a mask, and the bad pixels are then taken back out a mask word at a time, so words
+ * with no bad pixels cost one test, and the run is only read once more where there are bad pixels.
+ * @param histogram The histogram.
+ * @param data The frame data.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param start The index in data of the first pixel to add.
+ * @param pixel_count The number of pixels to add.
+ * @param mask The bad pixel mask bitset, or NULL if all the pixels are good.
+ * @param mask_start The index of the bit in mask of pixel start of data.
+ * @see #DpRt_Histogram_Add
+ * @see #HISTOGRAM_FITS_DECODE
+ * @see dprt_stats.html#DpRt_Stats_Mask_Get_Bits
+ */
+void DpRt_Histogram_Add_Masked(struct DpRt_Histogram_Struct *histogram,void *data,int encoding,size_t start,
+			       size_t pixel_count,unsigned long long *mask,size_t mask_start)
+{
+	unsigned short *pixel_list = ((unsigned short *)data)+start;
+	unsigned long long bits;
+	unsigned short value;
+	size_t i;
+	int bit;
+
+	DpRt_Histogram_Add(histogram,data,encoding,start,pixel_count);
+	if(mask == NULL)
+		return;
+	for(i=0;i<pixel_count;i+=DPRT_STATS_MASK_WORD_BITS)
+	{
+		bits = DpRt_Stats_Mask_Get_Bits(mask,mask_start+i);
+		if(pixel_count-i < DPRT_STATS_MASK_WORD_BITS)
+			bits &= (1ULL<<(pixel_count-i))-1ULL;
+		while(bits != 0)
+		{
+			bit = __builtin_ctzll(bits);
+			bits &= bits-1ULL;
+			value = pixel_list[i+bit];
+			if(encoding == DPRT_STATS_ENCODING_FITS)
+				value = HISTOGRAM_FITS_DECODE(value);
+			histogram->Bin_List[value]--;
+			histogram->Pixel_Count--;
+		}
+	}
+}
+
+/**
+ * Add one histogram into another. If the total is empty it takes on the partial histogram's pedestal, otherwise
+ * the two must have the same pedestal.
+ * @param total The histogram to add to.
+ * @param partial The histogram to add.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Merge(struct DpRt_Histogram_Struct *total,struct DpRt_Histogram_Struct *partial)
+{
+	int i;
+
+	if((total == NULL)||(partial == NULL))
+	{
+		DpRt_Error_Number = 1500;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Merge:total or partial was NULL.\n");
+		return FALSE;
+	}
+	if(partial->Pixel_Count == 0)
+		return TRUE;
+	if(total->Pixel_Count == 0)
+		total->Pedestal = partial->Pedestal;
+	else if(total->Pedestal != partial->Pedestal)
+	{
+		DpRt_Error_Number = 1512;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Merge:Pedestals differ (%d,%d).\n",total->Pedestal,
+			partial->Pedestal);
+		return FALSE;
+	}
+	for(i=0;i<DPRT_HISTOGRAM_BIN_COUNT;i++)
+		total->Bin_List[i] += partial->Bin_List[i];
+	total->Pixel_Count += partial->Pixel_Count;
+	return TRUE;
+}
+
+/**
+ * Build the histogram of a 16-bit frame, in bands of rows on the thread pool. Each thread adds it's bands to it's
+ * own histogram, held in a scratch buffer of the calling thread's current context, and these are merged into
+ * the result.
+ * @param data The frame data, of naxis_one*naxis_two pixels, in row-major order.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param histogram The address of a histogram to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Histogram_Calculate_Band
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Get_Thread_Count
+ * @see dprt_context.html#DpRt_Context_Get_Scratch
+ * @see dprt_context.html#DPRT_CONTEXT_SCRATCH_HISTOGRAM
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Calculate(void *data,int encoding,int naxis_one,int naxis_two,
+			     struct DpRt_Histogram_Struct *histogram)
+{
+	struct Histogram_Calculate_Struct calculate;
+	int band_count,thread_count,i,retval;
+
+	if((data == NULL)||(histogram == NULL)||(naxis_one < 0)||(naxis_two < 0))
+	{
+		DpRt_Error_Number = 1501;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Calculate:Illegal arguments (%d,%d).\n",naxis_one,naxis_two);
+		return FALSE;
+	}
+	DpRt_Histogram_Clear(histogram);
+	calculate.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	band_count = (naxis_two+calculate.Band_Rows-1)/calculate.Band_Rows;
+	if(band_count == 0)
+		return TRUE;
+	thread_count = DpRt_Thread_Pool_Get_Thread_Count();
+	if(thread_count < 1)
+		thread_count = 1;
+	calculate.Data = data;
+	calculate.Encoding = encoding;
+	calculate.Naxis_One = naxis_one;
+	calculate.Naxis_Two = naxis_two;
+	calculate.Aborted = FALSE;
+	calculate.Context = DpRt_Context_Get_Current();
+	if(!DpRt_Context_Get_Scratch(calculate.Context,DPRT_CONTEXT_SCRATCH_HISTOGRAM,
+				     thread_count*sizeof(struct DpRt_Histogram_Struct),
+				     (void **)&(calculate.Thread_Histogram_List)))
+	{
+		DpRt_Error_Number = 1502;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Calculate:Failed to allocate %d thread histograms.\n",
+			thread_count);
+		return FALSE;
+	}
+	for(i=0;i<thread_count;i++)
+		DpRt_Histogram_Clear(&(calculate.Thread_Histogram_List[i]));
+	retval = DpRt_Thread_Pool_Run(band_count,Histogram_Calculate_Band,&calculate);
+	if(calculate.Aborted)
+	{
+		DpRt_Error_Number = 1503;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Calculate:Operation Aborted.\n");
+		return FALSE;
+	}
+	if(retval == FALSE)
+	{
+		DpRt_Error_Number = 1504;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Calculate:Failed to histogram bands.\n");
+		return FALSE;
+	}
+	for(i=0;i<thread_count;i++)
+		DpRt_Histogram_Merge(histogram,&(calculate.Thread_Histogram_List[i]));
+	return TRUE;
+}
+
+/**
+ * Count the pixels in a histogram whose values are between low and high inclusive. For instance, the number of
+ * saturated pixels is the count between the saturation level and 65535.
+ * @param histogram The histogram.
+ * @param low The lowest value counted. Values below the lowest binned value (0 less the pedestal) are
+ *        treated as it.
+ * @param high The highest value counted. Values above the highest binned value (65535 less the pedestal) are
+ *        treated as it.
+ * @param count The address of an unsigned long long to store the count.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Histogram_Window_Count
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Get_Count(struct DpRt_Histogram_Struct *histogram,int low,int high,unsigned long long *count)
+{
+	if((histogram == NULL)||(count == NULL))
+	{
+		DpRt_Error_Number = 1505;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Count:histogram or count was NULL.\n");
+		return FALSE;
+	}
+	low += histogram->Pedestal;
+	high += histogram->Pedestal;
+	if(low < 0)
+		low = 0;
+	if(high > (DPRT_HISTOGRAM_BIN_COUNT-1))
+		high = DPRT_HISTOGRAM_BIN_COUNT-1;
+	(*count) = 0;
+	if(low <= high)
+		(*count) = Histogram_Window_Count(histogram,low,high);
+	return TRUE;
+}
+
+/**
+ * Find a percentile of a histogram: the lowest value at or below which at least fraction of the pixels lie.
+ * The median is the percentile with a fraction of 0.5.
+ * @param histogram The histogram, which must not be empty.
+ * @param fraction The fraction of pixels, between 0.0 and 1.0.
+ * @param value The address of an integer to store the value.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Histogram_Window_Percentile
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Get_Percentile(struct DpRt_Histogram_Struct *histogram,double fraction,int *value)
+{
+	if((histogram == NULL)||(value == NULL)||(fraction < 0.0)||(fraction > 1.0))
+	{
+		DpRt_Error_Number = 1506;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Percentile:Illegal arguments (fraction %.2f).\n",
+			fraction);
+		return FALSE;
+	}
+	if(histogram->Pixel_Count == 0)
+	{
+		DpRt_Error_Number = 1507;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Percentile:Histogram is empty.\n");
+		return FALSE;
+	}
+	(*value) = Histogram_Window_Percentile(histogram,0,DPRT_HISTOGRAM_BIN_COUNT-1,histogram->Pixel_Count,
+					       fraction)-histogram->Pedestal;
+	return TRUE;
+}
+
+/**
+ * Find the mode of a histogram: the value with the most pixels (the lowest such value, if there is a tie).
+ * @param histogram The histogram, which must not be empty.
+ * @param value The address of an integer to store the mode.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Get_Mode(struct DpRt_Histogram_Struct *histogram,int *value)
+{
+	int i;
+
+	if((histogram == NULL)||(value == NULL))
+	{
+		DpRt_Error_Number = 1508;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Mode:histogram or value was NULL.\n");
+		return FALSE;
+	}
+	if(histogram->Pixel_Count == 0)
+	{
+		DpRt_Error_Number = 1509;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Mode:Histogram is empty.\n");
+		return FALSE;
+	}
+	(*value) = 0;
+	for(i=1;i<DPRT_HISTOGRAM_BIN_COUNT;i++)
+	{
+		if(histogram->Bin_List[i] > histogram->Bin_List[(*value)])
+			(*value) = i;
+	}
+	(*value) -= histogram->Pedestal;
+	return TRUE;
+}
+
+/**
+ * Estimate the sky level of a frame from it's histogram. The median and standard deviation (half the spread
+ * of the 15.87 and 84.13 percentiles, which is not affected by stars) of the pixels are found, and pixels
+ * more than kappa standard deviations from the median are clipped, by narrowing the window of bins considered.
+ * This is repeated until the window stops changing, or for iterations times. The sky is then the mode estimate
+ * 2.5 median - 1.5 mean of the clipped pixels, or the clipped median if the mean and median differ by more than
+ * HISTOGRAM_SKY_MODE_LIMIT standard deviations (a crowded field).
+ * @param histogram The histogram, which must not be empty.
+ * @param kappa The clipping limit, in standard deviations.
+ * @param iterations The maximum number of clipping iterations.
+ * @param sky The address of a double to store the sky level.
+ * @param sigma The address of a double to store the clipped standard deviation of the sky, or NULL.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #HISTOGRAM_SKY_MODE_LIMIT
+ * @see #Histogram_Window_Count
+ * @see #Histogram_Window_Percentile
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Histogram_Get_Sky(struct DpRt_Histogram_Struct *histogram,double kappa,int iterations,double *sky,
+			   double *sigma)
+{
+	unsigned long long window_count;
+	double median,deviation,sum,mean;
+	int low,high,new_low,new_high,iteration,i;
+
+	if((histogram == NULL)||(sky == NULL)||(kappa <= 0.0)||(iterations < 0))
+	{
+		DpRt_Error_Number = 1510;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Sky:Illegal arguments (kappa %.2f,iterations %d).\n",
+			kappa,iterations);
+		return FALSE;
+	}
+	if(histogram->Pixel_Count == 0)
+	{
+		DpRt_Error_Number = 1511;
+		sprintf(DpRt_Error_String,"DpRt_Histogram_Get_Sky:Histogram is empty.\n");
+		return FALSE;
+	}
+	low = 0;
+	high = DPRT_HISTOGRAM_BIN_COUNT-1;
+	window_count = histogram->Pixel_Count;
+	median = 0.0;
+	deviation = 0.0;
+	for(iteration=0;iteration<=iterations;iteration++)
+	{
+		median = (double)Histogram_Window_Percentile(histogram,low,high,window_count,0.5);
+		deviation = ((double)(Histogram_Window_Percentile(histogram,low,high,window_count,0.8413)-
+				      Histogram_Window_Percentile(histogram,low,high,window_count,0.1587)))/2.0;
+		/* the spread of integer values is at least one bin */
+		if(deviation < 0.5)
+			deviation = 0.5;
+		if(iteration == iterations)
+			break;
+		new_low = (int)floor(median-(kappa*deviation));
+		new_high = (int)ceil(median+(kappa*deviation));
+		if(new_low < 0)
+			new_low = 0;
+		if(new_high > (DPRT_HISTOGRAM_BIN_COUNT-1))
+			new_high = DPRT_HISTOGRAM_BIN_COUNT-1;
+		if((new_low == low)&&(new_high == high))
+			break;
+		low = new_low;
+		high = new_high;
+		/* the window always contains the median, so is never empty */
+		window_count = Histogram_Window_Count(histogram,low,high);
+	}
+	sum = 0.0;
+	for(i=low;i<=high;i++)
+		sum += ((double)i)*((double)histogram->Bin_List[i]);
+	mean = sum/((double)window_count);
+	if(fabs(mean-median) < (HISTOGRAM_SKY_MODE_LIMIT*deviation))
+		(*sky) = (2.5*median)-(1.5*mean);
+	else
+		(*sky) = median;
+	(*sky) -= (double)(histogram->Pedestal);
+	if(sigma != NULL)
+		(*sigma) = deviation;
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Thread pool task function, adding one band of rows to the histogram of the thread running it.
+ * The abort flag of the histogram's context is checked before the band is started.
+ * @param user_data A pointer to the Histogram_Calculate_Struct describing the histogram.
+ * @param band_index The index of the band to add.
+ * @param thread_index The index of the thread running the task, used to select it's histogram.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it was aborted.
+ * @see #Histogram_Calculate_Struct
+ * @see #DpRt_Histogram_Add
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ */
+static int Histogram_Calculate_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Histogram_Calculate_Struct *calculate = (struct Histogram_Calculate_Struct *)user_data;
+	int start_y,end_y;
+
+	if(calculate->Aborted || DpRt_Context_Get_Abort(calculate->Context))
+	{
+		calculate->Aborted = TRUE;
+		return FALSE;
+	}
+	start_y = band_index*calculate->Band_Rows;
+	end_y = start_y+calculate->Band_Rows;
+	if(end_y > calculate->Naxis_Two)
+		end_y = calculate->Naxis_Two;
+	DpRt_Histogram_Add(&(calculate->Thread_Histogram_List[thread_index]),calculate->Data,calculate->Encoding,
+			   ((size_t)start_y)*((size_t)calculate->Naxis_One),
+			   ((size_t)(end_y-start_y))*((size_t)calculate->Naxis_One));
+	return TRUE;
+}
+
+/**
+ * Count the pixels in a window of bins.
+ * @param histogram The histogram.
+ * @param low The first bin in the window.
+ * @param high The last bin in the window.
+ * @return The number of pixels in the window.
+ */
+static unsigned long long Histogram_Window_Count(struct DpRt_Histogram_Struct *histogram,int low,int high)
+{
+	unsigned long long count = 0;
+	int i;
+
+	for(i=low;i<=high;i++)
+		count += histogram->Bin_List[i];
+	return count;
+}
+
+/**
+ * Find a percentile of the pixels in a window of bins: the lowest value at or below which at least fraction
+ * of the window's pixels lie.
+ * @param histogram The histogram.
+ * @param low The first bin in the window.
+ * @param high The last bin in the window.
+ * @param window_count The number of pixels in the window, which must be at least one.
+ * @param fraction The fraction of pixels, between 0.0 and 1.0.
+ * @return The percentile.
+ */
+static int Histogram_Window_Percentile(struct DpRt_Histogram_Struct *histogram,int low,int high,
+				       unsigned long long window_count,double fraction)
+{
+	unsigned long long target,count;
+	int i;
+
+	target = (unsigned long long)ceil(fraction*((double)window_count));
+	if(target < 1)
+		target = 1;
+	count = 0;
+	for(i=low;i<high;i++)
+	{
+		count += histogram->Bin_List[i];
+		if(count >= target)
+			return i;
+	}
+	return high;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,771 @@
+/* dprt_job.c
+** Asynchronous reduction jobs, run on dedicated job threads.
+** $Header$
+*/
+/**
+ * dprt_job.c provides an asynchronous interface to the reduction routines. A caller submits a filename and a
+ * reduction type with DpRt_Job_Submit, and gets a job id back immediately. The job is queued, and run by one of a
+ * small number of dedicated job threads, created in DpRt_Initialise and destroyed in DpRt_Shutdown. Each job thread
+ * owns a DpRt_Context, so jobs run concurrently with each other and with reductions made through the
+ * synchronous API. The caller can poll the job's state, wait for it to finish with a timeout, cancel it, and/or
+ * supply a callback function that is called (on the job thread) when the job finishes.
+ * Finished jobs are kept, so their results can be retrieved, until they are released with DpRt_Job_Release,
+ * unless they were submitted with auto_release set.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_job.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The maximum number of job threads.
+ */
+#define JOB_MAX_THREAD_COUNT		(64)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a submitted job.
+ * <dl>
+ * <dt>Id</dt> <dd>The job id returned to the caller.</dd>
+ * <dt>Type</dt> <dd>The job type, DPRT_JOB_TYPE_CALIBRATE_REDUCE or DPRT_JOB_TYPE_EXPOSE_REDUCE.</dd>
+ * <dt>Input_Filename</dt> <dd>A copy of the filename to reduce.</dd>
+ * <dt>Callback</dt> <dd>The function to call when the job finishes, or NULL.</dd>
+ * <dt>User_Data</dt> <dd>The user data to pass to Callback.</dd>
+ * <dt>Auto_Release</dt> <dd>A boolean, if TRUE the job is released as soon as it finishes.</dd>
+ * <dt>State</dt> <dd>The job state, as seen by DpRt_Job_Poll/DpRt_Job_Wait. This only becomes a terminal state
+ *     once the callback (if any) has returned.</dd>
+ * <dt>Cancel_Requested</dt> <dd>A boolean, set when a running job is cancelled.</dd>
+ * <dt>Wait_Count</dt> <dd>The number of threads in DpRt_Job_Wait on this job.</dd>
+ * <dt>Release_Pending</dt> <dd>A boolean, set when the job is released whilst other threads are waiting on it.
+ *     The last waiter frees the job.</dd>
+ * <dt>Context</dt> <dd>The context of the job thread running the job, or NULL if the job is not running.</dd>
+ * <dt>Result</dt> <dd>The job's result.</dd>
+ * <dt>Next</dt> <dd>The next job in the job list.</dd>
+ * </dl>
+ * @see #DpRt_Job_Result_Struct
+ */
+struct Job_Struct
+{
+	int Id;
+	int Type;
+	char *Input_Filename;
+	DpRt_Job_Callback_Function Callback;
+	void *User_Data;
+	int Auto_Release;
+	int State;
+	int Cancel_Requested;
+	int Wait_Count;
+	int Release_Pending;
+	DpRt_Context *Context;
+	struct DpRt_Job_Result_Struct Result;
+	struct Job_Struct *Next;
+};
+
+/**
+ * Structure holding the job threads and job list.
+ * <dl>
+ * <dt>Thread_List</dt> <dd>The list of job threads.</dd>
+ * <dt>Context_List</dt> <dd>The list of contexts, one per job thread.</dd>
+ * <dt>Thread_Count</dt> <dd>The number of job threads.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting the job list and job structures.</dd>
+ * <dt>Work_Condition</dt> <dd>Condition signalled when a job is submitted, or the job threads are shutting down.</dd>
+ * <dt>Done_Condition</dt> <dd>Condition signalled when a job finishes.</dd>
+ * <dt>Job_List_Head</dt> <dd>The first job in the list of unreleased jobs, in submission order.</dd>
+ * <dt>Job_List_Tail</dt> <dd>The last job in the list of unreleased jobs.</dd>
+ * <dt>Next_Id</dt> <dd>The id to give the next submitted job.</dd>
+ * <dt>Shutdown</dt> <dd>A boolean, set to TRUE to stop the job threads.</dd>
+ * </dl>
+ * @see #Job_Struct
+ */
+struct Job_Data_Struct
+{
+	pthread_t *Thread_List;
+	DpRt_Context **Context_List;
+	int Thread_Count;
+	pthread_mutex_t Mutex;
+	pthread_cond_t Work_Condition;
+	pthread_cond_t Done_Condition;
+	struct Job_Struct *Job_List_Head;
+	struct Job_Struct *Job_List_Tail;
+	int Next_Id;
+	int Shutdown;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The job data.
+ * @see #Job_Data_Struct
+ */
+static struct Job_Data_Struct Job_Data =
+{
+	NULL,NULL,0,PTHREAD_MUTEX_INITIALIZER,PTHREAD_COND_INITIALIZER,PTHREAD_COND_INITIALIZER,NULL,NULL,1,FALSE
+};
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void *Job_Worker(void *arg);
+static void Job_Run(struct Job_Struct *job,DpRt_Context *context);
+static void Job_Finish(struct Job_Struct *job,int state);
+static struct Job_Struct *Job_Find(int job_id);
+static struct Job_Struct *Job_Find_Queued(void);
+static void Job_Remove(struct Job_Struct *job);
+static void Job_Free(struct Job_Struct *job);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Create the job threads, each with it's own context.
+ * @param thread_count The number of job threads to create. Values less than one are treated as one.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Job_Data
+ * @see #Job_Worker
+ * @see #JOB_MAX_THREAD_COUNT
+ * @see dprt_context.html#DpRt_Context_Create
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Initialise(int thread_count)
+{
+	int i,retval;
+
+	/* re-initialising replaces the existing job threads */
+	if(Job_Data.Thread_List != NULL)
+		DpRt_Job_Shutdown();
+	if(thread_count < 1)
+		thread_count = 1;
+	if(thread_count > JOB_MAX_THREAD_COUNT)
+		thread_count = JOB_MAX_THREAD_COUNT;
+	fprintf(stdout,"DpRt_Job_Initialise:Using %d job threads.\n",thread_count);
+	Job_Data.Thread_List = (pthread_t *)malloc(thread_count*sizeof(pthread_t));
+	Job_Data.Context_List = (DpRt_Context **)calloc(thread_count,sizeof(DpRt_Context *));
+	if((Job_Data.Thread_List == NULL)||(Job_Data.Context_List == NULL))
+	{
+		if(Job_Data.Thread_List != NULL)
+			free(Job_Data.Thread_List);
+		Job_Data.Thread_List = NULL;
+		if(Job_Data.Context_List != NULL)
+			free(Job_Data.Context_List);
+		Job_Data.Context_List = NULL;
+		DpRt_Error_Number = 800;
+		sprintf(DpRt_Error_String,"DpRt_Job_Initialise:Failed to allocate thread list(%d).\n",thread_count);
+		return FALSE;
+	}
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	Job_Data.Shutdown = FALSE;
+	Job_Data.Thread_Count = 0;
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	for(i=0;i<thread_count;i++)
+	{
+		if(!DpRt_Context_Create(&(Job_Data.Context_List[i])))
+		{
+			DpRt_Job_Shutdown();
+			fprintf(stderr,"%s",DpRt_Error_String);
+			DpRt_Error_Number = 801;
+			sprintf(DpRt_Error_String,"DpRt_Job_Initialise:Failed to create context %d.\n",i);
+			return FALSE;
+		}
+		retval = pthread_create(&(Job_Data.Thread_List[i]),NULL,Job_Worker,Job_Data.Context_List[i]);
+		if(retval != 0)
+		{
+			/* stop the job threads created so far */
+			DpRt_Context_Destroy(Job_Data.Context_List[i]);
+			Job_Data.Context_List[i] = NULL;
+			DpRt_Job_Shutdown();
+			DpRt_Error_Number = 802;
+			sprintf(DpRt_Error_String,"DpRt_Job_Initialise:Failed to create thread %d (%d).\n",i,retval);
+			return FALSE;
+		}
+		Job_Data.Thread_Count++;
+	}
+	return TRUE;
+}
+
+/**
+ * Stop and join the job threads. Queued jobs are cancelled (their callbacks are called from this thread),
+ * and running jobs are asked to abort, and finish on their job threads before this routine returns.
+ * Finished jobs that have not been released are then released, so their ids must not be used again. A job
+ * that another thread is still waiting on is freed by the last waiter, as in DpRt_Job_Release.
+ * @return The routine returns TRUE.
+ * @see #Job_Data
+ * @see #Job_Find_Queued
+ * @see #Job_Finish
+ * @see #Job_Remove
+ * @see #Job_Free
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see dprt_context.html#DpRt_Context_Destroy
+ */
+int DpRt_Job_Shutdown(void)
+{
+	struct Job_Struct *job = NULL;
+	struct Job_Struct *next_job = NULL;
+	int i;
+
+	if(Job_Data.Thread_List == NULL)
+		return TRUE;
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	Job_Data.Shutdown = TRUE;
+	/* ask running jobs to abort */
+	for(job = Job_Data.Job_List_Head; job != NULL; job = job->Next)
+	{
+		if(job->Context != NULL)
+		{
+			job->Cancel_Requested = TRUE;
+			DpRt_Context_Set_Abort(job->Context,TRUE);
+		}
+	}
+	pthread_cond_broadcast(&(Job_Data.Work_Condition));
+	/* cancel queued jobs. The job threads no longer claim jobs, so each queued job is claimed here */
+	while((job = Job_Find_Queued()) != NULL)
+	{
+		job->State = DPRT_JOB_STATE_RUNNING;
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		job->Result.Error_Number = 814;
+		sprintf(job->Result.Error_String,"DpRt_Job_Shutdown:Job %d cancelled by shutdown.\n",job->Id);
+		Job_Finish(job,DPRT_JOB_STATE_CANCELLED);
+		pthread_mutex_lock(&(Job_Data.Mutex));
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	for(i=0;i<Job_Data.Thread_Count;i++)
+		pthread_join(Job_Data.Thread_List[i],NULL);
+	/* release the finished jobs that were never released */
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	for(job = Job_Data.Job_List_Head; job != NULL; job = next_job)
+	{
+		next_job = job->Next;
+		if(job->Wait_Count > 0)
+			job->Release_Pending = TRUE;
+		else
+		{
+			Job_Remove(job);
+			Job_Free(job);
+		}
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	free(Job_Data.Thread_List);
+	Job_Data.Thread_List = NULL;
+	if(Job_Data.Context_List != NULL)
+	{
+		for(i=0;i<Job_Data.Thread_Count;i++)
+			DpRt_Context_Destroy(Job_Data.Context_List[i]);
+		free(Job_Data.Context_List);
+		Job_Data.Context_List = NULL;
+	}
+	Job_Data.Thread_Count = 0;
+	return TRUE;
+}
+
+/**
+ * Submit a reduction job. The routine returns as soon as the job is queued.
+ * @param type The job type, DPRT_JOB_TYPE_CALIBRATE_REDUCE or DPRT_JOB_TYPE_EXPOSE_REDUCE.
+ * @param input_filename The FITS filename to be reduced. A copy is taken.
+ * @param callback A function to call (on the job thread) when the job finishes, or NULL. The callback is called
+ *        exactly once for each job, whether it completes, fails or is cancelled.
+ * @param user_data A pointer passed to callback.
+ * @param auto_release A boolean, if TRUE the job is released once it has finished and the callback has returned.
+ *        The job id must then not be used after the callback.
+ * @param job_id The address of an integer to store the new job's id.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Job_Data
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Submit(int type,char *input_filename,DpRt_Job_Callback_Function callback,void *user_data,
+		    int auto_release,int *job_id)
+{
+	struct Job_Struct *job = NULL;
+
+	if((type != DPRT_JOB_TYPE_CALIBRATE_REDUCE)&&(type != DPRT_JOB_TYPE_EXPOSE_REDUCE))
+	{
+		DpRt_Error_Number = 803;
+		sprintf(DpRt_Error_String,"DpRt_Job_Submit:Illegal job type %d.\n",type);
+		return FALSE;
+	}
+	if((input_filename == NULL)||(job_id == NULL))
+	{
+		DpRt_Error_Number = 804;
+		sprintf(DpRt_Error_String,"DpRt_Job_Submit:input_filename or job_id was NULL.\n");
+		return FALSE;
+	}
+	job = (struct Job_Struct *)calloc(1,sizeof(struct Job_Struct));
+	if(job != NULL)
+		job->Input_Filename = strdup(input_filename);
+	if((job == NULL)||(job->Input_Filename == NULL))
+	{
+		if(job != NULL)
+			free(job);
+		DpRt_Error_Number = 805;
+		sprintf(DpRt_Error_String,"DpRt_Job_Submit:Failed to allocate job(%.150s).\n",input_filename);
+		return FALSE;
+	}
+	job->Type = type;
+	job->Callback = callback;
+	job->User_Data = user_data;
+	job->Auto_Release = auto_release;
+	job->State = DPRT_JOB_STATE_QUEUED;
+	job->Result.Type = type;
+	job->Result.State = DPRT_JOB_STATE_QUEUED;
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	if((Job_Data.Thread_List == NULL)||Job_Data.Shutdown)
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		Job_Free(job);
+		DpRt_Error_Number = 806;
+		sprintf(DpRt_Error_String,"DpRt_Job_Submit:Job threads are not running(%.150s).\n",input_filename);
+		return FALSE;
+	}
+	job->Id = Job_Data.Next_Id++;
+	if(Job_Data.Next_Id <= 0)
+		Job_Data.Next_Id = 1;
+	if(Job_Data.Job_List_Tail != NULL)
+		Job_Data.Job_List_Tail->Next = job;
+	else
+		Job_Data.Job_List_Head = job;
+	Job_Data.Job_List_Tail = job;
+	(*job_id) = job->Id;
+	pthread_cond_signal(&(Job_Data.Work_Condition));
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	return TRUE;
+}
+
+/**
+ * Get the current state of a job.
+ * @param job_id The job id.
+ * @param state The address of an integer to store the job's state (DPRT_JOB_STATE_QUEUED etc.).
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the job id is unknown).
+ * @see #Job_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Poll(int job_id,int *state)
+{
+	struct Job_Struct *job = NULL;
+
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job = Job_Find(job_id);
+	if((job == NULL)||(state == NULL))
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 807;
+		sprintf(DpRt_Error_String,"DpRt_Job_Poll:Job %d not found, or state was NULL.\n",job_id);
+		return FALSE;
+	}
+	(*state) = job->State;
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	return TRUE;
+}
+
+/**
+ * Wait for a job to finish.
+ * @param job_id The job id.
+ * @param timeout_ms The maximum time to wait, in milliseconds. A negative value waits indefinitely, zero does
+ *        not wait at all.
+ * @param state The address of an integer to store the job's state. If this is not a terminal state
+ *        (DPRT_JOB_STATE_IS_FINISHED), the wait timed out.
+ * @return The routine returns TRUE if it succeeded (whether or not the wait timed out),
+ *         and FALSE if it failed (the job id is unknown).
+ * @see #Job_Find
+ * @see #Job_Remove
+ * @see #Job_Free
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Wait(int job_id,int timeout_ms,int *state)
+{
+	struct Job_Struct *job = NULL;
+	struct timespec deadline;
+	int retval = 0,free_job = FALSE;
+
+	if(timeout_ms > 0)
+	{
+		clock_gettime(CLOCK_REALTIME,&deadline);
+		deadline.tv_sec += timeout_ms/1000;
+		deadline.tv_nsec += (long)(timeout_ms%1000)*1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job = Job_Find(job_id);
+	if((job == NULL)||(state == NULL))
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 808;
+		sprintf(DpRt_Error_String,"DpRt_Job_Wait:Job %d not found, or state was NULL.\n",job_id);
+		return FALSE;
+	}
+	job->Wait_Count++;
+	while((!DPRT_JOB_STATE_IS_FINISHED(job->State))&&(timeout_ms != 0)&&(retval != ETIMEDOUT))
+	{
+		if(timeout_ms < 0)
+			pthread_cond_wait(&(Job_Data.Done_Condition),&(Job_Data.Mutex));
+		else
+			retval = pthread_cond_timedwait(&(Job_Data.Done_Condition),&(Job_Data.Mutex),&deadline);
+	}
+	(*state) = job->State;
+	job->Wait_Count--;
+	/* the job was released whilst we were waiting on it */
+	if(job->Release_Pending && (job->Wait_Count == 0))
+	{
+		Job_Remove(job);
+		free_job = TRUE;
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	if(free_job)
+		Job_Free(job);
+	return TRUE;
+}
+
+/**
+ * Get the result of a finished job. The result's Output_Filename is a copy, owned by the caller, who should
+ * free it (it remains valid after the job is released).
+ * @param job_id The job id.
+ * @param result The address of a structure to copy the job's result into.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the job id is unknown, or the job
+ *         has not finished).
+ * @see #Job_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Get_Result(int job_id,struct DpRt_Job_Result_Struct *result)
+{
+	struct Job_Struct *job = NULL;
+
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job = Job_Find(job_id);
+	if((job == NULL)||(result == NULL))
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 809;
+		sprintf(DpRt_Error_String,"DpRt_Job_Get_Result:Job %d not found, or result was NULL.\n",job_id);
+		return FALSE;
+	}
+	if(!DPRT_JOB_STATE_IS_FINISHED(job->State))
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 810;
+		sprintf(DpRt_Error_String,"DpRt_Job_Get_Result:Job %d has not finished (%d).\n",job_id,job->State);
+		return FALSE;
+	}
+	(*result) = job->Result;
+	if(job->Result.Output_Filename != NULL)
+	{
+		result->Output_Filename = strdup(job->Result.Output_Filename);
+		if(result->Output_Filename == NULL)
+		{
+			pthread_mutex_unlock(&(Job_Data.Mutex));
+			DpRt_Error_Number = 817;
+			sprintf(DpRt_Error_String,"DpRt_Job_Get_Result:Job %d:Failed to copy output filename.\n",
+				job_id);
+			return FALSE;
+		}
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	return TRUE;
+}
+
+/**
+ * Cancel a job. A queued job is removed from the queue and finished (with state DPRT_JOB_STATE_CANCELLED)
+ * before this routine returns, it's callback being called from this thread. A running job has it's context's
+ * abort flag set, and finishes on it's job thread as soon as the reduction notices the abort; if the
+ * reduction completes regardless, the job finishes normally. Cancelling a finished job does nothing.
+ * @param job_id The job id.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the job id is unknown).
+ * @see #Job_Find
+ * @see #Job_Finish
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Cancel(int job_id)
+{
+	struct Job_Struct *job = NULL;
+
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job = Job_Find(job_id);
+	if(job == NULL)
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 811;
+		sprintf(DpRt_Error_String,"DpRt_Job_Cancel:Job %d not found.\n",job_id);
+		return FALSE;
+	}
+	if(job->State == DPRT_JOB_STATE_QUEUED)
+	{
+		/* claim the job, so no job thread runs it */
+		job->State = DPRT_JOB_STATE_RUNNING;
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		job->Result.Error_Number = 813;
+		sprintf(job->Result.Error_String,"DpRt_Job_Cancel:Job %d cancelled.\n",job_id);
+		Job_Finish(job,DPRT_JOB_STATE_CANCELLED);
+		return TRUE;
+	}
+	if(job->State == DPRT_JOB_STATE_RUNNING)
+	{
+		job->Cancel_Requested = TRUE;
+		if(job->Context != NULL)
+			DpRt_Context_Set_Abort(job->Context,TRUE);
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	return TRUE;
+}
+
+/**
+ * Release a finished job, freeing it's result. If other threads are waiting on the job, it is freed when the
+ * last of them returns. The job id must not be used again.
+ * @param job_id The job id.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (the job id is unknown, or the job
+ *         has not finished).
+ * @see #Job_Find
+ * @see #Job_Remove
+ * @see #Job_Free
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Job_Release(int job_id)
+{
+	struct Job_Struct *job = NULL;
+
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job = Job_Find(job_id);
+	if(job == NULL)
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 812;
+		sprintf(DpRt_Error_String,"DpRt_Job_Release:Job %d not found.\n",job_id);
+		return FALSE;
+	}
+	if(!DPRT_JOB_STATE_IS_FINISHED(job->State))
+	{
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		DpRt_Error_Number = 815;
+		sprintf(DpRt_Error_String,"DpRt_Job_Release:Job %d has not finished (%d).\n",job_id,job->State);
+		return FALSE;
+	}
+	if(job->Wait_Count > 0)
+	{
+		job->Release_Pending = TRUE;
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		return TRUE;
+	}
+	Job_Remove(job);
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	Job_Free(job);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Job thread. Claims queued jobs in submission order and runs them in the thread's context,
+ * until the job threads are shut down. The context's abort flag is cleared whilst the job is claimed, under the
+ * job mutex, so a DpRt_Job_Cancel of the running job always reaches the reduction (which does not clear it).
+ * @param arg The job thread's context.
+ * @return The routine returns NULL.
+ * @see #Job_Data
+ * @see #Job_Find_Queued
+ * @see #Job_Run
+ * @see #Job_Finish
+ * @see dprt_context.html#DpRt_Context_Set_Abort
+ */
+static void *Job_Worker(void *arg)
+{
+	DpRt_Context *context = (DpRt_Context *)arg;
+	struct Job_Struct *job = NULL;
+	int state;
+
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	while(TRUE)
+	{
+		job = NULL;
+		while((!Job_Data.Shutdown)&&((job = Job_Find_Queued()) == NULL))
+			pthread_cond_wait(&(Job_Data.Work_Condition),&(Job_Data.Mutex));
+		if(Job_Data.Shutdown)
+			break;
+		job->State = DPRT_JOB_STATE_RUNNING;
+		job->Context = context;
+		DpRt_Context_Set_Abort(context,FALSE);
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		Job_Run(job,context);
+		pthread_mutex_lock(&(Job_Data.Mutex));
+		job->Context = NULL;
+		if(job->Result.Successful)
+			state = DPRT_JOB_STATE_DONE;
+		else if(job->Cancel_Requested)
+			state = DPRT_JOB_STATE_CANCELLED;
+		else
+			state = DPRT_JOB_STATE_FAILED;
+		pthread_mutex_unlock(&(Job_Data.Mutex));
+		Job_Finish(job,state);
+		pthread_mutex_lock(&(Job_Data.Mutex));
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	return NULL;
+}
+
+/**
+ * Run a job's reduction in the specified context, and fill in the job's result.
+ * @param job The job.
+ * @param context The context to run the reduction in.
+ * @see dprt.html#DpRt_Context_Calibrate_Reduce
+ * @see dprt.html#DpRt_Context_Expose_Reduce
+ * @see dprt_context.html#DpRt_Context_Get_Error_Number
+ * @see dprt_context.html#DpRt_Context_Get_Error_String
+ */
+static void Job_Run(struct Job_Struct *job,DpRt_Context *context)
+{
+	struct DpRt_Job_Result_Struct *result = &(job->Result);
+
+	if(job->Type == DPRT_JOB_TYPE_CALIBRATE_REDUCE)
+	{
+		result->Successful = DpRt_Context_Calibrate_Reduce(context,job->Input_Filename,
+								   &(result->Output_Filename),&(result->Mean_Counts),
+								   &(result->Peak_Counts));
+	}
+	else
+	{
+		result->Successful = DpRt_Context_Expose_Reduce(context,job->Input_Filename,&(result->Output_Filename),
+								&(result->Seeing),&(result->Counts),&(result->X_Pix),
+								&(result->Y_Pix),&(result->Photometricity),
+								&(result->Sky_Brightness),&(result->Saturated));
+	}
+	result->Error_Number = DpRt_Context_Get_Error_Number(context);
+	DpRt_Context_Get_Error_String(context,result->Error_String);
+}
+
+/**
+ * Finish a job. The job must have been claimed (it's state is DPRT_JOB_STATE_RUNNING) by the calling thread.
+ * The job's callback is called, then it's state is set, waiters are woken, and the job is released if it was
+ * submitted with auto_release. This routine must be called without the job mutex held.
+ * @param job The job.
+ * @param state The terminal state of the job.
+ * @see #Job_Data
+ * @see #Job_Remove
+ * @see #Job_Free
+ */
+static void Job_Finish(struct Job_Struct *job,int state)
+{
+	int free_job = FALSE;
+
+	job->Result.State = state;
+	if(job->Callback != NULL)
+		job->Callback(job->Id,&(job->Result),job->User_Data);
+	pthread_mutex_lock(&(Job_Data.Mutex));
+	job->State = state;
+	pthread_cond_broadcast(&(Job_Data.Done_Condition));
+	if(job->Auto_Release)
+	{
+		if(job->Wait_Count > 0)
+			job->Release_Pending = TRUE;
+		else
+		{
+			Job_Remove(job);
+			free_job = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&(Job_Data.Mutex));
+	if(free_job)
+		Job_Free(job);
+}
+
+/**
+ * Find a job in the job list. The job mutex must be held.
+ * @param job_id The job id.
+ * @return The job, or NULL if no job with that id is in the list.
+ * @see #Job_Data
+ */
+static struct Job_Struct *Job_Find(int job_id)
+{
+	struct Job_Struct *job = NULL;
+
+	for(job = Job_Data.Job_List_Head; job != NULL; job = job->Next)
+	{
+		if(job->Id == job_id)
+			return job;
+	}
+	return NULL;
+}
+
+/**
+ * Find the first queued job in the job list. The job mutex must be held.
+ * @return The job, or NULL if no job is queued.
+ * @see #Job_Data
+ */
+static struct Job_Struct *Job_Find_Queued(void)
+{
+	struct Job_Struct *job = NULL;
+
+	for(job = Job_Data.Job_List_Head; job != NULL; job = job->Next)
+	{
+		if(job->State == DPRT_JOB_STATE_QUEUED)
+			return job;
+	}
+	return NULL;
+}
+
+/**
+ * Remove a job from the job list. The job mutex must be held.
+ * @param job The job.
+ * @see #Job_Data
+ */
+static void Job_Remove(struct Job_Struct *job)
+{
+	struct Job_Struct *previous_job = NULL;
+	struct Job_Struct *current_job = NULL;
+
+	for(current_job = Job_Data.Job_List_Head; current_job != NULL; current_job = current_job->Next)
+	{
+		if(current_job == job)
+		{
+			if(previous_job != NULL)
+				previous_job->Next = job->Next;
+			else
+				Job_Data.Job_List_Head = job->Next;
+			if(Job_Data.Job_List_Tail == job)
+				Job_Data.Job_List_Tail = previous_job;
+			job->Next = NULL;
+			return;
+		}
+		previous_job = current_job;
+	}
+}
+
+/**
+ * Free a job, and the memory it owns. The job must have been removed from the job list.
+ * @param job The job.
+ */
+static void Job_Free(struct Job_Struct *job)
+{
+	if(job->Input_Filename != NULL)
+		free(job->Input_Filename);
+	if(job->Result.Output_Filename != NULL)
+		free(job->Result.Output_Filename);
+	free(job);
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,564 @@
+/* dprt_mask.c
+** Derivation of bad pixel masks from master calibration frames.
+** $Header$
+*/
+/**
+ * dprt_mask.c derives a bad pixel mask for frames of a size from the master bias and flat of that size made by
+ * DpRt_Master_Make. In the master bias, pixels far from the frame's median (hot and dead pixels) are bad, as are
+ * whole columns whose median is far from the median of all the columns (hot and dead columns), distances being
+ * measured in standard deviations estimated from the median absolute deviation, so the defects being looked for do
+ * not inflate it. In a spectrally normalised master flat (see dprt_flat.c), pixels whose response is outside a range
+ * are bad. Only the data section is masked. The mask is written to
+ * &lt;directory_name&gt;/bpm_&lt;naxis_one&gt;x&lt;naxis_two&gt;.fits, non-zero for bad pixels, which the exposure
+ * reduction uses when no dprt.calibration.bpm_filename is configured. It is held in memory as a packed bitset
+ * by the calibration cache (see dprt_calibration.c).
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_combine.h"
+#include "dprt_overscan.h"
+#include "dprt_master.h"
+#include "dprt_mask.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The start of the filename of a derived bad pixel mask.
+ */
+#define MASK_FILENAME_PREFIX		("bpm_")
+/**
+ * The end of the filename of a derived bad pixel mask.
+ */
+#define MASK_FILENAME_SUFFIX		(".fits")
+/**
+ * The factor converting a median absolute deviation into a standard deviation, for normally distributed values.
+ */
+#define MASK_MAD_TO_SIGMA		(1.4826)
+/**
+ * The smallest standard deviation used, half a count (the quantisation of the raw frames), so a master bias
+ * whose pixels are mostly identical does not have every other pixel marked bad.
+ */
+#define MASK_MIN_SIGMA			(0.5)
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Mask_Read_Master(char *filename,int naxis_one,int naxis_two,float **data,int *normalise_window);
+static void Mask_Flag_Bias(struct DpRt_Mask_Parameter_Struct *parameters,float *bias,int naxis_one,
+			   float *scratch_list,float *column_list,unsigned char *bad_list,int *bad_count,
+			   int *column_count);
+static void Mask_Flag_Flat(struct DpRt_Mask_Parameter_Struct *parameters,float *flat,int naxis_one,
+			   unsigned char *bad_list,int *bad_count);
+static int Mask_Write(char *filename,unsigned char *bad_list,int naxis_one,int naxis_two,int bad_count,
+		      int column_count);
+static double Mask_Robust_Sigma(float *value_list,int count,float median);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the bad pixel mask derivation parameters from the configuration ("dprt.mask.auto", "dprt.mask.bias_sigma",
+ * "dprt.mask.column_sigma", "dprt.mask.flat_low" and "dprt.mask.flat_high"), and the data section of frames of a
+ * size (the "dprt.overscan.trimsec" section if "dprt.overscan" is set, otherwise the whole frame).
+ * @param naxis_one The number of columns in the frames.
+ * @param naxis_two The number of rows in the frames.
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_overscan.html#DpRt_Overscan_Get
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Mask_Get_Parameters(int naxis_one,int naxis_two,struct DpRt_Mask_Parameter_Struct *parameters)
+{
+	struct DpRt_Overscan_Struct overscan;
+
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 2200;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Boolean("dprt.mask.auto",&(parameters->Enabled)))||
+	   (!DpRt_Config_Get_Double("dprt.mask.bias_sigma",&(parameters->Bias_Sigma)))||
+	   (!DpRt_Config_Get_Double("dprt.mask.column_sigma",&(parameters->Column_Sigma)))||
+	   (!DpRt_Config_Get_Double("dprt.mask.flat_low",&(parameters->Flat_Low)))||
+	   (!DpRt_Config_Get_Double("dprt.mask.flat_high",&(parameters->Flat_High))))
+		return FALSE;
+	if((parameters->Bias_Sigma <= 0.0)||(parameters->Column_Sigma <= 0.0)||
+	   (parameters->Flat_Low >= parameters->Flat_High))
+	{
+		DpRt_Error_Number = 2201;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Get_Parameters:Illegal thresholds (bias %.2f,column %.2f,"
+			"flat %.2f..%.2f).\n",parameters->Bias_Sigma,parameters->Column_Sigma,parameters->Flat_Low,
+			parameters->Flat_High);
+		return FALSE;
+	}
+	if(!DpRt_Overscan_Get("","",naxis_one,naxis_two,&overscan))
+		return FALSE;
+	parameters->Start_X = overscan.Trim_Start_X;
+	parameters->End_X = overscan.Trim_End_X;
+	parameters->Start_Y = overscan.Trim_Start_Y;
+	parameters->End_Y = overscan.Trim_End_Y;
+	return TRUE;
+}
+
+/**
+ * Get the filename of the bad pixel mask of a size derived in a directory by DpRt_Mask_Make:
+ * &lt;directory_name&gt;/bpm_&lt;naxis_one&gt;x&lt;naxis_two&gt;.fits.
+ * @param directory_name The directory the mask is made in.
+ * @param naxis_one The number of columns in the mask.
+ * @param naxis_two The number of rows in the mask.
+ * @param filename A string to store the filename in.
+ * @param filename_length The length of the filename string, including the terminator.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (or the filename was too long).
+ * @see #MASK_FILENAME_PREFIX
+ * @see #MASK_FILENAME_SUFFIX
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Mask_Get_Filename(char *directory_name,int naxis_one,int naxis_two,char *filename,size_t filename_length)
+{
+	int length;
+
+	if((directory_name == NULL)||(filename == NULL))
+	{
+		DpRt_Error_Number = 2202;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Get_Filename:Illegal arguments.\n");
+		return FALSE;
+	}
+	length = snprintf(filename,filename_length,"%s/%s%dx%d%s",directory_name,MASK_FILENAME_PREFIX,naxis_one,
+			  naxis_two,MASK_FILENAME_SUFFIX);
+	if((length < 0)||(((size_t)length) >= filename_length))
+	{
+		DpRt_Error_Number = 2202;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Get_Filename:Mask filename in %.128s too long.\n",directory_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Derive the bad pixel mask of a size from the master bias and flat of that size in a directory, and write it to
+ * the directory (see DpRt_Mask_Get_Filename). Either master may be missing, and a master flat is only used if it has
+ * been spectrally normalised (it's NORMWIN keyword is non-zero), as the response of an unnormalised flat follows the
+ * lamp spectrum and the slit. If neither master can be used, no mask is written.
+ * @param directory_name The directory containing the masters, and to put the mask in.
+ * @param naxis_one The number of columns in the masters.
+ * @param naxis_two The number of rows in the masters.
+ * @return The routine returns TRUE if it succeeded (or there was nothing to derive a mask from), and FALSE if it
+ *         failed.
+ * @see #DpRt_Mask_Get_Parameters
+ * @see #DpRt_Mask_Get_Filename
+ * @see #Mask_Read_Master
+ * @see #Mask_Flag_Bias
+ * @see #Mask_Flag_Flat
+ * @see #Mask_Write
+ * @see dprt_master.html#DpRt_Master_Get_Filename
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Mask_Make(char *directory_name,int naxis_one,int naxis_two)
+{
+	struct DpRt_Mask_Parameter_Struct parameters;
+	char filename[DPRT_MASK_FILENAME_LENGTH];
+	unsigned char *bad_list = NULL;
+	float *bias = NULL;
+	float *flat = NULL;
+	float *scratch_list = NULL;
+	float *column_list = NULL;
+	size_t pixel_count;
+	int normalise_window,bad_count,column_count,retval;
+
+	if((directory_name == NULL)||(naxis_one < 1)||(naxis_two < 1))
+	{
+		DpRt_Error_Number = 2203;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Make:Illegal arguments (%dx%d).\n",naxis_one,naxis_two);
+		return FALSE;
+	}
+	if(!DpRt_Mask_Get_Parameters(naxis_one,naxis_two,&parameters))
+		return FALSE;
+	if((!DpRt_Master_Get_Filename(directory_name,DPRT_MASTER_TYPE_BIAS,naxis_one,naxis_two,filename,
+				      DPRT_MASK_FILENAME_LENGTH))||
+	   (!Mask_Read_Master(filename,naxis_one,naxis_two,&bias,&normalise_window)))
+		return FALSE;
+	if((!DpRt_Master_Get_Filename(directory_name,DPRT_MASTER_TYPE_FLAT,naxis_one,naxis_two,filename,
+				      DPRT_MASK_FILENAME_LENGTH))||
+	   (!Mask_Read_Master(filename,naxis_one,naxis_two,&flat,&normalise_window)))
+	{
+		if(bias != NULL)
+			free(bias);
+		return FALSE;
+	}
+	if((flat != NULL)&&(normalise_window < 1))
+	{
+		fprintf(stdout,"DpRt_Mask_Make:%s is not spectrally normalised:Not using it.\n",filename);
+		free(flat);
+		flat = NULL;
+	}
+	if((bias == NULL)&&(flat == NULL))
+	{
+		fprintf(stdout,"DpRt_Mask_Make:No usable %dx%d masters in %s:Not making a bad pixel mask.\n",
+			naxis_one,naxis_two,directory_name);
+		return TRUE;
+	}
+	pixel_count = ((size_t)naxis_one)*((size_t)naxis_two);
+	bad_list = (unsigned char *)calloc(pixel_count,sizeof(unsigned char));
+	scratch_list = (float *)malloc(pixel_count*sizeof(float));
+	column_list = (float *)malloc(((size_t)naxis_one)*sizeof(float));
+	retval = (bad_list != NULL)&&(scratch_list != NULL)&&(column_list != NULL);
+	if(retval == FALSE)
+	{
+		DpRt_Error_Number = 2204;
+		sprintf(DpRt_Error_String,"DpRt_Mask_Make:Failed to allocate %dx%d mask.\n",naxis_one,naxis_two);
+	}
+	bad_count = 0;
+	column_count = 0;
+	if(retval && (parameters.Start_X < parameters.End_X)&&(parameters.Start_Y < parameters.End_Y))
+	{
+		if(bias != NULL)
+		{
+			Mask_Flag_Bias(&parameters,bias,naxis_one,scratch_list,column_list,bad_list,&bad_count,
+				       &column_count);
+		}
+		if(flat != NULL)
+			Mask_Flag_Flat(&parameters,flat,naxis_one,bad_list,&bad_count);
+	}
+	if(retval)
+		retval = DpRt_Mask_Get_Filename(directory_name,naxis_one,naxis_two,filename,DPRT_MASK_FILENAME_LENGTH);
+	if(retval)
+		retval = Mask_Write(filename,bad_list,naxis_one,naxis_two,bad_count,column_count);
+	if(retval)
+	{
+		fprintf(stdout,"DpRt_Mask_Make:Made %s:%d bad pixels (%d bad columns) from the master%s%s.\n",filename,
+			bad_count,column_count,(bias != NULL) ? " bias" : "",(flat != NULL) ? " flat" : "");
+	}
+	if(bias != NULL)
+		free(bias);
+	if(flat != NULL)
+		free(flat);
+	if(bad_list != NULL)
+		free(bad_list);
+	if(scratch_list != NULL)
+		free(scratch_list);
+	if(column_list != NULL)
+		free(column_list);
+	return retval;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Read a master frame made by DpRt_Master_Make into memory.
+ * @param filename The filename of the master.
+ * @param naxis_one The number of columns the master must have.
+ * @param naxis_two The number of rows the master must have.
+ * @param data The address of a float pointer to store the (allocated) master, or NULL if the file does not exist.
+ * @param normalise_window The address of an integer to store the master's NORMWIN keyword in, 0 if it has none.
+ * @return The routine returns TRUE if it succeeded (or the file does not exist), and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Mask_Read_Master(char *filename,int naxis_one,int naxis_two,float **data,int *normalise_window)
+{
+	struct stat file_stat;
+	fitsfile *fp = NULL;
+	size_t pixel_count;
+	int naxis,file_naxis_one,file_naxis_two,status = 0;
+
+	(*data) = NULL;
+	(*normalise_window) = 0;
+	if(stat(filename,&file_stat) != 0)
+	{
+		if(errno == ENOENT)
+			return TRUE;
+		DpRt_Error_Number = 2205;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:Failed to stat %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_open_file(&fp,filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 2205;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:Failed to open %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_read_key(fp,TINT,"NAXIS",&naxis,NULL,&status)||
+	   fits_read_key(fp,TINT,"NAXIS1",&file_naxis_one,NULL,&status)||
+	   fits_read_key(fp,TINT,"NAXIS2",&file_naxis_two,NULL,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 2206;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:Failed to read the size of %.200s.\n",filename);
+		return FALSE;
+	}
+	if((naxis != 2)||(file_naxis_one != naxis_one)||(file_naxis_two != naxis_two))
+	{
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 2206;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:%.200s is %dx%d (%d axes), not %dx%d.\n",filename,
+			file_naxis_one,file_naxis_two,naxis,naxis_one,naxis_two);
+		return FALSE;
+	}
+	if(fits_read_key(fp,TINT,"NORMWIN",normalise_window,NULL,&status))
+	{
+		(*normalise_window) = 0;
+		status = 0;
+		fits_clear_errmsg();
+	}
+	pixel_count = ((size_t)naxis_one)*((size_t)naxis_two);
+	(*data) = (float *)malloc(pixel_count*sizeof(float));
+	if((*data) == NULL)
+	{
+		fits_close_file(fp,&status);
+		DpRt_Error_Number = 2204;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:Failed to allocate %dx%d frame for %.200s.\n",naxis_one,
+			naxis_two,filename);
+		return FALSE;
+	}
+	if(fits_read_img(fp,TFLOAT,1,(LONGLONG)pixel_count,NULL,(*data),NULL,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		free((*data));
+		(*data) = NULL;
+		DpRt_Error_Number = 2207;
+		sprintf(DpRt_Error_String,"Mask_Read_Master:Failed to read %.200s.\n",filename);
+		return FALSE;
+	}
+	fits_close_file(fp,&status);
+	return TRUE;
+}
+
+/**
+ * Mark the bad pixels and columns of the data section of a master bias. A pixel is bad if it is more than
+ * Bias_Sigma standard deviations from the median of the data section. The median of each column of the data section
+ * is then found, and a column is bad if it's median is more than Column_Sigma standard deviations (of the column
+ * medians) from the median of the column medians. Standard deviations are estimated from the median absolute
+ * deviation, and are at least MASK_MIN_SIGMA.
+ * @param parameters The mask parameters, holding the thresholds and the data section.
+ * @param bias The master bias.
+ * @param naxis_one The number of columns in the master bias.
+ * @param scratch_list A list of at least as many values as there are pixels in the master bias, used to find
+ *        medians.
+ * @param column_list A list of at least naxis_one values, used to hold the column medians.
+ * @param bad_list The mask, a byte for each pixel, set to one for bad pixels.
+ * @param bad_count The address of an integer, incremented for each pixel newly marked bad.
+ * @param column_count The address of an integer, incremented for each bad column.
+ * @see dprt_combine.html#DpRt_Combine_Median
+ * @see #Mask_Robust_Sigma
+ */
+static void Mask_Flag_Bias(struct DpRt_Mask_Parameter_Struct *parameters,float *bias,int naxis_one,
+			   float *scratch_list,float *column_list,unsigned char *bad_list,int *bad_count,
+			   int *column_count)
+{
+	size_t index;
+	double sigma,limit;
+	float median;
+	int width,height,count,x,y;
+
+	width = parameters->End_X-parameters->Start_X;
+	height = parameters->End_Y-parameters->Start_Y;
+	/* hot and dead pixels */
+	count = 0;
+	for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+	{
+		for(x=parameters->Start_X;x<parameters->End_X;x++)
+			scratch_list[count++] = bias[(((size_t)y)*((size_t)naxis_one))+x];
+	}
+	median = DpRt_Combine_Median(scratch_list,count);
+	count = 0;
+	for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+	{
+		for(x=parameters->Start_X;x<parameters->End_X;x++)
+			scratch_list[count++] = bias[(((size_t)y)*((size_t)naxis_one))+x];
+	}
+	sigma = Mask_Robust_Sigma(scratch_list,count,median);
+	limit = parameters->Bias_Sigma*sigma;
+	for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+	{
+		for(x=parameters->Start_X;x<parameters->End_X;x++)
+		{
+			index = (((size_t)y)*((size_t)naxis_one))+x;
+			if((fabs(bias[index]-median) > limit)&&(bad_list[index] == 0))
+			{
+				bad_list[index] = 1;
+				(*bad_count)++;
+			}
+		}
+	}
+	/* hot and dead columns */
+	for(x=parameters->Start_X;x<parameters->End_X;x++)
+	{
+		for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+			scratch_list[y-parameters->Start_Y] = bias[(((size_t)y)*((size_t)naxis_one))+x];
+		column_list[x-parameters->Start_X] = DpRt_Combine_Median(scratch_list,height);
+	}
+	memcpy(scratch_list,column_list,width*sizeof(float));
+	median = DpRt_Combine_Median(scratch_list,width);
+	memcpy(scratch_list,column_list,width*sizeof(float));
+	sigma = Mask_Robust_Sigma(scratch_list,width,median);
+	limit = parameters->Column_Sigma*sigma;
+	for(x=parameters->Start_X;x<parameters->End_X;x++)
+	{
+		if(fabs(column_list[x-parameters->Start_X]-median) <= limit)
+			continue;
+		(*column_count)++;
+		for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+		{
+			index = (((size_t)y)*((size_t)naxis_one))+x;
+			if(bad_list[index] == 0)
+			{
+				bad_list[index] = 1;
+				(*bad_count)++;
+			}
+		}
+	}
+}
+
+/**
+ * Mark the bad pixels of the data section of a spectrally normalised master flat: those whose response is below
+ * Flat_Low or above Flat_High, or is not a number.
+ * @param parameters The mask parameters, holding the thresholds and the data section.
+ * @param flat The normalised master flat.
+ * @param naxis_one The number of columns in the master flat.
+ * @param bad_list The mask, a byte for each pixel, set to one for bad pixels.
+ * @param bad_count The address of an integer, incremented for each pixel newly marked bad.
+ */
+static void Mask_Flag_Flat(struct DpRt_Mask_Parameter_Struct *parameters,float *flat,int naxis_one,
+			   unsigned char *bad_list,int *bad_count)
+{
+	size_t index;
+	float low,high;
+	int x,y;
+
+	low = (float)(parameters->Flat_Low);
+	high = (float)(parameters->Flat_High);
+	for(y=parameters->Start_Y;y<parameters->End_Y;y++)
+	{
+		for(x=parameters->Start_X;x<parameters->End_X;x++)
+		{
+			index = (((size_t)y)*((size_t)naxis_one))+x;
+			/* the comparisons are written so a NaN response is bad */
+			if((!((flat[index] >= low)&&(flat[index] <= high)))&&(bad_list[index] == 0))
+			{
+				bad_list[index] = 1;
+				(*bad_count)++;
+			}
+		}
+	}
+}
+
+/**
+ * Write a bad pixel mask to a FITS file, as an 8-bit image, one for bad pixels. Any existing file is overwritten,
+ * and if the routine fails no file is left behind.
+ * @param filename The filename to write.
+ * @param bad_list The mask, a byte for each pixel.
+ * @param naxis_one The number of columns in the mask.
+ * @param naxis_two The number of rows in the mask.
+ * @param bad_count The number of bad pixels, written to the NBADPIX keyword.
+ * @param column_count The number of bad columns, written to the NBADCOL keyword.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Mask_Write(char *filename,unsigned char *bad_list,int naxis_one,int naxis_two,int bad_count,
+		      int column_count)
+{
+	char fits_filename[DPRT_MASK_FILENAME_LENGTH+1];
+	fitsfile *fp = NULL;
+	long axes_list[2];
+	int status = 0;
+
+	snprintf(fits_filename,DPRT_MASK_FILENAME_LENGTH+1,"!%s",filename);
+	axes_list[0] = naxis_one;
+	axes_list[1] = naxis_two;
+	if(fits_create_file(&fp,fits_filename,&status)||
+	   fits_create_img(fp,BYTE_IMG,2,axes_list,&status)||
+	   fits_update_key(fp,TSTRING,"OBSTYPE","BPM","Bad pixel mask, non-zero for bad pixels",&status)||
+	   fits_update_key(fp,TINT,"NBADPIX",&bad_count,"Number of bad pixels",&status)||
+	   fits_update_key(fp,TINT,"NBADCOL",&column_count,"Number of bad columns",&status))
+	{
+		fits_report_error(stderr,status);
+		if(fp != NULL)
+		{
+			status = 0;
+			fits_close_file(fp,&status);
+			remove(filename);
+		}
+		DpRt_Error_Number = 2208;
+		sprintf(DpRt_Error_String,"Mask_Write:Failed to create %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_write_img(fp,TBYTE,1,((LONGLONG)naxis_one)*((LONGLONG)naxis_two),bad_list,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		remove(filename);
+		DpRt_Error_Number = 2209;
+		sprintf(DpRt_Error_String,"Mask_Write:Failed to write %.200s.\n",filename);
+		return FALSE;
+	}
+	if(fits_close_file(fp,&status))
+	{
+		fits_report_error(stderr,status);
+		remove(filename);
+		DpRt_Error_Number = 2210;
+		sprintf(DpRt_Error_String,"Mask_Write:Failed to close %.200s.\n",filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Estimate the standard deviation of a list of values from their median absolute deviation.
+ * @param value_list The values, which are overwritten.
+ * @param count The number of values.
+ * @param median The median of the values.
+ * @return The standard deviation, at least MASK_MIN_SIGMA.
+ * @see #MASK_MAD_TO_SIGMA
+ * @see #MASK_MIN_SIGMA
+ * @see dprt_combine.html#DpRt_Combine_Median
+ */
+static double Mask_Robust_Sigma(float *value_list,int count,float median)
+{
+	double sigma;
+	int i;
+
+	for(i=0;i<count;i++)
+		value_list[i] = fabsf(value_list[i]-median);
+	sigma = MASK_MAD_TO_SIGMA*DpRt_Combine_Median(value_list,count);
+	if(sigma < MASK_MIN_SIGMA)
+		sigma = MASK_MIN_SIGMA;
+	return sigma;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,1202 @@
+/* dprt_master.c
+** Combine bias and flat frames into master calibration frames.
+** $Header$
+*/
+/**
+ * dprt_master.c is a native stacking engine for master bias and flat frames. DpRt_Master_Make scans a directory
+ * for 16-bit frames of the right OBSTYPE, groups them by size, and combines each group with DpRt_Master_Combine.
+ * The frames are combined (mean, median or kappa-sigma clipped mean) in bands of rows. Each band of every frame is
+ * read into a per-thread band buffer leased from the buffer pool, combined, and written to the master, so the
+ * memory used is bounded by the band size times the number of frames (dprt.master.max_mbytes in total), rather
+ * than by the size of the whole stack. Bands are spread across the thread pool. CFITSIO calls are serialised
+ * on a mutex, as the frames' fitsfile handles are shared between the threads. Master flats have the lamp spectrum
+ * removed from each band as it is combined (see dprt_flat.c).
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_config.h"
+#include "dprt_thread_pool.h"
+#include "dprt_buffer_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_combine.h"
+#include "dprt_accumulate.h"
+#include "dprt_flat.h"
+#include "dprt_mask.h"
+#include "dprt_master.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * Master frames are only made from FITS files with the bits per pixel of this value.
+ */
+#define MASTER_BITPIX			(16)
+/**
+ * Master frames are only made from FITS files with this number of axes.
+ */
+#define MASTER_NAXIS			(2)
+/**
+ * Files in the directory starting with this prefix are master frames, and are not combined.
+ */
+#define MASTER_FILENAME_PREFIX		("master_")
+/**
+ * Only files in the directory ending with this suffix are combined.
+ */
+#define MASTER_FILENAME_SUFFIX		(".fits")
+/**
+ * The length of the filename strings used by this module.
+ */
+#define MASTER_FILENAME_LENGTH		(1024)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure describing a candidate frame found by DpRt_Master_Make.
+ * <dl>
+ * <dt>Filename</dt> <dd>The frame's filename.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * </dl>
+ */
+struct Master_Frame_Struct
+{
+	char Filename[MASTER_FILENAME_LENGTH];
+	int Naxis_One;
+	int Naxis_Two;
+};
+
+/**
+ * Structure holding the state of one DpRt_Master_Combine call, shared by it's band tasks.
+ * <dl>
+ * <dt>Type</dt> <dd>The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.</dd>
+ * <dt>Combine_Parameters</dt> <dd>The combine method and it's parameters.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of frames being combined.</dd>
+ * <dt>Fits_List</dt> <dd>The open frames.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frames.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frames.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in a band.</dd>
+ * <dt>Band_Buffer_List</dt> <dd>Per thread buffers for a band of every frame (Frame_Count*Band_Rows*Naxis_One
+ *     pixels, frame after frame).</dd>
+ * <dt>Output_Buffer_List</dt> <dd>Per thread buffers for a band of the master (Band_Rows*Naxis_One pixels).</dd>
+ * <dt>Scale_List</dt> <dd>The value each frame's pixels are multiplied by before combining: 1 for biases,
+ *     one over the frame's mean for flats.</dd>
+ * <dt>Sum_List</dt> <dd>Flats: the sum of each band of each frame (Band_Count*Frame_Count), used to
+ *     compute the frame means.</dd>
+ * <dt>Flat_Parameters</dt> <dd>Flats: how the lamp spectrum is removed from each band of the master. Enabled is
+ *     FALSE for biases.</dd>
+ * <dt>Output_Fits</dt> <dd>The master frame being written.</dd>
+ * <dt>Context</dt> <dd>The context the combine is running in, whose abort flag is checked by each band.</dd>
+ * <dt>Fits_Mutex</dt> <dd>Mutex serialising the CFITSIO calls of the band tasks.</dd>
+ * <dt>Aborted</dt> <dd>A boolean, set when a band sees the abort flag.</dd>
+ * <dt>Failed</dt> <dd>A boolean, set when a band fails.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the first band to fail.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the first band to fail.</dd>
+ * </dl>
+ */
+struct Master_Combine_Struct
+{
+	int Type;
+	struct DpRt_Combine_Parameter_Struct Combine_Parameters;
+	int Frame_Count;
+	fitsfile **Fits_List;
+	int Naxis_One;
+	int Naxis_Two;
+	int Band_Rows;
+	unsigned short **Band_Buffer_List;
+	float **Output_Buffer_List;
+	double *Scale_List;
+	unsigned long long *Sum_List;
+	struct DpRt_Flat_Parameter_Struct Flat_Parameters;
+	fitsfile *Output_Fits;
+	DpRt_Context *Context;
+	pthread_mutex_t Fits_Mutex;
+	volatile int Aborted;
+	volatile int Failed;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The names of the combine methods, indexed by method, written to the COMBMETH keyword of master frames.
+ */
+static char *Master_Method_Name_List[] = {"mean","median","sigma_clip","minmax"};
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Master_Scan_Directory(char *directory_name,char *obstype,struct Master_Frame_Struct **frame_list,
+				 int *frame_count);
+static int Master_Frame_Compare(const void *a,const void *b);
+static int Master_Make_Accumulated(char *directory_name,int type,char *type_string,int method,int min_frames,
+				   int *made_count);
+static int Master_Get_Combine_Parameters(int method,struct DpRt_Combine_Parameter_Struct *parameters);
+static int Master_Create_Output(char *output_filename,int type,int method,int frame_count,int naxis_one,
+				int naxis_two,int normalise_window,fitsfile **fp);
+static int Master_Open_Frames(char **filename_list,struct Master_Combine_Struct *combine);
+static void Master_Close_Frames(struct Master_Combine_Struct *combine);
+static int Master_Sum_Band(void *user_data,int band_index,int thread_index);
+static int Master_Combine_Band(void *user_data,int band_index,int thread_index);
+static int Master_Read_Band(struct Master_Combine_Struct *combine,int thread_index,int start_y,int rows);
+static void Master_Band_Error(struct Master_Combine_Struct *combine,int error_number,char *error_string);
+static void Master_Make_Mask(char *directory_name,int naxis_one,int naxis_two);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Make master frames of the specified type from the frames in a directory. The directory is scanned for
+ * 16-bit, 2 axis FITS files whose OBSTYPE contains the dprt.master.bias.obstype or dprt.master.flat.obstype
+ * string. The frames are grouped by size, and each group of at least dprt.master.min_frames frames is combined,
+ * using the dprt.master.bias.method or dprt.master.flat.method method, into
+ * &lt;directory_name&gt;/master_&lt;bias|flat&gt;_&lt;naxis1&gt;x&lt;naxis2&gt;.fits.
+ * If dprt.master.accumulate is TRUE, masters are first made from the frames accumulated as they were reduced
+ * by DpRt_Calibrate_Reduce (see Master_Make_Accumulated), and the directory is only scanned if no master could
+ * be made that way. After each master is made, the bad pixel mask of it's size is re-derived (see Master_Make_Mask).
+ * @param directory_name The directory containing the frames.
+ * @param type The type of master to make, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed, or no master frame could be made.
+ * @see #MASTER_FILENAME_PREFIX
+ * @see #DPRT_MASTER_MAX_FRAME_COUNT
+ * @see #Master_Make_Accumulated
+ * @see #Master_Make_Mask
+ * @see #Master_Scan_Directory
+ * @see #DpRt_Master_Get_Filename
+ * @see #DpRt_Master_Combine
+ * @see #DpRt_Master_Method_From_String
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Make(char *directory_name,int type)
+{
+	struct Master_Frame_Struct *frame_list = NULL;
+	char *filename_list[DPRT_MASTER_MAX_FRAME_COUNT];
+	char output_filename[MASTER_FILENAME_LENGTH];
+	char *obstype = NULL;
+	char *method_string = NULL;
+	char *type_string = NULL;
+	int frame_count,min_frames,method,start_index,end_index,group_count,made_count,accumulate,i,retval;
+
+	if(directory_name == NULL)
+	{
+		DpRt_Error_Number = 1013;
+		sprintf(DpRt_Error_String,"DpRt_Master_Make:directory_name was NULL.\n");
+		return FALSE;
+	}
+	if(type == DPRT_MASTER_TYPE_BIAS)
+	{
+		type_string = "bias";
+		retval = DpRt_Config_Get_String("dprt.master.bias.obstype",&obstype);
+		if(retval)
+			retval = DpRt_Config_Get_String("dprt.master.bias.method",&method_string);
+	}
+	else if(type == DPRT_MASTER_TYPE_FLAT)
+	{
+		type_string = "flat";
+		retval = DpRt_Config_Get_String("dprt.master.flat.obstype",&obstype);
+		if(retval)
+			retval = DpRt_Config_Get_String("dprt.master.flat.method",&method_string);
+	}
+	else
+	{
+		DpRt_Error_Number = 1013;
+		sprintf(DpRt_Error_String,"DpRt_Master_Make:Illegal type %d.\n",type);
+		return FALSE;
+	}
+	if(retval)
+		retval = DpRt_Config_Get_Integer("dprt.master.min_frames",&min_frames);
+	if(retval)
+		retval = DpRt_Master_Method_From_String(method_string,&method);
+	if(method_string != NULL)
+		free(method_string);
+	if(retval)
+		retval = DpRt_Config_Get_Boolean("dprt.master.accumulate",&accumulate);
+	if(retval && (min_frames < 1))
+		min_frames = 1;
+	/* make masters from the frames accumulated as they were reduced, if there are enough of them */
+	if(retval && accumulate)
+	{
+		retval = Master_Make_Accumulated(directory_name,type,type_string,method,min_frames,&made_count);
+		if(retval && (made_count > 0))
+		{
+			free(obstype);
+			return TRUE;
+		}
+		if(retval)
+		{
+			fprintf(stdout,"DpRt_Master_Make:Not enough accumulated %s frames:Scanning %s.\n",type_string,
+				directory_name);
+		}
+	}
+	if(retval)
+		retval = Master_Scan_Directory(directory_name,obstype,&frame_list,&frame_count);
+	if(obstype != NULL)
+		free(obstype);
+	if(retval == FALSE)
+		return FALSE;
+	/* combine each group of frames of the same size */
+	made_count = 0;
+	start_index = 0;
+	while(start_index < frame_count)
+	{
+		end_index = start_index+1;
+		while((end_index < frame_count)&&
+		      (frame_list[end_index].Naxis_One == frame_list[start_index].Naxis_One)&&
+		      (frame_list[end_index].Naxis_Two == frame_list[start_index].Naxis_Two))
+			end_index++;
+		group_count = end_index-start_index;
+		if(group_count < min_frames)
+		{
+			fprintf(stdout,"DpRt_Master_Make:Only %d %s frames of size %dx%d:Not making a master.\n",
+				group_count,type_string,frame_list[start_index].Naxis_One,
+				frame_list[start_index].Naxis_Two);
+		}
+		else
+		{
+			if(group_count > DPRT_MASTER_MAX_FRAME_COUNT)
+			{
+				fprintf(stdout,"DpRt_Master_Make:Using the first %d of %d %s frames of size %dx%d.\n",
+					DPRT_MASTER_MAX_FRAME_COUNT,group_count,type_string,
+					frame_list[start_index].Naxis_One,frame_list[start_index].Naxis_Two);
+				group_count = DPRT_MASTER_MAX_FRAME_COUNT;
+			}
+			for(i=0;i<group_count;i++)
+				filename_list[i] = frame_list[start_index+i].Filename;
+			if(!DpRt_Master_Get_Filename(directory_name,type,frame_list[start_index].Naxis_One,
+						     frame_list[start_index].Naxis_Two,output_filename,
+						     MASTER_FILENAME_LENGTH))
+			{
+				free(frame_list);
+				return FALSE;
+			}
+			if(!DpRt_Master_Combine(filename_list,group_count,type,method,output_filename))
+			{
+				free(frame_list);
+				return FALSE;
+			}
+			made_count++;
+			Master_Make_Mask(directory_name,frame_list[start_index].Naxis_One,
+					 frame_list[start_index].Naxis_Two);
+		}
+		start_index = end_index;
+	}
+	if(frame_list != NULL)
+		free(frame_list);
+	if(made_count == 0)
+	{
+		DpRt_Error_Number = 1016;
+		sprintf(DpRt_Error_String,"DpRt_Master_Make(%.150s):Not enough %s frames to make a master.\n",
+			directory_name,type_string);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Combine a list of 16-bit, 2 axis frames of the same size into a 32-bit floating point master frame.
+ * The frames are combined in bands of rows, spread across the thread pool. The band size is chosen so that the
+ * band buffers of all the threads fit in dprt.master.max_mbytes (but is at least one row, and at most
+ * the band rows used for reductions). Flats are normalised by their mean before being combined, which takes
+ * an extra pass over the frames, so the master flat has a mean of about one. If dprt.master.flat.normalise is set,
+ * the lamp spectrum is then removed from each band of a master flat, by the band's own task, before it is written
+ * (see DpRt_Flat_Normalise_Rows). NFRAMES, COMBMETH and OBSTYPE (and for flats NORMWIN) keywords are written to the
+ * master. If the routine fails, no master is left behind.
+ * @param filename_list The list of frames to combine.
+ * @param frame_count The number of frames in the list, between 1 and DPRT_MASTER_MAX_FRAME_COUNT.
+ * @param type The type of master to make, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param method The combine method, DPRT_MASTER_METHOD_MEAN, DPRT_MASTER_METHOD_MEDIAN or
+ *        DPRT_MASTER_METHOD_SIGMA_CLIP or DPRT_MASTER_METHOD_MINMAX.
+ * @param output_filename The filename of the master frame. Any existing file is overwritten.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Master_Combine_Struct
+ * @see #Master_Get_Combine_Parameters
+ * @see #Master_Open_Frames
+ * @see #Master_Create_Output
+ * @see #Master_Sum_Band
+ * @see #Master_Combine_Band
+ * @see dprt_flat.html#DpRt_Flat_Get_Parameters
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Get_Thread_Count
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Lease
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Combine(char **filename_list,int frame_count,int type,int method,char *output_filename)
+{
+	struct Master_Combine_Struct combine;
+	unsigned long long sum;
+	size_t band_bytes,output_bytes,thread_bytes;
+	void *buffer = NULL;
+	int thread_count,band_count,max_mbytes,band_rows,created = FALSE,i,j,retval,status = 0;
+
+	if((filename_list == NULL)||(output_filename == NULL)||(frame_count < 1)||
+	   (frame_count > DPRT_MASTER_MAX_FRAME_COUNT))
+	{
+		DpRt_Error_Number = 1000;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine:Illegal arguments (%d frames).\n",frame_count);
+		return FALSE;
+	}
+	if(((type != DPRT_MASTER_TYPE_BIAS)&&(type != DPRT_MASTER_TYPE_FLAT))||
+	   (method < DPRT_MASTER_METHOD_MEAN)||(method > DPRT_MASTER_METHOD_MINMAX))
+	{
+		DpRt_Error_Number = 1001;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine:Illegal type %d or method %d.\n",type,method);
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Integer("dprt.master.max_mbytes",&max_mbytes))||
+	   (!Master_Get_Combine_Parameters(method,&(combine.Combine_Parameters))))
+		return FALSE;
+	combine.Type = type;
+	combine.Frame_Count = frame_count;
+	combine.Output_Fits = NULL;
+	combine.Context = DpRt_Context_Get_Current();
+	combine.Aborted = FALSE;
+	combine.Failed = FALSE;
+	combine.Error_Number = 0;
+	combine.Error_String[0] = '\0';
+	thread_count = DpRt_Thread_Pool_Get_Thread_Count();
+	/* allocate lists */
+	combine.Fits_List = (fitsfile **)calloc(frame_count,sizeof(fitsfile *));
+	combine.Scale_List = (double *)malloc(frame_count*sizeof(double));
+	combine.Band_Buffer_List = (unsigned short **)calloc(thread_count,sizeof(unsigned short *));
+	combine.Output_Buffer_List = (float **)calloc(thread_count,sizeof(float *));
+	combine.Sum_List = NULL;
+	if((combine.Fits_List == NULL)||(combine.Scale_List == NULL)||(combine.Band_Buffer_List == NULL)||
+	   (combine.Output_Buffer_List == NULL))
+	{
+		DpRt_Error_Number = 1005;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine:Failed to allocate lists (%d frames,%d threads).\n",
+			frame_count,thread_count);
+		retval = FALSE;
+		goto tidy;
+	}
+	for(i=0;i<frame_count;i++)
+		combine.Scale_List[i] = 1.0;
+	/* open and check the frames */
+	if(!Master_Open_Frames(filename_list,&combine))
+	{
+		retval = FALSE;
+		goto tidy;
+	}
+	/* flats: how the lamp spectrum is removed */
+	combine.Flat_Parameters.Enabled = FALSE;
+	if((type == DPRT_MASTER_TYPE_FLAT)&&
+	   (!DpRt_Flat_Get_Parameters(combine.Naxis_One,combine.Naxis_Two,&(combine.Flat_Parameters))))
+	{
+		retval = FALSE;
+		goto tidy;
+	}
+	/* choose a band size so all the threads' band buffers fit in max_mbytes */
+	band_rows = DpRt_Reduce_Get_Band_Rows();
+	thread_bytes = ((size_t)thread_count)*((size_t)combine.Naxis_One)*
+		((((size_t)frame_count)*sizeof(unsigned short))+sizeof(float));
+	if((max_mbytes > 0)&&(thread_bytes > 0)&&
+	   ((((size_t)max_mbytes)*1024*1024)/thread_bytes < (size_t)band_rows))
+		band_rows = (int)((((size_t)max_mbytes)*1024*1024)/thread_bytes);
+	if(band_rows > combine.Naxis_Two)
+		band_rows = combine.Naxis_Two;
+	if(band_rows < 1)
+		band_rows = 1;
+	combine.Band_Rows = band_rows;
+	band_count = (combine.Naxis_Two+band_rows-1)/band_rows;
+	fprintf(stdout,"DpRt_Master_Combine(%s):Combining %d frames of %dx%d in %d bands of %d rows.\n",
+		output_filename,frame_count,combine.Naxis_One,combine.Naxis_Two,band_count,band_rows);
+	/* lease per thread band buffers */
+	band_bytes = ((size_t)frame_count)*((size_t)band_rows)*((size_t)combine.Naxis_One)*sizeof(unsigned short);
+	output_bytes = ((size_t)band_rows)*((size_t)combine.Naxis_One)*sizeof(float);
+	/* keep the output part of the buffer aligned */
+	band_bytes = (band_bytes+DPRT_BUFFER_POOL_ALIGNMENT-1)&(~((size_t)(DPRT_BUFFER_POOL_ALIGNMENT-1)));
+	for(i=0;i<thread_count;i++)
+	{
+		if(!DpRt_Buffer_Pool_Lease(band_bytes+output_bytes,&buffer))
+		{
+			fprintf(stderr,"%s",DpRt_Error_String);
+			DpRt_Error_Number = 1006;
+			sprintf(DpRt_Error_String,"DpRt_Master_Combine:Failed to lease band buffer %d (%lu bytes).\n",
+				i,(unsigned long)(band_bytes+output_bytes));
+			retval = FALSE;
+			goto tidy;
+		}
+		combine.Band_Buffer_List[i] = (unsigned short *)buffer;
+		combine.Output_Buffer_List[i] = (float *)(((char *)buffer)+band_bytes);
+	}
+	pthread_mutex_init(&(combine.Fits_Mutex),NULL);
+	/* flats: find the mean of each frame, so they can be normalised */
+	if(type == DPRT_MASTER_TYPE_FLAT)
+	{
+		combine.Sum_List = (unsigned long long *)calloc(((size_t)band_count)*((size_t)frame_count),
+								sizeof(unsigned long long));
+		if(combine.Sum_List == NULL)
+		{
+			DpRt_Error_Number = 1005;
+			sprintf(DpRt_Error_String,"DpRt_Master_Combine:Failed to allocate band sums (%d bands).\n",
+				band_count);
+			retval = FALSE;
+			goto destroy;
+		}
+		retval = DpRt_Thread_Pool_Run(band_count,Master_Sum_Band,&combine);
+		if(retval == FALSE)
+			goto band_failed;
+		for(j=0;j<frame_count;j++)
+		{
+			sum = 0;
+			for(i=0;i<band_count;i++)
+				sum += combine.Sum_List[(i*frame_count)+j];
+			if(sum == 0)
+			{
+				DpRt_Error_Number = 1011;
+				sprintf(DpRt_Error_String,"DpRt_Master_Combine:Flat %.200s has a mean of zero.\n",
+					filename_list[j]);
+				retval = FALSE;
+				goto destroy;
+			}
+			combine.Scale_List[j] = (((double)combine.Naxis_One)*((double)combine.Naxis_Two))/((double)sum);
+		}
+	}
+	/* create the master */
+	created = TRUE;
+	if(!Master_Create_Output(output_filename,type,method,frame_count,combine.Naxis_One,combine.Naxis_Two,
+				 combine.Flat_Parameters.Enabled ? combine.Flat_Parameters.Window : 0,
+				 &(combine.Output_Fits)))
+	{
+		retval = FALSE;
+		goto destroy;
+	}
+	/* combine the bands */
+	retval = DpRt_Thread_Pool_Run(band_count,Master_Combine_Band,&combine);
+	status = 0;
+	if(fits_close_file(combine.Output_Fits,&status) && retval)
+	{
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 1012;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine:Failed to close master %.200s.\n",output_filename);
+		retval = FALSE;
+		goto destroy;
+	}
+	combine.Output_Fits = NULL;
+band_failed:
+	if(combine.Aborted)
+	{
+		DpRt_Error_Number = 1010;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine(%.200s):Operation Aborted.\n",output_filename);
+		retval = FALSE;
+	}
+	else if(combine.Failed)
+	{
+		DpRt_Error_Number = combine.Error_Number;
+		strcpy(DpRt_Error_String,combine.Error_String);
+		retval = FALSE;
+	}
+	else if(retval == FALSE)
+	{
+		DpRt_Error_Number = 1018;
+		sprintf(DpRt_Error_String,"DpRt_Master_Combine(%.200s):Failed to combine bands.\n",output_filename);
+	}
+	if(retval)
+	{
+		fprintf(stdout,"DpRt_Master_Combine:Made %s from %d frames (%s).\n",output_filename,frame_count,
+			Master_Method_Name_List[method]);
+	}
+destroy:
+	/* don't leave a partially written master behind */
+	if((retval == FALSE)&&created)
+		remove(output_filename);
+	pthread_mutex_destroy(&(combine.Fits_Mutex));
+tidy:
+	if(combine.Band_Buffer_List != NULL)
+	{
+		for(i=0;i<thread_count;i++)
+		{
+			if(combine.Band_Buffer_List[i] != NULL)
+				DpRt_Buffer_Pool_Return(combine.Band_Buffer_List[i]);
+		}
+		free(combine.Band_Buffer_List);
+	}
+	if(combine.Fits_List != NULL)
+	{
+		Master_Close_Frames(&combine);
+		free(combine.Fits_List);
+	}
+	if(combine.Output_Buffer_List != NULL)
+		free(combine.Output_Buffer_List);
+	if(combine.Scale_List != NULL)
+		free(combine.Scale_List);
+	if(combine.Sum_List != NULL)
+		free(combine.Sum_List);
+	return retval;
+}
+
+/**
+ * Convert a combine method name ("mean", "median", "sigma_clip" or "minmax", case insensitive) into a combine method.
+ * @param method_string The method name.
+ * @param method The address of an integer to store the method.
+ * @return The routine returns TRUE if it succeeded, and FALSE if the name was not recognised.
+ * @see #DPRT_MASTER_METHOD_MEAN
+ * @see #DPRT_MASTER_METHOD_MEDIAN
+ * @see #DPRT_MASTER_METHOD_SIGMA_CLIP
+ * @see #DPRT_MASTER_METHOD_MINMAX
+ */
+int DpRt_Master_Method_From_String(char *method_string,int *method)
+{
+	if((method_string == NULL)||(method == NULL))
+	{
+		DpRt_Error_Number = 1017;
+		sprintf(DpRt_Error_String,"DpRt_Master_Method_From_String:method_string or method was NULL.\n");
+		return FALSE;
+	}
+	if(strcasecmp(method_string,"mean") == 0)
+		(*method) = DPRT_MASTER_METHOD_MEAN;
+	else if(strcasecmp(method_string,"median") == 0)
+		(*method) = DPRT_MASTER_METHOD_MEDIAN;
+	else if(strcasecmp(method_string,"sigma_clip") == 0)
+		(*method) = DPRT_MASTER_METHOD_SIGMA_CLIP;
+	else if(strcasecmp(method_string,"minmax") == 0)
+		(*method) = DPRT_MASTER_METHOD_MINMAX;
+	else
+	{
+		DpRt_Error_Number = 1017;
+		sprintf(DpRt_Error_String,"DpRt_Master_Method_From_String:Unknown method '%.200s'.\n",method_string);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Get the filename of the master frame of a type and size made in a directory by DpRt_Master_Make:
+ * &lt;directory_name&gt;/master_&lt;bias|flat&gt;_&lt;naxis_one&gt;x&lt;naxis_two&gt;.fits.
+ * @param directory_name The directory the master is made in.
+ * @param type The master type, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param naxis_one The number of columns in the master.
+ * @param naxis_two The number of rows in the master.
+ * @param filename A string to store the filename in.
+ * @param filename_length The length of the filename string, including the terminator.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (or the filename was too long).
+ * @see #MASTER_FILENAME_PREFIX
+ * @see #MASTER_FILENAME_SUFFIX
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Get_Filename(char *directory_name,int type,int naxis_one,int naxis_two,char *filename,
+			     size_t filename_length)
+{
+	char *type_string = NULL;
+	int length;
+
+	if((directory_name == NULL)||(filename == NULL)||
+	   ((type != DPRT_MASTER_TYPE_BIAS)&&(type != DPRT_MASTER_TYPE_FLAT)))
+	{
+		DpRt_Error_Number = 1021;
+		sprintf(DpRt_Error_String,"DpRt_Master_Get_Filename:Illegal arguments (type %d).\n",type);
+		return FALSE;
+	}
+	if(type == DPRT_MASTER_TYPE_BIAS)
+		type_string = "bias";
+	else
+		type_string = "flat";
+	length = snprintf(filename,filename_length,"%s/%s%s_%dx%d%s",directory_name,MASTER_FILENAME_PREFIX,
+			  type_string,naxis_one,naxis_two,MASTER_FILENAME_SUFFIX);
+	if((length < 0)||(((size_t)length) >= filename_length))
+	{
+		DpRt_Error_Number = 1021;
+		sprintf(DpRt_Error_String,"DpRt_Master_Get_Filename:Master filename in %.128s too long.\n",
+			directory_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Scan a directory for frames to combine. Files ending in MASTER_FILENAME_SUFFIX, not starting with
+ * MASTER_FILENAME_PREFIX, which are 16-bit 2 axis images and whose OBSTYPE contains obstype, are returned.
+ * Other files are skipped. The list is sorted by size, then filename.
+ * @param directory_name The directory to scan.
+ * @param obstype The string the OBSTYPE keyword value must contain.
+ * @param frame_list The address of a list of frames, allocated by this routine. The caller must free it.
+ * @param frame_count The address of an integer to store the number of frames in the list.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Master_Frame_Struct
+ * @see #Master_Frame_Compare
+ */
+static int Master_Scan_Directory(char *directory_name,char *obstype,struct Master_Frame_Struct **frame_list,
+				 int *frame_count)
+{
+	struct Master_Frame_Struct frame;
+	struct Master_Frame_Struct *new_frame_list = NULL;
+	struct dirent *entry = NULL;
+	fitsfile *fp = NULL;
+	char value[FLEN_VALUE];
+	DIR *dir = NULL;
+	int bitpix,naxis,name_length,suffix_length,allocated_count,status;
+
+	(*frame_list) = NULL;
+	(*frame_count) = 0;
+	allocated_count = 0;
+	dir = opendir(directory_name);
+	if(dir == NULL)
+	{
+		DpRt_Error_Number = 1014;
+		sprintf(DpRt_Error_String,"Master_Scan_Directory:Failed to open directory %.200s.\n",directory_name);
+		return FALSE;
+	}
+	suffix_length = strlen(MASTER_FILENAME_SUFFIX);
+	while((entry = readdir(dir)) != NULL)
+	{
+		name_length = strlen(entry->d_name);
+		if((name_length <= suffix_length)||
+		   (strcmp(entry->d_name+name_length-suffix_length,MASTER_FILENAME_SUFFIX) != 0)||
+		   (strncmp(entry->d_name,MASTER_FILENAME_PREFIX,strlen(MASTER_FILENAME_PREFIX)) == 0))
+			continue;
+		if(snprintf(frame.Filename,MASTER_FILENAME_LENGTH,"%s/%s",directory_name,entry->d_name) >=
+		   MASTER_FILENAME_LENGTH)
+			continue;
+		status = 0;
+		if(fits_open_file(&fp,frame.Filename,READONLY,&status))
+		{
+			fprintf(stderr,"Master_Scan_Directory:Skipping %s:Failed to open.\n",frame.Filename);
+			continue;
+		}
+		if(fits_read_key(fp,TINT,"BITPIX",&bitpix,NULL,&status)||
+		   fits_read_key(fp,TINT,"NAXIS",&naxis,NULL,&status)||
+		   fits_read_key(fp,TINT,"NAXIS1",&(frame.Naxis_One),NULL,&status)||
+		   fits_read_key(fp,TINT,"NAXIS2",&(frame.Naxis_Two),NULL,&status)||
+		   fits_read_key(fp,TSTRING,"OBSTYPE",value,NULL,&status))
+		{
+			status = 0;
+			fits_close_file(fp,&status);
+			fprintf(stderr,"Master_Scan_Directory:Skipping %s:Failed to read keywords.\n",frame.Filename);
+			continue;
+		}
+		status = 0;
+		fits_close_file(fp,&status);
+		if((bitpix != MASTER_BITPIX)||(naxis != MASTER_NAXIS)||(frame.Naxis_One < 1)||(frame.Naxis_Two < 1)||
+		   (strstr(value,obstype) == NULL))
+			continue;
+		if((*frame_count) == allocated_count)
+		{
+			allocated_count = (allocated_count*2)+16;
+			new_frame_list = (struct Master_Frame_Struct *)realloc((*frame_list),
+						allocated_count*sizeof(struct Master_Frame_Struct));
+			if(new_frame_list == NULL)
+			{
+				closedir(dir);
+				if((*frame_list) != NULL)
+					free(*frame_list);
+				(*frame_list) = NULL;
+				(*frame_count) = 0;
+				DpRt_Error_Number = 1015;
+				sprintf(DpRt_Error_String,"Master_Scan_Directory:Failed to allocate frame list(%d).\n",
+					allocated_count);
+				return FALSE;
+			}
+			(*frame_list) = new_frame_list;
+		}
+		(*frame_list)[(*frame_count)++] = frame;
+	}
+	closedir(dir);
+	if((*frame_count) > 0)
+		qsort((*frame_list),(*frame_count),sizeof(struct Master_Frame_Struct),Master_Frame_Compare);
+	fprintf(stdout,"Master_Scan_Directory:Found %d %s frames in %s.\n",(*frame_count),obstype,directory_name);
+	return TRUE;
+}
+
+/**
+ * qsort comparison function, ordering frames by size, then filename.
+ * @param a The first frame.
+ * @param b The second frame.
+ * @return Less than, equal to or greater than zero as a is ordered before, with or after b.
+ * @see #Master_Frame_Struct
+ */
+static int Master_Frame_Compare(const void *a,const void *b)
+{
+	const struct Master_Frame_Struct *frame_a = (const struct Master_Frame_Struct *)a;
+	const struct Master_Frame_Struct *frame_b = (const struct Master_Frame_Struct *)b;
+
+	if(frame_a->Naxis_One != frame_b->Naxis_One)
+		return frame_a->Naxis_One-frame_b->Naxis_One;
+	if(frame_a->Naxis_Two != frame_b->Naxis_Two)
+		return frame_a->Naxis_Two-frame_b->Naxis_Two;
+	return strcmp(frame_a->Filename,frame_b->Filename);
+}
+
+/**
+ * Make master frames from the accumulators of a type. A master is made from each accumulator with at least
+ * min_frames frames, into &lt;directory_name&gt;/master_&lt;bias|flat&gt;_&lt;naxis1&gt;x&lt;naxis2&gt;.fits.
+ * Master flats have the lamp spectrum removed across the thread pool, if dprt.master.flat.normalise is set.
+ * The bad pixel mask of each master's size is re-derived once it is written (see Master_Make_Mask).
+ * If any masters are made, the accumulators of the type are reset, ready to accumulate the next set of frames.
+ * @param directory_name The directory to put the masters in.
+ * @param type The type of master to make, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param type_string The type of master as a string, "bias" or "flat".
+ * @param method The combine method.
+ * @param min_frames The minimum number of frames to make a master from.
+ * @param made_count The address of an integer to store the number of masters made.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Master_Get_Combine_Parameters
+ * @see #Master_Create_Output
+ * @see #Master_Make_Mask
+ * @see #DpRt_Master_Get_Filename
+ * @see dprt_accumulate.html#DpRt_Accumulate_Get_Count
+ * @see dprt_accumulate.html#DpRt_Accumulate_Get
+ * @see dprt_accumulate.html#DpRt_Accumulate_Finalise
+ * @see dprt_accumulate.html#DpRt_Accumulate_Reset
+ * @see dprt_flat.html#DpRt_Flat_Get_Parameters
+ * @see dprt_flat.html#DpRt_Flat_Normalise
+ * @see dprt_buffer_pool.html#DpRt_Buffer_Pool_Lease
+ */
+static int Master_Make_Accumulated(char *directory_name,int type,char *type_string,int method,int min_frames,
+				   int *made_count)
+{
+	struct DpRt_Combine_Parameter_Struct parameters;
+	struct DpRt_Flat_Parameter_Struct flat_parameters;
+	char output_filename[MASTER_FILENAME_LENGTH];
+	fitsfile *fp = NULL;
+	void *buffer = NULL;
+	int accumulator_count,naxis_one,naxis_two,frame_count,index,retval,status = 0;
+
+	(*made_count) = 0;
+	if(!Master_Get_Combine_Parameters(method,&parameters))
+		return FALSE;
+	if(!DpRt_Accumulate_Get_Count(type,&accumulator_count))
+		return FALSE;
+	for(index=0;index<accumulator_count;index++)
+	{
+		if(!DpRt_Accumulate_Get(type,index,&naxis_one,&naxis_two,&frame_count))
+			return FALSE;
+		if(frame_count < min_frames)
+		{
+			fprintf(stdout,"Master_Make_Accumulated:Only %d accumulated %s frames of size %dx%d:"
+				"Not making a master.\n",frame_count,type_string,naxis_one,naxis_two);
+			continue;
+		}
+		if(!DpRt_Buffer_Pool_Lease(((size_t)naxis_one)*((size_t)naxis_two)*sizeof(float),&buffer))
+			return FALSE;
+		if(!DpRt_Accumulate_Finalise(type,index,&parameters,(float *)buffer))
+		{
+			DpRt_Buffer_Pool_Return(buffer);
+			return FALSE;
+		}
+		/* remove the lamp spectrum from master flats */
+		flat_parameters.Enabled = FALSE;
+		if((type == DPRT_MASTER_TYPE_FLAT)&&
+		   (!DpRt_Flat_Get_Parameters(naxis_one,naxis_two,&flat_parameters)))
+		{
+			DpRt_Buffer_Pool_Return(buffer);
+			return FALSE;
+		}
+		if(flat_parameters.Enabled &&
+		   (!DpRt_Flat_Normalise(&flat_parameters,(float *)buffer,naxis_one,naxis_two)))
+		{
+			DpRt_Buffer_Pool_Return(buffer);
+			return FALSE;
+		}
+		if(!DpRt_Master_Get_Filename(directory_name,type,naxis_one,naxis_two,output_filename,
+					     MASTER_FILENAME_LENGTH))
+		{
+			DpRt_Buffer_Pool_Return(buffer);
+			return FALSE;
+		}
+		if(!Master_Create_Output(output_filename,type,method,frame_count,naxis_one,naxis_two,
+					 flat_parameters.Enabled ? flat_parameters.Window : 0,&fp))
+		{
+			DpRt_Buffer_Pool_Return(buffer);
+			remove(output_filename);
+			return FALSE;
+		}
+		retval = fits_write_img(fp,TFLOAT,1,((LONGLONG)naxis_one)*((LONGLONG)naxis_two),buffer,&status);
+		DpRt_Buffer_Pool_Return(buffer);
+		if(retval)
+		{
+			fits_report_error(stderr,status);
+			status = 0;
+			fits_close_file(fp,&status);
+			remove(output_filename);
+			DpRt_Error_Number = 1019;
+			sprintf(DpRt_Error_String,"Master_Make_Accumulated:Failed to write master %.200s.\n",
+				output_filename);
+			return FALSE;
+		}
+		if(fits_close_file(fp,&status))
+		{
+			fits_report_error(stderr,status);
+			remove(output_filename);
+			DpRt_Error_Number = 1020;
+			sprintf(DpRt_Error_String,"Master_Make_Accumulated:Failed to close master %.200s.\n",
+				output_filename);
+			return FALSE;
+		}
+		fprintf(stdout,"Master_Make_Accumulated:Made %s from %d accumulated frames (%s).\n",output_filename,
+			frame_count,Master_Method_Name_List[method]);
+		(*made_count)++;
+		Master_Make_Mask(directory_name,naxis_one,naxis_two);
+	}
+	if((*made_count) > 0)
+		DpRt_Accumulate_Reset(type);
+	return TRUE;
+}
+
+/**
+ * Get the parameters of a combine method from the configuration.
+ * @param method The combine method.
+ * @param parameters The address of a structure to fill in with the method and it's parameters.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ */
+static int Master_Get_Combine_Parameters(int method,struct DpRt_Combine_Parameter_Struct *parameters)
+{
+	parameters->Method = method;
+	if(!DpRt_Config_Get_Double("dprt.master.sigma_clip.kappa",&(parameters->Kappa)))
+		return FALSE;
+	if(!DpRt_Config_Get_Integer("dprt.master.sigma_clip.iterations",&(parameters->Iterations)))
+		return FALSE;
+	if(!DpRt_Config_Get_Integer("dprt.master.minmax.reject_low",&(parameters->Reject_Low)))
+		return FALSE;
+	if(!DpRt_Config_Get_Integer("dprt.master.minmax.reject_high",&(parameters->Reject_High)))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Create a 32-bit floating point master frame, overwriting any existing file, and write it's NFRAMES, COMBMETH
+ * and OBSTYPE keywords, and for master flats the NORMWIN keyword.
+ * @param output_filename The filename of the master frame.
+ * @param type The type of master, DPRT_MASTER_TYPE_BIAS or DPRT_MASTER_TYPE_FLAT.
+ * @param method The combine method.
+ * @param frame_count The number of frames combined.
+ * @param naxis_one The number of columns in the master.
+ * @param naxis_two The number of rows in the master.
+ * @param normalise_window Master flats: the window the lamp spectrum was removed with, zero if it was not.
+ * @param fp The address of a fitsfile pointer to store the open master.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Master_Method_Name_List
+ */
+static int Master_Create_Output(char *output_filename,int type,int method,int frame_count,int naxis_one,
+				int naxis_two,int normalise_window,fitsfile **fp)
+{
+	char fits_filename[MASTER_FILENAME_LENGTH+1];
+	char *obstype = NULL;
+	long axes_list[2];
+	int status = 0;
+
+	snprintf(fits_filename,MASTER_FILENAME_LENGTH+1,"!%s",output_filename);
+	axes_list[0] = naxis_one;
+	axes_list[1] = naxis_two;
+	if(type == DPRT_MASTER_TYPE_BIAS)
+		obstype = "BIAS";
+	else
+		obstype = "FLAT";
+	(*fp) = NULL;
+	if(fits_create_file(fp,fits_filename,&status)||
+	   fits_create_img((*fp),FLOAT_IMG,2,axes_list,&status)||
+	   fits_update_key((*fp),TINT,"NFRAMES",&frame_count,"Number of frames combined",&status)||
+	   fits_update_key((*fp),TSTRING,"COMBMETH",Master_Method_Name_List[method],"Combine method",&status)||
+	   fits_update_key((*fp),TSTRING,"OBSTYPE",obstype,"Master frame type",&status)||
+	   ((type == DPRT_MASTER_TYPE_FLAT)&&
+	    fits_update_key((*fp),TINT,"NORMWIN",&normalise_window,"Lamp spectrum window, 0 if not removed",&status)))
+	{
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 1007;
+		sprintf(DpRt_Error_String,"Master_Create_Output:Failed to create master %.200s.\n",output_filename);
+		if((*fp) != NULL)
+		{
+			status = 0;
+			fits_close_file((*fp),&status);
+			(*fp) = NULL;
+		}
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Open the frames to be combined, checking they are 16-bit 2 axis images of the same size.
+ * combine->Naxis_One and combine->Naxis_Two are set from the first frame. On failure, any frames that were
+ * opened are left in combine->Fits_List, to be closed by Master_Close_Frames.
+ * @param filename_list The list of frames.
+ * @param combine The combine structure. Frame_Count and Fits_List must have been set.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #MASTER_BITPIX
+ * @see #MASTER_NAXIS
+ */
+static int Master_Open_Frames(char **filename_list,struct Master_Combine_Struct *combine)
+{
+	int i,bitpix,naxis,naxis_one,naxis_two,status = 0;
+
+	for(i=0;i<combine->Frame_Count;i++)
+	{
+		if(fits_open_file(&(combine->Fits_List[i]),filename_list[i],READONLY,&status))
+		{
+			fits_report_error(stderr,status);
+			combine->Fits_List[i] = NULL;
+			DpRt_Error_Number = 1002;
+			sprintf(DpRt_Error_String,"Master_Open_Frames:Failed to open %.200s.\n",filename_list[i]);
+			return FALSE;
+		}
+		if(fits_read_key(combine->Fits_List[i],TINT,"BITPIX",&bitpix,NULL,&status)||
+		   fits_read_key(combine->Fits_List[i],TINT,"NAXIS",&naxis,NULL,&status)||
+		   fits_read_key(combine->Fits_List[i],TINT,"NAXIS1",&naxis_one,NULL,&status)||
+		   fits_read_key(combine->Fits_List[i],TINT,"NAXIS2",&naxis_two,NULL,&status))
+		{
+			fits_report_error(stderr,status);
+			DpRt_Error_Number = 1003;
+			sprintf(DpRt_Error_String,"Master_Open_Frames:Failed to read keywords of %.200s.\n",
+				filename_list[i]);
+			return FALSE;
+		}
+		if(i == 0)
+		{
+			combine->Naxis_One = naxis_one;
+			combine->Naxis_Two = naxis_two;
+		}
+		if((bitpix != MASTER_BITPIX)||(naxis != MASTER_NAXIS)||(naxis_one < 1)||(naxis_two < 1)||
+		   (naxis_one != combine->Naxis_One)||(naxis_two != combine->Naxis_Two))
+		{
+			DpRt_Error_Number = 1004;
+			sprintf(DpRt_Error_String,"Master_Open_Frames:%.150s is not a %dx%d 16-bit image "
+				"(BITPIX %d,NAXIS %d,%dx%d).\n",filename_list[i],combine->Naxis_One,
+				combine->Naxis_Two,bitpix,naxis,naxis_one,naxis_two);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Close the open frames in combine->Fits_List.
+ * @param combine The combine structure.
+ */
+static void Master_Close_Frames(struct Master_Combine_Struct *combine)
+{
+	int i,status;
+
+	for(i=0;i<combine->Frame_Count;i++)
+	{
+		if(combine->Fits_List[i] != NULL)
+		{
+			status = 0;
+			fits_close_file(combine->Fits_List[i],&status);
+			combine->Fits_List[i] = NULL;
+		}
+	}
+}
+
+/**
+ * Thread pool task summing a band of each flat frame, into combine->Sum_List.
+ * @param user_data The combine structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread, used to select the band buffer.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Master_Read_Band
+ */
+static int Master_Sum_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Master_Combine_Struct *combine = (struct Master_Combine_Struct *)user_data;
+	unsigned short *band = NULL;
+	unsigned long long sum;
+	size_t pixel_count,i;
+	int start_y,rows,frame_index;
+
+	if(combine->Aborted || combine->Failed || DpRt_Context_Get_Abort(combine->Context))
+	{
+		if(!combine->Failed)
+			combine->Aborted = TRUE;
+		return FALSE;
+	}
+	start_y = band_index*combine->Band_Rows;
+	rows = combine->Band_Rows;
+	if(start_y+rows > combine->Naxis_Two)
+		rows = combine->Naxis_Two-start_y;
+	if(!Master_Read_Band(combine,thread_index,start_y,rows))
+		return FALSE;
+	pixel_count = ((size_t)rows)*((size_t)combine->Naxis_One);
+	for(frame_index=0;frame_index<combine->Frame_Count;frame_index++)
+	{
+		band = combine->Band_Buffer_List[thread_index]+(((size_t)frame_index)*((size_t)combine->Band_Rows)*
+								((size_t)combine->Naxis_One));
+		sum = 0;
+		for(i=0;i<pixel_count;i++)
+			sum += band[i];
+		combine->Sum_List[(band_index*combine->Frame_Count)+frame_index] = sum;
+	}
+	return TRUE;
+}
+
+/**
+ * Thread pool task combining a band of the frames, and writing it to the master.
+ * The band is combined by DpRt_Combine_Pixels, which uses sorting network kernels for stacks of up to
+ * DPRT_COMBINE_MAX_NETWORK_COUNT frames. Master flats then have the lamp spectrum removed from the band, whilst it
+ * is still in cache.
+ * @param user_data The combine structure.
+ * @param band_index The index of the band.
+ * @param thread_index The index of the thread, used to select the band and output buffers.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Master_Read_Band
+ * @see #Master_Band_Error
+ * @see dprt_combine.html#DpRt_Combine_Pixels
+ * @see dprt_flat.html#DpRt_Flat_Normalise_Rows
+ */
+static int Master_Combine_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Master_Combine_Struct *combine = (struct Master_Combine_Struct *)user_data;
+	char error_string[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	unsigned short *band = NULL;
+	float *output = NULL;
+	size_t pixel_count,frame_stride;
+	int start_y,rows,retval,status = 0;
+
+	if(combine->Aborted || combine->Failed || DpRt_Context_Get_Abort(combine->Context))
+	{
+		if(!combine->Failed)
+			combine->Aborted = TRUE;
+		return FALSE;
+	}
+	start_y = band_index*combine->Band_Rows;
+	rows = combine->Band_Rows;
+	if(start_y+rows > combine->Naxis_Two)
+		rows = combine->Naxis_Two-start_y;
+	if(!Master_Read_Band(combine,thread_index,start_y,rows))
+		return FALSE;
+	band = combine->Band_Buffer_List[thread_index];
+	output = combine->Output_Buffer_List[thread_index];
+	pixel_count = ((size_t)rows)*((size_t)combine->Naxis_One);
+	frame_stride = ((size_t)combine->Band_Rows)*((size_t)combine->Naxis_One);
+	if(!DpRt_Combine_Pixels(&(combine->Combine_Parameters),band,frame_stride,combine->Frame_Count,
+				combine->Scale_List,pixel_count,output))
+	{
+		Master_Band_Error(combine,DpRt_Error_Number,DpRt_Error_String);
+		return FALSE;
+	}
+	if(combine->Flat_Parameters.Enabled)
+		DpRt_Flat_Normalise_Rows(&(combine->Flat_Parameters),output,combine->Naxis_One,start_y,rows);
+	/* write the band to the master */
+	pthread_mutex_lock(&(combine->Fits_Mutex));
+	retval = fits_write_img(combine->Output_Fits,TFLOAT,(((LONGLONG)start_y)*((LONGLONG)combine->Naxis_One))+1,
+				(LONGLONG)pixel_count,output,&status);
+	pthread_mutex_unlock(&(combine->Fits_Mutex));
+	if(retval)
+	{
+		fits_report_error(stderr,status);
+		sprintf(error_string,"Master_Combine_Band:Failed to write rows %d to %d.\n",start_y,start_y+rows);
+		Master_Band_Error(combine,1009,error_string);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Read a band of rows of every frame into the thread's band buffer. The CFITSIO calls are serialised
+ * on combine->Fits_Mutex.
+ * @param combine The combine structure.
+ * @param thread_index The index of the thread, used to select the band buffer.
+ * @param start_y The first row of the band.
+ * @param rows The number of rows in the band.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Master_Band_Error
+ */
+static int Master_Read_Band(struct Master_Combine_Struct *combine,int thread_index,int start_y,int rows)
+{
+	char error_string[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	unsigned short *band = NULL;
+	int frame_index,retval = 0,status = 0;
+
+	pthread_mutex_lock(&(combine->Fits_Mutex));
+	for(frame_index=0;frame_index<combine->Frame_Count;frame_index++)
+	{
+		band = combine->Band_Buffer_List[thread_index]+(((size_t)frame_index)*((size_t)combine->Band_Rows)*
+								((size_t)combine->Naxis_One));
+		retval = fits_read_img(combine->Fits_List[frame_index],TUSHORT,
+				       (((LONGLONG)start_y)*((LONGLONG)combine->Naxis_One))+1,
+				       ((LONGLONG)rows)*((LONGLONG)combine->Naxis_One),NULL,band,NULL,&status);
+		if(retval)
+			break;
+	}
+	pthread_mutex_unlock(&(combine->Fits_Mutex));
+	if(retval)
+	{
+		fits_report_error(stderr,status);
+		sprintf(error_string,"Master_Read_Band:Failed to read rows %d to %d of frame %d.\n",start_y,
+			start_y+rows,frame_index);
+		Master_Band_Error(combine,1008,error_string);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Record the failure of a band. Only the first failure's error is kept.
+ * @param combine The combine structure.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ */
+static void Master_Band_Error(struct Master_Combine_Struct *combine,int error_number,char *error_string)
+{
+	pthread_mutex_lock(&(combine->Fits_Mutex));
+	if(combine->Failed == FALSE)
+	{
+		combine->Error_Number = error_number;
+		strncpy(combine->Error_String,error_string,DPRT_CONTEXT_ERROR_STRING_LENGTH-1);
+		combine->Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH-1] = '\0';
+		combine->Failed = TRUE;
+	}
+	pthread_mutex_unlock(&(combine->Fits_Mutex));
+}
+
+/**
+ * Re-derive the bad pixel mask of a size from the masters in the directory, once a new master of that size has
+ * been made, if dprt.mask.auto is set. A mask that cannot be derived is reported, but does not fail the master:
+ * the error is cleared and the previous mask (if any) is left in place.
+ * @param directory_name The directory containing the masters.
+ * @param naxis_one The number of columns in the master.
+ * @param naxis_two The number of rows in the master.
+ * @see dprt_mask.html#DpRt_Mask_Get_Parameters
+ * @see dprt_mask.html#DpRt_Mask_Make
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static void Master_Make_Mask(char *directory_name,int naxis_one,int naxis_two)
+{
+	struct DpRt_Mask_Parameter_Struct parameters;
+
+	if(DpRt_Mask_Get_Parameters(naxis_one,naxis_two,&parameters))
+	{
+		if(parameters.Enabled == FALSE)
+			return;
+		if(DpRt_Mask_Make(directory_name,naxis_one,naxis_two))
+			return;
+	}
+	fprintf(stderr,"Master_Make_Mask:Failed to make bad pixel mask of size %dx%d:%d:%s",naxis_one,naxis_two,
+		DpRt_Error_Number,DpRt_Error_String);
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+}
+
+/*
+** $Log$
+*/
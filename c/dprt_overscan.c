@@ -0,0 +1,350 @@
+/* dprt_overscan.c
+** Overscan (bias section) levels and data (trim) sections of frames.
+** $Header$
+*/
+/**
+ * dprt_overscan.c works out the overscan and data sections of a frame, from it's BIASSEC and TRIMSEC keywords
+ * or the configuration, and computes a robust level for each row from the row's overscan pixels.
+ * The levels are computed a group of DPRT_OVERSCAN_ROW_GROUP_COUNT rows at a time: the group's overscan pixels are
+ * gathered column by column into a small buffer on the stack, and combined by the sorting network kernels
+ * of DpRt_Combine_Pixels, one row per lane. The overscan columns are at the edge of the rows being reduced,
+ * so this is done by the reduction as it goes, band by band, rather than as a separate pass over the frame.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_stats.h"
+#include "dprt_combine.h"
+#include "dprt_master.h"
+#include "dprt_overscan.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * Macro to convert a 16-bit value read from a FITS data unit (big-endian, signed, with a BZERO of 32768)
+ * into the unsigned pixel value. On a big-endian host only the BZERO offset (flipping the top bit) is needed.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define OVERSCAN_FITS_DECODE(v)	((unsigned short)((v)^0x8000))
+#else
+#define OVERSCAN_FITS_DECODE(v)	((unsigned short)((((v)>>8)|((v)<<8))^0x8000))
+#endif
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Overscan_Get_Section(char *header_section,char *keyword,char **section);
+static int Overscan_Get_Parameters(struct DpRt_Combine_Parameter_Struct *parameters);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Work out the overscan and data sections of a frame. If the "dprt.overscan" property is FALSE, overscan is
+ * switched off and the data section is the whole frame. Otherwise each section comes from the frame's keyword
+ * if it has one, or the "dprt.overscan.biassec"/"dprt.overscan.trimsec" property. With no overscan section
+ * the frame is only trimmed, and with no data section the whole frame is used. The overscan levels are combined
+ * using the "dprt.overscan.method" property.
+ * @param biassec The frame's BIASSEC keyword value, or an empty string or NULL if it has none.
+ * @param trimsec The frame's TRIMSEC keyword value, or an empty string or NULL if it has none.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param overscan The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_OVERSCAN_MAX_COLUMNS
+ * @see #DpRt_Overscan_Parse_Section
+ * @see #Overscan_Get_Section
+ * @see #Overscan_Get_Parameters
+ * @see dprt_config.html#DpRt_Config_Get_Boolean
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Overscan_Get(char *biassec,char *trimsec,int naxis_one,int naxis_two,
+		      struct DpRt_Overscan_Struct *overscan)
+{
+	char *section = NULL;
+	int i,retval;
+
+	if((overscan == NULL)||(naxis_one < 0)||(naxis_two < 0))
+	{
+		DpRt_Error_Number = 1400;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Get:overscan was NULL or illegal dimensions (%d,%d).\n",
+			naxis_one,naxis_two);
+		return FALSE;
+	}
+	overscan->Enabled = FALSE;
+	overscan->Bias_Start_X = 0;
+	overscan->Bias_End_X = 0;
+	overscan->Bias_Start_Y = 0;
+	overscan->Bias_End_Y = 0;
+	overscan->Trim_Start_X = 0;
+	overscan->Trim_End_X = naxis_one;
+	overscan->Trim_Start_Y = 0;
+	overscan->Trim_End_Y = naxis_two;
+	if(!DpRt_Config_Get_Boolean("dprt.overscan",&(overscan->Enabled)))
+		return FALSE;
+	if(!overscan->Enabled)
+		return TRUE;
+	if(!Overscan_Get_Parameters(&(overscan->Parameters)))
+		return FALSE;
+	for(i=0;i<DPRT_OVERSCAN_MAX_COLUMNS;i++)
+		overscan->Scale_List[i] = 1.0;
+/* the overscan section */
+	if(!Overscan_Get_Section(biassec,"dprt.overscan.biassec",&section))
+		return FALSE;
+	if(strlen(section) > 0)
+	{
+		retval = DpRt_Overscan_Parse_Section(section,naxis_one,naxis_two,&(overscan->Bias_Start_X),
+						     &(overscan->Bias_End_X),&(overscan->Bias_Start_Y),
+						     &(overscan->Bias_End_Y));
+		free(section);
+		if(retval == FALSE)
+			return FALSE;
+		if((overscan->Bias_End_X-overscan->Bias_Start_X) > DPRT_OVERSCAN_MAX_COLUMNS)
+		{
+			DpRt_Error_Number = 1401;
+			sprintf(DpRt_Error_String,"DpRt_Overscan_Get:Overscan section has %d columns (maximum %d).\n",
+				overscan->Bias_End_X-overscan->Bias_Start_X,DPRT_OVERSCAN_MAX_COLUMNS);
+			return FALSE;
+		}
+	}
+	else
+		free(section);
+/* the data section */
+	if(!Overscan_Get_Section(trimsec,"dprt.overscan.trimsec",&section))
+		return FALSE;
+	if(strlen(section) > 0)
+	{
+		retval = DpRt_Overscan_Parse_Section(section,naxis_one,naxis_two,&(overscan->Trim_Start_X),
+						     &(overscan->Trim_End_X),&(overscan->Trim_Start_Y),
+						     &(overscan->Trim_End_Y));
+		free(section);
+		if(retval == FALSE)
+			return FALSE;
+	}
+	else
+		free(section);
+	return TRUE;
+}
+
+/**
+ * Parse a FITS image section of the form "[x1:x2,y1:y2]", where the positions are 1-based and inclusive,
+ * into 0-based start positions and exclusive end positions. The section must lie within the frame.
+ * @param section The section string.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param start_x The address of an integer to store the first column.
+ * @param end_x The address of an integer to store one more than the last column.
+ * @param start_y The address of an integer to store the first row.
+ * @param end_y The address of an integer to store one more than the last row.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Overscan_Parse_Section(char *section,int naxis_one,int naxis_two,int *start_x,int *end_x,
+				int *start_y,int *end_y)
+{
+	int x1,x2,y1,y2;
+	char c;
+
+	if((section == NULL)||(start_x == NULL)||(end_x == NULL)||(start_y == NULL)||(end_y == NULL))
+	{
+		DpRt_Error_Number = 1402;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Parse_Section:Illegal arguments.\n");
+		return FALSE;
+	}
+	if(sscanf(section," [ %d : %d , %d : %d %c",&x1,&x2,&y1,&y2,&c) != 5)
+	{
+		DpRt_Error_Number = 1403;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Parse_Section:Failed to parse section '%.64s'.\n",section);
+		return FALSE;
+	}
+	if((c != ']')||(x1 < 1)||(x1 > x2)||(x2 > naxis_one)||(y1 < 1)||(y1 > y2)||(y2 > naxis_two))
+	{
+		DpRt_Error_Number = 1404;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Parse_Section:Section '%.64s' is not within (%d,%d).\n",
+			section,naxis_one,naxis_two);
+		return FALSE;
+	}
+	(*start_x) = x1-1;
+	(*end_x) = x2;
+	(*start_y) = y1-1;
+	(*end_y) = y2;
+	return TRUE;
+}
+
+/**
+ * Compute the overscan level of a run of rows of a frame. The level of a row is it's overscan pixels combined
+ * using overscan->Parameters. Rows outside the overscan section's rows use the nearest row inside it. If a master
+ * bias is given, the mean of the master bias's own overscan pixels in that row is taken off the level, as the
+ * master bias is subtracted as well and already contains the overscan level it was made with.
+ * If the overscan section is empty, the levels are zero (less any master bias overscan).
+ * The rows are done DPRT_OVERSCAN_ROW_GROUP_COUNT at a time, each row's overscan pixels in a lane of the
+ * sorting network kernels.
+ * @param overscan The overscan and data sections, from DpRt_Overscan_Get.
+ * @param data The frame data, in row-major order.
+ * @param encoding How the pixel values are stored in data, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param naxis_one The number of columns in the frame.
+ * @param start_y The first row to compute the level of.
+ * @param row_count The number of rows to compute the level of.
+ * @param bias The cached master bias of the frame's size, or NULL.
+ * @param level_list The address of a list of row_count floats to store the levels in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_OVERSCAN_MAX_COLUMNS
+ * @see #DPRT_OVERSCAN_ROW_GROUP_COUNT
+ * @see #OVERSCAN_FITS_DECODE
+ * @see dprt_combine.html#DpRt_Combine_Pixels
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Overscan_Get_Levels(struct DpRt_Overscan_Struct *overscan,void *data,int encoding,int naxis_one,
+			     int start_y,int row_count,float *bias,float *level_list)
+{
+	unsigned short column_list[DPRT_OVERSCAN_MAX_COLUMNS*DPRT_OVERSCAN_ROW_GROUP_COUNT];
+	unsigned short *row = NULL;
+	float *bias_row = NULL;
+	double bias_level;
+	int column_count,group_start,group_count,lane,source_y,x;
+
+	if((overscan == NULL)||(data == NULL)||(level_list == NULL)||(row_count < 0))
+	{
+		DpRt_Error_Number = 1405;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Get_Levels:Illegal arguments.\n");
+		return FALSE;
+	}
+	column_count = overscan->Bias_End_X-overscan->Bias_Start_X;
+	for(group_start=0;group_start<row_count;group_start+=group_count)
+	{
+		group_count = row_count-group_start;
+		if(group_count > DPRT_OVERSCAN_ROW_GROUP_COUNT)
+			group_count = DPRT_OVERSCAN_ROW_GROUP_COUNT;
+		if(column_count == 0)
+		{
+			for(lane=0;lane<group_count;lane++)
+				level_list[group_start+lane] = 0.0f;
+		}
+		else
+		{
+			/* gather the group's overscan pixels, column x of lane (row) l at [x*group_count+l] */
+			for(lane=0;lane<group_count;lane++)
+			{
+				source_y = start_y+group_start+lane;
+				if(source_y < overscan->Bias_Start_Y)
+					source_y = overscan->Bias_Start_Y;
+				if(source_y >= overscan->Bias_End_Y)
+					source_y = overscan->Bias_End_Y-1;
+				row = ((unsigned short *)data)+(((size_t)source_y)*((size_t)naxis_one))+
+					overscan->Bias_Start_X;
+				if(encoding == DPRT_STATS_ENCODING_FITS)
+				{
+					for(x=0;x<column_count;x++)
+						column_list[(x*group_count)+lane] = OVERSCAN_FITS_DECODE(row[x]);
+				}
+				else
+				{
+					for(x=0;x<column_count;x++)
+						column_list[(x*group_count)+lane] = row[x];
+				}
+			}
+			if(!DpRt_Combine_Pixels(&(overscan->Parameters),column_list,(size_t)group_count,column_count,
+						overscan->Scale_List,(size_t)group_count,level_list+group_start))
+				return FALSE;
+		}
+		if((bias != NULL)&&(column_count > 0))
+		{
+			for(lane=0;lane<group_count;lane++)
+			{
+				source_y = start_y+group_start+lane;
+				if(source_y < overscan->Bias_Start_Y)
+					source_y = overscan->Bias_Start_Y;
+				if(source_y >= overscan->Bias_End_Y)
+					source_y = overscan->Bias_End_Y-1;
+				bias_row = bias+(((size_t)source_y)*((size_t)naxis_one))+overscan->Bias_Start_X;
+				bias_level = 0.0;
+				for(x=0;x<column_count;x++)
+					bias_level += bias_row[x];
+				level_list[group_start+lane] -= (float)(bias_level/((double)column_count));
+			}
+		}
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Get a section string: the frame's keyword value if it is not empty, otherwise the configured value.
+ * @param header_section The frame's keyword value, or NULL.
+ * @param keyword The property keyword holding the configured value.
+ * @param section The address of a pointer to store an allocated copy of the section, which the caller must free.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+static int Overscan_Get_Section(char *header_section,char *keyword,char **section)
+{
+	if((header_section != NULL)&&(strlen(header_section) > 0))
+	{
+		(*section) = strdup(header_section);
+		if((*section) == NULL)
+		{
+			DpRt_Error_Number = 1406;
+			sprintf(DpRt_Error_String,"Overscan_Get_Section:Failed to copy section '%.64s'.\n",
+				header_section);
+			return FALSE;
+		}
+		return TRUE;
+	}
+	return DpRt_Config_Get_String(keyword,section);
+}
+
+/**
+ * Get the parameters of the overscan combine from the configuration. Min/max rejection rejects the lowest and
+ * highest value.
+ * @param parameters The address of a structure to fill in with the method and it's parameters.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_master.html#DpRt_Master_Method_From_String
+ */
+static int Overscan_Get_Parameters(struct DpRt_Combine_Parameter_Struct *parameters)
+{
+	char *method_string = NULL;
+	int retval;
+
+	if(!DpRt_Config_Get_String("dprt.overscan.method",&method_string))
+		return FALSE;
+	retval = DpRt_Master_Method_From_String(method_string,&(parameters->Method));
+	free(method_string);
+	if(retval == FALSE)
+		return FALSE;
+	if(!DpRt_Config_Get_Double("dprt.overscan.sigma_clip.kappa",&(parameters->Kappa)))
+		return FALSE;
+	if(!DpRt_Config_Get_Integer("dprt.overscan.sigma_clip.iterations",&(parameters->Iterations)))
+		return FALSE;
+	parameters->Reject_Low = 1;
+	parameters->Reject_High = 1;
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
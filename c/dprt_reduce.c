@@ -0,0 +1,496 @@
+/* dprt_reduce.c
+** Tiled (row band) multi-threaded frame reductions.
+** $Header$
+*/
+/**
+ * dprt_reduce.c splits a frame into bands of rows, and reduces each band on the thread pool.
+ * Each band produces a partial result, which are merged in band order once all the bands are complete, so the
+ * result is deterministic whatever the number of threads. Each band checks the abort flag of the calling thread's
+ * context before starting, so an abort takes effect within one band's worth of work. The statistics can be
+ * computed on the fly from a frame calibrated with master bias, flat and bad pixel mask frames, in one fused pass,
+ * without the calibrated frame ever being written to memory. Overscan levels are computed for each group of rows
+ * as the band reaches them and subtracted on the fly, and the statistics restricted to the frame's data section.
+ * The exact histogram of the (calibrated) pixels can be built in the same pass, each thread adding to it's own
+ * histogram, which are merged once all the bands are complete. The sum of each row (the spatial profile of a
+ * spectrum) can be kept in the same pass, as the chunk statistics already hold it. Pixels set in a bad pixel mask
+ * are left out of the statistics and histogram by the kernels themselves; a frame with only a mask is reduced
+ * without calibrating it, reading the mask bitset alongside the frame.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_context.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_calibration.h"
+#include "dprt_overscan.h"
+#include "dprt_histogram.h"
+#include "dprt_reduce.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The default number of rows in each band, used if DpRt_Reduce_Initialise has not been called.
+ */
+#define REDUCE_DEFAULT_BAND_ROWS	(64)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the data needed to reduce the statistics of each band of a frame.
+ * <dl>
+ * <dt>Data</dt> <dd>The frame data.</dd>
+ * <dt>Encoding</dt> <dd>How the pixel values are stored in Data (DPRT_STATS_ENCODING_NATIVE/DPRT_STATS_ENCODING_FITS).</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in each band (the last band may be smaller).</dd>
+ * <dt>Saturation_Level</dt> <dd>The saturation level passed to the statistics kernel (raised by the pedestal of a
+ *     calibrated frame).</dd>
+ * <dt>Pedestal</dt> <dd>The pedestal added to the calibrated pixels (DPRT_CALIBRATION_PEDESTAL), or zero if the
+ *     frame is not being calibrated.</dd>
+ * <dt>Bias</dt> <dd>The master bias subtracted from the frame before the statistics are computed, or NULL.</dd>
+ * <dt>Flat</dt> <dd>The master flat (reciprocals) the frame is multiplied by, or NULL.</dd>
+ * <dt>Mask</dt> <dd>The bad pixel mask bitset, whose bad pixels are left out of the statistics, or NULL.</dd>
+ * <dt>Overscan</dt> <dd>The overscan and data sections of the frame, or NULL if overscan is not being used.</dd>
+ * <dt>Band_Stats_List</dt> <dd>A list of partial statistics, one per band, held in the context's scratch buffer.</dd>
+ * <dt>Thread_Histogram_List</dt> <dd>A list of partial histograms, one per thread, held in the context's scratch
+ *     buffer, or NULL if no histogram is being built.</dd>
+ * <dt>Row_Sum_List</dt> <dd>A list of Naxis_Two row sums, each filled in by the band holding the row, or NULL if
+ *     they are not wanted.</dd>
+ * <dt>Context</dt> <dd>The context of the thread that started the reduction, whose abort flag the bands check.</dd>
+ * <dt>Aborted</dt> <dd>A boolean, set to TRUE by any band that saw the abort flag set. Later bands then
+ *     return without doing any work.</dd>
+ * </dl>
+ */
+struct Reduce_Stats_Struct
+{
+	void *Data;
+	int Encoding;
+	int Naxis_One;
+	int Naxis_Two;
+	int Band_Rows;
+	int Saturation_Level;
+	int Pedestal;
+	float *Bias;
+	float *Flat;
+	unsigned long long *Mask;
+	struct DpRt_Overscan_Struct *Overscan;
+	struct DpRt_Stats_Struct *Band_Stats_List;
+	struct DpRt_Histogram_Struct *Thread_Histogram_List;
+	unsigned long long *Row_Sum_List;
+	DpRt_Context *Context;
+	volatile int Aborted;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The number of rows in each band.
+ * @see #REDUCE_DEFAULT_BAND_ROWS
+ */
+static int Reduce_Band_Rows = REDUCE_DEFAULT_BAND_ROWS;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Reduce_Stats_Band(void *user_data,int band_index,int thread_index);
+static int Reduce_Calibrated_Stats_Rows(struct Reduce_Stats_Struct *reduce_stats,int start_y,int end_y,
+					struct DpRt_Stats_Struct *stats,struct DpRt_Histogram_Struct *histogram);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Set the number of rows in each band of a tiled reduction.
+ * @param band_rows The number of rows in each band, which must be at least one.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Reduce_Band_Rows
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Reduce_Initialise(int band_rows)
+{
+	if(band_rows < 1)
+	{
+		DpRt_Error_Number = 400;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Initialise:Illegal band rows %d.\n",band_rows);
+		return FALSE;
+	}
+	Reduce_Band_Rows = band_rows;
+	fprintf(stdout,"DpRt_Reduce_Initialise:Using bands of %d rows.\n",Reduce_Band_Rows);
+	return TRUE;
+}
+
+/**
+ * Return the number of rows in each band of a tiled reduction.
+ * @return The number of rows.
+ * @see #Reduce_Band_Rows
+ */
+int DpRt_Reduce_Get_Band_Rows(void)
+{
+	return Reduce_Band_Rows;
+}
+
+/**
+ * Compute the statistics of a frame, reducing bands of rows in parallel on the thread pool.
+ * @param data The frame data, of naxis_one*naxis_two pixels, in row-major order.
+ * @param encoding How the pixel values are stored in data: DPRT_STATS_ENCODING_NATIVE for host order unsigned
+ *        shorts, or DPRT_STATS_ENCODING_FITS for a memory mapped FITS data unit.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param stats The address of a structure to fill with the statistics.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #DpRt_Reduce_Calibrated_Stats
+ */
+int DpRt_Reduce_Stats(void *data,int encoding,int naxis_one,int naxis_two,int saturation_level,
+		      struct DpRt_Stats_Struct *stats)
+{
+	return DpRt_Reduce_Calibrated_Stats(data,encoding,naxis_one,naxis_two,NULL,NULL,NULL,NULL,saturation_level,
+					    stats,NULL,NULL);
+}
+
+/**
+ * Compute the statistics of a frame calibrated with a master bias and master flat (see DpRt_Calibration_Apply),
+ * leaving out the pixels set in a bad pixel mask, reducing bands of rows in parallel on the thread pool. Each band
+ * is calibrated a chunk of pixels at a time into a buffer on the stack, whose statistics are taken whilst it is
+ * still in cache, so the frame is read once and no calibrated frame is written. If overscan is in use, each row's
+ * overscan level is subtracted as well, and only the data section contributes to the statistics (the maximum's
+ * position is still in frame coordinates). If no bias, flat or overscan are given, the statistics kernels are run
+ * directly on the frame (with the mask, if there is one). If a histogram is wanted, each band also adds the pixels
+ * it has just computed the statistics of to the histogram of the thread running it, whilst they are still in cache.
+ * If row sums are wanted, the sum of each (calibrated) row within the data section is kept as well, from the
+ * statistics of it's chunks. Calibrated pixels are raised by DPRT_CALIBRATION_PEDESTAL before they are stored as
+ * unsigned shorts, so their noise below zero is not clamped away, and the pedestal is taken back off the sum,
+ * minimum, maximum and row sums (which are clamped at zero) and recorded as the histogram's pedestal.
+ * The per-band results and per-thread histograms are kept in scratch buffers of the calling thread's current context.
+ * @param data The frame data, of naxis_one*naxis_two pixels, in row-major order.
+ * @param encoding How the pixel values are stored in data: DPRT_STATS_ENCODING_NATIVE for host order unsigned
+ *        shorts, or DPRT_STATS_ENCODING_FITS for a memory mapped FITS data unit.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param overscan The overscan and data sections of the frame (from DpRt_Overscan_Get), or NULL. If it is not
+ *        enabled, it is ignored.
+ * @param bias The cached master bias of the frame's size, or NULL.
+ * @param flat The cached master flat of the frame's size, or NULL.
+ * @param mask The cached bad pixel mask bitset of the frame's size, or NULL. Bad pixels are not counted in any of
+ *        the statistics, the histogram or the row sums.
+ * @param saturation_level Pixels with a (calibrated) value greater than or equal to this are counted as saturated.
+ * @param stats The address of a structure to fill with the statistics of the calibrated frame.
+ * @param histogram The address of a histogram to fill with the calibrated pixels the statistics are taken from,
+ *        or NULL.
+ * @param row_sum_list A list of naxis_two values to fill with the sum of the calibrated pixels of each row, or NULL.
+ *        Rows outside the data section are set to zero.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Reduce_Band_Rows
+ * @see #Reduce_Stats_Band
+ * @see dprt_stats.html#DpRt_Stats_Merge
+ * @see dprt_histogram.html#DpRt_Histogram_Merge
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Get_Thread_Count
+ * @see dprt_context.html#DpRt_Context_Get_Current
+ * @see dprt_context.html#DpRt_Context_Get_Scratch
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Reduce_Calibrated_Stats(void *data,int encoding,int naxis_one,int naxis_two,
+				 struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,unsigned long long *mask,
+				 int saturation_level,struct DpRt_Stats_Struct *stats,
+				 struct DpRt_Histogram_Struct *histogram,unsigned long long *row_sum_list)
+{
+	struct Reduce_Stats_Struct reduce_stats;
+	unsigned long long pedestal_sum;
+	int band_count,thread_count,i,retval;
+
+	if((data == NULL)||(stats == NULL))
+	{
+		DpRt_Error_Number = 401;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:data or stats was NULL.\n");
+		return FALSE;
+	}
+	if((naxis_one < 0)||(naxis_two < 0))
+	{
+		DpRt_Error_Number = 402;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:Illegal dimensions (%d,%d).\n",naxis_one,naxis_two);
+		return FALSE;
+	}
+	band_count = (naxis_two+Reduce_Band_Rows-1)/Reduce_Band_Rows;
+	if(histogram != NULL)
+		DpRt_Histogram_Clear(histogram);
+	if(row_sum_list != NULL)
+		memset(row_sum_list,0,((size_t)naxis_two)*sizeof(unsigned long long));
+	if(band_count == 0)
+		return DpRt_Stats_Calculate_Rows(data,encoding,naxis_one,0,naxis_two,saturation_level,stats);
+	reduce_stats.Data = data;
+	reduce_stats.Encoding = encoding;
+	reduce_stats.Naxis_One = naxis_one;
+	reduce_stats.Naxis_Two = naxis_two;
+	reduce_stats.Band_Rows = Reduce_Band_Rows;
+	reduce_stats.Bias = bias;
+	reduce_stats.Flat = flat;
+	reduce_stats.Mask = mask;
+	if((overscan != NULL)&&(overscan->Enabled))
+		reduce_stats.Overscan = overscan;
+	else
+		reduce_stats.Overscan = NULL;
+	reduce_stats.Saturation_Level = saturation_level;
+	reduce_stats.Pedestal = 0;
+	if((bias != NULL)||(flat != NULL)||(reduce_stats.Overscan != NULL))
+	{
+		reduce_stats.Pedestal = DPRT_CALIBRATION_PEDESTAL;
+		if(saturation_level > (DPRT_HISTOGRAM_BIN_COUNT-1-DPRT_CALIBRATION_PEDESTAL))
+			reduce_stats.Saturation_Level = DPRT_HISTOGRAM_BIN_COUNT-1;
+		else
+			reduce_stats.Saturation_Level = saturation_level+DPRT_CALIBRATION_PEDESTAL;
+	}
+	reduce_stats.Row_Sum_List = row_sum_list;
+	reduce_stats.Aborted = FALSE;
+	reduce_stats.Context = DpRt_Context_Get_Current();
+	if(!DpRt_Context_Get_Scratch(reduce_stats.Context,DPRT_CONTEXT_SCRATCH_REDUCE,
+				     band_count*sizeof(struct DpRt_Stats_Struct),(void **)&(reduce_stats.Band_Stats_List)))
+	{
+		DpRt_Error_Number = 403;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:Failed to allocate band statistics(%d).\n",band_count);
+		return FALSE;
+	}
+	reduce_stats.Thread_Histogram_List = NULL;
+	thread_count = DpRt_Thread_Pool_Get_Thread_Count();
+	if(thread_count < 1)
+		thread_count = 1;
+	if(histogram != NULL)
+	{
+		if(!DpRt_Context_Get_Scratch(reduce_stats.Context,DPRT_CONTEXT_SCRATCH_HISTOGRAM,
+					     thread_count*sizeof(struct DpRt_Histogram_Struct),
+					     (void **)&(reduce_stats.Thread_Histogram_List)))
+		{
+			DpRt_Error_Number = 406;
+			sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:Failed to allocate %d thread histograms.\n",
+				thread_count);
+			return FALSE;
+		}
+		for(i=0;i<thread_count;i++)
+		{
+			DpRt_Histogram_Clear(&(reduce_stats.Thread_Histogram_List[i]));
+			reduce_stats.Thread_Histogram_List[i].Pedestal = reduce_stats.Pedestal;
+		}
+		histogram->Pedestal = reduce_stats.Pedestal;
+	}
+	retval = DpRt_Thread_Pool_Run(band_count,Reduce_Stats_Band,&reduce_stats);
+	if(reduce_stats.Aborted)
+	{
+		DpRt_Error_Number = 404;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:Operation Aborted.\n");
+		return FALSE;
+	}
+	if(retval == FALSE)
+	{
+		DpRt_Error_Number = 405;
+		sprintf(DpRt_Error_String,"DpRt_Reduce_Stats:Failed to reduce bands.\n");
+		return FALSE;
+	}
+	/* merge partial results in band order */
+	(*stats) = reduce_stats.Band_Stats_List[0];
+	for(i=1;i<band_count;i++)
+		DpRt_Stats_Merge(stats,&(reduce_stats.Band_Stats_List[i]));
+	if((reduce_stats.Pedestal != 0)&&(stats->Pixel_Count > 0))
+	{
+		pedestal_sum = ((unsigned long long)reduce_stats.Pedestal)*stats->Pixel_Count;
+		stats->Sum = (stats->Sum > pedestal_sum) ? stats->Sum-pedestal_sum : 0;
+		stats->Min = (stats->Min > reduce_stats.Pedestal) ? stats->Min-reduce_stats.Pedestal : 0;
+		stats->Max = (stats->Max > reduce_stats.Pedestal) ? stats->Max-reduce_stats.Pedestal : 0;
+	}
+	if(histogram != NULL)
+	{
+		for(i=0;i<thread_count;i++)
+			DpRt_Histogram_Merge(histogram,&(reduce_stats.Thread_Histogram_List[i]));
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Thread pool task function, computing the statistics of one band of rows.
+ * The abort flag of the reduction's context is checked before the band is started. If row sums are wanted of a
+ * frame that is not being calibrated, the statistics kernel is run a row at a time. The bad pixel mask, if there is
+ * one, is passed to the statistics kernel and histogram of a frame that is not being calibrated.
+ * @param user_data A pointer to the Reduce_Stats_Struct describing the reduction.
+ * @param band_index The index of the band to reduce.
+ * @param thread_index The index of the thread running the task, used to select it's histogram.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Reduce_Stats_Struct
+ * @see #Reduce_Calibrated_Stats_Rows
+ * @see dprt_stats.html#DpRt_Stats_Calculate_Rows_Masked
+ * @see dprt_histogram.html#DpRt_Histogram_Add_Masked
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ */
+static int Reduce_Stats_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Reduce_Stats_Struct *reduce_stats = (struct Reduce_Stats_Struct *)user_data;
+	struct DpRt_Stats_Struct row_stats;
+	struct DpRt_Histogram_Struct *histogram = NULL;
+	int start_y,end_y,y;
+
+	if(reduce_stats->Aborted || DpRt_Context_Get_Abort(reduce_stats->Context))
+	{
+		reduce_stats->Aborted = TRUE;
+		return FALSE;
+	}
+	start_y = band_index*reduce_stats->Band_Rows;
+	end_y = start_y+reduce_stats->Band_Rows;
+	if(end_y > reduce_stats->Naxis_Two)
+		end_y = reduce_stats->Naxis_Two;
+	if(reduce_stats->Thread_Histogram_List != NULL)
+		histogram = &(reduce_stats->Thread_Histogram_List[thread_index]);
+	if((reduce_stats->Bias != NULL)||(reduce_stats->Flat != NULL)||(reduce_stats->Overscan != NULL))
+	{
+		return Reduce_Calibrated_Stats_Rows(reduce_stats,start_y,end_y,
+						    &(reduce_stats->Band_Stats_List[band_index]),histogram);
+	}
+	if(reduce_stats->Row_Sum_List != NULL)
+	{
+		memset(&(reduce_stats->Band_Stats_List[band_index]),0,sizeof(struct DpRt_Stats_Struct));
+		for(y=start_y;y<end_y;y++)
+		{
+			if(!DpRt_Stats_Calculate_Rows_Masked(reduce_stats->Data,reduce_stats->Encoding,
+							     reduce_stats->Naxis_One,y,y+1,reduce_stats->Mask,0,
+							     reduce_stats->Saturation_Level,&row_stats))
+				return FALSE;
+			reduce_stats->Row_Sum_List[y] = row_stats.Sum;
+			DpRt_Stats_Merge(&(reduce_stats->Band_Stats_List[band_index]),&row_stats);
+		}
+	}
+	else if(!DpRt_Stats_Calculate_Rows_Masked(reduce_stats->Data,reduce_stats->Encoding,reduce_stats->Naxis_One,
+						  start_y,end_y,reduce_stats->Mask,0,reduce_stats->Saturation_Level,
+						  &(reduce_stats->Band_Stats_List[band_index])))
+		return FALSE;
+	if(histogram != NULL)
+	{
+		DpRt_Histogram_Add_Masked(histogram,reduce_stats->Data,reduce_stats->Encoding,
+					  ((size_t)start_y)*((size_t)reduce_stats->Naxis_One),
+					  ((size_t)(end_y-start_y))*((size_t)reduce_stats->Naxis_One),
+					  reduce_stats->Mask,((size_t)start_y)*((size_t)reduce_stats->Naxis_One));
+	}
+	return TRUE;
+}
+
+/**
+ * Compute the statistics of a band of rows of a frame, calibrating it on the fly. Each row is calibrated a chunk
+ * at a time into a buffer on the stack, the chunk's statistics are computed by the selected statistics kernel,
+ * and merged into the band's statistics (with the maximum's position moved to the chunk's place in the frame).
+ * If overscan is in use, only the band's rows and columns within the data section are calibrated, and the
+ * overscan levels of each group of DPRT_OVERSCAN_ROW_GROUP_COUNT rows are computed just before the group is
+ * calibrated, whilst it's overscan pixels are about to be read anyway. The pixels are raised by the reduction's
+ * pedestal as they are calibrated, so the band's statistics include it. Each chunk's sum is added to it's row's
+ * sum, if they are wanted, and the pedestal is taken off each row's sum once the row is done. The chunk's bits of
+ * the bad pixel mask are passed to the statistics kernel and histogram, so bad pixels (which calibration has set
+ * to zero) are left out.
+ * @param reduce_stats The reduction structure, holding the frame, calibration frames and overscan sections.
+ * @param start_y The first row of the band.
+ * @param end_y One more than the last row of the band.
+ * @param stats The address of a structure to fill with the band's statistics.
+ * @param histogram The histogram to add the calibrated chunks to, or NULL.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_calibration.html#DPRT_CALIBRATION_CHUNK_PIXELS
+ * @see dprt_calibration.html#DpRt_Calibration_Apply_Pixels
+ * @see dprt_overscan.html#DPRT_OVERSCAN_ROW_GROUP_COUNT
+ * @see dprt_overscan.html#DpRt_Overscan_Get_Levels
+ * @see dprt_histogram.html#DpRt_Histogram_Add_Masked
+ * @see dprt_stats.html#DpRt_Stats_Calculate_Rows_Masked
+ * @see dprt_stats.html#DpRt_Stats_Merge
+ */
+static int Reduce_Calibrated_Stats_Rows(struct Reduce_Stats_Struct *reduce_stats,int start_y,int end_y,
+					struct DpRt_Stats_Struct *stats,struct DpRt_Histogram_Struct *histogram)
+{
+	struct DpRt_Stats_Struct chunk_stats;
+	unsigned short chunk[DPRT_CALIBRATION_CHUNK_PIXELS];
+	float level_list[DPRT_OVERSCAN_ROW_GROUP_COUNT];
+	unsigned long long row_sum,row_count,pedestal_sum;
+	size_t row_start;
+	int chunk_count,start_x,end_x,group_y,group_count,x,y;
+
+	memset(stats,0,sizeof(struct DpRt_Stats_Struct));
+	stats->Max_Y = start_y;
+	start_x = 0;
+	end_x = reduce_stats->Naxis_One;
+	if(reduce_stats->Overscan != NULL)
+	{
+		start_x = reduce_stats->Overscan->Trim_Start_X;
+		end_x = reduce_stats->Overscan->Trim_End_X;
+		if(start_y < reduce_stats->Overscan->Trim_Start_Y)
+			start_y = reduce_stats->Overscan->Trim_Start_Y;
+		if(end_y > reduce_stats->Overscan->Trim_End_Y)
+			end_y = reduce_stats->Overscan->Trim_End_Y;
+	}
+	for(group_y=start_y;group_y<end_y;group_y+=group_count)
+	{
+		group_count = end_y-group_y;
+		if(group_count > DPRT_OVERSCAN_ROW_GROUP_COUNT)
+			group_count = DPRT_OVERSCAN_ROW_GROUP_COUNT;
+		if(reduce_stats->Overscan != NULL)
+		{
+			if(!DpRt_Overscan_Get_Levels(reduce_stats->Overscan,reduce_stats->Data,reduce_stats->Encoding,
+						     reduce_stats->Naxis_One,group_y,group_count,reduce_stats->Bias,
+						     level_list))
+				return FALSE;
+		}
+		else
+		{
+			for(y=0;y<group_count;y++)
+				level_list[y] = 0.0f;
+		}
+		for(y=group_y;y<group_y+group_count;y++)
+		{
+			row_start = ((size_t)y)*((size_t)reduce_stats->Naxis_One);
+			row_sum = 0;
+			row_count = 0;
+			for(x=start_x;x<end_x;x+=chunk_count)
+			{
+				chunk_count = end_x-x;
+				if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+					chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+				DpRt_Calibration_Apply_Pixels(reduce_stats->Data,reduce_stats->Encoding,row_start+x,
+							      (size_t)chunk_count,
+							      level_list[y-group_y]-((float)reduce_stats->Pedestal),
+							      reduce_stats->Bias,reduce_stats->Flat,reduce_stats->Mask,
+							      chunk);
+				if(!DpRt_Stats_Calculate_Rows_Masked(chunk,DPRT_STATS_ENCODING_NATIVE,chunk_count,0,1,
+								     reduce_stats->Mask,row_start+x,
+								     reduce_stats->Saturation_Level,&chunk_stats))
+					return FALSE;
+				chunk_stats.Max_X += x;
+				chunk_stats.Max_Y = y;
+				DpRt_Stats_Merge(stats,&chunk_stats);
+				row_sum += chunk_stats.Sum;
+				row_count += chunk_stats.Pixel_Count;
+				if(histogram != NULL)
+				{
+					DpRt_Histogram_Add_Masked(histogram,chunk,DPRT_STATS_ENCODING_NATIVE,0,
+								  (size_t)chunk_count,reduce_stats->Mask,row_start+x);
+				}
+			}
+			if(reduce_stats->Row_Sum_List != NULL)
+			{
+				pedestal_sum = ((unsigned long long)reduce_stats->Pedestal)*row_count;
+				reduce_stats->Row_Sum_List[y] = (row_sum > pedestal_sum) ? row_sum-pedestal_sum : 0;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,952 @@
+/* dprt_source.c
+** Detection and measurement of the brightest sources in a frame.
+** $Header$
+*/
+/**
+ * dprt_source.c finds the brightest stars in a frame, and measures their centroids and FWHMs, so the seeing
+ * and the position of the brightest object are real measurements.
+ * Detection is a pass over the frame in bands of rows on the thread pool. Each band calibrates it's rows on the
+ * fly (overscan, bias, flat and bad pixel mask, as the fused statistics pass does), three rows at a time, skips
+ * rows with no pixel above the detection threshold (sky plus a number of sky standard deviations), and keeps the
+ * brightest local maxima with enough neighbouring pixels above the threshold (rejecting most cosmic rays and hot
+ * pixels) in a short per-band list, ranked by the sky subtracted counts in the 3x3 pixels around the peak.
+ * The band lists are merged in order of brightness, skipping peaks close to a brighter one, until the
+ * wanted number of sources is reached. Each source is then measured in a small stamp around it's peak, using
+ * Gaussian weighted moments: the weighted centroid, and a Gaussian width solved from the weighted second moment,
+ * iterated a few times starting from the half maximum area.
+ * The same pass also finds the brightest peak in box summed pixels, for acquisition. Each band keeps the sums of
+ * it's last few rows in each column, so the box sums are a sliding window along those column sums, without an
+ * extra frame sized buffer. A box only replaces the band's brightest if it's brightest pixel holds no more of the
+ * box's counts than a point spread function of the configured width would, which rejects cosmic rays and hot
+ * pixels however bright they are.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_stats.h"
+#include "dprt_thread_pool.h"
+#include "dprt_reduce.h"
+#include "dprt_calibration.h"
+#include "dprt_overscan.h"
+#include "dprt_source.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of Gaussian weighted moment iterations used to measure each source.
+ */
+#define SOURCE_MEASURE_ITERATIONS	(4)
+/**
+ * The ratio of the FWHM to the standard deviation of a Gaussian, 2 sqrt(2 ln 2).
+ */
+#define SOURCE_FWHM_PER_SIGMA		(2.35482)
+/**
+ * The width of a stamp (and the maximum number of pixels in a stamp row).
+ */
+#define SOURCE_STAMP_WIDTH		((2*DPRT_SOURCE_MAX_STAMP_RADIUS)+1)
+/**
+ * The smallest box the peak finder sums pixels over, which is also the number of rows the detection needs.
+ */
+#define SOURCE_MIN_BOX_SIZE		(3)
+/**
+ * The number of box sums computed at a time, with vectorisable loops over the column sums.
+ */
+#define SOURCE_BOX_CHUNK_PIXELS		(256)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the sources found in one band of rows, brightest first.
+ * <dl>
+ * <dt>Count</dt> <dd>The number of sources in Source_List.</dd>
+ * <dt>Source_List</dt> <dd>The sources, in order of decreasing Flux (3x3 counts).</dd>
+ * <dt>Peak</dt> <dd>The brightest box in the band that was not rejected as too narrow.</dd>
+ * <dt>Box_Sum</dt> <dd>The (not sky subtracted) box sum of Peak, if it was found.</dd>
+ * </dl>
+ */
+struct Source_Band_Struct
+{
+	int Count;
+	struct DpRt_Source_Struct Source_List[DPRT_SOURCE_MAX_COUNT];
+	struct DpRt_Source_Peak_Struct Peak;
+	int Box_Sum;
+};
+
+/**
+ * Structure holding the data needed to find the sources in each band of a frame.
+ * <dl>
+ * <dt>Frame</dt> <dd>The frame, and it's calibration.</dd>
+ * <dt>Parameters</dt> <dd>The detection parameters.</dd>
+ * <dt>Sky</dt> <dd>The sky level, in calibrated counts.</dd>
+ * <dt>Threshold</dt> <dd>A pixel must be greater than this to be detected.</dd>
+ * <dt>Box_Size</dt> <dd>The width and height of the peak finder's box, an odd number. This is also the number of
+ *     calibrated rows each thread keeps.</dd>
+ * <dt>Box_Threshold</dt> <dd>A box sum must be greater than this to be a peak.</dd>
+ * <dt>Box_Fraction</dt> <dd>The largest fraction of a box's sky subtracted counts it's brightest pixel may hold.</dd>
+ * <dt>Start_X</dt> <dd>The first column searched (the start of the data section).</dd>
+ * <dt>Width</dt> <dd>The number of columns searched.</dd>
+ * <dt>Start_Y</dt> <dd>The first row searched (the start of the data section).</dd>
+ * <dt>End_Y</dt> <dd>One more than the last row searched.</dd>
+ * <dt>Band_Rows</dt> <dd>The number of rows in each band (the last band may be smaller).</dd>
+ * <dt>Band_List</dt> <dd>A list of the sources found in each band, held in the context's scratch buffer.</dd>
+ * <dt>Row_List</dt> <dd>Box_Size rows of Width calibrated pixels per thread, held in the context's scratch
+ *     buffer.</dd>
+ * <dt>Column_Sum_List</dt> <dd>Width column sums (of the rows in Row_List) per thread, held in the context's scratch
+ *     buffer.</dd>
+ * <dt>Context</dt> <dd>The context of the thread that started the search, whose abort flag the bands check.</dd>
+ * <dt>Aborted</dt> <dd>A boolean, set to TRUE by any band that saw the abort flag set.</dd>
+ * </dl>
+ */
+struct Source_Find_Struct
+{
+	struct DpRt_Source_Frame_Struct *Frame;
+	struct DpRt_Source_Parameter_Struct *Parameters;
+	double Sky;
+	int Threshold;
+	int Box_Size;
+	int Box_Threshold;
+	double Box_Fraction;
+	int Start_X;
+	int Width;
+	int Start_Y;
+	int End_Y;
+	int Band_Rows;
+	struct Source_Band_Struct *Band_List;
+	unsigned short *Row_List;
+	int *Column_Sum_List;
+	DpRt_Context *Context;
+	volatile int Aborted;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Source_Find_Band(void *user_data,int band_index,int thread_index);
+static void Source_Band_Add(struct Source_Band_Struct *band,int max_count,struct DpRt_Source_Struct *source);
+static int Source_Is_Brighter(struct DpRt_Source_Struct *source,struct DpRt_Source_Struct *other_source);
+static int Source_Box_Check(struct Source_Find_Struct *find,unsigned short *row_list,int first_y,int y,int x,
+			    int box_sum,struct Source_Band_Struct *band);
+static int Source_Get_Box_Size(double psf_fwhm);
+static int Source_Get_Row(struct DpRt_Source_Frame_Struct *frame,int y,int start_x,int pixel_count,
+			  unsigned short *row);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the source detection and measurement parameters from the configuration ("dprt.source.max_count",
+ * "dprt.source.detect_sigma", "dprt.source.min_pixels", "dprt.source.stamp_radius", "dprt.source.min_fwhm" and
+ * "dprt.source.peak.psf_fwhm").
+ * @param saturation_level Sources with a peak greater than or equal to this are saturated.
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_SOURCE_MAX_COUNT
+ * @see #DPRT_SOURCE_MAX_STAMP_RADIUS
+ * @see #DPRT_SOURCE_MAX_BOX_SIZE
+ * @see #Source_Get_Box_Size
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Source_Get_Parameters(int saturation_level,struct DpRt_Source_Parameter_Struct *parameters)
+{
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 1600;
+		sprintf(DpRt_Error_String,"DpRt_Source_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Integer("dprt.source.max_count",&(parameters->Max_Count)))||
+	   (!DpRt_Config_Get_Double("dprt.source.detect_sigma",&(parameters->Detect_Sigma)))||
+	   (!DpRt_Config_Get_Integer("dprt.source.min_pixels",&(parameters->Min_Pixels)))||
+	   (!DpRt_Config_Get_Integer("dprt.source.stamp_radius",&(parameters->Stamp_Radius)))||
+	   (!DpRt_Config_Get_Double("dprt.source.min_fwhm",&(parameters->Min_FWHM)))||
+	   (!DpRt_Config_Get_Double("dprt.source.peak.psf_fwhm",&(parameters->PSF_FWHM))))
+		return FALSE;
+	if((parameters->Max_Count < 1)||(parameters->Max_Count > DPRT_SOURCE_MAX_COUNT)||
+	   (parameters->Stamp_Radius < 1)||(parameters->Stamp_Radius > DPRT_SOURCE_MAX_STAMP_RADIUS)||
+	   (parameters->Min_Pixels < 0)||(parameters->Min_Pixels > 8))
+	{
+		DpRt_Error_Number = 1601;
+		sprintf(DpRt_Error_String,"DpRt_Source_Get_Parameters:Illegal max count %d (1..%d), "
+			"stamp radius %d (1..%d) or min pixels %d (0..8).\n",parameters->Max_Count,
+			DPRT_SOURCE_MAX_COUNT,parameters->Stamp_Radius,DPRT_SOURCE_MAX_STAMP_RADIUS,
+			parameters->Min_Pixels);
+		return FALSE;
+	}
+	if((parameters->PSF_FWHM <= 0.0)||(parameters->PSF_FWHM > DPRT_SOURCE_MAX_BOX_SIZE)||
+	   (Source_Get_Box_Size(parameters->PSF_FWHM) > DPRT_SOURCE_MAX_BOX_SIZE))
+	{
+		DpRt_Error_Number = 1608;
+		sprintf(DpRt_Error_String,"DpRt_Source_Get_Parameters:Illegal peak PSF FWHM %.2f (the box can be at "
+			"most %d pixels).\n",parameters->PSF_FWHM,DPRT_SOURCE_MAX_BOX_SIZE);
+		return FALSE;
+	}
+	parameters->Saturation_Level = saturation_level;
+	return TRUE;
+}
+
+/**
+ * Find and measure the brightest sources in a frame. The frame is searched in bands of rows on the thread pool,
+ * the band's candidates merged brightest first (skipping candidates within the stamp radius of a brighter one),
+ * and each source measured with DpRt_Source_Measure. Sources narrower than Min_FWHM, or which could not be
+ * measured, are thrown away. The per-band lists and per-thread row buffers are kept in a scratch buffer of the
+ * calling thread's current context.
+ * The brightest peak is found in the same pass (see Source_Find_Band): the brightest box of the bands that was
+ * not too narrow. It's centroid, the first moment of the box, is refined by measuring it with DpRt_Source_Measure.
+ * Peaks and sources are only looked for at least half a box from the edge of the data section.
+ * @param frame The frame, and it's calibration.
+ * @param sky The sky level of the (calibrated) frame.
+ * @param sky_sigma The standard deviation of the sky.
+ * @param parameters The detection and measurement parameters.
+ * @param source_list A list of at least parameters->Max_Count sources, filled in brightest (Flux) first.
+ * @param source_count The address of an integer to store the number of sources found.
+ * @param peak The address of a structure to store the brightest peak in, or NULL if it is not wanted.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #Source_Find_Struct
+ * @see #Source_Get_Box_Size
+ * @see #Source_Find_Band
+ * @see #Source_Is_Brighter
+ * @see #DpRt_Source_Measure
+ * @see dprt_reduce.html#DpRt_Reduce_Get_Band_Rows
+ * @see dprt_thread_pool.html#DpRt_Thread_Pool_Run
+ * @see dprt_context.html#DpRt_Context_Get_Scratch
+ * @see dprt_context.html#DPRT_CONTEXT_SCRATCH_SOURCE
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Source_Find(struct DpRt_Source_Frame_Struct *frame,double sky,double sky_sigma,
+		     struct DpRt_Source_Parameter_Struct *parameters,struct DpRt_Source_Struct *source_list,
+		     int *source_count,struct DpRt_Source_Peak_Struct *peak)
+{
+	struct Source_Find_Struct find;
+	struct DpRt_Source_Struct source;
+	struct DpRt_Source_Peak_Struct *band_peak = NULL;
+	int *band_cursor_list = NULL;
+	double dx,dy,radius_squared,sigma,box_threshold;
+	size_t band_list_size;
+	int end_x,band_count,thread_count,best_band,blended,half_box,retval,i,j;
+
+	if((frame == NULL)||(frame->Data == NULL)||(parameters == NULL)||(source_list == NULL)||
+	   (source_count == NULL))
+	{
+		DpRt_Error_Number = 1602;
+		sprintf(DpRt_Error_String,"DpRt_Source_Find:Illegal arguments.\n");
+		return FALSE;
+	}
+	(*source_count) = 0;
+	if(peak != NULL)
+		peak->Found = FALSE;
+	find.Box_Size = Source_Get_Box_Size(parameters->PSF_FWHM);
+	if(find.Box_Size > DPRT_SOURCE_MAX_BOX_SIZE)
+		find.Box_Size = DPRT_SOURCE_MAX_BOX_SIZE;
+	half_box = find.Box_Size/2;
+	DpRt_Source_Get_Section(frame,&(find.Start_X),&end_x,&(find.Start_Y),&(find.End_Y));
+	find.Width = end_x-find.Start_X;
+	/* peaks need half a box on each side */
+	if((find.Width < find.Box_Size)||((find.End_Y-find.Start_Y) < find.Box_Size))
+		return TRUE;
+	find.Frame = frame;
+	find.Parameters = parameters;
+	find.Sky = sky;
+	find.Threshold = (int)(sky+(parameters->Detect_Sigma*sky_sigma));
+	/* a box sum must be Detect_Sigma box sum standard deviations above the sky */
+	box_threshold = (((double)(find.Box_Size*find.Box_Size))*sky)+
+		(parameters->Detect_Sigma*((double)find.Box_Size)*sky_sigma);
+	if(box_threshold > ((double)(find.Box_Size*find.Box_Size*65535)))
+		box_threshold = (double)(find.Box_Size*find.Box_Size*65535);
+	find.Box_Threshold = (int)box_threshold;
+	/* the fraction of a Gaussian of the PSF's FWHM, centred in the box, held by the central pixel */
+	sigma = parameters->PSF_FWHM/SOURCE_FWHM_PER_SIGMA;
+	find.Box_Fraction = erf(0.5/(sigma*M_SQRT2))/erf((((double)find.Box_Size)/2.0)/(sigma*M_SQRT2));
+	find.Box_Fraction *= find.Box_Fraction;
+	find.Band_Rows = DpRt_Reduce_Get_Band_Rows();
+	band_count = ((find.End_Y-find.Start_Y-(2*half_box))+find.Band_Rows-1)/find.Band_Rows;
+	thread_count = DpRt_Thread_Pool_Get_Thread_Count();
+	if(thread_count < 1)
+		thread_count = 1;
+	find.Aborted = FALSE;
+	find.Context = DpRt_Context_Get_Current();
+	/* the band lists, then the per-band merge cursors, then the per-thread column sums and row buffers */
+	band_list_size = band_count*sizeof(struct Source_Band_Struct);
+	band_list_size += band_count*sizeof(int);
+	band_list_size = (band_list_size+sizeof(double)-1)&(~(sizeof(double)-1));
+	if(!DpRt_Context_Get_Scratch(find.Context,DPRT_CONTEXT_SCRATCH_SOURCE,
+				     band_list_size+(thread_count*find.Width*sizeof(int))+
+				     (thread_count*find.Box_Size*find.Width*sizeof(unsigned short)),
+				     (void **)&(find.Band_List)))
+	{
+		DpRt_Error_Number = 1603;
+		sprintf(DpRt_Error_String,"DpRt_Source_Find:Failed to allocate %d band lists.\n",band_count);
+		return FALSE;
+	}
+	band_cursor_list = (int *)(&(find.Band_List[band_count]));
+	find.Column_Sum_List = (int *)(((char *)find.Band_List)+band_list_size);
+	find.Row_List = (unsigned short *)(find.Column_Sum_List+(((size_t)thread_count)*((size_t)find.Width)));
+	retval = DpRt_Thread_Pool_Run(band_count,Source_Find_Band,&find);
+	if(find.Aborted)
+	{
+		DpRt_Error_Number = 1604;
+		sprintf(DpRt_Error_String,"DpRt_Source_Find:Operation Aborted.\n");
+		return FALSE;
+	}
+	if(retval == FALSE)
+	{
+		DpRt_Error_Number = 1605;
+		sprintf(DpRt_Error_String,"DpRt_Source_Find:Failed to search bands.\n");
+		return FALSE;
+	}
+	/* the brightest peak of the bands, ranked in the same way as the sources */
+	if(peak != NULL)
+	{
+		band_peak = NULL;
+		for(i=0;i<band_count;i++)
+		{
+			if(find.Band_List[i].Peak.Found == FALSE)
+				continue;
+			if((band_peak == NULL)||(find.Band_List[i].Peak.Flux > band_peak->Flux)||
+			   ((find.Band_List[i].Peak.Flux == band_peak->Flux)&&
+			    ((find.Band_List[i].Peak.Peak_Y < band_peak->Peak_Y)||
+			     ((find.Band_List[i].Peak.Peak_Y == band_peak->Peak_Y)&&
+			      (find.Band_List[i].Peak.Peak_X < band_peak->Peak_X)))))
+				band_peak = &(find.Band_List[i].Peak);
+		}
+		if(band_peak != NULL)
+		{
+			(*peak) = (*band_peak);
+			if(sky_sigma > 0.0)
+				peak->Confidence = peak->Flux/(((double)find.Box_Size)*sky_sigma);
+			else
+				peak->Confidence = 0.0;
+			/* refine the box centroid */
+			source.Peak_X = peak->Peak_X;
+			source.Peak_Y = peak->Peak_Y;
+			if(!DpRt_Source_Measure(frame,sky,parameters,&source))
+				return FALSE;
+			if((source.FWHM > 0.0)&&(fabs(source.X-peak->X) <= ((double)half_box))&&
+			   (fabs(source.Y-peak->Y) <= ((double)half_box)))
+			{
+				peak->X = source.X;
+				peak->Y = source.Y;
+			}
+		}
+	}
+	/* merge the band lists brightest first, skipping peaks blended with a brighter one */
+	radius_squared = ((double)parameters->Stamp_Radius)*((double)parameters->Stamp_Radius);
+	for(i=0;i<band_count;i++)
+		band_cursor_list[i] = 0;
+	while((*source_count) < parameters->Max_Count)
+	{
+		best_band = -1;
+		for(i=0;i<band_count;i++)
+		{
+			if(band_cursor_list[i] >= find.Band_List[i].Count)
+				continue;
+			if((best_band < 0)||
+			   Source_Is_Brighter(&(find.Band_List[i].Source_List[band_cursor_list[i]]),
+					      &(find.Band_List[best_band].Source_List[band_cursor_list[best_band]])))
+				best_band = i;
+		}
+		if(best_band < 0)
+			break;
+		source = find.Band_List[best_band].Source_List[band_cursor_list[best_band]];
+		band_cursor_list[best_band]++;
+		blended = FALSE;
+		for(j=0;j<(*source_count);j++)
+		{
+			dx = (double)(source.Peak_X-source_list[j].Peak_X);
+			dy = (double)(source.Peak_Y-source_list[j].Peak_Y);
+			if(((dx*dx)+(dy*dy)) <= radius_squared)
+				blended = TRUE;
+		}
+		if(blended == FALSE)
+		{
+			source_list[(*source_count)] = source;
+			(*source_count)++;
+		}
+	}
+	/* measure the sources, keeping the ones that look like stars */
+	j = 0;
+	for(i=0;i<(*source_count);i++)
+	{
+		if(!DpRt_Source_Measure(frame,sky,parameters,&(source_list[i])))
+			return FALSE;
+		if(source_list[i].FWHM >= parameters->Min_FWHM)
+		{
+			source_list[j] = source_list[i];
+			j++;
+		}
+	}
+	(*source_count) = j;
+	/* sort by measured flux, brightest first (insertion sort, the list is short) */
+	for(i=1;i<(*source_count);i++)
+	{
+		source = source_list[i];
+		for(j=i-1;(j >= 0)&&Source_Is_Brighter(&source,&(source_list[j]));j--)
+			source_list[j+1] = source_list[j];
+		source_list[j+1] = source;
+	}
+	return TRUE;
+}
+
+/**
+ * Measure a source in a stamp of parameters->Stamp_Radius pixels around it's peak (clipped to the data section).
+ * The stamp is calibrated and sky subtracted. The starting Gaussian width is from the area of the pixels above half
+ * the peak. Each iteration then computes the Gaussian weighted centroid and second moment of the stamp about
+ * it, within the stamp radius. For a Gaussian source of width sigma and a weight of width s, the weighted second
+ * moment is m = 2 sigma^2 s^2/(sigma^2+s^2), so sigma^2 = m s^2/(2 s^2 - m), which is used as the next weight.
+ * If the source cannot be measured (no positive weighted counts), it's FWHM is set to zero.
+ * @param frame The frame, and it's calibration.
+ * @param sky The sky level of the (calibrated) frame.
+ * @param parameters The measurement parameters.
+ * @param source The source, whose Peak_X and Peak_Y must be set. The other fields are filled in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #SOURCE_MEASURE_ITERATIONS
+ * @see #SOURCE_FWHM_PER_SIGMA
+ * @see #SOURCE_STAMP_WIDTH
+ * @see #Source_Get_Row
+ * @see #DpRt_Source_Get_Section
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Source_Measure(struct DpRt_Source_Frame_Struct *frame,double sky,
+			struct DpRt_Source_Parameter_Struct *parameters,struct DpRt_Source_Struct *source)
+{
+	unsigned short row[SOURCE_STAMP_WIDTH];
+	float stamp[SOURCE_STAMP_WIDTH*SOURCE_STAMP_WIDTH];
+	double centre_x,centre_y,width,weight,weighted,sum_weighted,sum_x,sum_y,sum_r,moment_x,moment_y,moment;
+	double radius_squared,dx,dy,r,sigma_squared,half_maximum,flux;
+	int start_x,end_x,start_y,end_y,stamp_start_x,stamp_start_y,stamp_width,stamp_height;
+	int area,iteration,x,y;
+
+	if((frame == NULL)||(parameters == NULL)||(source == NULL)||(parameters->Stamp_Radius < 1)||
+	   (parameters->Stamp_Radius > DPRT_SOURCE_MAX_STAMP_RADIUS))
+	{
+		DpRt_Error_Number = 1606;
+		sprintf(DpRt_Error_String,"DpRt_Source_Measure:Illegal arguments.\n");
+		return FALSE;
+	}
+	DpRt_Source_Get_Section(frame,&start_x,&end_x,&start_y,&end_y);
+	stamp_start_x = source->Peak_X-parameters->Stamp_Radius;
+	if(stamp_start_x < start_x)
+		stamp_start_x = start_x;
+	stamp_width = source->Peak_X+parameters->Stamp_Radius+1;
+	if(stamp_width > end_x)
+		stamp_width = end_x;
+	stamp_width -= stamp_start_x;
+	stamp_start_y = source->Peak_Y-parameters->Stamp_Radius;
+	if(stamp_start_y < start_y)
+		stamp_start_y = start_y;
+	stamp_height = source->Peak_Y+parameters->Stamp_Radius+1;
+	if(stamp_height > end_y)
+		stamp_height = end_y;
+	stamp_height -= stamp_start_y;
+	source->X = (double)source->Peak_X;
+	source->Y = (double)source->Peak_Y;
+	source->Peak = 0.0;
+	source->Flux = 0.0;
+	source->FWHM = 0.0;
+	source->Saturated = FALSE;
+	if((stamp_width < 1)||(stamp_height < 1))
+		return TRUE;
+	/* calibrate and sky subtract the stamp */
+	for(y=0;y<stamp_height;y++)
+	{
+		if(!Source_Get_Row(frame,stamp_start_y+y,stamp_start_x,stamp_width,row))
+			return FALSE;
+		for(x=0;x<stamp_width;x++)
+			stamp[(y*stamp_width)+x] = ((float)row[x])-((float)sky);
+		if((stamp_start_y+y) == source->Peak_Y)
+			source->Peak = (double)row[source->Peak_X-stamp_start_x];
+	}
+	source->Saturated = (source->Peak >= ((double)parameters->Saturation_Level));
+	/* starting width, from the area above half maximum */
+	half_maximum = (source->Peak-sky)/2.0;
+	area = 0;
+	for(x=0;x<(stamp_width*stamp_height);x++)
+	{
+		if(stamp[x] >= half_maximum)
+			area++;
+	}
+	width = (2.0*sqrt(((double)area)/M_PI))/SOURCE_FWHM_PER_SIGMA;
+	if(width < 0.5)
+		width = 0.5;
+	/* Gaussian weighted moments */
+	radius_squared = ((double)parameters->Stamp_Radius)*((double)parameters->Stamp_Radius);
+	centre_x = (double)(source->Peak_X-stamp_start_x);
+	centre_y = (double)(source->Peak_Y-stamp_start_y);
+	for(iteration=0;iteration<SOURCE_MEASURE_ITERATIONS;iteration++)
+	{
+		sum_weighted = 0.0;
+		sum_x = 0.0;
+		sum_y = 0.0;
+		sum_r = 0.0;
+		for(y=0;y<stamp_height;y++)
+		{
+			dy = ((double)y)-centre_y;
+			for(x=0;x<stamp_width;x++)
+			{
+				dx = ((double)x)-centre_x;
+				r = (dx*dx)+(dy*dy);
+				if(r > radius_squared)
+					continue;
+				weight = exp(-r/(2.0*width*width));
+				weighted = weight*stamp[(y*stamp_width)+x];
+				sum_weighted += weighted;
+				sum_x += weighted*dx;
+				sum_y += weighted*dy;
+				sum_r += weighted*r;
+			}
+		}
+		if(sum_weighted <= 0.0)
+			return TRUE;
+		moment_x = sum_x/sum_weighted;
+		moment_y = sum_y/sum_weighted;
+		/* the second moment about the weighted centroid */
+		moment = (sum_r/sum_weighted)-((moment_x*moment_x)+(moment_y*moment_y));
+		centre_x += moment_x;
+		centre_y += moment_y;
+		if((moment > 0.0)&&((2.0*width*width) > moment))
+		{
+			sigma_squared = (moment*width*width)/((2.0*width*width)-moment);
+			width = sqrt(sigma_squared);
+		}
+		if(width < 0.3)
+			width = 0.3;
+		if(width > ((double)parameters->Stamp_Radius))
+			width = (double)parameters->Stamp_Radius;
+	}
+	/* the sky subtracted counts within the stamp radius */
+	flux = 0.0;
+	for(y=0;y<stamp_height;y++)
+	{
+		dy = ((double)y)-centre_y;
+		for(x=0;x<stamp_width;x++)
+		{
+			dx = ((double)x)-centre_x;
+			if(((dx*dx)+(dy*dy)) <= radius_squared)
+				flux += stamp[(y*stamp_width)+x];
+		}
+	}
+	source->X = ((double)stamp_start_x)+centre_x;
+	source->Y = ((double)stamp_start_y)+centre_y;
+	source->Flux = flux;
+	source->FWHM = SOURCE_FWHM_PER_SIGMA*width;
+	return TRUE;
+}
+
+/**
+ * Work out the typical FWHM of a list of sources: the median FWHM of the sources that are not saturated.
+ * @param source_list The list of sources.
+ * @param source_count The number of sources in the list.
+ * @param fwhm The address of a double to store the median FWHM in pixels, or zero if there are no
+ *        unsaturated sources.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Source_Get_FWHM(struct DpRt_Source_Struct *source_list,int source_count,double *fwhm)
+{
+	double fwhm_list[DPRT_SOURCE_MAX_COUNT];
+	double value;
+	int count,i,j;
+
+	if(((source_list == NULL)&&(source_count > 0))||(source_count > DPRT_SOURCE_MAX_COUNT)||(fwhm == NULL))
+	{
+		DpRt_Error_Number = 1607;
+		sprintf(DpRt_Error_String,"DpRt_Source_Get_FWHM:Illegal arguments (%d sources).\n",source_count);
+		return FALSE;
+	}
+	count = 0;
+	for(i=0;i<source_count;i++)
+	{
+		if(source_list[i].Saturated)
+			continue;
+		value = source_list[i].FWHM;
+		for(j=count-1;(j >= 0)&&(fwhm_list[j] > value);j--)
+			fwhm_list[j+1] = fwhm_list[j];
+		fwhm_list[j+1] = value;
+		count++;
+	}
+	(*fwhm) = 0.0;
+	if(count == 0)
+		return TRUE;
+	if((count%2) == 1)
+		(*fwhm) = fwhm_list[count/2];
+	else
+		(*fwhm) = (fwhm_list[(count/2)-1]+fwhm_list[count/2])/2.0;
+	return TRUE;
+}
+
+/**
+ * Get the section of a frame sources are found and measured in (and spectra traced and extracted from): the data
+ * section if overscan is in use, otherwise the whole frame.
+ * @param frame The frame.
+ * @param start_x The address of an integer to store the first column.
+ * @param end_x The address of an integer to store one more than the last column.
+ * @param start_y The address of an integer to store the first row.
+ * @param end_y The address of an integer to store one more than the last row.
+ */
+void DpRt_Source_Get_Section(struct DpRt_Source_Frame_Struct *frame,int *start_x,int *end_x,int *start_y,
+			     int *end_y)
+{
+	if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+	{
+		(*start_x) = frame->Overscan->Trim_Start_X;
+		(*end_x) = frame->Overscan->Trim_End_X;
+		(*start_y) = frame->Overscan->Trim_Start_Y;
+		(*end_y) = frame->Overscan->Trim_End_Y;
+	}
+	else
+	{
+		(*start_x) = 0;
+		(*end_x) = frame->Naxis_One;
+		(*start_y) = 0;
+		(*end_y) = frame->Naxis_Two;
+	}
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Thread pool task function, finding the brightest peaks in one band of rows. Box_Size calibrated rows are kept
+ * in the thread's row buffers (the row being searched and half a box either side), with their sums in each column.
+ * The row being searched is skipped unless it's maximum is above the threshold.
+ * A peak must be above the threshold, greater than the neighbours before it (in row-major order) and at least
+ * as great as the ones after it, and have at least Min_Pixels neighbours above the threshold.
+ * The box sums centred on the row are computed from the column sums a chunk at a time, and only if the greatest
+ * column sum could make a box brighter than the band's brightest (and Box_Threshold). Each box in a chunk that
+ * is brighter is checked with Source_Box_Check.
+ * The abort flag of the search's context is checked before the band is started.
+ * @param user_data A pointer to the Source_Find_Struct describing the search.
+ * @param band_index The index of the band to search.
+ * @param thread_index The index of the thread running the task, used to select it's row buffers.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed or was aborted.
+ * @see #SOURCE_BOX_CHUNK_PIXELS
+ * @see #Source_Find_Struct
+ * @see #Source_Get_Row
+ * @see #Source_Band_Add
+ * @see #Source_Box_Check
+ * @see dprt_context.html#DpRt_Context_Get_Abort
+ */
+static int Source_Find_Band(void *user_data,int band_index,int thread_index)
+{
+	struct Source_Find_Struct *find = (struct Source_Find_Struct *)user_data;
+	struct Source_Band_Struct *band = &(find->Band_List[band_index]);
+	struct DpRt_Source_Struct source;
+	unsigned short *row_list = NULL;
+	unsigned short *previous_row = NULL;
+	unsigned short *row = NULL;
+	unsigned short *next_row = NULL;
+	unsigned short *new_row = NULL;
+	int *column_sum_list = NULL;
+	int box_sum_list[SOURCE_BOX_CHUNK_PIXELS];
+	unsigned short threshold,row_max,value;
+	int start_y,end_y,first_y,width,box_size,half_box,box_limit,box_max,column_max,neighbour_count,sum;
+	int chunk_count,i,j,x,y;
+
+	band->Count = 0;
+	band->Peak.Found = FALSE;
+	band->Box_Sum = 0;
+	if(find->Aborted || DpRt_Context_Get_Abort(find->Context))
+	{
+		find->Aborted = TRUE;
+		return FALSE;
+	}
+	/* peaks are searched for in rows which have half a box either side */
+	box_size = find->Box_Size;
+	half_box = box_size/2;
+	start_y = find->Start_Y+half_box+(band_index*find->Band_Rows);
+	end_y = start_y+find->Band_Rows;
+	if(end_y > (find->End_Y-half_box))
+		end_y = find->End_Y-half_box;
+	width = find->Width;
+	if(find->Threshold < 0)
+		threshold = 0;
+	else if(find->Threshold > 65535)
+		threshold = 65535;
+	else
+		threshold = (unsigned short)find->Threshold;
+	/* row y is kept in row buffer (y-first_y)%box_size */
+	first_y = start_y-half_box;
+	row_list = find->Row_List+(((size_t)thread_index)*((size_t)box_size)*((size_t)width));
+	column_sum_list = find->Column_Sum_List+(((size_t)thread_index)*((size_t)width));
+	for(x=0;x<width;x++)
+		column_sum_list[x] = 0;
+	for(y=first_y;y<start_y+half_box;y++)
+	{
+		new_row = row_list+(((size_t)(y-first_y))*((size_t)width));
+		if(!Source_Get_Row(find->Frame,y,find->Start_X,width,new_row))
+			return FALSE;
+		for(x=0;x<width;x++)
+			column_sum_list[x] += new_row[x];
+	}
+	for(y=start_y;y<end_y;y++)
+	{
+		/* replace the row half a box before the last one with the row half a box after this one */
+		new_row = row_list+(((size_t)((y+half_box-first_y)%box_size))*((size_t)width));
+		if((y+half_box-first_y) >= box_size)
+		{
+			for(x=0;x<width;x++)
+				column_sum_list[x] -= new_row[x];
+		}
+		if(!Source_Get_Row(find->Frame,y+half_box,find->Start_X,width,new_row))
+			return FALSE;
+		column_max = 0;
+		for(x=0;x<width;x++)
+		{
+			column_sum_list[x] += new_row[x];
+			column_max = (column_sum_list[x] > column_max) ? column_sum_list[x] : column_max;
+		}
+		previous_row = row_list+(((size_t)((y-1-first_y)%box_size))*((size_t)width));
+		row = row_list+(((size_t)((y-first_y)%box_size))*((size_t)width));
+		next_row = row_list+(((size_t)((y+1-first_y)%box_size))*((size_t)width));
+		row_max = 0;
+		for(x=1;x<width-1;x++)
+			row_max = (row[x] > row_max) ? row[x] : row_max;
+		if(row_max > threshold)
+		{
+			for(x=1;x<width-1;x++)
+			{
+				value = row[x];
+				if(value <= threshold)
+					continue;
+				if((value <= previous_row[x-1])||(value <= previous_row[x])||(value <= previous_row[x+1])||
+				   (value <= row[x-1])||(value < row[x+1])||
+				   (value < next_row[x-1])||(value < next_row[x])||(value < next_row[x+1]))
+					continue;
+				neighbour_count = (previous_row[x-1] > threshold)+(previous_row[x] > threshold)+
+					(previous_row[x+1] > threshold)+(row[x-1] > threshold)+(row[x+1] > threshold)+
+					(next_row[x-1] > threshold)+(next_row[x] > threshold)+
+					(next_row[x+1] > threshold);
+				if(neighbour_count < find->Parameters->Min_Pixels)
+					continue;
+				sum = previous_row[x-1]+previous_row[x]+previous_row[x+1]+row[x-1]+row[x]+row[x+1]+
+					next_row[x-1]+next_row[x]+next_row[x+1];
+				source.Peak_X = find->Start_X+x;
+				source.Peak_Y = y;
+				source.X = (double)source.Peak_X;
+				source.Y = (double)source.Peak_Y;
+				source.Peak = (double)value;
+				source.Flux = ((double)sum)-(9.0*find->Sky);
+				source.FWHM = 0.0;
+				source.Saturated = FALSE;
+				Source_Band_Add(band,find->Parameters->Max_Count,&source);
+			}
+		}
+		/* box sums centred on this row, if any could be brighter than the band's brightest */
+		box_limit = find->Box_Threshold;
+		if(band->Peak.Found && (band->Box_Sum > box_limit))
+			box_limit = band->Box_Sum;
+		if((column_max*box_size) <= box_limit)
+			continue;
+		for(x=half_box;x<width-half_box;x+=chunk_count)
+		{
+			chunk_count = width-half_box-x;
+			if(chunk_count > SOURCE_BOX_CHUNK_PIXELS)
+				chunk_count = SOURCE_BOX_CHUNK_PIXELS;
+			for(i=0;i<chunk_count;i++)
+				box_sum_list[i] = column_sum_list[x-half_box+i];
+			for(j=1;j<box_size-1;j++)
+			{
+				for(i=0;i<chunk_count;i++)
+					box_sum_list[i] += column_sum_list[x-half_box+j+i];
+			}
+			box_max = 0;
+			for(i=0;i<chunk_count;i++)
+			{
+				box_sum_list[i] += column_sum_list[x+half_box+i];
+				box_max = (box_sum_list[i] > box_max) ? box_sum_list[i] : box_max;
+			}
+			if(box_max <= box_limit)
+				continue;
+			for(i=0;i<chunk_count;i++)
+			{
+				if(box_sum_list[i] <= box_limit)
+					continue;
+				if(Source_Box_Check(find,row_list,first_y,y,x+i,box_sum_list[i],band))
+					box_limit = box_sum_list[i];
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Add a source to a band's list, which is kept brightest first and no longer than max_count. If the list is full,
+ * the source is only added if it is brighter than the faintest source in the list, which is dropped.
+ * @param band The band's list.
+ * @param max_count The maximum length of the list.
+ * @param source The source to add.
+ * @see #Source_Is_Brighter
+ */
+static void Source_Band_Add(struct Source_Band_Struct *band,int max_count,struct DpRt_Source_Struct *source)
+{
+	int i;
+
+	if(band->Count == max_count)
+	{
+		if(!Source_Is_Brighter(source,&(band->Source_List[band->Count-1])))
+			return;
+		band->Count--;
+	}
+	for(i=band->Count-1;(i >= 0)&&Source_Is_Brighter(source,&(band->Source_List[i]));i--)
+		band->Source_List[i+1] = band->Source_List[i];
+	band->Source_List[i+1] = (*source);
+	band->Count++;
+}
+
+/**
+ * Return whether a source should be ranked before another: it has a greater Flux, or an equal Flux and comes
+ * first in row-major order. This makes the ranking independent of the order the bands were searched in.
+ * @param source The source.
+ * @param other_source The source to compare it with.
+ * @return TRUE if source is ranked before other_source, FALSE otherwise.
+ */
+static int Source_Is_Brighter(struct DpRt_Source_Struct *source,struct DpRt_Source_Struct *other_source)
+{
+	if(source->Flux != other_source->Flux)
+		return (source->Flux > other_source->Flux);
+	if(source->Peak_Y != other_source->Peak_Y)
+		return (source->Peak_Y < other_source->Peak_Y);
+	return (source->Peak_X < other_source->Peak_X);
+}
+
+/**
+ * Check whether a box brighter than a band's brightest peak is a peak, and if so make it the band's brightest.
+ * The box must have positive sky subtracted counts, and it's brightest pixel must not hold more than Box_Fraction
+ * of them, which rejects features narrower than the PSF (cosmic rays and hot pixels). The peak's centroid is the
+ * first moment of the box's (positive) sky subtracted pixels.
+ * @param find The search.
+ * @param row_list The thread's row buffers, holding the rows of the box.
+ * @param first_y The row held in the first row buffer, row y is in buffer (y-first_y)%Box_Size.
+ * @param y The row of the centre of the box.
+ * @param x The column of the centre of the box, relative to Start_X.
+ * @param box_sum The sum of the (calibrated) pixels in the box.
+ * @param band The band's list, whose Peak and Box_Sum are set if the box is a peak.
+ * @return The routine returns TRUE if the box is the band's new brightest peak, and FALSE if it was rejected.
+ * @see #Source_Find_Struct
+ */
+static int Source_Box_Check(struct Source_Find_Struct *find,unsigned short *row_list,int first_y,int y,int x,
+			    int box_sum,struct Source_Band_Struct *band)
+{
+	unsigned short *row = NULL;
+	double flux,value,sum,sum_x,sum_y;
+	int half_box,peak,i,j;
+
+	half_box = find->Box_Size/2;
+	flux = ((double)box_sum)-(((double)(find->Box_Size*find->Box_Size))*find->Sky);
+	if(flux <= 0.0)
+		return FALSE;
+	peak = 0;
+	sum = 0.0;
+	sum_x = 0.0;
+	sum_y = 0.0;
+	for(j=-half_box;j<=half_box;j++)
+	{
+		row = row_list+(((size_t)((y+j-first_y)%find->Box_Size))*((size_t)find->Width));
+		for(i=-half_box;i<=half_box;i++)
+		{
+			if(row[x+i] > peak)
+				peak = row[x+i];
+			value = ((double)row[x+i])-find->Sky;
+			if(value > 0.0)
+			{
+				sum += value;
+				sum_x += value*((double)i);
+				sum_y += value*((double)j);
+			}
+		}
+	}
+	if((((double)peak)-find->Sky) > (find->Box_Fraction*flux))
+		return FALSE;
+	band->Peak.Found = TRUE;
+	band->Peak.Peak_X = find->Start_X+x;
+	band->Peak.Peak_Y = y;
+	band->Peak.X = ((double)band->Peak.Peak_X)+(sum_x/sum);
+	band->Peak.Y = ((double)band->Peak.Peak_Y)+(sum_y/sum);
+	band->Peak.Peak = (double)peak;
+	band->Peak.Flux = flux;
+	band->Peak.Confidence = 0.0;
+	band->Box_Sum = box_sum;
+	return TRUE;
+}
+
+/**
+ * Get the size of the peak finder's box for a PSF FWHM: the odd number of pixels at least one pixel wider
+ * than the FWHM, and at least SOURCE_MIN_BOX_SIZE.
+ * @param psf_fwhm The FWHM of the narrowest PSF accepted, in pixels.
+ * @return The width (and height) of the box, in pixels.
+ * @see #SOURCE_MIN_BOX_SIZE
+ */
+static int Source_Get_Box_Size(double psf_fwhm)
+{
+	int box_size;
+
+	box_size = (2*((int)ceil(psf_fwhm/2.0)))+1;
+	if(box_size < SOURCE_MIN_BOX_SIZE)
+		box_size = SOURCE_MIN_BOX_SIZE;
+	return box_size;
+}
+
+/**
+ * Get part of a row of a frame, calibrated: the row's overscan level (if overscan is in use), bias, flat and bad
+ * pixel mask are applied, a chunk at a time.
+ * @param frame The frame, and it's calibration.
+ * @param y The row.
+ * @param start_x The first column to get.
+ * @param pixel_count The number of pixels to get.
+ * @param row Where to put the calibrated pixels.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_overscan.html#DpRt_Overscan_Get_Levels
+ * @see dprt_calibration.html#DpRt_Calibration_Apply_Pixels
+ * @see dprt_calibration.html#DPRT_CALIBRATION_CHUNK_PIXELS
+ */
+static int Source_Get_Row(struct DpRt_Source_Frame_Struct *frame,int y,int start_x,int pixel_count,
+			  unsigned short *row)
+{
+	size_t row_start;
+	float level;
+	int chunk_count,x;
+
+	level = 0.0f;
+	if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+	{
+		if(!DpRt_Overscan_Get_Levels(frame->Overscan,frame->Data,frame->Encoding,frame->Naxis_One,y,1,
+					     frame->Bias,&level))
+			return FALSE;
+	}
+	row_start = (((size_t)y)*((size_t)frame->Naxis_One))+start_x;
+	for(x=0;x<pixel_count;x+=chunk_count)
+	{
+		chunk_count = pixel_count-x;
+		if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+			chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+		DpRt_Calibration_Apply_Pixels(frame->Data,frame->Encoding,row_start+x,(size_t)chunk_count,level,
+					      frame->Bias,frame->Flat,frame->Mask,row+x);
+	}
+	return TRUE;
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,752 @@
+/* dprt_spectrum.c
+** Quick-look extraction of a 1D spectrum from an exposure frame.
+** $Header$
+*/
+/**
+ * dprt_spectrum.c extracts a quick-look 1D spectrum from a Sprat exposure frame, so observers have a spectrum
+ * as soon as the frame is read out. The dispersion axis is along the rows (NAXIS1), so the trace of the object is
+ * at a nearly fixed row. The trace is measured in a narrow window around the cached trace of the previous frame of
+ * the same target (see dprt_trace.c). Failing that, it is found in the spatial profile of the frame, the sum of each
+ * calibrated row, which the fused statistics pass (DpRt_Reduce_Calibrated_Stats) keeps as it goes, so finding it
+ * needs no extra pass over the frame, and measured in a wider window around that. The spectrum is then the sum of
+ * the rows of an aperture following the trace, less the sky, the mean of sky bands either side of the aperture
+ * scaled to the aperture's width. Only the aperture and sky band rows are read again, calibrated on the fly as in
+ * the statistics pass, and summed into the spectrum a chunk of columns at a time. The spectrum is written as a 1D
+ * FITS image next to the output file.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_calibration.h"
+#include "dprt_combine.h"
+#include "dprt_overscan.h"
+#include "dprt_source.h"
+#include "dprt_trace.h"
+#include "dprt_arc.h"
+#include "dprt_spectrum.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The ratio of the standard deviation of a normal distribution to it's median absolute deviation.
+ */
+#define SPECTRUM_SIGMA_PER_MAD		(1.4826)
+/**
+ * The extension of a spectrum's filename.
+ */
+#define SPECTRUM_FILENAME_EXTENSION	(".fits")
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Spectrum_Search_Profile(unsigned long long *row_sum_list,int start_y,int end_y,int width,
+				   struct DpRt_Spectrum_Parameter_Struct *parameters,double *profile_list,
+				   double *trace_y);
+static int Spectrum_Trace_Is_Good(struct DpRt_Trace_Struct *trace,struct DpRt_Trace_Parameter_Struct *parameters);
+static int Spectrum_Get_Level(struct DpRt_Source_Frame_Struct *frame,int y,float *level);
+static void Spectrum_Add_Row(struct DpRt_Source_Frame_Struct *frame,int y,float level,int start_x,int pixel_count,
+			     double *sum_list);
+static int Spectrum_Write_Trace(fitsfile *fp,struct DpRt_Spectrum_Struct *spectrum,int *status);
+static int Spectrum_Write_Wavelength(fitsfile *fp,struct DpRt_Spectrum_Struct *spectrum,int *status);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the quick-look extraction parameters from the configuration.
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_SPECTRUM_MAX_APERTURE
+ * @see #DPRT_SPECTRUM_MAX_SKY_WIDTH
+ * @see #DPRT_SPECTRUM_SUFFIX_LENGTH
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_config.html#DpRt_Config_Get_String
+ * @see dprt_trace.html#DpRt_Trace_Get_Parameters
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Spectrum_Get_Parameters(struct DpRt_Spectrum_Parameter_Struct *parameters)
+{
+	char *suffix = NULL;
+
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 1800;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Integer("dprt.spectrum.aperture",&(parameters->Aperture)))||
+	   (!DpRt_Config_Get_Integer("dprt.spectrum.sky.gap",&(parameters->Sky_Gap)))||
+	   (!DpRt_Config_Get_Integer("dprt.spectrum.sky.width",&(parameters->Sky_Width)))||
+	   (!DpRt_Config_Get_Double("dprt.spectrum.detect_sigma",&(parameters->Detect_Sigma)))||
+	   (!DpRt_Config_Get_String("dprt.spectrum.suffix",&suffix)))
+		return FALSE;
+	if((parameters->Aperture < 0)||(parameters->Aperture > DPRT_SPECTRUM_MAX_APERTURE)||
+	   (parameters->Sky_Gap < 0)||(parameters->Sky_Width < 0)||
+	   (parameters->Sky_Width > DPRT_SPECTRUM_MAX_SKY_WIDTH))
+	{
+		DpRt_Error_Number = 1801;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Get_Parameters:Illegal aperture %d (0..%d), sky gap %d "
+			"or sky width %d (0..%d).\n",parameters->Aperture,DPRT_SPECTRUM_MAX_APERTURE,
+			parameters->Sky_Gap,parameters->Sky_Width,DPRT_SPECTRUM_MAX_SKY_WIDTH);
+		return FALSE;
+	}
+	/* an empty suffix would make the spectrum overwrite the output file */
+	if((suffix == NULL)||(strlen(suffix) == 0)||(strlen(suffix) >= DPRT_SPECTRUM_SUFFIX_LENGTH))
+	{
+		DpRt_Error_Number = 1802;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Get_Parameters:Illegal suffix (must be 1..%d characters).\n",
+			DPRT_SPECTRUM_SUFFIX_LENGTH-1);
+		return FALSE;
+	}
+	strcpy(parameters->Suffix,suffix);
+	if(!DpRt_Trace_Get_Parameters(&(parameters->Trace)))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Find the trace of a spectrum in a frame. If a model of the trace is cached with key (from a previous frame of
+ * the same target), the trace is measured in a narrow window (Trace.Window rows) around it (see
+ * DpRt_Trace_Refine). Otherwise, or if the measured model is not good enough (see Spectrum_Trace_Is_Good), the
+ * trace is searched for in the spatial profile of the frame (see Spectrum_Search_Profile), and measured in a wider
+ * window (Trace.Search_Window rows) around the row found. If that model is not good enough either, the trace is
+ * taken to be at the row found in the profile at every column. A good model is cached with key, for the next frame.
+ * The aperture at the centre column is centred on the nearest row to the trace there (and clipped to the data
+ * section).
+ * @param frame The frame, and it's calibration.
+ * @param row_sum_list The sum of each calibrated row of the frame (see DpRt_Reduce_Calibrated_Stats).
+ * @param key The key the trace model is cached with, describing the target and instrument configuration.
+ *        If it is an empty string, the model is not cached.
+ * @param parameters The extraction parameters.
+ * @param profile_list A list of at least frame->Naxis_Two doubles, used to find the medians.
+ * @param spectrum The address of a structure to fill in with the trace and aperture. If no trace was found,
+ *        Found is set to FALSE.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_source.html#DpRt_Source_Get_Section
+ * @see #Spectrum_Search_Profile
+ * @see #Spectrum_Trace_Is_Good
+ * @see dprt_trace.html#DpRt_Trace_Cache_Get
+ * @see dprt_trace.html#DpRt_Trace_Cache_Put
+ * @see dprt_trace.html#DpRt_Trace_Refine
+ * @see dprt_trace.html#DpRt_Trace_Evaluate
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Spectrum_Find_Trace(struct DpRt_Source_Frame_Struct *frame,unsigned long long *row_sum_list,char *key,
+			     struct DpRt_Spectrum_Parameter_Struct *parameters,double *profile_list,
+			     struct DpRt_Spectrum_Struct *spectrum)
+{
+	struct DpRt_Trace_Struct cached_trace,profile_trace;
+	double profile_y;
+	int start_x,end_x,start_y,end_y,width,height,centre_y;
+
+	if((frame == NULL)||(row_sum_list == NULL)||(key == NULL)||(parameters == NULL)||(profile_list == NULL)||
+	   (spectrum == NULL))
+	{
+		DpRt_Error_Number = 1803;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Find_Trace:Illegal arguments.\n");
+		return FALSE;
+	}
+	memset(spectrum,0,sizeof(struct DpRt_Spectrum_Struct));
+	DpRt_Source_Get_Section(frame,&start_x,&end_x,&start_y,&end_y);
+	width = end_x-start_x;
+	height = end_y-start_y;
+	if((width < 1)||(height < 1))
+		return TRUE;
+	/* measure the trace in a narrow window around the cached model of the previous frame */
+	if(!DpRt_Trace_Cache_Get(key,&cached_trace))
+		return FALSE;
+	if(cached_trace.Valid)
+	{
+		if(!DpRt_Trace_Refine(frame,&(parameters->Trace),&cached_trace,parameters->Trace.Window,
+				      &(spectrum->Trace)))
+			return FALSE;
+		if(Spectrum_Trace_Is_Good(&(spectrum->Trace),&(parameters->Trace)))
+			spectrum->Trace_Source = DPRT_SPECTRUM_TRACE_SOURCE_CACHE;
+		else
+			spectrum->Trace.Valid = FALSE;
+	}
+	/* otherwise search the spatial profile, and measure the trace in a wide window around the row found */
+	if(spectrum->Trace.Valid == FALSE)
+	{
+		if(!Spectrum_Search_Profile(row_sum_list,start_y,end_y,width,parameters,profile_list,&profile_y))
+			return TRUE;
+		memset(&profile_trace,0,sizeof(struct DpRt_Trace_Struct));
+		profile_trace.Valid = TRUE;
+		profile_trace.Order = 0;
+		profile_trace.Coefficient_List[0] = profile_y;
+		profile_trace.Centre_X = ((double)(start_x+end_x-1))/2.0;
+		profile_trace.Scale_X = 1.0;
+		if(!DpRt_Trace_Refine(frame,&(parameters->Trace),&profile_trace,parameters->Trace.Search_Window,
+				      &(spectrum->Trace)))
+			return FALSE;
+		if(Spectrum_Trace_Is_Good(&(spectrum->Trace),&(parameters->Trace)))
+			spectrum->Trace_Source = DPRT_SPECTRUM_TRACE_SOURCE_SEARCH;
+		else
+		{
+			spectrum->Trace = profile_trace;
+			spectrum->Trace_Source = DPRT_SPECTRUM_TRACE_SOURCE_PROFILE;
+		}
+	}
+	if(spectrum->Trace_Source != DPRT_SPECTRUM_TRACE_SOURCE_PROFILE)
+	{
+		if(!DpRt_Trace_Cache_Put(key,&(spectrum->Trace)))
+			return FALSE;
+	}
+	spectrum->Found = TRUE;
+	spectrum->Trace_Y = DpRt_Trace_Evaluate(&(spectrum->Trace),((double)(start_x+end_x-1))/2.0);
+	centre_y = (int)floor(spectrum->Trace_Y+0.5);
+	spectrum->Aperture_Start_Y = centre_y-parameters->Aperture;
+	if(spectrum->Aperture_Start_Y < start_y)
+		spectrum->Aperture_Start_Y = start_y;
+	spectrum->Aperture_End_Y = centre_y+parameters->Aperture+1;
+	if(spectrum->Aperture_End_Y > end_y)
+		spectrum->Aperture_End_Y = end_y;
+	spectrum->Start_X = start_x;
+	spectrum->Length = width;
+	return TRUE;
+}
+
+/**
+ * Extract the spectrum along a trace found by DpRt_Spectrum_Find_Trace. The spectrum is divided into
+ * Trace.Block_Count blocks of columns, and in each the aperture follows the trace, centred on the nearest row to
+ * the trace at the block's centre column. Each block's aperture rows are summed into flux_list, and it's sky band
+ * rows (Sky_Width rows either side of the aperture, Sky_Gap rows away from it, clipped to the data section) into
+ * sky_list. The rows are read in order, calibrated on the fly, each row's overscan level being found once for all
+ * the blocks using it. Each block's mean sky row, scaled to the number of aperture rows, is then subtracted from
+ * it's part of the spectrum. If no sky rows of a block are in the data section, it's sky is not subtracted.
+ * Nothing is done if no trace was found.
+ * @param frame The frame, and it's calibration.
+ * @param parameters The extraction parameters.
+ * @param spectrum The spectrum's trace and aperture, from DpRt_Spectrum_Find_Trace. Sky_Row_Count and Flux are
+ *        filled in.
+ * @param flux_list A list of at least spectrum->Length doubles, filled in with the sky subtracted spectrum.
+ * @param sky_list A list of at least spectrum->Length doubles, filled in with the mean sky row of each block.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Spectrum_Get_Level
+ * @see #Spectrum_Add_Row
+ * @see dprt_trace.html#DpRt_Trace_Get_Block
+ * @see dprt_trace.html#DpRt_Trace_Evaluate
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Spectrum_Extract(struct DpRt_Source_Frame_Struct *frame,
+			  struct DpRt_Spectrum_Parameter_Struct *parameters,struct DpRt_Spectrum_Struct *spectrum,
+			  double *flux_list,double *sky_list)
+{
+	int block_start_x_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int block_end_x_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int aperture_start_y_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int aperture_end_y_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int sky_start_y_list[DPRT_TRACE_MAX_BLOCK_COUNT][2];
+	int sky_end_y_list[DPRT_TRACE_MAX_BLOCK_COUNT][2];
+	int sky_row_count_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	double sky_scale,aperture_scale;
+	float level;
+	int start_x,end_x,start_y,end_y,block_count,centre_y,min_y,max_y,block,band,row_used,x,y;
+
+	if((frame == NULL)||(parameters == NULL)||(spectrum == NULL)||(flux_list == NULL)||(sky_list == NULL))
+	{
+		DpRt_Error_Number = 1804;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Extract:Illegal arguments.\n");
+		return FALSE;
+	}
+	spectrum->Sky_Row_Count = 0;
+	spectrum->Flux = 0.0;
+	if(spectrum->Found == FALSE)
+		return TRUE;
+	DpRt_Source_Get_Section(frame,&start_x,&end_x,&start_y,&end_y);
+	for(x=0;x<spectrum->Length;x++)
+	{
+		flux_list[x] = 0.0;
+		sky_list[x] = 0.0;
+	}
+	/* the aperture and sky bands of each block, around the trace at it's centre column */
+	block_count = parameters->Trace.Block_Count;
+	if(block_count > spectrum->Length)
+		block_count = spectrum->Length;
+	min_y = end_y;
+	max_y = start_y-1;
+	for(block=0;block<block_count;block++)
+	{
+		DpRt_Trace_Get_Block(spectrum->Start_X,spectrum->Length,block_count,block,&(block_start_x_list[block]),
+				     &(block_end_x_list[block]));
+		centre_y = (int)floor(DpRt_Trace_Evaluate(&(spectrum->Trace),
+				((double)(block_start_x_list[block]+block_end_x_list[block]-1))/2.0)+0.5);
+		aperture_start_y_list[block] = centre_y-parameters->Aperture;
+		aperture_end_y_list[block] = centre_y+parameters->Aperture+1;
+		/* the sky band below the aperture, then the one above it */
+		sky_end_y_list[block][0] = aperture_start_y_list[block]-parameters->Sky_Gap;
+		sky_start_y_list[block][0] = sky_end_y_list[block][0]-parameters->Sky_Width;
+		sky_start_y_list[block][1] = aperture_end_y_list[block]+parameters->Sky_Gap;
+		sky_end_y_list[block][1] = sky_start_y_list[block][1]+parameters->Sky_Width;
+		if(aperture_start_y_list[block] < start_y)
+			aperture_start_y_list[block] = start_y;
+		if(aperture_end_y_list[block] > end_y)
+			aperture_end_y_list[block] = end_y;
+		if(aperture_end_y_list[block] < aperture_start_y_list[block])
+			aperture_end_y_list[block] = aperture_start_y_list[block];
+		if(aperture_start_y_list[block] < aperture_end_y_list[block])
+		{
+			if(aperture_start_y_list[block] < min_y)
+				min_y = aperture_start_y_list[block];
+			if(aperture_end_y_list[block]-1 > max_y)
+				max_y = aperture_end_y_list[block]-1;
+		}
+		for(band=0;band<2;band++)
+		{
+			if(sky_start_y_list[block][band] < start_y)
+				sky_start_y_list[block][band] = start_y;
+			if(sky_end_y_list[block][band] > end_y)
+				sky_end_y_list[block][band] = end_y;
+			if(sky_start_y_list[block][band] < sky_end_y_list[block][band])
+			{
+				if(sky_start_y_list[block][band] < min_y)
+					min_y = sky_start_y_list[block][band];
+				if(sky_end_y_list[block][band]-1 > max_y)
+					max_y = sky_end_y_list[block][band]-1;
+			}
+		}
+		sky_row_count_list[block] = 0;
+	}
+	/* sum each block's aperture and sky band rows, a row at a time */
+	for(y=min_y;y<=max_y;y++)
+	{
+		row_used = FALSE;
+		level = 0.0f;
+		for(block=0;block<block_count;block++)
+		{
+			if((y >= aperture_start_y_list[block])&&(y < aperture_end_y_list[block]))
+			{
+				if((row_used == FALSE)&&(!Spectrum_Get_Level(frame,y,&level)))
+					return FALSE;
+				row_used = TRUE;
+				Spectrum_Add_Row(frame,y,level,block_start_x_list[block],
+						 block_end_x_list[block]-block_start_x_list[block],
+						 flux_list+(block_start_x_list[block]-spectrum->Start_X));
+			}
+			for(band=0;band<2;band++)
+			{
+				if((y >= sky_start_y_list[block][band])&&(y < sky_end_y_list[block][band]))
+				{
+					if((row_used == FALSE)&&(!Spectrum_Get_Level(frame,y,&level)))
+						return FALSE;
+					row_used = TRUE;
+					Spectrum_Add_Row(frame,y,level,block_start_x_list[block],
+							 block_end_x_list[block]-block_start_x_list[block],
+							 sky_list+(block_start_x_list[block]-spectrum->Start_X));
+					sky_row_count_list[block]++;
+				}
+			}
+		}
+	}
+	/* subtract each block's mean sky row, scaled to it's aperture */
+	for(block=0;block<block_count;block++)
+	{
+		if((block == 0)||(sky_row_count_list[block] < spectrum->Sky_Row_Count))
+			spectrum->Sky_Row_Count = sky_row_count_list[block];
+		if(sky_row_count_list[block] == 0)
+			continue;
+		sky_scale = 1.0/((double)sky_row_count_list[block]);
+		aperture_scale = (double)(aperture_end_y_list[block]-aperture_start_y_list[block]);
+		for(x=block_start_x_list[block]-spectrum->Start_X;x<block_end_x_list[block]-spectrum->Start_X;x++)
+		{
+			sky_list[x] *= sky_scale;
+			flux_list[x] -= sky_list[x]*aperture_scale;
+		}
+	}
+	for(x=0;x<spectrum->Length;x++)
+		spectrum->Flux += flux_list[x];
+	return TRUE;
+}
+
+/**
+ * Get the filename a spectrum is written to, next to an output file: the output filename with it's extension
+ * (if it has one) replaced by the suffix and ".fits".
+ * @param output_filename The output filename.
+ * @param parameters The extraction parameters, holding the suffix.
+ * @param spectrum_filename A string to store the spectrum's filename in.
+ * @param spectrum_filename_length The length of the spectrum_filename string, including the terminator.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed (or the filename was too long).
+ * @see #SPECTRUM_FILENAME_EXTENSION
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Spectrum_Get_Filename(char *output_filename,struct DpRt_Spectrum_Parameter_Struct *parameters,
+			       char *spectrum_filename,size_t spectrum_filename_length)
+{
+	char *slash = NULL;
+	char *dot = NULL;
+	int stem_length,length;
+
+	if((output_filename == NULL)||(parameters == NULL)||(spectrum_filename == NULL))
+	{
+		DpRt_Error_Number = 1805;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Get_Filename:Illegal arguments.\n");
+		return FALSE;
+	}
+	stem_length = strlen(output_filename);
+	slash = strrchr(output_filename,'/');
+	dot = strrchr(output_filename,'.');
+	if((dot != NULL)&&((slash == NULL)||(dot > slash)))
+		stem_length = dot-output_filename;
+	length = snprintf(spectrum_filename,spectrum_filename_length,"%.*s%s%s",stem_length,output_filename,
+			  parameters->Suffix,SPECTRUM_FILENAME_EXTENSION);
+	if((length < 0)||(((size_t)length) >= spectrum_filename_length))
+	{
+		DpRt_Error_Number = 1806;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Get_Filename:Spectrum filename of %.128s too long.\n",
+			output_filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Write a spectrum as a 32-bit floating point 1D FITS image, overwriting any existing file. The header holds the
+ * frame it was extracted from (ORIGFILE), the trace (TRACEY) and aperture rows (APSTART, APEND) at the centre
+ * column and the number of sky rows (SKYROWS), all in FITS (1 based) pixel coordinates, the trace model (see
+ * Spectrum_Write_Trace), and a linear world coordinate system giving the frame column of each element. If the
+ * spectrum has a dispersion solution, it is written too (see Spectrum_Write_Wavelength).
+ * @param spectrum_filename The filename to write the spectrum to.
+ * @param input_filename The filename of the frame the spectrum was extracted from.
+ * @param spectrum The spectrum's trace and aperture.
+ * @param flux_list The spectrum, of spectrum->Length elements.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_SPECTRUM_FILENAME_LENGTH
+ * @see #Spectrum_Write_Trace
+ * @see #Spectrum_Write_Wavelength
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Spectrum_Write(char *spectrum_filename,char *input_filename,struct DpRt_Spectrum_Struct *spectrum,
+			double *flux_list)
+{
+	fitsfile *fp = NULL;
+	char fits_filename[DPRT_SPECTRUM_FILENAME_LENGTH+1];
+	double trace_y,crpix,crval,cdelt;
+	long axes_list[1];
+	int aperture_start_y,aperture_end_y,status = 0;
+
+	if((spectrum_filename == NULL)||(input_filename == NULL)||(spectrum == NULL)||(flux_list == NULL)||
+	   (spectrum->Found == FALSE)||(spectrum->Length < 1))
+	{
+		DpRt_Error_Number = 1807;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Write:Illegal arguments.\n");
+		return FALSE;
+	}
+	snprintf(fits_filename,DPRT_SPECTRUM_FILENAME_LENGTH+1,"!%s",spectrum_filename);
+	axes_list[0] = spectrum->Length;
+	trace_y = spectrum->Trace_Y+1.0;
+	aperture_start_y = spectrum->Aperture_Start_Y+1;
+	aperture_end_y = spectrum->Aperture_End_Y;
+	crpix = 1.0;
+	crval = (double)(spectrum->Start_X+1);
+	cdelt = 1.0;
+	if(fits_create_file(&fp,fits_filename,&status)||
+	   fits_create_img(fp,FLOAT_IMG,1,axes_list,&status)||
+	   fits_update_key(fp,TSTRING,"ORIGFILE",input_filename,"Frame the spectrum was extracted from",&status)||
+	   fits_update_key(fp,TDOUBLE,"TRACEY",&trace_y,"Row of the trace at the centre column",&status)||
+	   fits_update_key(fp,TINT,"APSTART",&aperture_start_y,"First row of the aperture",&status)||
+	   fits_update_key(fp,TINT,"APEND",&aperture_end_y,"Last row of the aperture",&status)||
+	   fits_update_key(fp,TINT,"SKYROWS",&(spectrum->Sky_Row_Count),"Number of sky rows subtracted",&status)||
+	   fits_update_key(fp,TSTRING,"CTYPE1","PIXEL","Frame column",&status)||
+	   fits_update_key(fp,TDOUBLE,"CRPIX1",&crpix,"Reference element",&status)||
+	   fits_update_key(fp,TDOUBLE,"CRVAL1",&crval,"Frame column of the reference element",&status)||
+	   fits_update_key(fp,TDOUBLE,"CDELT1",&cdelt,"Columns per element",&status)||
+	   Spectrum_Write_Trace(fp,spectrum,&status)||
+	   Spectrum_Write_Wavelength(fp,spectrum,&status))
+	{
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 1808;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Write:Failed to create spectrum %.150s.\n",spectrum_filename);
+		if(fp != NULL)
+		{
+			status = 0;
+			fits_close_file(fp,&status);
+			remove(spectrum_filename);
+		}
+		return FALSE;
+	}
+	if(fits_write_img(fp,TDOUBLE,1,(LONGLONG)spectrum->Length,flux_list,&status))
+	{
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fp,&status);
+		remove(spectrum_filename);
+		DpRt_Error_Number = 1809;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Write:Failed to write spectrum %.150s.\n",spectrum_filename);
+		return FALSE;
+	}
+	if(fits_close_file(fp,&status))
+	{
+		fits_report_error(stderr,status);
+		remove(spectrum_filename);
+		DpRt_Error_Number = 1810;
+		sprintf(DpRt_Error_String,"DpRt_Spectrum_Write:Failed to close spectrum %.150s.\n",spectrum_filename);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Search for the trace of a spectrum in the spatial profile of a frame (the mean of each row of the data section).
+ * The trace is the row whose faintest of it and the rows either side of it is brightest, if they are all more than
+ * Detect_Sigma standard deviations above the profile's median, the standard deviation being estimated from the
+ * profile's median absolute deviation, which the sky rows dominate. Using the neighbouring rows stops a single
+ * cosmic ray or hot pixel, which can lift the mean of it's row well above the noise, being taken for a trace (or
+ * hiding a tilted trace, which is spread over several rows of the profile). It's position is the centroid of the
+ * profile above the median within the aperture of that row.
+ * @param row_sum_list The sum of each calibrated row of the frame (see DpRt_Reduce_Calibrated_Stats).
+ * @param start_y The first row of the data section.
+ * @param end_y One more than the last row of the data section.
+ * @param width The number of columns in the data section, at least one.
+ * @param parameters The extraction parameters.
+ * @param profile_list A list of at least end_y-start_y doubles, used to find the medians.
+ * @param trace_y The address of a double to store the row of the trace in.
+ * @return The routine returns TRUE if a trace was found, and FALSE if one was not.
+ * @see #SPECTRUM_SIGMA_PER_MAD
+ * @see dprt_combine.html#DpRt_Combine_Median_Double
+ */
+static int Spectrum_Search_Profile(unsigned long long *row_sum_list,int start_y,int end_y,int width,
+				   struct DpRt_Spectrum_Parameter_Struct *parameters,double *profile_list,
+				   double *trace_y)
+{
+	unsigned long long faintest,peak_faintest;
+	double median,threshold,weight,weight_sum,weighted_sum;
+	int height,peak_y,y;
+
+	height = end_y-start_y;
+	if(height < 3)
+		return FALSE;
+	/* the row whose faintest of it and it's neighbours is brightest */
+	peak_y = start_y+1;
+	peak_faintest = 0;
+	for(y=start_y+1;y<end_y-1;y++)
+	{
+		faintest = row_sum_list[y];
+		if(row_sum_list[y-1] < faintest)
+			faintest = row_sum_list[y-1];
+		if(row_sum_list[y+1] < faintest)
+			faintest = row_sum_list[y+1];
+		if(faintest > peak_faintest)
+		{
+			peak_faintest = faintest;
+			peak_y = y;
+		}
+	}
+	/* the median and median absolute deviation of the profile */
+	for(y=start_y;y<end_y;y++)
+		profile_list[y-start_y] = ((double)row_sum_list[y])/((double)width);
+	median = DpRt_Combine_Median_Double(profile_list,height);
+	for(y=start_y;y<end_y;y++)
+		profile_list[y-start_y] = fabs((((double)row_sum_list[y])/((double)width))-median);
+	threshold = median+(parameters->Detect_Sigma*SPECTRUM_SIGMA_PER_MAD*
+			     DpRt_Combine_Median_Double(profile_list,height));
+	if((((double)peak_faintest)/((double)width)) <= threshold)
+		return FALSE;
+	/* the centroid of the profile above the median, around the brightest row */
+	weight_sum = 0.0;
+	weighted_sum = 0.0;
+	for(y=peak_y-parameters->Aperture;y<=peak_y+parameters->Aperture;y++)
+	{
+		if((y < start_y)||(y >= end_y))
+			continue;
+		weight = (((double)row_sum_list[y])/((double)width))-median;
+		if(weight > 0.0)
+		{
+			weight_sum += weight;
+			weighted_sum += weight*((double)y);
+		}
+	}
+	(*trace_y) = weighted_sum/weight_sum;
+	return TRUE;
+}
+
+/**
+ * Decide whether a measured trace model is good enough to use: it must have been fitted, to at least half the
+ * blocks of columns, with an rms residual of no more than Max_Residual rows.
+ * @param trace The measured trace model.
+ * @param parameters The trace measurement parameters.
+ * @return The routine returns TRUE if the model is good enough, and FALSE if it is not.
+ */
+static int Spectrum_Trace_Is_Good(struct DpRt_Trace_Struct *trace,struct DpRt_Trace_Parameter_Struct *parameters)
+{
+	return trace->Valid && ((2*trace->Used_Block_Count) >= trace->Block_Count)&&
+		(trace->Residual <= parameters->Max_Residual);
+}
+
+/**
+ * Get the overscan level of a row of a frame.
+ * @param frame The frame, and it's calibration.
+ * @param y The row.
+ * @param level The address of a float to store the row's overscan level in, zero if overscan is not in use.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_overscan.html#DpRt_Overscan_Get_Levels
+ */
+static int Spectrum_Get_Level(struct DpRt_Source_Frame_Struct *frame,int y,float *level)
+{
+	(*level) = 0.0f;
+	if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+	{
+		if(!DpRt_Overscan_Get_Levels(frame->Overscan,frame->Data,frame->Encoding,frame->Naxis_One,y,1,
+					     frame->Bias,level))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Add part of a row of a frame, calibrated, to a list of sums: the row's overscan level, bias, flat and bad pixel
+ * mask are applied a chunk at a time into a buffer on the stack, which is added to the sums whilst it is still in
+ * cache.
+ * @param frame The frame, and it's calibration.
+ * @param y The row.
+ * @param level The row's overscan level (see Spectrum_Get_Level).
+ * @param start_x The first column to add.
+ * @param pixel_count The number of pixels to add.
+ * @param sum_list The list of pixel_count sums to add the calibrated pixels to.
+ * @see dprt_calibration.html#DpRt_Calibration_Apply_Pixels
+ * @see dprt_calibration.html#DPRT_CALIBRATION_CHUNK_PIXELS
+ */
+static void Spectrum_Add_Row(struct DpRt_Source_Frame_Struct *frame,int y,float level,int start_x,int pixel_count,
+			     double *sum_list)
+{
+	unsigned short chunk[DPRT_CALIBRATION_CHUNK_PIXELS];
+	double *chunk_sum_list = NULL;
+	size_t row_start;
+	int chunk_count,x,i;
+
+	row_start = (((size_t)y)*((size_t)frame->Naxis_One))+start_x;
+	for(x=0;x<pixel_count;x+=chunk_count)
+	{
+		chunk_count = pixel_count-x;
+		if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+			chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+		DpRt_Calibration_Apply_Pixels(frame->Data,frame->Encoding,row_start+x,(size_t)chunk_count,level,
+					      frame->Bias,frame->Flat,frame->Mask,chunk);
+		chunk_sum_list = sum_list+x;
+		for(i=0;i<chunk_count;i++)
+			chunk_sum_list[i] += (double)chunk[i];
+	}
+}
+
+/**
+ * Write the trace model of a spectrum into it's FITS header: how it was found (TRSOURCE), the order (TRORDER)
+ * and coefficients (TRCOEF0...) of the polynomial giving the trace's row (1 based) at each column, of the variable
+ * (column-TRXCEN)/TRXSCL, the rms residual (TRRESID) and the number of column blocks fitted (TRBLOCKS).
+ * @param fp The open FITS file.
+ * @param spectrum The spectrum.
+ * @param status The address of the CFITSIO status.
+ * @return The CFITSIO status, non-zero if writing a keyword failed.
+ * @see #DPRT_SPECTRUM_TRACE_SOURCE_PROFILE
+ * @see #DPRT_SPECTRUM_TRACE_SOURCE_SEARCH
+ * @see #DPRT_SPECTRUM_TRACE_SOURCE_CACHE
+ */
+static int Spectrum_Write_Trace(fitsfile *fp,struct DpRt_Spectrum_Struct *spectrum,int *status)
+{
+	char keyword[FLEN_KEYWORD];
+	char *source = NULL;
+	double coefficient,centre_x;
+	int i;
+
+	if(spectrum->Trace_Source == DPRT_SPECTRUM_TRACE_SOURCE_CACHE)
+		source = "CACHE";
+	else if(spectrum->Trace_Source == DPRT_SPECTRUM_TRACE_SOURCE_SEARCH)
+		source = "SEARCH";
+	else
+		source = "PROFILE";
+	centre_x = spectrum->Trace.Centre_X+1.0;
+	fits_update_key(fp,TSTRING,"TRSOURCE",source,"How the trace was found",status);
+	fits_update_key(fp,TINT,"TRORDER",&(spectrum->Trace.Order),"Order of the trace polynomial",status);
+	for(i=0;i<=spectrum->Trace.Order;i++)
+	{
+		/* the rows are 1 based in FITS */
+		coefficient = spectrum->Trace.Coefficient_List[i];
+		if(i == 0)
+			coefficient += 1.0;
+		sprintf(keyword,"TRCOEF%d",i);
+		fits_update_key(fp,TDOUBLE,keyword,&coefficient,"Trace polynomial coefficient",status);
+	}
+	fits_update_key(fp,TDOUBLE,"TRXCEN",&centre_x,"Trace polynomial centre column",status);
+	fits_update_key(fp,TDOUBLE,"TRXSCL",&(spectrum->Trace.Scale_X),"Trace polynomial column scale",status);
+	fits_update_key(fp,TDOUBLE,"TRRESID",&(spectrum->Trace.Residual),"Trace fit rms residual in rows",status);
+	fits_update_key(fp,TINT,"TRBLOCKS",&(spectrum->Trace.Used_Block_Count),"Column blocks the trace was fitted to",
+			status);
+	return (*status);
+}
+
+/**
+ * Write the dispersion solution of a spectrum into it's FITS header, if it has one: the order (DISPORD) and
+ * coefficients (DISPC0...) of the polynomial giving the wavelength at each frame column, of the variable
+ * (column-DISPXCEN)/DISPXSCL, the rms residual (DISPRMS), and the number of lines (DISPNLIN) and arcs (DISPNARC)
+ * it was fitted to. The spectrum is not resampled, but an alternate linear world coordinate system (CTYPE1A...)
+ * gives the wavelength of each element at the tangent of the solution at the centre column, which is exact for
+ * a linear solution.
+ * @param fp The open FITS file.
+ * @param spectrum The spectrum.
+ * @param status The address of the CFITSIO status.
+ * @return The CFITSIO status, non-zero if writing a keyword failed.
+ * @see dprt_arc.html#DpRt_Arc_Solution_Struct
+ */
+static int Spectrum_Write_Wavelength(fitsfile *fp,struct DpRt_Spectrum_Struct *spectrum,int *status)
+{
+	struct DpRt_Arc_Solution_Struct *solution = NULL;
+	char keyword[FLEN_KEYWORD];
+	double centre_x,crpix,crval,cdelt;
+	int i;
+
+	solution = &(spectrum->Solution);
+	if(solution->Valid == FALSE)
+		return (*status);
+	/* the columns are 1 based in FITS */
+	centre_x = solution->Centre_X+1.0;
+	crpix = solution->Centre_X-((double)spectrum->Start_X)+1.0;
+	crval = solution->Coefficient_List[0];
+	cdelt = solution->Coefficient_List[1]/solution->Scale_X;
+	fits_update_key(fp,TINT,"DISPORD",&(solution->Order),"Order of the dispersion polynomial",status);
+	for(i=0;i<=solution->Order;i++)
+	{
+		sprintf(keyword,"DISPC%d",i);
+		fits_update_key(fp,TDOUBLE,keyword,&(solution->Coefficient_List[i]),"Dispersion polynomial coefficient",
+				status);
+	}
+	fits_update_key(fp,TDOUBLE,"DISPXCEN",&centre_x,"Dispersion polynomial centre column",status);
+	fits_update_key(fp,TDOUBLE,"DISPXSCL",&(solution->Scale_X),"Dispersion polynomial column scale",status);
+	fits_update_key(fp,TDOUBLE,"DISPRMS",&(solution->RMS),"Dispersion fit rms residual",status);
+	fits_update_key(fp,TINT,"DISPNLIN",&(solution->Line_Count),"Number of arc lines fitted",status);
+	fits_update_key(fp,TINT,"DISPNARC",&(solution->Arc_Count),"Number of arcs the solution was refined with",
+			status);
+	fits_update_key(fp,TSTRING,"CTYPE1A","WAVE","Wavelength",status);
+	fits_update_key(fp,TSTRING,"CUNIT1A","Angstrom","Wavelength units",status);
+	fits_update_key(fp,TDOUBLE,"CRPIX1A",&crpix,"Reference element",status);
+	fits_update_key(fp,TDOUBLE,"CRVAL1A",&crval,"Wavelength of the reference element",status);
+	fits_update_key(fp,TDOUBLE,"CDELT1A",&cdelt,"Wavelength per element at the reference element",status);
+	return (*status);
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,776 @@
+/* dprt_stats.c
+** Single pass statistics kernels for 16-bit frames.
+** $Header$
+*/
+/**
+ * dprt_stats.c computes the statistics of a 16-bit (unsigned short) frame: the exact sum, minimum, maximum,
+ * position of the (first) maximum pixel and saturated pixel count, in a single pass over the data.
+ * Vectorised versions of the per-row kernel are provided for SSE2, AVX2 and AVX-512 (BW), and the best one supported
+ * by the CPU is selected at run time. A portable scalar kernel is used on other architectures/compilers.
+ * The kernels can also read the data unit of a FITS file directly (big-endian signed 16-bit integers with BZERO 32768),
+ * byte-swapping and applying BZERO as each vector is loaded. Bad pixels can be left out of the statistics, using a
+ * bad pixel mask held as a packed bitset (one bit per pixel, see DPRT_STATS_MASK_WORD_COUNT). The bits for each
+ * vector are read alongside it and used as a lane mask, so a band's mask (1/16th of the size of it's pixels) stays in
+ * cache, and vectors with no bad pixels cost one extra test.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+/**
+ * Defined if we are compiling on an x86 architecture with a compiler (gcc) supporting function target attributes,
+ * intrinsics and __builtin_cpu_supports. In this case the vectorised kernels are compiled in.
+ */
+#define STATS_X86
+#endif
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_stats.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of vector iterations processed before the 16/32-bit lane accumulators in the vectorised kernels
+ * are widened into 64-bit totals. 16384 iterations of two 16-bit values per 32-bit lane cannot overflow
+ * (16384*2*65535 < 2^32).
+ */
+#define STATS_CHUNK_ITERATIONS		(16384)
+/**
+ * Macro to convert a 16-bit value read from a FITS data unit (big-endian, signed, with a BZERO of 32768)
+ * into the unsigned pixel value. On a big-endian host only the BZERO offset (flipping the top bit) is needed.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define STATS_FITS_DECODE(v)		((unsigned short)((v)^0x8000))
+#else
+#define STATS_FITS_DECODE(v)		((unsigned short)((((v)>>8)|((v)<<8))^0x8000))
+#endif
+
+/* ------------------------------------------------------- */
+/* enums */
+/* ------------------------------------------------------- */
+/**
+ * The available row kernels.
+ * <dl>
+ * <dt>STATS_KERNEL_SCALAR</dt> <dd>Portable scalar C.</dd>
+ * <dt>STATS_KERNEL_SSE2</dt> <dd>SSE2 intrinsics, 8 pixels per iteration.</dd>
+ * <dt>STATS_KERNEL_AVX2</dt> <dd>AVX2 intrinsics, 16 pixels per iteration.</dd>
+ * <dt>STATS_KERNEL_AVX512</dt> <dd>AVX-512 (F and BW) intrinsics, 32 pixels per iteration.</dd>
+ * </dl>
+ */
+enum STATS_KERNEL
+{
+	STATS_KERNEL_SCALAR=0,STATS_KERNEL_SSE2=1,STATS_KERNEL_AVX2=2,STATS_KERNEL_AVX512=3
+};
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the statistics of a single row, as computed by a row kernel.
+ * <dl>
+ * <dt>Sum</dt> <dd>The sum of the pixel values in the row.</dd>
+ * <dt>Min</dt> <dd>The minimum pixel value in the row.</dd>
+ * <dt>Max</dt> <dd>The maximum pixel value in the row.</dd>
+ * <dt>Saturated_Count</dt> <dd>The number of pixels in the row with a value greater than or equal to the
+ *     saturation level.</dd>
+ * <dt>Masked_Count</dt> <dd>The number of bad pixels in the row, which are left out of the other statistics.</dd>
+ * </dl>
+ */
+struct Stats_Row_Struct
+{
+	unsigned long long Sum;
+	unsigned short Min;
+	unsigned short Max;
+	unsigned long long Saturated_Count;
+	unsigned long long Masked_Count;
+};
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Stats_Row_Scalar(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r);
+#ifdef STATS_X86
+static void Stats_Row_SSE2(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r);
+static void Stats_Row_AVX2(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r);
+static void Stats_Row_AVX512(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r);
+#endif
+static inline unsigned long long Stats_Mask_Bits(unsigned long long *mask,size_t start);
+static enum STATS_KERNEL Stats_Detect_Kernel(void);
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The names of the row kernels, indexed by STATS_KERNEL.
+ * @see #STATS_KERNEL
+ */
+static char *Stats_Kernel_Name_List[] = {"scalar","sse2","avx2","avx512"};
+/**
+ * The currently selected row kernel.
+ * @see #STATS_KERNEL
+ */
+static enum STATS_KERNEL Stats_Kernel = STATS_KERNEL_SCALAR;
+/**
+ * The row kernel function for the currently selected row kernel, or NULL if no kernel has been selected yet.
+ */
+static void (*Stats_Row_Function)(unsigned short *row,int n,int encoding,unsigned long long *mask,
+				  size_t mask_start,unsigned short saturation_level,struct Stats_Row_Struct *r) = NULL;
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Select the row kernel used by the statistics routines.
+ * @param kernel_name The kernel to use: one of "scalar", "sse2", "avx2", "avx512", or "auto" (or NULL)
+ *        to select the best kernel the CPU supports. A kernel the CPU (or build) does not support is an error.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Stats_Kernel
+ * @see #Stats_Row_Function
+ * @see #Stats_Detect_Kernel
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Stats_Initialise(char *kernel_name)
+{
+	enum STATS_KERNEL best_kernel,kernel;
+	int i,found;
+
+	best_kernel = Stats_Detect_Kernel();
+	if((kernel_name == NULL)||(strcasecmp(kernel_name,"auto") == 0))
+		kernel = best_kernel;
+	else
+	{
+		found = FALSE;
+		kernel = STATS_KERNEL_SCALAR;
+		for(i=STATS_KERNEL_SCALAR;i<=STATS_KERNEL_AVX512;i++)
+		{
+			if(strcasecmp(kernel_name,Stats_Kernel_Name_List[i]) == 0)
+			{
+				kernel = (enum STATS_KERNEL)i;
+				found = TRUE;
+			}
+		}
+		if(found == FALSE)
+		{
+			DpRt_Error_Number = 200;
+			sprintf(DpRt_Error_String,"DpRt_Stats_Initialise:Unknown kernel '%s'.\n",kernel_name);
+			return FALSE;
+		}
+		if(kernel > best_kernel)
+		{
+			DpRt_Error_Number = 201;
+			sprintf(DpRt_Error_String,"DpRt_Stats_Initialise:Kernel '%s' not supported (best '%s').\n",
+				kernel_name,Stats_Kernel_Name_List[best_kernel]);
+			return FALSE;
+		}
+	}
+	switch(kernel)
+	{
+#ifdef STATS_X86
+		case STATS_KERNEL_AVX512:
+			Stats_Row_Function = Stats_Row_AVX512;
+			break;
+		case STATS_KERNEL_AVX2:
+			Stats_Row_Function = Stats_Row_AVX2;
+			break;
+		case STATS_KERNEL_SSE2:
+			Stats_Row_Function = Stats_Row_SSE2;
+			break;
+#endif
+		default:
+			kernel = STATS_KERNEL_SCALAR;
+			Stats_Row_Function = Stats_Row_Scalar;
+			break;
+	}
+	Stats_Kernel = kernel;
+	fprintf(stdout,"DpRt_Stats_Initialise:Using '%s' statistics kernel.\n",Stats_Kernel_Name_List[Stats_Kernel]);
+	return TRUE;
+}
+
+/**
+ * Return the name of the currently selected statistics kernel.
+ * @return A string, one of "scalar", "sse2", "avx2" or "avx512".
+ * @see #Stats_Kernel
+ * @see #Stats_Kernel_Name_List
+ */
+char *DpRt_Stats_Get_Kernel_Name(void)
+{
+	return Stats_Kernel_Name_List[Stats_Kernel];
+}
+
+/**
+ * Compute the statistics of a whole 16-bit frame in a single pass.
+ * @param data The frame data, of naxis_one*naxis_two pixels, in row-major order.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param stats The address of a structure to fill with the statistics.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Stats_Calculate_Rows
+ */
+int DpRt_Stats_Calculate(unsigned short *data,int naxis_one,int naxis_two,int saturation_level,
+			 struct DpRt_Stats_Struct *stats)
+{
+	return DpRt_Stats_Calculate_Rows(data,DPRT_STATS_ENCODING_NATIVE,naxis_one,0,naxis_two,saturation_level,stats);
+}
+
+/**
+ * Compute the statistics of a band of rows of a 16-bit frame in a single pass.
+ * @param data The frame data, in row-major order.
+ * @param encoding How the pixel values are stored in data: DPRT_STATS_ENCODING_NATIVE for host order unsigned
+ *        shorts, or DPRT_STATS_ENCODING_FITS for a FITS data unit (big-endian, signed, BZERO 32768).
+ * @param naxis_one The number of columns in the frame.
+ * @param start_y The first row to include in the statistics.
+ * @param end_y One more than the last row to include in the statistics.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param stats The address of a structure to fill with the statistics.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DpRt_Stats_Calculate_Rows_Masked
+ */
+int DpRt_Stats_Calculate_Rows(void *data,int encoding,int naxis_one,int start_y,int end_y,int saturation_level,
+			      struct DpRt_Stats_Struct *stats)
+{
+	return DpRt_Stats_Calculate_Rows_Masked(data,encoding,naxis_one,start_y,end_y,NULL,0,saturation_level,stats);
+}
+
+/**
+ * Compute the statistics of a band of rows of a 16-bit frame in a single pass, leaving out the pixels set in a
+ * bad pixel mask. The maximum is searched for row by row using the selected (vectorised) kernel, and only the first
+ * row containing the maximum is re-scanned to find it's x position. Max_X/Max_Y are left at (0,start_y) if all the
+ * (good) pixels are zero, to match the previous behaviour of the scalar loops. If every pixel is bad, the
+ * statistics are those of an empty band.
+ * @param data The frame data, in row-major order.
+ * @param encoding How the pixel values are stored in data: DPRT_STATS_ENCODING_NATIVE for host order unsigned
+ *        shorts, or DPRT_STATS_ENCODING_FITS for a FITS data unit (big-endian, signed, BZERO 32768).
+ * @param naxis_one The number of columns in the frame.
+ * @param start_y The first row to include in the statistics.
+ * @param end_y One more than the last row to include in the statistics.
+ * @param mask The bad pixel mask bitset, or NULL if all the pixels are good.
+ * @param mask_start The index of the bit in mask of the first pixel of data. Pixel (x,y) of data is bad if bit
+ *        mask_start+(y*naxis_one)+x is set.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param stats The address of a structure to fill with the statistics.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Stats_Row_Function
+ * @see #Stats_Mask_Bits
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Stats_Calculate_Rows_Masked(void *data,int encoding,int naxis_one,int start_y,int end_y,
+				     unsigned long long *mask,size_t mask_start,int saturation_level,
+				     struct DpRt_Stats_Struct *stats)
+{
+	struct Stats_Row_Struct row_stats;
+	unsigned short *row = NULL;
+	unsigned short value;
+	size_t row_index;
+	int i,j;
+
+	if(data == NULL)
+	{
+		DpRt_Error_Number = 202;
+		sprintf(DpRt_Error_String,"DpRt_Stats_Calculate_Rows:data was NULL.\n");
+		return FALSE;
+	}
+	if(stats == NULL)
+	{
+		DpRt_Error_Number = 203;
+		sprintf(DpRt_Error_String,"DpRt_Stats_Calculate_Rows:stats was NULL.\n");
+		return FALSE;
+	}
+	if((encoding != DPRT_STATS_ENCODING_NATIVE)&&(encoding != DPRT_STATS_ENCODING_FITS))
+	{
+		DpRt_Error_Number = 206;
+		sprintf(DpRt_Error_String,"DpRt_Stats_Calculate_Rows:Illegal encoding %d.\n",encoding);
+		return FALSE;
+	}
+	if((naxis_one < 0)||(start_y < 0)||(end_y < start_y))
+	{
+		DpRt_Error_Number = 204;
+		sprintf(DpRt_Error_String,"DpRt_Stats_Calculate_Rows:Illegal dimensions (%d,%d,%d).\n",
+			naxis_one,start_y,end_y);
+		return FALSE;
+	}
+	if(Stats_Row_Function == NULL)
+	{
+		if(!DpRt_Stats_Initialise(NULL))
+			return FALSE;
+	}
+	stats->Sum = 0;
+	stats->Pixel_Count = ((unsigned long long)naxis_one)*((unsigned long long)(end_y-start_y));
+	stats->Min = 0xffff;
+	stats->Max = 0;
+	stats->Max_X = 0;
+	stats->Max_Y = start_y;
+	stats->Saturated_Count = 0;
+	if(stats->Pixel_Count == 0)
+	{
+		stats->Min = 0;
+		return TRUE;
+	}
+	for(j=start_y;j<end_y;j++)
+	{
+		row_index = ((size_t)naxis_one)*((size_t)j);
+		row = ((unsigned short *)data)+row_index;
+		if(saturation_level <= 0)
+		{
+			Stats_Row_Function(row,naxis_one,encoding,mask,mask_start+row_index,0xffff,&row_stats);
+			row_stats.Saturated_Count = naxis_one-row_stats.Masked_Count;
+		}
+		else if(saturation_level > 0xffff)
+		{
+			Stats_Row_Function(row,naxis_one,encoding,mask,mask_start+row_index,0xffff,&row_stats);
+			row_stats.Saturated_Count = 0;
+		}
+		else
+		{
+			Stats_Row_Function(row,naxis_one,encoding,mask,mask_start+row_index,
+					   (unsigned short)saturation_level,&row_stats);
+		}
+		stats->Sum += row_stats.Sum;
+		stats->Pixel_Count -= row_stats.Masked_Count;
+		stats->Saturated_Count += row_stats.Saturated_Count;
+		if(row_stats.Min < stats->Min)
+			stats->Min = row_stats.Min;
+		if(row_stats.Max > stats->Max)
+		{
+			stats->Max = row_stats.Max;
+			stats->Max_Y = j;
+		}
+	}
+	if(stats->Pixel_Count == 0)
+	{
+		stats->Min = 0;
+		return TRUE;
+	}
+	/* find the x position of the first (good) maximum in the row containing it */
+	if(stats->Max > 0)
+	{
+		row_index = ((size_t)naxis_one)*((size_t)stats->Max_Y);
+		row = ((unsigned short *)data)+row_index;
+		for(i=0;i<naxis_one;i++)
+		{
+			value = row[i];
+			if(encoding == DPRT_STATS_ENCODING_FITS)
+				value = STATS_FITS_DECODE(value);
+			if((value == stats->Max)&&
+			   ((mask == NULL)||((Stats_Mask_Bits(mask,mask_start+row_index+i)&1ULL) == 0)))
+			{
+				stats->Max_X = i;
+				break;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Get the bits of a bad pixel mask for the 64 pixels starting at a pixel, which need not be at the start of a
+ * word.
+ * @param mask The bad pixel mask bitset.
+ * @param start The index of the first pixel.
+ * @return The 64 bits, bit zero for pixel start.
+ * @see #Stats_Mask_Bits
+ */
+unsigned long long DpRt_Stats_Mask_Get_Bits(unsigned long long *mask,size_t start)
+{
+	return Stats_Mask_Bits(mask,start);
+}
+
+/**
+ * Merge the statistics of a partial region of a frame (for instance a band of rows) into a running total.
+ * The position of the maximum is resolved in row-major order, so the result does not depend on the order
+ * the partial results are merged in, provided no two partial regions overlap.
+ * The total should be initialised by copying the first partial result into it.
+ * @param total The address of the running total statistics, updated by this routine.
+ * @param partial The address of the partial statistics to merge in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Stats_Merge(struct DpRt_Stats_Struct *total,struct DpRt_Stats_Struct *partial)
+{
+	if((total == NULL)||(partial == NULL))
+	{
+		DpRt_Error_Number = 205;
+		sprintf(DpRt_Error_String,"DpRt_Stats_Merge:total or partial was NULL.\n");
+		return FALSE;
+	}
+	if(partial->Pixel_Count == 0)
+		return TRUE;
+	if(total->Pixel_Count == 0)
+	{
+		(*total) = (*partial);
+		return TRUE;
+	}
+	total->Sum += partial->Sum;
+	total->Pixel_Count += partial->Pixel_Count;
+	total->Saturated_Count += partial->Saturated_Count;
+	if(partial->Min < total->Min)
+		total->Min = partial->Min;
+	if((partial->Max > total->Max)||
+	   ((partial->Max == total->Max)&&((partial->Max_Y < total->Max_Y)||
+					   ((partial->Max_Y == total->Max_Y)&&(partial->Max_X < total->Max_X)))))
+	{
+		total->Max = partial->Max;
+		total->Max_X = partial->Max_X;
+		total->Max_Y = partial->Max_Y;
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Portable scalar row kernel. Bad pixels are skipped a mask word at a time.
+ * @param row The row data.
+ * @param n The number of pixels in the row.
+ * @param encoding How the pixel values are stored in the row, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param mask The bad pixel mask bitset, or NULL.
+ * @param mask_start The index of the bit in mask of the row's first pixel.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param r The address of a structure to fill with the row statistics.
+ * @see #Stats_Row_Struct
+ * @see #STATS_FITS_DECODE
+ */
+static void Stats_Row_Scalar(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r)
+{
+	unsigned long long sum = 0,saturated_count = 0,masked_count = 0,bits = 0;
+	unsigned short min = 0xffff,max = 0,value;
+	int i;
+
+	for(i=0;i<n;i++)
+	{
+		if(mask != NULL)
+		{
+			if((i%DPRT_STATS_MASK_WORD_BITS) == 0)
+				bits = Stats_Mask_Bits(mask,mask_start+i);
+			if(bits & (1ULL<<(i%DPRT_STATS_MASK_WORD_BITS)))
+			{
+				masked_count++;
+				continue;
+			}
+		}
+		value = row[i];
+		if(encoding == DPRT_STATS_ENCODING_FITS)
+			value = STATS_FITS_DECODE(value);
+		sum += value;
+		if(value < min)
+			min = value;
+		if(value > max)
+			max = value;
+		saturated_count += (value >= saturation_level);
+	}
+	r->Sum = sum;
+	r->Min = min;
+	r->Max = max;
+	r->Saturated_Count = saturated_count;
+	r->Masked_Count = masked_count;
+}
+
+#ifdef STATS_X86
+/**
+ * SSE2 row kernel. SSE2 only has signed 16-bit comparisons, so the values are biased by 0x8000 before the
+ * min/max/saturation comparisons. The sum is accumulated in 32-bit lanes, which are widened to 64-bit every
+ * STATS_CHUNK_ITERATIONS iterations. The saturated count is computed by counting pixels below the saturation level.
+ * FITS encoded data is byte-swapped with shifts. A vector's 8 mask bits are spread into a lane mask by testing
+ * each lane's bit, and bad lanes are set to zero for the sum, maximum and saturation, and to 0xffff for the minimum.
+ * @param row The row data.
+ * @param n The number of pixels in the row.
+ * @param encoding How the pixel values are stored in the row, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param mask The bad pixel mask bitset, or NULL.
+ * @param mask_start The index of the bit in mask of the row's first pixel.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param r The address of a structure to fill with the row statistics.
+ * @see #STATS_CHUNK_ITERATIONS
+ * @see #Stats_Row_Scalar
+ */
+__attribute__((target("sse2")))
+static void Stats_Row_SSE2(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r)
+{
+	__m128i bias,zero,saturation,vector_min,vector_max,sum64,sum32,below16,value,min_value,biased_value;
+	__m128i lane_bit,bad;
+	unsigned long long sum64_list[2];
+	unsigned short min_list[8],max_list[8],below_list[8];
+	struct Stats_Row_Struct tail;
+	unsigned long long below_count = 0,masked_count = 0,bits;
+	int i = 0,k,chunk_end;
+
+	bias = _mm_set1_epi16((short)0x8000);
+	zero = _mm_setzero_si128();
+	saturation = _mm_set1_epi16((short)(saturation_level^0x8000));
+	vector_min = _mm_set1_epi16((short)0x7fff);
+	vector_max = _mm_set1_epi16((short)0x8000);
+	lane_bit = _mm_setr_epi16(1,2,4,8,16,32,64,128);
+	sum64 = _mm_setzero_si128();
+	while(i+8 <= n)
+	{
+		sum32 = _mm_setzero_si128();
+		below16 = _mm_setzero_si128();
+		chunk_end = i+(8*STATS_CHUNK_ITERATIONS);
+		if(chunk_end > n)
+			chunk_end = n;
+		for(;i+8 <= chunk_end;i+=8)
+		{
+			value = _mm_loadu_si128((__m128i *)(row+i));
+			if(encoding == DPRT_STATS_ENCODING_FITS)
+				value = _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(value,8),_mm_srli_epi16(value,8)),bias);
+			min_value = value;
+			if((mask != NULL)&&((bits = (Stats_Mask_Bits(mask,mask_start+i)&0xff)) != 0))
+			{
+				masked_count += __builtin_popcountll(bits);
+				bad = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)bits),lane_bit),lane_bit);
+				min_value = _mm_or_si128(value,bad);
+				value = _mm_andnot_si128(bad,value);
+			}
+			biased_value = _mm_xor_si128(value,bias);
+			vector_min = _mm_min_epi16(vector_min,_mm_xor_si128(min_value,bias));
+			vector_max = _mm_max_epi16(vector_max,biased_value);
+			below16 = _mm_sub_epi16(below16,_mm_cmpgt_epi16(saturation,biased_value));
+			sum32 = _mm_add_epi32(sum32,_mm_add_epi32(_mm_unpacklo_epi16(value,zero),
+								  _mm_unpackhi_epi16(value,zero)));
+		}
+		sum64 = _mm_add_epi64(sum64,_mm_unpacklo_epi32(sum32,zero));
+		sum64 = _mm_add_epi64(sum64,_mm_unpackhi_epi32(sum32,zero));
+		_mm_storeu_si128((__m128i *)below_list,below16);
+		for(k=0;k<8;k++)
+			below_count += below_list[k];
+	}
+	_mm_storeu_si128((__m128i *)sum64_list,sum64);
+	_mm_storeu_si128((__m128i *)min_list,_mm_xor_si128(vector_min,bias));
+	_mm_storeu_si128((__m128i *)max_list,_mm_xor_si128(vector_max,bias));
+	Stats_Row_Scalar(row+i,n-i,encoding,mask,mask_start+i,saturation_level,&tail);
+	r->Sum = sum64_list[0]+sum64_list[1]+tail.Sum;
+	r->Min = tail.Min;
+	r->Max = tail.Max;
+	for(k=0;k<8;k++)
+	{
+		if(min_list[k] < r->Min)
+			r->Min = min_list[k];
+		if(max_list[k] > r->Max)
+			r->Max = max_list[k];
+	}
+	r->Saturated_Count = ((unsigned long long)i)-below_count+tail.Saturated_Count;
+	r->Masked_Count = masked_count+tail.Masked_Count;
+}
+
+/**
+ * AVX2 row kernel. Unsigned 16-bit min/max are available directly, a pixel is saturated if
+ * max(value,saturation_level) == value. FITS encoded data is byte-swapped with a byte shuffle. A vector's 16 mask
+ * bits are spread into a lane mask as in Stats_Row_SSE2.
+ * @param row The row data.
+ * @param n The number of pixels in the row.
+ * @param encoding How the pixel values are stored in the row, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param mask The bad pixel mask bitset, or NULL.
+ * @param mask_start The index of the bit in mask of the row's first pixel.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param r The address of a structure to fill with the row statistics.
+ * @see #STATS_CHUNK_ITERATIONS
+ * @see #Stats_Row_Scalar
+ */
+__attribute__((target("avx2")))
+static void Stats_Row_AVX2(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r)
+{
+	__m256i zero,bias,swap,saturation,vector_min,vector_max,sum64,sum32,saturated16,value,min_value,lane_bit,bad;
+	unsigned long long sum64_list[4];
+	unsigned short min_list[16],max_list[16],saturated_list[16];
+	struct Stats_Row_Struct tail;
+	unsigned long long saturated_count = 0,masked_count = 0,bits;
+	int i = 0,k,chunk_end;
+
+	zero = _mm256_setzero_si256();
+	bias = _mm256_set1_epi16((short)0x8000);
+	swap = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+	saturation = _mm256_set1_epi16((short)saturation_level);
+	vector_min = _mm256_set1_epi16((short)0xffff);
+	vector_max = _mm256_setzero_si256();
+	lane_bit = _mm256_setr_epi16(1,2,4,8,16,32,64,128,0x100,0x200,0x400,0x800,0x1000,0x2000,0x4000,
+				     (short)0x8000);
+	sum64 = _mm256_setzero_si256();
+	while(i+16 <= n)
+	{
+		sum32 = _mm256_setzero_si256();
+		saturated16 = _mm256_setzero_si256();
+		chunk_end = i+(16*STATS_CHUNK_ITERATIONS);
+		if(chunk_end > n)
+			chunk_end = n;
+		for(;i+16 <= chunk_end;i+=16)
+		{
+			value = _mm256_loadu_si256((__m256i *)(row+i));
+			if(encoding == DPRT_STATS_ENCODING_FITS)
+				value = _mm256_xor_si256(_mm256_shuffle_epi8(value,swap),bias);
+			min_value = value;
+			if((mask != NULL)&&((bits = (Stats_Mask_Bits(mask,mask_start+i)&0xffff)) != 0))
+			{
+				masked_count += __builtin_popcountll(bits);
+				bad = _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short)bits),lane_bit),
+							 lane_bit);
+				min_value = _mm256_or_si256(value,bad);
+				value = _mm256_andnot_si256(bad,value);
+			}
+			vector_min = _mm256_min_epu16(vector_min,min_value);
+			vector_max = _mm256_max_epu16(vector_max,value);
+			saturated16 = _mm256_sub_epi16(saturated16,
+					 _mm256_cmpeq_epi16(_mm256_max_epu16(value,saturation),value));
+			sum32 = _mm256_add_epi32(sum32,_mm256_add_epi32(_mm256_unpacklo_epi16(value,zero),
+									_mm256_unpackhi_epi16(value,zero)));
+		}
+		sum64 = _mm256_add_epi64(sum64,_mm256_unpacklo_epi32(sum32,zero));
+		sum64 = _mm256_add_epi64(sum64,_mm256_unpackhi_epi32(sum32,zero));
+		_mm256_storeu_si256((__m256i *)saturated_list,saturated16);
+		for(k=0;k<16;k++)
+			saturated_count += saturated_list[k];
+	}
+	_mm256_storeu_si256((__m256i *)sum64_list,sum64);
+	_mm256_storeu_si256((__m256i *)min_list,vector_min);
+	_mm256_storeu_si256((__m256i *)max_list,vector_max);
+	Stats_Row_Scalar(row+i,n-i,encoding,mask,mask_start+i,saturation_level,&tail);
+	r->Sum = sum64_list[0]+sum64_list[1]+sum64_list[2]+sum64_list[3]+tail.Sum;
+	r->Min = tail.Min;
+	r->Max = tail.Max;
+	for(k=0;k<16;k++)
+	{
+		if(min_list[k] < r->Min)
+			r->Min = min_list[k];
+		if(max_list[k] > r->Max)
+			r->Max = max_list[k];
+	}
+	r->Saturated_Count = saturated_count+tail.Saturated_Count;
+	r->Masked_Count = masked_count+tail.Masked_Count;
+}
+
+/**
+ * AVX-512 (F and BW) row kernel. The saturation comparison produces a bit mask, which is counted with popcount.
+ * FITS encoded data is byte-swapped with a byte shuffle. A vector's 32 mask bits are used directly as an
+ * AVX-512 mask register: the minimum is only updated in the good lanes, and the bad lanes are then zeroed.
+ * @param row The row data.
+ * @param n The number of pixels in the row.
+ * @param encoding How the pixel values are stored in the row, DPRT_STATS_ENCODING_NATIVE or DPRT_STATS_ENCODING_FITS.
+ * @param mask The bad pixel mask bitset, or NULL.
+ * @param mask_start The index of the bit in mask of the row's first pixel.
+ * @param saturation_level Pixels with a value greater than or equal to this are counted as saturated.
+ * @param r The address of a structure to fill with the row statistics.
+ * @see #STATS_CHUNK_ITERATIONS
+ * @see #Stats_Row_Scalar
+ */
+__attribute__((target("avx512f,avx512bw")))
+static void Stats_Row_AVX512(unsigned short *row,int n,int encoding,unsigned long long *mask,size_t mask_start,
+			unsigned short saturation_level,struct Stats_Row_Struct *r)
+{
+	__m512i zero,bias,swap,saturation,vector_min,vector_max,sum64,sum32,value;
+	unsigned short min_list[32],max_list[32];
+	struct Stats_Row_Struct tail;
+	unsigned long long saturated_count = 0,masked_count = 0;
+	__mmask32 good;
+	int i = 0,k,chunk_end;
+
+	zero = _mm512_setzero_si512();
+	bias = _mm512_set1_epi16((short)0x8000);
+	swap = _mm512_broadcast_i32x4(_mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14));
+	saturation = _mm512_set1_epi16((short)saturation_level);
+	vector_min = _mm512_set1_epi16((short)0xffff);
+	vector_max = _mm512_setzero_si512();
+	sum64 = _mm512_setzero_si512();
+	while(i+32 <= n)
+	{
+		sum32 = _mm512_setzero_si512();
+		chunk_end = i+(32*STATS_CHUNK_ITERATIONS);
+		if(chunk_end > n)
+			chunk_end = n;
+		for(;i+32 <= chunk_end;i+=32)
+		{
+			value = _mm512_loadu_si512((void *)(row+i));
+			if(encoding == DPRT_STATS_ENCODING_FITS)
+				value = _mm512_xor_si512(_mm512_shuffle_epi8(value,swap),bias);
+			if((mask != NULL)&&((good = (__mmask32)~Stats_Mask_Bits(mask,mask_start+i)) != 0xffffffffU))
+			{
+				masked_count += 32-__builtin_popcount((unsigned int)good);
+				vector_min = _mm512_mask_min_epu16(vector_min,good,vector_min,value);
+				value = _mm512_maskz_mov_epi16(good,value);
+			}
+			else
+				vector_min = _mm512_min_epu16(vector_min,value);
+			vector_max = _mm512_max_epu16(vector_max,value);
+			saturated_count += __builtin_popcount((unsigned int)_mm512_cmpge_epu16_mask(value,saturation));
+			sum32 = _mm512_add_epi32(sum32,_mm512_add_epi32(_mm512_unpacklo_epi16(value,zero),
+									_mm512_unpackhi_epi16(value,zero)));
+		}
+		sum64 = _mm512_add_epi64(sum64,_mm512_cvtepu32_epi64(_mm512_castsi512_si256(sum32)));
+		sum64 = _mm512_add_epi64(sum64,_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(sum32,1)));
+	}
+	_mm512_storeu_si512((void *)min_list,vector_min);
+	_mm512_storeu_si512((void *)max_list,vector_max);
+	Stats_Row_Scalar(row+i,n-i,encoding,mask,mask_start+i,saturation_level,&tail);
+	r->Sum = ((unsigned long long)_mm512_reduce_add_epi64(sum64))+tail.Sum;
+	r->Min = tail.Min;
+	r->Max = tail.Max;
+	for(k=0;k<32;k++)
+	{
+		if(min_list[k] < r->Min)
+			r->Min = min_list[k];
+		if(max_list[k] > r->Max)
+			r->Max = max_list[k];
+	}
+	r->Saturated_Count = saturated_count+tail.Saturated_Count;
+	r->Masked_Count = masked_count+tail.Masked_Count;
+}
+#endif
+
+/**
+ * Get the bits of a bad pixel mask for the 64 pixels starting at a pixel. The pixel need not be at the start of a
+ * word, in which case the bits are taken from two words (the spare word at the end of the mask means the second
+ * word always exists).
+ * @param mask The bad pixel mask bitset.
+ * @param start The index of the first pixel.
+ * @return The 64 bits, bit zero for pixel start.
+ * @see dprt_stats.html#DPRT_STATS_MASK_WORD_COUNT
+ */
+static inline unsigned long long Stats_Mask_Bits(unsigned long long *mask,size_t start)
+{
+	size_t word = start/DPRT_STATS_MASK_WORD_BITS;
+	int shift = (int)(start%DPRT_STATS_MASK_WORD_BITS);
+
+	if(shift == 0)
+		return mask[word];
+	return (mask[word]>>shift)|(mask[word+1]<<(DPRT_STATS_MASK_WORD_BITS-shift));
+}
+
+/**
+ * Work out the best row kernel supported by this CPU (and build).
+ * @return The best supported kernel.
+ * @see #STATS_KERNEL
+ */
+static enum STATS_KERNEL Stats_Detect_Kernel(void)
+{
+#ifdef STATS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return STATS_KERNEL_AVX512;
+	if(__builtin_cpu_supports("avx2"))
+		return STATS_KERNEL_AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return STATS_KERNEL_SSE2;
+#endif
+	return STATS_KERNEL_SCALAR;
+}
+
+/*
+** $Log$
+*/
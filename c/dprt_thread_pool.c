@@ -0,0 +1,386 @@
+/* dprt_thread_pool.c
+** Worker thread pool used to parallelise reductions.
+** $Header$
+*/
+/**
+ * dprt_thread_pool.c provides a pool of worker threads, created in DpRt_Initialise and destroyed in DpRt_Shutdown.
+ * A caller submits a job of a number of independent tasks (for instance, one per band of rows in a frame) with
+ * DpRt_Thread_Pool_Run. The tasks are claimed in order by the worker threads, and by the calling thread itself,
+ * and DpRt_Thread_Pool_Run returns when they have all completed. Several jobs may be run concurrently from
+ * different calling threads.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_thread_pool.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The maximum number of threads (including the calling thread) the pool will use.
+ */
+#define THREAD_POOL_MAX_THREAD_COUNT	(256)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a job submitted to the pool. The structure lives on the stack of the DpRt_Thread_Pool_Run
+ * call that submitted it.
+ * <dl>
+ * <dt>Task_Count</dt> <dd>The number of tasks in the job.</dd>
+ * <dt>Next_Task</dt> <dd>The index of the next task to be claimed.</dd>
+ * <dt>Completed_Count</dt> <dd>The number of tasks that have finished.</dd>
+ * <dt>Failed_Count</dt> <dd>The number of tasks that returned FALSE.</dd>
+ * <dt>Function</dt> <dd>The function to call for each task.</dd>
+ * <dt>User_Data</dt> <dd>The user data to pass to Function.</dd>
+ * <dt>Next</dt> <dd>The next job in the pool's job list.</dd>
+ * </dl>
+ */
+struct Thread_Pool_Job_Struct
+{
+	int Task_Count;
+	int Next_Task;
+	int Completed_Count;
+	int Failed_Count;
+	DpRt_Thread_Pool_Task_Function Function;
+	void *User_Data;
+	struct Thread_Pool_Job_Struct *Next;
+};
+
+/**
+ * Structure holding the thread pool's data.
+ * <dl>
+ * <dt>Thread_List</dt> <dd>The list of worker threads.</dd>
+ * <dt>Worker_Count</dt> <dd>The number of worker threads (the thread count less the calling thread).</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting the job list and job structures.</dd>
+ * <dt>Work_Condition</dt> <dd>Condition signalled when a job is added, or the pool is shutting down.</dd>
+ * <dt>Done_Condition</dt> <dd>Condition signalled when a job's last task completes.</dd>
+ * <dt>Job_List_Head</dt> <dd>The first job in the list of jobs with unclaimed tasks.</dd>
+ * <dt>Job_List_Tail</dt> <dd>The last job in the list of jobs with unclaimed tasks.</dd>
+ * <dt>Shutdown</dt> <dd>A boolean, set to TRUE to stop the worker threads.</dd>
+ * </dl>
+ * @see #Thread_Pool_Job_Struct
+ */
+struct Thread_Pool_Struct
+{
+	pthread_t *Thread_List;
+	int Worker_Count;
+	pthread_mutex_t Mutex;
+	pthread_cond_t Work_Condition;
+	pthread_cond_t Done_Condition;
+	struct Thread_Pool_Job_Struct *Job_List_Head;
+	struct Thread_Pool_Job_Struct *Job_List_Tail;
+	int Shutdown;
+};
+
+/**
+ * Structure passed to each worker thread on creation.
+ * <dl>
+ * <dt>Thread_Index</dt> <dd>The index of the worker thread, passed to task functions.</dd>
+ * </dl>
+ */
+struct Thread_Pool_Worker_Struct
+{
+	int Thread_Index;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The thread pool data.
+ * @see #Thread_Pool_Struct
+ */
+static struct Thread_Pool_Struct Thread_Pool_Data =
+{
+	NULL,0,PTHREAD_MUTEX_INITIALIZER,PTHREAD_COND_INITIALIZER,PTHREAD_COND_INITIALIZER,NULL,NULL,FALSE
+};
+/**
+ * The per worker data, allocated when the pool is initialised.
+ * @see #Thread_Pool_Worker_Struct
+ */
+static struct Thread_Pool_Worker_Struct *Thread_Pool_Worker_List = NULL;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void *Thread_Pool_Worker(void *arg);
+static struct Thread_Pool_Job_Struct *Thread_Pool_Claim_Task(struct Thread_Pool_Job_Struct *job,int *task_index);
+static void Thread_Pool_Complete_Task(struct Thread_Pool_Job_Struct *job,int retval);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Create the worker threads. If the pool has already been initialised, the existing worker threads are stopped first.
+ * @param thread_count The total number of threads to use, including the calling thread. If this is zero
+ *        or less, the number of online CPUs is used. If this is one, no worker threads are created and tasks are
+ *        run serially by the calling thread.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Thread_Pool_Data
+ * @see #Thread_Pool_Worker_List
+ * @see #Thread_Pool_Worker
+ * @see #THREAD_POOL_MAX_THREAD_COUNT
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Thread_Pool_Initialise(int thread_count)
+{
+	int i,retval;
+
+	/* re-initialising the pool replaces the existing worker threads */
+	if(Thread_Pool_Data.Thread_List != NULL)
+		DpRt_Thread_Pool_Shutdown();
+	if(thread_count <= 0)
+		thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(thread_count < 1)
+		thread_count = 1;
+	if(thread_count > THREAD_POOL_MAX_THREAD_COUNT)
+		thread_count = THREAD_POOL_MAX_THREAD_COUNT;
+	fprintf(stdout,"DpRt_Thread_Pool_Initialise:Using %d threads.\n",thread_count);
+	Thread_Pool_Data.Shutdown = FALSE;
+	Thread_Pool_Data.Worker_Count = 0;
+	if(thread_count == 1)
+		return TRUE;
+	Thread_Pool_Data.Thread_List = (pthread_t *)malloc((thread_count-1)*sizeof(pthread_t));
+	Thread_Pool_Worker_List = (struct Thread_Pool_Worker_Struct *)malloc((thread_count-1)*
+									   sizeof(struct Thread_Pool_Worker_Struct));
+	if((Thread_Pool_Data.Thread_List == NULL)||(Thread_Pool_Worker_List == NULL))
+	{
+		if(Thread_Pool_Data.Thread_List != NULL)
+			free(Thread_Pool_Data.Thread_List);
+		Thread_Pool_Data.Thread_List = NULL;
+		if(Thread_Pool_Worker_List != NULL)
+			free(Thread_Pool_Worker_List);
+		Thread_Pool_Worker_List = NULL;
+		DpRt_Error_Number = 300;
+		sprintf(DpRt_Error_String,"DpRt_Thread_Pool_Initialise:Failed to allocate thread list(%d).\n",
+			thread_count);
+		return FALSE;
+	}
+	for(i=0;i<thread_count-1;i++)
+	{
+		Thread_Pool_Worker_List[i].Thread_Index = i;
+		retval = pthread_create(&(Thread_Pool_Data.Thread_List[i]),NULL,Thread_Pool_Worker,
+					&(Thread_Pool_Worker_List[i]));
+		if(retval != 0)
+		{
+			/* stop the workers created so far */
+			DpRt_Thread_Pool_Shutdown();
+			DpRt_Error_Number = 301;
+			sprintf(DpRt_Error_String,"DpRt_Thread_Pool_Initialise:Failed to create thread %d (%d).\n",
+				i,retval);
+			return FALSE;
+		}
+		Thread_Pool_Data.Worker_Count++;
+	}
+	return TRUE;
+}
+
+/**
+ * Stop and join the worker threads. Any jobs still running complete, as their calling threads run any
+ * remaining tasks themselves.
+ * @return The routine returns TRUE.
+ * @see #Thread_Pool_Data
+ * @see #Thread_Pool_Worker_List
+ */
+int DpRt_Thread_Pool_Shutdown(void)
+{
+	int i;
+
+	if(Thread_Pool_Data.Thread_List == NULL)
+		return TRUE;
+	pthread_mutex_lock(&(Thread_Pool_Data.Mutex));
+	Thread_Pool_Data.Shutdown = TRUE;
+	pthread_cond_broadcast(&(Thread_Pool_Data.Work_Condition));
+	pthread_mutex_unlock(&(Thread_Pool_Data.Mutex));
+	for(i=0;i<Thread_Pool_Data.Worker_Count;i++)
+		pthread_join(Thread_Pool_Data.Thread_List[i],NULL);
+	free(Thread_Pool_Data.Thread_List);
+	Thread_Pool_Data.Thread_List = NULL;
+	free(Thread_Pool_Worker_List);
+	Thread_Pool_Worker_List = NULL;
+	Thread_Pool_Data.Worker_Count = 0;
+	return TRUE;
+}
+
+/**
+ * Return the number of threads (worker threads plus the calling thread) tasks may be run on. This is the number
+ * of per-thread scratch areas a task function indexing by thread_index requires.
+ * @return The thread count, at least one.
+ * @see #Thread_Pool_Data
+ */
+int DpRt_Thread_Pool_Get_Thread_Count(void)
+{
+	return Thread_Pool_Data.Worker_Count+1;
+}
+
+/**
+ * Run a job of task_count tasks on the thread pool, and wait for them all to complete. The calling thread
+ * also runs tasks, using thread index DpRt_Thread_Pool_Get_Thread_Count()-1.
+ * The tasks are claimed in index order, but may complete in any order; callers needing deterministic results
+ * should store per task results and merge them in index order afterwards.
+ * @param task_count The number of tasks to run.
+ * @param function The function to call for each task.
+ * @param user_data A pointer passed to each call of function.
+ * @return The routine returns TRUE if all the tasks succeeded, and FALSE if any task failed. Task functions
+ *         should record their own failure reasons, this routine does not set the error number/string when
+ *         a task fails.
+ * @see #Thread_Pool_Data
+ * @see #Thread_Pool_Claim_Task
+ * @see #Thread_Pool_Complete_Task
+ */
+int DpRt_Thread_Pool_Run(int task_count,DpRt_Thread_Pool_Task_Function function,void *user_data)
+{
+	struct Thread_Pool_Job_Struct job;
+	int task_index,retval,failed_count,caller_thread_index;
+
+	if(function == NULL)
+	{
+		DpRt_Error_Number = 302;
+		sprintf(DpRt_Error_String,"DpRt_Thread_Pool_Run:function was NULL.\n");
+		return FALSE;
+	}
+	if(task_count <= 0)
+		return TRUE;
+	job.Task_Count = task_count;
+	job.Next_Task = 0;
+	job.Completed_Count = 0;
+	job.Failed_Count = 0;
+	job.Function = function;
+	job.User_Data = user_data;
+	job.Next = NULL;
+	pthread_mutex_lock(&(Thread_Pool_Data.Mutex));
+	caller_thread_index = Thread_Pool_Data.Worker_Count;
+	/* only hand the job to the workers if there are any, and more than one task */
+	if((Thread_Pool_Data.Worker_Count > 0)&&(task_count > 1)&&(Thread_Pool_Data.Shutdown == FALSE))
+	{
+		if(Thread_Pool_Data.Job_List_Tail != NULL)
+			Thread_Pool_Data.Job_List_Tail->Next = &job;
+		else
+			Thread_Pool_Data.Job_List_Head = &job;
+		Thread_Pool_Data.Job_List_Tail = &job;
+		pthread_cond_broadcast(&(Thread_Pool_Data.Work_Condition));
+	}
+	/* the calling thread runs tasks from it's own job */
+	while(Thread_Pool_Claim_Task(&job,&task_index) != NULL)
+	{
+		pthread_mutex_unlock(&(Thread_Pool_Data.Mutex));
+		retval = function(user_data,task_index,caller_thread_index);
+		pthread_mutex_lock(&(Thread_Pool_Data.Mutex));
+		Thread_Pool_Complete_Task(&job,retval);
+	}
+	/* wait for tasks claimed by workers to complete */
+	while(job.Completed_Count < job.Task_Count)
+		pthread_cond_wait(&(Thread_Pool_Data.Done_Condition),&(Thread_Pool_Data.Mutex));
+	failed_count = job.Failed_Count;
+	pthread_mutex_unlock(&(Thread_Pool_Data.Mutex));
+	return (failed_count == 0);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Worker thread function. Claims tasks from the head of the job list until the pool is shut down.
+ * @param arg A pointer to this worker's Thread_Pool_Worker_Struct.
+ * @return NULL.
+ * @see #Thread_Pool_Data
+ * @see #Thread_Pool_Claim_Task
+ * @see #Thread_Pool_Complete_Task
+ */
+static void *Thread_Pool_Worker(void *arg)
+{
+	struct Thread_Pool_Worker_Struct *worker = (struct Thread_Pool_Worker_Struct *)arg;
+	struct Thread_Pool_Job_Struct *job = NULL;
+	int task_index,retval;
+
+	pthread_mutex_lock(&(Thread_Pool_Data.Mutex));
+	while(TRUE)
+	{
+		while((Thread_Pool_Data.Shutdown == FALSE)&&(Thread_Pool_Data.Job_List_Head == NULL))
+			pthread_cond_wait(&(Thread_Pool_Data.Work_Condition),&(Thread_Pool_Data.Mutex));
+		if(Thread_Pool_Data.Shutdown)
+			break;
+		job = Thread_Pool_Claim_Task(Thread_Pool_Data.Job_List_Head,&task_index);
+		if(job == NULL)
+			continue;
+		pthread_mutex_unlock(&(Thread_Pool_Data.Mutex));
+		retval = job->Function(job->User_Data,task_index,worker->Thread_Index);
+		pthread_mutex_lock(&(Thread_Pool_Data.Mutex));
+		Thread_Pool_Complete_Task(job,retval);
+	}
+	pthread_mutex_unlock(&(Thread_Pool_Data.Mutex));
+	return NULL;
+}
+
+/**
+ * Claim the next task of a job. If this claims the job's last task, the job is removed from the pool's job list
+ * (if it is on it). Must be called with Thread_Pool_Data.Mutex held.
+ * @param job The job to claim a task from, or NULL.
+ * @param task_index The address of an integer to store the claimed task index.
+ * @return The job, or NULL if the job was NULL or had no unclaimed tasks.
+ * @see #Thread_Pool_Data
+ */
+static struct Thread_Pool_Job_Struct *Thread_Pool_Claim_Task(struct Thread_Pool_Job_Struct *job,int *task_index)
+{
+	struct Thread_Pool_Job_Struct *previous_job = NULL;
+	struct Thread_Pool_Job_Struct *current_job = NULL;
+
+	if((job == NULL)||(job->Next_Task >= job->Task_Count))
+		return NULL;
+	(*task_index) = job->Next_Task;
+	job->Next_Task++;
+	if(job->Next_Task >= job->Task_Count)
+	{
+		/* remove the fully claimed job from the job list */
+		for(current_job = Thread_Pool_Data.Job_List_Head;current_job != NULL;current_job = current_job->Next)
+		{
+			if(current_job == job)
+			{
+				if(previous_job != NULL)
+					previous_job->Next = job->Next;
+				else
+					Thread_Pool_Data.Job_List_Head = job->Next;
+				if(Thread_Pool_Data.Job_List_Tail == job)
+					Thread_Pool_Data.Job_List_Tail = previous_job;
+				job->Next = NULL;
+				break;
+			}
+			previous_job = current_job;
+		}
+	}
+	return job;
+}
+
+/**
+ * Record the completion of a task, and wake the job's submitter if it was the last one.
+ * Must be called with Thread_Pool_Data.Mutex held.
+ * @param job The job the task belonged to.
+ * @param retval The value returned by the task function.
+ * @see #Thread_Pool_Data
+ */
+static void Thread_Pool_Complete_Task(struct Thread_Pool_Job_Struct *job,int retval)
+{
+	if(retval == FALSE)
+		job->Failed_Count++;
+	job->Completed_Count++;
+	if(job->Completed_Count >= job->Task_Count)
+		pthread_cond_broadcast(&(Thread_Pool_Data.Done_Condition));
+}
+
+/*
+** $Log$
+*/
@@ -0,0 +1,647 @@
+/* dprt_trace.c
+** Measurement and caching of the trace of a spectrum across the frame.
+** $Header$
+*/
+/**
+ * dprt_trace.c measures the trace of a spectrum across a Sprat frame, and caches it between frames. The data
+ * section is divided into blocks of columns, the centroid of the trace is measured in a narrow window of rows in
+ * each block, around the row a model of the trace predicts, and a low order polynomial is fitted to the block
+ * centroids, rejecting outliers. Only the window rows of each block are read, calibrated on the fly a row at a time.
+ * The fitted models are cached by a key describing the target and instrument configuration, so the next frame of a
+ * repeat-exposure sequence can be measured in a narrow window around the previous frame's trace, rather than
+ * searched for from scratch.
+ * @author Chris Mottram, LJMU
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_calibration.h"
+#include "dprt_overscan.h"
+#include "dprt_source.h"
+#include "dprt_trace.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The ratio of the standard deviation of a normal distribution to it's median absolute deviation.
+ */
+#define TRACE_SIGMA_PER_MAD		(1.4826)
+/**
+ * Block centroids more than this many standard deviations (estimated from the median absolute residual) from the
+ * fitted polynomial are rejected.
+ */
+#define TRACE_CLIP_KAPPA		(3.0)
+/**
+ * The smallest residual, in rows, a block centroid is rejected for, so a near perfect fit does not reject
+ * good centroids.
+ */
+#define TRACE_MIN_CLIP_RESIDUAL		(0.25)
+/**
+ * The maximum number of times outliers are rejected and the polynomial refitted.
+ */
+#define TRACE_CLIP_ITERATIONS		(2)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a cached trace model.
+ * <dl>
+ * <dt>Key</dt> <dd>The key the model was cached with, an empty string if the entry is unused.</dd>
+ * <dt>Trace</dt> <dd>The trace model.</dd>
+ * <dt>Last_Used</dt> <dd>The value of Trace_Use_Count when the entry was last used.</dd>
+ * </dl>
+ * @see #DPRT_TRACE_KEY_LENGTH
+ */
+struct Trace_Cache_Struct
+{
+	char Key[DPRT_TRACE_KEY_LENGTH];
+	struct DpRt_Trace_Struct Trace;
+	unsigned long Last_Used;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The cached trace models.
+ * @see #Trace_Cache_Struct
+ */
+static struct Trace_Cache_Struct Trace_Cache_List[DPRT_TRACE_CACHE_COUNT];
+/**
+ * A counter incremented every time a cached model is used, used to find the least recently used model.
+ */
+static unsigned long Trace_Use_Count = 0;
+/**
+ * Mutex protecting the cached trace models.
+ */
+static pthread_mutex_t Trace_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static double Trace_Sum_Row(struct DpRt_Source_Frame_Struct *frame,int y,float level,int start_x,int pixel_count);
+static int Trace_Centroid(double *window_sum_list,int window_count,double *centroid);
+static int Trace_Fit(double *x_list,double *y_list,int *used_list,int count,struct DpRt_Trace_Struct *trace,
+		     double *residual_list);
+static int Trace_Find(char *key);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the trace measurement parameters from the configuration ("dprt.trace.block_count", "dprt.trace.order",
+ * "dprt.trace.window", "dprt.trace.search_window" and "dprt.trace.max_residual").
+ * @param parameters The address of a structure to fill in.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_TRACE_MAX_BLOCK_COUNT
+ * @see #DPRT_TRACE_MAX_ORDER
+ * @see #DPRT_TRACE_MAX_WINDOW
+ * @see dprt_config.html#DpRt_Config_Get_Integer
+ * @see dprt_config.html#DpRt_Config_Get_Double
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Trace_Get_Parameters(struct DpRt_Trace_Parameter_Struct *parameters)
+{
+	if(parameters == NULL)
+	{
+		DpRt_Error_Number = 1900;
+		sprintf(DpRt_Error_String,"DpRt_Trace_Get_Parameters:parameters was NULL.\n");
+		return FALSE;
+	}
+	if((!DpRt_Config_Get_Integer("dprt.trace.block_count",&(parameters->Block_Count)))||
+	   (!DpRt_Config_Get_Integer("dprt.trace.order",&(parameters->Order)))||
+	   (!DpRt_Config_Get_Integer("dprt.trace.window",&(parameters->Window)))||
+	   (!DpRt_Config_Get_Integer("dprt.trace.search_window",&(parameters->Search_Window)))||
+	   (!DpRt_Config_Get_Double("dprt.trace.max_residual",&(parameters->Max_Residual))))
+		return FALSE;
+	if((parameters->Block_Count < 1)||(parameters->Block_Count > DPRT_TRACE_MAX_BLOCK_COUNT)||
+	   (parameters->Order < 0)||(parameters->Order > DPRT_TRACE_MAX_ORDER)||
+	   (parameters->Window < 1)||(parameters->Window > DPRT_TRACE_MAX_WINDOW)||
+	   (parameters->Search_Window < 1)||(parameters->Search_Window > DPRT_TRACE_MAX_WINDOW)||
+	   (parameters->Max_Residual <= 0.0))
+	{
+		DpRt_Error_Number = 1901;
+		sprintf(DpRt_Error_String,"DpRt_Trace_Get_Parameters:Illegal block count %d (1..%d), order %d (0..%d), "
+			"window %d or search window %d (1..%d), or max residual %.3f.\n",parameters->Block_Count,
+			DPRT_TRACE_MAX_BLOCK_COUNT,parameters->Order,DPRT_TRACE_MAX_ORDER,parameters->Window,
+			parameters->Search_Window,DPRT_TRACE_MAX_WINDOW,parameters->Max_Residual);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Get the row of a trace model at a column.
+ * @param trace The trace model.
+ * @param x The column.
+ * @return The row of the trace.
+ * @see #DpRt_Trace_Struct
+ */
+double DpRt_Trace_Evaluate(struct DpRt_Trace_Struct *trace,double x)
+{
+	double u,y;
+	int i;
+
+	u = (x-trace->Centre_X)/trace->Scale_X;
+	y = 0.0;
+	for(i=trace->Order;i>=0;i--)
+		y = (y*u)+trace->Coefficient_List[i];
+	return y;
+}
+
+/**
+ * Get the columns of one of the blocks a section of columns is divided into. The blocks are as equal in width as
+ * possible.
+ * @param start_x The first column of the section.
+ * @param width The number of columns in the section.
+ * @param block_count The number of blocks, no more than width.
+ * @param block The block, from 0 to block_count-1.
+ * @param block_start_x The address of an integer to store the first column of the block.
+ * @param block_end_x The address of an integer to store one more than the last column of the block.
+ */
+void DpRt_Trace_Get_Block(int start_x,int width,int block_count,int block,int *block_start_x,int *block_end_x)
+{
+	(*block_start_x) = start_x+((block*width)/block_count);
+	(*block_end_x) = start_x+(((block+1)*width)/block_count);
+}
+
+/**
+ * Measure the trace of a spectrum in a frame, in a window of rows around a predicted trace. The data section is
+ * divided into parameters->Block_Count blocks of columns, and in each the rows within window rows of the predicted
+ * trace (at the block's centre column) are summed, calibrated on the fly. The rows are read in order, each row's
+ * overscan level being found once for all the blocks whose window it is in. The centroid of each block's window
+ * profile (see Trace_Centroid) is the trace's row in that block, and a polynomial of order parameters->Order
+ * (less if there are too few centroids) is fitted to them, rejecting outliers (see Trace_Fit). If fewer than two
+ * blocks have a centroid, trace->Valid is set to FALSE.
+ * @param frame The frame, and it's calibration.
+ * @param parameters The trace measurement parameters.
+ * @param predicted_trace The trace model predicting where the trace is. This can be trace.
+ * @param window The half width of the window, in rows, at most DPRT_TRACE_MAX_WINDOW.
+ * @param trace The address of a structure to fill in with the fitted trace model.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #DPRT_TRACE_MAX_BLOCK_COUNT
+ * @see #DPRT_TRACE_MAX_WINDOW
+ * @see #DpRt_Trace_Evaluate
+ * @see #DpRt_Trace_Get_Block
+ * @see dprt_source.html#DpRt_Source_Get_Section
+ * @see #Trace_Sum_Row
+ * @see #Trace_Centroid
+ * @see #Trace_Fit
+ * @see dprt_overscan.html#DpRt_Overscan_Get_Levels
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Trace_Refine(struct DpRt_Source_Frame_Struct *frame,struct DpRt_Trace_Parameter_Struct *parameters,
+		      struct DpRt_Trace_Struct *predicted_trace,int window,struct DpRt_Trace_Struct *trace)
+{
+	double window_sum_list[DPRT_TRACE_MAX_BLOCK_COUNT][(2*DPRT_TRACE_MAX_WINDOW)+1];
+	double x_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	double y_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	double residual_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int window_start_y_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	int used_list[DPRT_TRACE_MAX_BLOCK_COUNT];
+	struct DpRt_Trace_Struct predicted;
+	double centroid;
+	float level;
+	int start_x,end_x,start_y,end_y,width,block_count,window_count,min_y,max_y,block_start_x,block_end_x;
+	int block,row_used,y;
+
+	if((frame == NULL)||(parameters == NULL)||(predicted_trace == NULL)||(trace == NULL)||
+	   (predicted_trace->Valid == FALSE)||(window < 1)||(window > DPRT_TRACE_MAX_WINDOW))
+	{
+		DpRt_Error_Number = 1902;
+		sprintf(DpRt_Error_String,"DpRt_Trace_Refine:Illegal arguments.\n");
+		return FALSE;
+	}
+	/* take a copy of the prediction, so it can be the trace being filled in */
+	predicted = (*predicted_trace);
+	memset(trace,0,sizeof(struct DpRt_Trace_Struct));
+	trace->Valid = FALSE;
+	DpRt_Source_Get_Section(frame,&start_x,&end_x,&start_y,&end_y);
+	width = end_x-start_x;
+	window_count = (2*window)+1;
+	if((width < 1)||((end_y-start_y) < window_count))
+		return TRUE;
+	block_count = parameters->Block_Count;
+	if(block_count > width)
+		block_count = width;
+	trace->Block_Count = block_count;
+	/* the window of each block, around the predicted trace at it's centre column */
+	min_y = end_y;
+	max_y = start_y-1;
+	for(block=0;block<block_count;block++)
+	{
+		DpRt_Trace_Get_Block(start_x,width,block_count,block,&block_start_x,&block_end_x);
+		x_list[block] = ((double)(block_start_x+block_end_x-1))/2.0;
+		window_start_y_list[block] = ((int)floor(DpRt_Trace_Evaluate(&predicted,x_list[block])+0.5))-window;
+		used_list[block] = (window_start_y_list[block] >= start_y)&&
+			((window_start_y_list[block]+window_count) <= end_y);
+		if(used_list[block])
+		{
+			if(window_start_y_list[block] < min_y)
+				min_y = window_start_y_list[block];
+			if(window_start_y_list[block]+window_count-1 > max_y)
+				max_y = window_start_y_list[block]+window_count-1;
+		}
+	}
+	/* sum each block's window rows, a row at a time */
+	for(y=min_y;y<=max_y;y++)
+	{
+		row_used = FALSE;
+		for(block=0;block<block_count;block++)
+		{
+			if(used_list[block] && (y >= window_start_y_list[block])&&
+			   (y < window_start_y_list[block]+window_count))
+				row_used = TRUE;
+		}
+		if(row_used == FALSE)
+			continue;
+		level = 0.0f;
+		if((frame->Overscan != NULL)&&(frame->Overscan->Enabled))
+		{
+			if(!DpRt_Overscan_Get_Levels(frame->Overscan,frame->Data,frame->Encoding,frame->Naxis_One,y,1,
+						     frame->Bias,&level))
+				return FALSE;
+		}
+		for(block=0;block<block_count;block++)
+		{
+			if(used_list[block] && (y >= window_start_y_list[block])&&
+			   (y < window_start_y_list[block]+window_count))
+			{
+				DpRt_Trace_Get_Block(start_x,width,block_count,block,&block_start_x,&block_end_x);
+				window_sum_list[block][y-window_start_y_list[block]] = Trace_Sum_Row(frame,y,level,
+									block_start_x,block_end_x-block_start_x);
+			}
+		}
+	}
+	/* the trace's centroid in each block */
+	for(block=0;block<block_count;block++)
+	{
+		if(used_list[block])
+		{
+			used_list[block] = Trace_Centroid(window_sum_list[block],window_count,&centroid);
+			if(used_list[block])
+				y_list[block] = ((double)window_start_y_list[block])+centroid;
+		}
+	}
+	trace->Order = parameters->Order;
+	trace->Centre_X = ((double)(start_x+end_x-1))/2.0;
+	trace->Scale_X = ((double)width)/2.0;
+	if(trace->Scale_X < 1.0)
+		trace->Scale_X = 1.0;
+	trace->Valid = Trace_Fit(x_list,y_list,used_list,block_count,trace,residual_list);
+	return TRUE;
+}
+
+/**
+ * Get a trace model from the cache.
+ * @param key The key the model was cached with, describing the target and instrument configuration. If it is an
+ *        empty string, no model is found.
+ * @param trace The address of a structure to copy the model into. If there is no model cached with this key,
+ *        trace->Valid is set to FALSE.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Trace_Mutex
+ * @see #Trace_Cache_List
+ * @see #Trace_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Trace_Cache_Get(char *key,struct DpRt_Trace_Struct *trace)
+{
+	int index;
+
+	if((key == NULL)||(trace == NULL))
+	{
+		DpRt_Error_Number = 1903;
+		sprintf(DpRt_Error_String,"DpRt_Trace_Cache_Get:key or trace was NULL.\n");
+		return FALSE;
+	}
+	trace->Valid = FALSE;
+	pthread_mutex_lock(&Trace_Mutex);
+	index = Trace_Find(key);
+	if(index >= 0)
+	{
+		(*trace) = Trace_Cache_List[index].Trace;
+		Trace_Cache_List[index].Last_Used = ++Trace_Use_Count;
+	}
+	pthread_mutex_unlock(&Trace_Mutex);
+	return TRUE;
+}
+
+/**
+ * Put a trace model into the cache, replacing any model already cached with the same key. If the cache is full,
+ * the least recently used model is thrown away. Models that are not valid, or have an empty key, are not cached.
+ * @param key The key to cache the model with, describing the target and instrument configuration, shorter than
+ *        DPRT_TRACE_KEY_LENGTH.
+ * @param trace The trace model.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see #Trace_Mutex
+ * @see #Trace_Cache_List
+ * @see #Trace_Find
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Trace_Cache_Put(char *key,struct DpRt_Trace_Struct *trace)
+{
+	int index,i;
+
+	if((key == NULL)||(trace == NULL)||(strlen(key) >= DPRT_TRACE_KEY_LENGTH))
+	{
+		DpRt_Error_Number = 1904;
+		sprintf(DpRt_Error_String,"DpRt_Trace_Cache_Put:Illegal key or trace.\n");
+		return FALSE;
+	}
+	if((strlen(key) == 0)||(trace->Valid == FALSE))
+		return TRUE;
+	pthread_mutex_lock(&Trace_Mutex);
+	index = Trace_Find(key);
+	if(index < 0)
+	{
+		/* an unused entry, or the least recently used one */
+		for(i=0;i<DPRT_TRACE_CACHE_COUNT;i++)
+		{
+			if(strlen(Trace_Cache_List[i].Key) == 0)
+			{
+				index = i;
+				break;
+			}
+			if((index < 0)||(Trace_Cache_List[i].Last_Used < Trace_Cache_List[index].Last_Used))
+				index = i;
+		}
+		strcpy(Trace_Cache_List[index].Key,key);
+	}
+	Trace_Cache_List[index].Trace = (*trace);
+	Trace_Cache_List[index].Last_Used = ++Trace_Use_Count;
+	pthread_mutex_unlock(&Trace_Mutex);
+	return TRUE;
+}
+
+/**
+ * Throw away all the cached trace models.
+ * @return The routine returns TRUE.
+ * @see #Trace_Mutex
+ * @see #Trace_Cache_List
+ */
+int DpRt_Trace_Shutdown(void)
+{
+	int i;
+
+	pthread_mutex_lock(&Trace_Mutex);
+	for(i=0;i<DPRT_TRACE_CACHE_COUNT;i++)
+	{
+		Trace_Cache_List[i].Key[0] = '\0';
+		Trace_Cache_List[i].Trace.Valid = FALSE;
+	}
+	Trace_Use_Count = 0;
+	pthread_mutex_unlock(&Trace_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Sum part of a row of a frame, calibrated: the row's overscan level, bias, flat and bad pixel mask are applied
+ * a chunk at a time into a buffer on the stack, which is summed whilst it is still in cache.
+ * @param frame The frame, and it's calibration.
+ * @param y The row.
+ * @param level The row's overscan level, or zero if overscan is not in use.
+ * @param start_x The first column to sum.
+ * @param pixel_count The number of pixels to sum.
+ * @return The sum of the calibrated pixels.
+ * @see dprt_calibration.html#DpRt_Calibration_Apply_Pixels
+ * @see dprt_calibration.html#DPRT_CALIBRATION_CHUNK_PIXELS
+ */
+static double Trace_Sum_Row(struct DpRt_Source_Frame_Struct *frame,int y,float level,int start_x,int pixel_count)
+{
+	unsigned short chunk[DPRT_CALIBRATION_CHUNK_PIXELS];
+	unsigned long long sum;
+	size_t row_start;
+	int chunk_count,x,i;
+
+	sum = 0;
+	row_start = (((size_t)y)*((size_t)frame->Naxis_One))+start_x;
+	for(x=0;x<pixel_count;x+=chunk_count)
+	{
+		chunk_count = pixel_count-x;
+		if(chunk_count > DPRT_CALIBRATION_CHUNK_PIXELS)
+			chunk_count = DPRT_CALIBRATION_CHUNK_PIXELS;
+		DpRt_Calibration_Apply_Pixels(frame->Data,frame->Encoding,row_start+x,(size_t)chunk_count,level,
+					      frame->Bias,frame->Flat,frame->Mask,chunk);
+		for(i=0;i<chunk_count;i++)
+			sum += chunk[i];
+	}
+	return (double)sum;
+}
+
+/**
+ * Find the centroid of the trace in the profile of a block's window. The background is the straight line
+ * between the first and last rows of the window, and the centroid is that of the profile above the background over
+ * the rows either side of the brightest row that are above it. There is no centroid if the brightest row is at
+ * the edge of the window (the trace is outside it), or not above the background.
+ * @param window_sum_list The summed rows of the window.
+ * @param window_count The number of rows in the window, at least 3.
+ * @param centroid The address of a double to store the centroid in, as an offset from the first row.
+ * @return The routine returns TRUE if there was a centroid, and FALSE if there was not.
+ */
+static int Trace_Centroid(double *window_sum_list,int window_count,double *centroid)
+{
+	double excess_list[(2*DPRT_TRACE_MAX_WINDOW)+1];
+	double weight_sum,weighted_sum;
+	int peak,first,last,i;
+
+	peak = 0;
+	for(i=0;i<window_count;i++)
+	{
+		excess_list[i] = window_sum_list[i]-(window_sum_list[0]+(((window_sum_list[window_count-1]-
+				 window_sum_list[0])*((double)i))/((double)(window_count-1))));
+		if(excess_list[i] > excess_list[peak])
+			peak = i;
+	}
+	if((peak == 0)||(peak == window_count-1)||(excess_list[peak] <= 0.0))
+		return FALSE;
+	first = peak;
+	while((first > 0)&&(excess_list[first-1] > 0.0))
+		first--;
+	last = peak;
+	while((last < window_count-1)&&(excess_list[last+1] > 0.0))
+		last++;
+	weight_sum = 0.0;
+	weighted_sum = 0.0;
+	for(i=first;i<=last;i++)
+	{
+		weight_sum += excess_list[i];
+		weighted_sum += excess_list[i]*((double)i);
+	}
+	(*centroid) = weighted_sum/weight_sum;
+	return TRUE;
+}
+
+/**
+ * Fit a polynomial to the block centroids by least squares, rejecting outliers. The order is reduced if there are
+ * too few centroids to leave a residual. After each fit, centroids more than TRACE_CLIP_KAPPA standard deviations
+ * (estimated from the median absolute residual, but at least TRACE_MIN_CLIP_RESIDUAL rows) from the polynomial are
+ * rejected, and the polynomial refitted, up to TRACE_CLIP_ITERATIONS times. The residual is the rms of the
+ * residuals of the centroids used.
+ * @param x_list The centre column of each block.
+ * @param y_list The centroid row of each block.
+ * @param used_list A boolean for each block, TRUE if it has a centroid. Rejected blocks are set to FALSE.
+ * @param count The number of blocks.
+ * @param trace The trace, with Order, Centre_X and Scale_X set. The fitted Order, Coefficient_List, Residual and
+ *        Used_Block_Count are filled in.
+ * @param residual_list A list of count doubles, used to find the median absolute residual.
+ * @return The routine returns TRUE if the fit succeeded, and FALSE if there were too few centroids.
+ * @see #TRACE_SIGMA_PER_MAD
+ * @see #TRACE_CLIP_KAPPA
+ * @see #TRACE_MIN_CLIP_RESIDUAL
+ * @see #TRACE_CLIP_ITERATIONS
+ * @see #DpRt_Trace_Evaluate
+ */
+static int Trace_Fit(double *x_list,double *y_list,int *used_list,int count,struct DpRt_Trace_Struct *trace,
+		     double *residual_list)
+{
+	double matrix[DPRT_TRACE_MAX_ORDER+1][DPRT_TRACE_MAX_ORDER+2];
+	double power_list[(2*DPRT_TRACE_MAX_ORDER)+1];
+	double u,power,swap,factor,residual,residual_sum,clip,value;
+	int order,used_count,iteration,rejected,i,j,k,pivot;
+
+	for(iteration=0;iteration<=TRACE_CLIP_ITERATIONS;iteration++)
+	{
+		used_count = 0;
+		for(i=0;i<count;i++)
+		{
+			if(used_list[i])
+				used_count++;
+		}
+		order = trace->Order;
+		if(order > used_count-2)
+			order = used_count-2;
+		if(order < 0)
+			return FALSE;
+		/* the normal equations, solved by gaussian elimination with partial pivoting */
+		memset(matrix,0,sizeof(matrix));
+		for(i=0;i<count;i++)
+		{
+			if(used_list[i] == FALSE)
+				continue;
+			u = (x_list[i]-trace->Centre_X)/trace->Scale_X;
+			power = 1.0;
+			for(j=0;j<=2*order;j++)
+			{
+				power_list[j] = power;
+				power *= u;
+			}
+			for(j=0;j<=order;j++)
+			{
+				for(k=0;k<=order;k++)
+					matrix[j][k] += power_list[j+k];
+				matrix[j][order+1] += power_list[j]*y_list[i];
+			}
+		}
+		for(j=0;j<=order;j++)
+		{
+			pivot = j;
+			for(k=j+1;k<=order;k++)
+			{
+				if(fabs(matrix[k][j]) > fabs(matrix[pivot][j]))
+					pivot = k;
+			}
+			if(fabs(matrix[pivot][j]) < 1.0e-12)
+				return FALSE;
+			for(k=0;k<=order+1;k++)
+			{
+				swap = matrix[j][k];
+				matrix[j][k] = matrix[pivot][k];
+				matrix[pivot][k] = swap;
+			}
+			for(i=j+1;i<=order;i++)
+			{
+				factor = matrix[i][j]/matrix[j][j];
+				for(k=j;k<=order+1;k++)
+					matrix[i][k] -= factor*matrix[j][k];
+			}
+		}
+		for(j=order;j>=0;j--)
+		{
+			value = matrix[j][order+1];
+			for(k=j+1;k<=order;k++)
+				value -= matrix[j][k]*trace->Coefficient_List[k];
+			trace->Coefficient_List[j] = value/matrix[j][j];
+		}
+		for(j=order+1;j<=DPRT_TRACE_MAX_ORDER;j++)
+			trace->Coefficient_List[j] = 0.0;
+		trace->Order = order;
+		trace->Used_Block_Count = used_count;
+		/* the residuals, and the standard deviation estimated from the median absolute residual */
+		residual_sum = 0.0;
+		k = 0;
+		for(i=0;i<count;i++)
+		{
+			if(used_list[i] == FALSE)
+				continue;
+			residual = fabs(y_list[i]-DpRt_Trace_Evaluate(trace,x_list[i]));
+			residual_sum += residual*residual;
+			/* insertion sort, there are few blocks */
+			for(j=k;(j > 0)&&(residual_list[j-1] > residual);j--)
+				residual_list[j] = residual_list[j-1];
+			residual_list[j] = residual;
+			k++;
+		}
+		trace->Residual = sqrt(residual_sum/((double)(used_count-order-1)));
+		if((iteration == TRACE_CLIP_ITERATIONS)||(used_count-1 < order+2))
+			break;
+		clip = TRACE_CLIP_KAPPA*TRACE_SIGMA_PER_MAD*residual_list[used_count/2];
+		if(clip < TRACE_MIN_CLIP_RESIDUAL)
+			clip = TRACE_MIN_CLIP_RESIDUAL;
+		rejected = 0;
+		for(i=0;(i<count)&&(used_count-rejected > order+2);i++)
+		{
+			if(used_list[i] && (fabs(y_list[i]-DpRt_Trace_Evaluate(trace,x_list[i])) > clip))
+			{
+				used_list[i] = FALSE;
+				rejected++;
+			}
+		}
+		if(rejected == 0)
+			break;
+	}
+	return TRUE;
+}
+
+/**
+ * Find a cached trace model by it's key. Trace_Mutex must be held.
+ * @param key The key.
+ * @return The index of the model in Trace_Cache_List, or -1 if it was not found.
+ * @see #Trace_Cache_List
+ */
+static int Trace_Find(char *key)
+{
+	int i;
+
+	if(strlen(key) == 0)
+		return -1;
+	for(i=0;i<DPRT_TRACE_CACHE_COUNT;i++)
+	{
+		if(strcmp(Trace_Cache_List[i].Key,key) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+** $Log$
+*/
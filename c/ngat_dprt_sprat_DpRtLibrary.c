@@ -14,8 +14,97 @@
 #include "ngat_dprt_sprat_DpRtLibrary.h"
 #include "object.h"
 #include "dprt.h"
+#include "dprt_job.h"
+#include "dprt_focus.h"
 #include "dprt_jni_general.h"
 
+/* -------------------------------------------------- */
+/* hash definitions */
+/* -------------------------------------------------- */
+/**
+ * Index in Done_Class_List of the ngat.message.INST_DP.CALIBRATE_REDUCE_DONE class.
+ * @see #Done_Class_List
+ */
+#define DONE_CLASS_CALIBRATE_REDUCE	(0)
+/**
+ * Index in Done_Class_List of the ngat.message.INST_DP.EXPOSE_REDUCE_DONE class.
+ * @see #Done_Class_List
+ */
+#define DONE_CLASS_EXPOSE_REDUCE	(1)
+/**
+ * Index in Done_Class_List of the ngat.message.INST_DP.MAKE_MASTER_BIAS_DONE class.
+ * @see #Done_Class_List
+ */
+#define DONE_CLASS_MAKE_MASTER_BIAS	(2)
+/**
+ * Index in Done_Class_List of the ngat.message.INST_DP.MAKE_MASTER_FLAT_DONE class.
+ * @see #Done_Class_List
+ */
+#define DONE_CLASS_MAKE_MASTER_FLAT	(3)
+/**
+ * The number of done message classes in Done_Class_List.
+ * @see #Done_Class_List
+ */
+#define DONE_CLASS_COUNT		(4)
+
+/* -------------------------------------------------- */
+/* structures */
+/* -------------------------------------------------- */
+/**
+ * Structure holding a done message class, and the IDs of the setter methods used to fill in instances of it,
+ * resolved once when the library is loaded. The method IDs only relevant to some classes are NULL for the others.
+ * <dl>
+ * <dt>Class_Name</dt> <dd>The JNI name of the class.</dd>
+ * <dt>Class</dt> <dd>A global reference to the class, or NULL if the class (or one of it's methods) could
+ *     not be found, in which case the class is looked up from the object on each call instead.</dd>
+ * <dt>Set_Successful</dt> <dd>COMMAND_DONE.setSuccessful(boolean).</dd>
+ * <dt>Set_Error_Num</dt> <dd>COMMAND_DONE.setErrorNum(int).</dd>
+ * <dt>Set_Error_String</dt> <dd>COMMAND_DONE.setErrorString(String).</dd>
+ * <dt>Set_Filename</dt> <dd>REDUCE_DONE.setFilename(String).</dd>
+ * <dt>Set_Mean_Counts</dt> <dd>CALIBRATE_REDUCE_DONE.setMeanCounts(float).</dd>
+ * <dt>Set_Peak_Counts</dt> <dd>CALIBRATE_REDUCE_DONE.setPeakCounts(float).</dd>
+ * <dt>Set_Seeing</dt> <dd>EXPOSE_REDUCE_DONE.setSeeing(float).</dd>
+ * <dt>Set_Counts</dt> <dd>EXPOSE_REDUCE_DONE.setCounts(float).</dd>
+ * <dt>Set_X_Pix</dt> <dd>EXPOSE_REDUCE_DONE.setXpix(float).</dd>
+ * <dt>Set_Y_Pix</dt> <dd>EXPOSE_REDUCE_DONE.setYpix(float).</dd>
+ * <dt>Set_Photometricity</dt> <dd>EXPOSE_REDUCE_DONE.setPhotometricity(float).</dd>
+ * <dt>Set_Sky_Brightness</dt> <dd>EXPOSE_REDUCE_DONE.setSkyBrightness(float).</dd>
+ * <dt>Set_Saturation</dt> <dd>EXPOSE_REDUCE_DONE.setSaturation(boolean).</dd>
+ * </dl>
+ */
+struct Done_Class_Struct
+{
+	char *Class_Name;
+	jclass Class;
+	jmethodID Set_Successful;
+	jmethodID Set_Error_Num;
+	jmethodID Set_Error_String;
+	jmethodID Set_Filename;
+	jmethodID Set_Mean_Counts;
+	jmethodID Set_Peak_Counts;
+	jmethodID Set_Seeing;
+	jmethodID Set_Counts;
+	jmethodID Set_X_Pix;
+	jmethodID Set_Y_Pix;
+	jmethodID Set_Photometricity;
+	jmethodID Set_Sky_Brightness;
+	jmethodID Set_Saturation;
+};
+
+/**
+ * Structure passed as the user data of an asynchronous job submitted from Java.
+ * <dl>
+ * <dt>Reduce_Done</dt> <dd>A global reference to the CALIBRATE_REDUCE_DONE or EXPOSE_REDUCE_DONE
+ *     object to fill in when the job finishes.</dd>
+ * <dt>Listener</dt> <dd>A global reference to the listener object to call when the job finishes, or NULL.</dd>
+ * </dl>
+ */
+struct Job_Callback_Data_Struct
+{
+	jobject Reduce_Done;
+	jobject Listener;
+};
+
 /* -------------------------------------------------- */
 /* internal variables */
 /* -------------------------------------------------- */
@@ -23,10 +112,55 @@
  * Revision Control System identifier.
  */
 static char rcsid[] = "$Id: ngat_dprt_sprat_DpRtLibrary.c,v 1.1 2014-09-03 14:07:35 cjm Exp $";
+/**
+ * Copy of the JavaVM pointer, used to get a JNIEnv for the job threads when an asynchronous job finishes.
+ * @see #JNI_OnLoad
+ * @see #Job_Callback
+ */
+static JavaVM *Java_VM = NULL;
+/**
+ * The done message classes filled in by this library, with their setter method IDs. Filled in by
+ * Done_Class_Cache_Initialise when the library is loaded, and released when it is unloaded.
+ * The list is indexed by the DONE_CLASS_ hash definitions.
+ * @see #Done_Class_Struct
+ * @see #DONE_CLASS_CALIBRATE_REDUCE
+ * @see #DONE_CLASS_EXPOSE_REDUCE
+ * @see #DONE_CLASS_MAKE_MASTER_BIAS
+ * @see #DONE_CLASS_MAKE_MASTER_FLAT
+ * @see #Done_Class_Cache_Initialise
+ * @see #Done_Class_Cache_Free
+ */
+static struct Done_Class_Struct Done_Class_List[DONE_CLASS_COUNT] =
+{
+	{"ngat/message/INST_DP/CALIBRATE_REDUCE_DONE",NULL,
+	 NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL},
+	{"ngat/message/INST_DP/EXPOSE_REDUCE_DONE",NULL,
+	 NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL},
+	{"ngat/message/INST_DP/MAKE_MASTER_BIAS_DONE",NULL,
+	 NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL},
+	{"ngat/message/INST_DP/MAKE_MASTER_FLAT_DONE",NULL,
+	 NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL}
+};
 
 /* -------------------------------------------------- */
 /* internal functions */
 /* -------------------------------------------------- */
+static jint Job_Submit(JNIEnv *env,int type,jstring input_filename_string,jobject reduce_done,jobject listener);
+static void Job_Callback(int job_id,struct DpRt_Job_Result_Struct *result,void *user_data);
+static int Batch_Get_Filenames(JNIEnv *env,jobjectArray input_filename_array,jobjectArray reduce_done_array,
+			       char ***input_filename_list,int *count);
+static void Batch_Free_Filenames(char **input_filename_list,int count);
+static void Done_Class_Cache_Initialise(JNIEnv *env);
+static void Done_Class_Cache_Free(JNIEnv *env);
+static int Done_Class_Get_Method(JNIEnv *env,struct Done_Class_Struct *done_class,char *name,char *signature,
+				 jmethodID *method_id);
+static int Done_Set_Command_Done(JNIEnv *env,int done_class,jobject done,int successful,int error_number,
+				 char *error_string);
+static int Done_Set_Reduce_Done(JNIEnv *env,int done_class,jobject done,char *filename);
+static int Done_Set_Calibrate_Reduce_Done(JNIEnv *env,jobject done,double mean_counts,double peak_counts);
+static int Done_Set_Expose_Reduce_Done(JNIEnv *env,jobject done,double seeing,double counts,double x_pix,
+				       double y_pix,double photometricity,double sky_brightness,int saturated);
+static int Focus_Set_Result(JNIEnv *env,jdoubleArray result_array,struct DpRt_Focus_Fit_Struct *fit);
 
 
 /* -------------------------------------------------- */
@@ -36,14 +170,37 @@ static char rcsid[] = "$Id: ngat_dprt_sprat_DpRtLibrary.c,v 1.1 2014-09-03 14:07
  * This routine gets called when the native library is loaded. We use this routine
  * to get a copy of the JavaVM pointer of the JVM we are running in. This is used to
  * get the correct per-thread JNIEnv context pointer when C calls back into Java.
+ * We also resolve the done message classes, and the IDs of the methods used to fill them in, here, so they
+ * are not looked up by name on every reduction.
+ * @see #Java_VM
+ * @see #Done_Class_Cache_Initialise
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Java_VM
  */
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
 {
+	JNIEnv *env = NULL;
+
+	Java_VM = vm;
 	DpRt_JNI_Set_Java_VM(vm);
+	if((*vm)->GetEnv(vm,(void**)&env,JNI_VERSION_1_2) == JNI_OK)
+		Done_Class_Cache_Initialise(env);
 	return JNI_VERSION_1_2;
 }
 
+/**
+ * This routine gets called when the class loader that loaded the native library is garbage collected.
+ * The global references to the done message classes are released.
+ * @see #Done_Class_Cache_Free
+ */
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *reserved)
+{
+	JNIEnv *env = NULL;
+
+	if((*vm)->GetEnv(vm,(void**)&env,JNI_VERSION_1_2) == JNI_OK)
+		Done_Class_Cache_Free(env);
+	Java_VM = NULL;
+}
+
 /**
  * Class:     ngat_dprt_sprat_DpRtLibrary<br>
  * Method:    DpRt_Initialise<br>
@@ -100,6 +257,27 @@ JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Shutdown(JNIEnv *e
 		DpRt_JNI_Throw_Exception(env,"DpRt_Shutdown");
 }
 
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Reload_Config<br>
+ * Signature: ()V<br>
+ * Java Native Interface implementation ngat.dprt.sprat.DpRtLibrary's reloadConfig.
+ * This re-loads the C layer's snapshot of the dprt.* configuration properties, which is otherwise only
+ * loaded in DpRt_Initialise.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @see dprt.html#DpRt_Reload_Config
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Reload_1Config(JNIEnv *env,jobject obj)
+{
+	int retval;
+
+	retval = DpRt_Reload_Config();
+	if(retval != TRUE)
+		DpRt_JNI_Throw_Exception(env,"DpRt_Reload_Config");
+}
+
 /**
  * Class:     ngat_dprt_sprat_DpRtLibrary<br>
  * Method:    DpRt_Set_Status<br>
@@ -158,9 +336,9 @@ JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_finaliseLoggerReference(
  * @see dprt.html#DpRt_Calibrate_Reduce
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Calibrate_Reduce_Done
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Calibrate_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Reduce(JNIEnv *env,jobject object,
 								   jstring input_filename_string,jobject reduce_done)
@@ -171,7 +349,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Red
 	double meanCounts = 0.0,peakCounts= 0.0;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the input_filename should be null as well */
@@ -190,20 +367,18 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Red
 		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
 
 	/* set the relevant fields in reduce_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,reduce_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,reduce_done,successful,error_number,error_string) == FALSE)
+	if(Done_Set_Command_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,successful,error_number,
+				 error_string) == FALSE)
 		return FALSE;
 
-	if(DpRt_JNI_Set_Reduce_Done(env,cls,reduce_done,output_filename) == FALSE)
+	if(Done_Set_Reduce_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,output_filename) == FALSE)
 		return FALSE;
 
 	/* free output_filename allocated in Reduction */
 	if(output_filename != NULL)
 		free(output_filename);
 
-	if(DpRt_JNI_Set_Calibrate_Reduce_Done(env,cls,reduce_done,meanCounts,peakCounts) == FALSE)
+	if(Done_Set_Calibrate_Reduce_Done(env,reduce_done,meanCounts,peakCounts) == FALSE)
 		return FALSE;
 
 	return TRUE;
@@ -222,9 +397,9 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Red
  * @see dprt.html#DpRt_Expose_Reduce
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Expose_Reduce_Done
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Expose_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce(JNIEnv *env,jobject obj,
 				     jstring input_filename_string,jobject reduce_done)
@@ -237,7 +412,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce
 	int saturated = FALSE;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the input_filename should be null as well */
@@ -257,10 +431,8 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce
 		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
 
 	/* set the relevant fields in reduce_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,reduce_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,reduce_done,successful,error_number,error_string) == FALSE)
+	if(Done_Set_Command_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,successful,error_number,
+				 error_string) == FALSE)
 	{
 		/* free output_filename allocated in DpRt_Expose_Reduce */
 		if(output_filename != NULL)
@@ -268,7 +440,7 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce
 		return FALSE;
 	}
 
-	if(DpRt_JNI_Set_Reduce_Done(env,cls,reduce_done,output_filename) == FALSE)
+	if(Done_Set_Reduce_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,output_filename) == FALSE)
 	{
 		/* free output_filename allocated in DpRt_Expose_Reduce */
 		if(output_filename != NULL)
@@ -280,13 +452,282 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce
 	if(output_filename != NULL)
 		free(output_filename);
 
-	if(DpRt_JNI_Set_Expose_Reduce_Done(env,cls,reduce_done,seeing,counts,x_pix,y_pix,
-					   photometricity,sky_brightness,saturated) == FALSE)
+	if(Done_Set_Expose_Reduce_Done(env,reduce_done,seeing,counts,x_pix,y_pix,
+				       photometricity,sky_brightness,saturated) == FALSE)
 		return FALSE;
 
 	return TRUE;
 }
 
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Calibrate_Reduce_Batch<br>
+ * Signature: ([Ljava/lang/String;[Lngat/message/INST_DP/CALIBRATE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtCalibrateReduceBatch is called.
+ * The frames are reduced with DpRt_Calibrate_Reduce_Batch, and each element of reduce_done_array is filled in
+ * with the result of the corresponding frame.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param input_filename_array An array of Java String objects, the filenames to be processed.
+ * @param reduce_done_array An array of CALIBRATE_REDUCE_DONE objects, of the same length as input_filename_array.
+ * @return The routine returns TRUE if all the frames were reduced and their done objects filled in successfully,
+ *         and FALSE otherwise.
+ * @see #Batch_Get_Filenames
+ * @see #Batch_Free_Filenames
+ * @see dprt.html#DpRt_Calibrate_Reduce_Batch
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Calibrate_Reduce_Done
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Reduce_1Batch(JNIEnv *env,jobject obj,
+				jobjectArray input_filename_array,jobjectArray reduce_done_array)
+{
+	struct DpRt_Calibrate_Reduce_Result_Struct *result_list = NULL;
+	char **input_filename_list = NULL;
+	jobject reduce_done;
+	int i,count,successful,retval = TRUE;
+
+	if(!Batch_Get_Filenames(env,input_filename_array,reduce_done_array,&input_filename_list,&count))
+		return FALSE;
+	result_list = (struct DpRt_Calibrate_Reduce_Result_Struct *)malloc(count*
+							sizeof(struct DpRt_Calibrate_Reduce_Result_Struct));
+	if(result_list == NULL)
+	{
+		Batch_Free_Filenames(input_filename_list,count);
+		DpRt_JNI_Error_Number = 902;
+		sprintf(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce_Batch:Failed to allocate result list(%d).\n",
+			count);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Calibrate_Reduce_Batch");
+		return FALSE;
+	}
+	/* call the reduction process */
+	successful = DpRt_Calibrate_Reduce_Batch(input_filename_list,count,result_list);
+	Batch_Free_Filenames(input_filename_list,count);
+	/* set the relevant fields in each reduce_done */
+	for(i=0;i<count;i++)
+	{
+		reduce_done = (*env)->GetObjectArrayElement(env,reduce_done_array,i);
+		if((Done_Set_Command_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,result_list[i].Successful,
+					  result_list[i].Error_Number,result_list[i].Error_String) == FALSE)||
+		   (Done_Set_Reduce_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,
+					 result_list[i].Output_Filename) == FALSE)||
+		   (Done_Set_Calibrate_Reduce_Done(env,reduce_done,result_list[i].Mean_Counts,
+						   result_list[i].Peak_Counts) == FALSE))
+			retval = FALSE;
+		/* free output_filename allocated in Reduction */
+		if(result_list[i].Output_Filename != NULL)
+			free(result_list[i].Output_Filename);
+		(*env)->DeleteLocalRef(env,reduce_done);
+	}
+	free(result_list);
+	return (retval && successful);
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Expose_Reduce_Batch<br>
+ * Signature: ([Ljava/lang/String;[Lngat/message/INST_DP/EXPOSE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtExposeReduceBatch is called.
+ * The frames are reduced with DpRt_Expose_Reduce_Batch, and each element of reduce_done_array is filled in
+ * with the result of the corresponding frame.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param input_filename_array An array of Java String objects, the filenames to be processed.
+ * @param reduce_done_array An array of EXPOSE_REDUCE_DONE objects, of the same length as input_filename_array.
+ * @return The routine returns TRUE if all the frames were reduced and their done objects filled in successfully,
+ *         and FALSE otherwise.
+ * @see #Batch_Get_Filenames
+ * @see #Batch_Free_Filenames
+ * @see dprt.html#DpRt_Expose_Reduce_Batch
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Expose_Reduce_Done
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce_1Batch(JNIEnv *env,jobject obj,
+				jobjectArray input_filename_array,jobjectArray reduce_done_array)
+{
+	struct DpRt_Expose_Reduce_Result_Struct *result_list = NULL;
+	char **input_filename_list = NULL;
+	jobject reduce_done;
+	int i,count,successful,retval = TRUE;
+
+	if(!Batch_Get_Filenames(env,input_filename_array,reduce_done_array,&input_filename_list,&count))
+		return FALSE;
+	result_list = (struct DpRt_Expose_Reduce_Result_Struct *)malloc(count*
+							sizeof(struct DpRt_Expose_Reduce_Result_Struct));
+	if(result_list == NULL)
+	{
+		Batch_Free_Filenames(input_filename_list,count);
+		DpRt_JNI_Error_Number = 903;
+		sprintf(DpRt_JNI_Error_String,"DpRt_Expose_Reduce_Batch:Failed to allocate result list(%d).\n",
+			count);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Batch");
+		return FALSE;
+	}
+	/* call the reduction process */
+	successful = DpRt_Expose_Reduce_Batch(input_filename_list,count,result_list);
+	Batch_Free_Filenames(input_filename_list,count);
+	/* set the relevant fields in each reduce_done */
+	for(i=0;i<count;i++)
+	{
+		reduce_done = (*env)->GetObjectArrayElement(env,reduce_done_array,i);
+		if((Done_Set_Command_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,result_list[i].Successful,
+					  result_list[i].Error_Number,result_list[i].Error_String) == FALSE)||
+		   (Done_Set_Reduce_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,
+					 result_list[i].Output_Filename) == FALSE)||
+		   (Done_Set_Expose_Reduce_Done(env,reduce_done,result_list[i].Seeing,result_list[i].Counts,
+						result_list[i].X_Pix,result_list[i].Y_Pix,
+						result_list[i].Photometricity,result_list[i].Sky_Brightness,
+						result_list[i].Saturated) == FALSE))
+			retval = FALSE;
+		/* free output_filename allocated in Reduction */
+		if(result_list[i].Output_Filename != NULL)
+			free(result_list[i].Output_Filename);
+		(*env)->DeleteLocalRef(env,reduce_done);
+	}
+	free(result_list);
+	return (retval && successful);
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Calibrate_Reduce_Buffer<br>
+ * Signature: (Ljava/lang/String;Ljava/nio/ByteBuffer;IIDLngat/message/INST_DP/CALIBRATE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtCalibrateReduceBuffer is called.
+ * The pixels in the direct ByteBuffer are reduced in place with DpRt_Calibrate_Reduce_Buffer,
+ * without a FITS file being written or read.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param frame_name_string The Java String object representing the name of the frame (usually the filename
+ *        it will be saved as).
+ * @param buffer A direct java.nio.ByteBuffer holding the 16-bit pixels of the frame.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param bzero The BZERO of the pixels, 32768 (FITS encoded) or 0 (unsigned, native byte order).
+ * @param reduce_done A Java object of class CALIBRATE_REDUCE_DONE, filled in with the result.
+ * @return The routine returns TRUE if the reduction succeeded, and FALSE if it failed.
+ * @see dprt.html#DpRt_Calibrate_Reduce_Buffer
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Calibrate_Reduce_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Calibrate_1Reduce_1Buffer(JNIEnv *env,jobject obj,
+				jstring frame_name_string,jobject buffer,jint naxis_one,jint naxis_two,jdouble bzero,
+				jobject reduce_done)
+{
+	char error_string[DPRT_ERROR_STRING_LENGTH];
+	const char *frame_name = NULL;
+	char *output_filename = NULL;
+	void *data = NULL;
+	jlong data_length;
+	double mean_counts,peak_counts;
+	int successful,error_number;
+
+	/* get the address of the pixels, without copying them */
+	data = (*env)->GetDirectBufferAddress(env,buffer);
+	data_length = (*env)->GetDirectBufferCapacity(env,buffer);
+	if((data == NULL)||(data_length < 0))
+	{
+		DpRt_JNI_Error_Number = 608;
+		sprintf(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce_Buffer:buffer is not a direct ByteBuffer.\n");
+		DpRt_JNI_Throw_Exception(env,"DpRt_Calibrate_Reduce_Buffer");
+		return FALSE;
+	}
+	if(frame_name_string != NULL)
+		frame_name = (*env)->GetStringUTFChars(env,frame_name_string,0);
+	/* call the reduction process */
+	successful = DpRt_Calibrate_Reduce_Buffer((char*)frame_name,data,(size_t)data_length,naxis_one,naxis_two,
+						  bzero,&output_filename,&mean_counts,&peak_counts);
+	/* get the error information associated with this call */
+	error_number = DpRt_JNI_Get_Error_Number();
+	DpRt_JNI_Get_Error_String(error_string);
+	/* free any c strings allocated */
+	if(frame_name_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,frame_name_string,frame_name);
+	/* set the relevant fields in reduce_done */
+	if((Done_Set_Command_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,successful,error_number,
+				  error_string) == FALSE)||
+	   (Done_Set_Reduce_Done(env,DONE_CLASS_CALIBRATE_REDUCE,reduce_done,output_filename) == FALSE)||
+	   (Done_Set_Calibrate_Reduce_Done(env,reduce_done,mean_counts,peak_counts) == FALSE))
+		successful = FALSE;
+	/* free output_filename allocated in Reduction */
+	if(output_filename != NULL)
+		free(output_filename);
+	return successful;
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Expose_Reduce_Buffer<br>
+ * Signature: (Ljava/lang/String;Ljava/nio/ByteBuffer;IIDDLngat/message/INST_DP/EXPOSE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtExposeReduceBuffer is called.
+ * The pixels in the direct ByteBuffer are reduced in place with DpRt_Expose_Reduce_Buffer,
+ * without a FITS file being written or read.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param frame_name_string The Java String object representing the name of the frame (usually the filename
+ *        it will be saved as).
+ * @param buffer A direct java.nio.ByteBuffer holding the 16-bit pixels of the frame.
+ * @param naxis_one The number of columns in the frame.
+ * @param naxis_two The number of rows in the frame.
+ * @param bzero The BZERO of the pixels, 32768 (FITS encoded) or 0 (unsigned, native byte order).
+ * @param telfocus The telescope focus the frame was taken at (the TELFOCUS keyword value).
+ * @param reduce_done A Java object of class EXPOSE_REDUCE_DONE, filled in with the result.
+ * @return The routine returns TRUE if the reduction succeeded, and FALSE if it failed.
+ * @see dprt.html#DpRt_Expose_Reduce_Buffer
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Expose_Reduce_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce_1Buffer(JNIEnv *env,jobject obj,
+				jstring frame_name_string,jobject buffer,jint naxis_one,jint naxis_two,jdouble bzero,
+				jdouble telfocus,jobject reduce_done)
+{
+	char error_string[DPRT_ERROR_STRING_LENGTH];
+	const char *frame_name = NULL;
+	char *output_filename = NULL;
+	void *data = NULL;
+	jlong data_length;
+	double seeing,counts,x_pix,y_pix,photometricity,sky_brightness;
+	int saturated,successful,error_number;
+
+	/* get the address of the pixels, without copying them */
+	data = (*env)->GetDirectBufferAddress(env,buffer);
+	data_length = (*env)->GetDirectBufferCapacity(env,buffer);
+	if((data == NULL)||(data_length < 0))
+	{
+		DpRt_JNI_Error_Number = 609;
+		sprintf(DpRt_JNI_Error_String,"DpRt_Expose_Reduce_Buffer:buffer is not a direct ByteBuffer.\n");
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Buffer");
+		return FALSE;
+	}
+	if(frame_name_string != NULL)
+		frame_name = (*env)->GetStringUTFChars(env,frame_name_string,0);
+	/* call the reduction process */
+	successful = DpRt_Expose_Reduce_Buffer((char*)frame_name,data,(size_t)data_length,naxis_one,naxis_two,bzero,
+					       telfocus,&output_filename,&seeing,&counts,&x_pix,&y_pix,&photometricity,
+					       &sky_brightness,&saturated);
+	/* get the error information associated with this call */
+	error_number = DpRt_JNI_Get_Error_Number();
+	DpRt_JNI_Get_Error_String(error_string);
+	/* free any c strings allocated */
+	if(frame_name_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,frame_name_string,frame_name);
+	/* set the relevant fields in reduce_done */
+	if((Done_Set_Command_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,successful,error_number,
+				  error_string) == FALSE)||
+	   (Done_Set_Reduce_Done(env,DONE_CLASS_EXPOSE_REDUCE,reduce_done,output_filename) == FALSE)||
+	   (Done_Set_Expose_Reduce_Done(env,reduce_done,seeing,counts,x_pix,y_pix,photometricity,sky_brightness,
+					saturated) == FALSE))
+		successful = FALSE;
+	/* free output_filename allocated in Reduction */
+	if(output_filename != NULL)
+		free(output_filename);
+	return successful;
+}
+
 /**
  * Class:     ngat_dprt_sprat_DpRtLibrary<br>
  * Method:    DpRt_Make_Master_Bias<br>
@@ -300,8 +741,8 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Expose_1Reduce
  * @see dprt.html#DpRt_Make_Master_Bias
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1Bias(JNIEnv *env,jobject obj,
 						jstring dirname_jstring,jobject make_master_bias_done)
@@ -310,7 +751,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1
 	const char *dirname_cstring = NULL;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the dirname_cstring should be null as well */
@@ -329,10 +769,8 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1
 		(*env)->ReleaseStringUTFChars(env,dirname_jstring,dirname_cstring);
 
 	/* set the relevant fields in make_master_bias_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,make_master_bias_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,make_master_bias_done,successful,error_number,error_string) == FALSE)
+	if(Done_Set_Command_Done(env,DONE_CLASS_MAKE_MASTER_BIAS,make_master_bias_done,successful,error_number,
+				 error_string) == FALSE)
 	{
 		return FALSE;
 	}
@@ -352,8 +790,8 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1
  * @see dprt.html#DpRt_Make_Master_Flat
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1Flat(JNIEnv *env,jobject obj,
 								jstring dirname_jstring,jobject make_master_flat_done)
@@ -362,7 +800,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1
 	const char *dirname_cstring = NULL;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the dirname_cstring should be null as well */
@@ -381,16 +818,293 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Make_1Master_1
 		(*env)->ReleaseStringUTFChars(env,dirname_jstring,dirname_cstring);
 
 	/* set the relevant fields in make_master_flat_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,make_master_flat_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,make_master_flat_done,successful,error_number,error_string) == FALSE)
+	if(Done_Set_Command_Done(env,DONE_CLASS_MAKE_MASTER_FLAT,make_master_flat_done,successful,error_number,
+				 error_string) == FALSE)
 	{
 		return FALSE;
 	}
 	return TRUE;
 }
 
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Submit_Calibrate_Reduce<br>
+ * Signature: (Ljava/lang/String;Lngat/message/INST_DP/CALIBRATE_REDUCE_DONE;Ljava/lang/Object;)I<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtSubmitCalibrateReduce is called.
+ * The reduction is queued on a job thread, and the job id returned immediately. When the job finishes,
+ * reduce_done is filled in and, if a listener was supplied, it's <code>jobDone(int,Object)</code> method is called
+ * (on the job thread) with the job id and reduce_done. Jobs submitted with a listener are released once the
+ * listener returns; jobs without one should be waited for/polled, and then released with DpRt_Job_Release.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param input_filename_string The Java String object representing the filename string to be processed.
+ * @param reduce_done A Java object of class CALIBRATE_REDUCE_DONE, filled in when the job finishes.
+ * @param listener An object with a <code>void jobDone(int jobId,Object done)</code> method, or null.
+ * @return The job id.
+ * @see #Job_Submit
+ * @see dprt_job.html#DPRT_JOB_TYPE_CALIBRATE_REDUCE
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Submit_1Calibrate_1Reduce(JNIEnv *env,jobject obj,
+					 jstring input_filename_string,jobject reduce_done,jobject listener)
+{
+	return Job_Submit(env,DPRT_JOB_TYPE_CALIBRATE_REDUCE,input_filename_string,reduce_done,listener);
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Submit_Expose_Reduce<br>
+ * Signature: (Ljava/lang/String;Lngat/message/INST_DP/EXPOSE_REDUCE_DONE;Ljava/lang/Object;)I<br>
+ * JNI interface routine called when ngat.dprt.sprat.DpRtLibrary.DpRtSubmitExposeReduce is called.
+ * As DpRt_Submit_Calibrate_Reduce, but for an expose reduction.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param input_filename_string The Java String object representing the filename string to be processed.
+ * @param reduce_done A Java object of class EXPOSE_REDUCE_DONE, filled in when the job finishes.
+ * @param listener An object with a <code>void jobDone(int jobId,Object done)</code> method, or null.
+ * @return The job id.
+ * @see #Job_Submit
+ * @see dprt_job.html#DPRT_JOB_TYPE_EXPOSE_REDUCE
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Submit_1Expose_1Reduce(JNIEnv *env,jobject obj,
+					 jstring input_filename_string,jobject reduce_done,jobject listener)
+{
+	return Job_Submit(env,DPRT_JOB_TYPE_EXPOSE_REDUCE,input_filename_string,reduce_done,listener);
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Job_Poll<br>
+ * Signature: (I)I<br>
+ * JNI interface routine called to get the state of an asynchronous job.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param job_id The job id.
+ * @return The job state (DPRT_JOB_STATE_QUEUED etc.).
+ * @see dprt_job.html#DpRt_Job_Poll
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Job_1Poll(JNIEnv *env,jobject obj,jint job_id)
+{
+	int state = 0;
+
+	if(!DpRt_Job_Poll(job_id,&state))
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_Poll");
+	}
+	return state;
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Job_Wait<br>
+ * Signature: (II)I<br>
+ * JNI interface routine called to wait for an asynchronous job to finish.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param job_id The job id.
+ * @param timeout_ms The maximum time to wait in milliseconds, negative to wait indefinitely.
+ * @return The job state. If this is not a terminal state, the wait timed out.
+ * @see dprt_job.html#DpRt_Job_Wait
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Job_1Wait(JNIEnv *env,jobject obj,jint job_id,
+									  jint timeout_ms)
+{
+	int state = 0;
+
+	if(!DpRt_Job_Wait(job_id,timeout_ms,&state))
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_Wait");
+	}
+	return state;
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Job_Cancel<br>
+ * Signature: (I)V<br>
+ * JNI interface routine called to cancel an asynchronous job.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param job_id The job id.
+ * @see dprt_job.html#DpRt_Job_Cancel
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Job_1Cancel(JNIEnv *env,jobject obj,jint job_id)
+{
+	if(!DpRt_Job_Cancel(job_id))
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_Cancel");
+	}
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Job_Release<br>
+ * Signature: (I)V<br>
+ * JNI interface routine called to release a finished asynchronous job, that was submitted without a listener.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param job_id The job id.
+ * @see dprt_job.html#DpRt_Job_Release
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Job_1Release(JNIEnv *env,jobject obj,jint job_id)
+{
+	if(!DpRt_Job_Release(job_id))
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_Release");
+	}
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Focus_Run_Start<br>
+ * Signature: (Ljava/lang/String;)V<br>
+ * JNI interface routine called to start a focus run, that the frames subsequently expose reduced are added to.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param run_id_string The Java String object representing the run id.
+ * @see dprt_focus.html#DpRt_Focus_Run_Start
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Focus_1Run_1Start(JNIEnv *env,jobject obj,
+										  jstring run_id_string)
+{
+	const char *run_id = NULL;
+	int retval;
+
+	if(run_id_string != NULL)
+		run_id = (*env)->GetStringUTFChars(env,run_id_string,0);
+	retval = DpRt_Focus_Run_Start((char*)run_id);
+	if(run_id_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,run_id_string,run_id);
+	if(retval == FALSE)
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Focus_Run_Start");
+	}
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Focus_Run_Add<br>
+ * Signature: (Ljava/lang/String;DD[D)Z<br>
+ * JNI interface routine called to add a frame to a focus run, and refit the best focus.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param run_id_string The Java String object representing the run id.
+ * @param telfocus The telescope focus the frame was taken at.
+ * @param fwhm The FWHM measured in the frame.
+ * @param result_array A Java double array of at least DPRT_FOCUS_RESULT_COUNT elements, filled in with the fit
+ *        (see DpRt_Focus_Fit_To_List), or null.
+ * @return The routine returns true if the fit has converged, so the focus run can be stopped.
+ * @see #Focus_Set_Result
+ * @see dprt_focus.html#DpRt_Focus_Run_Add
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Focus_1Run_1Add(JNIEnv *env,jobject obj,
+					jstring run_id_string,jdouble telfocus,jdouble fwhm,jdoubleArray result_array)
+{
+	struct DpRt_Focus_Fit_Struct fit;
+	const char *run_id = NULL;
+	int retval;
+
+	if(run_id_string != NULL)
+		run_id = (*env)->GetStringUTFChars(env,run_id_string,0);
+	retval = DpRt_Focus_Run_Add((char*)run_id,telfocus,fwhm,&fit);
+	if(run_id_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,run_id_string,run_id);
+	if(retval == FALSE)
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Focus_Run_Add");
+		return FALSE;
+	}
+	if(!Focus_Set_Result(env,result_array,&fit))
+		return FALSE;
+	return (jboolean)fit.Converged;
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Focus_Run_Get<br>
+ * Signature: (Ljava/lang/String;[D)Z<br>
+ * JNI interface routine called to get the best focus fit of a focus run, as it was after it's last frame.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param run_id_string The Java String object representing the run id.
+ * @param result_array A Java double array of at least DPRT_FOCUS_RESULT_COUNT elements, filled in with the fit
+ *        (see DpRt_Focus_Fit_To_List), or null.
+ * @return The routine returns true if the fit has converged, so the focus run can be stopped.
+ * @see #Focus_Set_Result
+ * @see dprt_focus.html#DpRt_Focus_Run_Get
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Focus_1Run_1Get(JNIEnv *env,jobject obj,
+					jstring run_id_string,jdoubleArray result_array)
+{
+	struct DpRt_Focus_Fit_Struct fit;
+	const char *run_id = NULL;
+	int retval;
+
+	if(run_id_string != NULL)
+		run_id = (*env)->GetStringUTFChars(env,run_id_string,0);
+	retval = DpRt_Focus_Run_Get((char*)run_id,&fit);
+	if(run_id_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,run_id_string,run_id);
+	if(retval == FALSE)
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Focus_Run_Get");
+		return FALSE;
+	}
+	if(!Focus_Set_Result(env,result_array,&fit))
+		return FALSE;
+	return (jboolean)fit.Converged;
+}
+
+/**
+ * Class:     ngat_dprt_sprat_DpRtLibrary<br>
+ * Method:    DpRt_Focus_Run_End<br>
+ * Signature: (Ljava/lang/String;)V<br>
+ * JNI interface routine called to end a focus run, throwing away it's frames.
+ * @param env The JNI environment pointer.
+ * @param obj The instance of ngat.dprt.sprat.DpRtLibrary this method was called with.
+ * @param run_id_string The Java String object representing the run id.
+ * @see dprt_focus.html#DpRt_Focus_Run_End
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Focus_1Run_1End(JNIEnv *env,jobject obj,
+										jstring run_id_string)
+{
+	const char *run_id = NULL;
+	int retval;
+
+	if(run_id_string != NULL)
+		run_id = (*env)->GetStringUTFChars(env,run_id_string,0);
+	retval = DpRt_Focus_Run_End((char*)run_id);
+	if(run_id_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,run_id_string,run_id);
+	if(retval == FALSE)
+	{
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Focus_Run_End");
+	}
+}
+
 /**
  * Class:     ngat_dprt_sprat_DpRtLibrary<br>
  * Method:    DpRt_Abort<br>
@@ -421,6 +1135,523 @@ JNIEXPORT void JNICALL Java_ngat_dprt_sprat_DpRtLibrary_DpRt_1Finalise_1Referenc
 /* -------------------------------------------------- */
 /* internal routines */
 /* -------------------------------------------------- */
+/**
+ * Submit an asynchronous reduction job on behalf of Java. Global references to reduce_done and listener are
+ * held until the job finishes. If the submission fails, an exception is thrown. Jobs are refused until the Java
+ * VM has been cached by JNI_OnLoad, as without it Job_Callback cannot fill in the done object or delete the global
+ * references.
+ * @param env The JNI environment pointer.
+ * @param type The job type, DPRT_JOB_TYPE_CALIBRATE_REDUCE or DPRT_JOB_TYPE_EXPOSE_REDUCE.
+ * @param input_filename_string The Java String object representing the filename string to be processed.
+ * @param reduce_done The CALIBRATE_REDUCE_DONE or EXPOSE_REDUCE_DONE object to fill in when the job finishes.
+ * @param listener The listener object to call when the job finishes, or NULL.
+ * @return The job id, or -1 if the submission failed.
+ * @see #Java_VM
+ * @see #Job_Callback_Data_Struct
+ * @see #Job_Callback
+ * @see dprt_job.html#DpRt_Job_Submit
+ * @see dprt_context.html#DpRt_Context_Thread_Error_To_JNI
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+static jint Job_Submit(JNIEnv *env,int type,jstring input_filename_string,jobject reduce_done,jobject listener)
+{
+	struct Job_Callback_Data_Struct *callback_data = NULL;
+	const char *input_filename = NULL;
+	int retval,job_id = -1;
+
+	if(Java_VM == NULL)
+	{
+		DpRt_JNI_Error_Number = 818;
+		sprintf(DpRt_JNI_Error_String,"Job_Submit:No Java VM to call back into.\n");
+		DpRt_JNI_Throw_Exception(env,"Job_Submit");
+		return -1;
+	}
+	callback_data = (struct Job_Callback_Data_Struct *)malloc(sizeof(struct Job_Callback_Data_Struct));
+	if(callback_data == NULL)
+	{
+		DpRt_JNI_Error_Number = 816;
+		sprintf(DpRt_JNI_Error_String,"Job_Submit:Failed to allocate callback data.\n");
+		DpRt_JNI_Throw_Exception(env,"Job_Submit");
+		return -1;
+	}
+	callback_data->Reduce_Done = (*env)->NewGlobalRef(env,reduce_done);
+	callback_data->Listener = NULL;
+	if(listener != NULL)
+		callback_data->Listener = (*env)->NewGlobalRef(env,listener);
+	/* Get the filename froma java string to a c null terminated string
+	** If the java String is null the input_filename should be null as well */
+	if(input_filename_string != NULL)
+		input_filename = (*env)->GetStringUTFChars(env,input_filename_string,0);
+	retval = DpRt_Job_Submit(type,(char*)input_filename,Job_Callback,callback_data,(listener != NULL),&job_id);
+	/* free any c strings allocated */
+	if(input_filename_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
+	if(retval == FALSE)
+	{
+		(*env)->DeleteGlobalRef(env,callback_data->Reduce_Done);
+		if(callback_data->Listener != NULL)
+			(*env)->DeleteGlobalRef(env,callback_data->Listener);
+		free(callback_data);
+		DpRt_Context_Thread_Error_To_JNI();
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_Submit");
+		return -1;
+	}
+	return job_id;
+}
+
+/**
+ * Callback called (usually on a job thread) when an asynchronous job submitted from Java finishes.
+ * The calling thread is attached to the JVM if necessary. The job's CALIBRATE_REDUCE_DONE or EXPOSE_REDUCE_DONE
+ * object is filled in, the listener's <code>jobDone(int,Object)</code> method is called if there is a listener,
+ * and the global references are deleted.
+ * @param job_id The job id.
+ * @param result The job's result.
+ * @param user_data The job's Job_Callback_Data_Struct.
+ * @see #Java_VM
+ * @see #Job_Callback_Data_Struct
+ * @see #Done_Set_Command_Done
+ * @see #Done_Set_Reduce_Done
+ * @see #Done_Set_Calibrate_Reduce_Done
+ * @see #Done_Set_Expose_Reduce_Done
+ */
+static void Job_Callback(int job_id,struct DpRt_Job_Result_Struct *result,void *user_data)
+{
+	struct Job_Callback_Data_Struct *callback_data = (struct Job_Callback_Data_Struct *)user_data;
+	JNIEnv *env = NULL;
+	jclass cls;
+	jmethodID method_id;
+	int attached = FALSE,retval,done_class;
+
+	/* Job_Submit refuses jobs until the Java VM is cached, so this should not happen */
+	if(Java_VM == NULL)
+	{
+		fprintf(stderr,"Job_Callback:Job %d:No Java VM.\n",job_id);
+		free(callback_data);
+		return;
+	}
+	retval = (*Java_VM)->GetEnv(Java_VM,(void**)&env,JNI_VERSION_1_2);
+	if(retval == JNI_EDETACHED)
+	{
+		retval = (*Java_VM)->AttachCurrentThread(Java_VM,(void**)&env,NULL);
+		attached = (retval == JNI_OK);
+	}
+	if(retval != JNI_OK)
+	{
+		fprintf(stderr,"Job_Callback:Job %d:Failed to get JNI environment (%d).\n",job_id,retval);
+		free(callback_data);
+		return;
+	}
+	/* set the relevant fields in reduce_done */
+	if(result->Type == DPRT_JOB_TYPE_CALIBRATE_REDUCE)
+		done_class = DONE_CLASS_CALIBRATE_REDUCE;
+	else
+		done_class = DONE_CLASS_EXPOSE_REDUCE;
+	retval = Done_Set_Command_Done(env,done_class,callback_data->Reduce_Done,result->Successful,
+				       result->Error_Number,result->Error_String);
+	if(retval)
+		retval = Done_Set_Reduce_Done(env,done_class,callback_data->Reduce_Done,result->Output_Filename);
+	if(retval)
+	{
+		if(result->Type == DPRT_JOB_TYPE_CALIBRATE_REDUCE)
+		{
+			retval = Done_Set_Calibrate_Reduce_Done(env,callback_data->Reduce_Done,
+								result->Mean_Counts,result->Peak_Counts);
+		}
+		else
+		{
+			retval = Done_Set_Expose_Reduce_Done(env,callback_data->Reduce_Done,result->Seeing,
+							     result->Counts,result->X_Pix,result->Y_Pix,
+							     result->Photometricity,result->Sky_Brightness,
+							     result->Saturated);
+		}
+	}
+	if(retval == FALSE)
+		fprintf(stderr,"Job_Callback:Job %d:Failed to fill in reduce done object.\n",job_id);
+	/* tell the listener */
+	if(callback_data->Listener != NULL)
+	{
+		cls = (*env)->GetObjectClass(env,callback_data->Listener);
+		method_id = (*env)->GetMethodID(env,cls,"jobDone","(ILjava/lang/Object;)V");
+		if(method_id != NULL)
+			(*env)->CallVoidMethod(env,callback_data->Listener,method_id,(jint)job_id,
+					       callback_data->Reduce_Done);
+		else
+			fprintf(stderr,"Job_Callback:Job %d:Listener has no jobDone method.\n",job_id);
+		(*env)->DeleteLocalRef(env,cls);
+		(*env)->DeleteGlobalRef(env,callback_data->Listener);
+	}
+	/* clear any exception thrown whilst filling in the done object or calling the listener */
+	if((*env)->ExceptionCheck(env))
+	{
+		(*env)->ExceptionDescribe(env);
+		(*env)->ExceptionClear(env);
+	}
+	(*env)->DeleteGlobalRef(env,callback_data->Reduce_Done);
+	free(callback_data);
+	if(attached)
+		(*Java_VM)->DetachCurrentThread(Java_VM);
+}
+
+/**
+ * Copy the filenames in a Java String array into an allocated list of C strings, for a batch reduction.
+ * The array must be the same length as the array of done objects. If the routine fails, an exception is thrown.
+ * @param env The JNI environment pointer.
+ * @param input_filename_array An array of Java String objects.
+ * @param reduce_done_array The array of done objects.
+ * @param input_filename_list The address of a list of strings, allocated by this routine. Free it with
+ *        Batch_Free_Filenames.
+ * @param count The address of an integer to store the number of filenames.
+ * @return The routine returns TRUE if it succeeded and FALSE if it failed.
+ * @see #Batch_Free_Filenames
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+static int Batch_Get_Filenames(JNIEnv *env,jobjectArray input_filename_array,jobjectArray reduce_done_array,
+			       char ***input_filename_list,int *count)
+{
+	jstring input_filename_string;
+	const char *input_filename = NULL;
+	int i;
+
+	if((input_filename_array == NULL)||(reduce_done_array == NULL)||
+	   ((*env)->GetArrayLength(env,input_filename_array) != (*env)->GetArrayLength(env,reduce_done_array)))
+	{
+		DpRt_JNI_Error_Number = 904;
+		sprintf(DpRt_JNI_Error_String,"Batch_Get_Filenames:Filename and done arrays NULL or mismatched.\n");
+		DpRt_JNI_Throw_Exception(env,"Batch_Get_Filenames");
+		return FALSE;
+	}
+	(*count) = (*env)->GetArrayLength(env,input_filename_array);
+	(*input_filename_list) = (char **)calloc((*count)+1,sizeof(char *));
+	if((*input_filename_list) == NULL)
+	{
+		DpRt_JNI_Error_Number = 905;
+		sprintf(DpRt_JNI_Error_String,"Batch_Get_Filenames:Failed to allocate filename list(%d).\n",(*count));
+		DpRt_JNI_Throw_Exception(env,"Batch_Get_Filenames");
+		return FALSE;
+	}
+	for(i=0;i<(*count);i++)
+	{
+		input_filename_string = (jstring)((*env)->GetObjectArrayElement(env,input_filename_array,i));
+		if(input_filename_string != NULL)
+		{
+			input_filename = (*env)->GetStringUTFChars(env,input_filename_string,0);
+			(*input_filename_list)[i] = strdup(input_filename);
+			(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
+			(*env)->DeleteLocalRef(env,input_filename_string);
+		}
+		else
+			(*input_filename_list)[i] = strdup("");
+		if((*input_filename_list)[i] == NULL)
+		{
+			Batch_Free_Filenames((*input_filename_list),i);
+			(*input_filename_list) = NULL;
+			DpRt_JNI_Error_Number = 906;
+			sprintf(DpRt_JNI_Error_String,"Batch_Get_Filenames:Failed to copy filename %d.\n",i);
+			DpRt_JNI_Throw_Exception(env,"Batch_Get_Filenames");
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Free a list of filenames allocated by Batch_Get_Filenames.
+ * @param input_filename_list The list of filenames.
+ * @param count The number of filenames in the list.
+ * @see #Batch_Get_Filenames
+ */
+static void Batch_Free_Filenames(char **input_filename_list,int count)
+{
+	int i;
+
+	if(input_filename_list == NULL)
+		return;
+	for(i=0;i<count;i++)
+	{
+		if(input_filename_list[i] != NULL)
+			free(input_filename_list[i]);
+	}
+	free(input_filename_list);
+}
+
+/**
+ * Resolve the done message classes in Done_Class_List, and the IDs of their setter methods. Global references
+ * to the classes are kept until Done_Class_Cache_Free is called. If a class, or one of it's methods, cannot be
+ * found, the pending exception is cleared and the class is left NULL, so the Done_Set routines fall back to
+ * looking the class up from the object.
+ * @param env The JNI environment pointer.
+ * @see #Done_Class_List
+ * @see #Done_Class_Get_Method
+ */
+static void Done_Class_Cache_Initialise(JNIEnv *env)
+{
+	struct Done_Class_Struct *done_class = NULL;
+	jclass cls;
+	int i,retval;
+
+	for(i=0;i<DONE_CLASS_COUNT;i++)
+	{
+		done_class = &(Done_Class_List[i]);
+		cls = (*env)->FindClass(env,done_class->Class_Name);
+		if(cls == NULL)
+		{
+			(*env)->ExceptionClear(env);
+			fprintf(stderr,"Done_Class_Cache_Initialise:Failed to find class %s.\n",done_class->Class_Name);
+			continue;
+		}
+		done_class->Class = (jclass)((*env)->NewGlobalRef(env,cls));
+		(*env)->DeleteLocalRef(env,cls);
+		if(done_class->Class == NULL)
+			continue;
+		retval = Done_Class_Get_Method(env,done_class,"setSuccessful","(Z)V",&(done_class->Set_Successful)) &&
+			Done_Class_Get_Method(env,done_class,"setErrorNum","(I)V",&(done_class->Set_Error_Num)) &&
+			Done_Class_Get_Method(env,done_class,"setErrorString","(Ljava/lang/String;)V",
+					      &(done_class->Set_Error_String));
+		if(retval && ((i == DONE_CLASS_CALIBRATE_REDUCE)||(i == DONE_CLASS_EXPOSE_REDUCE)))
+		{
+			retval = Done_Class_Get_Method(env,done_class,"setFilename","(Ljava/lang/String;)V",
+						       &(done_class->Set_Filename));
+		}
+		if(retval && (i == DONE_CLASS_CALIBRATE_REDUCE))
+		{
+			retval = Done_Class_Get_Method(env,done_class,"setMeanCounts","(F)V",
+						       &(done_class->Set_Mean_Counts)) &&
+				Done_Class_Get_Method(env,done_class,"setPeakCounts","(F)V",
+						      &(done_class->Set_Peak_Counts));
+		}
+		if(retval && (i == DONE_CLASS_EXPOSE_REDUCE))
+		{
+			retval = Done_Class_Get_Method(env,done_class,"setSeeing","(F)V",&(done_class->Set_Seeing)) &&
+				Done_Class_Get_Method(env,done_class,"setCounts","(F)V",&(done_class->Set_Counts)) &&
+				Done_Class_Get_Method(env,done_class,"setXpix","(F)V",&(done_class->Set_X_Pix)) &&
+				Done_Class_Get_Method(env,done_class,"setYpix","(F)V",&(done_class->Set_Y_Pix)) &&
+				Done_Class_Get_Method(env,done_class,"setPhotometricity","(F)V",
+						      &(done_class->Set_Photometricity)) &&
+				Done_Class_Get_Method(env,done_class,"setSkyBrightness","(F)V",
+						      &(done_class->Set_Sky_Brightness)) &&
+				Done_Class_Get_Method(env,done_class,"setSaturation","(Z)V",
+						      &(done_class->Set_Saturation));
+		}
+		if(retval == FALSE)
+		{
+			(*env)->DeleteGlobalRef(env,done_class->Class);
+			done_class->Class = NULL;
+		}
+	}
+}
+
+/**
+ * Release the global references to the done message classes held in Done_Class_List.
+ * @param env The JNI environment pointer.
+ * @see #Done_Class_List
+ */
+static void Done_Class_Cache_Free(JNIEnv *env)
+{
+	int i;
+
+	for(i=0;i<DONE_CLASS_COUNT;i++)
+	{
+		if(Done_Class_List[i].Class != NULL)
+			(*env)->DeleteGlobalRef(env,Done_Class_List[i].Class);
+		Done_Class_List[i].Class = NULL;
+	}
+}
+
+/**
+ * Get the ID of a method of a done message class. If the method does not exist, the pending exception
+ * is cleared.
+ * @param env The JNI environment pointer.
+ * @param done_class The done message class.
+ * @param name The name of the method.
+ * @param signature The JNI signature of the method.
+ * @param method_id The address of a jmethodID to fill in.
+ * @return The routine returns TRUE if the method was found, and FALSE if it was not.
+ */
+static int Done_Class_Get_Method(JNIEnv *env,struct Done_Class_Struct *done_class,char *name,char *signature,
+				 jmethodID *method_id)
+{
+	(*method_id) = (*env)->GetMethodID(env,done_class->Class,name,signature);
+	if((*method_id) == NULL)
+	{
+		(*env)->ExceptionClear(env);
+		fprintf(stderr,"Done_Class_Get_Method:Failed to find method %s%s in class %s.\n",name,signature,
+			done_class->Class_Name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Fill in the COMMAND_DONE fields of a done message, using the cached method IDs of it's class. If the class
+ * was not cached, the class is got from the object and DpRt_JNI_Set_Command_Done is used instead.
+ * @param env The JNI environment pointer.
+ * @param done_class The index in Done_Class_List of the done message's class.
+ * @param done The done message object.
+ * @param successful A boolean, whether the operation succeeded.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ * @return The routine returns TRUE if it succeeded, and FALSE if a Java exception was thrown.
+ * @see #Done_Class_List
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
+ */
+static int Done_Set_Command_Done(JNIEnv *env,int done_class,jobject done,int successful,int error_number,
+				 char *error_string)
+{
+	struct Done_Class_Struct *cache = &(Done_Class_List[done_class]);
+	jstring error_jstring = NULL;
+	jclass cls;
+	int retval;
+
+	if(cache->Class == NULL)
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Command_Done(env,cls,done,successful,error_number,error_string);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	(*env)->CallVoidMethod(env,done,cache->Set_Successful,(jboolean)successful);
+	(*env)->CallVoidMethod(env,done,cache->Set_Error_Num,(jint)error_number);
+	if(error_string != NULL)
+		error_jstring = (*env)->NewStringUTF(env,error_string);
+	(*env)->CallVoidMethod(env,done,cache->Set_Error_String,error_jstring);
+	if(error_jstring != NULL)
+		(*env)->DeleteLocalRef(env,error_jstring);
+	return ((*env)->ExceptionCheck(env) == JNI_FALSE);
+}
+
+/**
+ * Fill in the REDUCE_DONE fields of a done message, using the cached method IDs of it's class. If the class
+ * was not cached, the class is got from the object and DpRt_JNI_Set_Reduce_Done is used instead.
+ * @param env The JNI environment pointer.
+ * @param done_class The index in Done_Class_List of the done message's class.
+ * @param done The done message object.
+ * @param filename The reduced filename.
+ * @return The routine returns TRUE if it succeeded, and FALSE if a Java exception was thrown.
+ * @see #Done_Class_List
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
+ */
+static int Done_Set_Reduce_Done(JNIEnv *env,int done_class,jobject done,char *filename)
+{
+	struct Done_Class_Struct *cache = &(Done_Class_List[done_class]);
+	jstring filename_jstring = NULL;
+	jclass cls;
+	int retval;
+
+	if(cache->Class == NULL)
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Reduce_Done(env,cls,done,filename);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	if(filename != NULL)
+		filename_jstring = (*env)->NewStringUTF(env,filename);
+	(*env)->CallVoidMethod(env,done,cache->Set_Filename,filename_jstring);
+	if(filename_jstring != NULL)
+		(*env)->DeleteLocalRef(env,filename_jstring);
+	return ((*env)->ExceptionCheck(env) == JNI_FALSE);
+}
+
+/**
+ * Fill in the CALIBRATE_REDUCE_DONE fields of a done message, using the cached method IDs. If the class
+ * was not cached, the class is got from the object and DpRt_JNI_Set_Calibrate_Reduce_Done is used instead.
+ * @param env The JNI environment pointer.
+ * @param done The CALIBRATE_REDUCE_DONE object.
+ * @param mean_counts The mean counts.
+ * @param peak_counts The peak counts.
+ * @return The routine returns TRUE if it succeeded, and FALSE if a Java exception was thrown.
+ * @see #Done_Class_List
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Calibrate_Reduce_Done
+ */
+static int Done_Set_Calibrate_Reduce_Done(JNIEnv *env,jobject done,double mean_counts,double peak_counts)
+{
+	struct Done_Class_Struct *cache = &(Done_Class_List[DONE_CLASS_CALIBRATE_REDUCE]);
+	jclass cls;
+	int retval;
+
+	if(cache->Class == NULL)
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Calibrate_Reduce_Done(env,cls,done,mean_counts,peak_counts);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	(*env)->CallVoidMethod(env,done,cache->Set_Mean_Counts,(jfloat)mean_counts);
+	(*env)->CallVoidMethod(env,done,cache->Set_Peak_Counts,(jfloat)peak_counts);
+	return ((*env)->ExceptionCheck(env) == JNI_FALSE);
+}
+
+/**
+ * Fill in the EXPOSE_REDUCE_DONE fields of a done message, using the cached method IDs. If the class
+ * was not cached, the class is got from the object and DpRt_JNI_Set_Expose_Reduce_Done is used instead.
+ * @param env The JNI environment pointer.
+ * @param done The EXPOSE_REDUCE_DONE object.
+ * @param seeing The seeing.
+ * @param counts The counts of the brightest object.
+ * @param x_pix The x position of the brightest object.
+ * @param y_pix The y position of the brightest object.
+ * @param photometricity The photometricity.
+ * @param sky_brightness The sky brightness.
+ * @param saturated A boolean, whether the brightest object is saturated.
+ * @return The routine returns TRUE if it succeeded, and FALSE if a Java exception was thrown.
+ * @see #Done_Class_List
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Expose_Reduce_Done
+ */
+static int Done_Set_Expose_Reduce_Done(JNIEnv *env,jobject done,double seeing,double counts,double x_pix,
+				       double y_pix,double photometricity,double sky_brightness,int saturated)
+{
+	struct Done_Class_Struct *cache = &(Done_Class_List[DONE_CLASS_EXPOSE_REDUCE]);
+	jclass cls;
+	int retval;
+
+	if(cache->Class == NULL)
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Expose_Reduce_Done(env,cls,done,seeing,counts,x_pix,y_pix,photometricity,
+							 sky_brightness,saturated);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	(*env)->CallVoidMethod(env,done,cache->Set_Seeing,(jfloat)seeing);
+	(*env)->CallVoidMethod(env,done,cache->Set_Counts,(jfloat)counts);
+	(*env)->CallVoidMethod(env,done,cache->Set_X_Pix,(jfloat)x_pix);
+	(*env)->CallVoidMethod(env,done,cache->Set_Y_Pix,(jfloat)y_pix);
+	(*env)->CallVoidMethod(env,done,cache->Set_Photometricity,(jfloat)photometricity);
+	(*env)->CallVoidMethod(env,done,cache->Set_Sky_Brightness,(jfloat)sky_brightness);
+	(*env)->CallVoidMethod(env,done,cache->Set_Saturation,(jboolean)saturated);
+	return ((*env)->ExceptionCheck(env) == JNI_FALSE);
+}
+
+/**
+ * Copy a focus run fit into a Java double array, indexed by the DPRT_FOCUS_RESULT_ hash definitions.
+ * If the array is too short, an exception is thrown.
+ * @param env The JNI environment pointer.
+ * @param result_array The Java double array, or NULL if the fit is not wanted.
+ * @param fit The fit.
+ * @return The routine returns TRUE if it succeeded, and FALSE if it failed.
+ * @see dprt_focus.html#DpRt_Focus_Fit_To_List
+ * @see dprt_focus.html#DPRT_FOCUS_RESULT_COUNT
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+static int Focus_Set_Result(JNIEnv *env,jdoubleArray result_array,struct DpRt_Focus_Fit_Struct *fit)
+{
+	double result_list[DPRT_FOCUS_RESULT_COUNT];
+
+	if(result_array == NULL)
+		return TRUE;
+	if((*env)->GetArrayLength(env,result_array) < DPRT_FOCUS_RESULT_COUNT)
+	{
+		DpRt_JNI_Error_Number = 1708;
+		sprintf(DpRt_JNI_Error_String,"Focus_Set_Result:Result array has fewer than %d elements.\n",
+			DPRT_FOCUS_RESULT_COUNT);
+		DpRt_JNI_Throw_Exception(env,"Focus_Set_Result");
+		return FALSE;
+	}
+	DpRt_Focus_Fit_To_List(fit,result_list);
+	(*env)->SetDoubleArrayRegion(env,result_array,0,DPRT_FOCUS_RESULT_COUNT,(jdouble *)result_list);
+	return ((*env)->ExceptionCheck(env) == JNI_FALSE);
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 */
@@ -3,6 +3,8 @@
 */
 #ifndef DPRT_H
 #define DPRT_H
+#include <stddef.h>
+#include "dprt_context.h"
 
 /**
  * TRUE is the value usually returned from routines to indicate success.
@@ -17,14 +19,97 @@
 #define FALSE 0
 #endif
 
+/* structures */
+/**
+ * Structure holding the result of reducing one calibration frame of a batch (DpRt_Calibrate_Reduce_Batch).
+ * <dl>
+ * <dt>Successful</dt> <dd>A boolean, TRUE if the frame was reduced successfully.</dd>
+ * <dt>Error_Number</dt> <dd>The error number, if the reduction failed.</dd>
+ * <dt>Error_String</dt> <dd>The error string, if the reduction failed.</dd>
+ * <dt>Output_Filename</dt> <dd>The reduced filename, allocated by the reduction. The caller should free it.</dd>
+ * <dt>Mean_Counts</dt> <dd>The mean counts.</dd>
+ * <dt>Peak_Counts</dt> <dd>The peak counts.</dd>
+ * </dl>
+ */
+struct DpRt_Calibrate_Reduce_Result_Struct
+{
+	int Successful;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	char *Output_Filename;
+	double Mean_Counts;
+	double Peak_Counts;
+};
+
+/**
+ * Structure holding the result of reducing one exposure frame of a batch (DpRt_Expose_Reduce_Batch).
+ * <dl>
+ * <dt>Successful</dt> <dd>A boolean, TRUE if the frame was reduced successfully.</dd>
+ * <dt>Error_Number</dt> <dd>The error number, if the reduction failed.</dd>
+ * <dt>Error_String</dt> <dd>The error string, if the reduction failed.</dd>
+ * <dt>Output_Filename</dt> <dd>The reduced filename, allocated by the reduction. The caller should free it.</dd>
+ * <dt>Seeing</dt> <dd>The seeing.</dd>
+ * <dt>Counts</dt> <dd>The counts of the brightest object.</dd>
+ * <dt>X_Pix</dt> <dd>The x position of the brightest object.</dd>
+ * <dt>Y_Pix</dt> <dd>The y position of the brightest object.</dd>
+ * <dt>Photometricity</dt> <dd>The photometricity.</dd>
+ * <dt>Sky_Brightness</dt> <dd>The sky brightness.</dd>
+ * <dt>Saturated</dt> <dd>A boolean, TRUE if the brightest object is saturated.</dd>
+ * </dl>
+ */
+struct DpRt_Expose_Reduce_Result_Struct
+{
+	int Successful;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	char *Output_Filename;
+	double Seeing;
+	double Counts;
+	double X_Pix;
+	double Y_Pix;
+	double Photometricity;
+	double Sky_Brightness;
+	int Saturated;
+};
+
 /* function declarations */
 extern int DpRt_Initialise(void);
 extern int DpRt_Shutdown(void);
+extern int DpRt_Reload_Config(void);
 extern int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts);
 extern int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
 		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+extern int DpRt_Calibrate_Reduce_Batch(char **input_filename_list,int input_filename_count,
+				       struct DpRt_Calibrate_Reduce_Result_Struct *result_list);
+extern int DpRt_Expose_Reduce_Batch(char **input_filename_list,int input_filename_count,
+				    struct DpRt_Expose_Reduce_Result_Struct *result_list);
+extern int DpRt_Calibrate_Reduce_Buffer(char *frame_name,void *data,size_t data_length,int naxis_one,int naxis_two,
+					double bzero,char **output_filename,double *mean_counts,double *peak_counts);
+extern int DpRt_Expose_Reduce_Buffer(char *frame_name,void *data,size_t data_length,int naxis_one,int naxis_two,
+				     double bzero,double telfocus,char **output_filename,double *seeing,double *counts,
+				     double *x_pix,double *y_pix,double *photometricity,double *sky_brightness,
+				     int *saturated);
 extern int DpRt_Make_Master_Bias(char *directory_name);
 extern int DpRt_Make_Master_Flat(char *directory_name);
+extern int DpRt_Context_Calibrate_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,
+					 double *mean_counts,double *peak_counts);
+extern int DpRt_Context_Expose_Reduce(DpRt_Context *context,char *input_filename,char **output_filename,
+				      double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+				      double *sky_brightness,int *saturated);
+extern int DpRt_Context_Calibrate_Reduce_Batch(DpRt_Context *context,char **input_filename_list,
+					       int input_filename_count,
+					       struct DpRt_Calibrate_Reduce_Result_Struct *result_list);
+extern int DpRt_Context_Expose_Reduce_Batch(DpRt_Context *context,char **input_filename_list,int input_filename_count,
+					    struct DpRt_Expose_Reduce_Result_Struct *result_list);
+extern int DpRt_Context_Calibrate_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,
+						size_t data_length,int naxis_one,int naxis_two,double bzero,
+						char **output_filename,double *mean_counts,double *peak_counts);
+extern int DpRt_Context_Expose_Reduce_Buffer(DpRt_Context *context,char *frame_name,void *data,size_t data_length,
+					     int naxis_one,int naxis_two,double bzero,double telfocus,
+					     char **output_filename,double *seeing,double *counts,double *x_pix,
+					     double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+extern int DpRt_Context_Make_Master_Bias(DpRt_Context *context,char *directory_name);
+extern int DpRt_Context_Make_Master_Flat(DpRt_Context *context,char *directory_name);
 #endif
 /*
 ** $Log: not supported by cvs2svn $
@@ -0,0 +1,25 @@
+/* dprt_accumulate.h
+** $Header$
+*/
+#ifndef DPRT_ACCUMULATE_H
+#define DPRT_ACCUMULATE_H
+#include "dprt_combine.h"
+
+/* hash definitions */
+/**
+ * The maximum number of frames an accumulator's reservoir can hold.
+ */
+#define DPRT_ACCUMULATE_MAX_RESERVOIR_SIZE	(256)
+
+/* function declarations */
+extern int DpRt_Accumulate_Add(int type,void *data,int encoding,int naxis_one,int naxis_two,double scale);
+extern int DpRt_Accumulate_Get_Count(int type,int *count);
+extern int DpRt_Accumulate_Get(int type,int index,int *naxis_one,int *naxis_two,int *frame_count);
+extern int DpRt_Accumulate_Finalise(int type,int index,struct DpRt_Combine_Parameter_Struct *parameters,
+				    float *output);
+extern int DpRt_Accumulate_Reset(int type);
+extern int DpRt_Accumulate_Shutdown(void);
+#endif
+/*
+** $Log$
+*/
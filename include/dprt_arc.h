@@ -0,0 +1,129 @@
+/* dprt_arc.h
+** $Header$
+*/
+#ifndef DPRT_ARC_H
+#define DPRT_ARC_H
+#include <stddef.h>
+#include "dprt_source.h"
+
+/* hash definitions */
+/**
+ * The highest order of the dispersion solution polynomial.
+ */
+#define DPRT_ARC_MAX_ORDER		(4)
+/**
+ * The maximum number of emission lines found in an arc, and the maximum number of lines in a line list.
+ */
+#define DPRT_ARC_MAX_LINE_COUNT		(256)
+/**
+ * The maximum number of dispersion solutions (one per frame size) held in memory at once.
+ */
+#define DPRT_ARC_SOLUTION_COUNT		(4)
+/**
+ * The maximum length of a line list or dispersion solution filename, including the terminating NULL.
+ */
+#define DPRT_ARC_FILENAME_LENGTH	(1024)
+
+/* structures */
+/**
+ * Structure holding the parameters of arc line finding and dispersion solution fitting. Wavelengths are in the
+ * units of the line list (usually Angstroms).
+ * <dl>
+ * <dt>Line_List_Filename</dt> <dd>The filename of the line list, a text file with the wavelength of a line at the
+ *     start of each line ('#' starts a comment).</dd>
+ * <dt>Detect_Sigma</dt> <dd>A line's peak must be this many standard deviations (estimated from the collapsed
+ *     arc's median absolute deviation) above the collapsed arc's median.</dd>
+ * <dt>Order</dt> <dd>The order of the dispersion solution polynomial, at most DPRT_ARC_MAX_ORDER.</dd>
+ * <dt>Central_Wavelength</dt> <dd>The initial guess of the wavelength at the centre column, used when there is no
+ *     cached solution.</dd>
+ * <dt>Dispersion</dt> <dd>The initial guess of the dispersion, in wavelength per column.</dd>
+ * <dt>Search_Range</dt> <dd>How far either side of Central_Wavelength the initial guess is searched.</dd>
+ * <dt>Match_Tolerance</dt> <dd>A line is matched to a line list wavelength if they are no further apart than this
+ *     using the initial guess or the cached solution.</dd>
+ * <dt>Refine_Tolerance</dt> <dd>A line is matched to a line list wavelength if they are no further apart than this
+ *     using a solution fitted to this arc's lines.</dd>
+ * <dt>Min_Lines</dt> <dd>A solution must be fitted to at least this many lines to be used.</dd>
+ * <dt>Max_RMS</dt> <dd>A solution must have an rms residual no more than this to be used.</dd>
+ * </dl>
+ */
+struct DpRt_Arc_Parameter_Struct
+{
+	char Line_List_Filename[DPRT_ARC_FILENAME_LENGTH];
+	double Detect_Sigma;
+	int Order;
+	double Central_Wavelength;
+	double Dispersion;
+	double Search_Range;
+	double Match_Tolerance;
+	double Refine_Tolerance;
+	int Min_Lines;
+	double Max_RMS;
+};
+
+/**
+ * Structure describing an emission line found in an arc.
+ * <dl>
+ * <dt>X</dt> <dd>The column of the line's centre.</dd>
+ * <dt>Peak</dt> <dd>The line's peak above the collapsed arc's median.</dd>
+ * <dt>Wavelength</dt> <dd>The wavelength of the line list line it was matched to, only valid if Matched is TRUE.</dd>
+ * <dt>Matched</dt> <dd>A boolean, TRUE if the line was matched to a line list line and used in the solution.</dd>
+ * </dl>
+ */
+struct DpRt_Arc_Line_Struct
+{
+	double X;
+	double Peak;
+	double Wavelength;
+	int Matched;
+};
+
+/**
+ * Structure holding a dispersion solution, the wavelength as a polynomial of the column:
+ * wavelength = sum over i of Coefficient_List[i]*u^i, where u = (column-Centre_X)/Scale_X.
+ * <dl>
+ * <dt>Valid</dt> <dd>A boolean, TRUE if the solution has been fitted. The other fields are only valid if it
+ *     is.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frames the solution applies to.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frames the solution applies to.</dd>
+ * <dt>Order</dt> <dd>The order of the polynomial.</dd>
+ * <dt>Coefficient_List</dt> <dd>The polynomial's coefficients, lowest order first.</dd>
+ * <dt>Centre_X</dt> <dd>The column the polynomial is centred on.</dd>
+ * <dt>Scale_X</dt> <dd>The number of columns the polynomial's variable is scaled by.</dd>
+ * <dt>RMS</dt> <dd>The rms residual of the matched lines about the polynomial, in wavelength.</dd>
+ * <dt>Line_Count</dt> <dd>The number of lines the polynomial was fitted to.</dd>
+ * <dt>Arc_Count</dt> <dd>The number of arcs the solution has been fitted or refined with.</dd>
+ * </dl>
+ */
+struct DpRt_Arc_Solution_Struct
+{
+	int Valid;
+	int Naxis_One;
+	int Naxis_Two;
+	int Order;
+	double Coefficient_List[DPRT_ARC_MAX_ORDER+1];
+	double Centre_X;
+	double Scale_X;
+	double RMS;
+	int Line_Count;
+	int Arc_Count;
+};
+
+/* function declarations */
+extern int DpRt_Arc_Get_Parameters(struct DpRt_Arc_Parameter_Struct *parameters);
+extern int DpRt_Arc_Read_Line_List(char *filename,double *wavelength_list,int *wavelength_count);
+extern int DpRt_Arc_Collapse(struct DpRt_Source_Frame_Struct *frame,double *column_sum_list,int *start_x,
+			     int *length);
+extern int DpRt_Arc_Find_Lines(double *column_sum_list,int start_x,int length,
+			       struct DpRt_Arc_Parameter_Struct *parameters,double *work_list,
+			       struct DpRt_Arc_Line_Struct *line_list,int *line_count);
+extern int DpRt_Arc_Solve(struct DpRt_Arc_Line_Struct *line_list,int line_count,double *wavelength_list,
+			  int wavelength_count,int naxis_one,int naxis_two,struct DpRt_Arc_Parameter_Struct *parameters,
+			  struct DpRt_Arc_Solution_Struct *seed_solution,struct DpRt_Arc_Solution_Struct *solution);
+extern double DpRt_Arc_Evaluate(struct DpRt_Arc_Solution_Struct *solution,double x);
+extern int DpRt_Arc_Solution_Get(int naxis_one,int naxis_two,struct DpRt_Arc_Solution_Struct *solution);
+extern int DpRt_Arc_Solution_Put(struct DpRt_Arc_Solution_Struct *solution);
+extern int DpRt_Arc_Shutdown(void);
+#endif
+/*
+** $Log$
+*/
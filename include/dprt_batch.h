@@ -0,0 +1,34 @@
+/* dprt_batch.h
+** $Header$
+*/
+#ifndef DPRT_BATCH_H
+#define DPRT_BATCH_H
+#include "dprt_context.h"
+
+/* hash definitions */
+/**
+ * The maximum number of slots (frames read ahead of the one being processed, plus that one) a batch can use.
+ */
+#define DPRT_BATCH_MAX_DEPTH		(8)
+
+/* structures */
+/**
+ * Type of the function called (on the batch's read thread) to read item index of a batch into slot slot.
+ * The function should return TRUE if it succeeded, and FALSE (setting DpRt_Error_Number/DpRt_Error_String)
+ * if it failed, in which case the slot must not hold anything that needs freeing.
+ */
+typedef int (*DpRt_Batch_Read_Function)(int index,int slot,void *user_data);
+/**
+ * Type of the function called (on the calling thread) to process item index of a batch, previously read into
+ * slot slot. read_retval is the value returned by the read function; if it is FALSE, DpRt_Error_Number and
+ * DpRt_Error_String hold the read error. The function must release anything the read function put in the slot.
+ */
+typedef void (*DpRt_Batch_Process_Function)(int index,int slot,int read_retval,void *user_data);
+
+/* function declarations */
+extern int DpRt_Batch_Run(DpRt_Context *context,int count,int depth,DpRt_Batch_Read_Function read_function,
+			  DpRt_Batch_Process_Function process_function,void *user_data);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,23 @@
+/* dprt_buffer_pool.h
+** $Header$
+*/
+#ifndef DPRT_BUFFER_POOL_H
+#define DPRT_BUFFER_POOL_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * The alignment, in bytes, of all buffers leased from the pool.
+ */
+#define DPRT_BUFFER_POOL_ALIGNMENT	(64)
+
+/* function declarations */
+extern int DpRt_Buffer_Pool_Initialise(size_t max_bytes,int use_huge_pages);
+extern int DpRt_Buffer_Pool_Shutdown(void);
+extern int DpRt_Buffer_Pool_Lease(size_t size,void **buffer);
+extern int DpRt_Buffer_Pool_Return(void *buffer);
+extern int DpRt_Buffer_Pool_Get_Usage(size_t *allocated_bytes,size_t *leased_bytes,size_t *max_bytes);
+#endif
+/*
+** $Log$
+*/
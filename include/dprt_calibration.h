@@ -0,0 +1,53 @@
+/* dprt_calibration.h
+** $Header$
+*/
+#ifndef DPRT_CALIBRATION_H
+#define DPRT_CALIBRATION_H
+#include <stddef.h>
+#include "dprt_master.h"
+
+/* hash definitions */
+/**
+ * Calibration frame type: a master bias, subtracted from frames.
+ */
+#define DPRT_CALIBRATION_TYPE_BIAS	(DPRT_MASTER_TYPE_BIAS)
+/**
+ * Calibration frame type: a master flat, which frames are divided by.
+ */
+#define DPRT_CALIBRATION_TYPE_FLAT	(DPRT_MASTER_TYPE_FLAT)
+/**
+ * Calibration frame type: a bad pixel mask, non-zero for bad pixels, which are set to zero in frames and left out of
+ * their statistics. It is cached as a packed bitset.
+ */
+#define DPRT_CALIBRATION_TYPE_BPM	(2)
+/**
+ * The maximum length of the filename of a calibration frame, including the terminator.
+ */
+#define DPRT_CALIBRATION_FILENAME_LENGTH	(1024)
+/**
+ * The maximum number of pixels calibrated by one call of DpRt_Calibration_Apply_Pixels.
+ */
+#define DPRT_CALIBRATION_CHUNK_PIXELS	(1024)
+/**
+ * A pedestal added to calibrated pixels before they are stored as unsigned shorts for their statistics, so the
+ * noise of bias subtracted pixels below zero is kept rather than clamped to zero (which biases the mean and sky
+ * upwards). It is subtracted from the results again, so calibrated values are clamped to
+ * [-DPRT_CALIBRATION_PEDESTAL,65535-DPRT_CALIBRATION_PEDESTAL] instead.
+ */
+#define DPRT_CALIBRATION_PEDESTAL	(1000)
+
+/* function declarations */
+extern int DpRt_Calibration_Cache_Get(int type,char *filename,int naxis_one,int naxis_two,float **data);
+extern int DpRt_Calibration_Cache_Get_Mask(char *filename,int naxis_one,int naxis_two,unsigned long long **mask);
+extern int DpRt_Calibration_Cache_Release(void *data);
+extern int DpRt_Calibration_Cache_Invalidate(int type);
+extern int DpRt_Calibration_Cache_Get_Counts(int *hit_count,int *miss_count);
+extern int DpRt_Calibration_Cache_Shutdown(void);
+extern int DpRt_Calibration_Apply(void *data,int encoding,int naxis_one,int naxis_two,float *bias,float *flat,
+				  unsigned long long *mask,unsigned short *output);
+extern void DpRt_Calibration_Apply_Pixels(void *data,int encoding,size_t start,size_t pixel_count,float offset,
+					  float *bias,float *flat,unsigned long long *mask,unsigned short *output);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,65 @@
+/* dprt_combine.h
+** $Header$
+*/
+#ifndef DPRT_COMBINE_H
+#define DPRT_COMBINE_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * Combine method: the mean of the values.
+ */
+#define DPRT_COMBINE_METHOD_MEAN	(0)
+/**
+ * Combine method: the median of the values.
+ */
+#define DPRT_COMBINE_METHOD_MEDIAN	(1)
+/**
+ * Combine method: the kappa-sigma clipped mean of the values.
+ */
+#define DPRT_COMBINE_METHOD_SIGMA_CLIP	(2)
+/**
+ * Combine method: the mean of the values, after rejecting the lowest and highest values.
+ */
+#define DPRT_COMBINE_METHOD_MINMAX	(3)
+/**
+ * The largest stack depth (number of frames) combined using the sorting network kernels. Deeper stacks
+ * are combined a pixel at a time.
+ */
+#define DPRT_COMBINE_MAX_NETWORK_COUNT	(32)
+/**
+ * The number of pixels combined in parallel by the sorting network kernels.
+ */
+#define DPRT_COMBINE_LANE_COUNT		(16)
+
+/* structures */
+/**
+ * Structure holding the parameters of a combine.
+ * <dl>
+ * <dt>Method</dt> <dd>The combine method, DPRT_COMBINE_METHOD_MEAN, DPRT_COMBINE_METHOD_MEDIAN,
+ *     DPRT_COMBINE_METHOD_SIGMA_CLIP or DPRT_COMBINE_METHOD_MINMAX.</dd>
+ * <dt>Kappa</dt> <dd>Sigma clipping: values more than Kappa standard deviations from the mean are rejected.</dd>
+ * <dt>Iterations</dt> <dd>Sigma clipping: the maximum number of clipping iterations.</dd>
+ * <dt>Reject_Low</dt> <dd>Min/max rejection: the number of lowest values rejected.</dd>
+ * <dt>Reject_High</dt> <dd>Min/max rejection: the number of highest values rejected.</dd>
+ * </dl>
+ */
+struct DpRt_Combine_Parameter_Struct
+{
+	int Method;
+	double Kappa;
+	int Iterations;
+	int Reject_Low;
+	int Reject_High;
+};
+
+/* function declarations */
+extern int DpRt_Combine_Pixels(struct DpRt_Combine_Parameter_Struct *parameters,unsigned short *data,
+			       size_t frame_stride,int frame_count,double *scale_list,size_t pixel_count,
+			       float *output);
+extern float DpRt_Combine_Median(float *value_list,int count);
+extern double DpRt_Combine_Median_Double(double *value_list,int count);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,18 @@
+/* dprt_config.h
+** $Header$
+*/
+#ifndef DPRT_CONFIG_H
+#define DPRT_CONFIG_H
+
+/* function declarations */
+extern int DpRt_Config_Load(void);
+extern int DpRt_Config_Free(void);
+extern int DpRt_Config_Is_Loaded(void);
+extern int DpRt_Config_Get_String(char *keyword,char **value);
+extern int DpRt_Config_Get_Integer(char *keyword,int *value);
+extern int DpRt_Config_Get_Double(char *keyword,double *value);
+extern int DpRt_Config_Get_Boolean(char *keyword,int *value);
+#endif
+/*
+** $Log$
+*/
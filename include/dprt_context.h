@@ -0,0 +1,77 @@
+/* dprt_context.h
+** $Header$
+*/
+#ifndef DPRT_CONTEXT_H
+#define DPRT_CONTEXT_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * The length of the error string held in each context (and each thread).
+ */
+#define DPRT_CONTEXT_ERROR_STRING_LENGTH	(256)
+/**
+ * The number of scratch buffers each context holds.
+ */
+#define DPRT_CONTEXT_SCRATCH_COUNT		(6)
+/**
+ * Index of the scratch buffer used by the tiled reductions (dprt_reduce.c) for their per-band results.
+ */
+#define DPRT_CONTEXT_SCRATCH_REDUCE		(0)
+/**
+ * Index of the scratch buffer holding the per-thread histograms of a frame histogram (dprt_histogram.c) or a
+ * tiled reduction building one (dprt_reduce.c).
+ */
+#define DPRT_CONTEXT_SCRATCH_HISTOGRAM		(1)
+/**
+ * Index of the scratch buffer holding the merged histogram of an exposure reduction (dprt.c).
+ */
+#define DPRT_CONTEXT_SCRATCH_EXPOSE_HISTOGRAM	(2)
+/**
+ * Index of the scratch buffer holding the per-band source lists and per-thread row buffers of a source search
+ * (dprt_source.c).
+ */
+#define DPRT_CONTEXT_SCRATCH_SOURCE		(3)
+/**
+ * Index of the scratch buffer holding the spatial profile and extracted spectrum of an exposure reduction (dprt.c).
+ */
+#define DPRT_CONTEXT_SCRATCH_SPECTRUM		(4)
+/**
+ * Index of the scratch buffer holding the collapsed arc of a calibration reduction (dprt.c).
+ */
+#define DPRT_CONTEXT_SCRATCH_ARC		(5)
+
+/* structures */
+/**
+ * Opaque handle for a reduction context. Each context has it's own error state, abort flag,
+ * random number generator state and scratch buffers, so reductions in different contexts can run concurrently
+ * from different threads. A context must only be used by one thread at a time.
+ * @see dprt_context.html#DpRt_Context_Struct
+ */
+typedef struct DpRt_Context_Struct DpRt_Context;
+
+/* external variables */
+extern __thread int DpRt_Error_Number;
+extern __thread char DpRt_Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+
+/* function declarations */
+extern int DpRt_Context_Create(DpRt_Context **context);
+extern int DpRt_Context_Destroy(DpRt_Context *context);
+extern DpRt_Context *DpRt_Context_Get_Default(void);
+extern DpRt_Context *DpRt_Context_Get_Current(void);
+extern DpRt_Context *DpRt_Context_Enter(DpRt_Context *context);
+extern void DpRt_Context_Leave(DpRt_Context *context,DpRt_Context *previous_context);
+extern void DpRt_Context_Set_Abort(DpRt_Context *context,int value);
+extern int DpRt_Context_Get_Abort(DpRt_Context *context);
+extern int DpRt_Context_Get_Error_Number(DpRt_Context *context);
+extern void DpRt_Context_Get_Error_String(DpRt_Context *context,char *error_string);
+extern void DpRt_Context_Set_Random_Seed(DpRt_Context *context,unsigned int seed);
+extern int DpRt_Context_Random(DpRt_Context *context);
+extern int DpRt_Context_Get_Scratch(DpRt_Context *context,int index,size_t size,void **buffer);
+extern void DpRt_Context_Error_From_JNI(void);
+extern void DpRt_Context_Error_To_JNI(DpRt_Context *context);
+extern void DpRt_Context_Thread_Error_To_JNI(void);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,60 @@
+/* dprt_fits.h
+** $Header$
+*/
+#ifndef DPRT_FITS_H
+#define DPRT_FITS_H
+#include <stddef.h>
+#include "fitsio.h"
+
+/* structures */
+/**
+ * Structure describing the data of a 16-bit FITS image, either memory mapped directly from the file,
+ * read into a frame buffer leased from the buffer pool, or held in memory owned by the caller
+ * (DpRt_Fits_Image_From_Buffer, when Buffer and Map_Address are both NULL).
+ * <dl>
+ * <dt>Data</dt> <dd>The pixel data, of Naxis_One*Naxis_Two pixels in row-major order.</dd>
+ * <dt>Encoding</dt> <dd>How the pixel values are stored in Data: DPRT_STATS_ENCODING_NATIVE (read via CFITSIO)
+ *     or DPRT_STATS_ENCODING_FITS (memory mapped). Caller owned data can use either.</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the image.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the image.</dd>
+ * <dt>Obstype</dt> <dd>The value of the OBSTYPE keyword, or an empty string if the image has none
+ *     (always empty for DpRt_Fits_Image_From_Buffer).</dd>
+ * <dt>Object</dt> <dd>The value of the OBJECT keyword (the target's name), or an empty string if the image has none
+ *     (always empty for DpRt_Fits_Image_From_Buffer).</dd>
+ * <dt>Biassec</dt> <dd>The value of the BIASSEC keyword (the overscan region), or an empty string if the image
+ *     has none (always empty for DpRt_Fits_Image_From_Buffer).</dd>
+ * <dt>Trimsec</dt> <dd>The value of the TRIMSEC keyword (the data region), or an empty string if the image
+ *     has none (always empty for DpRt_Fits_Image_From_Buffer).</dd>
+ * <dt>Exposure_Length</dt> <dd>The value of the EXPTIME keyword in seconds, or zero if the image has none
+ *     (always zero for DpRt_Fits_Image_From_Buffer).</dd>
+ * <dt>Buffer</dt> <dd>The frame buffer leased from the buffer pool, or NULL if the image is memory mapped.</dd>
+ * <dt>Map_Address</dt> <dd>The start of the memory mapping, or NULL if the image was read via CFITSIO.</dd>
+ * <dt>Map_Length</dt> <dd>The length of the memory mapping in bytes.</dd>
+ * </dl>
+ */
+struct DpRt_Fits_Image_Struct
+{
+	void *Data;
+	int Encoding;
+	int Naxis_One;
+	int Naxis_Two;
+	char Obstype[FLEN_VALUE];
+	char Object[FLEN_VALUE];
+	char Biassec[FLEN_VALUE];
+	char Trimsec[FLEN_VALUE];
+	double Exposure_Length;
+	void *Buffer;
+	void *Map_Address;
+	size_t Map_Length;
+};
+
+/* function declarations */
+extern int DpRt_Fits_Image_Read(fitsfile *fp,char *filename,int naxis_one,int naxis_two,int use_mmap,
+				struct DpRt_Fits_Image_Struct *image);
+extern int DpRt_Fits_Image_Free(struct DpRt_Fits_Image_Struct *image);
+extern int DpRt_Fits_Image_From_Buffer(void *data,size_t data_length,int naxis_one,int naxis_two,double bzero,
+				       struct DpRt_Fits_Image_Struct *image);
+#endif
+/*
+** $Log$
+*/
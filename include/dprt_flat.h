@@ -0,0 +1,52 @@
+/* dprt_flat.h
+** $Header$
+*/
+#ifndef DPRT_FLAT_H
+#define DPRT_FLAT_H
+
+/* hash definitions */
+/**
+ * The largest number of columns in a block a row's smooth level is measured in.
+ */
+#define DPRT_FLAT_MAX_WINDOW		(1024)
+/**
+ * The maximum number of blocks a row is divided into. Wider rows use wider blocks.
+ */
+#define DPRT_FLAT_MAX_BLOCK_COUNT	(1024)
+
+/* structures */
+/**
+ * Structure holding the parameters of spectral flat normalisation.
+ * <dl>
+ * <dt>Enabled</dt> <dd>A boolean, TRUE if master flats are normalised.</dd>
+ * <dt>Window</dt> <dd>The number of columns in each block of a row whose median is taken, at most
+ *     DPRT_FLAT_MAX_WINDOW.</dd>
+ * <dt>Min_Level</dt> <dd>Pixels whose smooth level is below this (unilluminated parts of the slit) are set to
+ *     one rather than normalised.</dd>
+ * <dt>Start_X</dt> <dd>The first column of the data section, columns outside the data section are set to one.</dd>
+ * <dt>End_X</dt> <dd>One more than the last column of the data section.</dd>
+ * <dt>Start_Y</dt> <dd>The first row of the data section, rows outside the data section are set to one.</dd>
+ * <dt>End_Y</dt> <dd>One more than the last row of the data section.</dd>
+ * </dl>
+ */
+struct DpRt_Flat_Parameter_Struct
+{
+	int Enabled;
+	int Window;
+	double Min_Level;
+	int Start_X;
+	int End_X;
+	int Start_Y;
+	int End_Y;
+};
+
+/* function declarations */
+extern int DpRt_Flat_Get_Parameters(int naxis_one,int naxis_two,struct DpRt_Flat_Parameter_Struct *parameters);
+extern void DpRt_Flat_Normalise_Rows(struct DpRt_Flat_Parameter_Struct *parameters,float *flat,int naxis_one,
+				     int start_y,int row_count);
+extern int DpRt_Flat_Normalise(struct DpRt_Flat_Parameter_Struct *parameters,float *flat,int naxis_one,
+			       int naxis_two);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,84 @@
+/* dprt_focus.h
+** $Header$
+*/
+#ifndef DPRT_FOCUS_H
+#define DPRT_FOCUS_H
+
+/* hash definitions */
+/**
+ * The maximum length of a focus run id, including the terminating NULL.
+ */
+#define DPRT_FOCUS_RUN_ID_LENGTH		(64)
+/**
+ * The maximum number of focus runs held at once. When a new run takes the list over this number, the least
+ * recently used run that is not the current run is thrown away.
+ */
+#define DPRT_FOCUS_MAX_RUN_COUNT		(8)
+/**
+ * The maximum number of frames in a focus run.
+ */
+#define DPRT_FOCUS_MAX_POINT_COUNT		(64)
+/**
+ * Index in a focus result list (see DpRt_Focus_Fit_To_List) of the best focus.
+ */
+#define DPRT_FOCUS_RESULT_BEST_FOCUS		(0)
+/**
+ * Index in a focus result list of the uncertainty of the best focus.
+ */
+#define DPRT_FOCUS_RESULT_BEST_FOCUS_ERROR	(1)
+/**
+ * Index in a focus result list of the FWHM at the best focus.
+ */
+#define DPRT_FOCUS_RESULT_BEST_FWHM		(2)
+/**
+ * Index in a focus result list of the number of frames in the run.
+ */
+#define DPRT_FOCUS_RESULT_POINT_COUNT		(3)
+/**
+ * Index in a focus result list of the number of frames used in the fit (not rejected as outliers).
+ */
+#define DPRT_FOCUS_RESULT_USED_COUNT		(4)
+/**
+ * The number of values in a focus result list.
+ */
+#define DPRT_FOCUS_RESULT_COUNT			(5)
+
+/* structures */
+/**
+ * Structure holding the best focus parabola fit of a focus run.
+ * <dl>
+ * <dt>Point_Count</dt> <dd>The number of frames in the run.</dd>
+ * <dt>Used_Count</dt> <dd>The number of frames used in the fit, the rest were rejected as outliers.</dd>
+ * <dt>Valid</dt> <dd>A boolean, TRUE if the fitted parabola has a minimum. The best focus fields are only
+ *     valid if it is.</dd>
+ * <dt>Best_Focus</dt> <dd>The focus at the minimum of the parabola, in the same units as TELFOCUS.</dd>
+ * <dt>Best_Focus_Error</dt> <dd>The standard error of Best_Focus, from the scatter of the frames about the fit.
+ *     It is zero if there are too few frames to estimate it.</dd>
+ * <dt>Best_FWHM</dt> <dd>The FWHM at the minimum of the parabola.</dd>
+ * <dt>Converged</dt> <dd>A boolean, TRUE if the fit uses enough frames, Best_Focus_Error is within the tolerance,
+ *     and Best_Focus lies within the focus range of the frames used, so the run can be stopped.</dd>
+ * </dl>
+ */
+struct DpRt_Focus_Fit_Struct
+{
+	int Point_Count;
+	int Used_Count;
+	int Valid;
+	double Best_Focus;
+	double Best_Focus_Error;
+	double Best_FWHM;
+	int Converged;
+};
+
+/* function declarations */
+extern int DpRt_Focus_Run_Start(char *run_id);
+extern int DpRt_Focus_Run_Add(char *run_id,double telfocus,double fwhm,struct DpRt_Focus_Fit_Struct *fit);
+extern int DpRt_Focus_Run_Add_Current(double telfocus,double fwhm,char *run_id,struct DpRt_Focus_Fit_Struct *fit);
+extern int DpRt_Focus_Run_Get(char *run_id,struct DpRt_Focus_Fit_Struct *fit);
+extern int DpRt_Focus_Run_End(char *run_id);
+extern void DpRt_Focus_Fit_To_List(struct DpRt_Focus_Fit_Struct *fit,double *result_list);
+extern int DpRt_Focus_Shutdown(void);
+#endif
+/*
+** $Log$
+*/
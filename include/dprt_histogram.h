@@ -0,0 +1,49 @@
+/* dprt_histogram.h
+** $Header$
+*/
+#ifndef DPRT_HISTOGRAM_H
+#define DPRT_HISTOGRAM_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * The number of bins in a histogram, one for every 16-bit pixel value.
+ */
+#define DPRT_HISTOGRAM_BIN_COUNT	(65536)
+
+/* structures */
+/**
+ * Structure holding an exact histogram of the values of a 16-bit frame (or part of one).
+ * <dl>
+ * <dt>Pixel_Count</dt> <dd>The number of pixels in the histogram.</dd>
+ * <dt>Pedestal</dt> <dd>A value that was added to every pixel before it was binned, so bin i holds pixels of
+ *     value i-Pedestal. Values passed to and returned from the histogram routines have it removed.</dd>
+ * <dt>Bin_List</dt> <dd>The number of pixels in each bin.</dd>
+ * </dl>
+ */
+struct DpRt_Histogram_Struct
+{
+	unsigned long long Pixel_Count;
+	int Pedestal;
+	unsigned int Bin_List[DPRT_HISTOGRAM_BIN_COUNT];
+};
+
+/* function declarations */
+extern void DpRt_Histogram_Clear(struct DpRt_Histogram_Struct *histogram);
+extern void DpRt_Histogram_Add(struct DpRt_Histogram_Struct *histogram,void *data,int encoding,size_t start,
+			       size_t pixel_count);
+extern void DpRt_Histogram_Add_Masked(struct DpRt_Histogram_Struct *histogram,void *data,int encoding,size_t start,
+				      size_t pixel_count,unsigned long long *mask,size_t mask_start);
+extern int DpRt_Histogram_Merge(struct DpRt_Histogram_Struct *total,struct DpRt_Histogram_Struct *partial);
+extern int DpRt_Histogram_Calculate(void *data,int encoding,int naxis_one,int naxis_two,
+				    struct DpRt_Histogram_Struct *histogram);
+extern int DpRt_Histogram_Get_Count(struct DpRt_Histogram_Struct *histogram,int low,int high,
+				    unsigned long long *count);
+extern int DpRt_Histogram_Get_Percentile(struct DpRt_Histogram_Struct *histogram,double fraction,int *value);
+extern int DpRt_Histogram_Get_Mode(struct DpRt_Histogram_Struct *histogram,int *value);
+extern int DpRt_Histogram_Get_Sky(struct DpRt_Histogram_Struct *histogram,double kappa,int iterations,
+				  double *sky,double *sigma);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,105 @@
+/* dprt_job.h
+** $Header$
+*/
+#ifndef DPRT_JOB_H
+#define DPRT_JOB_H
+#include "dprt_context.h"
+
+/* hash definitions */
+/**
+ * Job type: reduce a calibration frame, as DpRt_Calibrate_Reduce.
+ */
+#define DPRT_JOB_TYPE_CALIBRATE_REDUCE	(0)
+/**
+ * Job type: reduce an exposure frame, as DpRt_Expose_Reduce.
+ */
+#define DPRT_JOB_TYPE_EXPOSE_REDUCE	(1)
+/**
+ * Job state: the job is waiting for a job thread.
+ */
+#define DPRT_JOB_STATE_QUEUED		(0)
+/**
+ * Job state: a job thread is reducing the frame.
+ */
+#define DPRT_JOB_STATE_RUNNING		(1)
+/**
+ * Job state: the reduction completed successfully.
+ */
+#define DPRT_JOB_STATE_DONE		(2)
+/**
+ * Job state: the reduction failed.
+ */
+#define DPRT_JOB_STATE_FAILED		(3)
+/**
+ * Job state: the job was cancelled before, or whilst, it ran.
+ */
+#define DPRT_JOB_STATE_CANCELLED	(4)
+/**
+ * Macro to determine whether a job state is a terminal state (the job will not change state again).
+ */
+#define DPRT_JOB_STATE_IS_FINISHED(state)	((state) >= DPRT_JOB_STATE_DONE)
+
+/* structures */
+/**
+ * Structure holding the result of a job. The fields mirror the parameters of DpRt_Calibrate_Reduce and
+ * DpRt_Expose_Reduce, only the fields relevant to the job's type are filled in.
+ * <dl>
+ * <dt>Type</dt> <dd>The job type, DPRT_JOB_TYPE_CALIBRATE_REDUCE or DPRT_JOB_TYPE_EXPOSE_REDUCE.</dd>
+ * <dt>State</dt> <dd>The terminal state of the job: DPRT_JOB_STATE_DONE, DPRT_JOB_STATE_FAILED
+ *     or DPRT_JOB_STATE_CANCELLED.</dd>
+ * <dt>Successful</dt> <dd>A boolean, TRUE if the reduction succeeded.</dd>
+ * <dt>Error_Number</dt> <dd>The error number, if the reduction failed.</dd>
+ * <dt>Error_String</dt> <dd>The error string, if the reduction failed.</dd>
+ * <dt>Output_Filename</dt> <dd>The reduced filename. In the result passed to a callback this is owned by the job,
+ *     and freed when the job is released. In the result copied by DpRt_Job_Get_Result it is a copy owned by
+ *     the caller.</dd>
+ * <dt>Mean_Counts</dt> <dd>Calibrate reductions: the mean counts.</dd>
+ * <dt>Peak_Counts</dt> <dd>Calibrate reductions: the peak counts.</dd>
+ * <dt>Seeing</dt> <dd>Expose reductions: the seeing.</dd>
+ * <dt>Counts</dt> <dd>Expose reductions: the counts of the brightest object.</dd>
+ * <dt>X_Pix</dt> <dd>Expose reductions: the x position of the brightest object.</dd>
+ * <dt>Y_Pix</dt> <dd>Expose reductions: the y position of the brightest object.</dd>
+ * <dt>Photometricity</dt> <dd>Expose reductions: the photometricity.</dd>
+ * <dt>Sky_Brightness</dt> <dd>Expose reductions: the sky brightness.</dd>
+ * <dt>Saturated</dt> <dd>Expose reductions: a boolean, TRUE if the brightest object is saturated.</dd>
+ * </dl>
+ */
+struct DpRt_Job_Result_Struct
+{
+	int Type;
+	int State;
+	int Successful;
+	int Error_Number;
+	char Error_String[DPRT_CONTEXT_ERROR_STRING_LENGTH];
+	char *Output_Filename;
+	double Mean_Counts;
+	double Peak_Counts;
+	double Seeing;
+	double Counts;
+	double X_Pix;
+	double Y_Pix;
+	double Photometricity;
+	double Sky_Brightness;
+	int Saturated;
+};
+
+/**
+ * Type of the function called when a job finishes. The result is owned by the job, and is only valid
+ * for the duration of the call.
+ */
+typedef void (*DpRt_Job_Callback_Function)(int job_id,struct DpRt_Job_Result_Struct *result,void *user_data);
+
+/* function declarations */
+extern int DpRt_Job_Initialise(int thread_count);
+extern int DpRt_Job_Shutdown(void);
+extern int DpRt_Job_Submit(int type,char *input_filename,DpRt_Job_Callback_Function callback,void *user_data,
+			   int auto_release,int *job_id);
+extern int DpRt_Job_Poll(int job_id,int *state);
+extern int DpRt_Job_Wait(int job_id,int timeout_ms,int *state);
+extern int DpRt_Job_Get_Result(int job_id,struct DpRt_Job_Result_Struct *result);
+extern int DpRt_Job_Cancel(int job_id);
+extern int DpRt_Job_Release(int job_id);
+#endif
+/*
+** $Log$
+*/
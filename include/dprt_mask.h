@@ -0,0 +1,52 @@
+/* dprt_mask.h
+** $Header$
+*/
+#ifndef DPRT_MASK_H
+#define DPRT_MASK_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * The maximum length of the filename of a derived bad pixel mask, including the terminator.
+ */
+#define DPRT_MASK_FILENAME_LENGTH	(1024)
+
+/* structures */
+/**
+ * Structure holding the parameters used to derive a bad pixel mask from master calibration frames.
+ * <dl>
+ * <dt>Enabled</dt> <dd>A boolean, TRUE if a bad pixel mask is derived whenever a master is made.</dd>
+ * <dt>Bias_Sigma</dt> <dd>A master bias pixel further than this many (robust) standard deviations from the master
+ *     bias median is bad (hot or dead).</dd>
+ * <dt>Column_Sigma</dt> <dd>A column whose master bias median is further than this many (robust) standard
+ *     deviations from the median of all the column medians is bad (a hot or dead column).</dd>
+ * <dt>Flat_Low</dt> <dd>A pixel of a spectrally normalised master flat with a response below this is bad.</dd>
+ * <dt>Flat_High</dt> <dd>A pixel of a spectrally normalised master flat with a response above this is bad.</dd>
+ * <dt>Start_X</dt> <dd>The first column of the data section, pixels outside the data section are never bad.</dd>
+ * <dt>End_X</dt> <dd>One more than the last column of the data section.</dd>
+ * <dt>Start_Y</dt> <dd>The first row of the data section.</dd>
+ * <dt>End_Y</dt> <dd>One more than the last row of the data section.</dd>
+ * </dl>
+ */
+struct DpRt_Mask_Parameter_Struct
+{
+	int Enabled;
+	double Bias_Sigma;
+	double Column_Sigma;
+	double Flat_Low;
+	double Flat_High;
+	int Start_X;
+	int End_X;
+	int Start_Y;
+	int End_Y;
+};
+
+/* function declarations */
+extern int DpRt_Mask_Get_Parameters(int naxis_one,int naxis_two,struct DpRt_Mask_Parameter_Struct *parameters);
+extern int DpRt_Mask_Get_Filename(char *directory_name,int naxis_one,int naxis_two,char *filename,
+				  size_t filename_length);
+extern int DpRt_Mask_Make(char *directory_name,int naxis_one,int naxis_two);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,50 @@
+/* dprt_master.h
+** $Header$
+*/
+#ifndef DPRT_MASTER_H
+#define DPRT_MASTER_H
+#include "dprt_combine.h"
+
+/* hash definitions */
+/**
+ * Master frame type: a master bias, combined from bias frames.
+ */
+#define DPRT_MASTER_TYPE_BIAS		(0)
+/**
+ * Master frame type: a master flat, combined from flat frames each normalised by it's mean, with the lamp spectrum
+ * removed if dprt.master.flat.normalise is set.
+ */
+#define DPRT_MASTER_TYPE_FLAT		(1)
+/**
+ * Combine method: the mean of the frames.
+ */
+#define DPRT_MASTER_METHOD_MEAN		(DPRT_COMBINE_METHOD_MEAN)
+/**
+ * Combine method: the median of the frames.
+ */
+#define DPRT_MASTER_METHOD_MEDIAN	(DPRT_COMBINE_METHOD_MEDIAN)
+/**
+ * Combine method: the kappa-sigma clipped mean of the frames.
+ */
+#define DPRT_MASTER_METHOD_SIGMA_CLIP	(DPRT_COMBINE_METHOD_SIGMA_CLIP)
+/**
+ * Combine method: the mean of the frames, after rejecting the dprt.master.minmax.reject_low lowest and
+ * dprt.master.minmax.reject_high highest values of each pixel.
+ */
+#define DPRT_MASTER_METHOD_MINMAX	(DPRT_COMBINE_METHOD_MINMAX)
+/**
+ * The maximum number of frames that can be combined into one master frame. Every frame is held open
+ * whilst the master is made.
+ */
+#define DPRT_MASTER_MAX_FRAME_COUNT	(256)
+
+/* function declarations */
+extern int DpRt_Master_Make(char *directory_name,int type);
+extern int DpRt_Master_Combine(char **filename_list,int frame_count,int type,int method,char *output_filename);
+extern int DpRt_Master_Method_From_String(char *method_string,int *method);
+extern int DpRt_Master_Get_Filename(char *directory_name,int type,int naxis_one,int naxis_two,char *filename,
+				    size_t filename_length);
+#endif
+/*
+** $Log$
+*/
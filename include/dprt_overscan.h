@@ -0,0 +1,63 @@
+/* dprt_overscan.h
+** $Header$
+*/
+#ifndef DPRT_OVERSCAN_H
+#define DPRT_OVERSCAN_H
+#include "dprt_combine.h"
+
+/* hash definitions */
+/**
+ * The maximum number of columns in an overscan (bias) section.
+ */
+#define DPRT_OVERSCAN_MAX_COLUMNS	(256)
+/**
+ * The number of rows whose overscan levels are computed together, one row per lane of the sorting network kernels
+ * of DpRt_Combine_Pixels. Reductions computing levels a group of rows at a time size their level lists with it.
+ */
+#define DPRT_OVERSCAN_ROW_GROUP_COUNT	(DPRT_COMBINE_LANE_COUNT)
+
+/* structures */
+/**
+ * Structure describing the overscan and data (trim) sections of a frame, and how the overscan is combined.
+ * All positions are 0-based, and the end positions are one more than the last column/row in the section.
+ * <dl>
+ * <dt>Enabled</dt> <dd>A boolean, TRUE if overscan subtraction and trimming are switched on.</dd>
+ * <dt>Bias_Start_X</dt> <dd>The first column of the overscan section.</dd>
+ * <dt>Bias_End_X</dt> <dd>One more than the last column of the overscan section. If this equals Bias_Start_X
+ *     there is no overscan section, and the frame is only trimmed.</dd>
+ * <dt>Bias_Start_Y</dt> <dd>The first row of the overscan section.</dd>
+ * <dt>Bias_End_Y</dt> <dd>One more than the last row of the overscan section.</dd>
+ * <dt>Trim_Start_X</dt> <dd>The first column of the data section.</dd>
+ * <dt>Trim_End_X</dt> <dd>One more than the last column of the data section.</dd>
+ * <dt>Trim_Start_Y</dt> <dd>The first row of the data section.</dd>
+ * <dt>Trim_End_Y</dt> <dd>One more than the last row of the data section.</dd>
+ * <dt>Parameters</dt> <dd>How the overscan pixels of each row are combined into the row's level.</dd>
+ * <dt>Scale_List</dt> <dd>A list of ones, one per overscan column, passed to DpRt_Combine_Pixels.</dd>
+ * </dl>
+ */
+struct DpRt_Overscan_Struct
+{
+	int Enabled;
+	int Bias_Start_X;
+	int Bias_End_X;
+	int Bias_Start_Y;
+	int Bias_End_Y;
+	int Trim_Start_X;
+	int Trim_End_X;
+	int Trim_Start_Y;
+	int Trim_End_Y;
+	struct DpRt_Combine_Parameter_Struct Parameters;
+	double Scale_List[DPRT_OVERSCAN_MAX_COLUMNS];
+};
+
+/* function declarations */
+extern int DpRt_Overscan_Get(char *biassec,char *trimsec,int naxis_one,int naxis_two,
+			     struct DpRt_Overscan_Struct *overscan);
+extern int DpRt_Overscan_Parse_Section(char *section,int naxis_one,int naxis_two,int *start_x,int *end_x,
+				       int *start_y,int *end_y);
+extern int DpRt_Overscan_Get_Levels(struct DpRt_Overscan_Struct *overscan,void *data,int encoding,int naxis_one,
+				    int start_y,int row_count,float *bias,float *level_list);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,22 @@
+/* dprt_reduce.h
+** $Header$
+*/
+#ifndef DPRT_REDUCE_H
+#define DPRT_REDUCE_H
+#include "dprt_stats.h"
+#include "dprt_overscan.h"
+#include "dprt_histogram.h"
+
+/* function declarations */
+extern int DpRt_Reduce_Initialise(int band_rows);
+extern int DpRt_Reduce_Get_Band_Rows(void);
+extern int DpRt_Reduce_Stats(void *data,int encoding,int naxis_one,int naxis_two,int saturation_level,
+			     struct DpRt_Stats_Struct *stats);
+extern int DpRt_Reduce_Calibrated_Stats(void *data,int encoding,int naxis_one,int naxis_two,
+					struct DpRt_Overscan_Struct *overscan,float *bias,float *flat,
+					unsigned long long *mask,int saturation_level,struct DpRt_Stats_Struct *stats,
+					struct DpRt_Histogram_Struct *histogram,unsigned long long *row_sum_list);
+#endif
+/*
+** $Log$
+*/
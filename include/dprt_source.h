@@ -0,0 +1,141 @@
+/* dprt_source.h
+** $Header$
+*/
+#ifndef DPRT_SOURCE_H
+#define DPRT_SOURCE_H
+#include "dprt_overscan.h"
+
+/* hash definitions */
+/**
+ * The maximum number of sources found and measured in a frame.
+ */
+#define DPRT_SOURCE_MAX_COUNT		(64)
+/**
+ * The maximum radius, in pixels, of the stamp each source is measured in.
+ */
+#define DPRT_SOURCE_MAX_STAMP_RADIUS	(16)
+/**
+ * The maximum size (width and height) of the box the peak finder sums pixels over.
+ */
+#define DPRT_SOURCE_MAX_BOX_SIZE	(15)
+
+/* structures */
+/**
+ * Structure describing a frame to find sources in, and how it is calibrated on the fly.
+ * <dl>
+ * <dt>Data</dt> <dd>The frame data, in row-major order.</dd>
+ * <dt>Encoding</dt> <dd>How the pixel values are stored in Data (DPRT_STATS_ENCODING_NATIVE/DPRT_STATS_ENCODING_FITS).</dd>
+ * <dt>Naxis_One</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis_Two</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Overscan</dt> <dd>The overscan and data sections of the frame, or NULL. Sources are only looked for in the
+ *     data section, and each row has it's overscan level subtracted.</dd>
+ * <dt>Bias</dt> <dd>The cached master bias of the frame's size, or NULL.</dd>
+ * <dt>Flat</dt> <dd>The cached master flat (reciprocals) of the frame's size, or NULL.</dd>
+ * <dt>Mask</dt> <dd>The cached bad pixel mask bitset of the frame's size, or NULL.</dd>
+ * </dl>
+ */
+struct DpRt_Source_Frame_Struct
+{
+	void *Data;
+	int Encoding;
+	int Naxis_One;
+	int Naxis_Two;
+	struct DpRt_Overscan_Struct *Overscan;
+	float *Bias;
+	float *Flat;
+	unsigned long long *Mask;
+};
+
+/**
+ * Structure holding the parameters of source detection and measurement.
+ * <dl>
+ * <dt>Max_Count</dt> <dd>The number of brightest sources measured, at most DPRT_SOURCE_MAX_COUNT.</dd>
+ * <dt>Detect_Sigma</dt> <dd>A source's peak must be this many sky standard deviations above the sky.</dd>
+ * <dt>Min_Pixels</dt> <dd>At least this many of the 8 pixels around a source's peak must also be above the
+ *     detection threshold, which rejects most cosmic rays and hot pixels.</dd>
+ * <dt>Stamp_Radius</dt> <dd>The radius of the stamp each source is measured in, in pixels, at most
+ *     DPRT_SOURCE_MAX_STAMP_RADIUS. Fainter peaks within this radius of a brighter one are not measured.</dd>
+ * <dt>Min_FWHM</dt> <dd>Sources with a FWHM less than this (in pixels) are rejected as cosmic rays.</dd>
+ * <dt>PSF_FWHM</dt> <dd>The FWHM (in pixels) of the narrowest point spread function the peak finder accepts. It sets the
+ *     size of the box pixels are summed over, and features whose brightest pixel holds more of the box's counts than
+ *     a Gaussian of this FWHM would are rejected as cosmic rays or hot pixels.</dd>
+ * <dt>Saturation_Level</dt> <dd>Sources with a peak greater than or equal to this are saturated.</dd>
+ * </dl>
+ */
+struct DpRt_Source_Parameter_Struct
+{
+	int Max_Count;
+	double Detect_Sigma;
+	int Min_Pixels;
+	int Stamp_Radius;
+	double Min_FWHM;
+	double PSF_FWHM;
+	int Saturation_Level;
+};
+
+/**
+ * Structure describing a source measured in a frame.
+ * <dl>
+ * <dt>Peak_X</dt> <dd>The column of the source's peak pixel.</dd>
+ * <dt>Peak_Y</dt> <dd>The row of the source's peak pixel.</dd>
+ * <dt>X</dt> <dd>The x (column) position of the source's centroid, in pixels.</dd>
+ * <dt>Y</dt> <dd>The y (row) position of the source's centroid, in pixels.</dd>
+ * <dt>Peak</dt> <dd>The (calibrated) value of the peak pixel, including the sky.</dd>
+ * <dt>Flux</dt> <dd>The sky subtracted counts within the stamp radius of the centroid. Whilst sources are being
+ *     found, the sky subtracted counts in the 3x3 pixels around the peak, used to rank them.</dd>
+ * <dt>FWHM</dt> <dd>The full width at half maximum of the source, in pixels.</dd>
+ * <dt>Saturated</dt> <dd>A boolean, TRUE if the peak is saturated (the FWHM is then not reliable).</dd>
+ * </dl>
+ */
+struct DpRt_Source_Struct
+{
+	int Peak_X;
+	int Peak_Y;
+	double X;
+	double Y;
+	double Peak;
+	double Flux;
+	double FWHM;
+	int Saturated;
+};
+
+/**
+ * Structure describing the brightest peak in a frame, found in box summed pixels.
+ * <dl>
+ * <dt>Found</dt> <dd>A boolean, TRUE if a peak was found. The other fields are only valid if it is.</dd>
+ * <dt>Peak_X</dt> <dd>The column of the centre of the brightest box.</dd>
+ * <dt>Peak_Y</dt> <dd>The row of the centre of the brightest box.</dd>
+ * <dt>X</dt> <dd>The x (column) position of the peak's centroid, in pixels.</dd>
+ * <dt>Y</dt> <dd>The y (row) position of the peak's centroid, in pixels.</dd>
+ * <dt>Peak</dt> <dd>The (calibrated) value of the brightest pixel in the box, including the sky.</dd>
+ * <dt>Flux</dt> <dd>The sky subtracted counts in the box.</dd>
+ * <dt>Confidence</dt> <dd>The significance of the peak: Flux divided by the standard deviation of a box sum of sky,
+ *     or zero if the sky standard deviation is not known.</dd>
+ * </dl>
+ */
+struct DpRt_Source_Peak_Struct
+{
+	int Found;
+	int Peak_X;
+	int Peak_Y;
+	double X;
+	double Y;
+	double Peak;
+	double Flux;
+	double Confidence;
+};
+
+/* function declarations */
+extern int DpRt_Source_Get_Parameters(int saturation_level,struct DpRt_Source_Parameter_Struct *parameters);
+extern int DpRt_Source_Find(struct DpRt_Source_Frame_Struct *frame,double sky,double sky_sigma,
+			    struct DpRt_Source_Parameter_Struct *parameters,struct DpRt_Source_Struct *source_list,
+			    int *source_count,struct DpRt_Source_Peak_Struct *peak);
+extern int DpRt_Source_Measure(struct DpRt_Source_Frame_Struct *frame,double sky,
+			       struct DpRt_Source_Parameter_Struct *parameters,struct DpRt_Source_Struct *source);
+extern int DpRt_Source_Get_FWHM(struct DpRt_Source_Struct *source_list,int source_count,double *fwhm);
+extern void DpRt_Source_Get_Section(struct DpRt_Source_Frame_Struct *frame,int *start_x,int *end_x,int *start_y,
+				    int *end_y);
+#endif
+/*
+** $Log$
+*/
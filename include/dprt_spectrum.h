@@ -0,0 +1,120 @@
+/* dprt_spectrum.h
+** $Header$
+*/
+#ifndef DPRT_SPECTRUM_H
+#define DPRT_SPECTRUM_H
+#include <stddef.h>
+#include "dprt_source.h"
+#include "dprt_trace.h"
+#include "dprt_arc.h"
+
+/* hash definitions */
+/**
+ * The largest aperture half width, in rows.
+ */
+#define DPRT_SPECTRUM_MAX_APERTURE	(32)
+/**
+ * The largest width of each sky band, in rows.
+ */
+#define DPRT_SPECTRUM_MAX_SKY_WIDTH	(32)
+/**
+ * The maximum length of the suffix added to a spectrum's filename, including the terminating NULL.
+ */
+#define DPRT_SPECTRUM_SUFFIX_LENGTH	(32)
+/**
+ * The maximum length of a spectrum's filename, including the terminating NULL.
+ */
+#define DPRT_SPECTRUM_FILENAME_LENGTH	(1024)
+/**
+ * Value of a spectrum's Trace_Source: the trace is a constant row, the centroid of the spatial profile, as no
+ * model fitted to it's block centroids was good enough.
+ */
+#define DPRT_SPECTRUM_TRACE_SOURCE_PROFILE	(0)
+/**
+ * Value of a spectrum's Trace_Source: the trace was searched for in the spatial profile, and measured in a wide
+ * window around it.
+ */
+#define DPRT_SPECTRUM_TRACE_SOURCE_SEARCH	(1)
+/**
+ * Value of a spectrum's Trace_Source: the trace was measured in a narrow window around the cached trace of the
+ * previous frame of the same target.
+ */
+#define DPRT_SPECTRUM_TRACE_SOURCE_CACHE	(2)
+
+/* structures */
+/**
+ * Structure holding the parameters of a quick-look spectral extraction. The dispersion axis is along the rows
+ * (NAXIS1), so the trace is at a nearly fixed row.
+ * <dl>
+ * <dt>Aperture</dt> <dd>The half width of the aperture summed across the trace, in rows.</dd>
+ * <dt>Sky_Gap</dt> <dd>The number of rows between the aperture and each sky band.</dd>
+ * <dt>Sky_Width</dt> <dd>The number of rows in each sky band, either side of the aperture.</dd>
+ * <dt>Detect_Sigma</dt> <dd>The trace's peak in the spatial profile must be this many standard deviations
+ *     (estimated from the profile's median absolute deviation) above the profile's median.</dd>
+ * <dt>Suffix</dt> <dd>The suffix added to the output filename (before the extension) to make the spectrum's
+ *     filename.</dd>
+ * <dt>Trace</dt> <dd>The parameters the trace is measured and modelled with.</dd>
+ * </dl>
+ * @see dprt_trace.html#DpRt_Trace_Parameter_Struct
+ */
+struct DpRt_Spectrum_Parameter_Struct
+{
+	int Aperture;
+	int Sky_Gap;
+	int Sky_Width;
+	double Detect_Sigma;
+	char Suffix[DPRT_SPECTRUM_SUFFIX_LENGTH];
+	struct DpRt_Trace_Parameter_Struct Trace;
+};
+
+/**
+ * Structure describing a spectrum extracted from a frame.
+ * <dl>
+ * <dt>Found</dt> <dd>A boolean, TRUE if a trace was found. The other fields are only valid if it is.</dd>
+ * <dt>Trace_Source</dt> <dd>How the trace was found, one of DPRT_SPECTRUM_TRACE_SOURCE_PROFILE,
+ *     DPRT_SPECTRUM_TRACE_SOURCE_SEARCH or DPRT_SPECTRUM_TRACE_SOURCE_CACHE.</dd>
+ * <dt>Trace</dt> <dd>The model of the trace's row at each column.</dd>
+ * <dt>Trace_Y</dt> <dd>The row of the trace at the centre column of the spectrum.</dd>
+ * <dt>Aperture_Start_Y</dt> <dd>The first row of the aperture at the centre column. The aperture follows the
+ *     trace, a block of columns at a time.</dd>
+ * <dt>Aperture_End_Y</dt> <dd>One more than the last row of the aperture at the centre column.</dd>
+ * <dt>Sky_Row_Count</dt> <dd>The fewest sky rows the sky of any block of columns was estimated from, zero if the
+ *     sky was not subtracted from some columns.</dd>
+ * <dt>Start_X</dt> <dd>The column of the first element of the spectrum.</dd>
+ * <dt>Length</dt> <dd>The number of elements (columns) in the spectrum.</dd>
+ * <dt>Flux</dt> <dd>The total sky subtracted counts in the spectrum.</dd>
+ * <dt>Solution</dt> <dd>The dispersion solution giving the wavelength of each frame column, if there is one
+ *     (Valid is TRUE).</dd>
+ * </dl>
+ */
+struct DpRt_Spectrum_Struct
+{
+	int Found;
+	int Trace_Source;
+	struct DpRt_Trace_Struct Trace;
+	double Trace_Y;
+	int Aperture_Start_Y;
+	int Aperture_End_Y;
+	int Sky_Row_Count;
+	int Start_X;
+	int Length;
+	double Flux;
+	struct DpRt_Arc_Solution_Struct Solution;
+};
+
+/* function declarations */
+extern int DpRt_Spectrum_Get_Parameters(struct DpRt_Spectrum_Parameter_Struct *parameters);
+extern int DpRt_Spectrum_Find_Trace(struct DpRt_Source_Frame_Struct *frame,unsigned long long *row_sum_list,
+				    char *key,struct DpRt_Spectrum_Parameter_Struct *parameters,double *profile_list,
+				    struct DpRt_Spectrum_Struct *spectrum);
+extern int DpRt_Spectrum_Extract(struct DpRt_Source_Frame_Struct *frame,
+				 struct DpRt_Spectrum_Parameter_Struct *parameters,struct DpRt_Spectrum_Struct *spectrum,
+				 double *flux_list,double *sky_list);
+extern int DpRt_Spectrum_Get_Filename(char *output_filename,struct DpRt_Spectrum_Parameter_Struct *parameters,
+				      char *spectrum_filename,size_t spectrum_filename_length);
+extern int DpRt_Spectrum_Write(char *spectrum_filename,char *input_filename,struct DpRt_Spectrum_Struct *spectrum,
+			       double *flux_list);
+#endif
+/*
+** $Log$
+*/
@@ -0,0 +1,69 @@
+/* dprt_stats.h
+** $Header$
+*/
+#ifndef DPRT_STATS_H
+#define DPRT_STATS_H
+#include <stddef.h>
+
+/* hash definitions */
+/**
+ * Pixel encoding: unsigned 16-bit integers in host byte order.
+ */
+#define DPRT_STATS_ENCODING_NATIVE	(0)
+/**
+ * Pixel encoding: the raw data unit of a BITPIX=16 FITS image, i.e. big-endian signed 16-bit integers
+ * with a BZERO of 32768 (and a BSCALE of 1).
+ */
+#define DPRT_STATS_ENCODING_FITS	(1)
+/**
+ * The number of pixels held in each word of a bad pixel mask bitset.
+ */
+#define DPRT_STATS_MASK_WORD_BITS	(64)
+/**
+ * Macro giving the number of words in the bad pixel mask bitset of a frame of pixel_count pixels. Pixel i of the
+ * frame (in row-major order) is bad if bit (i%64) of word (i/64) is set. A spare zero word follows the last one, so
+ * 64 bits can be read starting at any pixel without reading past the end.
+ */
+#define DPRT_STATS_MASK_WORD_COUNT(pixel_count)	((((size_t)(pixel_count))+DPRT_STATS_MASK_WORD_BITS-1)/ \
+						 DPRT_STATS_MASK_WORD_BITS+1)
+
+/* structures */
+/**
+ * Structure holding the statistics of a 16-bit frame (or a band of rows of a frame).
+ * <dl>
+ * <dt>Sum</dt> <dd>The exact sum of all pixel values.</dd>
+ * <dt>Pixel_Count</dt> <dd>The number of pixels included in the statistics (bad pixels are not included).</dd>
+ * <dt>Min</dt> <dd>The minimum pixel value.</dd>
+ * <dt>Max</dt> <dd>The maximum pixel value.</dd>
+ * <dt>Max_X</dt> <dd>The x (column) position of the first (in row-major order) pixel with value Max.</dd>
+ * <dt>Max_Y</dt> <dd>The y (row) position of the first (in row-major order) pixel with value Max.</dd>
+ * <dt>Saturated_Count</dt> <dd>The number of pixels with a value greater than or equal to the saturation level.</dd>
+ * </dl>
+ */
+struct DpRt_Stats_Struct
+{
+	unsigned long long Sum;
+	unsigned long long Pixel_Count;
+	unsigned short Min;
+	unsigned short Max;
+	int Max_X;
+	int Max_Y;
+	unsigned long long Saturated_Count;
+};
+
+/* function declarations */
+extern int DpRt_Stats_Initialise(char *kernel_name);
+extern char *DpRt_Stats_Get_Kernel_Name(void);
+extern int DpRt_Stats_Calculate(unsigned short *data,int naxis_one,int naxis_two,int saturation_level,
+				struct DpRt_Stats_Struct *stats);
+extern int DpRt_Stats_Calculate_Rows(void *data,int encoding,int naxis_one,int start_y,int end_y,int saturation_level,
+				     struct DpRt_Stats_Struct *stats);
+extern int DpRt_Stats_Calculate_Rows_Masked(void *data,int encoding,int naxis_one,int start_y,int end_y,
+					    unsigned long long *mask,size_t mask_start,int saturation_level,
+					    struct DpRt_Stats_Struct *stats);
+extern unsigned long long DpRt_Stats_Mask_Get_Bits(unsigned long long *mask,size_t start);
+extern int DpRt_Stats_Merge(struct DpRt_Stats_Struct *total,struct DpRt_Stats_Struct *partial);
+#endif
+/*
+** $Log$
+*/
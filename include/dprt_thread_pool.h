@@ -0,0 +1,27 @@
+/* dprt_thread_pool.h
+** $Header$
+*/
+#ifndef DPRT_THREAD_POOL_H
+#define DPRT_THREAD_POOL_H
+
+/* type definitions */
+/**
+ * Type of a function run by the thread pool, once per task.
+ * @param user_data The user data passed to DpRt_Thread_Pool_Run.
+ * @param task_index The index of the task to run, from 0 to task_count-1.
+ * @param thread_index The index of the thread running the task, from 0 to DpRt_Thread_Pool_Get_Thread_Count()-1.
+ *        No two tasks of the same DpRt_Thread_Pool_Run call run concurrently with the same thread index, so it can
+ *        be used to index per-thread scratch space.
+ * @return The function should return TRUE if the task succeeded, and FALSE if it failed (or was aborted).
+ */
+typedef int (*DpRt_Thread_Pool_Task_Function)(void *user_data,int task_index,int thread_index);
+
+/* function declarations */
+extern int DpRt_Thread_Pool_Initialise(int thread_count);
+extern int DpRt_Thread_Pool_Shutdown(void);
+extern int DpRt_Thread_Pool_Get_Thread_Count(void);
+extern int DpRt_Thread_Pool_Run(int task_count,DpRt_Thread_Pool_Task_Function function,void *user_data);
+#endif
+/*
+** $Log$
+*/
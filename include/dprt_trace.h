@@ -0,0 +1,95 @@
+/* dprt_trace.h
+** $Header$
+*/
+#ifndef DPRT_TRACE_H
+#define DPRT_TRACE_H
+#include "dprt_source.h"
+
+/* hash definitions */
+/**
+ * The highest order of the polynomial fitted to a trace.
+ */
+#define DPRT_TRACE_MAX_ORDER		(2)
+/**
+ * The maximum number of column blocks a trace's centroid is measured in.
+ */
+#define DPRT_TRACE_MAX_BLOCK_COUNT	(32)
+/**
+ * The largest half width, in rows, of the window a trace's centroid is measured in.
+ */
+#define DPRT_TRACE_MAX_WINDOW		(32)
+/**
+ * The maximum length of a trace cache key, including the terminating NULL.
+ */
+#define DPRT_TRACE_KEY_LENGTH		(128)
+/**
+ * The maximum number of trace models held in the cache at once. When a new key takes the cache over this number,
+ * the least recently used model is thrown away.
+ */
+#define DPRT_TRACE_CACHE_COUNT		(8)
+
+/* structures */
+/**
+ * Structure holding the parameters of trace measurement.
+ * <dl>
+ * <dt>Block_Count</dt> <dd>The number of blocks of columns the data section is divided into, a centroid being
+ *     measured in each, at most DPRT_TRACE_MAX_BLOCK_COUNT.</dd>
+ * <dt>Order</dt> <dd>The order of the polynomial fitted to the block centroids, at most DPRT_TRACE_MAX_ORDER.</dd>
+ * <dt>Window</dt> <dd>The half width, in rows, of the window around a cached model's predicted position that
+ *     each block's centroid is measured in.</dd>
+ * <dt>Search_Window</dt> <dd>The half width, in rows, of the window around the spatial profile's trace that each
+ *     block's centroid is measured in when there is no usable cached model.</dd>
+ * <dt>Max_Residual</dt> <dd>A fitted model is only used (and cached) if the rms residual of the block centroids
+ *     about it, in rows, is no more than this.</dd>
+ * </dl>
+ */
+struct DpRt_Trace_Parameter_Struct
+{
+	int Block_Count;
+	int Order;
+	int Window;
+	int Search_Window;
+	double Max_Residual;
+};
+
+/**
+ * Structure holding a model of the trace of a spectrum, the row of the trace as a polynomial of the column:
+ * row = sum over i of Coefficient_List[i]*u^i, where u = (column-Centre_X)/Scale_X.
+ * <dl>
+ * <dt>Valid</dt> <dd>A boolean, TRUE if the model has been fitted. The other fields are only valid if it is.</dd>
+ * <dt>Order</dt> <dd>The order of the polynomial.</dd>
+ * <dt>Coefficient_List</dt> <dd>The polynomial's coefficients, lowest order first.</dd>
+ * <dt>Centre_X</dt> <dd>The column the polynomial is centred on.</dd>
+ * <dt>Scale_X</dt> <dd>The number of columns the polynomial's variable is scaled by.</dd>
+ * <dt>Residual</dt> <dd>The rms residual, in rows, of the block centroids used about the polynomial.</dd>
+ * <dt>Block_Count</dt> <dd>The number of column blocks a centroid was measured in.</dd>
+ * <dt>Used_Block_Count</dt> <dd>The number of block centroids the polynomial was fitted to, the rest had no
+ *     trace in their window or were rejected as outliers.</dd>
+ * </dl>
+ */
+struct DpRt_Trace_Struct
+{
+	int Valid;
+	int Order;
+	double Coefficient_List[DPRT_TRACE_MAX_ORDER+1];
+	double Centre_X;
+	double Scale_X;
+	double Residual;
+	int Block_Count;
+	int Used_Block_Count;
+};
+
+/* function declarations */
+extern int DpRt_Trace_Get_Parameters(struct DpRt_Trace_Parameter_Struct *parameters);
+extern double DpRt_Trace_Evaluate(struct DpRt_Trace_Struct *trace,double x);
+extern void DpRt_Trace_Get_Block(int start_x,int width,int block_count,int block,int *block_start_x,
+				 int *block_end_x);
+extern int DpRt_Trace_Refine(struct DpRt_Source_Frame_Struct *frame,struct DpRt_Trace_Parameter_Struct *parameters,
+			     struct DpRt_Trace_Struct *predicted_trace,int window,struct DpRt_Trace_Struct *trace);
+extern int DpRt_Trace_Cache_Get(char *key,struct DpRt_Trace_Struct *trace);
+extern int DpRt_Trace_Cache_Put(char *key,struct DpRt_Trace_Struct *trace);
+extern int DpRt_Trace_Shutdown(void);
+#endif
+/*
+** $Log$
+*/
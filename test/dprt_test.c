@@ -5,13 +5,14 @@
  * dprt_test.c Tests libdprt_sprat, the Data Pipeline Real Time
  * reduction library. Note you cannot check Aborting reductions with this software at the moment.
  * <pre>
- * dprt_test [-b][-c][-e][-f][-help] <filename>
+ * dprt_test [-b][-c][-e][-f][-batch][-help] <filename> [<filename> ...]
  * </pre>
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/time.h>
 #include "dprt.h"
 #include "dprt_jni_general.h"
 #include "object.h"
@@ -42,6 +43,7 @@
 /* ------------------------------------------------------- */
 static void Help(void);
 static int Parse_Args(int argc,char *argv[]);
+static int Reduce_Batch(void);
 
 /* ------------------------------------------------------- */
 /* internal variables */
@@ -58,6 +60,18 @@ static char Filename[256] = "";
  * The type of reduction to perform on the file.
  */
 static int Reduce_Type = REDUCE_TYPE_EXPOSE;
+/**
+ * Boolean, if TRUE all the filenames on the command line are reduced as one batch.
+ */
+static int Batch = FALSE;
+/**
+ * The list of filenames specified on the command line, used in batch mode.
+ */
+static char **Batch_Filename_List = NULL;
+/**
+ * The number of filenames in Batch_Filename_List.
+ */
+static int Batch_Filename_Count = 0;
 
 /* ------------------------------------------------------- */
 /* external functions */
@@ -103,7 +117,12 @@ int main(int argc, char *argv[])
 	Object_Set_Log_Handler_Function(Object_Log_Handler_Stdout);
 	Object_Set_Log_Filter_Function(Object_Log_Filter_Level_Absolute);
 	Object_Set_Log_Filter_Level(LOG_VERBOSITY_VERY_VERBOSE);
-	if(Reduce_Type == REDUCE_TYPE_MAKE_MASTER_BIAS)
+	if(Batch)
+	{
+		if(!Reduce_Batch())
+			return 1;
+	}
+	else if(Reduce_Type == REDUCE_TYPE_MAKE_MASTER_BIAS)
 	{
 		fprintf(stdout,"Creating master bias frame from directory '%s'.\n",Filename);
 		if(DpRt_Make_Master_Bias(Filename))
@@ -200,10 +219,19 @@ static int Parse_Args(int argc,char *argv[])
 	int call_help = FALSE;
 
 	strcpy(Filename,"");
+	Batch_Filename_List = (char **)malloc(argc*sizeof(char *));
+	if(Batch_Filename_List == NULL)
+	{
+		fprintf(stderr,"dprt_test: Failed to allocate filename list.\n");
+		return FALSE;
+	}
+	Batch_Filename_Count = 0;
 	for(i=1;i<argc;i++)
 	{
 		if(strcmp(argv[i],"-help")==0)
 			call_help = TRUE;
+		else if(strcmp(argv[i],"-batch")==0)
+			Batch = TRUE;
 		else if(strcmp(argv[i],"-b")==0)
 			Reduce_Type = REDUCE_TYPE_MAKE_MASTER_BIAS;
 		else if(strcmp(argv[i],"-c")==0)
@@ -213,7 +241,10 @@ static int Parse_Args(int argc,char *argv[])
 		else if(strcmp(argv[i],"-f")==0)
 			Reduce_Type = REDUCE_TYPE_MAKE_MASTER_FLAT;
 		else
+		{
 			strcpy(Filename,argv[i]);
+			Batch_Filename_List[Batch_Filename_Count++] = argv[i];
+		}
 	}
 	if(call_help)
 	{
@@ -223,6 +254,109 @@ static int Parse_Args(int argc,char *argv[])
 	return TRUE;
 }
 
+/**
+ * Routine to reduce all the filenames specified on the command line as one batch, using
+ * DpRt_Calibrate_Reduce_Batch or DpRt_Expose_Reduce_Batch depending on Reduce_Type. The result of each frame,
+ * and the elapsed time of the batch, are printed.
+ * @return Returns TRUE if the batch was run, FALSE if it could not be (individual frames may still have failed).
+ * @see #Batch_Filename_List
+ * @see #Batch_Filename_Count
+ * @see #Reduce_Type
+ */
+static int Reduce_Batch(void)
+{
+	struct DpRt_Calibrate_Reduce_Result_Struct *calibrate_result_list = NULL;
+	struct DpRt_Expose_Reduce_Result_Struct *expose_result_list = NULL;
+	struct timeval start_time,end_time;
+	char error_string[DPRT_ERROR_STRING_LENGTH];
+	int i,retval;
+
+	if((Reduce_Type != REDUCE_TYPE_EXPOSE)&&(Reduce_Type != REDUCE_TYPE_CALIBRATION))
+	{
+		fprintf(stderr,"dprt_test: Batch mode only supports calibration (-c) or expose (-e) reductions.\n");
+		return FALSE;
+	}
+	fprintf(stdout,"Reducing %d files as a batch of %s.\n",Batch_Filename_Count,
+		(Reduce_Type == REDUCE_TYPE_EXPOSE) ? "exposures" : "calibrations");
+	gettimeofday(&start_time,NULL);
+	if(Reduce_Type == REDUCE_TYPE_EXPOSE)
+	{
+		expose_result_list = (struct DpRt_Expose_Reduce_Result_Struct *)malloc(Batch_Filename_Count*
+								sizeof(struct DpRt_Expose_Reduce_Result_Struct));
+		if(expose_result_list == NULL)
+		{
+			fprintf(stderr,"dprt_test: Failed to allocate result list.\n");
+			return FALSE;
+		}
+		retval = DpRt_Expose_Reduce_Batch(Batch_Filename_List,Batch_Filename_Count,expose_result_list);
+	}
+	else
+	{
+		calibrate_result_list = (struct DpRt_Calibrate_Reduce_Result_Struct *)malloc(Batch_Filename_Count*
+								sizeof(struct DpRt_Calibrate_Reduce_Result_Struct));
+		if(calibrate_result_list == NULL)
+		{
+			fprintf(stderr,"dprt_test: Failed to allocate result list.\n");
+			return FALSE;
+		}
+		retval = DpRt_Calibrate_Reduce_Batch(Batch_Filename_List,Batch_Filename_Count,calibrate_result_list);
+	}
+	gettimeofday(&end_time,NULL);
+	if(retval == FALSE)
+	{
+		DpRt_JNI_Get_Error_String(error_string);
+		fprintf(stderr,"Batch reduction had failures:(%d) %s.\n",DpRt_JNI_Get_Error_Number(),error_string);
+	}
+	for(i=0;i<Batch_Filename_Count;i++)
+	{
+		if(Reduce_Type == REDUCE_TYPE_EXPOSE)
+		{
+			if(expose_result_list[i].Successful)
+			{
+				fprintf(stdout,"%s:output_filename:%s"
+					"\n\tseeing:%.2f,counts:%.2f,x_pix:%.2f,y_pix:%.2f"
+					"\n\tphotometricity:%.2f,sky brightness:%.2f,saturated:%d\n",
+					Batch_Filename_List[i],expose_result_list[i].Output_Filename,
+					expose_result_list[i].Seeing,expose_result_list[i].Counts,
+					expose_result_list[i].X_Pix,expose_result_list[i].Y_Pix,
+					expose_result_list[i].Photometricity,expose_result_list[i].Sky_Brightness,
+					expose_result_list[i].Saturated);
+			}
+			else
+			{
+				fprintf(stderr,"%s:failed:(%d) %s.\n",Batch_Filename_List[i],
+					expose_result_list[i].Error_Number,expose_result_list[i].Error_String);
+			}
+			if(expose_result_list[i].Output_Filename != NULL)
+				free(expose_result_list[i].Output_Filename);
+		}
+		else
+		{
+			if(calibrate_result_list[i].Successful)
+			{
+				fprintf(stdout,"%s:output_filename:%s"
+					"\n\tmean counts:%.2f,peak counts:%.2f\n",
+					Batch_Filename_List[i],calibrate_result_list[i].Output_Filename,
+					calibrate_result_list[i].Mean_Counts,calibrate_result_list[i].Peak_Counts);
+			}
+			else
+			{
+				fprintf(stderr,"%s:failed:(%d) %s.\n",Batch_Filename_List[i],
+					calibrate_result_list[i].Error_Number,calibrate_result_list[i].Error_String);
+			}
+			if(calibrate_result_list[i].Output_Filename != NULL)
+				free(calibrate_result_list[i].Output_Filename);
+		}
+	}
+	fprintf(stdout,"Batch of %d files took %.3f seconds.\n",Batch_Filename_Count,
+		((double)(end_time.tv_sec-start_time.tv_sec))+(((double)(end_time.tv_usec-start_time.tv_usec))/1000000.0));
+	if(expose_result_list != NULL)
+		free(expose_result_list);
+	if(calibrate_result_list != NULL)
+		free(calibrate_result_list);
+	return TRUE;
+}
+
 /**
  * Routine to produce some help.
  */
@@ -230,11 +364,12 @@ static void Help(void)
 {
 	fprintf(stdout,"dprt_test Tests the reduction routines in libdprt.\n");
 	fprintf(stdout,"dprt_test does NOT test the Java JNI interface or aborting reductions.\n");
-	fprintf(stdout,"dprt_test [-b] [-c] [-e] [-f] [-help] <filename>\n");
+	fprintf(stdout,"dprt_test [-b] [-c] [-e] [-f] [-batch] [-help] <filename> [<filename> ...]\n");
 	fprintf(stdout,"-b creates a master bias frame from biases in the directory specified in filename.\n");
 	fprintf(stdout,"-c reduces the filename as a calibration image.\n");
 	fprintf(stdout,"-e reduces the filename as a expose image.\n");
 	fprintf(stdout,"-f creates a master flat frame from fields in the directory specified in filename.\n");
+	fprintf(stdout,"-batch reduces all the filenames as one batch, as calibration (-c) or expose (-e) images.\n");
 	fprintf(stdout,"-help prints this help message and exits.\n");
 	fprintf(stdout,"You must always specify a filename to reduce.\n");
 }